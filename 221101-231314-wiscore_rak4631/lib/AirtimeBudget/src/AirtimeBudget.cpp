@@ -0,0 +1,146 @@
+#include "AirtimeBudget.h"
+
+#include <string.h>
+
+bool au915Modulation(uint8_t data_rate, loraModulation *modulation) {
+    if (data_rate <= 5) {
+        // DR0 - DR5: SF12 - SF7 at 125 kHz
+        *modulation = { (uint8_t)(12 - data_rate), 125 };
+        return true;
+    }
+    if (data_rate == 6) {
+        *modulation = { 8, 500 };
+        return true;
+    }
+    return false;
+}
+
+uint32_t loraTimeOnAirUs(const loraModulation *modulation, uint8_t phy_length) {
+    int32_t sf = modulation->spreading_factor;
+    uint32_t symbol_us = ((uint32_t)1 << sf) * 1000 / modulation->bandwidth_khz;
+    int32_t low_data_rate = (symbol_us >= 16000) ? 1 : 0;
+
+    // payload symbols = 8 + max(ceil((8PL - 4SF + 28 + 16CRC - 20IH) / (4(SF - 2DE))) * (CR + 4), 0)
+    int32_t numerator = 8 * (int32_t)phy_length - 4 * sf + 28 + 16;
+    int32_t denominator = 4 * (sf - 2 * low_data_rate);
+    int32_t blocks = (numerator > 0) ? (numerator + denominator - 1) / denominator : 0;
+    uint32_t payload_symbols = 8 + blocks * 5;
+
+    // preamble is LORA_PREAMBLE_SYMBOLS + 4.25 symbols, so work in quarter symbols
+    uint32_t quarter_symbols = (LORA_PREAMBLE_SYMBOLS * 4) + 17 + (payload_symbols * 4);
+    return (quarter_symbols * symbol_us) / 4;
+}
+
+uint32_t lorawanTimeOnAirUs(uint8_t data_rate, uint8_t payload_length) {
+    loraModulation modulation;
+    if (!au915Modulation(data_rate, &modulation)) {
+        return UINT32_MAX;
+    }
+    return loraTimeOnAirUs(&modulation, payload_length + LORAWAN_FRAME_OVERHEAD);
+}
+
+uint8_t lorawanMaxPayloadForAirtime(uint8_t data_rate, uint32_t max_airtime_us) {
+    if (lorawanTimeOnAirUs(data_rate, 0) > max_airtime_us) {
+        return 0;
+    }
+    // time on air only grows with length, so binary search for the longest that fits
+    uint16_t low = 0;
+    uint16_t high = 255 - LORAWAN_FRAME_OVERHEAD;
+    while (low < high) {
+        uint16_t mid = (low + high + 1) / 2;
+        if (lorawanTimeOnAirUs(data_rate, mid) <= max_airtime_us) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+airtimeLedger::airtimeLedger(uint32_t budget_ms, uint32_t dwell_ms) {
+    budget_us = budget_ms * 1000;
+    dwell_us = (dwell_ms == 0) ? UINT32_MAX : dwell_ms * 1000;
+}
+
+void airtimeLedger::advance(uint32_t now_ms) {
+    // unsigned subtraction so millis() wrapping is fine
+    into_hour_ms += now_ms - last_ms;
+    last_ms = now_ms;
+    uint8_t hours = 0;
+    while ((into_hour_ms >= AIRTIME_HOUR_MS) && (hours < AIRTIME_HOURS)) {
+        into_hour_ms -= AIRTIME_HOUR_MS;
+        current = (current + 1) % AIRTIME_HOURS;
+        hours_us[current] = 0;
+        hours++;
+    }
+    // more than a day has passed, everything has already been cleared
+    into_hour_ms %= AIRTIME_HOUR_MS;
+}
+
+uint32_t airtimeLedger::usedMs(uint32_t now_ms) {
+    advance(now_ms);
+    uint32_t used_us = 0;
+    for (uint8_t h = 0; h < AIRTIME_HOURS; h++) {
+        used_us += hours_us[h];
+    }
+    return used_us / 1000;
+}
+
+AIRTIME_DECISION airtimeLedger::check(uint32_t now_ms, uint8_t data_rate, uint8_t payload_length) {
+    uint32_t airtime_us = lorawanTimeOnAirUs(data_rate, payload_length);
+    if (airtime_us > dwell_us) {
+        too_long++;
+        return AIRTIME_DECISION::TOO_LONG;
+    }
+    if (((uint64_t)usedMs(now_ms) * 1000 + airtime_us) > budget_us) {
+        deferred++;
+        return AIRTIME_DECISION::DEFER;
+    }
+    return AIRTIME_DECISION::ADMIT;
+}
+
+void airtimeLedger::record(uint32_t now_ms, uint32_t airtime_us) {
+    advance(now_ms);
+    hours_us[current] += airtime_us;
+    last_frame_us = airtime_us;
+}
+
+uint8_t airtimeLedger::maxPayload(uint32_t now_ms, uint8_t data_rate) {
+    uint32_t used_us = usedMs(now_ms) * 1000;
+    uint32_t left_us = (used_us < budget_us) ? budget_us - used_us : 0;
+    return lorawanMaxPayloadForAirtime(data_rate, (left_us < dwell_us) ? left_us : dwell_us);
+}
+
+uint8_t airtimeLedger::dwellPayload(uint8_t data_rate) const {
+    return lorawanMaxPayloadForAirtime(data_rate, dwell_us);
+}
+
+void airtimeLedger::status(uint32_t now_ms, airtimeStatus *status) {
+    status->used_ms = usedMs(now_ms);
+    status->budget_ms = budget_us / 1000;
+    status->last_frame_us = last_frame_us;
+    status->deferred = deferred;
+    status->too_long = too_long;
+}
+
+void airtimeLedger::save(airtimeLedgerState *state, uint32_t now_ms) {
+    advance(now_ms);
+    memcpy(state->hours_us, hours_us, sizeof(hours_us));
+    state->into_hour_ms = into_hour_ms;
+    state->last_frame_us = last_frame_us;
+    state->deferred = deferred;
+    state->too_long = too_long;
+    state->current = current;
+}
+
+void airtimeLedger::resume(const airtimeLedgerState *state, uint32_t asleep_ms, uint32_t now_ms) {
+    memcpy(hours_us, state->hours_us, sizeof(hours_us));
+    into_hour_ms = state->into_hour_ms;
+    last_frame_us = state->last_frame_us;
+    deferred = state->deferred;
+    too_long = state->too_long;
+    current = state->current % AIRTIME_HOURS;
+    // the counter restarted at 0 on reset, so the save was asleep_ms before that
+    last_ms = 0 - asleep_ms;
+    advance(now_ms);
+}
@@ -0,0 +1,158 @@
+#pragma once
+/**
+ * @file AirtimeBudget.h
+ * @brief LoRa time-on-air calculator and a rolling 24 h airtime ledger, used to keep uplinks within the network's
+ * fair-use airtime and the region's dwell time limit.
+ *
+ * The ledger keeps the airtime used in each of the last 24 hours, so "the last 24 h" slides an hour at a time. Before a
+ * frame is sent, check() says whether it can be sent now (ADMIT), has to wait for budget to free up (DEFER) or is too
+ * long for the dwell time at the current data rate (TOO_LONG). The ledger doesn't shrink frames: a TOO_LONG frame has to
+ * be re-encoded or split by the caller to dwellPayload() bytes, or held until the data rate goes up.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#define LORAWAN_FRAME_OVERHEAD 13  /**< MHDR (1) + FHDR without FOpts (7) + FPort (1) + MIC (4) bytes. */
+#define LORA_PREAMBLE_SYMBOLS  8   /**< LoRaWAN preamble length. */
+#define AIRTIME_HOURS          24  /**< Length of the rolling window in hours. */
+#define AIRTIME_HOUR_MS        (60UL * 60 * 1000)
+
+/** @brief Spreading factor and bandwidth of a data rate. */
+struct loraModulation {
+    uint8_t spreading_factor; /**< 7 - 12. */
+    uint16_t bandwidth_khz;   /**< 125 or 500. */
+};
+
+/**
+ * @brief Modulation of an AU915 uplink data rate.
+ * @param data_rate DR0 - DR6.
+ * @param modulation Filled with the modulation.
+ * @return True if data_rate is a valid AU915 uplink data rate.
+ */
+bool au915Modulation(uint8_t data_rate, loraModulation *modulation);
+
+/**
+ * @brief Time on air of a LoRa packet (explicit header, CRC on, coding rate 4/5, low data rate optimisation when the
+ * symbol time is 16 ms or more), from the formula in the SX126x datasheet.
+ * @param modulation Spreading factor and bandwidth.
+ * @param phy_length PHY payload length in bytes.
+ * @return Time on air in µs.
+ */
+uint32_t loraTimeOnAirUs(const loraModulation *modulation, uint8_t phy_length);
+
+/**
+ * @brief Time on air of an AU915 LoRaWAN uplink with the given application payload length.
+ * @return Time on air in µs, or UINT32_MAX if the data rate is invalid.
+ */
+uint32_t lorawanTimeOnAirUs(uint8_t data_rate, uint8_t payload_length);
+
+/**
+ * @brief Longest application payload that can be sent at a data rate within max_airtime_us.
+ * @return The length in bytes (0 if not even an empty payload fits).
+ */
+uint8_t lorawanMaxPayloadForAirtime(uint8_t data_rate, uint32_t max_airtime_us);
+
+/** @brief What to do with a frame. */
+enum class AIRTIME_DECISION : uint8_t {
+    ADMIT,    /**< Send it now. */
+    DEFER,    /**< Over the 24 h budget; queue it and try again later. */
+    TOO_LONG, /**< Longer than the dwell time at this data rate; never sent as it is, see dwellPayload(). */
+};
+
+/** @brief Ledger state for telemetry. */
+struct airtimeStatus {
+    uint32_t used_ms;        /**< Airtime used in the last 24 h. */
+    uint32_t budget_ms;      /**< Airtime allowed per 24 h. */
+    uint32_t last_frame_us;  /**< Time on air of the last frame sent. */
+    uint32_t deferred;       /**< Frames deferred because the budget was used up. */
+    uint32_t too_long;       /**< Frames rejected for being longer than the dwell time. */
+};
+
+/** @brief The ledger, so it can carry on after a reset (see DeepSleep.h). */
+struct airtimeLedgerState {
+    uint32_t hours_us[AIRTIME_HOURS];
+    uint32_t into_hour_ms;
+    uint32_t last_frame_us;
+    uint32_t deferred;
+    uint32_t too_long;
+    uint8_t current;
+};
+
+/**
+ * @brief Rolling 24 h ledger of airtime used.
+ */
+class airtimeLedger {
+  public:
+    /**
+     * @brief Construct a new airtime ledger.
+     * @param budget_ms Airtime allowed in any 24 h window.
+     * @param dwell_ms Longest single transmission allowed (0 = no limit).
+     */
+    airtimeLedger(uint32_t budget_ms, uint32_t dwell_ms);
+
+    /**
+     * @brief Checks a frame against the dwell time and the budget. Counts deferred & too long frames.
+     * @param now_ms Current time in ms (e.g. millis(), may wrap).
+     * @param data_rate Data rate the frame will be sent at.
+     * @param payload_length Application payload length.
+     */
+    AIRTIME_DECISION check(uint32_t now_ms, uint8_t data_rate, uint8_t payload_length);
+
+    /**
+     * @brief Records a frame that was sent.
+     * @param now_ms Current time in ms.
+     * @param airtime_us Time on air of the frame.
+     */
+    void record(uint32_t now_ms, uint32_t airtime_us);
+
+    /**
+     * @brief Longest application payload that would be admitted right now at a data rate.
+     */
+    uint8_t maxPayload(uint32_t now_ms, uint8_t data_rate);
+
+    /**
+     * @brief Longest application payload the dwell time allows at a data rate, however much budget is left.
+     */
+    uint8_t dwellPayload(uint8_t data_rate) const;
+
+    /**
+     * @brief Airtime used in the last 24 h, in ms.
+     */
+    uint32_t usedMs(uint32_t now_ms);
+
+    /**
+     * @brief Fills status with the ledger state for telemetry.
+     */
+    void status(uint32_t now_ms, airtimeStatus *status);
+
+    /**
+     * @brief Saves the airtime used, so it can be resumed after a reset. The budget & dwell time aren't included.
+     */
+    void save(airtimeLedgerState *state, uint32_t now_ms);
+
+    /**
+     * @brief Carries on from a saved ledger after a reset, with the hours that passed in between.
+     * @param state From save().
+     * @param asleep_ms Time from save() until the reset.
+     * @param now_ms Current time in ms, counted from the reset.
+     */
+    void resume(const airtimeLedgerState *state, uint32_t asleep_ms, uint32_t now_ms);
+
+  private:
+    void advance(uint32_t now_ms);
+
+    uint32_t budget_us;
+    uint32_t dwell_us;
+    uint32_t hours_us[AIRTIME_HOURS] = {}; // airtime used in each hour, hours_us[current] is this hour
+    uint8_t current = 0;
+    uint32_t last_ms = 0;        // time of the last advance()
+    uint32_t into_hour_ms = 0;   // time since the current hour started
+    uint32_t last_frame_us = 0;
+    uint32_t deferred = 0;
+    uint32_t too_long = 0;
+};
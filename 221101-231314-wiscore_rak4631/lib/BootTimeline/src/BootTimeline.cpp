@@ -0,0 +1,60 @@
+#include "BootTimeline.h"
+
+static const char *const PHASE_NAMES[(uint8_t)BOOT_PHASE::COUNT] = {
+    "logging", "flash log", "config", "radio", "join started", "storage", "ready", "sensors", "joined", "first reading",
+};
+
+const char *bootPhaseName(BOOT_PHASE phase) {
+    return (phase < BOOT_PHASE::COUNT) ? PHASE_NAMES[(uint8_t)phase] : "?";
+}
+
+void bootTimeline::start(bool resumed, uint32_t reset_reason) {
+    was_resumed = resumed;
+    this->reset_reason = reset_reason;
+    marked_mask = 0;
+    for (uint8_t i = 0; i < (uint8_t)BOOT_PHASE::COUNT; i++) {
+        marks_ms[i] = 0;
+    }
+}
+
+bool bootTimeline::mark(BOOT_PHASE phase, uint32_t now_ms) {
+    if ((phase >= BOOT_PHASE::COUNT) || marked(phase)) {
+        return false;
+    }
+    marks_ms[(uint8_t)phase] = now_ms;
+    marked_mask |= 1u << (uint8_t)phase;
+    return true;
+}
+
+bool bootTimeline::marked(BOOT_PHASE phase) const {
+    return (phase < BOOT_PHASE::COUNT) && ((marked_mask & (1u << (uint8_t)phase)) != 0);
+}
+
+uint32_t bootTimeline::at(BOOT_PHASE phase) const { return marked(phase) ? marks_ms[(uint8_t)phase] : 0; }
+
+uint8_t bootTimeline::encode(uint8_t *buffer, uint8_t max_length) const {
+    if (max_length < BOOT_TIMELINE_HEADER) {
+        return 0;
+    }
+    uint8_t pos = 0;
+    buffer[pos++] = BOOT_TIMELINE_VERSION;
+    buffer[pos++] = was_resumed ? BOOT_TIMELINE_RESUMED : 0;
+    buffer[pos++] = (uint8_t)(reset_reason >> 24);
+    buffer[pos++] = (uint8_t)(reset_reason >> 16);
+    buffer[pos++] = (uint8_t)(reset_reason >> 8);
+    buffer[pos++] = (uint8_t)reset_reason;
+    for (uint8_t i = 0; i < (uint8_t)BOOT_PHASE::COUNT; i++) {
+        if (!marked((BOOT_PHASE)i)) {
+            continue;
+        }
+        if ((pos + BOOT_TIMELINE_ITEM) > max_length) {
+            break;
+        }
+        uint32_t ticks = marks_ms[i] / BOOT_TIMELINE_TICK_MS;
+        ticks = (ticks > 0xFFFF) ? 0xFFFF : ticks;
+        buffer[pos++] = i;
+        buffer[pos++] = (uint8_t)(ticks >> 8);
+        buffer[pos++] = (uint8_t)ticks;
+    }
+    return pos;
+}
@@ -0,0 +1,95 @@
+#pragma once
+/**
+ * @file BootTimeline.h
+ * @brief When each phase of a boot finished, in ms since reset, and the boot report they're sent up in.
+ *
+ * Only the first time a phase is marked counts, so a phase that's retried (e.g. the sensors) is timed to when it first
+ * worked. The report is [version][flags][reset reason (4 bytes)] then [phase][time (2 bytes)] for each phase marked so
+ * far, in phase order. Times are in BOOT_TIMELINE_TICK_MS and saturate at 0xFFFF. Everything is MSB first.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#define BOOT_REPORT_PORT       206  /**< Port for the boot report (200-222 are system ports). */
+#define BOOT_TIMELINE_VERSION  1    /**< Version of the report format. */
+#define BOOT_TIMELINE_HEADER   6    /**< [version][flags][reset reason (4 bytes)]. */
+#define BOOT_TIMELINE_ITEM     3    /**< [phase][time (2 bytes)]. */
+#define BOOT_TIMELINE_TICK_MS  10   /**< Time unit in the report: 10 ms, up to about 11 minutes. */
+#define BOOT_TIMELINE_RESUMED  0x01 /**< Report flag: the boot woke from deep sleep with its state. */
+
+/** @brief Phases of a boot, in the order setup() and the tasks finish them. */
+enum class BOOT_PHASE : uint8_t {
+    LOGGING = 0,   /**< Logging started (Serial isn't waited for). */
+    FLASH_LOG,     /**< Stored log found, records are kept on flash. */
+    CONFIG,        /**< Device config loaded, clock & detector resumed. */
+    RADIO,         /**< LoRaWAN stack initialised. */
+    JOIN_STARTED,  /**< Join request sent, or the saved session restored. */
+    STORAGE,       /**< Outbox & history loaded. */
+    READY,         /**< End of setup(), the tasks are running. */
+    SENSORS,       /**< Sensors initialised, by the acquisition task. */
+    JOINED,        /**< Join accepted (or the session restored). */
+    FIRST_READING, /**< First reading after the boot sent or queued. */
+    COUNT          /**< Number of phases, not a phase. */
+};
+
+#define BOOT_TIMELINE_MAX_LENGTH (BOOT_TIMELINE_HEADER + BOOT_TIMELINE_ITEM * (uint8_t)BOOT_PHASE::COUNT)
+
+/**
+ * @brief Name of a phase, for the logs.
+ */
+const char *bootPhaseName(BOOT_PHASE phase);
+
+/**
+ * @brief The time each phase of a boot finished. Each phase is marked by one task only, so marks from different tasks
+ * don't need a lock.
+ */
+class bootTimeline {
+  public:
+    /**
+     * @brief Forgets the marks and sets what's in the report header.
+     * @param resumed The boot woke from deep sleep with its state.
+     * @param reset_reason Why the device reset, e.g. readResetReason() (the nRF52 RESETREAS register).
+     */
+    void start(bool resumed, uint32_t reset_reason);
+
+    /**
+     * @brief Marks a phase as finished, unless it already was.
+     * @param now_ms Time since reset, e.g. millis().
+     * @return True if this was the first mark.
+     */
+    bool mark(BOOT_PHASE phase, uint32_t now_ms);
+
+    /**
+     * @brief True if the phase has been marked.
+     */
+    bool marked(BOOT_PHASE phase) const;
+
+    /**
+     * @brief When the phase was marked, 0 if it wasn't.
+     */
+    uint32_t at(BOOT_PHASE phase) const;
+
+    /**
+     * @brief True if this boot woke from deep sleep.
+     */
+    inline bool resumed(void) const { return was_resumed; };
+
+    /**
+     * @brief Encodes the report, see the file comment.
+     * @param buffer Buffer to encode into.
+     * @param max_length Max length of the report. Phases that don't fit are left out.
+     * @return Length of the report, 0 if not even the header fits.
+     */
+    uint8_t encode(uint8_t *buffer, uint8_t max_length) const;
+
+  private:
+    bool was_resumed = false;
+    uint32_t reset_reason = 0;
+    uint16_t marked_mask = 0; // bit per phase
+    uint32_t marks_ms[(uint8_t)BOOT_PHASE::COUNT] = {};
+};
@@ -0,0 +1,97 @@
+#include "DeepSleep.h"
+
+#include <LoRaWan-RAK4630.h> // Click to get library: https://platformio.org/lib/show/6601/SX126x-Arduino
+#include <nrf_soc.h>
+
+#define RAM_BLOCK_BASE     0x20000000UL // RAM0-7 are 8 kB blocks of two 4 kB sections
+#define RAM_BLOCK_SIZE     0x2000UL
+#define RAM_SECTION_SIZE   0x1000UL
+#define RAM8_BASE          0x20010000UL // RAM8 has six 32 kB sections
+#define RAM8_SECTION_SIZE  0x8000UL
+
+// not cleared by the C runtime, so it survives System OFF when its RAM section is retained
+static retainedBlock retained_block __attribute__((section(".noinit")));
+
+static deepSleepWakeTimer wake_timer = nullptr;
+static uint32_t wake_pin = 0;
+static uint8_t wake_level = LOW;
+
+/** @brief RAM retained as well as retained_block, see retainInDeepSleep(). */
+struct retainedRegion {
+    uintptr_t address;
+    uint32_t length;
+};
+static retainedRegion retained_regions[DEEP_SLEEP_RETAINED_REGIONS] = {};
+static uint8_t retained_region_count = 0;
+
+/**
+ * @brief Keeps the RAM section holding address powered & retained in System OFF.
+ */
+static void retainRAM(uint32_t address) {
+    uint8_t block;
+    uint8_t section;
+    if (address < RAM8_BASE) {
+        block = (address - RAM_BLOCK_BASE) / RAM_BLOCK_SIZE;
+        section = ((address - RAM_BLOCK_BASE) % RAM_BLOCK_SIZE) / RAM_SECTION_SIZE;
+    } else {
+        block = 8;
+        section = (address - RAM8_BASE) / RAM8_SECTION_SIZE;
+    }
+    sd_power_ram_power_set(block, (1UL << section) | (1UL << (POWER_RAM_POWERSET_S0RETENTION_Pos + section)));
+}
+
+void setDeepSleepWakeTimer(deepSleepWakeTimer timer, uint32_t pin, uint8_t level) {
+    wake_timer = timer;
+    wake_pin = pin;
+    wake_level = level;
+}
+
+bool retainInDeepSleep(const void *address, uint32_t length) {
+    if ((retained_region_count >= DEEP_SLEEP_RETAINED_REGIONS) || (length == 0)) {
+        return false;
+    }
+    retained_regions[retained_region_count++] = { (uintptr_t)address, length };
+    return true;
+}
+
+bool deepSleepAvailable(void) {
+    return wake_timer != nullptr;
+}
+
+bool wokeFromDeepSleep(void) {
+    return (readResetReason() & POWER_RESETREAS_OFF_Msk) != 0;
+}
+
+bool takeDeepSleepState(void *state, uint16_t length) {
+    if (!wokeFromDeepSleep()) {
+        // power on or another reset, whatever is in the block is stale
+        retained_block.magic = 0;
+        return false;
+    }
+    return openRetainedBlock(&retained_block, state, length);
+}
+
+bool enterDeepSleep(uint32_t sleep_ms, const void *state, uint16_t length) {
+    if (!deepSleepAvailable() || !sealRetainedBlock(&retained_block, state, length)) {
+        return false;
+    }
+    if (!wake_timer(sleep_ms)) {
+        LOG_WARN("Wake timer not armed, staying awake.");
+        retained_block.magic = 0;
+        return false;
+    }
+    retainRAM((uintptr_t)&retained_block);
+    retainRAM((uintptr_t)&retained_block + sizeof(retained_block) - 1);
+    for (uint8_t i = 0; i < retained_region_count; i++) {
+        // regions are far smaller than a section, so at most two sections each
+        retainRAM(retained_regions[i].address);
+        retainRAM(retained_regions[i].address + retained_regions[i].length - 1);
+    }
+    LOG_INFO("Deep sleep for %lu s.", sleep_ms / 1000);
+    // the drain task won't get another chance
+    flushLogging();
+    Radio.Sleep();
+    // doesn't return, waking is a reset
+    systemOff(wake_pin, wake_level);
+    return false;
+}
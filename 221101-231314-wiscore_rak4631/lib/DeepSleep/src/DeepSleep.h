@@ -0,0 +1,75 @@
+#pragma once
+/**
+ * @file DeepSleep.h
+ * @brief nRF52 System OFF between long sampling intervals, with the application's state kept in retained RAM so it can
+ * resume on wake instead of starting cold.
+ *
+ * In System OFF everything is off except the GPIO wake detection (and the retained RAM): about 0.5 uA against a few uA
+ * idling in System ON with FreeRTOS & the SoftDevice. Waking is a reset, so setup() runs again; the LoRaWAN session is
+ * in flash (LoRaWAN_session.h) so there's no join, and takeDeepSleepState() gives back the state saved on the way in.
+ *
+ * The nRF52's RTC doesn't run in System OFF, so it can't time its own wake up. An external timer that pulls a GPIO
+ * (e.g. the interrupt pin of a RAK12002 RTC module) does that; register it with setDeepSleepWakeTimer(). Until one is
+ * registered deepSleepAvailable() is false and the device just idles in System ON between cycles, as before.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+
+#include "Logging.h"       /**< Go here to change the logging level for the entire application. */
+#include "RetainedBlock.h" /**< Retained RAM with a magic number & CRC. */
+
+#define DEEP_SLEEP_RETAINED_REGIONS 4 /**< Most regions retainInDeepSleep() can add. */
+
+/**
+ * @brief Arms an external timer to wake the device after sleep_ms, by driving the wake pin to its wake level.
+ * @return False if it couldn't, the device then stays awake.
+ */
+typedef bool (*deepSleepWakeTimer)(uint32_t sleep_ms);
+
+/**
+ * @brief Registers the timer that wakes the device from System OFF.
+ * @param wake_timer Arms the timer, see deepSleepWakeTimer.
+ * @param wake_pin GPIO the timer drives.
+ * @param wake_level Level that wakes the device (HIGH or LOW).
+ */
+void setDeepSleepWakeTimer(deepSleepWakeTimer wake_timer, uint32_t wake_pin, uint8_t wake_level);
+
+/**
+ * @brief Keeps more RAM through System OFF, besides the state passed to enterDeepSleep(). The region has to be in a
+ * section the C runtime doesn't clear (.noinit), and it's up to its owner to check it's intact after a wake.
+ * @return False if there's no room for another region.
+ */
+bool retainInDeepSleep(const void *address, uint32_t length);
+
+/**
+ * @brief True once a wake timer is registered.
+ */
+bool deepSleepAvailable(void);
+
+/**
+ * @brief True if this boot is a wake from System OFF.
+ */
+bool wokeFromDeepSleep(void);
+
+/**
+ * @brief Gets the state saved by enterDeepSleep(), once. Call early in setup().
+ * @param state Filled with the state.
+ * @param length Size of state, must be the same as when it was saved.
+ * @return True if this is a wake from deep sleep and the state is intact; false means start cold.
+ */
+bool takeDeepSleepState(void *state, uint16_t length);
+
+/**
+ * @brief Saves state to retained RAM, arms the wake timer and enters System OFF. Puts the radio to sleep first.
+ * Everything not in state is lost, so flush anything that matters (history, compressor, session) before calling.
+ * @param sleep_ms Time until the wake up.
+ * @param state State to resume with, at most RETAINED_BLOCK_SIZE bytes.
+ * @param length Size of state.
+ * @return False if deep sleep isn't available or the wake timer couldn't be armed. Doesn't return otherwise.
+ */
+bool enterDeepSleep(uint32_t sleep_ms, const void *state, uint16_t length);
@@ -0,0 +1,38 @@
+#include "RetainedBlock.h"
+#include <string.h>
+
+// CRC-16/CCITT-FALSE, the same as flashCRC16(), without the flash dependencies
+static uint16_t blockCRC(const retainedBlock *block) {
+    uint16_t crc = 0xFFFF;
+    const uint8_t *bytes = (const uint8_t *)&block->length;
+    for (uint16_t i = 0; i < sizeof(block->length) + block->length; i++) {
+        uint8_t byte = (i < sizeof(block->length)) ? bytes[i] : block->data[i - sizeof(block->length)];
+        crc ^= (uint16_t)byte << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+bool sealRetainedBlock(retainedBlock *block, const void *state, uint16_t length) {
+    block->magic = 0;
+    if (length > RETAINED_BLOCK_SIZE) {
+        return false;
+    }
+    block->length = length;
+    memcpy(block->data, state, length);
+    block->crc = blockCRC(block);
+    block->magic = RETAINED_BLOCK_MAGIC;
+    return true;
+}
+
+bool openRetainedBlock(retainedBlock *block, void *state, uint16_t length) {
+    bool valid = (block->magic == RETAINED_BLOCK_MAGIC) && (block->length == length) &&
+                 (length <= RETAINED_BLOCK_SIZE) && (block->crc == blockCRC(block));
+    block->magic = 0;
+    if (valid) {
+        memcpy(state, block->data, length);
+    }
+    return valid;
+}
@@ -0,0 +1,45 @@
+#pragma once
+/**
+ * @file RetainedBlock.h
+ * @brief A block of RAM that is kept across a reset, e.g. System OFF with RAM retention, with a magic number, length &
+ * CRC so a cold boot (or a change to what's stored) is never mistaken for saved state.
+ *
+ * The block is opened once: openRetainedBlock() invalidates it, so a later reset for any other reason (watchdog,
+ * brownout, a crash straight after waking) starts cold instead of resuming stale state.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#define RETAINED_BLOCK_MAGIC 0x5EE9D0FFUL /**< Marks a sealed block. */
+#define RETAINED_BLOCK_SIZE  512          /**< Bytes of state a block can hold. */
+
+/** @brief The retained RAM itself. Put it in a section the C runtime doesn't clear (.noinit). */
+struct retainedBlock {
+    uint32_t magic;
+    uint16_t length; // of the state in data, so a different layout doesn't match
+    uint16_t crc;    // of length & data
+    uint8_t data[RETAINED_BLOCK_SIZE];
+};
+
+/**
+ * @brief Copies the state into the block and seals it.
+ * @param block The retained block.
+ * @param state State to keep.
+ * @param length Size of state, at most RETAINED_BLOCK_SIZE.
+ * @return False if state is too big (the block is left invalid).
+ */
+bool sealRetainedBlock(retainedBlock *block, const void *state, uint16_t length);
+
+/**
+ * @brief Copies the state out of the block if it was sealed with the same length and is intact, and invalidates it.
+ * @param block The retained block.
+ * @param state Filled with the state.
+ * @param length Size of state.
+ * @return True if state was filled.
+ */
+bool openRetainedBlock(retainedBlock *block, void *state, uint16_t length);
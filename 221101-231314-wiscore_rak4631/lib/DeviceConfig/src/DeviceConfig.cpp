@@ -0,0 +1,220 @@
+#include "DeviceConfig.h"
+
+#define DEVICE_CONFIG_MAGIC       0xC0F1
+#define DEVICE_CONFIG_STORAGE     3    // bump when deviceConfig changes so old saved settings are ignored
+#define MIN_INTERVAL_S            10   // anything faster would break the duty cycle
+#define MAX_TRIGGER_NTU           3000 // mvToNTU() caps at 3000 NTU
+#define MAX_TX_POWER              10   // TX_POWER_10 is the highest valid for AU915
+#define MIN_DETECTOR_THRESHOLD    10   // 1 sigma, any lower and noise alone starts events
+
+/** @brief Settings as stored in flash. */
+struct storedDeviceConfig {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t reserved;
+    deviceConfig config;
+    uint16_t crc;
+};
+
+// set in the RX handler, taken at the start of the next cycle
+static SemaphoreHandle_t config_mutex = NULL; // held while using anything below, the RX handler & the cycle share them
+static deviceConfig pending_config = {};
+static volatile bool config_pending = false;
+static uint8_t pending_command_id = 0;   // the command id of the newest downlink, echoed in the ack
+static uint32_t pending_downlinks = 0;   // counts downlinks held as pending
+static uint8_t taken_command_id = 0;     // ... and the one getPendingDeviceConfig() handed out
+static uint32_t taken_downlinks = 0;
+static uint8_t ack[DEVICE_CONFIG_ACK_SIZE] = {};
+static volatile bool ack_pending = false;
+
+// call with config_mutex held
+static void queueAck(uint8_t command_id, CONFIG_STATUS status) {
+    ack[0] = DEVICE_CONFIG_VERSION;
+    ack[1] = command_id;
+    ack[2] = (uint8_t)status;
+    ack_pending = true;
+}
+
+static void queueAckLocked(uint8_t command_id, CONFIG_STATUS status) {
+    xSemaphoreTake(config_mutex, portMAX_DELAY);
+    queueAck(command_id, status);
+    xSemaphoreGive(config_mutex);
+}
+
+bool loadDeviceConfig(deviceConfig *config) {
+    if (config_mutex == NULL) {
+        config_mutex = xSemaphoreCreateMutex();
+    }
+    storedDeviceConfig stored;
+    if (readFlashFile(DEVICE_CONFIG_FILE, 0, &stored, sizeof(stored)) && (stored.magic == DEVICE_CONFIG_MAGIC) &&
+        (stored.version == DEVICE_CONFIG_STORAGE) && (stored.crc == flashCRC16(&stored.config, sizeof(deviceConfig)))) {
+        *config = stored.config;
+        LOG_INFO("Loaded saved device config.");
+        return true;
+    }
+    *config = DEFAULT_DEVICE_CONFIG;
+    return false;
+}
+
+CONFIG_STATUS handleConfigDownlink(const deviceConfig *config, const uint8_t *buffer, uint8_t size) {
+    if (size < 2) {
+        queueAckLocked(0, CONFIG_STATUS::MALFORMED);
+        return CONFIG_STATUS::MALFORMED;
+    }
+    uint8_t command_id = buffer[1];
+    if (buffer[0] != DEVICE_CONFIG_VERSION) {
+        queueAckLocked(command_id, CONFIG_STATUS::BAD_VERSION);
+        return CONFIG_STATUS::BAD_VERSION;
+    }
+
+    // changes are made to a copy so that either every TLV is applied or none are
+    deviceConfig new_config = *config;
+    CONFIG_STATUS status = CONFIG_STATUS::OK;
+    uint8_t b = 2;
+    while ((b < size) && (status == CONFIG_STATUS::OK)) {
+        if ((b + 2) > size) {
+            status = CONFIG_STATUS::MALFORMED;
+            break;
+        }
+        CONFIG_TLV type = (CONFIG_TLV)buffer[b];
+        uint8_t length = buffer[b + 1];
+        const uint8_t *value = &buffer[b + 2];
+        b += 2 + length;
+        if (b > size) {
+            status = CONFIG_STATUS::MALFORMED;
+            break;
+        }
+
+        // all values are 1 or 2 bytes, MSB first
+        uint16_t v = (length == 2) ? (((uint16_t)value[0] << 8) | value[1]) : value[0];
+        switch (type) {
+            case CONFIG_TLV::NORMAL_INTERVAL:
+            case CONFIG_TLV::ACTIVE_INTERVAL:
+            case CONFIG_TLV::TRIGGER_NTU:
+            case CONFIG_TLV::COMPRESSION:
+                if (length != 2) {
+                    status = CONFIG_STATUS::MALFORMED;
+                }
+                break;
+            case CONFIG_TLV::TURBIDITY_SAMPLES:
+            case CONFIG_TLV::PAYLOAD_PORT:
+            case CONFIG_TLV::TX_POWER:
+            case CONFIG_TLV::ACTIVE_CYCLES:
+            case CONFIG_TLV::DETECTOR_SLACK:
+            case CONFIG_TLV::DETECTOR_THRESHOLD:
+                if (length != 1) {
+                    status = CONFIG_STATUS::MALFORMED;
+                }
+                break;
+            default:
+                status = CONFIG_STATUS::UNKNOWN_TLV;
+                break;
+        }
+        if (status != CONFIG_STATUS::OK) {
+            break;
+        }
+
+        switch (type) {
+            case CONFIG_TLV::NORMAL_INTERVAL:
+                new_config.normal_interval_ms = (uint32_t)v * 1000;
+                status = (v < MIN_INTERVAL_S) ? CONFIG_STATUS::INVALID_VALUE : status;
+                break;
+            case CONFIG_TLV::ACTIVE_INTERVAL:
+                new_config.active_interval_ms = (uint32_t)v * 1000;
+                status = (v < MIN_INTERVAL_S) ? CONFIG_STATUS::INVALID_VALUE : status;
+                break;
+            case CONFIG_TLV::TRIGGER_NTU:
+                new_config.trigger_ntu = v;
+                status = ((v == 0) || (v > MAX_TRIGGER_NTU)) ? CONFIG_STATUS::INVALID_VALUE : status;
+                break;
+            case CONFIG_TLV::TURBIDITY_SAMPLES:
+                new_config.turbidity_samples = v;
+                status = (v == 0) ? CONFIG_STATUS::INVALID_VALUE : status;
+                break;
+            case CONFIG_TLV::PAYLOAD_PORT:
+                // whether the port exists is checked by the application when applying
+                new_config.payload_port = v;
+                break;
+            case CONFIG_TLV::TX_POWER:
+                new_config.tx_power = v;
+                status = (v > MAX_TX_POWER) ? CONFIG_STATUS::INVALID_VALUE : status;
+                break;
+            case CONFIG_TLV::ACTIVE_CYCLES:
+                new_config.active_cycles = v;
+                status = (v == 0) ? CONFIG_STATUS::INVALID_VALUE : status;
+                break;
+            case CONFIG_TLV::COMPRESSION:
+                new_config.compression_dntu = v;
+                break;
+            case CONFIG_TLV::DETECTOR_SLACK:
+                new_config.detector_slack_dsigma = v;
+                break;
+            case CONFIG_TLV::DETECTOR_THRESHOLD:
+                new_config.detector_threshold_dsigma = v;
+                status = (v < MIN_DETECTOR_THRESHOLD) ? CONFIG_STATUS::INVALID_VALUE : status;
+                break;
+        }
+    }
+
+    if (status != CONFIG_STATUS::OK) {
+        queueAckLocked(command_id, status);
+        return status;
+    }
+
+    xSemaphoreTake(config_mutex, portMAX_DELAY);
+    pending_config = new_config;
+    pending_command_id = command_id;
+    pending_downlinks++;
+    config_pending = true;
+    xSemaphoreGive(config_mutex);
+    return CONFIG_STATUS::OK;
+}
+
+bool getPendingDeviceConfig(deviceConfig *new_config) {
+    if (!config_pending) {
+        return false;
+    }
+    xSemaphoreTake(config_mutex, portMAX_DELAY);
+    *new_config = pending_config;
+    taken_command_id = pending_command_id;
+    taken_downlinks = pending_downlinks;
+    xSemaphoreGive(config_mutex);
+    return true;
+}
+
+void finishDeviceConfig(const deviceConfig *config, bool applied) {
+    xSemaphoreTake(config_mutex, portMAX_DELAY);
+    // a downlink that came in while these were applied is left pending for the next cycle
+    config_pending = (pending_downlinks != taken_downlinks);
+    if (!applied) {
+        queueAck(taken_command_id, CONFIG_STATUS::APPLY_FAILED);
+        xSemaphoreGive(config_mutex);
+        LOG_WARN("Device config %u could not be applied.", taken_command_id);
+        return;
+    }
+    xSemaphoreGive(config_mutex);
+
+    storedDeviceConfig stored = {};
+    stored.magic = DEVICE_CONFIG_MAGIC;
+    stored.version = DEVICE_CONFIG_STORAGE;
+    stored.config = *config;
+    stored.crc = flashCRC16(&stored.config, sizeof(deviceConfig));
+    writeFlashFile(DEVICE_CONFIG_FILE, 0, &stored, sizeof(stored));
+    LOG_INFO("Device config %u applied.", taken_command_id);
+    queueAckLocked(taken_command_id, CONFIG_STATUS::OK);
+}
+
+uint8_t takeDeviceConfigAck(uint8_t *buffer) {
+    if (!ack_pending) {
+        return 0;
+    }
+    xSemaphoreTake(config_mutex, portMAX_DELAY);
+    memcpy(buffer, ack, DEVICE_CONFIG_ACK_SIZE);
+    ack_pending = false;
+    xSemaphoreGive(config_mutex);
+    return DEVICE_CONFIG_ACK_SIZE;
+}
+
+bool deviceConfigBusy(void) {
+    return config_pending || ack_pending;
+}
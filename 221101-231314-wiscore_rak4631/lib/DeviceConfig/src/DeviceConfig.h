@@ -0,0 +1,124 @@
+#pragma once
+/**
+ * @file DeviceConfig.h
+ * @brief Remotely tunable device settings and the binary downlink protocol used to change them.
+ *
+ * Downlinks on DEVICE_CONFIG_PORT are a versioned TLV command set (see README):
+ *   [version][command id] then any number of [type][length][value (MSB first)].
+ * The downlink is parsed and validated in the RX handler without allocating, and if every TLV is valid the new settings
+ * are held as pending. The application applies them all at once at the start of its next cycle with
+ * applyPendingDeviceConfig(), which also saves them to flash. The result is then acknowledged in the next uplink.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+
+#include "FlashStorage.h" /**< Internal flash access. */
+#include "Logging.h"      /**< Go here to change the logging level for the entire application. */
+
+#define DEVICE_CONFIG_PORT      201                /**< Port for config downlinks and acks (200-222 are system ports). */
+#define DEVICE_CONFIG_VERSION   1                  /**< Version of the TLV command set. */
+#define DEVICE_CONFIG_FILE      "/config.bin"      /**< Flash file the settings are saved in. */
+#define DEVICE_CONFIG_ACK_SIZE  3                  /**< [version][command id][status]. */
+
+/** @brief TLV types. Values are MSB first. */
+enum class CONFIG_TLV : uint8_t {
+    NORMAL_INTERVAL = 0x01,   /**< uint16_t: normal mode reporting interval in seconds. */
+    ACTIVE_INTERVAL = 0x02,   /**< uint16_t: active mode reporting interval in seconds. */
+    TRIGGER_NTU = 0x03,       /**< uint16_t: turbidity (NTU) that switches to active mode after 2 readings. */
+    TURBIDITY_SAMPLES = 0x04, /**< uint8_t: turbidity samples averaged per reading. */
+    PAYLOAD_PORT = 0x05,      /**< uint8_t: port (schema) used for readings. */
+    TX_POWER = 0x06,          /**< uint8_t: LoRaWAN TX power setting (TX_POWER_0 - TX_POWER_10). */
+    ACTIVE_CYCLES = 0x07,     /**< uint8_t: readings taken in active mode before returning to normal mode. */
+    COMPRESSION = 0x08,       /**< uint16_t: quiet period compression error bound in 0.1 NTU (0 = off). */
+    DETECTOR_SLACK = 0x09,    /**< uint8_t: event detector slack in 0.1 sigma. */
+    DETECTOR_THRESHOLD = 0x0A, /**< uint8_t: event detector threshold in 0.1 sigma. */
+};
+
+/** @brief Result of a config downlink, sent back in the ack. */
+enum class CONFIG_STATUS : uint8_t {
+    OK = 0,                  /**< Applied & saved. */
+    BAD_VERSION = 1,         /**< Unsupported command set version. */
+    MALFORMED = 2,           /**< Truncated or wrong length TLV. */
+    UNKNOWN_TLV = 3,         /**< TLV type not supported by this firmware. */
+    INVALID_VALUE = 4,       /**< Value out of range. */
+    APPLY_FAILED = 5,        /**< Valid, but the application could not apply it (e.g. sensor init failed). */
+};
+
+/** @brief The remotely tunable settings. */
+struct deviceConfig {
+    uint32_t normal_interval_ms;   /**< Normal mode reporting interval. */
+    uint32_t active_interval_ms;   /**< Active mode reporting interval. */
+    uint16_t trigger_ntu;          /**< Turbidity that switches to active mode, whatever the detector says. */
+    uint8_t turbidity_samples;     /**< Turbidity samples averaged per reading. */
+    uint8_t payload_port;          /**< Port number of the portSchema used for readings. */
+    uint8_t tx_power;              /**< LoRaWAN TX power setting. */
+    uint8_t active_cycles;         /**< Readings taken in active mode before returning to normal mode. */
+    uint16_t compression_dntu;     /**< Quiet period compression error bound in 0.1 NTU, 0 = send every reading. */
+    uint8_t detector_slack_dsigma; /**< Rise ignored by the event detector, in 0.1 sigma (see ChangeDetector.h). */
+    uint8_t detector_threshold_dsigma; /**< Event detector CUSUM threshold, in 0.1 sigma. */
+};
+
+/** @brief Settings used until a downlink changes them. */
+static const deviceConfig DEFAULT_DEVICE_CONFIG = {
+    2 * 60 * 1000, // normal_interval_ms
+    60 * 1000,     // active_interval_ms
+    30,            // trigger_ntu
+    100,           // turbidity_samples
+    10,            // payload_port
+    10,            // tx_power: TX_POWER_10
+    10,            // active_cycles
+    20,            // compression_dntu: 2 NTU
+    5,             // detector_slack_dsigma: 0.5 sigma
+    50,            // detector_threshold_dsigma: 5 sigma
+};
+
+/**
+ * @brief Loads the settings saved in flash, or DEFAULT_DEVICE_CONFIG if there are none. Call once at boot, before any
+ * downlink can arrive.
+ * @param config Settings to fill.
+ * @return True if settings were loaded from flash, false if the defaults are used.
+ */
+bool loadDeviceConfig(deviceConfig *config);
+
+/**
+ * @brief Parses a config downlink. Safe to call from the LoRaWAN RX handler: nothing is allocated and nothing is
+ * applied, the new settings are only held as pending.
+ * @param config Current settings, used as the base for settings the downlink doesn't change.
+ * @param buffer Downlink payload.
+ * @param size Length of buffer.
+ * @return Result of parsing; anything other than OK is acked straight away.
+ */
+CONFIG_STATUS handleConfigDownlink(const deviceConfig *config, const uint8_t *buffer, uint8_t size);
+
+/**
+ * @brief Checks for settings received by handleConfigDownlink().
+ * Call at the start of a cycle. If this returns true, apply new_config and then call finishDeviceConfig().
+ * @param new_config Filled with the pending settings.
+ * @return True if there are pending settings to apply.
+ */
+bool getPendingDeviceConfig(deviceConfig *new_config);
+
+/**
+ * @brief Completes a change started by getPendingDeviceConfig(): saves the settings to flash if they were applied and
+ * queues the ack.
+ * @param config The settings, now live.
+ * @param applied True if the application applied them, false if it could not (they are not saved).
+ */
+void finishDeviceConfig(const deviceConfig *config, bool applied);
+
+/**
+ * @brief Writes the pending ack, if any, into buffer and clears it.
+ * @param buffer Buffer of at least DEVICE_CONFIG_ACK_SIZE bytes.
+ * @return Length of the ack written, 0 if no ack is pending.
+ */
+uint8_t takeDeviceConfigAck(uint8_t *buffer);
+
+/**
+ * @brief True if settings are waiting to be applied or an ack is waiting to be sent. Both are only kept in RAM.
+ */
+bool deviceConfigBusy(void);
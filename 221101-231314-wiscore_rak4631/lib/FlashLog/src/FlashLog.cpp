@@ -0,0 +1,337 @@
+#include "FlashLog.h"
+
+#include "DeepSleep.h" /**< retainInDeepSleep(), so the RAM page survives System OFF. */
+
+#define FLASH_LOG_RETAINED_MAGIC 0x6C6F6721UL
+
+/** @brief Kept in RAM through resets & deep sleep. */
+struct flashLogRetained {
+    uint32_t magic;        // FLASH_LOG_RETAINED_MAGIC once set up, the budget is only carried on with it
+    logWriteBudget budget;
+    logPage page;          // records not written yet, its sequence is the next to be written
+};
+// not cleared by the C runtime, so the page survives a reset; checkLogPage() tells if it's intact
+static flashLogRetained retained __attribute__((section(".noinit")));
+
+static SemaphoreHandle_t flash_log_mutex = NULL; // held while using the RAM page, the slots or read_page
+static bool flash_ok = false;
+static uint16_t boot = 0;          // this boot's number, one more than the last boot mark found
+static bool boot_marked = false;   // the RAM page has this boot's mark
+static uint32_t slot_sequences[FLASH_LOG_PAGES] = {};
+static bool slot_valid[FLASH_LOG_PAGES] = {};
+static logPage read_page;          // a stored page being read
+static flashLogStats counters = {};
+
+// set in the RX callback, taken by prepareFlashLogFragment(), under flash_log_mutex
+static volatile bool request_pending = false;
+static uint8_t pending_id = 0;
+static uint8_t pending_level = 0;
+static uint8_t pending_pages = 0;
+
+// the request being sent, only used by the radio task
+static bool request_active = false;
+static uint8_t request_id = 0;
+static uint8_t request_level = 0;
+static uint32_t cursor_sequence = 0; // page to carry on from with the next fragment
+static uint16_t cursor_at = 0;       // where in that page
+static uint32_t cursor_after_sequence = 0;
+static uint16_t cursor_after_at = 0;
+static uint8_t fragment = 0;
+static bool prepared_last = false;
+static uint16_t records_sent = 0;
+static uint16_t records_prepared = 0;
+
+// forward declarations
+static void flashLogRecord(const uint8_t *record, uint8_t length);
+static void writePage(uint32_t now_ms);
+static const logPage *readPage(uint32_t sequence);
+static bool lastBootMark(const logPage *page, uint16_t *last_boot);
+static void takePendingRequest(void);
+
+bool initFlashLog(void) {
+    LOG_DEBUG("Initialising flash log...");
+    flash_log_mutex = xSemaphoreCreateMutex();
+    flash_ok = initFlashStorage();
+    memset(slot_valid, 0, sizeof(slot_valid));
+
+    // the newest page on the flash gives the next sequence & the last boot
+    uint32_t next_sequence = 0;
+    uint16_t last_boot = 0;
+    uint32_t stored_slots = flash_ok ? flashFileSize(FLASH_LOG_FILE) / LOG_PAGE_SIZE : 0;
+    stored_slots = (stored_slots > FLASH_LOG_PAGES) ? FLASH_LOG_PAGES : stored_slots;
+    for (uint8_t slot = 0; slot < stored_slots; slot++) {
+        if (!readFlashFile(FLASH_LOG_FILE, slot * LOG_PAGE_SIZE, &read_page, LOG_PAGE_SIZE) ||
+            !checkLogPage(&read_page) || ((read_page.sequence % FLASH_LOG_PAGES) != slot)) {
+            continue;
+        }
+        slot_valid[slot] = true;
+        slot_sequences[slot] = read_page.sequence;
+        if (read_page.sequence >= next_sequence) {
+            next_sequence = read_page.sequence + 1;
+            lastBootMark(&read_page, &last_boot);
+        }
+    }
+    // a slot left over from an older lap of the ring (e.g. the newer write was lost) is stale
+    for (uint8_t slot = 0; slot < FLASH_LOG_PAGES; slot++) {
+        slot_valid[slot] = slot_valid[slot] && (slot_sequences[slot] + FLASH_LOG_PAGES >= next_sequence);
+    }
+
+    uint32_t now_ms = millis();
+    bool carried_on = (retained.magic == FLASH_LOG_RETAINED_MAGIC) && checkLogPage(&retained.page) &&
+                      (retained.page.sequence >= next_sequence);
+    if (carried_on) {
+        lastBootMark(&retained.page, &last_boot);
+    } else {
+        startLogPage(&retained.page, next_sequence);
+    }
+    if (retained.magic == FLASH_LOG_RETAINED_MAGIC) {
+        resumeLogWriteBudget(&retained.budget, FLASH_LOG_BUDGET_UJ_PER_DAY, now_ms);
+    } else {
+        // a power on, nothing to carry on with
+        startLogWriteBudget(&retained.budget, FLASH_LOG_BUDGET_UJ_PER_DAY, now_ms);
+        retained.magic = FLASH_LOG_RETAINED_MAGIC;
+    }
+    boot = last_boot + 1;
+    boot_marked = false;
+    retainInDeepSleep(&retained, sizeof(retained));
+
+    flashLogStats stats;
+    getFlashLogStats(&stats);
+    LOG_INFO("Flash log: boot %u, %u pages stored, %u bytes carried on, %lu uJ of budget.", boot, stats.stored_pages,
+        carried_on ? retained.page.used : 0, stats.credit_uj);
+    if (FLASH_LOG_DUMP_ON_BOOT) {
+        // whenever Serial connects, the drain task doesn't wait for it any more
+        setSerialAttachHandler(dumpFlashLog);
+    }
+    setLogRecordSink(flashLogRecord);
+    return flash_ok;
+}
+
+void dumpFlashLog(void) {
+    xSemaphoreTake(flash_log_mutex, portMAX_DELAY);
+    uint32_t next_sequence = retained.page.sequence;
+    uint32_t oldest = (next_sequence > FLASH_LOG_PAGES) ? next_sequence - FLASH_LOG_PAGES : 0;
+    Serial.printf("Flash log: pages %lu - %lu, this is boot %u.\n", (unsigned long)oldest, (unsigned long)next_sequence,
+        boot);
+    char line[LOG_TOKEN_LINE_MAX];
+    for (uint32_t sequence = oldest; sequence <= next_sequence; sequence++) {
+        const logPage *page = readPage(sequence);
+        if (page == nullptr) {
+            continue;
+        }
+        Serial.printf("Flash log page %lu%s:\n", (unsigned long)sequence, (sequence == next_sequence) ? " (RAM)" : "");
+        uint16_t at = 0;
+        logPageItem item;
+        while (nextLogPageItem(page, &at, &item)) {
+            if (item.boot_mark) {
+                Serial.printf("Boot %u:\n", item.boot);
+                continue;
+            }
+            encodeLogLine(item.record, item.length, line);
+            Serial.println(line);
+        }
+    }
+    Serial.println("Flash log end.");
+    xSemaphoreGive(flash_log_mutex);
+}
+
+bool handleFlashLogRequest(const uint8_t *buffer, uint8_t size) {
+    if ((size != FLASH_LOG_REQUEST_SIZE) || (buffer[0] != FLASH_LOG_VERSION)) {
+        LOG_WARN("Flash log: bad request (%u bytes).", size);
+        return false;
+    }
+    // the newest pages, the RAM page counts as one
+    uint8_t pages = ((buffer[3] == 0) || (buffer[3] > FLASH_LOG_PAGES + 1)) ? FLASH_LOG_PAGES + 1 : buffer[3];
+    xSemaphoreTake(flash_log_mutex, portMAX_DELAY);
+    pending_id = buffer[1];
+    pending_level = buffer[2];
+    pending_pages = pages;
+    request_pending = true;
+    xSemaphoreGive(flash_log_mutex);
+    LOG_INFO("Flash log: request %u for %u pages at level %u.", buffer[1], pages, buffer[2]);
+    return true;
+}
+
+bool flashLogUploadPending(void) {
+    return request_active || request_pending;
+}
+
+uint8_t prepareFlashLogFragment(uint8_t *buffer, uint8_t max_length) {
+    takePendingRequest();
+    if (!request_active || (max_length < (FLASH_LOG_FRAGMENT_HEADER + LOG_PAGE_BOOT_ITEM + 1 + LOG_RECORD_MAX / 4))) {
+        return 0;
+    }
+    xSemaphoreTake(flash_log_mutex, portMAX_DELAY);
+    logFragment packing(buffer, FLASH_LOG_FRAGMENT_HEADER, max_length, request_level);
+    uint32_t next_sequence = retained.page.sequence;
+    uint32_t sequence = cursor_sequence;
+    uint16_t at = cursor_at;
+    if (sequence + FLASH_LOG_PAGES < next_sequence) {
+        // overwritten since the last fragment
+        sequence = next_sequence - FLASH_LOG_PAGES;
+        at = 0;
+    }
+    bool done = false;
+    for (;;) {
+        const logPage *page = readPage(sequence);
+        if ((page != nullptr) && !packing.pack(page, &at)) {
+            // full
+            break;
+        }
+        if (sequence >= next_sequence) {
+            // the RAM page is last
+            done = true;
+            break;
+        }
+        sequence++;
+        at = 0;
+    }
+    xSemaphoreGive(flash_log_mutex);
+
+    prepared_last = done || ((fragment + 1) >= FLASH_LOG_MAX_FRAGMENTS);
+    cursor_after_sequence = sequence;
+    cursor_after_at = at;
+    records_prepared = packing.records();
+
+    buffer[0] = FLASH_LOG_VERSION;
+    buffer[1] = request_id;
+    buffer[2] = fragment;
+    buffer[3] = prepared_last ? FLASH_LOG_FRAGMENT_LAST : 0;
+    return packing.length();
+}
+
+void flashLogFragmentSent(void) {
+    cursor_sequence = cursor_after_sequence;
+    cursor_at = cursor_after_at;
+    records_sent += records_prepared;
+    fragment++;
+    if (prepared_last) {
+        request_active = false;
+        LOG_INFO("Flash log: request %u done, %u records in %u fragments.", request_id, records_sent, fragment);
+    }
+}
+
+void getFlashLogStats(flashLogStats *stats) {
+    xSemaphoreTake(flash_log_mutex, portMAX_DELAY);
+    *stats = counters;
+    stats->boot = boot;
+    stats->stored_pages = 0;
+    for (uint8_t slot = 0; slot < FLASH_LOG_PAGES; slot++) {
+        stats->stored_pages += slot_valid[slot] ? 1 : 0;
+    }
+    stats->page_used = retained.page.used;
+    stats->credit_uj = logWriteCredit(&retained.budget, millis());
+    xSemaphoreGive(flash_log_mutex);
+}
+
+/**
+ * @brief The log record sink, see setLogRecordSink(). Adds the record to the RAM page, writing the page first if it's
+ * full. Runs in the drain task (or flushLogging()), i.e. when nothing else is running.
+ */
+void flashLogRecord(const uint8_t *record, uint8_t length) {
+    uint8_t level = record[0] & ~LOG_RECORD_TRUNCATED;
+    if (level > (uint8_t)FLASH_LOG_LEVEL) {
+        return;
+    }
+    xSemaphoreTake(flash_log_mutex, portMAX_DELAY);
+    uint32_t now_ms = millis();
+    if ((level > (uint8_t)FLASH_LOG_OVER_BUDGET_LEVEL) &&
+        (logWriteCredit(&retained.budget, now_ms) < FLASH_LOG_PAGE_WRITE_UJ)) {
+        // the page might not get written, leave the room for what matters
+        counters.records_skipped++;
+    } else {
+        // with this boot's mark if the page hasn't got one yet
+        if (logPageRoom(&retained.page) < length + (boot_marked ? 0 : LOG_PAGE_BOOT_ITEM)) {
+            writePage(now_ms);
+        }
+        if (!boot_marked) {
+            boot_marked = addLogPageBoot(&retained.page, boot);
+        }
+        if (addLogPageRecord(&retained.page, record, length)) {
+            counters.records_kept++;
+        }
+    }
+    xSemaphoreGive(flash_log_mutex);
+}
+
+/**
+ * @brief Writes the RAM page to its slot and starts the next one. If the budget has run out (or the flash can't be
+ * used) the page is dropped instead, and started again. Called with flash_log_mutex held.
+ */
+void writePage(uint32_t now_ms) {
+    uint32_t sequence = retained.page.sequence;
+    uint8_t slot = sequence % FLASH_LOG_PAGES;
+    boot_marked = false;
+    if (!flash_ok || !spendLogWriteBudget(&retained.budget, now_ms, FLASH_LOG_PAGE_WRITE_UJ)) {
+        // the newest records matter most
+        counters.pages_dropped++;
+        startLogPage(&retained.page, sequence);
+        return;
+    }
+    slot_valid[slot] = false;
+    if (writeFlashFile(FLASH_LOG_FILE, slot * LOG_PAGE_SIZE, &retained.page, LOG_PAGE_SIZE)) {
+        slot_valid[slot] = true;
+        slot_sequences[slot] = sequence;
+        counters.pages_written++;
+    } else {
+        counters.pages_dropped++;
+        LOG_ERROR("Flash log: unable to write page %lu.", sequence);
+    }
+    startLogPage(&retained.page, sequence + 1);
+}
+
+/**
+ * @brief Gets a page: the RAM page if it's the next to be written, otherwise from the flash into read_page. Called with
+ * flash_log_mutex held.
+ * @return The page, nullptr if it isn't stored.
+ */
+const logPage *readPage(uint32_t sequence) {
+    if (sequence == retained.page.sequence) {
+        return &retained.page;
+    }
+    uint8_t slot = sequence % FLASH_LOG_PAGES;
+    if (!slot_valid[slot] || (slot_sequences[slot] != sequence) ||
+        !readFlashFile(FLASH_LOG_FILE, slot * LOG_PAGE_SIZE, &read_page, LOG_PAGE_SIZE) ||
+        !checkLogPage(&read_page) || (read_page.sequence != sequence)) {
+        return nullptr;
+    }
+    return &read_page;
+}
+
+/**
+ * @brief Starts on the request stored by handleFlashLogRequest(), if there is one. Runs on the radio task, so never
+ * between a prepareFlashLogFragment() & its flashLogFragmentSent().
+ */
+void takePendingRequest(void) {
+    if (!request_pending) {
+        return;
+    }
+    xSemaphoreTake(flash_log_mutex, portMAX_DELAY);
+    request_id = pending_id;
+    request_level = pending_level;
+    uint32_t next_sequence = retained.page.sequence;
+    cursor_sequence = (next_sequence >= pending_pages) ? next_sequence + 1 - pending_pages : 0;
+    request_pending = false;
+    xSemaphoreGive(flash_log_mutex);
+    cursor_at = 0;
+    fragment = 0;
+    records_sent = 0;
+    request_active = true;
+}
+
+/**
+ * @brief Finds the last boot mark in a page.
+ * @return True if it has one, last_boot is left as it was if not.
+ */
+bool lastBootMark(const logPage *page, uint16_t *last_boot) {
+    bool found = false;
+    uint16_t at = 0;
+    logPageItem item;
+    while (nextLogPageItem(page, &at, &item)) {
+        if (item.boot_mark) {
+            *last_boot = item.boot;
+            found = true;
+        }
+    }
+    return found;
+}
@@ -0,0 +1,102 @@
+#pragma once
+/**
+ * @file FlashLog.h
+ * @brief Keeps the tokenised logs (see LogToken.h) on the internal flash, so a deployed node with nothing on Serial
+ * still leaves a trace, and gets them back later over Serial or by downlink.
+ *
+ * Records at FLASH_LOG_LEVEL and above are added to a page in RAM (see LogPage.h) as the drain task writes them out.
+ * A page is only written once it's full, by the drain task, which only runs when every other task is blocked: just
+ * before the CPU sleeps. The RAM page is in .noinit and kept through deep sleep, so neither a deep sleep nor a watchdog
+ * reset or crash loses it; it's checked on boot and carried on with.
+ *
+ * Pages go round a ring of FLASH_LOG_PAGES slots in FLASH_LOG_FILE, so each slot is rewritten once a lap and LittleFS
+ * spreads the blocks. Every write is paid for from a daily energy budget (FLASH_LOG_BUDGET_UJ_PER_DAY). When it has
+ * run out only records at FLASH_LOG_OVER_BUDGET_LEVEL and above are kept, and a full page that still can't be written
+ * is dropped from RAM so the newest records are the ones kept.
+ *
+ * A request on FLASH_LOG_PORT sends pages back as fragments on FLASH_LOG_PORT, one per call to
+ * prepareFlashLogFragment(), like a History backfill. See the README for the formats. The request comes in on the
+ * LoRaWAN RX callback while the radio task may be part way through a fragment, so handleFlashLogRequest() only stores
+ * it (under the flash log's mutex) and prepareFlashLogFragment() takes it up before the next fragment.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+
+#include "FlashStorage.h" /**< Internal flash access. */
+#include "LogPage.h"      /**< Page & fragment formats, write budget. */
+#include "Logging.h"      /**< Go here to change the logging level for the entire application. */
+
+#define FLASH_LOG_FILE              "/log.bin"      /**< Flash file that holds the ring of pages. */
+#define FLASH_LOG_PAGES             8               /**< Pages kept: 4 kB, a few hundred records. */
+#define FLASH_LOG_LEVEL             LOG_LEVEL::INFO /**< Lowest level kept. */
+#define FLASH_LOG_OVER_BUDGET_LEVEL LOG_LEVEL::WARN /**< Lowest level kept while the budget has run out. */
+#define FLASH_LOG_PAGE_WRITE_UJ     3000  /**< Energy of a page write: LittleFS rewrites the 4 kB block it's in. */
+#define FLASH_LOG_BUDGET_UJ_PER_DAY 72000 /**< Energy allowed for page writes per day (24 writes). */
+#define FLASH_LOG_DUMP_ON_BOOT      1     /**< Print the stored log once Serial is connected after a boot. */
+#define FLASH_LOG_PORT              205   /**< Port for log requests & fragments (200-222 are system). */
+#define FLASH_LOG_VERSION           1     /**< Version of the request & fragment formats. */
+#define FLASH_LOG_REQUEST_SIZE      4     /**< [version][request id][level][pages]. */
+#define FLASH_LOG_FRAGMENT_HEADER   4     /**< [version][request id][fragment][flags]. */
+#define FLASH_LOG_FRAGMENT_LAST     0x01  /**< Fragment flag: no more fragments for this request. */
+#define FLASH_LOG_MAX_FRAGMENTS     64    /**< Most fragments sent for one request. */
+
+/** @brief Flash log counters, for telemetry. */
+struct flashLogStats {
+    uint16_t boot;          /**< This boot's number, in the boot marks. */
+    uint16_t stored_pages;  /**< Pages on the flash. */
+    uint16_t page_used;     /**< Bytes used in the RAM page. */
+    uint32_t pages_written; /**< Pages written this boot. */
+    uint32_t pages_dropped; /**< Full pages dropped over budget (or because the write failed) this boot. */
+    uint32_t records_kept;  /**< Records added to the RAM page this boot. */
+    uint32_t records_skipped; /**< Records not kept because the budget had run out, this boot. */
+    uint32_t credit_uj;     /**< Write budget left. */
+};
+
+/**
+ * @brief Finds the pages on the flash, carries on with the RAM page if it survived the reset, and starts taking
+ * records from Logging. With FLASH_LOG_DUMP_ON_BOOT the stored log is printed once Serial connects (see
+ * setSerialAttachHandler()). Call once in setup(), after initLogging().
+ * @return True if successful, false if the flash couldn't be used (records are then only kept in RAM).
+ */
+bool initFlashLog(void);
+
+/**
+ * @brief Prints every stored record, oldest first, and the RAM page: each record as a token line, with a line before
+ * each page and boot. test/log_detokenise.cc renders it.
+ */
+void dumpFlashLog(void);
+
+/**
+ * @brief Parses a log request downlink. Called from the LoRaWAN RX callback, so only stores the request as pending.
+ * A new request replaces one in progress from the next prepareFlashLogFragment().
+ * @return True if it was a valid request.
+ */
+bool handleFlashLogRequest(const uint8_t *buffer, uint8_t size);
+
+/**
+ * @brief True while a log request has fragments left to send, or one is waiting to start.
+ */
+bool flashLogUploadPending(void);
+
+/**
+ * @brief Encodes the next fragment of the log request.
+ * @param buffer Buffer to encode into.
+ * @param max_length Max length of the fragment.
+ * @return Length of the fragment, 0 if there's nothing to send.
+ */
+uint8_t prepareFlashLogFragment(uint8_t *buffer, uint8_t max_length);
+
+/**
+ * @brief Moves on to the next fragment once the last prepared fragment has been sent.
+ */
+void flashLogFragmentSent(void);
+
+/**
+ * @brief Fills stats with the flash log counters.
+ */
+void getFlashLogStats(flashLogStats *stats);
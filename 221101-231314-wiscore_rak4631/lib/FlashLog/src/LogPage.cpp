@@ -0,0 +1,179 @@
+#include "LogPage.h"
+#include <string.h>
+
+#define LOG_RECORD_LEVEL_MASK 0x7F // level byte of a record, without LOG_RECORD_TRUNCATED
+#define MS_IN_DAY             (24UL * 60 * 60 * 1000)
+
+// CRC-16/CCITT-FALSE, the same as flashCRC16(), without the flash dependencies
+static uint16_t pageCRC(const void *data, uint16_t length, uint16_t crc) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (uint16_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)bytes[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+void startLogPage(logPage *page, uint32_t sequence) {
+    page->magic = LOG_PAGE_MAGIC;
+    page->version = LOG_PAGE_VERSION;
+    page->sequence = sequence;
+    page->used = 0;
+    page->crc = pageCRC(&page->sequence, sizeof(page->sequence), 0xFFFF);
+    // unused bytes are written too, keep them blank
+    memset(page->data, 0xFF, sizeof(page->data));
+}
+
+// appends bytes and carries the CRC on over them
+static void appendItem(logPage *page, const uint8_t *bytes, uint16_t length) {
+    memcpy(&page->data[page->used], bytes, length);
+    page->crc = pageCRC(bytes, length, page->crc);
+    page->used += length;
+}
+
+bool addLogPageRecord(logPage *page, const uint8_t *record, uint8_t length) {
+    if ((length == LOG_PAGE_BOOT_MARK) || (length > logPageRoom(page))) {
+        return false;
+    }
+    appendItem(page, &length, 1);
+    appendItem(page, record, length);
+    return true;
+}
+
+bool addLogPageBoot(logPage *page, uint16_t boot) {
+    if (page->used + LOG_PAGE_BOOT_ITEM > LOG_PAGE_DATA) {
+        return false;
+    }
+    uint8_t mark[LOG_PAGE_BOOT_ITEM] = { LOG_PAGE_BOOT_MARK, (uint8_t)(boot >> 8), (uint8_t)boot };
+    appendItem(page, mark, sizeof(mark));
+    return true;
+}
+
+uint16_t logPageRoom(const logPage *page) {
+    return (page->used + 1 < LOG_PAGE_DATA) ? LOG_PAGE_DATA - page->used - 1 : 0;
+}
+
+bool checkLogPage(const logPage *page) {
+    if ((page->magic != LOG_PAGE_MAGIC) || (page->version != LOG_PAGE_VERSION) || (page->used > LOG_PAGE_DATA)) {
+        return false;
+    }
+    uint16_t crc = pageCRC(&page->sequence, sizeof(page->sequence), 0xFFFF);
+    return page->crc == pageCRC(page->data, page->used, crc);
+}
+
+bool nextLogPageItem(const logPage *page, uint16_t *at, logPageItem *item) {
+    if (*at >= page->used) {
+        return false;
+    }
+    uint8_t length = page->data[*at];
+    if (length == LOG_PAGE_BOOT_MARK) {
+        if (*at + LOG_PAGE_BOOT_ITEM > page->used) {
+            return false;
+        }
+        item->boot_mark = true;
+        item->boot = ((uint16_t)page->data[*at + 1] << 8) | page->data[*at + 2];
+        *at += LOG_PAGE_BOOT_ITEM;
+        return true;
+    }
+    if (*at + 1 + length > page->used) {
+        return false;
+    }
+    item->boot_mark = false;
+    item->record = &page->data[*at + 1];
+    item->length = length;
+    *at += 1 + length;
+    return true;
+}
+
+logFragment::logFragment(uint8_t *buffer, uint8_t start, uint8_t max_length, uint8_t max_level)
+    : buffer(buffer), start(start), pos(start), max_length(max_length), max_level(max_level) {}
+
+bool logFragment::pack(const logPage *page, uint16_t *at) {
+    // the boot at *at is in the last mark before it
+    bool boot_known = false;
+    uint16_t boot = 0;
+    uint16_t scan = 0;
+    logPageItem item;
+    while ((scan < *at) && nextLogPageItem(page, &scan, &item)) {
+        if (item.boot_mark) {
+            boot_known = true;
+            boot = item.boot;
+        }
+    }
+
+    uint16_t next = *at;
+    while (nextLogPageItem(page, &next, &item)) {
+        if (item.boot_mark) {
+            boot_known = true;
+            boot = item.boot;
+            *at = next;
+            continue;
+        }
+        if ((item.record[0] & LOG_RECORD_LEVEL_MASK) > max_level) {
+            *at = next;
+            continue;
+        }
+        bool mark = boot_known && (!boot_marked || (marked_boot != boot));
+        uint16_t needed = (mark ? LOG_PAGE_BOOT_ITEM : 0) + 1 + item.length;
+        if (start + LOG_PAGE_BOOT_ITEM + 1 + item.length > max_length) {
+            // never fits
+            *at = next;
+            continue;
+        }
+        if (pos + needed > max_length) {
+            return false;
+        }
+        if (mark) {
+            buffer[pos++] = LOG_PAGE_BOOT_MARK;
+            buffer[pos++] = (uint8_t)(boot >> 8);
+            buffer[pos++] = (uint8_t)boot;
+            boot_marked = true;
+            marked_boot = boot;
+        }
+        buffer[pos++] = item.length;
+        memcpy(&buffer[pos], item.record, item.length);
+        pos += item.length;
+        packed++;
+        *at = next;
+    }
+    return true;
+}
+
+void startLogWriteBudget(logWriteBudget *budget, uint32_t per_day_uj, uint32_t now_ms) {
+    budget->per_day_uj = per_day_uj;
+    budget->credit_uj = per_day_uj;
+    budget->last_ms = now_ms;
+}
+
+bool resumeLogWriteBudget(logWriteBudget *budget, uint32_t per_day_uj, uint32_t now_ms) {
+    if ((budget->per_day_uj != per_day_uj) || (budget->credit_uj > per_day_uj)) {
+        startLogWriteBudget(budget, per_day_uj, now_ms);
+        return false;
+    }
+    budget->last_ms = now_ms;
+    return true;
+}
+
+uint32_t logWriteCredit(logWriteBudget *budget, uint32_t now_ms) {
+    uint32_t elapsed_ms = now_ms - budget->last_ms;
+    uint64_t refill_uj = (uint64_t)elapsed_ms * budget->per_day_uj / MS_IN_DAY;
+    if (refill_uj == 0) {
+        // too soon for a whole µJ, leave last_ms so the time isn't lost
+        return budget->credit_uj;
+    }
+    // only the time the whole µJ account for, so the remainder counts towards the next refill
+    budget->last_ms += (uint32_t)(refill_uj * MS_IN_DAY / budget->per_day_uj);
+    uint64_t credit_uj = budget->credit_uj + refill_uj;
+    budget->credit_uj = (credit_uj > budget->per_day_uj) ? budget->per_day_uj : (uint32_t)credit_uj;
+    return budget->credit_uj;
+}
+
+bool spendLogWriteBudget(logWriteBudget *budget, uint32_t now_ms, uint32_t cost_uj) {
+    if (logWriteCredit(budget, now_ms) < cost_uj) {
+        return false;
+    }
+    budget->credit_uj -= cost_uj;
+    return true;
+}
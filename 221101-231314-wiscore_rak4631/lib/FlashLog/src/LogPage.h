@@ -0,0 +1,149 @@
+#pragma once
+/**
+ * @file LogPage.h
+ * @brief Pages of tokenised log records (see LogToken.h) as they are kept in RAM and on the flash, the uplink fragments
+ * they are sent back in, and the daily energy budget for writing them.
+ *
+ * A page is filled in RAM and written to the flash whole. Its data is a list of items: [length][record] for a record,
+ * or [0][boot (2 bytes, MSB first)] to mark the boot the records after it are from (their times are millis() of that
+ * boot). The header's CRC is kept up to date with every item, so a page left in RAM by a reset can be checked and kept.
+ *
+ * The budget is a bucket of energy that fills at the daily budget's rate, up to a day's worth. A page write takes its
+ * cost out of the bucket and isn't made if there isn't enough.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#define LOG_PAGE_SIZE      512  /**< Bytes in a page, header included. */
+#define LOG_PAGE_HEADER    12   /**< Bytes of logPage before data. */
+#define LOG_PAGE_DATA      (LOG_PAGE_SIZE - LOG_PAGE_HEADER)
+#define LOG_PAGE_MAGIC     0x10C5 /**< Marks a started page. */
+#define LOG_PAGE_VERSION   1      /**< Version of the page & item formats. */
+#define LOG_PAGE_BOOT_MARK 0      /**< Item length byte of a boot mark. */
+#define LOG_PAGE_BOOT_ITEM 3      /**< Bytes in a boot mark. */
+
+/** @brief A page of log items. */
+struct logPage {
+    uint16_t magic;    /**< LOG_PAGE_MAGIC once started. */
+    uint16_t version;  /**< LOG_PAGE_VERSION. */
+    uint32_t sequence; /**< Counts up with every page, a page is kept in slot sequence % the number of slots. */
+    uint16_t used;     /**< Bytes of items in data. */
+    uint16_t crc;      /**< CRC-16/CCITT-FALSE of sequence & the used bytes of data. */
+    uint8_t data[LOG_PAGE_DATA];
+};
+static_assert(sizeof(logPage) == LOG_PAGE_SIZE, "logPage isn't LOG_PAGE_SIZE bytes");
+
+/**
+ * @brief Empties a page and gives it a sequence number.
+ */
+void startLogPage(logPage *page, uint32_t sequence);
+
+/**
+ * @brief Adds a record.
+ * @return False if it doesn't fit (the page is left as it was).
+ */
+bool addLogPageRecord(logPage *page, const uint8_t *record, uint8_t length);
+
+/**
+ * @brief Adds a boot mark, the records added after it are from that boot.
+ * @return False if it doesn't fit.
+ */
+bool addLogPageBoot(logPage *page, uint16_t boot);
+
+/**
+ * @brief Room left for a record, not counting its length byte.
+ */
+uint16_t logPageRoom(const logPage *page);
+
+/**
+ * @brief True if the page was started, is this version and its items match the CRC, i.e. it was fully written.
+ */
+bool checkLogPage(const logPage *page);
+
+/** @brief An item read from a page. */
+struct logPageItem {
+    bool boot_mark;        /**< A boot mark rather than a record. */
+    uint16_t boot;         /**< Boot of a boot mark. */
+    const uint8_t *record; /**< Record in the page's data. */
+    uint8_t length;        /**< Record length. */
+};
+
+/**
+ * @brief Reads the item at *at and moves *at on to the next one. Start with *at = 0.
+ * @return False at the end of the page (or if the rest is malformed).
+ */
+bool nextLogPageItem(const logPage *page, uint16_t *at, logPageItem *item);
+
+/**
+ * @brief An uplink fragment being packed with the records of one or more pages: [length][record] items, with a boot
+ * mark before the first record and wherever the boot changes, so the fragment can be read on its own.
+ */
+class logFragment {
+  public:
+    /**
+     * @brief Starts packing.
+     * @param buffer Fragment buffer, the items go after the fragment's header.
+     * @param start Bytes of header before the items.
+     * @param max_length Max length of the fragment.
+     * @param max_level Records above this LOG_LEVEL (as a number) are left out.
+     */
+    logFragment(uint8_t *buffer, uint8_t start, uint8_t max_length, uint8_t max_level);
+
+    /**
+     * @brief Packs the page's records from *at until the fragment is full, moving *at past what was packed or left out.
+     * A record that wouldn't fit even in an empty fragment is left out.
+     * @return True if the rest of the page was packed, false if the fragment is full.
+     */
+    bool pack(const logPage *page, uint16_t *at);
+
+    /** @brief Length of the fragment, header included. */
+    inline uint8_t length(void) const { return pos; };
+
+    /** @brief Records packed. */
+    inline uint16_t records(void) const { return packed; };
+
+  private:
+    uint8_t *buffer;
+    uint8_t start;
+    uint8_t pos;
+    uint8_t max_length;
+    uint8_t max_level;
+    bool boot_marked = false; // a boot mark has been packed, and marked_boot is its boot
+    uint16_t marked_boot = 0;
+    uint16_t packed = 0;
+};
+
+/** @brief Energy bucket for flash writes. Plain data so it can be kept in RAM that isn't cleared. */
+struct logWriteBudget {
+    uint32_t per_day_uj; /**< Refill rate, and the most the bucket holds. */
+    uint32_t credit_uj;  /**< Energy that can be spent now. */
+    uint32_t last_ms;    /**< When it was last refilled. */
+};
+
+/**
+ * @brief Starts a budget, full.
+ * @param now_ms Current time in ms (e.g. millis(), may wrap).
+ */
+void startLogWriteBudget(logWriteBudget *budget, uint32_t per_day_uj, uint32_t now_ms);
+
+/**
+ * @brief Carries on with a budget after a reset, when millis() has started again. The time in between isn't credited.
+ * @return False if it doesn't look like a budget (e.g. RAM after a power on), it's started again full.
+ */
+bool resumeLogWriteBudget(logWriteBudget *budget, uint32_t per_day_uj, uint32_t now_ms);
+
+/**
+ * @brief Energy that can be spent now.
+ */
+uint32_t logWriteCredit(logWriteBudget *budget, uint32_t now_ms);
+
+/**
+ * @brief Takes the cost of a write out of the budget if there's enough.
+ * @return True if the write can be made.
+ */
+bool spendLogWriteBudget(logWriteBudget *budget, uint32_t now_ms, uint32_t cost_uj);
@@ -0,0 +1,85 @@
+#include "FlashStorage.h"
+
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+
+using namespace Adafruit_LittleFS_Namespace;
+
+static bool flash_mounted = false;
+
+bool initFlashStorage(void) {
+    if (flash_mounted) {
+        return true;
+    }
+    if (!InternalFS.begin()) {
+        LOG_ERROR("Unable to mount the internal flash file system.");
+        return false;
+    }
+    flash_mounted = true;
+    return true;
+}
+
+bool readFlashFile(const char *path, uint32_t offset, void *buffer, uint32_t length) {
+    if (!initFlashStorage()) {
+        return false;
+    }
+    File file(InternalFS);
+    if (!file.open(path, FILE_O_READ)) {
+        return false;
+    }
+    bool ok = file.seek(offset) && (file.read(buffer, length) == (int)length);
+    file.close();
+    return ok;
+}
+
+bool writeFlashFile(const char *path, uint32_t offset, const void *buffer, uint32_t length) {
+    if (!initFlashStorage()) {
+        return false;
+    }
+    File file(InternalFS);
+    // FILE_O_WRITE creates the file if needed and opens it at the end, so seek back to where we want to write
+    if (!file.open(path, FILE_O_WRITE)) {
+        LOG_ERROR("Unable to open %s for writing.", path);
+        return false;
+    }
+    bool ok = file.seek(offset) && (file.write((const uint8_t *)buffer, length) == length);
+    file.close();
+    if (!ok) {
+        LOG_ERROR("Unable to write %lu bytes to %s.", length, path);
+    }
+    return ok;
+}
+
+uint32_t flashFileSize(const char *path) {
+    if (!initFlashStorage()) {
+        return 0;
+    }
+    File file(InternalFS);
+    if (!file.open(path, FILE_O_READ)) {
+        return 0;
+    }
+    uint32_t size = file.size();
+    file.close();
+    return size;
+}
+
+bool removeFlashFile(const char *path) {
+    if (!initFlashStorage()) {
+        return false;
+    }
+    if (!InternalFS.exists(path)) {
+        return true;
+    }
+    return InternalFS.remove(path);
+}
+
+uint16_t flashCRC16(const void *data, uint32_t length, uint16_t crc) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)bytes[i] << 8;
+        for (uint8_t b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
@@ -0,0 +1,68 @@
+#pragma once
+/**
+ * @file FlashStorage.h
+ * @brief Small wrapper around the nRF52 internal flash file system (LittleFS via InternalFS).
+ * Every library that needs to keep data across resets (e.g. the Outbox) should go through these functions so that there
+ * is only one place that touches the flash.
+ * LittleFS already does block level wear levelling and is power-loss resilient, so the libraries using these functions
+ * only need to worry about how often they write, not where.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+
+#include "Logging.h" /**< Go here to change the logging level for the entire application. */
+
+/**
+ * @brief Mounts the internal flash file system. Safe to call more than once.
+ * @return True if successful, false if not.
+ */
+bool initFlashStorage(void);
+
+/**
+ * @brief Reads length bytes from the file at path, starting at offset.
+ * @param path Path of the file e.g. "/outbox.bin".
+ * @param offset Byte offset into the file to start reading from.
+ * @param buffer Buffer to place the data into.
+ * @param length Number of bytes to read.
+ * @return True if all length bytes were read, false if not (e.g. file does not exist or is too short).
+ */
+bool readFlashFile(const char *path, uint32_t offset, void *buffer, uint32_t length);
+
+/**
+ * @brief Writes length bytes to the file at path, starting at offset. The file is created if it does not exist.
+ * @param path Path of the file e.g. "/outbox.bin".
+ * @param offset Byte offset into the file to start writing at.
+ * @param buffer Data to write.
+ * @param length Number of bytes to write.
+ * @return True if all length bytes were written, false if not.
+ */
+bool writeFlashFile(const char *path, uint32_t offset, const void *buffer, uint32_t length);
+
+/**
+ * @brief Gets the size of the file at path.
+ * @param path Path of the file.
+ * @return Size of the file in bytes. 0 if it does not exist.
+ */
+uint32_t flashFileSize(const char *path);
+
+/**
+ * @brief Deletes the file at path.
+ * @param path Path of the file.
+ * @return True if the file was deleted (or did not exist), false if not.
+ */
+bool removeFlashFile(const char *path);
+
+/**
+ * @brief CRC-16/CCITT-FALSE of the given data. Used to detect records that were only partially written when the power
+ * went out.
+ * @param data Data to check.
+ * @param length Length of data.
+ * @param crc Starting CRC value, pass a previous result to continue a CRC over several buffers.
+ * @return The CRC.
+ */
+uint16_t flashCRC16(const void *data, uint32_t length, uint16_t crc = 0xFFFF);
@@ -0,0 +1,216 @@
+#include "History.h"
+
+#define HISTORY_MAGIC      0x4D15
+#define HISTORY_INIT_CHUNK 16 // slots read at once by init()
+
+uint16_t History::recordCRC(const storedRecord *stored) {
+    uint16_t crc = flashCRC16(&stored->sequence, sizeof(stored->sequence));
+    return flashCRC16(&stored->record, sizeof(historyRecord), crc);
+}
+
+bool History::init(void) {
+    LOG_DEBUG("Initialising history...");
+    if (request_mutex == NULL) {
+        request_mutex = xSemaphoreCreateMutex();
+    }
+    next_sequence = 0;
+    bool flash_ok = initFlashStorage();
+    memset(slot_valid, 0, sizeof(slot_valid));
+
+    // read in chunks rather than a file open per slot, it's done twice: once to find the newest, then to check the rest
+    storedRecord chunk[HISTORY_INIT_CHUNK];
+    uint32_t stored_slots = flash_ok ? flashFileSize(HISTORY_FILE) / sizeof(storedRecord) : 0;
+    stored_slots = (stored_slots > HISTORY_SLOTS) ? HISTORY_SLOTS : stored_slots;
+    for (uint8_t pass = 0; flash_ok && (pass < 2); pass++) {
+        uint32_t oldest = (next_sequence > HISTORY_SLOTS) ? next_sequence - HISTORY_SLOTS : 0;
+        for (uint16_t first = 0; first < stored_slots; first += HISTORY_INIT_CHUNK) {
+            uint16_t n = ((stored_slots - first) < HISTORY_INIT_CHUNK) ? stored_slots - first : HISTORY_INIT_CHUNK;
+            if (!readFlashFile(HISTORY_FILE, first * sizeof(storedRecord), chunk, n * sizeof(storedRecord))) {
+                break;
+            }
+            for (uint16_t i = 0; i < n; i++) {
+                storedRecord *stored = &chunk[i];
+                uint16_t slot = first + i;
+                if (pass == 1) {
+                    // a slot left over from an older lap of the ring (e.g. the newer write was lost) is stale
+                    slot_valid[slot] = slot_valid[slot] && (stored->sequence >= oldest);
+                    continue;
+                }
+                if ((stored->magic != HISTORY_MAGIC) || (stored->crc != recordCRC(stored)) ||
+                    ((stored->sequence % HISTORY_SLOTS) != slot)) {
+                    continue;
+                }
+                slot_valid[slot] = true;
+                slot_times[slot] = stored->record.time_s;
+                if (stored->sequence >= next_sequence) {
+                    next_sequence = stored->sequence + 1;
+                }
+            }
+        }
+    }
+    flushed_sequence = next_sequence;
+
+    LOG_INFO("History: %u summaries, next sequence %lu.", count(), next_sequence);
+    return flash_ok;
+}
+
+void History::append(const historyRecord *record) {
+    uint16_t slot = next_sequence % HISTORY_SLOTS;
+    buffered[next_sequence - flushed_sequence] = *record;
+    slot_times[slot] = record->time_s;
+    slot_valid[slot] = true;
+    next_sequence++;
+    if ((next_sequence - flushed_sequence) >= HISTORY_FLUSH_RECORDS) {
+        flush();
+    }
+}
+
+bool History::flush(void) {
+    bool ok = true;
+    storedRecord stored[HISTORY_FLUSH_RECORDS];
+    uint8_t n = next_sequence - flushed_sequence;
+    for (uint8_t i = 0; i < n; i++) {
+        stored[i].sequence = flushed_sequence + i;
+        stored[i].record = buffered[i];
+        stored[i].magic = HISTORY_MAGIC;
+        stored[i].crc = recordCRC(&stored[i]);
+    }
+    // consecutive slots are written together, split in two where the ring wraps
+    uint8_t i = 0;
+    while (i < n) {
+        uint16_t slot = stored[i].sequence % HISTORY_SLOTS;
+        uint8_t run = ((n - i) < (HISTORY_SLOTS - slot)) ? n - i : HISTORY_SLOTS - slot;
+        ok &= writeFlashFile(HISTORY_FILE, slot * sizeof(storedRecord), &stored[i], run * sizeof(storedRecord));
+        i += run;
+    }
+    if (!ok) {
+        LOG_ERROR("History: unable to write %u summaries.", n);
+    }
+    flushed_sequence = next_sequence;
+    return ok;
+}
+
+uint16_t History::count(void) const {
+    uint16_t n = 0;
+    for (uint16_t slot = 0; slot < HISTORY_SLOTS; slot++) {
+        n += slot_valid[slot] ? 1 : 0;
+    }
+    return n;
+}
+
+bool History::readRecord(uint32_t sequence, historyRecord *record) {
+    if (sequence >= flushed_sequence) {
+        *record = buffered[sequence - flushed_sequence];
+        return true;
+    }
+    storedRecord stored;
+    if (!readFlashFile(HISTORY_FILE, (sequence % HISTORY_SLOTS) * sizeof(storedRecord), &stored, sizeof(stored)) ||
+        (stored.magic != HISTORY_MAGIC) || (stored.crc != recordCRC(&stored)) || (stored.sequence != sequence)) {
+        return false;
+    }
+    *record = stored.record;
+    return true;
+}
+
+bool History::handleRequest(const uint8_t *buffer, uint8_t size) {
+    if ((size != HISTORY_REQUEST_SIZE) || (buffer[0] != HISTORY_VERSION)) {
+        LOG_WARN("History: bad backfill request (%u bytes).", size);
+        return false;
+    }
+    uint32_t start_s =
+        ((uint32_t)buffer[2] << 24) | ((uint32_t)buffer[3] << 16) | ((uint32_t)buffer[4] << 8) | buffer[5];
+    uint32_t end_s = ((uint32_t)buffer[6] << 24) | ((uint32_t)buffer[7] << 16) | ((uint32_t)buffer[8] << 8) | buffer[9];
+    xSemaphoreTake(request_mutex, portMAX_DELAY);
+    pending_id = buffer[1];
+    pending_start_s = start_s;
+    pending_end_s = end_s;
+    request_pending = true;
+    xSemaphoreGive(request_mutex);
+    LOG_INFO("History: backfill %u requested for %lu - %lu s.", buffer[1], start_s, end_s);
+    return true;
+}
+
+// on the radio task, so never between a prepareFragment() & its fragmentSent()
+void History::takePendingRequest(void) {
+    if (!request_pending) {
+        return;
+    }
+    xSemaphoreTake(request_mutex, portMAX_DELAY);
+    request_id = pending_id;
+    request_start_s = pending_start_s;
+    request_end_s = pending_end_s;
+    request_pending = false;
+    xSemaphoreGive(request_mutex);
+    cursor = (next_sequence > HISTORY_SLOTS) ? next_sequence - HISTORY_SLOTS : 0;
+    fragment = 0;
+    records_sent = 0;
+    request_active = true;
+}
+
+uint8_t History::prepareFragment(uint8_t *buffer, uint8_t max_length) {
+    takePendingRequest();
+    if (!request_active || (max_length < (HISTORY_FRAGMENT_HEADER + HISTORY_RECORD_SIZE))) {
+        return 0;
+    }
+    uint8_t pos = HISTORY_FRAGMENT_HEADER;
+    uint32_t sequence = cursor;
+    records_prepared = 0;
+    historyRecord record;
+    for (; sequence < next_sequence; sequence++) {
+        uint16_t slot = sequence % HISTORY_SLOTS;
+        if (!slot_valid[slot] || (slot_times[slot] < request_start_s) || (slot_times[slot] > request_end_s)) {
+            continue;
+        }
+        if (((pos + HISTORY_RECORD_SIZE) > max_length) ||
+            ((records_sent + records_prepared) >= HISTORY_BACKFILL_MAX_RECORDS)) {
+            break;
+        }
+        if (!readRecord(sequence, &record)) {
+            continue;
+        }
+        buffer[pos++] = (uint8_t)(record.time_s >> 24);
+        buffer[pos++] = (uint8_t)(record.time_s >> 16);
+        buffer[pos++] = (uint8_t)(record.time_s >> 8);
+        buffer[pos++] = (uint8_t)record.time_s;
+        buffer[pos++] = (uint8_t)(record.mean_ntu >> 8);
+        buffer[pos++] = (uint8_t)record.mean_ntu;
+        buffer[pos++] = (uint8_t)(record.min_ntu >> 8);
+        buffer[pos++] = (uint8_t)record.min_ntu;
+        buffer[pos++] = (uint8_t)(record.max_ntu >> 8);
+        buffer[pos++] = (uint8_t)record.max_ntu;
+        buffer[pos++] = (uint8_t)(record.battery_mv >> 8);
+        buffer[pos++] = (uint8_t)record.battery_mv;
+        records_prepared++;
+    }
+
+    // last if nothing in range is left, or the request's limit has been reached
+    bool more = false;
+    if ((records_sent + records_prepared) < HISTORY_BACKFILL_MAX_RECORDS) {
+        for (uint32_t s = sequence; s < next_sequence; s++) {
+            uint16_t slot = s % HISTORY_SLOTS;
+            if (slot_valid[slot] && (slot_times[slot] >= request_start_s) && (slot_times[slot] <= request_end_s)) {
+                more = true;
+                break;
+            }
+        }
+    }
+    prepared_last = !more;
+    cursor_after = sequence;
+
+    buffer[0] = HISTORY_VERSION;
+    buffer[1] = request_id;
+    buffer[2] = fragment;
+    buffer[3] = prepared_last ? HISTORY_FRAGMENT_LAST : 0;
+    return pos;
+}
+
+void History::fragmentSent(void) {
+    cursor = cursor_after;
+    records_sent += records_prepared;
+    fragment++;
+    if (prepared_last) {
+        request_active = false;
+        LOG_INFO("History: backfill %u done, %u summaries in %u fragments.", request_id, records_sent,
+            fragment);
+    }
+}
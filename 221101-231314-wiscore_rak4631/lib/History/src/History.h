@@ -0,0 +1,142 @@
+#pragma once
+/**
+ * @file History.h
+ * @brief Flash-backed ring of per-cycle reading summaries, and on-demand backfill of a time range over LoRaWAN.
+ *
+ * Every cycle a summary (time, mean/min/max turbidity, battery) is appended. Summaries are buffered in RAM and written
+ * to the flash HISTORY_FLUSH_RECORDS at a time to limit flash wear, so a reset loses at most that many. The time of each
+ * slot is kept in RAM so a range can be found without reading the flash.
+ *
+ * A backfill request downlink on HISTORY_PORT asks for a time range. The matching summaries are then sent back as
+ * fragments on HISTORY_PORT, one fragment per call to prepareFragment() (main.cpp sends one every
+ * HISTORY_BACKFILL_INTERVAL_MS) so a backfill doesn't use up the duty cycle. See the README for the formats.
+ *
+ * The request comes in on the LoRaWAN RX callback while the radio task may be part way through a fragment, so
+ * handleRequest() only stores it (under a mutex) and prepareFragment() takes it up before the next fragment.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+
+#include "FlashStorage.h" /**< Internal flash access. */
+#include "Logging.h"      /**< Go here to change the logging level for the entire application. */
+
+#define HISTORY_FILE                 "/history.bin" /**< Flash file that holds the ring of summaries. */
+#define HISTORY_SLOTS                384            /**< Summaries kept: 12.8 h at the 2 min normal interval. */
+#define HISTORY_FLUSH_RECORDS        8              /**< Summaries buffered in RAM before they are written. */
+#define HISTORY_PORT                 203            /**< Port for backfill requests & fragments (200-222 are system). */
+#define HISTORY_VERSION              1              /**< Version of the request & fragment formats. */
+#define HISTORY_REQUEST_SIZE         10             /**< [version][request id][start (4 bytes)][end (4 bytes)]. */
+#define HISTORY_FRAGMENT_HEADER      4              /**< [version][request id][fragment][flags]. */
+#define HISTORY_RECORD_SIZE          12             /**< Encoded historyRecord. */
+#define HISTORY_FRAGMENT_LAST        0x01           /**< Fragment flag: no more fragments for this request. */
+#define HISTORY_BACKFILL_MAX_RECORDS 96             /**< Most summaries sent for one request. */
+#define HISTORY_BACKFILL_INTERVAL_MS 30000          /**< Time between backfill fragments. */
+
+/** @brief Summary of one reading cycle. */
+struct historyRecord {
+    uint32_t time_s;      /**< Time of the reading in seconds. */
+    uint16_t mean_ntu;    /**< Mean of the turbidity samples. */
+    uint16_t min_ntu;     /**< Lowest turbidity sample. */
+    uint16_t max_ntu;     /**< Highest turbidity sample. */
+    uint16_t battery_mv;  /**< Battery voltage. */
+};
+
+/**
+ * @brief Ring of reading summaries on the internal flash, plus the state of a backfill request.
+ */
+class History {
+  public:
+    /**
+     * @brief Loads the slot times from the flash. Call once in setup(), before any downlink can arrive.
+     * @return True if successful, false if the flash couldn't be used (summaries are then only kept in RAM until
+     * written).
+     */
+    bool init(void);
+
+    /**
+     * @brief Appends a summary. Written to the flash every HISTORY_FLUSH_RECORDS summaries.
+     * @param record The summary. Times should only go forwards.
+     */
+    void append(const historyRecord *record);
+
+    /**
+     * @brief Writes any buffered summaries to the flash.
+     * @return True if successful (or nothing to write).
+     */
+    bool flush(void);
+
+    /**
+     * @brief Number of summaries kept.
+     */
+    uint16_t count(void) const;
+
+    /**
+     * @brief Parses a backfill request downlink. Called from the LoRaWAN RX callback, so only stores the request as
+     * pending. A new request replaces one in progress from the next prepareFragment().
+     * @param buffer Downlink payload.
+     * @param size Length of the payload.
+     * @return True if it was a valid request.
+     */
+    bool handleRequest(const uint8_t *buffer, uint8_t size);
+
+    /**
+     * @brief True while a backfill request has fragments left to send.
+     */
+    inline bool backfillPending(void) const { return request_active || request_pending; };
+
+    /**
+     * @brief Encodes the next fragment of the backfill request.
+     * @param buffer Buffer to encode into.
+     * @param max_length Max length of the fragment (at least HISTORY_FRAGMENT_HEADER + HISTORY_RECORD_SIZE).
+     * @return Length of the fragment, 0 if there's nothing to send.
+     */
+    uint8_t prepareFragment(uint8_t *buffer, uint8_t max_length);
+
+    /**
+     * @brief Moves on to the next fragment once the last prepared fragment has been sent.
+     */
+    void fragmentSent(void);
+
+  private:
+    /** @brief Record stored in each flash slot. */
+    struct storedRecord {
+        uint32_t sequence; // increments with every append, slot = sequence % HISTORY_SLOTS
+        historyRecord record;
+        uint16_t magic;
+        uint16_t crc; // of sequence & record
+    };
+
+    bool readRecord(uint32_t sequence, historyRecord *record);
+    static uint16_t recordCRC(const storedRecord *stored);
+    void takePendingRequest(void);
+
+    uint32_t slot_times[HISTORY_SLOTS] = {}; // RAM index: time of each slot
+    bool slot_valid[HISTORY_SLOTS] = {};
+    uint32_t next_sequence = 0;   // sequence of the next append
+    uint32_t flushed_sequence = 0; // summaries before this are on the flash
+    historyRecord buffered[HISTORY_FLUSH_RECORDS] = {};
+
+    // set in the RX callback, taken by prepareFragment()
+    SemaphoreHandle_t request_mutex = NULL; // held while using the pending request
+    volatile bool request_pending = false;
+    uint8_t pending_id = 0;
+    uint32_t pending_start_s = 0;
+    uint32_t pending_end_s = 0;
+
+    // the request being sent, only used by the radio task
+    bool request_active = false;
+    uint8_t request_id = 0;
+    uint32_t request_start_s = 0;
+    uint32_t request_end_s = 0;
+    uint32_t cursor = 0;         // sequence to search from for the next fragment
+    uint32_t cursor_after = 0;   // cursor once the prepared fragment has been sent
+    uint8_t fragment = 0;        // index of the next fragment
+    uint8_t prepared_last = 0;   // the prepared fragment was the last one
+    uint16_t records_sent = 0;
+    uint16_t records_prepared = 0;
+};
@@ -32,7 +32,7 @@ lmh_app_data_t lorawan_payload = {
 void setup() {
     // initialise the logging module - function does nothing if APP_LOG_LEVEL in Logging.h = NONE
     initLogging();
-    log(LOG_LEVEL::INFO,
+    LOG_INFO(
         "\n================================="
         "\nWelcome to Simple LoRaWAN Example"
         "\n=================================");
@@ -54,11 +54,11 @@ void loop() {
     // every lorawan_app_interval milliseconds check if the device is connected
     delay(lorawan_app_interval);
     if (isLoRaWANConnected()) {
-        log(LOG_LEVEL::DEBUG, "Send payload");
+        LOG_DEBUG("Send payload");
         // send sendLoRaWANFrame will do nothing if not connected anyway, but it's best practice to check
         sendLoRaWANFrame(&lorawan_payload);
     } else {
         // else log that it's not connected
-        log(LOG_LEVEL::DEBUG, "LoRaWAN not connected. Try again later.");
+        LOG_DEBUG("LoRaWAN not connected. Try again later.");
     }
 }
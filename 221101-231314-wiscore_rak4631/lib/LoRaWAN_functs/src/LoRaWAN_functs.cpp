@@ -7,18 +7,37 @@ SoftwareTimer *timer_to_start_on_join = nullptr;
 lmh_param_t lora_init_params;
 lmh_callback_t lora_init_callbacks;
 
+// set by setLoRaWANDownlinkHandler() to be called by lorawanRXHandler()
+LoRaWANDownlinkHandler downlink_handler = nullptr;
+
+// timer used to retry the join with backoff, and the number of failed attempts so far
+SoftwareTimer join_retry_timer;
+uint32_t join_attempts = 0;
+
+// millis() when the session was joined or restored, 0 until then, see getLoRaWANJoinedMs()
+volatile uint32_t joined_ms = 0;
+
+// airtime used by uplinks in the last 24 h, checked by sendLoRaWANFrame()
+airtimeLedger airtime_ledger(LORAWAN_AIRTIME_BUDGET_MS, LORAWAN_DWELL_TIME_MS);
+
+// uplinks since anything was heard from the network, and confirmed uplinks in a row that weren't acked
+volatile uint32_t uplinks_unheard = 0;
+volatile uint32_t link_checks_failed = 0;
+
 // forward declarations
+static void joinRetryTimerHandler(TimerHandle_t unused);
 static void lorawanJoinedHandler(void);
 static void lorawanJoinedFailedHandler(void);
 static void lorawanRXHandler(lmh_app_data_t *app_data);
+static void lorawanConfirmHandler(bool acked);
 
 bool initLoRaWAN(uint8_t *appEUI, uint8_t *deviceEUI, uint8_t *appKey, uint8_t tx_power) {
-    log(LOG_LEVEL::DEBUG, "Initialising LoRaWAN...");
+    LOG_DEBUG("Initialising LoRaWAN...");
 
     // Initialize LoRa chip.
     uint32_t ret = lora_rak4630_init(); // function return code
     if (ret != 0) {
-        log(LOG_LEVEL::ERROR, "lora_rak4630_init failed with return code: %d.", ret);
+        LOG_ERROR("lora_rak4630_init failed with return code: %d.", ret);
         return false;
     }
 
@@ -31,23 +50,30 @@ bool initLoRaWAN(uint8_t *appEUI, uint8_t *deviceEUI, uint8_t *appKey, uint8_t t
     lmh_setDevEui(deviceEUI);
     lmh_setAppKey(appKey);
 
+    // Load any saved session before lmh_init() as it also seeds the random number generator used for the DevNonce
+    loadLoRaWANSession(appEUI, deviceEUI, appKey);
+
     // Fill the init params and callback structs for passing to lmh_init()
     lora_init_params = { LORAWAN_ADR_OFF, LORAWAN_DEFAULT_DATARATE, LORAWAN_PUBLIC_NETWORK, LORAWAN_JOIN_TRIALS,
                          tx_power,        LORAWAN_DUTYCYCLE_OFF };
     lora_init_callbacks.BoardGetBatteryLevel = BoardGetBatteryLevel;
     lora_init_callbacks.BoardGetUniqueId = BoardGetUniqueId;
-    lora_init_callbacks.BoardGetRandomSeed = BoardGetRandomSeed;
+    lora_init_callbacks.BoardGetRandomSeed = getLoRaWANRandomSeed;
     lora_init_callbacks.lmh_RxData = lorawanRXHandler;
     lora_init_callbacks.lmh_has_joined = lorawanJoinedHandler;
     lora_init_callbacks.lmh_has_joined_failed = lorawanJoinedFailedHandler;
+    lora_init_callbacks.lmh_conf_result = lorawanConfirmHandler;
 
     // Initialize LoRaWan
     ret = lmh_init(&lora_init_callbacks, lora_init_params, true, loraClass, loraRegion);
     if (ret != 0) {
-        log(LOG_LEVEL::ERROR, "lmh_init failed with return code: %d.", ret);
+        LOG_ERROR("lmh_init failed with return code: %d.", ret);
         return false;
     }
 
+    // one-shot timer, the period is set each time a retry is scheduled
+    join_retry_timer.begin(LORAWAN_JOIN_BACKOFF_MIN_MS, joinRetryTimerHandler, NULL, false);
+
     return true;
 }
 
@@ -58,59 +84,191 @@ bool initLoRaWAN(SoftwareTimer *timer, uint8_t *appEUI, uint8_t *deviceEUI, uint
     return initLoRaWAN(appEUI, deviceEUI, appKey, tx_power);
 }
 
+void setLoRaWANDownlinkHandler(LoRaWANDownlinkHandler handler) {
+    downlink_handler = handler;
+}
+
+bool setLoRaWANTxPower(uint8_t tx_power) {
+    MibRequestConfirm_t mib;
+    mib.Type = MIB_CHANNELS_TX_POWER;
+    mib.Param.ChannelsTxPower = tx_power;
+    if (LoRaMacMibSetRequestConfirm(&mib) != LORAMAC_STATUS_OK) {
+        LOG_ERROR("Unable to set TX power %u.", tx_power);
+        return false;
+    }
+    return true;
+}
+
+void startLoRaWANJoinProcedure(void) {
+    if (restoreLoRaWANSession()) {
+        joined_ms = millis();
+        if (setLoRaWANClass() && (timer_to_start_on_join != NULL)) {
+            timer_to_start_on_join->start();
+        }
+        return;
+    }
+    lmh_join();
+}
+
 // used by sendLoRaWANFrame() for logging
 uint32_t count = 0;
 uint32_t count_fail = 0;
 
-void sendLoRaWANFrame(lmh_app_data_t *lora_app_data) {
+bool sendLoRaWANFrame(lmh_app_data_t *lora_app_data) {
     if (!isLoRaWANConnected()) {
-        log(LOG_LEVEL::ERROR, "Device has not joined the network. Try again later.");
-        return;
+        LOG_ERROR("Device has not joined the network. Try again later.");
+        return false;
+    }
+
+    uint8_t data_rate = getLoRaWANDataRate();
+    switch (airtime_ledger.check(millis(), data_rate, lora_app_data->buffsize)) {
+        case AIRTIME_DECISION::TOO_LONG:
+            // the caller has to send it smaller (see getLoRaWANDwellPayloadLength()) or drop it
+            LOG_WARN("%u byte frame is over the dwell time at DR%u. Not sent.", lora_app_data->buffsize,
+                data_rate);
+            return false;
+        case AIRTIME_DECISION::DEFER:
+            LOG_WARN("Airtime budget used up (%lu ms in 24 h). Not sent.", airtime_ledger.usedMs(millis()));
+            return false;
+        default:
+            break;
     }
 
-    log(LOG_LEVEL::DEBUG, "Sending payload frame now...");
-    lmh_error_status ret = lmh_send(lora_app_data, loraConfirm);
+    // nothing heard for a while, ask the network to ack this one so a session it no longer knows is noticed
+    bool link_check = (uplinks_unheard >= LORAWAN_LINK_CHECK_UPLINKS);
+    LOG_DEBUG("Sending payload frame now...");
+    lmh_error_status ret = lmh_send(lora_app_data, link_check ? LMH_CONFIRMED_MSG : loraConfirm);
     if (ret == LMH_SUCCESS) {
         count++;
-        log(LOG_LEVEL::DEBUG, "lmh_send ok count %d.", count);
-    } else {
-        count_fail++;
-        log(LOG_LEVEL::ERROR, "lmh_send fail count %d.", count_fail);
+        uplinks_unheard++;
+        airtime_ledger.record(millis(), lorawanTimeOnAirUs(data_rate, lora_app_data->buffsize));
+        LOG_DEBUG("lmh_send ok count %d. Airtime %lu/%lu ms in 24 h.", count,
+            airtime_ledger.usedMs(millis()), (uint32_t)LORAWAN_AIRTIME_BUDGET_MS);
+        // commits the frame counters every LORAWAN_SESSION_COMMIT_INTERVAL uplinks
+        saveLoRaWANSession(false);
+        return true;
     }
+    count_fail++;
+    LOG_ERROR("lmh_send fail count %d.", count_fail);
+    return false;
+}
+
+uint8_t getLoRaWANDataRate(void) {
+    MibRequestConfirm_t mib;
+    mib.Type = MIB_CHANNELS_DATARATE;
+    LoRaMacMibGetRequestConfirm(&mib);
+    return mib.Param.ChannelsDatarate;
 }
 
+uint8_t getLoRaWANMaxPayloadLength(void) {
+    return airtime_ledger.maxPayload(millis(), getLoRaWANDataRate());
+}
+
+uint8_t getLoRaWANDwellPayloadLength(void) {
+    return airtime_ledger.dwellPayload(getLoRaWANDataRate());
+}
+
+void getLoRaWANAirtime(airtimeStatus *status) {
+    airtime_ledger.status(millis(), status);
+}
+
+void saveLoRaWANAirtime(airtimeLedgerState *state) { airtime_ledger.save(state, millis()); }
+
+void resumeLoRaWANAirtime(const airtimeLedgerState *state, uint32_t asleep_ms) {
+    airtime_ledger.resume(state, asleep_ms, millis());
+}
+
+uint32_t getLoRaWANJoinedMs(void) { return joined_ms; }
+
 /**
  * @brief LoRa function for handling HasJoined event.
  * Sends LoRa class change and starts app timer to send the payload periodically.
  */
 void lorawanJoinedHandler(void) {
-    log(LOG_LEVEL::INFO, "Network Joined!");
+    LOG_INFO("Network Joined!");
+    joined_ms = millis();
+    join_attempts = 0;
+    uplinks_unheard = 0;
+    link_checks_failed = 0;
+    // new keys & counters, save them so the next reset can skip the join
+    saveLoRaWANSession(true);
     if (setLoRaWANClass()) {
         // if given a SoftwareTimer in initLoRaWAN
         if (timer_to_start_on_join != NULL) {
             timer_to_start_on_join->start();
         }
     }
-    delay(1000); // This ensures the log message is printed
 }
 
 /**
  * @brief LoRa function for handling OTAA join failed.
+ * Schedules another join attempt. The wait doubles with each failure (up to LORAWAN_JOIN_BACKOFF_MAX_MS) and is
+ * randomised between half and all of that so a fleet that lost power together doesn't retry together.
  */
 void lorawanJoinedFailedHandler(void) {
-    log(LOG_LEVEL::ERROR, "OTAA join failed!");
-    log(LOG_LEVEL::ERROR, "Check your EUI's and Keys's!");
-    log(LOG_LEVEL::ERROR, "Check if a Gateway is in range!");
-    delay(1000); // This ensures the log messages are printed
+    LOG_ERROR("OTAA join failed!");
+    LOG_ERROR("Check your EUI's and Keys's!");
+    LOG_ERROR("Check if a Gateway is in range!");
+
+    uint32_t backoff = LORAWAN_JOIN_BACKOFF_MAX_MS;
+    if (join_attempts < 16) {
+        backoff = min((uint32_t)LORAWAN_JOIN_BACKOFF_MIN_MS << join_attempts, (uint32_t)LORAWAN_JOIN_BACKOFF_MAX_MS);
+    }
+    uint32_t wait = (backoff / 2) + random(backoff / 2);
+    join_attempts++;
+    LOG_INFO("Join attempt %lu failed, retrying in %lu s.", join_attempts, wait / 1000);
+    join_retry_timer.setPeriod(wait);
+    join_retry_timer.start();
+}
+
+/**
+ * @brief Retries the join once the backoff set in lorawanJoinedFailedHandler() has passed.
+ */
+void joinRetryTimerHandler(TimerHandle_t unused) {
+    lmh_join();
 }
 
 /**
  * @brief Function for handling LoRaWan received data from Gateway.
- * As we're not expecting any RX the app_data is just logged for now.
+ * The app_data is logged and passed to the handler set by setLoRaWANDownlinkHandler().
  * @param app_data  Pointer to rx data
  */
 void lorawanRXHandler(lmh_app_data_t *app_data) {
-    log(LOG_LEVEL::INFO, "LoRa Packet received on port %d, size:%d, rssi:%d, snr:%d, data:%s\n", app_data->port,
-        app_data->buffsize, app_data->rssi, app_data->snr, app_data->buffer);
-    delay(1000); // This ensures the log message is printed
+    LOG_INFO("LoRa Packet received on port %d, size:%d, rssi:%d, snr:%d", app_data->port,
+        app_data->buffsize, app_data->rssi, app_data->snr);
+    uplinks_unheard = 0;
+    link_checks_failed = 0;
+    if (downlink_handler != nullptr) {
+        downlink_handler(app_data->port, app_data->buffer, app_data->buffsize);
+    }
+}
+
+/**
+ * @brief LoRa function for handling the end of a confirmed uplink (see sendLoRaWANFrame()).
+ * An ack means the session is still good. After LORAWAN_LINK_CHECK_RETRIES unacked in a row the network has probably
+ * lost the session (the device was re-added, or its frame counter was rejected), so it's cleared and the device
+ * rejoins, with the usual backoff if that fails.
+ * @param acked True if the network acked the uplink.
+ */
+void lorawanConfirmHandler(bool acked) {
+    if (acked) {
+        uplinks_unheard = 0;
+        link_checks_failed = 0;
+        return;
+    }
+    link_checks_failed++;
+    LOG_WARN("Confirmed uplink %lu not acked.", link_checks_failed);
+    if (link_checks_failed < LORAWAN_LINK_CHECK_RETRIES) {
+        return;
+    }
+    LOG_ERROR("No answer from the network in %lu uplinks, rejoining.", uplinks_unheard);
+    uplinks_unheard = 0;
+    link_checks_failed = 0;
+    clearLoRaWANSession();
+    MibRequestConfirm_t mib;
+    mib.Type = MIB_NETWORK_JOINED;
+    mib.Param.IsNetworkJoined = false;
+    LoRaMacMibSetRequestConfirm(&mib);
+    join_attempts = 0;
+    lmh_join();
 }
@@ -1,3 +1,4 @@
+#pragma once
 /**
  * @file LoRaWAN_functs.h
  * @author Kalina Knight
@@ -14,14 +15,22 @@
 
 #include <LoRaWan-RAK4630.h>
 
+#include "AirtimeBudget.h"   /**< Time on air & the rolling airtime ledger. */
+#include "LoRaWAN_session.h" /**< Saves/restores the session so a reset doesn't need a full join. */
 #include "Logging.h"
 
 // LoRaWAN Config/Default Parameters - feel free to change these defaults to whatever suits the project
 static const DeviceClass_t loraClass = CLASS_A;                 /**< Class definition. */
 static const LoRaMacRegion_t loraRegion = LORAMAC_REGION_AU915; /**< Region:AU915. */
 static const lmh_confirm loraConfirm = LMH_UNCONFIRMED_MSG;     /**< Confirm/unconfirm packet definition. */
-#define LORAWAN_JOIN_TRIALS 3                                   /**< Join request reattempts. */
+#define LORAWAN_JOIN_TRIALS 3                                   /**< Join request reattempts per join attempt. */
+#define LORAWAN_JOIN_BACKOFF_MIN_MS 60000                       /**< Wait after the first failed join attempt. */
+#define LORAWAN_JOIN_BACKOFF_MAX_MS (60 * 60 * 1000)            /**< Longest wait between join attempts. */
 #define PAYLOAD_BUFFER_SIZE 64                                  /**< Data payload buffer size. */
+#define LORAWAN_AIRTIME_BUDGET_MS 30000                         /**< Airtime allowed per 24 h (TTN fair use: 30 s). */
+#define LORAWAN_DWELL_TIME_MS 400                               /**< Longest uplink allowed (AU915 dwell time). */
+#define LORAWAN_LINK_CHECK_UPLINKS 24                           /**< Unheard uplinks before one is confirmed. */
+#define LORAWAN_LINK_CHECK_RETRIES 3                            /**< Unacked confirmed uplinks before rejoining. */
 
 /**
  * @brief Initialise LoRaWAN.
@@ -44,19 +53,91 @@ bool initLoRaWAN(uint8_t *appEUI, uint8_t *deviceEUI, uint8_t *appKey, uint8_t t
  */
 bool initLoRaWAN(SoftwareTimer *timer, uint8_t *appEUI, uint8_t *deviceEUI, uint8_t *appKey, uint8_t tx_power = LORAWAN_DEFAULT_TX_POWER);
 
+/**
+ * @brief Function called with every downlink received. See setLoRaWANDownlinkHandler().
+ * @param port Port the downlink was received on.
+ * @param buffer Downlink payload.
+ * @param size Length of the payload.
+ */
+typedef void (*LoRaWANDownlinkHandler)(uint8_t port, const uint8_t *buffer, uint8_t size);
+
+/**
+ * @brief Sets the function to be called with downlinks. It is called from the LoRaMac RX callback, so it should only
+ * parse and store the data, not act on it.
+ * @param handler Downlink handler, or NULL to only log downlinks.
+ */
+void setLoRaWANDownlinkHandler(LoRaWANDownlinkHandler handler);
+
+/**
+ * @brief Changes the TX power setting after initLoRaWAN().
+ * @param tx_power TX power setting. TX_POWER_0 - TX_POWER_10 valid for AU915.
+ * @return True if successful, false if not.
+ */
+bool setLoRaWANTxPower(uint8_t tx_power);
+
 /**
  * @brief Attempt to join the LoRaWAN network.
- * Once connected the joined callback set in initLoRaWAN() will be called.
+ * If a session was saved before the last reset it is restored instead and no join is needed.
+ * Once connected the joined callback set in initLoRaWAN() will be called. If the join fails it is retried with
+ * exponential backoff (LORAWAN_JOIN_BACKOFF_MIN_MS doubling up to LORAWAN_JOIN_BACKOFF_MAX_MS, plus jitter) until it
+ * succeeds.
  */
-inline void startLoRaWANJoinProcedure(void) {
-    lmh_join();
-};
+void startLoRaWANJoinProcedure(void);
 
 /**
  * @brief Sends a frame with the data provided.
+ * The frame is only sent if its time on air at the current data rate is within LORAWAN_DWELL_TIME_MS and the airtime
+ * used in the last 24 h stays within LORAWAN_AIRTIME_BUDGET_MS. Otherwise it isn't sent and should be queued (and sent
+ * later or as smaller frames, see getLoRaWANMaxPayloadLength()).
  * @param lora_app_data Data to be sent.
+ * @return True if the frame was accepted by lmh_send(), false if not joined, over the airtime budget or dwell time,
+ * or the send failed.
+ */
+bool sendLoRaWANFrame(lmh_app_data_t *lora_app_data);
+
+/**
+ * @brief Gets the current uplink data rate.
+ * @return DR0 - DR6.
+ */
+uint8_t getLoRaWANDataRate(void);
+
+/**
+ * @brief Longest payload sendLoRaWANFrame() would send right now, given the data rate, dwell time & airtime left.
+ * @return Length in bytes, 0 if the airtime budget is used up.
+ */
+uint8_t getLoRaWANMaxPayloadLength(void);
+
+/**
+ * @brief Longest payload the dwell time allows at the current data rate, however much airtime is left. A longer frame
+ * can't be sent until the data rate goes up.
+ * @return Length in bytes.
+ */
+uint8_t getLoRaWANDwellPayloadLength(void);
+
+/**
+ * @brief Gets the airtime used, the budget and how many frames have been held back, e.g. for telemetry.
+ * @param status Filled with the airtime ledger state.
+ */
+void getLoRaWANAirtime(airtimeStatus *status);
+
+/**
+ * @brief Saves the airtime ledger before a deep sleep, so the 24 h budget isn't reset by the wake.
+ * @param state Filled with the ledger.
+ */
+void saveLoRaWANAirtime(airtimeLedgerState *state);
+
+/**
+ * @brief Carries on from the airtime ledger saved before a deep sleep.
+ * @param state From saveLoRaWANAirtime().
+ * @param asleep_ms Time spent asleep.
+ */
+void resumeLoRaWANAirtime(const airtimeLedgerState *state, uint32_t asleep_ms);
+
+/**
+ * @brief Gets when this boot's session was joined (or restored), e.g. for the boot timeline.
+ * @return millis() at the time, 0 if not yet.
  */
-void sendLoRaWANFrame(lmh_app_data_t *lora_app_data);
+uint32_t getLoRaWANJoinedMs(void);
 
 /**
  * @brief Gets the status of the current LoRaWAN connection.
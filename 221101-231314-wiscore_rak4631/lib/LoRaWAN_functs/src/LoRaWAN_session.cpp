@@ -0,0 +1,187 @@
+#include "LoRaWAN_session.h"
+
+#define LORAWAN_SESSION_MAGIC   0x5E55
+#define LORAWAN_SESSION_VERSION 2
+#define LORAWAN_SESSION_SLOTS   2
+
+// the stack's parameters; the MIB has no entry for the RX1 data rate offset
+extern LoRaMacParams_t LoRaMacParams;
+
+/** @brief Session as stored in each flash slot. */
+struct loraWANSession {
+    uint16_t magic;
+    uint8_t version;
+    uint8_t has_session;     // false if only the join nonce is valid
+    uint32_t commit;         // increments with every commit, newest valid slot wins
+    uint16_t credentials;    // flashCRC16 of the EUIs & app key the session belongs to
+    uint16_t reserved;
+    uint32_t join_nonce;     // mixed into the random seed, bumped every boot that has to join
+    uint32_t net_id;
+    uint32_t dev_addr;
+    uint8_t nwk_s_key[16];
+    uint8_t app_s_key[16];
+    uint32_t uplink_counter;
+    uint32_t downlink_counter;
+    uint32_t rx1_delay_ms;   // the receive settings from the join accept: RxDelay,
+    uint32_t rx2_delay_ms;
+    uint32_t rx2_frequency;  // the RX2 channel
+    uint8_t rx2_data_rate;   // and DLSettings
+    uint8_t rx1_dr_offset;
+    uint16_t crc;            // flashCRC16 of everything above
+};
+
+static loraWANSession session = {};   // last session loaded or committed
+static bool session_valid = false;    // session holds keys for the current credentials
+static uint16_t credentials_crc = 0;  // flashCRC16 of the current EUIs & app key
+
+static bool commitSession(void) {
+    session.magic = LORAWAN_SESSION_MAGIC;
+    session.version = LORAWAN_SESSION_VERSION;
+    session.credentials = credentials_crc;
+    session.commit++;
+    session.crc = flashCRC16(&session, offsetof(loraWANSession, crc));
+    uint32_t offset = (session.commit % LORAWAN_SESSION_SLOTS) * sizeof(loraWANSession);
+    return writeFlashFile(LORAWAN_SESSION_FILE, offset, &session, sizeof(loraWANSession));
+}
+
+bool loadLoRaWANSession(const uint8_t *appEUI, const uint8_t *deviceEUI, const uint8_t *appKey) {
+    credentials_crc = flashCRC16(appEUI, 8);
+    credentials_crc = flashCRC16(deviceEUI, 8, credentials_crc);
+    credentials_crc = flashCRC16(appKey, 16, credentials_crc);
+
+    // find the newest valid slot
+    bool found = false;
+    loraWANSession slot;
+    for (uint8_t s = 0; s < LORAWAN_SESSION_SLOTS; s++) {
+        if (!readFlashFile(LORAWAN_SESSION_FILE, s * sizeof(loraWANSession), &slot, sizeof(loraWANSession))) {
+            continue;
+        }
+        if ((slot.magic != LORAWAN_SESSION_MAGIC) || (slot.version != LORAWAN_SESSION_VERSION) ||
+            (slot.crc != flashCRC16(&slot, offsetof(loraWANSession, crc)))) {
+            continue;
+        }
+        if (!found || (slot.commit > session.commit)) {
+            session = slot;
+            found = true;
+        }
+    }
+
+    session_valid = found && session.has_session && (session.credentials == credentials_crc);
+    if (session_valid) {
+        LOG_INFO("Found saved LoRaWAN session: DevAddr %08lX, FCntUp %lu.", session.dev_addr,
+            session.uplink_counter);
+        return true;
+    }
+
+    // a join is needed: bump the join nonce so this boot's DevNonces differ from the last one's
+    session.has_session = false;
+    session.join_nonce++;
+    commitSession();
+    LOG_DEBUG("No saved LoRaWAN session, join nonce %lu.", session.join_nonce);
+    return false;
+}
+
+bool restoreLoRaWANSession(void) {
+    if (!session_valid) {
+        return false;
+    }
+
+    // skip ahead of any uplinks sent since the last commit so the counter never goes backwards
+    session.uplink_counter += LORAWAN_SESSION_COMMIT_INTERVAL;
+
+    MibRequestConfirm_t mib;
+    mib.Type = MIB_NET_ID;
+    mib.Param.NetID = session.net_id;
+    LoRaMacMibSetRequestConfirm(&mib);
+    mib.Type = MIB_DEV_ADDR;
+    mib.Param.DevAddr = session.dev_addr;
+    LoRaMacMibSetRequestConfirm(&mib);
+    mib.Type = MIB_NWK_SKEY;
+    mib.Param.NwkSKey = session.nwk_s_key;
+    LoRaMacMibSetRequestConfirm(&mib);
+    mib.Type = MIB_APP_SKEY;
+    mib.Param.AppSKey = session.app_s_key;
+    LoRaMacMibSetRequestConfirm(&mib);
+    mib.Type = MIB_UPLINK_COUNTER;
+    mib.Param.UpLinkCounter = session.uplink_counter;
+    LoRaMacMibSetRequestConfirm(&mib);
+    mib.Type = MIB_DOWNLINK_COUNTER;
+    mib.Param.DownLinkCounter = session.downlink_counter;
+    LoRaMacMibSetRequestConfirm(&mib);
+    mib.Type = MIB_RECEIVE_DELAY_1;
+    mib.Param.ReceiveDelay1 = session.rx1_delay_ms;
+    LoRaMacMibSetRequestConfirm(&mib);
+    mib.Type = MIB_RECEIVE_DELAY_2;
+    mib.Param.ReceiveDelay2 = session.rx2_delay_ms;
+    LoRaMacMibSetRequestConfirm(&mib);
+    mib.Type = MIB_RX2_CHANNEL;
+    mib.Param.Rx2Channel.Frequency = session.rx2_frequency;
+    mib.Param.Rx2Channel.Datarate = session.rx2_data_rate;
+    LoRaMacMibSetRequestConfirm(&mib);
+    LoRaMacParams.Rx1DrOffset = session.rx1_dr_offset;
+    mib.Type = MIB_NETWORK_JOINED;
+    mib.Param.IsNetworkJoined = true;
+    LoRaMacMibSetRequestConfirm(&mib);
+
+    // commit straight away so a second reset skips ahead again rather than reusing these counters
+    commitSession();
+    LOG_INFO("LoRaWAN session restored, skipping join.");
+    return true;
+}
+
+void saveLoRaWANSession(bool force) {
+    MibRequestConfirm_t mib;
+    mib.Type = MIB_UPLINK_COUNTER;
+    LoRaMacMibGetRequestConfirm(&mib);
+    uint32_t uplink_counter = mib.Param.UpLinkCounter;
+
+    if (!force && session_valid && (uplink_counter < session.uplink_counter + LORAWAN_SESSION_COMMIT_INTERVAL)) {
+        // not worth a flash write yet
+        return;
+    }
+
+    mib.Type = MIB_NET_ID;
+    LoRaMacMibGetRequestConfirm(&mib);
+    session.net_id = mib.Param.NetID;
+    mib.Type = MIB_DEV_ADDR;
+    LoRaMacMibGetRequestConfirm(&mib);
+    session.dev_addr = mib.Param.DevAddr;
+    mib.Type = MIB_NWK_SKEY;
+    LoRaMacMibGetRequestConfirm(&mib);
+    memcpy(session.nwk_s_key, mib.Param.NwkSKey, sizeof(session.nwk_s_key));
+    mib.Type = MIB_APP_SKEY;
+    LoRaMacMibGetRequestConfirm(&mib);
+    memcpy(session.app_s_key, mib.Param.AppSKey, sizeof(session.app_s_key));
+    mib.Type = MIB_DOWNLINK_COUNTER;
+    LoRaMacMibGetRequestConfirm(&mib);
+    session.downlink_counter = mib.Param.DownLinkCounter;
+    mib.Type = MIB_RECEIVE_DELAY_1;
+    LoRaMacMibGetRequestConfirm(&mib);
+    session.rx1_delay_ms = mib.Param.ReceiveDelay1;
+    mib.Type = MIB_RECEIVE_DELAY_2;
+    LoRaMacMibGetRequestConfirm(&mib);
+    session.rx2_delay_ms = mib.Param.ReceiveDelay2;
+    mib.Type = MIB_RX2_CHANNEL;
+    LoRaMacMibGetRequestConfirm(&mib);
+    session.rx2_frequency = mib.Param.Rx2Channel.Frequency;
+    session.rx2_data_rate = mib.Param.Rx2Channel.Datarate;
+    session.rx1_dr_offset = LoRaMacParams.Rx1DrOffset;
+    session.uplink_counter = uplink_counter;
+    session.has_session = true;
+
+    if (commitSession()) {
+        session_valid = true;
+        LOG_DEBUG("LoRaWAN session saved, FCntUp %lu.", uplink_counter);
+    }
+}
+
+void clearLoRaWANSession(void) {
+    session_valid = false;
+    session.has_session = false;
+    commitSession();
+}
+
+uint32_t getLoRaWANRandomSeed(void) {
+    // Knuth's multiplicative hash spreads consecutive nonces across the whole seed
+    return BoardGetRandomSeed() ^ (session.join_nonce * 2654435761UL);
+}
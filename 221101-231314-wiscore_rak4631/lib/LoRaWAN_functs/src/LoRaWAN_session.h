@@ -0,0 +1,66 @@
+#pragma once
+/**
+ * @file LoRaWAN_session.h
+ * @brief Persists the LoRaWAN session (DevAddr, session keys, frame counters and the RX window settings from the join
+ * accept) to the internal flash so the device can resume it after a reset or brownout instead of doing a full OTAA join
+ * every time.
+ *
+ * Frame counters change with every uplink so they are only committed every LORAWAN_SESSION_COMMIT_INTERVAL uplinks.
+ * On restore the uplink counter is advanced by that interval so it can never go backwards (which the network server
+ * would reject). The session is stored in two alternating slots so a reset part way through a commit always leaves
+ * the previous commit intact.
+ *
+ * DevNonce: this LoRaMac stack draws the DevNonce from its random number generator, so instead of a DevNonce counter a
+ * join nonce is persisted and mixed into the random seed. This stops the same DevNonce sequence being repeated after
+ * every reset (the network rejects reused DevNonces).
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <LoRaWan-RAK4630.h> // Click to get library: https://platformio.org/lib/show/6601/SX126x-Arduino
+
+#include "FlashStorage.h" /**< Internal flash access. */
+#include "Logging.h"      /**< Go here to change the logging level for the entire application. */
+
+#define LORAWAN_SESSION_FILE            "/lorawan_session.bin" /**< Flash file the session is saved in. */
+#define LORAWAN_SESSION_COMMIT_INTERVAL 32 /**< Commit the frame counters every N uplinks. */
+
+/**
+ * @brief Loads the saved session from flash.
+ * The session is only considered valid if it was saved with the same EUIs & app key.
+ * Must be called before lmh_init() as it also sets up the random seed (see getLoRaWANRandomSeed()).
+ * @param appEUI    OTAA key app EUI.
+ * @param deviceEUI OTAA key device EUI.
+ * @param appKey    OTAA key app key.
+ * @return True if a valid session was found, false if a join is required.
+ */
+bool loadLoRaWANSession(const uint8_t *appEUI, const uint8_t *deviceEUI, const uint8_t *appKey);
+
+/**
+ * @brief Puts the session found by loadLoRaWANSession() into the LoRaMac stack, marking the device as joined.
+ * Must be called after lmh_init().
+ * @return True if the session was restored, false if there was no valid session.
+ */
+bool restoreLoRaWANSession(void);
+
+/**
+ * @brief Reads the current session from the LoRaMac stack and commits it to flash.
+ * @param force If false the session is only written if the uplink counter has moved on by
+ * LORAWAN_SESSION_COMMIT_INTERVAL since the last commit. Use true after a join.
+ */
+void saveLoRaWANSession(bool force);
+
+/**
+ * @brief Forgets the saved session so the next boot does a full join.
+ */
+void clearLoRaWANSession(void);
+
+/**
+ * @brief Random seed for the LoRaMac stack (lmh_callback_t::BoardGetRandomSeed).
+ * Mixes the persisted join nonce into the board's random seed.
+ * @return Random seed.
+ */
+uint32_t getLoRaWANRandomSeed(void);
@@ -26,12 +26,11 @@ void setup() {
     initLogging();
 
     // now start logging :)
-    log(LOG_LEVEL::DEBUG, "This is a DEBUG level log message.");
-    log(LOG_LEVEL::INFO, "This is an INFO level log message.");
-    log(LOG_LEVEL::WARN, "This is a WARN level log message.");
-    log(LOG_LEVEL::ERROR, "This is an ERROR level log message.");
+    LOG_DEBUG("This is a DEBUG level log message.");
+    LOG_INFO("This is an INFO level log message.");
+    LOG_WARN("This is a WARN level log message.");
+    LOG_ERROR("This is an ERROR level log message.");
     // APP_LOG_LEVEL = LOG_LEVEL::NONE disables logging.
-    log(LOG_LEVEL::NONE, "This message will never print as the level doesn't really make sense.");
 
     seconds = 0;
 }
@@ -43,5 +42,5 @@ void loop() {
     delay(1000);
     seconds++;
     // printf style formatting can also be used in log messages
-    log(LOG_LEVEL::DEBUG, "Using printf style formatting: \n\t\t     Time elapsed = %lu seconds", seconds);
+    LOG_DEBUG("Using printf style formatting: \n\t\t     Time elapsed = %lu seconds", seconds);
 }
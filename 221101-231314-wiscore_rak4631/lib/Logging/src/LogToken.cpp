@@ -0,0 +1,330 @@
+#include "LogToken.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+logRecord::logRecord(uint8_t level, uint32_t time_ms, uint32_t token) {
+    buffer[used++] = level;
+    addVarint(time_ms);
+    for (uint8_t i = 0; i < 4; i++) {
+        buffer[used++] = (uint8_t)(token >> (8 * i));
+    }
+}
+
+bool logRecord::reserve(uint8_t bytes) {
+    if (used + bytes > LOG_RECORD_MAX) {
+        buffer[0] |= LOG_RECORD_TRUNCATED;
+        return false;
+    }
+    return true;
+}
+
+void logRecord::addVarint(uint64_t value) {
+    uint8_t bytes = 1;
+    for (uint64_t rest = value >> 7; rest != 0; rest >>= 7) {
+        bytes++;
+    }
+    if (!reserve(bytes)) {
+        return;
+    }
+    while (value >= 0x80) {
+        buffer[used++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[used++] = (uint8_t)value;
+}
+
+void logRecord::addSigned(int64_t value) { addVarint(((uint64_t)value << 1) ^ (uint64_t)(value >> 63)); }
+
+void logRecord::addUnsigned(uint64_t value) {
+    // same encoding as a signed value, so the format decides how it's shown
+    addVarint(value << 1);
+}
+
+void logRecord::addFloat(float value) {
+    if (!reserve(4)) {
+        return;
+    }
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (uint8_t i = 0; i < 4; i++) {
+        buffer[used++] = (uint8_t)(bits >> (8 * i));
+    }
+}
+
+void logRecord::addString(const char *value) {
+    if (!reserve(1)) {
+        return;
+    }
+    size_t length = (value != nullptr) ? strlen(value) : 0;
+    if (length > (size_t)(LOG_RECORD_MAX - used - 1)) {
+        length = LOG_RECORD_MAX - used - 1;
+        buffer[0] |= LOG_RECORD_TRUNCATED;
+    }
+    buffer[used++] = (uint8_t)length;
+    if (length > 0) {
+        memcpy(&buffer[used], value, length);
+        used += length;
+    }
+}
+
+size_t encodeLogLine(const uint8_t *record, uint8_t length, char *line) {
+    size_t out = 0;
+    line[out++] = '$';
+    for (uint8_t i = 0; i < length; i += 3) {
+        uint32_t group = (uint32_t)record[i] << 16;
+        if (i + 1 < length) {
+            group |= (uint32_t)record[i + 1] << 8;
+        }
+        if (i + 2 < length) {
+            group |= record[i + 2];
+        }
+        line[out++] = BASE64[(group >> 18) & 0x3F];
+        line[out++] = BASE64[(group >> 12) & 0x3F];
+        line[out++] = (i + 1 < length) ? BASE64[(group >> 6) & 0x3F] : '=';
+        line[out++] = (i + 2 < length) ? BASE64[group & 0x3F] : '=';
+    }
+    line[out] = '\0';
+    return out;
+}
+
+uint8_t decodeLogLine(const char *line, uint8_t *record) {
+    if (line[0] != '$') {
+        return 0;
+    }
+    uint32_t group = 0;
+    uint8_t bits = 0;
+    uint8_t length = 0;
+    for (const char *c = line + 1; (*c != '\0') && (*c != '=') && (*c != '\r') && (*c != '\n'); c++) {
+        const char *at = strchr(BASE64, *c);
+        if ((at == nullptr) || (length >= LOG_RECORD_MAX)) {
+            return 0;
+        }
+        group = (group << 6) | (uint32_t)(at - BASE64);
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            record[length++] = (uint8_t)(group >> bits);
+        }
+    }
+    return length;
+}
+
+// reads a varint, false if it runs off the end
+static bool readVarint(const uint8_t *data, uint8_t length, uint8_t *at, uint64_t *value) {
+    *value = 0;
+    for (uint8_t shift = 0; (*at < length) && (shift < 64); shift += 7) {
+        uint8_t byte = data[(*at)++];
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool readLogRecordHeader(const uint8_t *record, uint8_t length, logRecordHeader *header) {
+    if (length < 6) {
+        return false;
+    }
+    header->level = record[0] & ~LOG_RECORD_TRUNCATED;
+    header->truncated = (record[0] & LOG_RECORD_TRUNCATED) != 0;
+    uint8_t at = 1;
+    uint64_t time_ms;
+    if (!readVarint(record, length, &at, &time_ms) || (at + 4 > length)) {
+        return false;
+    }
+    header->time_ms = (uint32_t)time_ms;
+    header->token = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        header->token |= (uint32_t)record[at++] << (8 * i);
+    }
+    header->args_at = at;
+    return true;
+}
+
+// appends to out, keeping it terminated
+static void append(char *out, size_t out_size, size_t *used, const char *text, size_t length) {
+    for (size_t i = 0; (i < length) && (*used + 1 < out_size); i++) {
+        out[(*used)++] = text[i];
+    }
+    out[*used] = '\0';
+}
+
+bool renderLogMessage(const char *format, const uint8_t *args, uint8_t length, char *out, size_t out_size) {
+    size_t used = 0;
+    uint8_t at = 0;
+    out[0] = '\0';
+    const char *c = format;
+    while (*c != '\0') {
+        if (*c != '%') {
+            const char *next = strchr(c, '%');
+            size_t run = (next != nullptr) ? (size_t)(next - c) : strlen(c);
+            append(out, out_size, &used, c, run);
+            c += run;
+            continue;
+        }
+        if (c[1] == '%') {
+            append(out, out_size, &used, "%", 1);
+            c += 2;
+            continue;
+        }
+        // %[flags][width][.precision][length]conversion
+        const char *spec_start = c++;
+        char spec[16] = "%";
+        size_t spec_used = 1;
+        while ((*c != '\0') && (strchr("-+ #0123456789.", *c) != nullptr) && (spec_used < 10)) {
+            spec[spec_used++] = *c++;
+        }
+        bool long_long = false;
+        while ((*c != '\0') && (strchr("hlLzjt", *c) != nullptr)) {
+            long_long |= (c[0] == 'l') && (c[1] == 'l');
+            c++;
+        }
+        char conversion = *c;
+        if ((conversion == '\0') || (strchr("diuxXocfFeEgGsp", conversion) == nullptr)) {
+            // not a conversion, show it as it is
+            append(out, out_size, &used, spec_start, (size_t)(c - spec_start));
+            continue;
+        }
+        c++;
+        char text[80];
+        int written = -1;
+        if (strchr("fFeEgG", conversion) != nullptr) {
+            if (at + 4 <= length) {
+                uint32_t bits = 0;
+                for (uint8_t i = 0; i < 4; i++) {
+                    bits |= (uint32_t)args[at++] << (8 * i);
+                }
+                float value;
+                memcpy(&value, &bits, sizeof(value));
+                spec[spec_used++] = conversion;
+                spec[spec_used] = '\0';
+                written = snprintf(text, sizeof(text), spec, (double)value);
+            }
+        } else if (conversion == 's') {
+            if ((at < length) && (at + 1 + args[at] <= length)) {
+                char value[LOG_RECORD_MAX];
+                uint8_t string_length = args[at++];
+                memcpy(value, &args[at], string_length);
+                value[string_length] = '\0';
+                at += string_length;
+                spec[spec_used++] = 's';
+                spec[spec_used] = '\0';
+                written = snprintf(text, sizeof(text), spec, value);
+            }
+        } else {
+            uint64_t zigzag;
+            if (readVarint(args, length, &at, &zigzag)) {
+                int64_t value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+                spec[spec_used++] = 'l';
+                spec[spec_used++] = 'l';
+                spec[spec_used++] = (conversion == 'i') ? 'd' : (conversion == 'p') ? 'x' : conversion;
+                spec[spec_used] = '\0';
+                if ((conversion == 'd') || (conversion == 'i')) {
+                    written = snprintf(text, sizeof(text), spec, (long long)(long_long ? value : (int32_t)value));
+                } else if (conversion == 'c') {
+                    written = snprintf(text, sizeof(text), "%c", (char)value);
+                } else {
+                    unsigned long long unsigned_value = long_long ? (uint64_t)value : (uint32_t)value;
+                    written = snprintf(text, sizeof(text), spec, unsigned_value);
+                }
+            }
+        }
+        if (written < 0) {
+            append(out, out_size, &used, "<?>", 3);
+            return false;
+        }
+        append(out, out_size, &used, text, ((size_t)written < sizeof(text)) ? (size_t)written : sizeof(text) - 1);
+    }
+    return true;
+}
+
+// decodes one escape after the backslash, moving c past it
+static char unescape(const char **c) {
+    char e = *(*c)++;
+    switch (e) {
+        case 'n':
+            return '\n';
+        case 't':
+            return '\t';
+        case 'r':
+            return '\r';
+        case '0':
+            return '\0';
+        case 'x': {
+            char value = 0;
+            while (isxdigit((unsigned char)**c)) {
+                char h = *(*c)++;
+                value = (char)((value << 4) | ((h <= '9') ? h - '0' : (h | 0x20) - 'a' + 10));
+            }
+            return value;
+        }
+        default:
+            // \\ \" \' \?
+            return e;
+    }
+}
+
+void findLogFormats(const char *source, void (*found)(const char *format, void *context), void *context) {
+    static const char *const MACROS[] = { "LOG_ERROR", "LOG_WARN", "LOG_INFO", "LOG_DEBUG" };
+    const char *c = source;
+    while ((c = strstr(c, "LOG_")) != nullptr) {
+        const char *name = c;
+        c += 4;
+        size_t name_length = 0;
+        for (const char *macro : MACROS) {
+            size_t length = strlen(macro);
+            if ((strncmp(name, macro, length) == 0) && (name[length] == '(' || name[length] == ' ')) {
+                name_length = length;
+            }
+        }
+        if ((name_length == 0) || ((name > source) && (name[-1] == '_' || isalnum((unsigned char)name[-1])))) {
+            continue;
+        }
+        c = name + name_length;
+        while (*c == ' ') {
+            c++;
+        }
+        if (*c != '(') {
+            continue;
+        }
+        c++;
+        // adjacent literals are joined, until anything else
+        char format[512];
+        size_t used = 0;
+        bool literal = false;
+        for (;;) {
+            while ((*c == ' ') || (*c == '\t') || (*c == '\r') || (*c == '\n')) {
+                c++;
+            }
+            if (*c != '"') {
+                break;
+            }
+            literal = true;
+            c++;
+            while ((*c != '"') && (*c != '\0')) {
+                char value;
+                if (*c == '\\') {
+                    c++;
+                    value = unescape(&c);
+                } else {
+                    value = *c++;
+                }
+                if (used + 1 < sizeof(format)) {
+                    format[used++] = value;
+                }
+            }
+            if (*c == '"') {
+                c++;
+            }
+        }
+        if (literal) {
+            format[used] = '\0';
+            found(format, context);
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#pragma once
+/**
+ * @file LogToken.h
+ * @brief Tokenised log records: the format string is replaced by a 32 bit hash worked out at compile time, and the
+ * arguments are packed in binary. The strings stay on the host, where a detokeniser looks the token up in a table built
+ * from the sources and renders the message.
+ *
+ * Record: [level (1)][millis() (varint)][token (4 bytes, LSB first)][arguments]. Integers are zigzag varints (whatever
+ * their type), floats & doubles are 4 byte floats (LSB first), strings are [length (1)][bytes]. The level byte has
+ * LOG_RECORD_TRUNCATED set if an argument didn't fit.
+ *
+ * On the wire a record is a line of '$' followed by the record in base64, so it still goes through a serial monitor.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_RECORD_MAX       64   /**< Bytes in a record; a %s argument is cut short to fit. */
+#define LOG_RECORD_TRUNCATED 0x80 /**< Set in the level byte if arguments were cut short or dropped. */
+#define LOG_TOKEN_LINE_MAX   (1 + ((LOG_RECORD_MAX + 2) / 3) * 4 + 1) /**< '$', base64 of a record & the terminator. */
+
+/**
+ * @brief 32 bit FNV-1a hash of a format string. constexpr (and C++11 friendly) so the token is worked out at compile
+ * time and the string itself isn't kept in flash.
+ */
+constexpr uint32_t logToken(const char *format, uint32_t hash = 2166136261UL) {
+    return (*format == '\0') ? hash : logToken(format + 1, (hash ^ (uint8_t)*format) * 16777619UL);
+}
+
+/** @brief Forces logToken() to be worked out at compile time. */
+template <uint32_t token> struct logTokenValue {
+    static const uint32_t value = token;
+};
+
+/**
+ * @brief A record being packed.
+ */
+class logRecord {
+  public:
+    /**
+     * @brief Starts a record.
+     * @param level LOG_LEVEL as a number.
+     */
+    logRecord(uint8_t level, uint32_t time_ms, uint32_t token);
+
+    void addSigned(int64_t value);
+    void addUnsigned(uint64_t value);
+    void addFloat(float value);
+    void addString(const char *value);
+
+    inline const uint8_t *data(void) const { return buffer; };
+    inline uint8_t length(void) const { return used; };
+
+  private:
+    bool reserve(uint8_t bytes);
+    void addVarint(uint64_t value);
+
+    uint8_t buffer[LOG_RECORD_MAX];
+    uint8_t used = 0;
+};
+
+// Packs each argument by its type, see logRecord.
+inline void logArg(logRecord *record, signed char value) { record->addSigned(value); }
+inline void logArg(logRecord *record, short value) { record->addSigned(value); }
+inline void logArg(logRecord *record, int value) { record->addSigned(value); }
+inline void logArg(logRecord *record, long value) { record->addSigned(value); }
+inline void logArg(logRecord *record, long long value) { record->addSigned(value); }
+inline void logArg(logRecord *record, char value) { record->addSigned(value); }
+inline void logArg(logRecord *record, bool value) { record->addUnsigned(value); }
+inline void logArg(logRecord *record, unsigned char value) { record->addUnsigned(value); }
+inline void logArg(logRecord *record, unsigned short value) { record->addUnsigned(value); }
+inline void logArg(logRecord *record, unsigned int value) { record->addUnsigned(value); }
+inline void logArg(logRecord *record, unsigned long value) { record->addUnsigned(value); }
+inline void logArg(logRecord *record, unsigned long long value) { record->addUnsigned(value); }
+inline void logArg(logRecord *record, float value) { record->addFloat(value); }
+inline void logArg(logRecord *record, double value) { record->addFloat((float)value); }
+inline void logArg(logRecord *record, const char *value) { record->addString(value); }
+
+inline void logArgs(logRecord *) {}
+
+template <typename T, typename... Args> inline void logArgs(logRecord *record, T first, Args... rest) {
+    logArg(record, first);
+    logArgs(record, rest...);
+}
+
+/**
+ * @brief Encodes a record as a token line: '$' and base64, null terminated.
+ * @param line At least LOG_TOKEN_LINE_MAX bytes.
+ * @return Characters written, not counting the terminator.
+ */
+size_t encodeLogLine(const uint8_t *record, uint8_t length, char *line);
+
+/**
+ * @brief Decodes a token line back into a record.
+ * @param record At least LOG_RECORD_MAX bytes.
+ * @return Record length, 0 if the line isn't a token line.
+ */
+uint8_t decodeLogLine(const char *line, uint8_t *record);
+
+/** @brief A decoded record's header. */
+struct logRecordHeader {
+    uint8_t level;     /**< LOG_LEVEL as a number. */
+    bool truncated;    /**< Arguments were cut short or dropped. */
+    uint32_t time_ms;  /**< millis() when logged. */
+    uint32_t token;    /**< Hash of the format string. */
+    uint8_t args_at;   /**< Where the arguments start. */
+};
+
+/**
+ * @brief Reads a record's header.
+ * @return False if the record is too short.
+ */
+bool readLogRecordHeader(const uint8_t *record, uint8_t length, logRecordHeader *header);
+
+/**
+ * @brief Renders a record's arguments with its format string, printf style (%d %i %u %x %X %o %c %f %e %g %s & %%, with
+ * flags, width, precision & length modifiers). Integers are shown as the device's 32 bit values unless the format
+ * says ll.
+ * @param out Null terminated, cut short if too small.
+ * @return False if the arguments didn't match the format (the rest is rendered as "<?>").
+ */
+bool renderLogMessage(const char *format, const uint8_t *args, uint8_t length, char *out, size_t out_size);
+
+/**
+ * @brief Finds the format strings of LOG_ERROR/WARN/INFO/DEBUG calls in source text, joining adjacent literals and
+ * decoding escapes as the compiler does, so logToken() of each matches the device's.
+ * @param found Called with each format string.
+ */
+void findLogFormats(const char *source, void (*found)(const char *format, void *context), void *context);
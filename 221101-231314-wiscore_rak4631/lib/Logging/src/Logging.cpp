@@ -1,17 +1,45 @@
-#include "logging.h"
+#include "Logging.h"
+
+#include "MpscRing.h" /**< Lock-free ring the records wait in. */
+
+/** @brief A tokenised record waiting to be written. */
+struct logSlot {
+    uint8_t length;
+    uint8_t record[LOG_RECORD_MAX];
+};
+static mpscRing<logSlot, LOG_RING_SLOTS> log_ring; /**< Pushed by any task or interrupt, popped by one drainer. */
+static TaskHandle_t drain_task = NULL;             /**< Writes the records out, at the lowest priority. */
+static SemaphoreHandle_t drain_mutex = NULL;       /**< Held by whoever pops: the drain task or flushLogging(). */
+static uint32_t dropped_reported = 0;              /**< Overruns already logged, only used by the drainer. */
+static volatile logRecordSink record_sink = nullptr; /**< Also gets every record, see setLogRecordSink(). */
+static volatile serialAttachHandler attach_handler = nullptr; /**< See setSerialAttachHandler(). */
+static bool serial_hold = false;                   /**< The drain task waits for Serial before writing anything. */
+static bool attach_handled = false;                /**< The attach handler has been called, only used by the drainer. */
 
 // forward declarations
 void formatTimestamp(unsigned long timestamp, char *buffer, int buffer_len);
 void printLog(char *log);
-void initSerial(void);
+void initSerial(bool wait_for_serial);
+static void logDrainTask(void *unused);
+static void drainLogRing(void);
+static void holdForSerial(void);
 
-void initLogging(void) {
+void initLogging(bool wait_for_serial) {
     if (APP_LOG_LEVEL == LOG_LEVEL::NONE) {
         // do nothing
         return;
     }
     // change which function is called here if logging to a different location e.g. EEPROM, SD card, etc.
-    initSerial();
+    initSerial(wait_for_serial);
+
+    drain_mutex = xSemaphoreCreateMutex();
+    if (xTaskCreate(logDrainTask, "LOG", LOG_DRAIN_STACK_WORDS, NULL, TASK_PRIO_LOWEST, &drain_task) != pdPASS) {
+        drain_task = NULL;
+    }
+    // anything logged before now is waiting
+    if (drain_task != NULL) {
+        xTaskNotifyGive(drain_task);
+    }
 }
 
 void log(LOG_LEVEL level, const char *format, ...) {
@@ -57,31 +85,111 @@ void log(LOG_LEVEL level, const char *format, ...) {
     printLog(printable_log);
 }
 
+void logRecordOut(const logRecord *record) {
+    logSlot slot;
+    slot.length = record->length();
+    memcpy(slot.record, record->data(), slot.length);
+    if (!log_ring.push(slot)) {
+        // counted, the drain task reports it
+        return;
+    }
+    if (drain_task == NULL) {
+        return;
+    }
+    if (__get_IPSR() != 0) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(drain_task, &woken);
+        portYIELD_FROM_ISR(woken);
+    } else {
+        xTaskNotifyGive(drain_task);
+    }
+}
+
+void flushLogging(uint32_t timeout_ms) {
+    if ((drain_mutex == NULL) || (xSemaphoreTake(drain_mutex, pdMS_TO_TICKS(timeout_ms)) != pdTRUE)) {
+        return;
+    }
+    drainLogRing();
+    xSemaphoreGive(drain_mutex);
+    Serial.flush();
+}
+
+void loggingStats(spscRingStats *stats) { log_ring.stats(stats); }
+
+void setLogRecordSink(logRecordSink sink) { record_sink = sink; }
+
+void setSerialAttachHandler(serialAttachHandler handler) { attach_handler = handler; }
+
 /**
- * @brief Initialise Serial.
- * Flashes the LED_BUILTIN while waiting for Serial.
+ * @brief Writes out the log ring whenever a record is pushed. Only runs when every other task is blocked.
  */
-void initSerial(void) {
+void logDrainTask(void *unused) {
+    holdForSerial();
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        xSemaphoreTake(drain_mutex, portMAX_DELAY);
+        drainLogRing();
+        xSemaphoreGive(drain_mutex);
+    }
+}
+
+/**
+ * @brief Writes out every record waiting, after a warning if any were dropped since the last time. Called with
+ * drain_mutex held.
+ */
+void drainLogRing(void) {
+    serialAttachHandler handler = attach_handler;
+    if (!attach_handled && (handler != nullptr) && Serial) {
+        attach_handled = true;
+        handler();
+    }
+    spscRingStats stats;
+    log_ring.stats(&stats);
+    if (stats.overruns != dropped_reported) {
+        // queued behind the records that did get in
+        LOG_WARN("Log ring full, %lu records dropped.", stats.overruns - dropped_reported);
+        dropped_reported = stats.overruns;
+    }
+    logSlot slot;
+    char line[LOG_TOKEN_LINE_MAX];
+    while (log_ring.pop(&slot)) {
+        encodeLogLine(slot.record, slot.length, line);
+        printLog(line);
+        logRecordSink sink = record_sink;
+        if (sink != nullptr) {
+            sink(slot.record, slot.length);
+        }
+    }
+}
+
+/**
+ * @brief Initialise Serial. Doesn't wait for it to connect, the drain task holds the records instead (see
+ * holdForSerial()) so setup() carries on.
+ * @param wait_for_serial False to write the records straight away, e.g. waking from deep sleep.
+ */
+void initSerial(bool wait_for_serial) {
     // Initialize the board LEDs
     pinMode(LED_BUILTIN, OUTPUT);
     pinMode(LED_CONN, OUTPUT);
+    digitalWrite(LED_BUILTIN, LOW);
 
     // Initialize Serial for debug output
     Serial.begin(115200);
+    serial_hold = wait_for_serial;
+}
 
-    // Wait for upto 5 seconds for serial to connect
-    time_t serial_timeout = millis();
+/**
+ * @brief Waits in the drain task for up to LOG_SERIAL_HOLD_MS for Serial to connect, so the first logs aren't lost.
+ * Flashes the LED_BUILTIN while waiting. The records logged meanwhile wait in the ring.
+ */
+void holdForSerial(void) {
+    uint32_t serial_timeout = millis();
     // Toggle LED_BUILTIN while waiting for Serial
-    digitalWrite(LED_BUILTIN, LOW);
-    while (!Serial) {
-        if ((millis() - serial_timeout) < 5000) {
-            delay(100);
-            digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));
-        } else {
-            // stop waiting
-            break;
-        }
+    while (serial_hold && !Serial && ((millis() - serial_timeout) < LOG_SERIAL_HOLD_MS)) {
+        delay(LOG_SERIAL_POLL_MS);
+        digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN));
     }
+    serial_hold = false;
     // make sure LED is now off
     digitalWrite(LED_BUILTIN, LOW);
 }
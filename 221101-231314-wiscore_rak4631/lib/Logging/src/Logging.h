@@ -3,9 +3,14 @@
  * @file Logging.h
  * @author Kalina Knight
  * @brief Some basic functions for logging.
- * Change the APP_LOG_LEVEL to turn log messages on and off.
- * Currently the logs are directed to Serial. If you'd like to direct them to a different location (e.g. EEPROM, SD
- * card, etc.), then you will need to edit/replace two functions in logging.cpp: initSerial() & printLog().
+ * Change the APP_LOG_LEVEL to turn log messages on and off, and LOG_MODULE_LEVEL to log less from one module.
+ * Log with LOG_ERROR/WARN/INFO/DEBUG(format, ...). Calls below the level are removed at compile time, arguments and
+ * all. With LOG_TOKENISED the format string is replaced by a token and the arguments are sent in binary, see
+ * LogToken.h; test/log_detokenise.cc turns them back into text on the host.
+ * Tokenised records are pushed into a lock-free ring, from any task or interrupt, and written out by a drain task at the
+ * lowest priority, so logging never waits for Serial. Call flushLogging() before anything that stops the CPU.
+ * Currently the logs are directed to Serial. Tokenised records can also be given to a sink, see setLogRecordSink()
+ * (FlashLog.h keeps them on flash). For text, edit/replace two functions in logging.cpp: initSerial() & printLog().
  * @version 0.1
  * @date 2021-08-17
  *
@@ -15,6 +20,9 @@
 #include <Arduino.h>
 #include <stdarg.h>
 
+#include "LogToken.h" /**< Format string tokens & binary log records. */
+#include "SpscRing.h" /**< spscRingStats, for the log ring counters. */
+
 enum class LOG_LEVEL {
     NONE = 0,  /**< Disable logging. No messages are logged. */
     ERROR = 1, /**< Only ERROR level messages are logged. */
@@ -26,6 +34,23 @@ enum class LOG_LEVEL {
 // Set the logging level for the entire application here:
 #define APP_LOG_LEVEL LOG_LEVEL::DEBUG
 
+// Send logs as tokens & binary arguments (1), or format them as text on the device (0). Tokens keep the format strings
+// out of flash and skip vsnprintf, the text is readable without the detokeniser.
+#define LOG_TOKENISED 1
+
+// A module can log less than the application: after its includes, #undef LOG_MODULE_LEVEL and #define its own.
+#ifndef LOG_MODULE_LEVEL
+#define LOG_MODULE_LEVEL APP_LOG_LEVEL
+#endif
+
+// Tokenised records wait in a ring for the drain task. If it's full a record is dropped, and the drain task logs how
+// many were dropped once it has caught up.
+#define LOG_RING_SLOTS        64  /**< Records that can wait to be written, a power of 2: a boot's worth. */
+#define LOG_DRAIN_STACK_WORDS 512 /**< Stack of the drain task in 32 bit words, enough for a sink's flash write. */
+#define LOG_FLUSH_TIMEOUT_MS  500 /**< Longest flushLogging() waits for the drain task to let go of the ring. */
+#define LOG_SERIAL_HOLD_MS    5000 /**< Longest the drain task holds the records waiting for Serial after a boot. */
+#define LOG_SERIAL_POLL_MS    100  /**< How often Serial is checked (and the LED toggled) while holding. */
+
 // I'm unsure what the max is for Serial, but 200 characters seems like plenty
 #define MAX_LOG_LENGTH 200
 
@@ -35,9 +60,11 @@ enum class LOG_LEVEL {
 #define MS_IN_SECOND 1000
 
 /**
- * @brief Initialises location where logs are sent.
+ * @brief Initialises location where logs are sent. Returns straight away, setup() never waits for Serial.
+ * @param wait_for_serial Hold the records (up to LOG_SERIAL_HOLD_MS) until Serial connects so the first logs aren't
+ * lost. The drain task does the waiting. Pass false where nobody is watching, e.g. waking from deep sleep.
  */
-void initLogging(void);
+void initLogging(bool wait_for_serial = true);
 
 /**
  * @brief Formats and logs the message if it is of level >= APP_LOG_LEVEL.
@@ -48,3 +75,74 @@ void initLogging(void);
  * @param ... (Optional) Any additional arguments for the format.
  */
 void log(LOG_LEVEL level, const char *format, ...);
+
+/**
+ * @brief Writes out every record waiting in the ring and flushes Serial, e.g. before System OFF. Not from an interrupt.
+ * @param timeout_ms Longest to wait if the drain task is writing.
+ */
+void flushLogging(uint32_t timeout_ms = LOG_FLUSH_TIMEOUT_MS);
+
+/**
+ * @brief Fills stats with the log ring counters: records waiting, high water mark, logged & dropped (overruns).
+ */
+void loggingStats(spscRingStats *stats);
+
+/**
+ * @brief Gets each tokenised record as the drainer writes it out, besides Serial, e.g. to keep it on the flash (see
+ * FlashLog.h). Runs in the drain task, or in flushLogging(); it can log, the record goes in the ring.
+ */
+typedef void (*logRecordSink)(const uint8_t *record, uint8_t length);
+
+/**
+ * @brief Sets the sink, or nullptr for none.
+ */
+void setLogRecordSink(logRecordSink sink);
+
+/** @brief Called once, the first time the drainer finds Serial connected (and a handler set), before it writes out. */
+typedef void (*serialAttachHandler)(void);
+
+/**
+ * @brief Sets the handler, e.g. to print something only worth printing to a person (see dumpFlashLog()). Runs in the
+ * drain task (or flushLogging()), so it can be slow.
+ */
+void setSerialAttachHandler(serialAttachHandler handler);
+
+/**
+ * @brief Queues a tokenised record for the drain task, see LOG_TOKENISED. Safe from any task or interrupt.
+ */
+void logRecordOut(const logRecord *record);
+
+/**
+ * @brief Packs a tokenised record & sends it. Use the LOG_ macros rather than calling this.
+ */
+template <typename... Args> void logTokenised(LOG_LEVEL level, uint32_t token, Args... args) {
+    logRecord record((uint8_t)level, millis(), token);
+    logArgs(&record, args...);
+    logRecordOut(&record);
+}
+
+/** @brief True if a level is logged by this module, a constant so disabled calls are compiled out. */
+#define LOG_ENABLED(level)                                                                                             \
+    (((level) != LOG_LEVEL::NONE) && ((level) <= APP_LOG_LEVEL) && ((level) <= LOG_MODULE_LEVEL))
+
+#if LOG_TOKENISED
+#define LOG_AT(level, format, ...)                                                                                     \
+    do {                                                                                                               \
+        if (LOG_ENABLED(level)) {                                                                                      \
+            logTokenised(level, logTokenValue<logToken(format)>::value, ##__VA_ARGS__);                                \
+        }                                                                                                              \
+    } while (0)
+#else
+#define LOG_AT(level, format, ...)                                                                                     \
+    do {                                                                                                               \
+        if (LOG_ENABLED(level)) {                                                                                      \
+            log(level, format, ##__VA_ARGS__);                                                                         \
+        }                                                                                                              \
+    } while (0)
+#endif
+
+// The format must be a string literal, so the detokeniser can find it in the source.
+#define LOG_ERROR(format, ...) LOG_AT(LOG_LEVEL::ERROR, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...)  LOG_AT(LOG_LEVEL::WARN, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...)  LOG_AT(LOG_LEVEL::INFO, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) LOG_AT(LOG_LEVEL::DEBUG, format, ##__VA_ARGS__)
@@ -0,0 +1,210 @@
+#include "Outbox.h"
+
+#define OUTBOX_MAGIC         0x0B0C
+#define OUTBOX_STATE_PENDING 0xA5
+#define OUTBOX_STATE_SENT    0x00
+#define OUTBOX_STATE_EMPTY   0xFF // not stored, only used in the RAM index
+
+bool Outbox::init(void) {
+    LOG_DEBUG("Initialising outbox...");
+    pending_count = 0;
+    next_sequence = 0;
+    memset(in_frame, 0, sizeof(in_frame));
+
+    bool flash_ok = initFlashStorage();
+    outboxRecord record;
+    for (uint8_t slot = 0; slot < OUTBOX_SLOTS; slot++) {
+        slots[slot] = { 0, OUTBOX_STATE_EMPTY, 0, 0 };
+        if (!flash_ok || !readRecord(slot, &record)) {
+            continue;
+        }
+        slots[slot] = { record.sequence, record.state, record.priority, record.length };
+        if (record.sequence >= next_sequence) {
+            next_sequence = record.sequence + 1;
+        }
+        if (record.state == OUTBOX_STATE_PENDING) {
+            pending_count++;
+        }
+    }
+
+    LOG_INFO("Outbox: %u frames pending, next sequence %lu.", pending_count, next_sequence);
+    return flash_ok;
+}
+
+bool Outbox::push(uint8_t port, const uint8_t *data, uint8_t length, OUTBOX_PRIORITY priority) {
+    if (length > OUTBOX_MAX_FRAME_LENGTH) {
+        LOG_ERROR("Outbox: frame of %u bytes is too long to queue.", length);
+        dropped_count++;
+        return false;
+    }
+
+    uint8_t slot = next_sequence % OUTBOX_SLOTS;
+    if (slots[slot].state == OUTBOX_STATE_PENDING) {
+        // ring is full - don't let a routine reading push out an alert reading
+        if (slots[slot].priority > (uint8_t)priority) {
+            LOG_WARN("Outbox full, dropping new routine frame.");
+            dropped_count++;
+            return false;
+        }
+        LOG_WARN("Outbox full, overwriting frame %lu.", slots[slot].sequence);
+        dropped_count++;
+        pending_count--;
+    }
+
+    outboxRecord record = {};
+    record.magic = OUTBOX_MAGIC;
+    record.state = OUTBOX_STATE_PENDING;
+    record.priority = (uint8_t)priority;
+    record.sequence = next_sequence;
+    record.port = port;
+    record.length = length;
+    memcpy(record.data, data, length);
+    record.crc = recordCRC(&record);
+
+    // the record is written in one go so a reset part way through leaves a bad CRC, which init() ignores
+    if (!writeFlashFile(OUTBOX_FILE, slot * sizeof(outboxRecord), &record, sizeof(outboxRecord))) {
+        dropped_count++;
+        slots[slot].state = OUTBOX_STATE_EMPTY;
+        return false;
+    }
+
+    slots[slot] = { record.sequence, record.state, record.priority, record.length };
+    in_frame[slot] = false;
+    next_sequence++;
+    pending_count++;
+    LOG_DEBUG("Outbox: queued frame %lu (port %u, %u bytes, priority %u). %u pending.", record.sequence,
+        port, length, record.priority, pending_count);
+    return true;
+}
+
+uint16_t Outbox::dropLongerThan(uint8_t max_length) {
+    uint16_t dropped = 0;
+    for (uint8_t slot = 0; slot < OUTBOX_SLOTS; slot++) {
+        if ((slots[slot].state == OUTBOX_STATE_PENDING) && (slots[slot].length > max_length)) {
+            LOG_WARN("Outbox: frame %lu is %u bytes, can't be sent in %u. Dropped.", slots[slot].sequence,
+                slots[slot].length, max_length);
+            setState(slot, OUTBOX_STATE_SENT);
+            dropped_count++;
+            dropped++;
+        }
+    }
+    return dropped;
+}
+
+bool Outbox::prepareFrame(lmh_app_data_t *frame, uint8_t max_length) {
+    memset(in_frame, 0, sizeof(in_frame));
+    if (pending_count == 0) {
+        return false;
+    }
+
+    outboxRecord record;
+    bool skip[OUTBOX_SLOTS] = {};
+
+    // only one frame waiting, or the next one wouldn't fit in a batch: send it exactly as it was originally encoded
+    int first = nextSlotToSend(skip);
+    if (first < 0) {
+        return false;
+    }
+    if ((pending_count == 1) ||
+        ((OUTBOX_BATCH_HEADER + OUTBOX_BATCH_RECORD_HEADER + slots[first].length) > max_length)) {
+        if (slots[first].length > max_length) {
+            // not now, see dropLongerThan()
+            return false;
+        }
+        if (!readRecord(first, &record)) {
+            // corrupted since init(), stop trying to send it
+            setState(first, OUTBOX_STATE_SENT);
+            return false;
+        }
+        memcpy(frame->buffer, record.data, record.length);
+        frame->buffsize = record.length;
+        frame->port = record.port;
+        in_frame[first] = true;
+        return true;
+    }
+
+    // otherwise coalesce as many as will fit: [count] then per record [port][sequence MSB][sequence LSB][length][data]
+    uint8_t count = 0;
+    uint8_t pos = OUTBOX_BATCH_HEADER;
+    int slot;
+    while ((slot = nextSlotToSend(skip)) >= 0) {
+        skip[slot] = true;
+        if ((pos + OUTBOX_BATCH_RECORD_HEADER + slots[slot].length) > max_length) {
+            // doesn't fit, but a smaller one further down the queue might
+            continue;
+        }
+        if (!readRecord(slot, &record)) {
+            // corrupted since init(), stop trying to send it
+            setState(slot, OUTBOX_STATE_SENT);
+            continue;
+        }
+        frame->buffer[pos++] = record.port;
+        frame->buffer[pos++] = (uint8_t)(record.sequence >> 8);
+        frame->buffer[pos++] = (uint8_t)(record.sequence & 0xFF);
+        frame->buffer[pos++] = record.length;
+        memcpy(&frame->buffer[pos], record.data, record.length);
+        pos += record.length;
+        in_frame[slot] = true;
+        count++;
+    }
+
+    if (count == 0) {
+        return false;
+    }
+    frame->buffer[0] = count;
+    frame->buffsize = pos;
+    frame->port = OUTBOX_BATCH_PORT;
+    LOG_DEBUG("Outbox: coalesced %u frames into %u bytes.", count, pos);
+    return true;
+}
+
+void Outbox::markFrameSent(void) {
+    for (uint8_t slot = 0; slot < OUTBOX_SLOTS; slot++) {
+        if (in_frame[slot]) {
+            setState(slot, OUTBOX_STATE_SENT);
+            in_frame[slot] = false;
+        }
+    }
+}
+
+bool Outbox::readRecord(uint8_t slot, outboxRecord *record) {
+    if (!readFlashFile(OUTBOX_FILE, slot * sizeof(outboxRecord), record, sizeof(outboxRecord))) {
+        return false;
+    }
+    if ((record->magic != OUTBOX_MAGIC) || (record->length > OUTBOX_MAX_FRAME_LENGTH)) {
+        return false;
+    }
+    return (record->crc == recordCRC(record));
+}
+
+uint16_t Outbox::recordCRC(const outboxRecord *record) {
+    uint16_t crc = flashCRC16(&record->priority, sizeof(record->priority));
+    crc = flashCRC16(&record->sequence, sizeof(record->sequence), crc);
+    crc = flashCRC16(&record->port, sizeof(record->port), crc);
+    crc = flashCRC16(&record->length, sizeof(record->length), crc);
+    return flashCRC16(record->data, record->length, crc);
+}
+
+bool Outbox::setState(uint8_t slot, uint8_t state) {
+    if (slots[slot].state == OUTBOX_STATE_PENDING && state != OUTBOX_STATE_PENDING) {
+        pending_count--;
+    }
+    slots[slot].state = state;
+    // only the state byte is rewritten
+    return writeFlashFile(OUTBOX_FILE, slot * sizeof(outboxRecord) + offsetof(outboxRecord, state), &state,
+                          sizeof(state));
+}
+
+int Outbox::nextSlotToSend(const bool *skip) const {
+    int best = -1;
+    for (uint8_t slot = 0; slot < OUTBOX_SLOTS; slot++) {
+        if (skip[slot] || (slots[slot].state != OUTBOX_STATE_PENDING)) {
+            continue;
+        }
+        if ((best < 0) || (slots[slot].priority > slots[best].priority) ||
+            ((slots[slot].priority == slots[best].priority) && (slots[slot].sequence < slots[best].sequence))) {
+            best = slot;
+        }
+    }
+    return best;
+}
@@ -0,0 +1,130 @@
+#pragma once
+/**
+ * @file Outbox.h
+ * @brief Flash-backed store-and-forward outbox for LoRaWAN frames.
+ * Frames that could not be sent (not joined, or lmh_send() failed) are appended to a fixed size ring of records on the
+ * internal flash so they survive resets. Each record has a sequence number and a priority. When the link comes back
+ * the outbox is drained one uplink per wake-up, highest priority first, and queued frames are coalesced into a single
+ * batch frame (OUTBOX_BATCH_PORT) when more than one is waiting.
+ *
+ * Records are written round-robin (slot = sequence number % OUTBOX_SLOTS) so writes are spread evenly over the ring.
+ * See the README for the batch frame format.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <LoRaWan-RAK4630.h> // Click to get library: https://platformio.org/lib/show/6601/SX126x-Arduino
+
+#include "FlashStorage.h"   /**< Internal flash access. */
+#include "LoRaWAN_functs.h" /**< PAYLOAD_BUFFER_SIZE. */
+#include "Logging.h"        /**< Go here to change the logging level for the entire application. */
+
+#define OUTBOX_FILE                "/outbox.bin"       /**< Flash file that holds the ring of records. */
+#define OUTBOX_SLOTS               64                  /**< Number of frames that can be queued. */
+#define OUTBOX_MAX_FRAME_LENGTH    PAYLOAD_BUFFER_SIZE /**< Largest frame that can be queued. */
+#define OUTBOX_BATCH_PORT          200                 /**< Port for coalesced frames (200-222 are system ports). */
+#define OUTBOX_BATCH_MAX_LENGTH    51                  /**< Max batch length: AU915 DR0-DR2 application payload. */
+#define OUTBOX_BATCH_HEADER        1                   /**< Batch frame header: number of records. */
+#define OUTBOX_BATCH_RECORD_HEADER 4                   /**< Per record header: port, sequence (2 bytes), length. */
+
+/** @brief Priority of a queued frame. Higher priorities are always drained first. */
+enum class OUTBOX_PRIORITY : uint8_t {
+    ROUTINE = 0, /**< Normal mode readings. */
+    ALERT = 1,   /**< Readings taken while a turbidity event is active. */
+};
+
+/**
+ * @brief Store-and-forward queue of LoRaWAN frames on the internal flash.
+ */
+class Outbox {
+  public:
+    /**
+     * @brief Scans the flash ring and rebuilds the in-RAM index of pending frames.
+     * @return True if successful, false if the flash could not be used (the outbox will then be empty but still
+     * safe to call).
+     */
+    bool init(void);
+
+    /**
+     * @brief Appends a frame to the outbox.
+     * If the ring is full the oldest frame is overwritten, unless it is an ALERT frame and the new frame is ROUTINE, in
+     * which case the new frame is dropped instead.
+     * @param port LoRaWAN port the frame was encoded for.
+     * @param data Encoded frame.
+     * @param length Length of data (max OUTBOX_MAX_FRAME_LENGTH).
+     * @param priority Priority of the frame.
+     * @return True if the frame was queued, false if it was dropped.
+     */
+    bool push(uint8_t port, const uint8_t *data, uint8_t length, OUTBOX_PRIORITY priority);
+
+    /**
+     * @brief Drops the pending frames longer than max_length, counted in dropped(). Call with the longest uplink the
+     * data rate can ever carry: a frame over it would stay pending for ever, and every later reading would be queued
+     * behind it.
+     * @return Number of frames dropped.
+     */
+    uint16_t dropLongerThan(uint8_t max_length);
+
+    /**
+     * @brief Fills frame with the next uplink to send.
+     * A single pending frame is copied as is (original port), as is the next frame when it is too long to go in a batch.
+     * Otherwise several pending frames are coalesced into a batch frame on OUTBOX_BATCH_PORT, highest priority then
+     * oldest first, until max_length is reached.
+     * The frames used are remembered until markFrameSent() or the next prepareFrame().
+     * @param frame Frame to fill, frame->buffer must be at least max_length bytes.
+     * @param max_length Max length of the uplink.
+     * @return True if there was something to send, false if the outbox is empty.
+     */
+    bool prepareFrame(lmh_app_data_t *frame, uint8_t max_length = OUTBOX_BATCH_MAX_LENGTH);
+
+    /**
+     * @brief Removes the frames used by the last prepareFrame() from the outbox.
+     * Call once lmh_send() has accepted the frame.
+     */
+    void markFrameSent(void);
+
+    /**
+     * @brief Number of frames waiting to be sent.
+     */
+    inline uint16_t pending(void) const { return pending_count; };
+
+    /**
+     * @brief Number of frames lost because the ring was full or they were too long to send.
+     */
+    inline uint32_t dropped(void) const { return dropped_count; };
+
+  private:
+    /** @brief Record stored in each flash slot. */
+    struct outboxRecord {
+        uint16_t magic;    // OUTBOX_MAGIC if the slot has been written
+        uint8_t state;     // OUTBOX_STATE_*
+        uint8_t priority;  // OUTBOX_PRIORITY
+        uint32_t sequence; // increments with every push, never reused
+        uint8_t port;      // LoRaWAN port of the frame
+        uint8_t length;    // length of data
+        uint16_t crc;      // recordCRC() of everything except magic & state
+        uint8_t data[OUTBOX_MAX_FRAME_LENGTH];
+    };
+
+    /** @brief In-RAM copy of a slot's header so the flash only has to be read to send. */
+    struct slotIndex {
+        uint32_t sequence;
+        uint8_t state;
+        uint8_t priority;
+        uint8_t length;
+    };
+
+    static uint16_t recordCRC(const outboxRecord *record);
+    bool readRecord(uint8_t slot, outboxRecord *record);
+    bool setState(uint8_t slot, uint8_t state);
+    int nextSlotToSend(const bool *skip) const;
+
+    slotIndex slots[OUTBOX_SLOTS] = {};
+    bool in_frame[OUTBOX_SLOTS] = {}; // slots used by the last prepareFrame()
+    uint32_t next_sequence = 0;
+    uint16_t pending_count = 0;
+    uint32_t dropped_count = 0;
+};
@@ -33,6 +33,15 @@ function format_payload(args) {
   let f_port = args["uplink_message"]["f_port"];
   // decode byte payload
   let decoded_payload = decodePayload(bytes, f_port);
+  // compressed series frames from a device without a synced clock give each reading's age, turn those into timestamps
+  if (decoded_payload && Array.isArray(decoded_payload.turbidity)) {
+    for (let dot of decoded_payload.turbidity) {
+      if (dot.age_s !== undefined) {
+        dot.timestamp = ubidots_payload["timestamp"] - 1000 * dot.age_s;
+        delete dot.age_s;
+      }
+    }
+  }
 
   // Use this instead if you're already decoding in TTS using payload formatters.
   // PROTIP: Make sure the incoming decoded payload is an Ubidots-compatible JSON (See https://ubidots.com/docs/hw/#sending-data)
@@ -220,6 +229,7 @@ const relativeHumiditySchema = new sensorPortSchema(1, 1, 2.55, false, 2); // On
 const airPressureSchema = new sensorPortSchema(4, 1, 1, false);
 const gasResistanceSchema = new sensorPortSchema(4, 1, 1, false);
 const locationSchema = new sensorPortSchema(8, 2, 10 ** 4, true);
+const turbiditySchema = new sensorPortSchema(2, 1, 1, false);
 // const newSensorSchema = new sensorPortSchema(1, 1, 1, false);
 
 /**
@@ -231,7 +241,7 @@ class portSchema {
    * Constructor for PortSchema:
    * Creates object variables and defaults them be false if not specified in options.
    * @param {*} options Object instantiation of {batteryVoltage, temperature, relativeHumidity,
-   *                    airPressure, gasResistance, location}
+   *                    airPressure, gasResistance, location, turbidity}
    */
   constructor(options = {}) {
     Object.assign(
@@ -243,6 +253,7 @@ class portSchema {
         airPressure: false,
         gasResistance: false,
         location: false,
+        turbidity: false,
       },
       options
     );
@@ -275,7 +286,8 @@ const PORT_SCHEMA = {
   PORT56: new portSchema({                    temperature: true, relativeHumidity: true, airPressure: true,                      location: true}),
   PORT57: new portSchema({batteryVoltage: true, temperature: true, relativeHumidity: true, airPressure: true,                      location: true}),
   PORT58: new portSchema({                    temperature: true, relativeHumidity: true, airPressure: true, gasResistance: true, location: true}),
-  PORT59: new portSchema({batteryVoltage: true, temperature: true, relativeHumidity: true, airPressure: true, gasResistance: true, location: true})
+  PORT59: new portSchema({batteryVoltage: true, temperature: true, relativeHumidity: true, airPressure: true, gasResistance: true, location: true}),
+  PORT10: new portSchema({batteryVoltage: true,                                                                                    turbidity: true})
   // PORTX:  new portSchema({ indicate which sensor data is included })
 }
 
@@ -291,6 +303,46 @@ function decodePayload(bytes, port_num) {
   let decoded = {}; // final decoded object
   let b = 0; // byte iterator
 
+  // frames replayed from the device's outbox arrive coalesced on their own port
+  if (port_num == OUTBOX_BATCH_PORT) {
+    return decodeBatch(bytes);
+  }
+  // config acks are sent in front of a normal reading
+  if (port_num == DEVICE_CONFIG_PORT) {
+    return decodeConfigAck(bytes);
+  }
+  // turbidity compressed during quiet periods
+  if (port_num == SERIES_FRAME_PORT) {
+    return decodeSeries(bytes);
+  }
+  // time requests, answered by the application server (see decodeTimeRequest())
+  if (port_num == CLOCK_SYNC_PORT) {
+    return decodeTimeRequest(bytes);
+  }
+  // history sent back in answer to a backfill request downlink
+  if (port_num == HISTORY_PORT) {
+    return decodeHistory(bytes);
+  }
+  // flash log sent back in answer to a log request downlink
+  if (port_num == FLASH_LOG_PORT) {
+    return decodeFlashLog(bytes);
+  }
+  // boot timeline, sent with the first reading after a cold boot
+  if (port_num == BOOT_REPORT_PORT) {
+    return decodeBootReport(bytes);
+  }
+
+  // presence frames leave out invalid and unchanged fields, see decodePresence()
+  let presence = null;
+  if (port_num > PRESENCE_PORT_OFFSET && port_num < OUTBOX_BATCH_PORT) {
+    port_num -= PRESENCE_PORT_OFFSET;
+    presence = {
+      bitmap: bytes[0],
+      invalid: bytes[0] & PRESENCE_INVALID_FOLLOWS ? bytes[1] : 0,
+    };
+    b = bytes[0] & PRESENCE_INVALID_FOLLOWS ? 2 : 1;
+  }
+
   // which port has the data come from
   let port_name = "PORT" + port_num; // i.e. if port_num = 1 then port_name = "PORT1"
   // test that the port is defined in PORT_SCHEMA
@@ -302,27 +354,27 @@ function decodePayload(bytes, port_num) {
 
   // check if the port includes that sensor
   // then decodeValue and move forward in bytes by size of the sensor value
-  if (port_format.batteryVoltage) {
+  if (port_format.batteryVoltage && fieldPresent(presence, 0)) {
     decoded.battery_mv = batteryVoltageSchema.decodeValue(bytes, b);
     b += batteryVoltageSchema.n_bytes;
   }
-  if (port_format.temperature) {
+  if (port_format.temperature && fieldPresent(presence, 1)) {
     decoded.temperature = temperatureSchema.decodeValue(bytes, b);
     b += temperatureSchema.n_bytes;
   }
-  if (port_format.relativeHumidity) {
+  if (port_format.relativeHumidity && fieldPresent(presence, 2)) {
     decoded.humidity = relativeHumiditySchema.decodeValue(bytes, b);
     b += relativeHumiditySchema.n_bytes;
   }
-  if (port_format.airPressure) {
+  if (port_format.airPressure && fieldPresent(presence, 3)) {
     decoded.pressure = airPressureSchema.decodeValue(bytes, b);
     b += airPressureSchema.n_bytes;
   }
-  if (port_format.gasResistance) {
+  if (port_format.gasResistance && fieldPresent(presence, 4)) {
     decoded.gas = gasResistanceSchema.decodeValue(bytes, b);
     b += gasResistanceSchema.n_bytes;
   }
-  if (port_format.location) {
+  if (port_format.location && fieldPresent(presence, 5)) {
     // as location has two values (n_values = 2) an array is returned by decodeValues
     // these are assigned to latitude & longtiude respectively
     let [latitude, longitude] = locationSchema.decodeValue(bytes, b);
@@ -337,11 +389,365 @@ function decodePayload(bytes, port_num) {
       },
     };
   }
+  if (port_format.turbidity && fieldPresent(presence, 6)) {
+    decoded.turbidity = turbiditySchema.decodeValue(bytes, b);
+    b += turbiditySchema.n_bytes;
+  }
   // if (port_format.newSensor) {
   //   decoded.gas = newSensorSchema.decodeValue(bytes, b);
   //   b += newSensorSchema.n_bytes;
   // }
+  if (presence) {
+    decodePresence(decoded, port_format, presence);
+  }
+
+  debugLog(decoded);
+  return decoded;
+}
+
+/**
+ * Presence frames are sent on the port number + 100.
+ * Mirrors PRESENCE_PORT_OFFSET & PRESENCE_INVALID_FOLLOWS in the device firmware.
+ * The bitmap (and invalid mask, if any) bit of each field is its index in PRESENCE_FIELDS.
+ */
+const PRESENCE_PORT_OFFSET = 100;
+const PRESENCE_INVALID_FOLLOWS = 0x80;
+// prettier-ignore
+const PRESENCE_FIELDS = [
+  ["batteryVoltage", "battery_mv"], ["temperature", "temperature"], ["relativeHumidity", "humidity"],
+  ["airPressure", "pressure"], ["gasResistance", "gas"], ["location", "location"], ["turbidity", "turbidity"],
+];
+let last_known = {}; // last value of each field from a presence frame, kept for as long as the decoder is loaded
+
+/**
+ * Function fieldPresent()
+ * @param {*} presence Presence header of the frame, or null for a normal frame.
+ * @param {*} bit      Bit of the field in the bitmap.
+ * @returns True if the field's value is in the payload.
+ */
+function fieldPresent(presence, bit) {
+  return presence === null || !!(presence.bitmap & (1 << bit));
+}
+
+/**
+ * Function decodePresence()
+ * Fills the fields a presence frame left out: null if the device flagged them invalid, otherwise (unchanged) the last
+ * known value if the decoder has one, which is null for a field that is still invalid. If it doesn't, the field is left
+ * out and Ubidots keeps its last dot. The device sends every valid field and flags every invalid one at least every 12
+ * frames, so last_known is soon filled after a restart.
+ * @param {*} decoded     Decoded payload, modified in place.
+ * @param {*} port_format Port schema of the frame.
+ * @param {*} presence    Presence header of the frame.
+ */
+function decodePresence(decoded, port_format, presence) {
+  PRESENCE_FIELDS.forEach(([flag, name], bit) => {
+    if (!port_format[flag]) {
+      return;
+    }
+    if (presence.invalid & (1 << bit)) {
+      decoded[name] = null;
+      last_known[name] = null;
+    } else if (fieldPresent(presence, bit)) {
+      last_known[name] = decoded[name];
+    } else if (name in last_known) {
+      decoded[name] = last_known[name];
+    }
+  });
+}
+
+/**
+ * Port used by the device's Outbox library for coalesced frames.
+ * Mirrors OUTBOX_BATCH_PORT in the device firmware.
+ */
+const OUTBOX_BATCH_PORT = 200;
+
+/**
+ * Function decodeBatch()
+ * Decodes a batch frame from the device's outbox: [count] then per record [port][seq MSB][seq LSB][length][payload].
+ * @param {*} bytes Byte data payload.
+ * @returns Decoded payload of the newest record, with every record (oldest first) in the "records" list.
+ */
+function decodeBatch(bytes) {
+  let records = [];
+  let b = 1; // skip the record count
+  for (let r = 0; r < bytes[0] && b < bytes.length; r++) {
+    let port_num = bytes[b];
+    let sequence = (bytes[b + 1] << 8) | bytes[b + 2];
+    let length = bytes[b + 3];
+    b += 4;
+    let decoded = decodePayload(bytes.slice(b, b + length), port_num);
+    b += length;
+    records.push({ port: port_num, sequence: sequence, decoded: decoded });
+  }
+  // sequence numbers are 16 bit so may have wrapped, but within one batch they are close together
+  records.sort((x, y) => ((x.sequence - y.sequence + 0x8000) & 0xffff) - 0x8000);
+  debugLog(records);
+  if (records.length == 0) {
+    return;
+  }
+  let newest = Object.assign({}, records[records.length - 1].decoded);
+  newest.records = records;
+  return newest;
+}
+
+/**
+ * Port used by the device's DeviceConfig library for config downlinks and acks.
+ * Mirrors DEVICE_CONFIG_PORT in the device firmware.
+ */
+const DEVICE_CONFIG_PORT = 201;
+
+/**
+ * Function decodeConfigAck()
+ * Decodes a config ack: [version][command id][status][original port][original payload...].
+ * @param {*} bytes Byte data payload.
+ * @returns Decoded original payload with the ack added as "config_ack".
+ */
+function decodeConfigAck(bytes) {
+  let decoded = decodePayload(bytes.slice(4), bytes[3]) || {};
+  decoded.config_ack = {
+    value: bytes[2], // status: 0 = applied
+    context: { version: bytes[0], command_id: bytes[1] },
+  };
+  return decoded;
+}
+
+/**
+ * Port used by the device's SeriesCompression library for compressed turbidity.
+ * Mirrors SERIES_FRAME_PORT in the device firmware.
+ */
+const SERIES_FRAME_PORT = 202;
+
+/**
+ * Function decodeSeries()
+ * Decodes a series frame: [version][count][base time (4 bytes)] then per point [dt (2 bytes)][turbidity x10 (2 bytes)].
+ * Once the device's clock is synced times are Unix time and each point gets its timestamp. Before that times are
+ * seconds since the device booted, so each point is given as its age relative to the last point (the reading taken
+ * just before the uplink). Values between points can be linearly interpolated.
+ * @param {*} bytes Byte data payload.
+ * @returns Decoded payload with "turbidity" as a list of { value, timestamp } or { value, age_s }, oldest first.
+ */
+function decodeSeries(bytes) {
+  let count = bytes[1];
+  if (bytes[0] != 1 || bytes.length < 6 + 4 * count) {
+    debugLog("Error: Malformed series frame.");
+    return;
+  }
+  let time_s = ((bytes[2] << 24) | (bytes[3] << 16) | (bytes[4] << 8) | bytes[5]) >>> 0;
+  let points = [];
+  for (let p = 0, b = 6; p < count; p++, b += 4) {
+    time_s += (bytes[b] << 8) | bytes[b + 1];
+    points.push({ time_s: time_s, value: ((bytes[b + 2] << 8) | bytes[b + 3]) / 10 });
+  }
+  let decoded = { turbidity: [] };
+  for (let point of points) {
+    if (isUnixTime(point.time_s)) {
+      decoded.turbidity.push({ value: point.value, timestamp: 1000 * point.time_s });
+    } else {
+      decoded.turbidity.push({ value: point.value, age_s: time_s - point.time_s });
+    }
+  }
+  debugLog(decoded);
+  return decoded;
+}
+
+/**
+ * Device times from this on (2020-01-01) are Unix time from a synced clock, earlier ones are seconds since boot.
+ * Mirrors CLOCK_VALID_UNIX_S in the device firmware.
+ */
+const CLOCK_VALID_UNIX_S = 1577836800;
+
+function isUnixTime(time_s) {
+  return time_s >= CLOCK_VALID_UNIX_S;
+}
+
+/**
+ * Port used by the device's WallClock library for time requests & answers.
+ * Mirrors CLOCK_SYNC_PORT in the device firmware.
+ */
+const CLOCK_SYNC_PORT = 204;
+
+/**
+ * Function decodeTimeRequest()
+ * Decodes a time request: [version][token][device time s (4 bytes)][ms (2 bytes)].
+ * The application server should answer with a downlink on CLOCK_SYNC_PORT: [version][token][time s (4 bytes)]
+ * [ms (2 bytes)], where the time is the uplink's "received_at". It can be sent whenever, the device only uses the
+ * token to match it to its request.
+ * @param {*} bytes Byte data payload.
+ * @returns Decoded payload with "clock_offset" (server minus device time, in seconds) if the device is synced.
+ */
+function decodeTimeRequest(bytes) {
+  if (bytes[0] != 1 || bytes.length != 8) {
+    debugLog("Error: Malformed time request.");
+    return;
+  }
+  let time_s = ((bytes[2] << 24) | (bytes[3] << 16) | (bytes[4] << 8) | bytes[5]) >>> 0;
+  let device_ms = 1000 * time_s + ((bytes[6] << 8) | bytes[7]);
+  let decoded = {};
+  if (isUnixTime(time_s)) {
+    decoded.clock_offset = { value: (Date.now() - device_ms) / 1000, context: { token: bytes[1] } };
+  }
+  debugLog(decoded);
+  return decoded;
+}
+
+/**
+ * Port used by the device's History library for backfill requests and fragments.
+ * Mirrors HISTORY_PORT in the device firmware.
+ */
+const HISTORY_PORT = 203;
+
+/**
+ * Function decodeHistory()
+ * Decodes a backfill fragment: [version][request id][fragment][flags] then per summary [time (4 bytes)][mean (2 bytes)]
+ * [min (2 bytes)][max (2 bytes)][battery mV (2 bytes)]. Bit 0 of flags is set on the last fragment of a request.
+ * Summaries stored once the device's clock was synced also get a timestamp, earlier ones only have seconds since boot.
+ * @param {*} bytes Byte data payload.
+ * @returns Decoded payload with "history" giving the number of summaries, and the summaries in its context.
+ */
+function decodeHistory(bytes) {
+  if (bytes[0] != 1 || bytes.length < 4 || (bytes.length - 4) % 12 != 0) {
+    debugLog("Error: Malformed history fragment.");
+    return;
+  }
+  let records = [];
+  for (let b = 4; b < bytes.length; b += 12) {
+    records.push({
+      time_s: ((bytes[b] << 24) | (bytes[b + 1] << 16) | (bytes[b + 2] << 8) | bytes[b + 3]) >>> 0,
+      mean: (bytes[b + 4] << 8) | bytes[b + 5],
+      min: (bytes[b + 6] << 8) | bytes[b + 7],
+      max: (bytes[b + 8] << 8) | bytes[b + 9],
+      battery_mv: (bytes[b + 10] << 8) | bytes[b + 11],
+    });
+    let record = records[records.length - 1];
+    if (isUnixTime(record.time_s)) {
+      record.timestamp = 1000 * record.time_s;
+    }
+  }
+  let decoded = {
+    history: {
+      value: records.length,
+      context: { request_id: bytes[1], fragment: bytes[2], last: (bytes[3] & 0x01) != 0, records: records },
+    },
+  };
+  debugLog(decoded);
+  return decoded;
+}
+
+/**
+ * Port used by the device's FlashLog library for log requests and fragments.
+ * Mirrors FLASH_LOG_PORT in the device firmware.
+ */
+const FLASH_LOG_PORT = 205;
+
+const BASE64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Function tokenLine()
+ * Encodes a tokenised log record as the device prints it on Serial: '$' and base64.
+ * @param {*} bytes The record.
+ * @returns The line.
+ */
+function tokenLine(bytes) {
+  let line = "$";
+  for (let i = 0; i < bytes.length; i += 3) {
+    let group = (bytes[i] << 16) | ((bytes[i + 1] || 0) << 8) | (bytes[i + 2] || 0);
+    line += BASE64[(group >> 18) & 0x3f] + BASE64[(group >> 12) & 0x3f];
+    line += i + 1 < bytes.length ? BASE64[(group >> 6) & 0x3f] : "=";
+    line += i + 2 < bytes.length ? BASE64[group & 0x3f] : "=";
+  }
+  return line;
+}
+
+/**
+ * Function decodeFlashLog()
+ * Decodes a log fragment: [version][request id][fragment][flags] then items, [length][record] for a tokenised log
+ * record or [0][boot (2 bytes)] for the boot the records after it are from. Bit 0 of flags is set on the last fragment
+ * of a request. The records can't be rendered here, they're given as token lines for the host detokeniser
+ * (test/log_detokenise.cc in the device firmware).
+ * @param {*} bytes Byte data payload.
+ * @returns Decoded payload with "log" giving the number of records, and the records in its context.
+ */
+function decodeFlashLog(bytes) {
+  if (bytes[0] != 1 || bytes.length < 4) {
+    debugLog("Error: Malformed log fragment.");
+    return;
+  }
+  let records = [];
+  let boot = null;
+  for (let b = 4; b < bytes.length; ) {
+    if (bytes[b] == 0) {
+      boot = (bytes[b + 1] << 8) | bytes[b + 2];
+      b += 3;
+      continue;
+    }
+    let length = bytes[b];
+    if (b + 1 + length > bytes.length) {
+      debugLog("Error: Malformed log fragment.");
+      return;
+    }
+    records.push({ boot: boot, line: tokenLine(bytes.slice(b + 1, b + 1 + length)) });
+    b += 1 + length;
+  }
+  let decoded = {
+    log: {
+      value: records.length,
+      context: { request_id: bytes[1], fragment: bytes[2], last: (bytes[3] & 0x01) != 0, records: records },
+    },
+  };
+  debugLog(decoded);
+  return decoded;
+}
+
+/**
+ * Port used by the device's boot report.
+ * Mirrors BOOT_REPORT_PORT in the device firmware.
+ */
+const BOOT_REPORT_PORT = 206;
+
+/**
+ * Boot phases in the order of their ids. Mirrors BOOT_PHASE in the device firmware.
+ */
+const BOOT_PHASES = [
+  "logging",
+  "flash_log",
+  "config",
+  "radio",
+  "join_started",
+  "storage",
+  "ready",
+  "sensors",
+  "joined",
+  "first_reading",
+];
 
+/**
+ * Function decodeBootReport()
+ * Decodes a boot report: [version][flags][reset reason (4 bytes)] then per phase [phase][time (2 bytes)], the time in
+ * 10 ms units since the reset. Bit 0 of flags is set if the boot woke from deep sleep. The reset reason is the nRF52
+ * RESETREAS register.
+ * @param {*} bytes Byte data payload.
+ * @returns Decoded payload with "boot_ready_ms" giving the time to the end of setup(), and the phases in its context.
+ */
+function decodeBootReport(bytes) {
+  if (bytes[0] != 1 || bytes.length < 6 || (bytes.length - 6) % 3 != 0) {
+    debugLog("Error: Malformed boot report.");
+    return;
+  }
+  let phases = {};
+  for (let b = 6; b < bytes.length; b += 3) {
+    let name = BOOT_PHASES[bytes[b]] || "phase_" + bytes[b];
+    phases[name] = 10 * ((bytes[b + 1] << 8) | bytes[b + 2]);
+  }
+  let decoded = {
+    boot_ready_ms: {
+      value: phases.hasOwnProperty("ready") ? phases.ready : null,
+      context: {
+        resumed: (bytes[1] & 0x01) != 0,
+        reset_reason: ((bytes[2] << 24) | (bytes[3] << 16) | (bytes[4] << 8) | bytes[5]) >>> 0,
+        phases_ms: phases,
+      },
+    },
+  };
   debugLog(decoded);
   return decoded;
 }
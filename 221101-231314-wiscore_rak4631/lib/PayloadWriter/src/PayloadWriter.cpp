@@ -0,0 +1,29 @@
+#include "PayloadWriter.h"
+
+bool PayloadWriter::putBytes(const uint8_t *data, uint8_t length) {
+    uint8_t *out = reserve(length);
+    if (out == NULL) {
+        return false;
+    }
+    memcpy(out, data, length);
+    return true;
+}
+
+size_t formatHex(const uint8_t *data, size_t length, char *out, size_t out_size) {
+    static const char digits[] = "0123456789ABCDEF";
+    if (out_size == 0) {
+        return 0;
+    }
+    size_t n = (out_size - 1) / 3; // whole bytes that fit
+    if (n > length) {
+        n = length;
+    }
+    char *p = out;
+    for (size_t b = 0; b < n; b++) {
+        *p++ = digits[data[b] >> 4];
+        *p++ = digits[data[b] & 0x0F];
+        *p++ = ' ';
+    }
+    *p = '\0';
+    return p - out;
+}
@@ -0,0 +1,165 @@
+#pragma once
+/**
+ * @file PayloadWriter.h
+ * @brief Bounds-checked writer for building payloads in place, and an allocation-free hex formatter for logging them.
+ *
+ * A PayloadWriter wraps a caller-owned buffer with a fixed capacity. Every put either writes all of its bytes or none
+ * of them; if it doesn't fit the writer is marked as overflowed and every later put fails too, so a frame is never
+ * sent with a field missing from the middle. Values are written big-endian (MSB first), matching the decoder.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Writes big-endian values into a fixed size buffer without ever writing past the end.
+ */
+class PayloadWriter {
+  public:
+    /**
+     * @brief Construct a new payload writer.
+     * @param buffer Buffer to write into. Not owned; must outlive the writer.
+     * @param capacity Size of buffer.
+     * @param start Start writing at this byte, e.g. after a header written by someone else.
+     */
+    PayloadWriter(uint8_t *buffer, uint8_t capacity, uint8_t start = 0)
+        : buffer(buffer), capacity(capacity), position(start), overflow(start > capacity) {}
+
+    /**
+     * @brief Writes the lowest N bytes of value, MSB first. Specialised for 1, 2 and 4 bytes.
+     * @return True if written, false if it didn't fit (nothing is written).
+     */
+    template <uint8_t N> inline bool putBE(uint32_t value) {
+        uint8_t *out = reserve(N);
+        if (out == NULL) {
+            return false;
+        }
+        for (uint8_t i = 0; i < N; i++) {
+            out[i] = (uint8_t)(value >> (8 * (N - 1 - i)));
+        }
+        return true;
+    }
+
+    /** @brief Writes 1, 2 or 4 bytes. @return True if written, false if it didn't fit (nothing is written). */
+    bool putU8(uint8_t value);
+    bool putU16(uint16_t value);
+    bool putU32(uint32_t value);
+
+    /**
+     * @brief Writes the lowest width bytes of value, MSB first, for widths only known at runtime (e.g. from a schema).
+     * @param width 1 - 4 bytes.
+     * @return True if written, false if it didn't fit or width is invalid (nothing is written).
+     */
+    bool putBE(uint32_t value, uint8_t width);
+
+    /**
+     * @brief Copies bytes into the payload.
+     * @return True if written, false if they didn't fit (nothing is written).
+     */
+    bool putBytes(const uint8_t *data, uint8_t length);
+
+    /**
+     * @brief Claims the next length bytes so they can be filled in place, e.g. a header written after its contents.
+     * @return Pointer to the claimed bytes, or NULL (and overflowed) if they don't fit.
+     */
+    inline uint8_t *reserve(uint8_t length) {
+        if (overflow || (length > (uint8_t)(capacity - position))) {
+            overflow = true;
+            return NULL;
+        }
+        uint8_t *out = &buffer[position];
+        position += length;
+        return out;
+    }
+
+    /** @brief Bytes written so far (including the start offset). */
+    inline uint8_t length(void) const { return position; };
+    /** @brief Bytes left before the buffer is full. */
+    inline uint8_t remaining(void) const { return overflow ? 0 : capacity - position; };
+    /** @brief True if any put didn't fit. The payload is incomplete and shouldn't be sent. */
+    inline bool overflowed(void) const { return overflow; };
+    /** @brief The buffer being written. */
+    inline uint8_t *data(void) const { return buffer; };
+
+  private:
+    uint8_t *buffer;
+    uint8_t capacity;
+    uint8_t position;
+    bool overflow;
+};
+
+template <> inline bool PayloadWriter::putBE<1>(uint32_t value) {
+    uint8_t *out = reserve(1);
+    if (out == NULL) {
+        return false;
+    }
+    out[0] = (uint8_t)value;
+    return true;
+}
+
+template <> inline bool PayloadWriter::putBE<2>(uint32_t value) {
+    uint8_t *out = reserve(2);
+    if (out == NULL) {
+        return false;
+    }
+    out[0] = (uint8_t)(value >> 8);
+    out[1] = (uint8_t)value;
+    return true;
+}
+
+template <> inline bool PayloadWriter::putBE<4>(uint32_t value) {
+    uint8_t *out = reserve(4);
+    if (out == NULL) {
+        return false;
+    }
+    out[0] = (uint8_t)(value >> 24);
+    out[1] = (uint8_t)(value >> 16);
+    out[2] = (uint8_t)(value >> 8);
+    out[3] = (uint8_t)value;
+    return true;
+}
+
+inline bool PayloadWriter::putBE(uint32_t value, uint8_t width) {
+    switch (width) {
+        case 1:
+            return putBE<1>(value);
+        case 2:
+            return putBE<2>(value);
+        case 3:
+            return putBE<3>(value);
+        case 4:
+            return putBE<4>(value);
+        default:
+            overflow = true;
+            return false;
+    }
+}
+
+inline bool PayloadWriter::putU8(uint8_t value) {
+    return putBE<1>(value);
+}
+
+inline bool PayloadWriter::putU16(uint16_t value) {
+    return putBE<2>(value);
+}
+
+inline bool PayloadWriter::putU32(uint32_t value) {
+    return putBE<4>(value);
+}
+
+/**
+ * @brief Formats bytes as space separated hex ("0A 1B ") in a single pass, e.g. to log a payload.
+ * Always NUL terminates. If out is too small the output stops at the last whole byte that fits.
+ * @param data Bytes to format.
+ * @param length Number of bytes.
+ * @param out Buffer for the text; 3 * length + 1 chars fits everything.
+ * @param out_size Size of out.
+ * @return Number of chars written, not counting the NUL.
+ */
+size_t formatHex(const uint8_t *data, size_t length, char *out, size_t out_size);
@@ -0,0 +1,158 @@
+#include "PortRotation.h"
+
+/**
+ * @brief Sets the flags in a that are set in b.
+ */
+static void addPortFlags(portSchema *a, const portSchema *b) {
+    a->sendBatteryVoltage |= b->sendBatteryVoltage;
+    a->sendTemperature |= b->sendTemperature;
+    a->sendRelativeHumidity |= b->sendRelativeHumidity;
+    a->sendAirPressure |= b->sendAirPressure;
+    a->sendGasResistance |= b->sendGasResistance;
+    a->sendLocation |= b->sendLocation;
+    a->sendTurbidity |= b->sendTurbidity;
+}
+
+/**
+ * @brief A portSchema with no flags set.
+ */
+static portSchema emptyPort(uint8_t port_number) {
+    return { port_number, false, false, false, false, false, false, false };
+}
+
+portRotation::portRotation(const portRotationEntry *entries, uint8_t n_entries) {
+    if (n_entries > PORT_ROTATION_MAX_ENTRIES) {
+        n_entries = PORT_ROTATION_MAX_ENTRIES;
+    }
+    this->n_entries = n_entries;
+    for (uint8_t e = 0; e < n_entries; e++) {
+        this->entries[e] = entries[e];
+    }
+}
+
+portSchema portRotation::requiredSensors(void) const {
+    portSchema required = emptyPort(entries[0].port.port_number);
+    for (uint8_t e = 0; e < n_entries; e++) {
+        addPortFlags(&required, &entries[e].port);
+    }
+    return required;
+}
+
+portSchema portRotation::startFrame(uint32_t now_ms) {
+    due = 0;
+    for (uint8_t e = 0; e < n_entries; e++) {
+        bool by_count = (entries[e].every_n_frames > 0) && ((frames_started % entries[e].every_n_frames) == 0);
+        // the first frame sends everything so slow telemetry is available straight after a reset
+        bool by_time = (entries[e].every_ms > 0) &&
+                       ((frames_started == 0) || ((now_ms - last_sent_ms[e]) >= entries[e].every_ms));
+        if (by_count || by_time) {
+            due |= (1 << e);
+            last_sent_ms[e] = now_ms;
+        }
+    }
+    if (due == 0) {
+        // always send something
+        due = 1;
+    }
+    frames_started++;
+
+    portSchema frame_port = emptyPort(entries[0].port.port_number);
+    for (uint8_t e = 0; e < n_entries; e++) {
+        if (due & (1 << e)) {
+            addPortFlags(&frame_port, &entries[e].port);
+        }
+    }
+    return frame_port;
+}
+
+uint8_t portRotation::encodeFrame(sensorData *sensor_data, uint8_t *payload_buffer, uint8_t *port_number) {
+    return encodeFrame(sensor_data, due, payload_buffer, port_number);
+}
+
+uint8_t portRotation::encodeFrame(sensorData *sensor_data, uint8_t due_mask, uint8_t *payload_buffer,
+                                  uint8_t *port_number) {
+    uint8_t n_due = 0;
+    uint8_t only = 0;
+    for (uint8_t e = 0; e < n_entries; e++) {
+        if (due_mask & (1 << e)) {
+            n_due++;
+            only = e;
+        }
+    }
+
+    uint8_t length = 0;
+    if (n_due == 1) {
+        if (use_presence) {
+            PayloadWriter writer(payload_buffer, PAYLOAD_BUFFER_SIZE);
+            presence.encode(&entries[only].port, sensor_data, &writer, port_number);
+            length = writer.overflowed() ? 0 : writer.length();
+        } else {
+            *port_number = entries[only].port.port_number;
+            length = entries[only].port.encodeSensorDataToPayload(sensor_data, payload_buffer);
+        }
+    } else {
+        // [count] then per port [port][frame count MSB][frame count LSB][length][data]
+        uint8_t count = 0;
+        PayloadWriter writer(payload_buffer, OUTBOX_BATCH_MAX_LENGTH, OUTBOX_BATCH_HEADER);
+        for (uint8_t e = 0; e < n_entries; e++) {
+            if (!(due_mask & (1 << e))) {
+                continue;
+            }
+            if ((OUTBOX_BATCH_RECORD_HEADER + entries[e].port.payloadLength()) > writer.remaining()) {
+                LOG_WARN("Port %u doesn't fit in this frame, skipped.", entries[e].port.port_number);
+                continue;
+            }
+            uint8_t *record = writer.reserve(OUTBOX_BATCH_RECORD_HEADER);
+            uint8_t start = writer.length();
+            entries[e].port.encodeSensorData(sensor_data, &writer);
+            record[0] = entries[e].port.port_number;
+            record[1] = (uint8_t)(frame_count >> 8);
+            record[2] = (uint8_t)(frame_count & 0xFF);
+            record[3] = writer.length() - start;
+            count++;
+        }
+        payload_buffer[0] = count;
+        length = writer.length();
+        *port_number = OUTBOX_BATCH_PORT;
+    }
+
+    LOG_DEBUG("Port rotation frame %lu: %u port(s) due, %u bytes.", frame_count, n_due, length);
+    frame_count++;
+    return length;
+}
+
+void portRotation::setBasePort(const portSchema *port) {
+    entries[0].port = *port;
+}
+
+void portRotation::setPresenceBitmap(bool enabled) {
+    use_presence = enabled;
+    presence.invalidate();
+}
+
+void portRotation::frameSent(bool sent_live) {
+    if (sent_live) {
+        presence.commit();
+    } else {
+        presence.invalidate();
+    }
+}
+
+void portRotation::save(portRotationState *state, uint32_t now_ms) const {
+    state->frames_started = frames_started;
+    state->frame_count = frame_count;
+    for (uint8_t e = 0; e < PORT_ROTATION_MAX_ENTRIES; e++) {
+        state->since_sent_ms[e] = now_ms - last_sent_ms[e];
+    }
+    presence.save(&state->presence);
+}
+
+void portRotation::resume(const portRotationState *state, uint32_t asleep_ms) {
+    frames_started = state->frames_started;
+    frame_count = state->frame_count;
+    for (uint8_t e = 0; e < PORT_ROTATION_MAX_ENTRIES; e++) {
+        // before the reset, so this wraps the same way millis() does
+        last_sent_ms[e] = 0 - asleep_ms - state->since_sent_ms[e];
+    }
+    presence.restore(&state->presence);
+}
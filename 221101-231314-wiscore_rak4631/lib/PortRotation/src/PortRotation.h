@@ -0,0 +1,140 @@
+#pragma once
+/**
+ * @file PortRotation.h
+ * @brief Rotates between port schemas at runtime so that expensive data is only read and sent every Nth frame.
+ * E.g. PORT10 (battery + turbidity) every frame, PORT7 (+ environment) every 6th frame and PORT9 once a day.
+ *
+ * Each frame, the ports that are due are worked out first so that only the sensors they need are read. If only one
+ * port is due the frame is encoded exactly as that port. If several are due they are sent together in one frame using
+ * the same batch format as the Outbox (OUTBOX_BATCH_PORT), with the frame count as the sequence number.
+ * Optionally, single port frames can be sent as presence frames (see PresenceBitmap.h) so invalid and unchanged fields
+ * are left out.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+
+#include "Logging.h"    /**< Go here to change the logging level for the entire application. */
+#include "Outbox.h"     /**< Batch frame format. */
+#include "PortSchema.h" /**< Go here to see existing and define new sensor/port schemas. */
+#include "PresenceBitmap.h" /**< Leaves out invalid & unchanged fields. */
+
+#define PORT_ROTATION_MAX_ENTRIES 8 /**< Max number of ports in a rotation. */
+
+/** @brief One port in the rotation. A port is due if either of its conditions is met. */
+struct portRotationEntry {
+    portSchema port;         /**< Port to send. */
+    uint16_t every_n_frames; /**< Send every N frames (1 = every frame, 0 = not by frame count). */
+    uint32_t every_ms;       /**< Send if this long has passed since it was last sent (0 = not by time). */
+};
+
+/** @brief Where the rotation is up to, so it can carry on after a reset (see DeepSleep.h). */
+struct portRotationState {
+    uint32_t frames_started;
+    uint32_t frame_count;
+    uint32_t since_sent_ms[PORT_ROTATION_MAX_ENTRIES]; // time since each entry was last due
+    presenceState presence;
+};
+
+/**
+ * @brief A schedule of ports to rotate between.
+ */
+class portRotation {
+  public:
+    /**
+     * @brief Construct a new port rotation.
+     * @param entries Ports in the rotation. The first entry is the base port and should be sent every frame.
+     * @param n_entries Number of entries (max PORT_ROTATION_MAX_ENTRIES).
+     */
+    portRotation(const portRotationEntry *entries, uint8_t n_entries);
+
+    /**
+     * @brief Union of every port in the rotation. Pass this to initSensors() so every sensor the rotation needs is
+     * initialised.
+     * @return A portSchema with the flags of every port set (port_number is the base port's).
+     */
+    portSchema requiredSensors(void) const;
+
+    /**
+     * @brief Works out which ports are due for this frame. Call once per frame before reading the sensors.
+     * @param now_ms Current time in ms (e.g. millis()).
+     * @return A portSchema with the flags of every port due this frame set; pass it to getSensorData().
+     */
+    portSchema startFrame(uint32_t now_ms);
+
+    /**
+     * @brief Entries due this frame (valid between startFrame() and the next startFrame()), bit n = entry n. Keep it
+     * with the sensor data if the frame is encoded later, e.g. by another task.
+     */
+    inline uint8_t dueMask(void) const { return due; };
+
+    /**
+     * @brief Encodes the sensor data for the ports due this frame and moves on to the next frame.
+     * @param sensor_data Sensor data read using the result of startFrame().
+     * @param payload_buffer Buffer to encode into, at least PAYLOAD_BUFFER_SIZE bytes.
+     * @param port_number Filled with the port number to send the frame on.
+     * @return Length of the encoded frame.
+     */
+    uint8_t encodeFrame(sensorData *sensor_data, uint8_t *payload_buffer, uint8_t *port_number);
+
+    /**
+     * @brief Encodes sensor data for the entries in due_mask (from dueMask()), so frames can be started & encoded in
+     * different tasks. startFrame() and encodeFrame() don't share any state except the entries themselves.
+     */
+    uint8_t encodeFrame(sensorData *sensor_data, uint8_t due_mask, uint8_t *payload_buffer, uint8_t *port_number);
+
+    /**
+     * @brief Replaces the base (first) port of the rotation, e.g. after a config downlink.
+     * @param port New base port.
+     */
+    void setBasePort(const portSchema *port);
+
+    /**
+     * @brief The base (first) port of the rotation.
+     */
+    inline const portSchema *basePort(void) const { return &entries[0].port; };
+
+    /**
+     * @brief True if only the base port is due this frame (valid between startFrame() and the next startFrame()).
+     */
+    inline bool onlyBaseDue(void) const { return due == 1; };
+
+    /**
+     * @brief Turns presence frames on or off for single port frames. Off by default.
+     */
+    void setPresenceBitmap(bool enabled);
+
+    /**
+     * @brief Call after a frame from encodeFrame() has been handed to LoRaWAN. Not needed if the frame was dropped.
+     * @param sent_live True if it was sent straight away, false if it was queued (so may arrive out of order).
+     */
+    void frameSent(bool sent_live);
+
+    /**
+     * @brief Saves the frame counts, how long ago each entry was sent and the presence frame state.
+     * @param now_ms Current time in ms (e.g. millis()).
+     */
+    void save(portRotationState *state, uint32_t now_ms) const;
+
+    /**
+     * @brief Carries on from a saved rotation after a reset, so timed entries stay on schedule instead of all being
+     * due in the first frame. Call after setPresenceBitmap(). The entries themselves aren't saved.
+     * @param state From save().
+     * @param asleep_ms Time from save() until the reset (when millis() restarted from 0).
+     */
+    void resume(const portRotationState *state, uint32_t asleep_ms);
+
+  private:
+    portRotationEntry entries[PORT_ROTATION_MAX_ENTRIES];
+    uint32_t last_sent_ms[PORT_ROTATION_MAX_ENTRIES] = {};
+    uint8_t n_entries;
+    uint8_t due = 0;             // bitmask of entries due this frame
+    uint32_t frames_started = 0; // frames started so far
+    uint32_t frame_count = 0;    // frames encoded so far
+    bool use_presence = false;
+    presenceEncoder presence;
+};
@@ -33,8 +33,7 @@ sensorData sensor_data = { 1, true, 2, true, 3, true, 4, true, 5, true, 6, 7, tr
 // Sensor reading interval in [ms] = 2 seconds.
 const int encoding_interval = 2000;
 
-// PAYLOAD ENCODING
-#define PAYLOAD_BUFFER_SIZE 64
+// PAYLOAD ENCODING (PAYLOAD_BUFFER_SIZE is in LoRaWAN_functs.h)
 uint8_t payload_buffer[PAYLOAD_BUFFER_SIZE] = {};                /**< Buffer that payload data is placed in. */
 lmh_app_data_t lorawan_payload = { payload_buffer, 0, 0, 0, 0 }; /**< Struct that passes the payload buffer and relevant
                                                                     params for a LoRaWAN frame. */
@@ -45,13 +44,13 @@ lmh_app_data_t lorawan_payload = { payload_buffer, 0, 0, 0, 0 }; /**< Struct tha
 void setup() {
     // initialise the logging module - function does nothing if APP_LOG_LEVEL in Logging.h = NONE
     initLogging();
-    log(LOG_LEVEL::INFO,
+    LOG_INFO(
         "\n====================================="
         "\nWelcome to Simple Port Schema Example"
         "\n=====================================");
 
     // log sensor data once
-    log(LOG_LEVEL::INFO, "Sensor Data: {b: %.2f mV | t: %.2f C | h: %.2f %% | p: %lu Pa | g: %lu | l: %.5f, %.5f}",
+    LOG_INFO("Sensor Data: {b: %.2f mV | t: %.2f C | h: %.2f %% | p: %lu Pa | g: %lu | l: %.5f, %.5f}",
         sensor_data.battery_mv.value, sensor_data.temperature.value, sensor_data.humidity.value, sensor_data.pressure.value,
         sensor_data.gas_resist.value, sensor_data.location.latitude, sensor_data.location.longitude);
 
@@ -76,10 +75,8 @@ void loop() {
         lorawan_payload.buffsize = payload_port.encodeSensorDataToPayload(&sensor_data, payload_buffer);
 
         // log the encoded bytes
-        char encoded_payload_bytes[3 * PAYLOAD_BUFFER_SIZE] = {};
-        for (int b = 0; b < lorawan_payload.buffsize; b++) {
-            snprintf(encoded_payload_bytes, sizeof(encoded_payload_bytes), "%s%02X ", encoded_payload_bytes, payload_buffer[b]);
-        }
-        log(LOG_LEVEL::INFO, "Port: %2.d | Payload: %s", lorawan_payload.port, encoded_payload_bytes);
+        char encoded_payload_bytes[3 * PAYLOAD_BUFFER_SIZE + 1];
+        formatHex(payload_buffer, lorawan_payload.buffsize, encoded_payload_bytes, sizeof(encoded_payload_bytes));
+        LOG_INFO("Port: %2.d | Payload: %s", lorawan_payload.port, encoded_payload_bytes);
     }
 }
\ No newline at end of file
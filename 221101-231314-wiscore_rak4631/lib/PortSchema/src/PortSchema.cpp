@@ -1,42 +1,67 @@
 #include "PortSchema.h"
 // #include <stdint.h>
 
-uint8_t portSchema::encodeSensorDataToPayload(sensorData *sensor_data, uint8_t *payload_buffer, uint8_t start_pos) {
+bool portSchema::encodeSensorData(sensorData *sensor_data, PayloadWriter *writer) {
     /* If the data should be included in the payload according to the portSchema, then encode the value.
-     * he order of these if statements is the order the sensor data will be encoded into the payload and should match
+     * The order of these if statements is the order the sensor data will be encoded into the payload and should match
      * the schema.
-     * The buffsize is increased by the amount of data encoded in each step.
+     * Once the writer is full every later encodeData() fails, so checking once at the end is enough.
      */
-    uint8_t payload_length = start_pos;
     if (sendBatteryVoltage) {
-        payload_length = batteryVoltageSchema.encodeData(
-            sensor_data->battery_mv.value, sensor_data->battery_mv.is_valid, payload_buffer, payload_length);
+        batteryVoltageSchema.encodeData(sensor_data->battery_mv.value, sensor_data->battery_mv.is_valid, writer);
     }
     if (sendTemperature) {
-        payload_length = temperatureSchema.encodeData(sensor_data->temperature.value, sensor_data->temperature.is_valid,
-                                                      payload_buffer, payload_length);
+        temperatureSchema.encodeData(sensor_data->temperature.value, sensor_data->temperature.is_valid, writer);
     }
     if (sendRelativeHumidity) {
-        payload_length = relativeHumiditySchema.encodeData(sensor_data->humidity.value, sensor_data->humidity.is_valid,
-                                                           payload_buffer, payload_length);
+        relativeHumiditySchema.encodeData(sensor_data->humidity.value, sensor_data->humidity.is_valid, writer);
     }
     if (sendAirPressure) {
-        payload_length = airPressureSchema.encodeData(sensor_data->pressure.value, sensor_data->pressure.is_valid,
-                                                      payload_buffer, payload_length);
+        airPressureSchema.encodeData(sensor_data->pressure.value, sensor_data->pressure.is_valid, writer);
     }
     if (sendGasResistance) {
-        payload_length = gasResistanceSchema.encodeData(sensor_data->gas_resist.value, sensor_data->gas_resist.is_valid,
-                                                        payload_buffer, payload_length);
+        gasResistanceSchema.encodeData(sensor_data->gas_resist.value, sensor_data->gas_resist.is_valid, writer);
     }
     if (sendLocation) {
-        payload_length = locationSchema.encodeData(sensor_data->location.latitude, sensor_data->location.is_valid,
-                                                   payload_buffer, payload_length);
-        payload_length = locationSchema.encodeData(sensor_data->location.longitude, sensor_data->location.is_valid,
-                                                   payload_buffer, payload_length);
+        locationSchema.encodeData(sensor_data->location.latitude, sensor_data->location.is_valid, writer);
+        locationSchema.encodeData(sensor_data->location.longitude, sensor_data->location.is_valid, writer);
     }
     if (sendTurbidity) {
-        payload_length = turbiditySchema.encodeData(sensor_data->turbidity.value, sensor_data->turbidity.is_valid,
-                                                   payload_buffer, payload_length);
+        turbiditySchema.encodeData(sensor_data->turbidity.value, sensor_data->turbidity.is_valid, writer);
+    }
+    return !writer->overflowed();
+}
+
+uint8_t portSchema::encodeSensorDataToPayload(sensorData *sensor_data, uint8_t *payload_buffer, uint8_t start_pos) {
+    PayloadWriter writer(payload_buffer, PAYLOAD_BUFFER_SIZE, start_pos);
+    if (!encodeSensorData(sensor_data, &writer)) {
+        return start_pos;
+    }
+    return writer.length();
+}
+
+uint8_t portSchema::payloadLength(void) const {
+    uint8_t length = 0;
+    length += sendBatteryVoltage ? batteryVoltageSchema.n_bytes : 0;
+    length += sendTemperature ? temperatureSchema.n_bytes : 0;
+    length += sendRelativeHumidity ? relativeHumiditySchema.n_bytes : 0;
+    length += sendAirPressure ? airPressureSchema.n_bytes : 0;
+    length += sendGasResistance ? gasResistanceSchema.n_bytes : 0;
+    length += sendLocation ? locationSchema.n_bytes : 0;
+    length += sendTurbidity ? turbiditySchema.n_bytes : 0;
+    return length;
+}
+
+bool findPortSchema(uint8_t port_number, portSchema *port) {
+    static const portSchema *const all_ports[] = {
+        &PORT1,  &PORT2,  &PORT3,  &PORT4,  &PORT5,  &PORT6,  &PORT7,  &PORT8,  &PORT9,  &PORT10,
+        &PORT50, &PORT51, &PORT52, &PORT53, &PORT54, &PORT55, &PORT56, &PORT57, &PORT58, &PORT59,
+    };
+    for (const portSchema *p : all_ports) {
+        if (p->port_number == port_number) {
+            *port = *p;
+            return true;
+        }
     }
-    return payload_length;
-};
\ No newline at end of file
+    return false;
+}
@@ -15,6 +15,7 @@
 
 #include <LoRaWan-RAK4630.h> // Click to get library: https://platformio.org/lib/show/6601/SX126x-Arduino
 
+#include "LoRaWAN_functs.h"   /**< PAYLOAD_BUFFER_SIZE. */
 #include "Logging.h"          /**< Go here to change the logging level for the entire application. */
 #include "SensorPortSchema.h" /**< Go here for the individual sensor schema definitions. */
 
@@ -38,11 +39,25 @@ class portSchema {
      * @brief Encodes the given sensor data into the payload according to the port's schema.
      * Calls sensorPortSchema::encodeData for each sensor.
      * @param sensor_data Sensor data to be encoded.
-     * @param payload_buffer Payload buffer for data to be written into.
+     * @param writer Payload writer the data is appended to.
+     * @return True if every value was encoded, false if the payload is full.
+     */
+    bool encodeSensorData(sensorData *sensor_data, PayloadWriter *writer);
+
+    /**
+     * @brief Encodes the given sensor data into a PAYLOAD_BUFFER_SIZE buffer according to the port's schema.
+     * @param sensor_data Sensor data to be encoded.
+     * @param payload_buffer Payload buffer for data to be written into, at least PAYLOAD_BUFFER_SIZE bytes.
      * @param start_pos Start encoding data at this byte. Defaults to 0.
-     * @return Total length of data encoded to payload_buffer.
+     * @return Total length of data encoded to payload_buffer, start_pos if it didn't fit.
      */
     uint8_t encodeSensorDataToPayload(sensorData *sensor_data, uint8_t *payload_buffer, uint8_t start_pos = 0);
+
+    /**
+     * @brief Length of the payload encodeSensorDataToPayload() produces for this port.
+     * @return Length in bytes.
+     */
+    uint8_t payloadLength(void) const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -278,4 +293,12 @@ const portSchema PORT10 = {
     true   // sendTurbidity
 };
 
+/**
+ * @brief Finds the port schema with the given port number, e.g. for a port number received in a downlink.
+ * @param port_number Port number to find.
+ * @param port Filled with the matching port schema if found.
+ * @return True if found, false if no schema uses that port number.
+ */
+bool findPortSchema(uint8_t port_number, portSchema *port);
+
 #endif // PORT_SCHEMA_H
\ No newline at end of file
@@ -0,0 +1,155 @@
+#include "PresenceBitmap.h"
+
+#include <math.h>
+
+/**
+ * @brief Works out whether a field is sent, and updates the bitmap & invalid mask.
+ * @return True if the field should be written to the payload.
+ */
+template <typename T>
+static bool fieldPresent(bool in_port, PRESENCE_FIELD field, T value, bool valid, T last_value, bool last_valid,
+                         const sensorPortSchema *schema, bool full, uint8_t *bitmap, uint8_t *invalid) {
+    if (!in_port) {
+        return false;
+    }
+    uint8_t bit = 1 << (uint8_t)field;
+    if (!valid) {
+        // one the decoder already has as invalid is unchanged, and only repeated in keyframes
+        if (full || last_valid) {
+            *invalid |= bit;
+        }
+        return false;
+    }
+    if (!full && last_valid && (fabsf((float)value - (float)last_value) <= schema->tolerance)) {
+        return false;
+    }
+    *bitmap |= bit;
+    return true;
+}
+
+bool presenceEncoder::encode(const portSchema *port, const sensorData *sensor_data, PayloadWriter *writer,
+                             uint8_t *port_number) {
+    bool full = !has_last_sent || (frames_since_full >= (PRESENCE_KEYFRAME_INTERVAL - 1));
+    const sensorData *last = &last_sent;
+    uint8_t bitmap = 0;
+    uint8_t invalid = 0;
+
+    bool battery = fieldPresent(port->sendBatteryVoltage, PRESENCE_FIELD::BATTERY_VOLTAGE,
+                                sensor_data->battery_mv.value, sensor_data->battery_mv.is_valid,
+                                last->battery_mv.value, last->battery_mv.is_valid, &batteryVoltageSchema, full,
+                                &bitmap, &invalid);
+    bool temperature = fieldPresent(port->sendTemperature, PRESENCE_FIELD::TEMPERATURE,
+                                    sensor_data->temperature.value, sensor_data->temperature.is_valid,
+                                    last->temperature.value, last->temperature.is_valid, &temperatureSchema, full,
+                                    &bitmap, &invalid);
+    bool humidity = fieldPresent(port->sendRelativeHumidity, PRESENCE_FIELD::RELATIVE_HUMIDITY,
+                                 sensor_data->humidity.value, sensor_data->humidity.is_valid, last->humidity.value,
+                                 last->humidity.is_valid, &relativeHumiditySchema, full, &bitmap, &invalid);
+    bool pressure = fieldPresent(port->sendAirPressure, PRESENCE_FIELD::AIR_PRESSURE, sensor_data->pressure.value,
+                                 sensor_data->pressure.is_valid, last->pressure.value, last->pressure.is_valid,
+                                 &airPressureSchema, full, &bitmap, &invalid);
+    bool gas = fieldPresent(port->sendGasResistance, PRESENCE_FIELD::GAS_RESISTANCE, sensor_data->gas_resist.value,
+                            sensor_data->gas_resist.is_valid, last->gas_resist.value, last->gas_resist.is_valid,
+                            &gasResistanceSchema, full, &bitmap, &invalid);
+    // location is one field; it's sent if either coordinate has moved
+    bool location = fieldPresent(port->sendLocation, PRESENCE_FIELD::LOCATION, sensor_data->location.latitude,
+                                 sensor_data->location.is_valid, last->location.latitude, last->location.is_valid,
+                                 &locationSchema, full, &bitmap, &invalid) ||
+                    (port->sendLocation && sensor_data->location.is_valid &&
+                     fieldPresent(true, PRESENCE_FIELD::LOCATION, sensor_data->location.longitude, true,
+                                  last->location.longitude, last->location.is_valid, &locationSchema, full, &bitmap,
+                                  &invalid));
+    bool turbidity = fieldPresent(port->sendTurbidity, PRESENCE_FIELD::TURBIDITY, sensor_data->turbidity.value,
+                                  sensor_data->turbidity.is_valid, last->turbidity.value, last->turbidity.is_valid,
+                                  &turbiditySchema, full, &bitmap, &invalid);
+
+    // work out what the decoder will know once this frame is sent
+    pending = last_sent;
+    pending_full = full;
+    if (battery) {
+        pending.battery_mv = sensor_data->battery_mv;
+    }
+    if (temperature) {
+        pending.temperature = sensor_data->temperature;
+    }
+    if (humidity) {
+        pending.humidity = sensor_data->humidity;
+    }
+    if (pressure) {
+        pending.pressure = sensor_data->pressure;
+    }
+    if (gas) {
+        pending.gas_resist = sensor_data->gas_resist;
+    }
+    if (location) {
+        pending.location = sensor_data->location;
+    }
+    if (turbidity) {
+        pending.turbidity = sensor_data->turbidity;
+    }
+    // invalid fields are sent as invalid, so the decoder no longer has a value to compare with
+    pending.battery_mv.is_valid &= !(invalid & (1 << (uint8_t)PRESENCE_FIELD::BATTERY_VOLTAGE));
+    pending.temperature.is_valid &= !(invalid & (1 << (uint8_t)PRESENCE_FIELD::TEMPERATURE));
+    pending.humidity.is_valid &= !(invalid & (1 << (uint8_t)PRESENCE_FIELD::RELATIVE_HUMIDITY));
+    pending.pressure.is_valid &= !(invalid & (1 << (uint8_t)PRESENCE_FIELD::AIR_PRESSURE));
+    pending.gas_resist.is_valid &= !(invalid & (1 << (uint8_t)PRESENCE_FIELD::GAS_RESISTANCE));
+    pending.location.is_valid &= !(invalid & (1 << (uint8_t)PRESENCE_FIELD::LOCATION));
+    pending.turbidity.is_valid &= !(invalid & (1 << (uint8_t)PRESENCE_FIELD::TURBIDITY));
+
+    if (invalid) {
+        bitmap |= PRESENCE_INVALID_FOLLOWS;
+    }
+    writer->putU8(bitmap);
+    if (invalid) {
+        writer->putU8(invalid);
+    }
+    if (battery) {
+        batteryVoltageSchema.encodeData(sensor_data->battery_mv.value, true, writer);
+    }
+    if (temperature) {
+        temperatureSchema.encodeData(sensor_data->temperature.value, true, writer);
+    }
+    if (humidity) {
+        relativeHumiditySchema.encodeData(sensor_data->humidity.value, true, writer);
+    }
+    if (pressure) {
+        airPressureSchema.encodeData(sensor_data->pressure.value, true, writer);
+    }
+    if (gas) {
+        gasResistanceSchema.encodeData(sensor_data->gas_resist.value, true, writer);
+    }
+    if (location) {
+        locationSchema.encodeData(sensor_data->location.latitude, true, writer);
+        locationSchema.encodeData(sensor_data->location.longitude, true, writer);
+    }
+    if (turbidity) {
+        turbiditySchema.encodeData(sensor_data->turbidity.value, true, writer);
+    }
+
+    *port_number = port->port_number + PRESENCE_PORT_OFFSET;
+    return !writer->overflowed();
+}
+
+void presenceEncoder::commit(void) {
+    last_sent = pending;
+    has_last_sent = true;
+    frames_since_full = pending_full ? 0 : frames_since_full + 1;
+}
+
+void presenceEncoder::invalidate(void) {
+    has_last_sent = false;
+}
+
+void presenceEncoder::save(presenceState *state) const {
+    state->last_sent = last_sent;
+    state->has_last_sent = has_last_sent;
+    state->frames_since_full = frames_since_full;
+}
+
+void presenceEncoder::restore(const presenceState *state) {
+    last_sent = state->last_sent;
+    pending = state->last_sent;
+    has_last_sent = state->has_last_sent;
+    frames_since_full = state->frames_since_full;
+    pending_full = false;
+}
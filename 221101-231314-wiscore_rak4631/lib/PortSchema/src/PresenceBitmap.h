@@ -0,0 +1,89 @@
+#pragma once
+/**
+ * @file PresenceBitmap.h
+ * @brief Optional payload mode that leaves out invalid and unchanged fields, with a presence bitmap to say which fields
+ * are in the payload.
+ *
+ * A presence frame for a port is sent on port_number + PRESENCE_PORT_OFFSET (e.g. PORT10 -> 110):
+ * [bitmap][invalid mask, only if PRESENCE_INVALID_FOLLOWS is set][fields that are present, in the port's order]
+ * Bit n of the bitmap / invalid mask is PRESENCE_FIELD n. A field in the port that isn't present is either newly
+ * invalid (its bit is set in the invalid mask) or unchanged since the last frame that was sent: within the sensor
+ * schema's tolerance, or still invalid. The decoder uses its last known value, or invalid.
+ *
+ * Frames are compared with the last frame that was actually sent (see commit()), not the last reading, so a slow drift
+ * can't accumulate past the tolerance. Every PRESENCE_KEYFRAME_INTERVAL frames (and after invalidate()) every valid field
+ * is sent and every invalid one is in the invalid mask, which bounds how long the decoder can be wrong after a lost
+ * uplink.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "PortSchema.h"
+
+#define PRESENCE_PORT_OFFSET       100  /**< Presence frames are sent on port_number + 100 (101-159). */
+#define PRESENCE_INVALID_FOLLOWS   0x80 /**< Bitmap bit: an invalid mask byte follows the bitmap. */
+#define PRESENCE_KEYFRAME_INTERVAL 12   /**< Every Nth frame sends every valid field. */
+
+/** @brief Bit of each field in the presence bitmap and invalid mask. */
+enum class PRESENCE_FIELD : uint8_t {
+    BATTERY_VOLTAGE = 0,
+    TEMPERATURE = 1,
+    RELATIVE_HUMIDITY = 2,
+    AIR_PRESSURE = 3,
+    GAS_RESISTANCE = 4,
+    LOCATION = 5,
+    TURBIDITY = 6,
+};
+
+/** @brief What the decoder was last sent, so it can be resumed after a reset (see DeepSleep.h). */
+struct presenceState {
+    sensorData last_sent;
+    bool has_last_sent;
+    uint8_t frames_since_full;
+};
+
+/**
+ * @brief Encodes presence frames and remembers what was last sent.
+ */
+class presenceEncoder {
+  public:
+    /**
+     * @brief Encodes the sensor data for a port as a presence frame.
+     * @param port Port schema to encode.
+     * @param sensor_data Sensor data to encode.
+     * @param writer Payload writer the frame is written to.
+     * @param port_number Filled with the port number to send the frame on.
+     * @return True if encoded, false if the payload is full.
+     */
+    bool encode(const portSchema *port, const sensorData *sensor_data, PayloadWriter *writer, uint8_t *port_number);
+
+    /**
+     * @brief Call once the last encoded frame has been sent, so later frames are compared with it.
+     */
+    void commit(void);
+
+    /**
+     * @brief Call if the last encoded frame won't be sent in order (e.g. it was queued), so the next frame is full.
+     */
+    void invalidate(void);
+
+    /**
+     * @brief Saves what was last sent. A frame that was encoded but not yet committed is left out.
+     */
+    void save(presenceState *state) const;
+
+    /**
+     * @brief Carries on from what was last sent, so the keyframe interval isn't restarted.
+     */
+    void restore(const presenceState *state);
+
+  private:
+    sensorData last_sent = {}; // decoder's view of each field
+    sensorData pending = {};   // last_sent updated with the fields in the last encoded frame
+    bool has_last_sent = false;
+    uint8_t frames_since_full = 0;
+    bool pending_full = false;
+};
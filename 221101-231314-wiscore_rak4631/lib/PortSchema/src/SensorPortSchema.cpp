@@ -8,12 +8,12 @@
  * invalid 2 byte signed the value will be 0x7f7f.
  * @param sensor_data Sensor data to encode. This template allows the type of sensor_data to be flexible (to a point).
  * @param valid Validity of given sensor data.
- * @param payload_buffer LoRaWAN payload with buffer for data to be written into.
+ * @param writer Payload writer the data is appended to.
  * @param sensor_schema Sensor port schema that determines how the data is encoded.
- * @return New total length of data encoded to payload_buffer.
+ * @return True if encoded, false if the payload is full.
  */
 template <typename T>
-uint8_t encodeDataWithSchema(T sensor_data, bool valid, uint8_t *payload_buffer, uint8_t buf_pos, const sensorPortSchema *sensor_schema) {
+bool encodeDataWithSchema(T sensor_data, bool valid, PayloadWriter *writer, const sensorPortSchema *sensor_schema) {
     int data_to_encode = 0;
     // Check validity
     if (valid) {
@@ -32,28 +32,19 @@ uint8_t encodeDataWithSchema(T sensor_data, bool valid, uint8_t *payload_buffer,
     }
 
     if (!sensor_schema->is_signed && (data_to_encode < 0)) {
-        log(LOG_LEVEL::WARN, "A signed value is being sent for a sensor port schema that is unsigned.");
+        LOG_WARN("A signed value is being sent for a sensor port schema that is unsigned.");
     }
 
     // The total bytes assigned to the sensor is assumed to be split equally amongst the number of values used
     // to represent the sensor data.
-    int data_size = sensor_schema->n_bytes / sensor_schema->n_values;
+    uint8_t data_size = sensor_schema->n_bytes / sensor_schema->n_values;
 
-    // Bitwise encode the data
-    uint8_t i = 0;
-    uint8_t j = (data_size - 1);
-    for (; i < data_size; i++, j--) {
-        // This is a generalised form of basic MSB bitwise encoding
-        uint8_t bitshift = j * 8; // 8 bits in a byte
-        if (j > 0) {
-            payload_buffer[buf_pos + i] = (uint8_t)((data_to_encode & (0xFF << bitshift)) >> bitshift);
-        } else {
-            payload_buffer[buf_pos + i] = (uint8_t)(data_to_encode & 0xFF);
-        }
+    // MSB first, truncated to data_size bytes
+    if (!writer->putBE((uint32_t)data_to_encode, data_size)) {
+        LOG_ERROR("Payload full, sensor data not encoded.");
+        return false;
     }
-
-    // return the new buffer length
-    return (buf_pos + i);
+    return true;
 }
 
 /**
@@ -62,22 +53,22 @@ uint8_t encodeDataWithSchema(T sensor_data, bool valid, uint8_t *payload_buffer,
  * sensorPortSchema.
  */
 
-uint8_t sensorPortSchema::encodeData(uint8_t sensor_data, bool valid, uint8_t *payload_buffer, uint8_t current_buffer_len) const {
-    return (encodeDataWithSchema(sensor_data, valid, payload_buffer, current_buffer_len, this));
+bool sensorPortSchema::encodeData(uint8_t sensor_data, bool valid, PayloadWriter *writer) const {
+    return (encodeDataWithSchema(sensor_data, valid, writer, this));
 }
 
-uint8_t sensorPortSchema::encodeData(uint16_t sensor_data, bool valid, uint8_t *payload_buffer, uint8_t current_buffer_len) const {
-    return (encodeDataWithSchema(sensor_data, valid, payload_buffer, current_buffer_len, this));
+bool sensorPortSchema::encodeData(uint16_t sensor_data, bool valid, PayloadWriter *writer) const {
+    return (encodeDataWithSchema(sensor_data, valid, writer, this));
 }
 
-uint8_t sensorPortSchema::encodeData(uint32_t sensor_data, bool valid, uint8_t *payload_buffer, uint8_t current_buffer_len) const {
-    return (encodeDataWithSchema(sensor_data, valid, payload_buffer, current_buffer_len, this));
+bool sensorPortSchema::encodeData(uint32_t sensor_data, bool valid, PayloadWriter *writer) const {
+    return (encodeDataWithSchema(sensor_data, valid, writer, this));
 }
 
-uint8_t sensorPortSchema::encodeData(int sensor_data, bool valid, uint8_t *payload_buffer, uint8_t current_buffer_len) const {
-    return (encodeDataWithSchema(sensor_data, valid, payload_buffer, current_buffer_len, this));
+bool sensorPortSchema::encodeData(int sensor_data, bool valid, PayloadWriter *writer) const {
+    return (encodeDataWithSchema(sensor_data, valid, writer, this));
 }
 
-uint8_t sensorPortSchema::encodeData(float sensor_data, bool valid, uint8_t *payload_buffer, uint8_t current_buffer_len) const {
-    return (encodeDataWithSchema(sensor_data, valid, payload_buffer, current_buffer_len, this));
+bool sensorPortSchema::encodeData(float sensor_data, bool valid, PayloadWriter *writer) const {
+    return (encodeDataWithSchema(sensor_data, valid, writer, this));
 }
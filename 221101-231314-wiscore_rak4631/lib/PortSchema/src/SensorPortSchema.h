@@ -15,7 +15,8 @@
 
 #include <LoRaWan-RAK4630.h> // Click to get library: https://platformio.org/lib/show/6601/SX126x-Arduino
 
-#include "Logging.h" /**< Go here to change the logging level for the entire application. */
+#include "Logging.h"       /**< Go here to change the logging level for the entire application. */
+#include "PayloadWriter.h" /**< Bounds-checked payload writes. */
 
 /**
  * @brief Struct with data from sensors and their validity.
@@ -51,6 +52,8 @@ struct sensorData {
     
     struct {
         uint32_t value;
+        uint32_t min; /**< Lowest of the samples averaged into value. */
+        uint32_t max; /**< Highest of the samples averaged into value. */
         bool is_valid;
     } turbidity; // Turbdity: NTU
 };
@@ -63,6 +66,8 @@ class sensorPortSchema {
     float scale_factor; /**< Only int values are encoded. To send a float value, mulitply by scale_factor to encode;
                              then divide by scale_factor to decode. */
     bool is_signed;     /**< Value has a sign and hence can be negative. */
+    float tolerance;    /**< Changes this small (in the sensor's units) count as unchanged in presence frames, see
+                             PresenceBitmap.h. */
 
     /**
      * @brief Byte encodes the given sensor data into the payload according to the sensor port schema.
@@ -74,15 +79,14 @@ class sensorPortSchema {
      * invalid 2 byte signed the value will be 0x7f7f.
      * @param sensor_data Sensor data to encode (valid data types: int, float, uint8_t, uint16_t, uint32_t).
      * @param valid Validity of given sensor data.
-     * @param payload_buffer Payload buffer for data to be written into.
-     * @param current_buffer_len Length of current data in the buffer, used to avoid overwriting data.
-     * @return Total length of data encoded to payload_buffer.
+     * @param writer Payload writer the data is appended to.
+     * @return True if encoded, false if the payload is full (writer->overflowed() is then set).
      */
-    uint8_t encodeData(int sensor_data, bool valid, uint8_t *payload_buffer, uint8_t current_buffer_len) const;
-    uint8_t encodeData(float sensor_data, bool valid, uint8_t *payload_buffer, uint8_t current_buffer_len) const;
-    uint8_t encodeData(uint8_t sensor_data, bool valid, uint8_t *payload_buffer, uint8_t current_buffer_len) const;
-    uint8_t encodeData(uint16_t sensor_data, bool valid, uint8_t *payload_buffer, uint8_t current_buffer_len) const;
-    uint8_t encodeData(uint32_t sensor_data, bool valid, uint8_t *payload_buffer, uint8_t current_buffer_len) const;
+    bool encodeData(int sensor_data, bool valid, PayloadWriter *writer) const;
+    bool encodeData(float sensor_data, bool valid, PayloadWriter *writer) const;
+    bool encodeData(uint8_t sensor_data, bool valid, PayloadWriter *writer) const;
+    bool encodeData(uint16_t sensor_data, bool valid, PayloadWriter *writer) const;
+    bool encodeData(uint32_t sensor_data, bool valid, PayloadWriter *writer) const;
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -93,14 +97,16 @@ static const sensorPortSchema batteryVoltageSchema = { // units: mV
     .n_bytes = 2,
     .n_values = 1,
     .scale_factor = 1,
-    .is_signed = false
+    .is_signed = false,
+    .tolerance = 20, // mV
 };
 
 static const sensorPortSchema temperatureSchema = { // units: degrees C
     .n_bytes = 2,
     .n_values = 1,
     .scale_factor = pow(10.0, 2), // 2 decimal places
-    .is_signed = true
+    .is_signed = true,
+    .tolerance = 0.1, // degrees C
 };
 
 /** NOTE: relativeHumidity could instead have the same schema as temperature if more resolution is desired. */
@@ -108,28 +114,32 @@ static const sensorPortSchema relativeHumiditySchema = { // units: %
     .n_bytes = 1,
     .n_values = 1,
     .scale_factor = (float)(UINT8_MAX / 100.0), // percentage (0->100) is scaled to a byte (0->255)
-    .is_signed = false
+    .is_signed = false,
+    .tolerance = 1, // %
 };
 
 static const sensorPortSchema airPressureSchema = { // units: Pa
     .n_bytes = 4,
     .n_values = 1,
     .scale_factor = 1,
-    .is_signed = false
+    .is_signed = false,
+    .tolerance = 50, // Pa
 };
 
 static const sensorPortSchema gasResistanceSchema = { // units: ??
     .n_bytes = 4,
     .n_values = 1,
     .scale_factor = 1,
-    .is_signed = false
+    .is_signed = false,
+    .tolerance = 500,
 };
 
 static const sensorPortSchema locationSchema = { // units: degrees
     .n_bytes = 8,                                // split equally: 4 bytes lat, 4 bytes lng
     .n_values = 2,                               // lat and lng
     .scale_factor = pow(10.0, 4),                // 4 decimal places
-    .is_signed = true
+    .is_signed = true,
+    .tolerance = 0.0001, // degrees (the scale factor's resolution)
 };
 
 /* An example of a new sensor:
@@ -137,14 +147,16 @@ static const sensorPortSchema newSensorSchema = {
     .n_bytes = 1,
     .n_values = 1,
     .scale_factor = 1,
-    .is_signed = false
+    .is_signed = false,
+    .tolerance = 0
 };
 */
 static const sensorPortSchema turbiditySchema = { //unit NTU
     .n_bytes = 2,
     .n_values = 1,
     .scale_factor = 1,
-    .is_signed = false
+    .is_signed = false,
+    .tolerance = 0, // NTU, any change is sent
 };
 
 #endif // SENSOR_PORT_SCHEMA_H
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "PowerRail.h"
+
+// true if time a is at or after time b, across the millis() wrap
+static bool reached(uint32_t a, uint32_t b) { return (int32_t)(a - b) >= 0; }
+
+// time from now until then, 0 if it's passed
+static uint32_t until(uint32_t now_ms, uint32_t then_ms) { return reached(now_ms, then_ms) ? 0 : then_ms - now_ms; }
+
+powerRail::powerRail(const powerRailConfig *config, powerRailSwitch power_switch)
+    : config(config), power_switch(power_switch) {}
+
+uint32_t powerRail::acquire(uint32_t now_ms) {
+    users++;
+    // whoever kept it warm was right
+    off_pending = false;
+    if (on) {
+        return until(now_ms, changed_ms + config->warmup_ms);
+    }
+    if (!on_pending) {
+        uint32_t earliest_ms = switched ? changed_ms + config->min_off_ms : now_ms;
+        if (reached(now_ms, earliest_ms)) {
+            switchOn(now_ms);
+            return config->warmup_ms;
+        }
+        on_pending = true;
+        on_at_ms = earliest_ms;
+    }
+    return until(now_ms, on_at_ms) + config->warmup_ms;
+}
+
+void powerRail::release(uint32_t now_ms, uint32_t next_use_ms) {
+    if (users == 0) {
+        return;
+    }
+    users--;
+    if (users > 0) {
+        return;
+    }
+    if (on_pending) {
+        // never got switched on
+        on_pending = false;
+        return;
+    }
+    if (!on) {
+        return;
+    }
+    uint32_t off_ms = now_ms;
+    if (next_use_ms < config->keep_warm_ms) {
+        // cheaper to stay on than to warm up again, but don't stay on for ever if the use doesn't come
+        off_ms = now_ms + next_use_ms + config->keep_warm_ms;
+        kept_warm++;
+    }
+    uint32_t min_on_end_ms = changed_ms + config->min_on_ms;
+    if (!reached(off_ms, min_on_end_ms)) {
+        off_ms = min_on_end_ms;
+    }
+    if (reached(now_ms, off_ms)) {
+        switchOff(now_ms);
+    } else {
+        off_pending = true;
+        off_at_ms = off_ms;
+    }
+}
+
+uint32_t powerRail::service(uint32_t now_ms) {
+    if (on_pending && reached(now_ms, on_at_ms)) {
+        on_pending = false;
+        switchOn(now_ms);
+    }
+    if (off_pending && reached(now_ms, off_at_ms)) {
+        off_pending = false;
+        switchOff(now_ms);
+    }
+    if (on_pending) {
+        return until(now_ms, on_at_ms);
+    }
+    if (off_pending) {
+        return until(now_ms, off_at_ms);
+    }
+    return POWER_RAIL_IDLE;
+}
+
+void powerRail::stats(powerRailStats *stats, uint32_t now_ms) const {
+    stats->on = on;
+    stats->users = users;
+    stats->on_time_ms = on_time_ms + (on ? (uint32_t)(now_ms - changed_ms) : 0);
+    stats->switch_ons = switch_ons;
+    stats->kept_warm = kept_warm;
+}
+
+void powerRail::switchOn(uint32_t now_ms) {
+    power_switch(true);
+    on = true;
+    switched = true;
+    changed_ms = now_ms;
+    switch_ons++;
+}
+
+void powerRail::switchOff(uint32_t now_ms) {
+    power_switch(false);
+    on_time_ms += (uint32_t)(now_ms - changed_ms);
+    on = false;
+    changed_ms = now_ms;
+}
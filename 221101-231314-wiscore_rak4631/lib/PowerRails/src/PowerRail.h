@@ -0,0 +1,113 @@
+#pragma once
+/**
+ * @file PowerRail.h
+ * @brief A switched power rail shared by several devices. Each user acquires & releases it and the rail is on while
+ * anyone holds it, with a minimum on & off time, and kept warm between uses when that costs less than warming it up
+ * again. The on-time is accumulated for telemetry.
+ *
+ * Time is passed in (millis()) and the rail is switched through a callback.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#define POWER_RAIL_IDLE 0xFFFFFFFFUL /**< service() result when nothing is waiting to switch. */
+
+/**
+ * @brief Switches the rail, e.g. drives its enable pin.
+ */
+typedef void (*powerRailSwitch)(bool on);
+
+/** @brief How a rail behaves. */
+struct powerRailConfig {
+    const char *name;      /**< For the logs. */
+    uint32_t warmup_ms;    /**< From switching on until the devices on the rail can be read. */
+    uint32_t min_on_ms;    /**< Once on, the rail stays on at least this long. */
+    uint32_t min_off_ms;   /**< Once off, the rail stays off at least this long (e.g. so the devices reset). */
+    uint32_t keep_warm_ms; /**< Stays on if the next use is sooner than this. The break-even: the on-time that costs as
+                              much as switching on & warming up again. 0 always switches off. */
+};
+
+/** @brief Rail state for telemetry. */
+struct powerRailStats {
+    bool on;             /**< Rail is on. */
+    uint8_t users;       /**< Users holding it. */
+    uint64_t on_time_ms; /**< Total time on, including now. */
+    uint32_t switch_ons; /**< Times switched on. */
+    uint32_t kept_warm;  /**< Releases that kept it on for the next use. */
+};
+
+/**
+ * @brief A reference counted power rail.
+ */
+class powerRail {
+  public:
+    /**
+     * @brief Construct a new rail, off. The switch isn't called until the rail is first acquired.
+     * @param config Behaviour, kept by pointer.
+     * @param power_switch Switches the rail.
+     */
+    powerRail(const powerRailConfig *config, powerRailSwitch power_switch);
+
+    /**
+     * @brief Adds a user, switching the rail on if it's off (once its minimum off time is over, see service()).
+     * @return Time until the rail is warm: 0 if it already is, up to the remaining off time plus warmup_ms.
+     */
+    uint32_t acquire(uint32_t now_ms);
+
+    /**
+     * @brief Removes a user. When the last one goes the rail is switched off, unless the next use is within
+     * keep_warm_ms (it then stays on until next_use_ms + keep_warm_ms if it isn't acquired again) or the minimum on
+     * time isn't over. Either is done by service().
+     * @param next_use_ms Time until the rail is next acquired, if known (POWER_RAIL_IDLE if not).
+     */
+    void release(uint32_t now_ms, uint32_t next_use_ms = POWER_RAIL_IDLE);
+
+    /**
+     * @brief Switches the rail if a deferred switch on or off is due.
+     * @return Time until the next deferred switch, or POWER_RAIL_IDLE if none.
+     */
+    uint32_t service(uint32_t now_ms);
+
+    /**
+     * @brief True if the rail is on.
+     */
+    inline bool isOn(void) const { return on; };
+
+    /**
+     * @brief True if the rail is off with no switch on waiting.
+     */
+    inline bool isIdle(void) const { return !on && !on_pending; };
+
+    /**
+     * @brief The rail's name.
+     */
+    inline const char *name(void) const { return config->name; };
+
+    /**
+     * @brief Fills stats with the rail state for telemetry.
+     */
+    void stats(powerRailStats *stats, uint32_t now_ms) const;
+
+  private:
+    void switchOn(uint32_t now_ms);
+    void switchOff(uint32_t now_ms);
+
+    const powerRailConfig *config;
+    powerRailSwitch power_switch;
+    uint8_t users = 0;
+    bool on = false;
+    bool switched = false;     // switched at least once, so changed_ms is valid
+    uint32_t changed_ms = 0;   // when it last switched
+    bool on_pending = false;   // acquired during the minimum off time
+    uint32_t on_at_ms = 0;
+    bool off_pending = false;  // released but kept on
+    uint32_t off_at_ms = 0;
+    uint64_t on_time_ms = 0;   // up to the last switch off
+    uint32_t switch_ons = 0;
+    uint32_t kept_warm = 0;
+};
@@ -0,0 +1,48 @@
+#include "PowerRails.h"
+
+static void switchSensorRail(bool on) { digitalWrite(SENSOR_RAIL_PIN, on ? HIGH : LOW); }
+
+static const powerRailConfig SENSOR_RAIL_CONFIG = {
+    "3V3_S", SENSOR_RAIL_WARMUP_MS, SENSOR_RAIL_MIN_ON_MS, SENSOR_RAIL_MIN_OFF_MS, SENSOR_RAIL_KEEP_WARM_MS,
+};
+
+static powerRail rails[(uint8_t)POWER_RAIL::COUNT] = {
+    powerRail(&SENSOR_RAIL_CONFIG, switchSensorRail),
+};
+
+void initPowerRails(void) {
+    pinMode(SENSOR_RAIL_PIN, OUTPUT);
+    digitalWrite(SENSOR_RAIL_PIN, LOW);
+}
+
+powerRail *getPowerRail(POWER_RAIL rail) { return &rails[(uint8_t)rail]; }
+
+uint32_t servicePowerRails(uint32_t now_ms) {
+    uint32_t wait_ms = POWER_RAIL_IDLE;
+    for (powerRail &rail : rails) {
+        uint32_t rail_wait_ms = rail.service(now_ms);
+        if (rail_wait_ms < wait_ms) {
+            wait_ms = rail_wait_ms;
+        }
+    }
+    return wait_ms;
+}
+
+bool powerRailsIdle(void) {
+    for (const powerRail &rail : rails) {
+        if (!rail.isIdle()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void logPowerRails(uint32_t now_ms) {
+    for (const powerRail &rail : rails) {
+        powerRailStats stats;
+        rail.stats(&stats, now_ms);
+        LOG_DEBUG("Rail %s: %s (%u users) | on %lu s | switched on %lu | kept warm %lu", rail.name(),
+            stats.on ? "on" : "off", stats.users, (uint32_t)(stats.on_time_ms / 1000), stats.switch_ons,
+            stats.kept_warm);
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+/**
+ * @file PowerRails.h
+ * @brief The board's switched power rails, by name. Sensor drivers acquire the rails they need (see SensorHelper.h)
+ * instead of one global switch for every peripheral, so a rail is only powered while something uses it.
+ *
+ * Only switched from the acquisition task; powerRailsIdle() is also checked by the radio task before deep sleep, as
+ * the enable pins keep their level in System OFF.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+
+#include "Logging.h"   /**< Go here to change the logging level for the entire application. */
+#include "PowerRail.h" /**< Reference counted rail with min on/off times & keep warm. */
+
+// SENSOR RAIL - 3V3_S on the WisBlock base, switched by WB_IO2. Powers the analog (turbidity) sensor; the I2C sensors
+// are on the always-on 3V3.
+#define SENSOR_RAIL_PIN          WB_IO2
+#define SENSOR_RAIL_WARMUP_MS    5000 /**< The turbidity sensor's output settles in this time. */
+#define SENSOR_RAIL_MIN_ON_MS    0
+#define SENSOR_RAIL_MIN_OFF_MS   500  /**< Lets 3V3_S discharge so the sensor resets cleanly. */
+#define SENSOR_RAIL_KEEP_WARM_MS 6000 /**< Warm-up plus the switch-on surge, in on-time. */
+
+/** @brief The rails, by name. */
+enum class POWER_RAIL : uint8_t {
+    SENSOR, /**< 3V3_S, see SENSOR_RAIL_PIN. */
+    COUNT,
+};
+
+/**
+ * @brief Sets up the rails' enable pins, all off.
+ */
+void initPowerRails(void);
+
+/**
+ * @brief Gets a rail to acquire & release.
+ */
+powerRail *getPowerRail(POWER_RAIL rail);
+
+/**
+ * @brief Does any deferred switching on all the rails, see powerRail::service().
+ * @return Time until the next deferred switch, or POWER_RAIL_IDLE if none.
+ */
+uint32_t servicePowerRails(uint32_t now_ms);
+
+/**
+ * @brief True if every rail is off with nothing waiting to switch it on.
+ */
+bool powerRailsIdle(void);
+
+/**
+ * @brief Logs each rail's state, on-time & switch counts at DEBUG.
+ */
+void logPowerRails(uint32_t now_ms);
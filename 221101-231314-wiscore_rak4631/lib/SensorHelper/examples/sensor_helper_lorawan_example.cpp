@@ -43,7 +43,7 @@ void fillPayload(void);
 void setup() {
     // initialise the logging module - function does nothing if APP_LOG_LEVEL in Logging.h = NONE
     initLogging();
-    log(LOG_LEVEL::INFO,
+    LOG_INFO(
         "\n========================================"
         "\nWelcome to Sensor Helper LoRaWAN Example"
         "\n========================================");
@@ -69,13 +69,13 @@ void loop() {
     // every sensor_reading_interval ms check if connected and then send sensor payload
     delay(sensor_reading_interval);
     if (isLoRaWANConnected()) {
-        log(LOG_LEVEL::DEBUG, "Send payload");
+        LOG_DEBUG("Send payload");
         // fill lora data buffer
         fillPayload();
         // send data
         sendLoRaWANFrame(&lorawan_payload);
     } else {
-        log(LOG_LEVEL::DEBUG, "LoRaWAN not connected. Try again later.");
+        LOG_DEBUG("LoRaWAN not connected. Try again later.");
     }
 }
 
@@ -88,7 +88,7 @@ void fillPayload(void) {
     sensorData sensor_data = {};
     sensor_data = getSensorData(&payload_port);
 
-    log(LOG_LEVEL::INFO, "b: %.2f %% | t: %.2f C | h: %.2f %% | p: %lu Pa | g: %lu | l: %.5f, %.5f",
+    LOG_INFO("b: %.2f %% | t: %.2f C | h: %.2f %% | p: %lu Pa | g: %lu | l: %.5f, %.5f",
         sensor_data.battery_mv.value, sensor_data.temperature.value, sensor_data.humidity.value, sensor_data.pressure.value,
         sensor_data.gas_resist.value, sensor_data.location.latitude, sensor_data.location.longitude);
 
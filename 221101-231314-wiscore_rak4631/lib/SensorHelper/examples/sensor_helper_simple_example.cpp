@@ -36,7 +36,7 @@ const int sensor_reading_interval = 5000;
 void setup() {
     // initialise the logging module - function does nothing if APP_LOG_LEVEL in Logging.h = NONE
     initLogging();
-    log(LOG_LEVEL::INFO,
+    LOG_INFO(
         "\n======================================="
         "\nWelcome to Simple Sensor Helper Example"
         "\n=======================================");
@@ -63,7 +63,7 @@ void loop() {
     // get the sensor data
     sensor_data = getSensorData(&payload_port);
 
-    log(LOG_LEVEL::INFO, "b: %.2f %% | t: %.2f C | h: %.2f %% | p: %lu Pa | g: %lu | l: %.5f, %.5f",
+    LOG_INFO("b: %.2f %% | t: %.2f C | h: %.2f %% | p: %lu Pa | g: %lu | l: %.5f, %.5f",
         sensor_data.battery_mv.value, sensor_data.temperature.value, sensor_data.humidity.value, sensor_data.pressure.value,
         sensor_data.gas_resist.value, sensor_data.location.latitude, sensor_data.location.longitude);
 }
@@ -1,6 +1,10 @@
 #include "AnalogSensor.h"
 #include <math.h>
 
+// ADC & RAW are logged for every sample of the turbidity burst, so only log them when debugging the ADC itself
+#undef LOG_MODULE_LEVEL
+#define LOG_MODULE_LEVEL LOG_LEVEL::INFO
+
 AnalogSensor::AnalogSensor(uint8_t pin) {
     AnalogSensor(pin, DEFAULT_ANALOG_REFERENCE, DEFAULT_ANALOG_RESOLUTION);
 }
@@ -28,19 +32,33 @@ void AnalogSensor::setCompensationFactor(float comp_factor) {
     setRealMVPerLSB();
 };
 
+const AnalogSensor *AnalogSensor::adc_owner = nullptr;
+
 float AnalogSensor::getSensorMV(void) {
-    // set the ADC params each time in case the adc is being used for multiple sensors
+    if (selectADC()) {
+        // Let the ADC settle
+        delay(ANALOG_SETTLE_MS);
+    }
+    return sampleMV();
+}
+
+bool AnalogSensor::selectADC(void) {
+    // the ADC is shared, so set the params if another sensor used it last
+    if (adc_owner == this) {
+        return false;
+    }
     analogReference(analog_ref);
     analogReadResolution(analog_resolution);
     analogOversampling(oversampling);
+    adc_owner = this;
+    return true;
+}
 
-    // Let the ADC settle
-    delay(1);
-
+float AnalogSensor::sampleMV(void) {
     // Get a raw ADC reading
     float sensor_mv = readMV();
 
-    log(LOG_LEVEL::DEBUG, "ADC: %.2f mV", sensor_mv);
+    LOG_DEBUG("ADC: %.2f mV", sensor_mv);
 
     return sensor_mv;
 }
@@ -49,7 +67,7 @@ float AnalogSensor::readMV(void) {
     // Get the raw ADC value
     float raw = analogRead(pin);
     // return converted raw ADC value
-    log(LOG_LEVEL::DEBUG, "RAW: %.2f", raw);
+    LOG_DEBUG("RAW: %.2f", raw);
     return (raw * real_MV_per_LSB);
 }
 
@@ -128,7 +146,7 @@ float BatteryLevel::mvToSoC(float mvolts) {
         vbat_soc = 100.0;
     }
 
-    log(LOG_LEVEL::DEBUG, "LIPO: %.2f mV = %.2f%%", mvolts, vbat_soc);
+    LOG_DEBUG("LIPO: %.2f mV = %.2f%%", mvolts, vbat_soc);
     return vbat_soc;
 };
 
@@ -150,6 +168,6 @@ float TurbidityLevel::mvToNTU(float mvolts) {
     } else {
     turbdity = -843.846*sq(voltage-2.563) + 3004.742; // calculating turbidity from adc voltage
     }
-    log(LOG_LEVEL::DEBUG, "voltage: %.2f turbdity = %.2f% NTU", voltage, turbdity);
+    LOG_DEBUG("voltage: %.2f turbdity = %.2f% NTU", voltage, turbdity);
     return turbdity;
 };
\ No newline at end of file
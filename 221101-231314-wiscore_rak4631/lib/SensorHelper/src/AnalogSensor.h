@@ -16,6 +16,7 @@
 static const _eAnalogReference DEFAULT_ANALOG_REFERENCE = AR_DEFAULT; // Analog reference to default = 3.6V.
 static const int DEFAULT_ANALOG_RESOLUTION = 10;                      // Resolution to default 10-bit (0..4095).
 static const uint32_t DEFAULT_OVERSAMPLING = 0;                       // Oversampling disabled
+static const uint32_t ANALOG_SETTLE_MS = 1;                           // ADC settling time after its settings change
 
 /**
  * @brief AnalogSensor uses the onboard ADC to find the voltage of an analog sensor.
@@ -59,11 +60,24 @@ class AnalogSensor {
 
     /**
      * @brief Get the sensor reading.
-     * Uses the ADC parameters passed in object instantiation.
+     * Uses the ADC parameters passed in object instantiation. Blocks for ANALOG_SETTLE_MS if the ADC was last set up for
+     * another sensor; sequences use selectADC() & sampleMV() instead so they can sleep through it.
      * @return Sensor reading in mV.
      */
     float getSensorMV(void);
 
+    /**
+     * @brief Sets the ADC parameters for this sensor, unless they are already set for it.
+     * @return True if they were changed, wait ANALOG_SETTLE_MS before sampleMV().
+     */
+    bool selectADC(void);
+
+    /**
+     * @brief Get the sensor reading without setting the ADC parameters; call selectADC() first.
+     * @return Sensor reading in mV.
+     */
+    float sampleMV(void);
+
   private:
     /**
      * @brief Read sensor voltage.
@@ -83,6 +97,8 @@ class AnalogSensor {
     uint32_t oversampling;         // ADC oversampling
     float compensation_factor = 1; // Compensation factor sensor/pin - depends on the board hardware.
     float real_MV_per_LSB;         // Conversion factor that turns the raw ADC reading into the voltage
+
+    static const AnalogSensor *adc_owner; // Sensor the ADC parameters were last set for
 };
 
 static const uint8_t BATTERY_PIN = WB_A0;
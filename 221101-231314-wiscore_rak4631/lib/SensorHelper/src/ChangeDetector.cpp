@@ -0,0 +1,104 @@
+#include "ChangeDetector.h"
+
+#include <math.h>
+
+changeDetector::changeDetector(float slack_sigma, float threshold_sigma, float ceiling) {
+    configure(slack_sigma, threshold_sigma, ceiling);
+}
+
+void changeDetector::configure(float slack_sigma, float threshold_sigma, float ceiling) {
+    slack = fabsf(slack_sigma);
+    threshold = fabsf(threshold_sigma);
+    this->ceiling = ceiling;
+}
+
+void changeDetector::reset(void) {
+    mean = 0;
+    variance = 0;
+    n = 0;
+    s_high = 0;
+    event = false;
+    ceiling_run = 0;
+    quiet_run = 0;
+    event_readings = 0;
+}
+
+float changeDetector::sigma(void) const {
+    float s = sqrtf(variance);
+    return (s > DETECTOR_MIN_SIGMA) ? s : DETECTOR_MIN_SIGMA;
+}
+
+void changeDetector::learn(float value) {
+    // a plain average while warming up, then exponentially weighted
+    float alpha = (n < DETECTOR_WARMUP_READINGS) ? 1.0f / (n + 1) : DETECTOR_ALPHA;
+    if (n >= DETECTOR_WARMUP_READINGS) {
+        // limit what one burst can do to the baseline
+        float limit = 3 * sigma();
+        value = (value > mean + limit) ? mean + limit : (value < mean - limit) ? mean - limit : value;
+    } else {
+        n++;
+    }
+    float delta = value - mean;
+    mean += alpha * delta;
+    variance = (1 - alpha) * (variance + alpha * delta * delta);
+}
+
+TURBIDITY_SIGNAL changeDetector::update(float value) {
+    ceiling_run = ((ceiling > 0) && (value >= ceiling)) ? ceiling_run + 1 : 0;
+    bool over_ceiling = ceiling_run >= DETECTOR_CEILING_READINGS;
+
+    if (!event) {
+        bool learnt = n >= DETECTOR_WARMUP_READINGS;
+        if (learnt) {
+            // one reading can only add half the threshold, so a single burst is never an event on its own
+            float step = fminf((value - mean) / sigma() - slack, threshold / 2);
+            s_high = fmaxf(0, s_high + step);
+        }
+        if (over_ceiling || (learnt && (s_high > threshold))) {
+            event = true;
+            quiet_run = 0;
+            event_readings = 0;
+            return TURBIDITY_SIGNAL::RISING;
+        }
+        learn(value);
+        return TURBIDITY_SIGNAL::QUIET;
+    }
+
+    event_readings++;
+    float z = (value - mean) / sigma();
+    quiet_run = ((z < slack) && !over_ceiling) ? quiet_run + 1 : 0;
+    if (quiet_run >= DETECTOR_RECOVERY_READINGS) {
+        event = false;
+        s_high = 0;
+        return TURBIDITY_SIGNAL::RECOVERED;
+    }
+    if (event_readings >= DETECTOR_MAX_EVENT_READINGS) {
+        // a lasting step (e.g. the sensor was moved), start again from here
+        reset();
+        learn(value);
+        return TURBIDITY_SIGNAL::RECOVERED;
+    }
+    return TURBIDITY_SIGNAL::ELEVATED;
+}
+
+void changeDetector::save(changeDetectorState *state) const {
+    state->mean = mean;
+    state->variance = variance;
+    state->s_high = s_high;
+    state->n = n;
+    state->event_readings = event_readings;
+    state->ceiling_run = ceiling_run;
+    state->quiet_run = quiet_run;
+    state->event = event;
+}
+
+void changeDetector::restore(const changeDetectorState *state) {
+    mean = state->mean;
+    variance = state->variance;
+    s_high = state->s_high;
+    n = state->n;
+    event_readings = state->event_readings;
+    ceiling_run = state->ceiling_run;
+    quiet_run = state->quiet_run;
+    event = state->event;
+}
@@ -0,0 +1,109 @@
+#pragma once
+/**
+ * @file ChangeDetector.h
+ * @brief Streaming turbidity event detector: an EWMA baseline of the site's normal level & noise, and a one sided
+ * CUSUM of how far readings sit above it.
+ *
+ * Each reading is normalised against the baseline (z = (x - mean) / sigma). The CUSUM adds up z - slack and is reset
+ * at 0, so noise around the baseline cancels out. One reading can add at most half the threshold, so a single noisy
+ * burst is never an event, but a step or a slow rise builds up until it crosses the threshold. The baseline is frozen
+ * during an event so it doesn't chase the event.
+ *
+ * Constant memory and time per reading.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#define DETECTOR_ALPHA             (1.0f / 32) /**< EWMA weight of a new reading in the baseline. */
+#define DETECTOR_WARMUP_READINGS   8           /**< Readings used to learn the baseline before anything is detected. */
+#define DETECTOR_MIN_SIGMA         1.0f        /**< Noise floor in NTU, so a very steady site isn't over sensitive. */
+#define DETECTOR_RECOVERY_READINGS 3           /**< Readings back near the baseline before an event has ended. */
+#define DETECTOR_MAX_EVENT_READINGS 120        /**< An event this long is taken as the new normal and relearnt. */
+#define DETECTOR_CEILING_READINGS  2           /**< Readings at or above the ceiling that start an event anyway. */
+
+/** @brief What a reading means for the mode logic. */
+enum class TURBIDITY_SIGNAL : uint8_t {
+    QUIET,     /**< Normal for this site. */
+    RISING,    /**< An event has just started. */
+    ELEVATED,  /**< Still in an event. */
+    RECOVERED, /**< The event has just ended. */
+};
+
+/** @brief What a changeDetector has learnt, so it can carry on after a reset (see DeepSleep.h). */
+struct changeDetectorState {
+    float mean;
+    float variance;
+    float s_high;
+    uint16_t n;
+    uint16_t event_readings;
+    uint8_t ceiling_run;
+    uint8_t quiet_run;
+    bool event;
+};
+
+/**
+ * @brief EWMA/CUSUM change detector for one stream of readings.
+ */
+class changeDetector {
+  public:
+    /**
+     * @brief Construct a new detector, see configure().
+     */
+    changeDetector(float slack_sigma, float threshold_sigma, float ceiling);
+
+    /**
+     * @brief Sets the sensitivity. Takes effect from the next reading, the baseline is kept.
+     * @param slack_sigma Rise (in sigmas) that is ignored, usually 0.5. Smaller catches smaller rises.
+     * @param threshold_sigma CUSUM level (in sigmas) that starts an event, usually 4-5. Smaller reacts sooner but has
+     * more false alarms.
+     * @param ceiling Readings at or above this start an event after DETECTOR_CEILING_READINGS in a row, even while the
+     * baseline is being learnt. 0 = off.
+     */
+    void configure(float slack_sigma, float threshold_sigma, float ceiling);
+
+    /**
+     * @brief Adds a reading.
+     * @return The signal for this reading.
+     */
+    TURBIDITY_SIGNAL update(float value);
+
+    /**
+     * @brief Forgets the baseline, e.g. after the sensor has been moved or cleaned.
+     */
+    void reset(void);
+
+    inline bool inEvent(void) const { return event; };
+    inline float baseline(void) const { return mean; };
+    float sigma(void) const;
+    inline float cusum(void) const { return s_high; };
+
+    /**
+     * @brief Saves the baseline & event state. The sensitivity isn't included, it comes from configure().
+     */
+    void save(changeDetectorState *state) const;
+
+    /**
+     * @brief Carries on from a saved state instead of learning the baseline again.
+     */
+    void restore(const changeDetectorState *state);
+
+  private:
+    void learn(float value);
+
+    float slack;
+    float threshold;
+    float ceiling;
+    float mean = 0;
+    float variance = 0;
+    uint16_t n = 0;          // readings in the baseline, counts up to DETECTOR_WARMUP_READINGS
+    float s_high = 0;        // upper CUSUM, in sigmas
+    bool event = false;
+    uint8_t ceiling_run = 0; // readings in a row at or above the ceiling
+    uint8_t quiet_run = 0;   // readings in a row back near the baseline during an event
+    uint16_t event_readings = 0;
+};
@@ -0,0 +1,58 @@
+#include "EventMode.h"
+
+const char *eventModeName(EVENT_MODE mode) {
+    switch (mode) {
+        case EVENT_MODE::ACTIVE_MODE:
+            return "active mode";
+        case EVENT_MODE::NORMAL_MODE:
+            return "normal";
+        case EVENT_MODE::SWITCH_MODE:
+            return "switch mode";
+        default:
+            return "?";
+    }
+}
+
+eventMode::eventMode(uint8_t active_cycles) { configure(active_cycles); }
+
+void eventMode::configure(uint8_t active_cycles) { this->active_cycles = active_cycles; }
+
+bool eventMode::advance(void) {
+    switch (current) {
+        case EVENT_MODE::NORMAL_MODE:
+            if (trigger) {
+                current = EVENT_MODE::SWITCH_MODE;
+            }
+            break;
+        case EVENT_MODE::ACTIVE_MODE:
+            if (counter >= active_cycles - 1) {
+                current = EVENT_MODE::NORMAL_MODE;
+                counter = 0;
+                return true;
+            }
+            counter++;
+            break;
+        case EVENT_MODE::SWITCH_MODE:
+            trigger = false;
+            counter++;
+            current = EVENT_MODE::ACTIVE_MODE;
+            break;
+        default:
+            current = EVENT_MODE::NORMAL_MODE;
+            break;
+    }
+    return false;
+}
+
+bool eventMode::update(TURBIDITY_SIGNAL signal) {
+    if ((signal == TURBIDITY_SIGNAL::RISING) && (current == EVENT_MODE::NORMAL_MODE)) {
+        trigger = true;
+        return true;
+    }
+    if (((signal == TURBIDITY_SIGNAL::RISING) || (signal == TURBIDITY_SIGNAL::ELEVATED)) &&
+        (current == EVENT_MODE::ACTIVE_MODE)) {
+        // stay in active mode until the event is over
+        counter = 0;
+    }
+    return false;
+}
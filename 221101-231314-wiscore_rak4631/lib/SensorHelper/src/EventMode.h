@@ -0,0 +1,72 @@
+#pragma once
+/**
+ * @file EventMode.h
+ * @brief The normal/switch/active mode logic that sets how often readings are taken.
+ *
+ * A RISING signal in normal mode triggers an event: the active interval is used straight away and the next cycle moves
+ * to switch mode, then active mode. Active mode lasts active_cycles readings, and any RISING or ELEVATED signal while
+ * active starts the count again, so it only ends once the event is over.
+ *
+ * Shared by main.cpp and the fleet simulator (test/fleet_sim.cc).
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#include "ChangeDetector.h" /**< TURBIDITY_SIGNAL. */
+
+/** @brief Reporting mode. */
+enum class EVENT_MODE : uint8_t {
+    ACTIVE_MODE, /**< Reporting every active interval until the event is over. */
+    NORMAL_MODE, /**< Reporting every normal interval. */
+    SWITCH_MODE, /**< The cycle after a trigger, on the way to active mode. */
+};
+
+/**
+ * @brief Name of a mode, for logs.
+ */
+const char *eventModeName(EVENT_MODE mode);
+
+/**
+ * @brief The mode state machine for one node.
+ */
+class eventMode {
+  public:
+    /**
+     * @brief Construct a new eventMode in normal mode, see configure().
+     */
+    eventMode(uint8_t active_cycles);
+
+    /**
+     * @brief Sets how many readings active mode lasts after the last elevated one. Takes effect from the next cycle.
+     */
+    void configure(uint8_t active_cycles);
+
+    /**
+     * @brief Moves between the modes at the start of a cycle.
+     * @return True if active mode just ended, so the normal interval applies again.
+     */
+    bool advance(void);
+
+    /**
+     * @brief Takes the event detector's signal for a reading.
+     * @return True if it triggered an event, so the active interval applies from now.
+     */
+    bool update(TURBIDITY_SIGNAL signal);
+
+    inline EVENT_MODE mode(void) const { return current; };
+    /** @brief Triggered, but the switch to active mode is still to come. */
+    inline bool triggered(void) const { return trigger; };
+    /** @brief Readings are alerts: triggered or not in normal mode. */
+    inline bool alert(void) const { return trigger || (current != EVENT_MODE::NORMAL_MODE); };
+
+  private:
+    EVENT_MODE current = EVENT_MODE::NORMAL_MODE;
+    bool trigger = false;
+    int active_cycles;
+    int counter = 0; // readings in active mode since the last elevated one
+};
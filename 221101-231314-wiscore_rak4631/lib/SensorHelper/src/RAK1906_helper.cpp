@@ -3,7 +3,7 @@
 bool RAK1906::init(initRAK1906Sensors *initSensors) {
     Wire.begin();
     if (!begin(BME680_ADDRESS)) {
-        log(LOG_LEVEL::ERROR, "Could not find a valid BME680 sensor, check wiring!");
+        LOG_ERROR("Could not find a valid BME680 sensor, check wiring!");
         return false;
     }
 
@@ -1,5 +1,9 @@
 #include "SensorHelper.h"
 
+// the turbidity burst logs every sample, so only log it when debugging the readings themselves
+#undef LOG_MODULE_LEVEL
+#define LOG_MODULE_LEVEL LOG_LEVEL::INFO
+
 /**
  * @brief Temp & Humi Sensor Selection
  * As there are two different sensors that can provide temperature &/or humidity the user must specify which one to use.
@@ -18,13 +22,17 @@ RAK1906 enviroSensor;
 BatteryLevel batLvl;
 TurbidityLevel turbLvl;
 // GPSClass gps;
+
+uint8_t turbidity_samples = 100; // samples averaged per turbidity reading, see setTurbiditySamples()
+bool rail_in_use[(uint8_t)POWER_RAIL::COUNT] = {};   // rails of the sensors initialised, see acquireSensorRails()
+bool rail_acquired[(uint8_t)POWER_RAIL::COUNT] = {}; // what to release, initSensors() may run in between
 // AnalogSensor analogsensorexample(sensor A1, ADC reference voltage, ADC 10, ADC oversampling);
 
 bool initSensors(const portSchema *port_settings, bool useRAK1901, bool useRAK1906) {
-    log(LOG_LEVEL::DEBUG, "Initialising sensors...");
+    LOG_DEBUG("Initialising sensors...");
 
     if (useRAK1901 && useRAK1906) {
-        log(LOG_LEVEL::WARN, "Cannot use both SHTC3(RAK1901) & BME680(RAK1906). The RAK1906 will be used by default.");
+        LOG_WARN("Cannot use both SHTC3(RAK1901) & BME680(RAK1906). The RAK1906 will be used by default.");
         USERAK1906 = useRAK1906;
         USERAK1901 = false;
     } else {
@@ -32,6 +40,10 @@ bool initSensors(const portSchema *port_settings, bool useRAK1901, bool useRAK19
         USERAK1906 = useRAK1906;
     }
 
+    for (bool &in_use : rail_in_use) {
+        in_use = false;
+    }
+
     // battery voltage setup
     if (port_settings->sendBatteryVoltage) {
         batLvl.ADCInit();
@@ -49,26 +61,26 @@ bool initSensors(const portSchema *port_settings, bool useRAK1901, bool useRAK19
                 port_settings->sendGasResistance,
             };
             if (!enviroSensor.init(&init_sensors)) {
-                log(LOG_LEVEL::ERROR, "Unable to initialise the RAK1906.");
+                LOG_ERROR("Unable to initialise the RAK1906.");
                 return false;
             }
         } else if (USERAK1901) {
             if (port_settings->sendAirPressure || port_settings->sendGasResistance) {
-                log(LOG_LEVEL::ERROR, "The RAK1901 sensor cannot provide air pressure or gas resistance.");
+                LOG_ERROR("The RAK1901 sensor cannot provide air pressure or gas resistance.");
                 return false;
             } else if (port_settings->sendTemperature || port_settings->sendRelativeHumidity) {
                 // Temperature and humidity (tempHumiSensor) sensor setup
                 if (!tempHumiSensor.init()) {
-                    log(LOG_LEVEL::ERROR, "Unable to initialise the RAK1901.");
+                    LOG_ERROR("Unable to initialise the RAK1901.");
                     return false;
                 }
             }
         } else {
-            log(LOG_LEVEL::ERROR, "No sensor chosen to read temp/humi/pressure/gas.");
+            LOG_ERROR("No sensor chosen to read temp/humi/pressure/gas.");
             return false;
         }
     } else if (USERAK1901 || USERAK1906) {
-        log(LOG_LEVEL::WARN, "Neither a RAK1901 or RAK1906 is required for this port.");
+        LOG_WARN("Neither a RAK1901 or RAK1906 is required for this port.");
     }
 
     // if (port_settings->sendLocation) {
@@ -76,71 +88,124 @@ bool initSensors(const portSchema *port_settings, bool useRAK1901, bool useRAK19
     // }
     if (port_settings->sendTurbidity){
         turbLvl.ADCInit();
+        rail_in_use[(uint8_t)POWER_RAIL::SENSOR] = true;
     }
 
     return true;
 }
 
+uint32_t acquireSensorRails(uint32_t now_ms) {
+    uint32_t warm_ms = 0;
+    for (uint8_t i = 0; i < (uint8_t)POWER_RAIL::COUNT; i++) {
+        if (rail_in_use[i] && !rail_acquired[i]) {
+            rail_acquired[i] = true;
+            uint32_t rail_warm_ms = getPowerRail((POWER_RAIL)i)->acquire(now_ms);
+            if (rail_warm_ms > warm_ms) {
+                warm_ms = rail_warm_ms;
+            }
+        }
+    }
+    return warm_ms;
+}
+
+void releaseSensorRails(uint32_t now_ms, uint32_t next_use_ms) {
+    for (uint8_t i = 0; i < (uint8_t)POWER_RAIL::COUNT; i++) {
+        if (rail_acquired[i]) {
+            rail_acquired[i] = false;
+            getPowerRail((POWER_RAIL)i)->release(now_ms, next_use_ms);
+        }
+    }
+}
+
+void setTurbiditySamples(uint8_t samples) {
+    turbidity_samples = (samples > 0) ? samples : 1;
+}
+
 sensorData getSensorData(const portSchema *port_settings) {
-    sensorData data = {};
+    sensorReading reading;
+    reading.begin(port_settings, millis());
+    while (reading.step(millis())) {
+        delay(reading.msUntilWake(millis()));
+    }
+    return *reading.data();
+}
 
-    if (port_settings->sendBatteryVoltage) {
-        data.battery_mv.value = batLvl.getSensorMV();
-        data.battery_mv.is_valid = true;
+void sensorReading::begin(const portSchema *port_settings, uint32_t now_ms) {
+    port = *port_settings;
+    result = {};
+    start(now_ms);
+}
+
+bool sensorReading::body(uint32_t now_ms) {
+    SEQ_BEGIN();
+    if (port.sendBatteryVoltage) {
+        if (batLvl.selectADC()) {
+            SEQ_SLEEP(ANALOG_SETTLE_MS);
+        }
+        result.battery_mv.value = batLvl.sampleMV();
+        result.battery_mv.is_valid = true;
     }
 
-    if (port_settings->sendTemperature || port_settings->sendRelativeHumidity || port_settings->sendAirPressure ||
-        port_settings->sendGasResistance) {
+    if (port.sendTemperature || port.sendRelativeHumidity || port.sendAirPressure || port.sendGasResistance) {
         if (USERAK1906) {
             if (enviroSensor.dataReady()) {
-                if (port_settings->sendTemperature) {
-                    data.temperature.value = enviroSensor.getTemperature();
-                    data.temperature.is_valid = true;
+                if (port.sendTemperature) {
+                    result.temperature.value = enviroSensor.getTemperature();
+                    result.temperature.is_valid = true;
                 }
-                if (port_settings->sendRelativeHumidity) {
-                    data.humidity.value = enviroSensor.getHumidity();
-                    data.humidity.is_valid = true;
+                if (port.sendRelativeHumidity) {
+                    result.humidity.value = enviroSensor.getHumidity();
+                    result.humidity.is_valid = true;
                 }
-                if (port_settings->sendAirPressure) {
-                    data.pressure.value = enviroSensor.getPressure();
-                    data.pressure.is_valid = true;
+                if (port.sendAirPressure) {
+                    result.pressure.value = enviroSensor.getPressure();
+                    result.pressure.is_valid = true;
                 }
-                if (port_settings->sendGasResistance) {
-                    data.gas_resist.value = enviroSensor.getGasResistance();
-                    data.gas_resist.is_valid = true;
+                if (port.sendGasResistance) {
+                    result.gas_resist.value = enviroSensor.getGasResistance();
+                    result.gas_resist.is_valid = true;
                 }
             }
         } else if (USERAK1901) {
             if (tempHumiSensor.dataReady()) {
-                if (port_settings->sendTemperature) {
-                    data.temperature.value = tempHumiSensor.getTemperature();
-                    data.temperature.is_valid = true;
+                if (port.sendTemperature) {
+                    result.temperature.value = tempHumiSensor.getTemperature();
+                    result.temperature.is_valid = true;
                 }
-                if (port_settings->sendRelativeHumidity) {
-                    data.humidity.value = tempHumiSensor.getHumidity();
-                    data.humidity.is_valid = true;
+                if (port.sendRelativeHumidity) {
+                    result.humidity.value = tempHumiSensor.getHumidity();
+                    result.humidity.is_valid = true;
                 }
             }
         }
     }
 
-    // if (port_settings->sendLocation) {
+    // if (port.sendLocation) {
     //     if (valid gps data) {
-    //         data.location.latitude = gps.getLatitude();
-    //         data.location.longitude = gps.getLongitude();
-    //         data.location.is_valid = true;
+    //         result.location.latitude = gps.getLatitude();
+    //         result.location.longitude = gps.getLongitude();
+    //         result.location.is_valid = true;
     //     }
     // }
-    if (port_settings->sendTurbidity) {             // Takes 100 measurments and sends the avg turbidity
-        float sum = 0;
-        for (int i = 0; 100 > i; i++) {
-            float sensor = turbLvl.getSensorMV();
-            sum = sum + turbLvl.mvToNTU(sensor);
-            log(LOG_LEVEL::DEBUG,"%d",i);
-            delay(100);
+    if (port.sendTurbidity) { // Takes turbidity_samples measurments and sends the avg turbidity
+        if (turbLvl.selectADC()) {
+            SEQ_SLEEP(ANALOG_SETTLE_MS);
         }
-        data.turbidity.is_valid = true;
-        data.turbidity.value = sum/100;
+        sum = 0;
+        for (sample = 0; turbidity_samples > sample; sample++) {
+            {
+                float ntu = turbLvl.mvToNTU(turbLvl.sampleMV());
+                sum = sum + ntu;
+                min_ntu = ((sample == 0) || (ntu < min_ntu)) ? ntu : min_ntu;
+                max_ntu = ((sample == 0) || (ntu > max_ntu)) ? ntu : max_ntu;
+                LOG_DEBUG("%d", sample);
+            }
+            SEQ_SLEEP(TURBIDITY_SAMPLE_INTERVAL_MS);
+        }
+        result.turbidity.is_valid = true;
+        result.turbidity.value = sum / turbidity_samples;
+        result.turbidity.min = min_ntu;
+        result.turbidity.max = max_ntu;
     }
-    return data;
-}
\ No newline at end of file
+    SEQ_END();
+}
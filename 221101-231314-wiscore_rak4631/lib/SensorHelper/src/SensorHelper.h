@@ -20,10 +20,15 @@
  */
 
 #include "AnalogSensor.h"   /**< Class to read a sensor using the onboard ADC. Plus BatteryLevel class. */
+#include "ChangeDetector.h" /**< EWMA/CUSUM turbidity event detector. */
 #include "Logging.h"        /**< Go here to change the logging level for the entire application. */
 #include "PortSchema.h"     /**< Go here for portSchema definitions. */
+#include "PowerRails.h"     /**< Switched power rails the sensors are on. */
 #include "RAK1901_helper.h" /**< Wrapper for SHTC3 library. */
 #include "RAK1906_helper.h" /**< Wrapper for BME680 library. */
+#include "Sequencer.h"      /**< Cooperative sequences, so the turbidity burst doesn't block its task. */
+
+#define TURBIDITY_SAMPLE_INTERVAL_MS 100 /**< Time between the turbidity samples averaged into a reading. */
 
 /**
  * @brief Initialise the given sensors based on the port schema.
@@ -36,8 +41,54 @@
 bool initSensors(const portSchema *port_settings, bool useRAK1901, bool useRAK1906);
 
 /**
- * @brief Get the sensor data.
+ * @brief Acquires the power rails of the sensors initSensors() set up, see PowerRails.h.
+ * @return Time until they're all warm, 0 if no rails are needed or they're already warm.
+ */
+uint32_t acquireSensorRails(uint32_t now_ms);
+
+/**
+ * @brief Releases the rails from acquireSensorRails().
+ * @param next_use_ms Time until they're acquired again, so a rail is kept warm if that's cheaper.
+ */
+void releaseSensorRails(uint32_t now_ms, uint32_t next_use_ms);
+
+/**
+ * @brief Sets how many turbidity samples a reading averages (default 100, TURBIDITY_SAMPLE_INTERVAL_MS apart).
+ * @param samples Number of samples, min 1.
+ */
+void setTurbiditySamples(uint8_t samples);
+
+/**
+ * @brief Get the sensor data. Blocks for the whole turbidity burst, see sensorReading to read without blocking.
  * @param port_settings Pointer to port schema for this app.
  * @return The sensor data in sensorData struct format.
  */
 sensorData getSensorData(const portSchema *port_settings);
+
+/**
+ * @brief Reads the sensors as a sequence (see Sequencer.h): the turbidity samples are taken TURBIDITY_SAMPLE_INTERVAL_MS
+ * apart with the task free (and the CPU idle) in between, and the ADC settles the same way.
+ */
+class sensorReading : public sequence {
+  public:
+    /**
+     * @brief Starts a reading of the sensors in port_settings.
+     */
+    void begin(const portSchema *port_settings, uint32_t now_ms);
+
+    /**
+     * @brief The sensor data, complete once running() is false.
+     */
+    inline const sensorData *data(void) const { return &result; };
+
+  protected:
+    bool body(uint32_t now_ms) override;
+
+  private:
+    portSchema port = {};
+    sensorData result = {};
+    uint8_t sample = 0;
+    float sum = 0;
+    float min_ntu = 0;
+    float max_ntu = 0;
+};
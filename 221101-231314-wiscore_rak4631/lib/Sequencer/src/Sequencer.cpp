@@ -0,0 +1,59 @@
+#include "Sequencer.h"
+
+void sequence::start(uint32_t now_ms) {
+    resume_point = 0;
+    wake_ms = now_ms;
+    active = true;
+}
+
+void sequence::stop(void) {
+    active = false;
+}
+
+uint32_t sequence::msUntilWake(uint32_t now_ms) const {
+    if (!active) {
+        return SEQUENCER_IDLE;
+    }
+    int32_t remaining = (int32_t)(wake_ms - now_ms);
+    return (remaining > 0) ? (uint32_t)remaining : 0;
+}
+
+bool sequence::step(uint32_t now_ms) {
+    if (active && (msUntilWake(now_ms) == 0) && body(now_ms)) {
+        active = false;
+    }
+    return active;
+}
+
+bool sequencer::add(sequence *seq) {
+    if (n_sequences >= SEQUENCER_MAX_SEQUENCES) {
+        return false;
+    }
+    sequences[n_sequences++] = seq;
+    return true;
+}
+
+uint32_t sequencer::run(uint32_t now_ms) {
+    uint32_t next_wake = SEQUENCER_IDLE;
+    for (uint8_t s = 0; s < n_sequences; s++) {
+        sequences[s]->step(now_ms);
+        uint32_t wait = sequences[s]->msUntilWake(now_ms);
+        if (wait < next_wake) {
+            next_wake = wait;
+        }
+    }
+    return next_wake;
+}
+
+void virtualClock::runFor(sequencer *sequences, uint32_t duration_ms) {
+    uint32_t end_ms = now_ms + duration_ms;
+    for (;;) {
+        uint32_t wait = sequences->run(now_ms);
+        uint32_t left = end_ms - now_ms;
+        if ((wait == SEQUENCER_IDLE) || (wait > left)) {
+            now_ms = end_ms;
+            return;
+        }
+        now_ms += wait;
+    }
+}
@@ -0,0 +1,187 @@
+#pragma once
+/**
+ * @file Sequencer.h
+ * @brief Cooperative sequences (stackless protothreads) for flows that wait, e.g. sensor warm-up and sample bursts,
+ * without blocking their task.
+ *
+ * A sequence is a class with a body() written as straight-line steps between SEQ_BEGIN() and SEQ_END(). Each wait
+ * (SEQ_SLEEP(), SEQ_WAIT_UNTIL(), SEQ_AWAIT()) saves where it got to and returns; the next step() carries on from there
+ * once the wait is over. The task running the sequences blocks until the earliest wake time, so the CPU can drop into
+ * low power idle in between, and one task can run several sequences at once.
+ *
+ * Because body() returns at every wait, its local variables don't survive a wait: keep state in members. A local
+ * declared with an initialiser after SEQ_BEGIN() won't compile ("jump to case label"); declare it inside braces.
+ * Only one wait per source line.
+ *
+ * Time is always passed in (now_ms), so the same sequences run on millis() on the device and on a virtualClock on a
+ * host.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#define SEQUENCER_MAX_SEQUENCES 4           /**< Sequences one sequencer can run. */
+#define SEQUENCER_IDLE          0xFFFFFFFFUL /**< run() result when no sequence is running. */
+
+// A wait falls through into its own case label on the first pass. A comment can't mark that inside a macro, and
+// [[fallthrough]] needs C++17.
+#if defined(__has_attribute)
+#if __has_attribute(fallthrough)
+#define SEQ_FALLTHROUGH __attribute__((fallthrough))
+#endif
+#endif
+#ifndef SEQ_FALLTHROUGH
+#define SEQ_FALLTHROUGH
+#endif
+
+/** @brief Starts a sequence body. */
+#define SEQ_BEGIN()                                                                                                    \
+    switch (resume_point) {                                                                                            \
+        case 0:
+
+/** @brief Waits ms, then carries on. */
+#define SEQ_SLEEP(ms)                                                                                                  \
+    do {                                                                                                               \
+        wake_ms = now_ms + (ms);                                                                                       \
+        resume_point = __LINE__;                                                                                       \
+        return false;                                                                                                  \
+        case __LINE__:;                                                                                                \
+    } while (0)
+
+/** @brief Lets the other sequences run, then carries on straight away. */
+#define SEQ_YIELD() SEQ_SLEEP(0)
+
+/** @brief Waits until condition is true, checking it every poll_ms. */
+#define SEQ_WAIT_UNTIL(condition, poll_ms)                                                                             \
+    do {                                                                                                               \
+        resume_point = __LINE__;                                                                                       \
+        SEQ_FALLTHROUGH;                                                                                               \
+        case __LINE__:                                                                                                 \
+            if (!(condition)) {                                                                                        \
+                wake_ms = now_ms + (poll_ms);                                                                          \
+                return false;                                                                                          \
+            }                                                                                                          \
+    } while (0)
+
+/** @brief Runs another sequence, already started, to its end. Its waits become this sequence's waits. */
+#define SEQ_AWAIT(child)                                                                                               \
+    do {                                                                                                               \
+        resume_point = __LINE__;                                                                                       \
+        SEQ_FALLTHROUGH;                                                                                               \
+        case __LINE__:                                                                                                 \
+            if ((child).step(now_ms)) {                                                                                \
+                wake_ms = (child).wakeMs();                                                                            \
+                return false;                                                                                          \
+            }                                                                                                          \
+    } while (0)
+
+/** @brief Ends a sequence body. */
+#define SEQ_END()                                                                                                      \
+    }                                                                                                                  \
+    resume_point = 0;                                                                                                  \
+    return true;
+
+/**
+ * @brief Base class for a sequence. Subclasses implement body() with the SEQ_ macros.
+ */
+class sequence {
+  public:
+    /**
+     * @brief Starts (or restarts) the sequence from the top. It runs on the next step().
+     */
+    void start(uint32_t now_ms);
+
+    /**
+     * @brief Stops the sequence wherever it is.
+     */
+    void stop(void);
+
+    /**
+     * @brief True from start() until body() reaches SEQ_END() or stop() is called.
+     */
+    inline bool running(void) const { return active; };
+
+    /**
+     * @brief When the current wait is over (valid while running()).
+     */
+    inline uint32_t wakeMs(void) const { return wake_ms; };
+
+    /**
+     * @brief Time until the current wait is over: 0 if due now, SEQUENCER_IDLE if not running.
+     */
+    uint32_t msUntilWake(uint32_t now_ms) const;
+
+    /**
+     * @brief Runs the body up to its next wait, if the current wait is over.
+     * @return True if the sequence is still running.
+     */
+    bool step(uint32_t now_ms);
+
+  protected:
+    /**
+     * @brief The steps of the sequence, between SEQ_BEGIN() and SEQ_END(). The parameter must be called now_ms.
+     * @return True when finished (SEQ_END() does this).
+     */
+    virtual bool body(uint32_t now_ms) = 0;
+
+    uint16_t resume_point = 0; // __LINE__ of the wait to carry on from, 0 = the top
+    uint32_t wake_ms = 0;      // when the current wait is over
+
+  private:
+    bool active = false;
+};
+
+/**
+ * @brief Runs up to SEQUENCER_MAX_SEQUENCES sequences in one task. The task calls run() whenever it wakes, then blocks
+ * for the time it returns (or until an event that may start a sequence or end a SEQ_WAIT_UNTIL()).
+ */
+class sequencer {
+  public:
+    /**
+     * @brief Adds a sequence. It only runs once start()ed.
+     * @return False if already full.
+     */
+    bool add(sequence *seq);
+
+    /**
+     * @brief Steps every running sequence whose wait is over, once each.
+     * @return Time until the next wake (0 if one is due again straight away), or SEQUENCER_IDLE if none are running.
+     */
+    uint32_t run(uint32_t now_ms);
+
+  private:
+    sequence *sequences[SEQUENCER_MAX_SEQUENCES] = {};
+    uint8_t n_sequences = 0;
+};
+
+/**
+ * @brief Host implementation of the time base: a clock that only moves when told to, jumping straight to each wake
+ * time, so sequences that take minutes run in microseconds in a test.
+ */
+class virtualClock {
+  public:
+    explicit virtualClock(uint32_t start_ms = 0) : now_ms(start_ms){};
+
+    /**
+     * @brief The virtual millis().
+     */
+    inline uint32_t nowMs(void) const { return now_ms; };
+
+    /**
+     * @brief Moves the clock on without running anything.
+     */
+    inline void advance(uint32_t ms) { now_ms += ms; };
+
+    /**
+     * @brief Runs the sequencer for duration_ms of virtual time, jumping from wake to wake. Stops early, at the end
+     * time, if nothing is running. A sequence that yields forever never lets the clock move, so don't.
+     */
+    void runFor(sequencer *sequences, uint32_t duration_ms);
+
+  private:
+    uint32_t now_ms;
+};
@@ -0,0 +1,212 @@
+#include "SeriesCompression.h"
+
+#include <math.h>
+#include <string.h>
+
+swingingDoorCompressor::swingingDoorCompressor(float error_bound) {
+    setErrorBound(error_bound);
+}
+
+void swingingDoorCompressor::setErrorBound(float error_bound) {
+    this->error_bound = fabsf(error_bound);
+}
+
+void swingingDoorCompressor::restart(void) {
+    n_breakpoints = 0;
+    has_anchor = false;
+    has_last = false;
+}
+
+void swingingDoorCompressor::archive(const seriesPoint *point) {
+    // addReading() archives at most one point, and the caller sends the frame once frameReady(), so there is room
+    if (n_breakpoints < SERIES_MAX_POINTS) {
+        breakpoints[n_breakpoints++] = *point;
+    }
+}
+
+/**
+ * @brief Number of points from the start that can go in one frame: a gap longer than a point's dt can hold ends it.
+ */
+static uint8_t pointsBeforeGap(const seriesPoint *points, uint8_t n_points) {
+    uint8_t n = (n_points > 0) ? 1 : 0;
+    while ((n < n_points) && ((points[n].time_s - points[n - 1].time_s) <= UINT16_MAX)) {
+        n++;
+    }
+    return n;
+}
+
+void swingingDoorCompressor::openDoors(const seriesPoint *point) {
+    float dt = (float)(point->time_s - anchor.time_s);
+    upper_slope = (point->value + error_bound - anchor.value) / dt;
+    lower_slope = (point->value - error_bound - anchor.value) / dt;
+}
+
+void swingingDoorCompressor::addReading(uint32_t time_s, float value) {
+    seriesPoint point = { time_s, value };
+
+    if (!has_anchor) {
+        anchor = point;
+        has_anchor = true;
+        archive(&anchor);
+        return;
+    }
+    if (time_s <= anchor.time_s) {
+        // out of order or duplicate time, ignore it
+        return;
+    }
+    if (!has_last) {
+        openDoors(&point);
+        last = point;
+        has_last = true;
+        return;
+    }
+
+    // narrow the doors to this reading
+    float dt = (float)(time_s - anchor.time_s);
+    float upper = fminf(upper_slope, (value + error_bound - anchor.value) / dt);
+    float lower = fmaxf(lower_slope, (value - error_bound - anchor.value) / dt);
+
+    if (lower > upper) {
+        // doors closed: no single line fits every reading, so the previous reading ends this segment
+        anchor = last;
+        archive(&anchor);
+        openDoors(&point);
+        last = point;
+        return;
+    }
+    upper_slope = upper;
+    lower_slope = lower;
+
+    // The segment end is placed on the line through the doors closest to this reading, rather than on the reading
+    // itself. The reading's own slope isn't always between the doors, and only lines between the doors are within
+    // error_bound of every reading in the segment.
+    float slope = fminf(fmaxf((value - anchor.value) / dt, lower_slope), upper_slope);
+    last = { time_s, anchor.value + slope * dt };
+}
+
+uint8_t swingingDoorCompressor::pendingPoints(void) const {
+    return n_breakpoints + (has_last ? 1 : 0);
+}
+
+uint8_t swingingDoorCompressor::collectPoints(seriesPoint *points) const {
+    uint8_t n_points = 0;
+    for (uint8_t i = 0; i < n_breakpoints; i++) {
+        points[n_points++] = breakpoints[i];
+    }
+    if (has_last) {
+        points[n_points++] = last;
+    }
+    return n_points;
+}
+
+bool swingingDoorCompressor::frameReady(void) const {
+    seriesPoint points[SERIES_MAX_POINTS + 1];
+    uint8_t n_points = collectPoints(points);
+    return (n_points >= SERIES_MAX_POINTS) || (pointsBeforeGap(points, n_points) < n_points);
+}
+
+uint8_t swingingDoorCompressor::encodeFrame(uint8_t *buffer, uint8_t max_length) {
+    seriesPoint points[SERIES_MAX_POINTS + 1];
+    uint8_t n_points = collectPoints(points);
+    if ((n_points == 0) || (max_length < SERIES_FRAME_HEADER + SERIES_FRAME_POINT)) {
+        return 0;
+    }
+
+    // as many as fit, up to any gap too long for a dt; the rest stay for the next frame, which has its own base time
+    uint8_t max_points = (max_length - SERIES_FRAME_HEADER) / SERIES_FRAME_POINT;
+    uint8_t n_frame = pointsBeforeGap(points, n_points);
+    n_frame = (n_frame > max_points) ? max_points : n_frame;
+
+    uint8_t pos = 0;
+    buffer[pos++] = SERIES_FRAME_VERSION;
+    buffer[pos++] = n_frame;
+    uint32_t base = points[0].time_s;
+    buffer[pos++] = (uint8_t)(base >> 24);
+    buffer[pos++] = (uint8_t)(base >> 16);
+    buffer[pos++] = (uint8_t)(base >> 8);
+    buffer[pos++] = (uint8_t)(base & 0xFF);
+    uint32_t previous = base;
+    for (uint8_t i = 0; i < n_frame; i++) {
+        uint32_t dt = points[i].time_s - previous;
+        previous = points[i].time_s;
+        float scaled = points[i].value * SERIES_VALUE_SCALE;
+        uint16_t value = (scaled <= 0) ? 0 : (scaled >= UINT16_MAX) ? UINT16_MAX : (uint16_t)lroundf(scaled);
+        buffer[pos++] = (uint8_t)(dt >> 8);
+        buffer[pos++] = (uint8_t)(dt & 0xFF);
+        buffer[pos++] = (uint8_t)(value >> 8);
+        buffer[pos++] = (uint8_t)(value & 0xFF);
+    }
+
+    if (n_frame < n_points) {
+        // keep the breakpoints that didn't go in, and the latest reading as it is
+        n_breakpoints = (n_frame < n_breakpoints) ? n_breakpoints - n_frame : 0;
+        memmove(breakpoints, &points[n_frame], n_breakpoints * sizeof(seriesPoint));
+        return pos;
+    }
+    // the newest reading is the start of the next segment
+    n_breakpoints = 0;
+    if (has_last) {
+        anchor = last;
+        has_last = false;
+    }
+    return pos;
+}
+
+void swingingDoorCompressor::save(seriesCompressorState *state) const {
+    memcpy(state->breakpoints, breakpoints, sizeof(breakpoints));
+    state->anchor = anchor;
+    state->last = last;
+    state->upper_slope = upper_slope;
+    state->lower_slope = lower_slope;
+    state->n_breakpoints = n_breakpoints;
+    state->has_anchor = has_anchor;
+    state->has_last = has_last;
+}
+
+void swingingDoorCompressor::restore(const seriesCompressorState *state) {
+    memcpy(breakpoints, state->breakpoints, sizeof(breakpoints));
+    anchor = state->anchor;
+    last = state->last;
+    upper_slope = state->upper_slope;
+    lower_slope = state->lower_slope;
+    n_breakpoints = (state->n_breakpoints > SERIES_MAX_POINTS) ? SERIES_MAX_POINTS : state->n_breakpoints;
+    has_anchor = state->has_anchor;
+    has_last = state->has_last;
+}
+
+uint8_t decodeSeriesFrame(const uint8_t *buffer, uint8_t length, seriesPoint *points, uint8_t max_points) {
+    if ((length < SERIES_FRAME_HEADER) || (buffer[0] != SERIES_FRAME_VERSION)) {
+        return 0;
+    }
+    uint8_t n_points = buffer[1];
+    if ((n_points > max_points) || (length < SERIES_FRAME_HEADER + n_points * SERIES_FRAME_POINT)) {
+        return 0;
+    }
+    uint32_t time_s = ((uint32_t)buffer[2] << 24) | ((uint32_t)buffer[3] << 16) | ((uint32_t)buffer[4] << 8) | buffer[5];
+    const uint8_t *point = &buffer[SERIES_FRAME_HEADER];
+    for (uint8_t i = 0; i < n_points; i++, point += SERIES_FRAME_POINT) {
+        time_s += ((uint16_t)point[0] << 8) | point[1];
+        points[i].time_s = time_s;
+        points[i].value = (float)(((uint16_t)point[2] << 8) | point[3]) / SERIES_VALUE_SCALE;
+    }
+    return n_points;
+}
+
+float reconstructSeries(const seriesPoint *points, uint16_t n_points, uint32_t time_s) {
+    if (n_points == 0) {
+        return 0;
+    }
+    if (time_s <= points[0].time_s) {
+        return points[0].value;
+    }
+    for (uint16_t i = 1; i < n_points; i++) {
+        if (time_s <= points[i].time_s) {
+            const seriesPoint *a = &points[i - 1];
+            const seriesPoint *b = &points[i];
+            float fraction = (float)(time_s - a->time_s) / (float)(b->time_s - a->time_s);
+            return a->value + (b->value - a->value) * fraction;
+        }
+    }
+    return points[n_points - 1].value;
+}
+
@@ -0,0 +1,141 @@
+#pragma once
+/**
+ * @file SeriesCompression.h
+ * @brief Lossy time-series compression of readings using the swinging door algorithm, plus the frame format the
+ * breakpoints are sent in and the routine that reconstructs the series from them.
+ *
+ * The compressor keeps the last archived point and two "doors" (the steepest and shallowest lines from that point that
+ * stay within error_bound of every reading since). While the doors are open the readings lie within error_bound of a
+ * straight line and nothing needs to be stored. When they close, the end of the previous segment is archived as a
+ * breakpoint. Segment ends are kept on a line between the doors (within error_bound of the reading), so linear
+ * interpolation between breakpoints reproduces every reading to within error_bound (plus the 0.1 frame resolution).
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#define SERIES_FRAME_PORT       202 /**< Port for compressed series frames (200-222 are system ports). */
+#define SERIES_FRAME_VERSION    1   /**< Version of the frame format. */
+#define SERIES_FRAME_HEADER     6   /**< [version][count][base time (4 bytes)]. */
+#define SERIES_FRAME_POINT      4   /**< [dt from previous point (2 bytes)][value (2 bytes)]. */
+#define SERIES_VALUE_SCALE      10  /**< Values are sent in 0.1 units. */
+#define SERIES_MAX_POINTS       11  /**< (51 - SERIES_FRAME_HEADER) / SERIES_FRAME_POINT: fits AU915 DR0-DR2. */
+
+/** @brief A timestamped reading. */
+struct seriesPoint {
+    uint32_t time_s; /**< Time of the reading in seconds. */
+    float value;     /**< The reading. */
+};
+
+/** @brief The compressor's points and doors, so the series can carry on after a reset (see DeepSleep.h). */
+struct seriesCompressorState {
+    seriesPoint breakpoints[SERIES_MAX_POINTS];
+    seriesPoint anchor;
+    seriesPoint last;
+    float upper_slope;
+    float lower_slope;
+    uint8_t n_breakpoints;
+    bool has_anchor;
+    bool has_last;
+};
+
+/**
+ * @brief Swinging door compressor that buffers breakpoints until there are enough for a frame.
+ */
+class swingingDoorCompressor {
+  public:
+    /**
+     * @brief Construct a new compressor.
+     * @param error_bound Max difference between any reading and the reconstructed series (same units as the values).
+     */
+    explicit swingingDoorCompressor(float error_bound);
+
+    /**
+     * @brief Changes the error bound. Takes effect from the next segment.
+     */
+    void setErrorBound(float error_bound);
+
+    /**
+     * @brief Adds a reading. Readings must be in time order, and a frame that is frameReady() must be sent first.
+     * @param time_s Time of the reading in seconds.
+     * @param value The reading.
+     */
+    void addReading(uint32_t time_s, float value);
+
+    /**
+     * @brief Number of points that would be sent by encodeFrame() right now.
+     */
+    uint8_t pendingPoints(void) const;
+
+    /**
+     * @brief True once the buffered breakpoints fill a frame, or span a gap longer than a point's dt (about 18 hours)
+     * so the frame has to be closed, and it should be sent.
+     */
+    bool frameReady(void) const;
+
+    /**
+     * @brief Encodes the buffered breakpoints, plus the latest reading to close the curve, into a frame and clears them.
+     * The latest reading becomes the start of the next segment; it is not repeated in the next frame. Points after a gap
+     * longer than a point's dt, or that don't fit in max_length, are kept for the next frame.
+     * @param buffer Buffer to encode into.
+     * @param max_length Size of buffer.
+     * @return Length of the frame, 0 if there is nothing to send.
+     */
+    uint8_t encodeFrame(uint8_t *buffer, uint8_t max_length);
+
+    /**
+     * @brief Drops everything, so the next reading starts a new curve. Use after the clock has been stepped, once any
+     * buffered breakpoints have been sent with encodeFrame().
+     */
+    void restart(void);
+
+    /**
+     * @brief Saves the buffered points & the current segment, e.g. instead of sending a part filled frame before a deep
+     * sleep. Times are in seconds of the caller's clock, so that clock has to carry on after the reset too.
+     */
+    void save(seriesCompressorState *state) const;
+
+    /**
+     * @brief Carries on from saved points. The error bound isn't saved.
+     */
+    void restore(const seriesCompressorState *state);
+
+  private:
+    void archive(const seriesPoint *point);
+    uint8_t collectPoints(seriesPoint *points) const;
+    void openDoors(const seriesPoint *point);
+
+    float error_bound;
+    seriesPoint breakpoints[SERIES_MAX_POINTS]; // archived but not yet sent
+    uint8_t n_breakpoints = 0;
+    seriesPoint anchor = {};  // start of the current segment
+    seriesPoint last = {};    // latest reading, moved onto the closest line between the doors
+    bool has_anchor = false;  // false until the first reading
+    bool has_last = false;    // a reading has been added since the anchor
+    float upper_slope = 0;    // shallowest upper door so far
+    float lower_slope = 0;    // steepest lower door so far
+};
+
+/**
+ * @brief Decodes a frame made by swingingDoorCompressor::encodeFrame().
+ * @param buffer The frame.
+ * @param length Length of the frame.
+ * @param points Filled with the breakpoints.
+ * @param max_points Size of points.
+ * @return Number of points decoded, 0 if the frame is malformed.
+ */
+uint8_t decodeSeriesFrame(const uint8_t *buffer, uint8_t length, seriesPoint *points, uint8_t max_points);
+
+/**
+ * @brief Reconstructs the value at time_s by linear interpolation between breakpoints.
+ * Breakpoints from consecutive frames can simply be concatenated.
+ * @param points Breakpoints in time order.
+ * @param n_points Number of breakpoints.
+ * @param time_s Time to reconstruct. Times outside the breakpoints are clamped to the first/last value.
+ * @return The reconstructed value (0 if there are no points).
+ */
+float reconstructSeries(const seriesPoint *points, uint16_t n_points, uint32_t time_s);
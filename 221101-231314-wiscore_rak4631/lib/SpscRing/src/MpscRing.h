@@ -0,0 +1,124 @@
+#pragma once
+/**
+ * @file MpscRing.h
+ * @brief Lock-free multi-producer/single-consumer ring buffer, for records pushed from any task or interrupt and taken
+ * by one task, without a mutex or disabling interrupts.
+ *
+ * A bounded queue with a sequence number per slot (D. Vyukov's): a producer claims a slot by compare-and-swap on the
+ * head, copies its record in and then publishes the slot through its sequence number, so producers never wait for
+ * each other to finish copying. The consumer reads a slot once its sequence says it's published. All N slots are used.
+ * A push to a full ring is refused and counted as an overrun, like spscRing (SpscRing.h).
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <atomic>
+#include <stdint.h>
+
+#include "SpscRing.h" /**< spscRingStats. */
+
+/**
+ * @brief Lock-free ring of N records of type T. push() can be called from anywhere, pop() from one task at a time.
+ * @tparam T Record type, copied in and out.
+ * @tparam N Number of slots, a power of 2 (at most 256).
+ */
+template <typename T, uint16_t N> class mpscRing {
+    static_assert((N >= 2) && (N <= 256) && ((N & (N - 1)) == 0), "N must be a power of 2 from 2 to 256");
+
+  public:
+    mpscRing() {
+        for (uint16_t i = 0; i < N; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Producer: adds a record.
+     * @return True if added, false if the ring is full (counted as an overrun).
+     */
+    bool push(const T &record) {
+        uint32_t head = head_index.load(std::memory_order_relaxed);
+        slot *claimed;
+        for (;;) {
+            claimed = &slots[head & (N - 1)];
+            int32_t lag = (int32_t)(claimed->sequence.load(std::memory_order_acquire) - head);
+            if (lag == 0) {
+                // free, try to claim it; on failure head is reloaded
+                if (head_index.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (lag < 0) {
+                // still holds a record from the last time round
+                overruns.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                // another producer got it first
+                head = head_index.load(std::memory_order_relaxed);
+            }
+        }
+        claimed->record = record;
+        claimed->sequence.store(head + 1, std::memory_order_release);
+        pushed.fetch_add(1, std::memory_order_relaxed);
+
+        uint16_t waiting = depth();
+        if (waiting > high_water.load(std::memory_order_relaxed)) {
+            high_water.store(waiting, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Consumer: takes the oldest record.
+     * @return True if a record was taken, false if the ring is empty (or the oldest is still being written).
+     */
+    bool pop(T *record) {
+        uint32_t tail = tail_index.load(std::memory_order_relaxed);
+        slot *oldest = &slots[tail & (N - 1)];
+        if ((int32_t)(oldest->sequence.load(std::memory_order_acquire) - (tail + 1)) < 0) {
+            return false;
+        }
+        *record = oldest->record;
+        // free for the producers' next time round
+        oldest->sequence.store(tail + N, std::memory_order_release);
+        tail_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Records waiting (including any being written), a snapshot.
+     */
+    uint16_t depth(void) const {
+        uint32_t waiting = head_index.load(std::memory_order_acquire) - tail_index.load(std::memory_order_acquire);
+        return (waiting > N) ? N : (uint16_t)waiting;
+    }
+
+    /**
+     * @brief Most records this ring can hold.
+     */
+    static constexpr uint16_t capacity(void) { return N; }
+
+    /**
+     * @brief Fills stats with the counters.
+     */
+    void stats(spscRingStats *stats) const {
+        stats->depth = depth();
+        stats->high_water = high_water.load(std::memory_order_relaxed);
+        stats->pushed = pushed.load(std::memory_order_relaxed);
+        stats->overruns = overruns.load(std::memory_order_relaxed);
+    }
+
+  private:
+    struct slot {
+        std::atomic<uint32_t> sequence; // head value that may claim it, +1 once published
+        T record;
+    };
+    slot slots[N];
+    std::atomic<uint32_t> head_index{ 0 }; // next slot to claim, shared by the producers
+    std::atomic<uint32_t> tail_index{ 0 }; // next slot to read, only written by the consumer
+    std::atomic<uint16_t> high_water{ 0 };
+    std::atomic<uint32_t> pushed{ 0 };
+    std::atomic<uint32_t> overruns{ 0 };
+};
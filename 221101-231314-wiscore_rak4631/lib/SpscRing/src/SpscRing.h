@@ -0,0 +1,103 @@
+#pragma once
+/**
+ * @file SpscRing.h
+ * @brief Lock-free single-producer/single-consumer ring buffer, for handing records from one task to another without
+ * a mutex or disabling interrupts.
+ *
+ * Only the producer writes head and only the consumer writes tail, so each index is published with a release store
+ * and read with an acquire load and no other synchronisation is needed. One slot is kept empty to tell full from
+ * empty, so a ring holds N - 1 records. A push to a full ring is refused and counted as an overrun; the producer
+ * decides what to do with the record.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <atomic>
+#include <stdint.h>
+
+/** @brief Ring counters for telemetry. */
+struct spscRingStats {
+    uint16_t depth;      /**< Records waiting now. */
+    uint16_t high_water; /**< Most records that have been waiting at once. */
+    uint32_t pushed;     /**< Records pushed. */
+    uint32_t overruns;   /**< Records refused because the ring was full. */
+};
+
+/**
+ * @brief Lock-free ring of N - 1 records of type T. push() must only be called from one task and pop() from one other.
+ * @tparam T Record type, copied in and out.
+ * @tparam N Number of slots, a power of 2 (at most 256).
+ */
+template <typename T, uint16_t N> class spscRing {
+    static_assert((N >= 2) && (N <= 256) && ((N & (N - 1)) == 0), "N must be a power of 2 from 2 to 256");
+
+  public:
+    /**
+     * @brief Producer: adds a record.
+     * @return True if added, false if the ring is full (counted as an overrun).
+     */
+    bool push(const T &record) {
+        uint16_t head = head_index.load(std::memory_order_relaxed);
+        uint16_t next = (head + 1) & (N - 1);
+        if (next == tail_index.load(std::memory_order_acquire)) {
+            overruns.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots[head] = record;
+        head_index.store(next, std::memory_order_release);
+        pushed.fetch_add(1, std::memory_order_relaxed);
+
+        uint16_t depth = (next - tail_index.load(std::memory_order_acquire)) & (N - 1);
+        if (depth > high_water.load(std::memory_order_relaxed)) {
+            high_water.store(depth, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Consumer: takes the oldest record.
+     * @return True if a record was taken, false if the ring is empty.
+     */
+    bool pop(T *record) {
+        uint16_t tail = tail_index.load(std::memory_order_relaxed);
+        if (tail == head_index.load(std::memory_order_acquire)) {
+            return false;
+        }
+        *record = slots[tail];
+        tail_index.store((tail + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Records waiting. Exact from either side, a snapshot from anywhere else.
+     */
+    uint16_t depth(void) const {
+        return (head_index.load(std::memory_order_acquire) - tail_index.load(std::memory_order_acquire)) & (N - 1);
+    }
+
+    /**
+     * @brief Most records this ring can hold.
+     */
+    static constexpr uint16_t capacity(void) { return N - 1; }
+
+    /**
+     * @brief Fills stats with the counters.
+     */
+    void stats(spscRingStats *stats) const {
+        stats->depth = depth();
+        stats->high_water = high_water.load(std::memory_order_relaxed);
+        stats->pushed = pushed.load(std::memory_order_relaxed);
+        stats->overruns = overruns.load(std::memory_order_relaxed);
+    }
+
+  private:
+    T slots[N];
+    std::atomic<uint16_t> head_index{ 0 }; // next slot to write, only written by the producer
+    std::atomic<uint16_t> tail_index{ 0 }; // next slot to read, only written by the consumer
+    std::atomic<uint16_t> high_water{ 0 };
+    std::atomic<uint32_t> pushed{ 0 };
+    std::atomic<uint32_t> overruns{ 0 };
+};
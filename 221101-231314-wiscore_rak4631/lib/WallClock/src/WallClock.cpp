@@ -0,0 +1,142 @@
+#include "WallClock.h"
+
+#define CLOCK_DRIFT_GAIN 0.5f // weight of a new drift measurement once there is an estimate
+
+uint64_t wallClock::localNow(uint32_t local_ms) {
+    local_extended += (uint32_t)(local_ms - local_last);
+    local_last = local_ms;
+    return local_extended;
+}
+
+uint64_t wallClock::estimate(uint64_t local) const {
+    int64_t elapsed = (int64_t)(local - base_local);
+    return base_unix_ms + elapsed - (int64_t)((double)elapsed * drift_ppm * 1e-6);
+}
+
+uint64_t wallClock::nowMs(uint32_t local_ms) {
+    uint64_t now = estimate(localNow(local_ms));
+    if (now < last_returned_ms) {
+        return last_returned_ms;
+    }
+    last_returned_ms = now;
+    return now;
+}
+
+uint32_t wallClock::nowSeconds(uint32_t local_ms) {
+    return (uint32_t)(nowMs(local_ms) / 1000);
+}
+
+int64_t wallClock::sync(uint64_t unix_ms, uint32_t local_ms) {
+    uint64_t local = localNow(local_ms);
+    int64_t correction = 0;
+    if (synced) {
+        correction = (int64_t)(unix_ms - estimate(local));
+        int64_t span = (int64_t)(local - base_local);
+        if (span >= (int64_t)CLOCK_DRIFT_MIN_SPAN_MS) {
+            // the estimate already includes drift_ppm, so the correction is what's left over (behind if fast)
+            float residual_ppm = (float)((double)-correction * 1e6 / (double)span);
+            drift_ppm += (drift_ppm == 0) ? residual_ppm : CLOCK_DRIFT_GAIN * residual_ppm;
+            drift_ppm = (drift_ppm > CLOCK_MAX_DRIFT_PPM) ? CLOCK_MAX_DRIFT_PPM : drift_ppm;
+            drift_ppm = (drift_ppm < -CLOCK_MAX_DRIFT_PPM) ? -CLOCK_MAX_DRIFT_PPM : drift_ppm;
+        }
+    } else {
+        // uptime until now, so any backwards hold from before is meaningless
+        last_returned_ms = 0;
+    }
+    base_local = local;
+    base_unix_ms = unix_ms;
+    synced = true;
+    return correction;
+}
+
+uint32_t wallClock::msUntilNextSlot(uint32_t local_ms, uint32_t interval_ms, uint32_t lead_ms) {
+    if (!synced || (interval_ms == 0)) {
+        return interval_ms;
+    }
+    lead_ms = (lead_ms < interval_ms / 2) ? lead_ms : interval_ms / 2;
+    uint32_t tolerance_ms = (CLOCK_SLOT_TOLERANCE_MS < interval_ms / 4) ? CLOCK_SLOT_TOLERANCE_MS : interval_ms / 4;
+    uint64_t now = nowMs(local_ms);
+    // the first slot whose wake up is more than the tolerance away, so waking a little early doesn't repeat a slot
+    uint64_t slot = ((now + lead_ms + tolerance_ms) / interval_ms + 1) * interval_ms;
+    uint64_t wait_ms = slot - lead_ms - now;
+    return (uint32_t)((double)wait_ms * (1.0 + drift_ppm * 1e-6));
+}
+
+bool wallClock::syncDue(uint32_t local_ms) {
+    if (request_sent && ((uint32_t)(local_ms - request_local_ms) < CLOCK_SYNC_RETRY_MS)) {
+        return false;
+    }
+    return !synced || ((localNow(local_ms) - base_local) >= CLOCK_SYNC_INTERVAL_MS);
+}
+
+uint8_t wallClock::encodeRequest(uint8_t *buffer, uint32_t local_ms, uint32_t airtime_ms) {
+    uint64_t now = nowMs(local_ms);
+    uint32_t seconds = (uint32_t)(now / 1000);
+    uint16_t ms = (uint16_t)(now % 1000);
+    request_token++;
+    request_sent = true;
+    request_local_ms = local_ms + airtime_ms;
+
+    buffer[0] = CLOCK_SYNC_VERSION;
+    buffer[1] = request_token;
+    buffer[2] = (uint8_t)(seconds >> 24);
+    buffer[3] = (uint8_t)(seconds >> 16);
+    buffer[4] = (uint8_t)(seconds >> 8);
+    buffer[5] = (uint8_t)seconds;
+    buffer[6] = (uint8_t)(ms >> 8);
+    buffer[7] = (uint8_t)ms;
+    return CLOCK_SYNC_REQUEST_SIZE;
+}
+
+bool wallClock::handleAnswer(const uint8_t *buffer, uint8_t size) {
+    if ((size != CLOCK_SYNC_ANSWER_SIZE) || (buffer[0] != CLOCK_SYNC_VERSION) || !request_sent ||
+        (buffer[1] != request_token)) {
+        return false;
+    }
+    uint32_t seconds =
+        ((uint32_t)buffer[2] << 24) | ((uint32_t)buffer[3] << 16) | ((uint32_t)buffer[4] << 8) | buffer[5];
+    uint16_t ms = ((uint16_t)buffer[6] << 8) | buffer[7];
+    if ((seconds < CLOCK_VALID_UNIX_S) || (ms >= 1000)) {
+        return false;
+    }
+    answer_unix_ms = (uint64_t)seconds * 1000 + ms;
+    answer_local_ms = request_local_ms;
+    request_sent = false;
+    answer_ready = true;
+    return true;
+}
+
+bool wallClock::applyAnswer(uint32_t local_ms) {
+    if (!answer_ready) {
+        return false;
+    }
+    answer_ready = false;
+    bool first = !synced;
+    // the answer is the time when the request was received, carry it forward to now
+    int32_t since_request_ms = (int32_t)(local_ms - answer_local_ms);
+    since_request_ms = (since_request_ms > 0) ? since_request_ms : 0;
+    int64_t correction = sync(answer_unix_ms + since_request_ms, local_ms);
+    return first || (correction > CLOCK_STEP_TOLERANCE_MS) || (correction < -(int64_t)CLOCK_STEP_TOLERANCE_MS);
+}
+
+void wallClock::save(wallClockState *state, uint32_t local_ms) {
+    state->synced = synced;
+    state->drift_ppm = drift_ppm;
+    state->local_ms = localNow(local_ms);
+    state->base_local = base_local;
+    state->base_unix_ms = base_unix_ms;
+    state->last_returned_ms = last_returned_ms;
+}
+
+void wallClock::resume(const wallClockState *state, uint32_t asleep_ms, uint32_t local_ms) {
+    synced = state->synced;
+    drift_ppm = state->drift_ppm;
+    // the counter restarted at 0 on reset, so carry on from where it was plus the time asleep
+    local_extended = state->local_ms + asleep_ms + local_ms;
+    local_last = local_ms;
+    base_local = state->base_local;
+    base_unix_ms = state->base_unix_ms;
+    last_returned_ms = state->last_returned_ms;
+    request_sent = false;
+    answer_ready = false;
+}
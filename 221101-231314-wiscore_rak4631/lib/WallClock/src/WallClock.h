@@ -0,0 +1,163 @@
+#pragma once
+/**
+ * @file WallClock.h
+ * @brief Wall clock kept on the RTC driven millis(), synchronised over LoRaWAN, with drift estimation and a scheduler
+ * for sampling at absolute times.
+ *
+ * The device sends a time request on CLOCK_SYNC_PORT stamped with a token. The server answers with the time it received
+ * the request, and the clock is set to that time at the local time the request finished sending. The answer can arrive
+ * in any later downlink, so it doesn't have to make the RX1 window of the request. Each sync after the first also
+ * measures how far the local clock has drifted since the last one, and the drift is corrected between syncs.
+ *
+ * Until the first sync the clock counts from boot (uptime), so timestamps are always available; isSynced() says which.
+ * The clock never goes backwards: after a backwards correction it holds until real time catches up.
+ *
+ * Only handleAnswer() runs in the LoRaWAN RX callback; everything else is called from the application's tasks, one at a
+ * time. The clock doesn't lock: the caller serialises handleAnswer() with syncDue(), encodeRequest() and applyAnswer(),
+ * which share the request & answer with it (main.cpp holds clock_mutex for these). answerPending() may be read
+ * without the lock.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#define CLOCK_SYNC_PORT           204                  /**< Port for time requests & answers (200-222 are system). */
+#define CLOCK_SYNC_VERSION        1                    /**< Version of the request & answer formats. */
+#define CLOCK_SYNC_REQUEST_SIZE   8                    /**< [version][token][device time s (4 bytes)][ms (2 bytes)]. */
+#define CLOCK_SYNC_ANSWER_SIZE    8                    /**< [version][token][server time s (4 bytes)][ms (2 bytes)]. */
+#define CLOCK_SYNC_INTERVAL_MS    (12UL * 60 * 60 * 1000) /**< Time between syncs once synced. */
+#define CLOCK_SYNC_RETRY_MS       (10UL * 60 * 1000)   /**< Time before an unanswered request is sent again. */
+#define CLOCK_DRIFT_MIN_SPAN_MS   (60UL * 60 * 1000)   /**< Syncs closer together than this don't update the drift. */
+#define CLOCK_MAX_DRIFT_PPM       500                  /**< Drift estimates are clamped to +/- this. */
+#define CLOCK_STEP_TOLERANCE_MS   1000                 /**< Corrections bigger than this count as a step. */
+#define CLOCK_SLOT_TOLERANCE_MS   1000                 /**< A wake up this early still counts as its slot. */
+#define CLOCK_VALID_UNIX_S        1577836800UL         /**< 2020-01-01, server times before this are rejected. */
+
+/** @brief What a wallClock needs to carry on after a reset, e.g. across System OFF (see DeepSleep.h). */
+struct wallClockState {
+    bool synced;
+    float drift_ppm;
+    uint64_t local_ms;         /**< Local ms (without the wrap) when saved. */
+    uint64_t base_local;       /**< Local ms of the last sync. */
+    uint64_t base_unix_ms;     /**< Time at base_local. */
+    uint64_t last_returned_ms; /**< Latest time returned, so the clock still never goes backwards. */
+};
+
+/**
+ * @brief Wall clock in Unix time, derived from a free running millisecond counter that wraps (millis()).
+ */
+class wallClock {
+  public:
+    /**
+     * @brief True once the clock has been synchronised, so nowMs() is Unix time rather than uptime.
+     */
+    inline bool isSynced(void) const { return synced; };
+
+    /**
+     * @brief Current time.
+     * @param local_ms The millisecond counter, e.g. millis(). Must be called at least every 24 days.
+     * @return Unix time in ms if synced, otherwise ms since boot.
+     */
+    uint64_t nowMs(uint32_t local_ms);
+
+    /**
+     * @brief nowMs() in seconds.
+     */
+    uint32_t nowSeconds(uint32_t local_ms);
+
+    /**
+     * @brief Sets the clock, and updates the drift estimate if it was already synced.
+     * @param unix_ms Unix time in ms at local_ms.
+     * @param local_ms The millisecond counter at that time.
+     * @return The correction made in ms (new - old time), 0 for the first sync.
+     */
+    int64_t sync(uint64_t unix_ms, uint32_t local_ms);
+
+    /**
+     * @brief Estimated drift of the local clock, positive if it runs fast.
+     */
+    inline float driftPpm(void) const { return drift_ppm; };
+
+    /**
+     * @brief Local ms until the next sampling slot, so that sampling is aligned to absolute times: slots are the
+     * multiples of interval_ms in Unix time (e.g. on the minute for 60000). Until synced this is just interval_ms.
+     * @param local_ms The millisecond counter now.
+     * @param interval_ms Time between slots.
+     * @param lead_ms How long before the slot to wake, e.g. to power up the sensors.
+     * @return Delay in local ms, drift corrected. Called mid cycle, this is the rest of the cycle.
+     */
+    uint32_t msUntilNextSlot(uint32_t local_ms, uint32_t interval_ms, uint32_t lead_ms);
+
+    /**
+     * @brief True if a time request should be sent: not synced or CLOCK_SYNC_INTERVAL_MS since the last sync, and no
+     * request sent in the last CLOCK_SYNC_RETRY_MS.
+     */
+    bool syncDue(uint32_t local_ms);
+
+    /**
+     * @brief Encodes a time request and remembers when it was sent.
+     * @param buffer Buffer of at least CLOCK_SYNC_REQUEST_SIZE bytes.
+     * @param local_ms The millisecond counter just before sending.
+     * @param airtime_ms Time on air of the request; the server stamps it when it has been received.
+     * @return CLOCK_SYNC_REQUEST_SIZE.
+     */
+    uint8_t encodeRequest(uint8_t *buffer, uint32_t local_ms, uint32_t airtime_ms);
+
+    /**
+     * @brief Parses a time answer downlink. Called from the LoRaWAN RX callback, so only stores the answer; see
+     * applyAnswer().
+     * @return True if it answers the last request.
+     */
+    bool handleAnswer(const uint8_t *buffer, uint8_t size);
+
+    /**
+     * @brief Syncs the clock to a stored answer, if there is one.
+     * @param local_ms The millisecond counter now.
+     * @return True if the clock was stepped by more than CLOCK_STEP_TOLERANCE_MS (including the first sync), so
+     * timestamps before and after shouldn't be mixed.
+     */
+    bool applyAnswer(uint32_t local_ms);
+
+    /**
+     * @brief True if a time answer is waiting for applyAnswer().
+     */
+    inline bool answerPending(void) const { return answer_ready; };
+
+    /**
+     * @brief Saves the clock, so it can be resumed after a reset. An unanswered time request isn't kept.
+     * @param state Filled with the clock.
+     * @param local_ms The millisecond counter now.
+     */
+    void save(wallClockState *state, uint32_t local_ms);
+
+    /**
+     * @brief Carries on from a saved clock after a reset, as if the local counter had kept running.
+     * @param state From save().
+     * @param asleep_ms Local ms from save() until the reset (e.g. a timed System OFF), drift is corrected as usual.
+     * @param local_ms The millisecond counter now, i.e. the ms since the reset.
+     */
+    void resume(const wallClockState *state, uint32_t asleep_ms, uint32_t local_ms);
+
+  private:
+    uint64_t localNow(uint32_t local_ms);
+    uint64_t estimate(uint64_t local) const;
+
+    bool synced = false;
+    float drift_ppm = 0;
+    uint64_t local_extended = 0;   // local ms since boot, without the wrap
+    uint32_t local_last = 0;       // counter at the last localNow()
+    uint64_t base_local = 0;       // local ms of the last sync
+    uint64_t base_unix_ms = 0;     // time at base_local
+    uint64_t last_returned_ms = 0; // so the clock never goes backwards
+
+    uint8_t request_token = 0;
+    bool request_sent = false;
+    uint32_t request_local_ms = 0; // counter when the request finished sending
+    volatile bool answer_ready = false;
+    uint64_t answer_unix_ms = 0;
+    uint32_t answer_local_ms = 0;
+};
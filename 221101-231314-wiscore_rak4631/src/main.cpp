@@ -12,142 +12,549 @@
 #include <Arduino.h>
 #include <LoRaWan-RAK4630.h> // Click to get library: https://platformio.org/lib/show/6601/SX126x-Arduino
 
+#include "BootTimeline.h"   /**< When each boot phase finished, reported in the first uplink. */
+#include "DeepSleep.h"      /**< System OFF between long intervals, resuming from retained RAM. */
+#include "DeviceConfig.h"   /**< Settings that can be changed by downlink. */
+#include "EventMode.h"      /**< Normal/switch/active mode logic. */
+#include "FlashLog.h"       /**< Logs kept on flash, for when nothing is on Serial. */
+#include "History.h"        /**< Flash history of reading summaries that can be backfilled by downlink. */
 #include "LoRaWAN_functs.h" /**< Go here to change the LoRaWAN settings. */
 #include "Logging.h"        /**< Go here to change the logging level for the entire application. */
 #include "OTAA_keys.h"      /**< Go here to set the OTAA keys (See LoRaWAN_functs README). */
+#include "Outbox.h"         /**< Store-and-forward queue for frames that couldn't be sent. */
+#include "PortRotation.h"   /**< Rotates between ports so expensive data is only sent every Nth frame. */
 #include "PortSchema.h"     /**< Go here to see existing and define new sensor/port schemas. */
 #include "SensorHelper.h"   /**< Go here to add code for init-ing and reading new additional sensors. */
-#include "timer.h"         /** Adds sensor on off functions*/
+#include "Sequencer.h"        /**< Cooperative sequences, so waits don't block a task. */
+#include "SeriesCompression.h" /**< Compresses quiet period turbidity readings into breakpoints. */
+#include "SpscRing.h"        /**< Hands readings from the acquisition task to the radio task. */
+#include "WallClock.h"      /**< Network synchronised wall clock & absolute sampling schedule. */
+
+// DEVICE CONFIG - loaded from flash in setup(), changed by downlinks on DEVICE_CONFIG_PORT
+deviceConfig device_config = DEFAULT_DEVICE_CONFIG; /**< Intervals, trigger, sample count, port & TX power. */
+// forward declarations
+static void handleDownlink(uint8_t port, const uint8_t *buffer, uint8_t size);
+static void applyDeviceConfig(void);
+static void addDeviceConfigAck(void);
 
 // APP TIMER
-int lorawan_app_interval = 60000; /**< App payloadTimer interval value in [ms] = 5mins. */
+int lorawan_app_interval = 60000; /**< App payloadTimer interval value in [ms], set from device_config in setup(). */
 SoftwareTimer payloadTimer;              /**< payloadTimer to wakeup task and send payload. */
+#define SENSOR_WARMUP_MS SENSOR_RAIL_WARMUP_MS /**< Time the sensors are powered before a reading. */
 // forward declarations
 static void appTimerInit(void);
 static void appTimerTimeoutHandler(TimerHandle_t unused);
+static void scheduleNextCycle(void);
+
+// WALL CLOCK - see WallClock.h
+// Synchronised by a time request on CLOCK_SYNC_PORT. Once synced, readings are taken on multiples of the interval in
+// Unix time (payloadTimer wakes SENSOR_WARMUP_MS before) and timestamps are Unix time; before that they're uptime.
+wallClock wall_clock; /**< Used with radio_mutex held; answers arrive via handleDownlink(), see clock_mutex. */
+// forward declarations
+static bool applyClockAnswer(void);
+static void syncWallClock(void);
+static uint32_t timestampSeconds(void);
 
-// POWER SAVING - see README for further details on Semaphores & low power mode
-// TODO: not sure about pdFalse
-static SemaphoreHandle_t semaphore_handle = NULL; /**< Semaphore used by events to wake up loop task. */
-enum class EVENT_TASK {
-    SLEEP,        /**< Use semaphore take to "sleep" in a low power state. */
-    SEND_PAYLOAD, /**< Send a sensor reading payload. */
-    // ACTIVE_MODE,  /**< high rate of measurement due to turbidity trigger */
-    // NORMAl_MODE,   /**< normal rate of measurment */
+// TASKS - see README for further details on Semaphores & low power mode
+// Readings are taken by the acquisition task and sent by the loop task (the radio task), so sampling keeps to the
+// schedule while the radio is sending, waiting for RX windows or retrying. Each reading is passed on as a readingRecord
+// through reading_ring. radio_mutex is held while the LoRaMac stack, device_config or port_rotation are used, as
+// neither is safe to use from two tasks; the acquisition task never holds it while warming up or reading the sensors.
+// The RX callback doesn't take it: what it shares with the tasks has its own lock (clock_mutex for wall_clock).
+// Both tasks block on a semaphore between events, which lets the device 'sleep' in low power mode. The acquisition
+// cycle is a sequence (see Sequencer.h), so the sensor warm-up and the turbidity burst are waits on the semaphore too.
+#define ACQUISITION_STACK_WORDS 1024 /**< Stack of the acquisition task, in 32 bit words. */
+#define READING_RING_SLOTS 8         /**< Readings that can wait for the radio task is one less than this. */
+static SemaphoreHandle_t semaphore_handle = NULL;       /**< Semaphore used by events to wake up loop task. */
+static SemaphoreHandle_t acquisition_semaphore = NULL;  /**< Semaphore that wakes the acquisition task. */
+static SemaphoreHandle_t radio_mutex = NULL;            /**< Held while using LoRaMac, device_config or port_rotation. */
+static SemaphoreHandle_t clock_mutex = NULL;            /**< Held while wall_clock's time request & answer are used. */
+static TaskHandle_t acquisition_task_handle = NULL;     /**< The acquisition task, created in setup(). */
+/** @brief A reading handed from the acquisition task to the radio task. */
+struct readingRecord {
+    uint32_t time_s;      /**< Wall clock time of the reading, see timestampSeconds(). */
+    uint32_t taken_ms;    /**< millis() when the reading was pushed, to measure queue latency. */
+    uint8_t due_mask;     /**< Rotation entries read for this frame, see portRotation::dueMask(). */
+    bool alert;           /**< Turbidity event under way, send as OUTBOX_PRIORITY::ALERT. */
+    bool clock_stepped;   /**< The wall clock was stepped since the last reading, restart the compressor. */
+    sensorData data;      /**< The sensor data. */
 };
-static EVENT_TASK current_task = EVENT_TASK::SLEEP; /**< Current task of the device, similar to a finite state machine
-                                                       design. Used in loop() to switch between tasks. */
-enum class EVENT_MODE {
-    ACTIVE_MODE,
-    NORMAL_MODE,
-    SWITCH_MODE,
+/** @brief One acquisition cycle, run by the acquisition task. See acquisitionCycle::body(). */
+class acquisitionCycle : public sequence {
+  protected:
+    bool body(uint32_t now_ms) override;
+
+  private:
+    sensorReading sensor_reading;
+    portSchema frame_port = {};
+    readingRecord record = {};
+    bool clock_stepped = false; // kept until a reading carrying it gets through the ring
+    uint32_t warm_ms = 0;       // until the sensor rails are warm
 };
-static EVENT_MODE current_mode = EVENT_MODE::NORMAL_MODE;
+static acquisitionCycle acquisition_cycle;                       /**< The reading being taken. */
+static sequencer acquisition_sequencer;                          /**< Runs acquisition_cycle. */
+static volatile bool reading_requested = false;                  /**< Set by payloadTimer for the acquisition task. */
+static spscRing<readingRecord, READING_RING_SLOTS> reading_ring; /**< Acquisition task -> radio task. */
+static volatile bool backfill_due = false;                       /**< Set by backfillTimer for the radio task. */
+static volatile uint32_t timer_fired_ms = 0;                     /**< When payloadTimer last fired. */
+static uint32_t max_wake_latency_ms = 0;  /**< Longest from payloadTimer firing to a reading starting. */
+static uint32_t max_queue_latency_ms = 0; /**< Longest a reading waited in reading_ring. */
+// forward declarations
+static void acquisitionTask(void *unused);
+static void sendReading(readingRecord *record);
+static void logPipelineCounters(void);
+
+// EVENT MODE - see EventMode.h
+static eventMode event_mode(DEFAULT_DEVICE_CONFIG.active_cycles); /**< Only used from the acquisition task. */
+// forward declaration
+static void advanceMode(void);
+
+// EVENT DETECTION - see ChangeDetector.h
+// Learns the site's normal turbidity & noise, and signals RISING when readings climb away from it (or stay above
+// device_config.trigger_ntu). That switches to active mode, which then lasts until active_cycles readings in a row
+// aren't elevated.
+changeDetector turbidity_detector(DEFAULT_DEVICE_CONFIG.detector_slack_dsigma / 10.0f,
+                                  DEFAULT_DEVICE_CONFIG.detector_threshold_dsigma / 10.0f,
+                                  DEFAULT_DEVICE_CONFIG.trigger_ntu);
+// forward declaration
+static void configureDetector(void);
 // PAYLOAD ENCODING
 uint8_t payload_buffer[PAYLOAD_BUFFER_SIZE] = {};                /**< Buffer that payload data is placed in. */
 lmh_app_data_t lorawan_payload = { payload_buffer, 0, 0, 0, 0 }; /**< Struct that passes the payload buffer and relevant
                                                                     params for a LoRaWAN frame. */
 // forward declaration
-void fillPayload(void);
+void fillPayload(readingRecord *record);
+
+// STORE-AND-FORWARD
+Outbox outbox;                                                   /**< Frames waiting to be sent, kept in flash. */
+uint8_t outbox_buffer[PAYLOAD_BUFFER_SIZE] = {};                 /**< Buffer the outbox builds its uplinks in. */
+lmh_app_data_t outbox_frame = { outbox_buffer, 0, 0, 0, 0 };     /**< Frame the outbox drains into. */
+// forward declaration
+bool sendPayload(OUTBOX_PRIORITY priority);
+
+// HISTORY & BACKFILL - see History.h & FlashLog.h
+// A summary of every reading is kept in flash. A request on HISTORY_PORT sends back a time range, one fragment every
+// HISTORY_BACKFILL_INTERVAL_MS. Fragments go straight out, if one can't be sent it's tried again on the next tick.
+// A request on FLASH_LOG_PORT sends back the flash log the same way, once any history backfill is done.
+History history;                                                 /**< Summaries of past readings, kept in flash. */
+SoftwareTimer backfillTimer;                                     /**< Wakes the loop to send backfill fragments. */
+uint8_t backfill_buffer[PAYLOAD_BUFFER_SIZE] = {};               /**< Buffer backfill fragments are built in. */
+lmh_app_data_t backfill_frame = { backfill_buffer, 0, 0, 0, 0 }; /**< Frame for backfill fragments. */
+// forward declarations
+static void backfillTimerHandler(TimerHandle_t unused);
+static void sendBackfillFragment(void);
+static inline uint16_t clampNTU(uint32_t ntu) { return (ntu > 0xFFFF) ? 0xFFFF : ntu; }
 
 // PORT/SENSOR SELECTION
-// The chosen port determines the sensor data included in the payload - see PortSchema.h
-static portSchema payload_port = PORT10; /**< Frame data port. E.g. port 3: battery voltage + temperature */
+// The chosen ports determine the sensor data included in the payload - see PortSchema.h & PortRotation.h
+// The first entry is the base port sent every frame (set by device_config.payload_port), the others are only read & sent
+// every Nth frame or after a time, e.g. { PORT7, 6, 0 } = every 6th frame.
+static const bool USE_RAK1906 = false; /**< Set to true if a RAK1906 is fitted; the environmental ports need it. */
+static const portRotationEntry rotation_schedule[] = {
+    { PORT10, 1, 0 },                   // battery & turbidity every frame
+    { PORT7, 6, 0 },                    // + temperature, humidity & pressure every 6th frame
+    { PORT9, 0, 24UL * 60 * 60 * 1000 } // + gas resistance once a day (PORT59 would add location, but there's no GPS)
+};
+static portRotation port_rotation(rotation_schedule, USE_RAK1906 ? 3 : 1); /**< Ports sent each frame. */
+static const bool USE_PRESENCE_BITMAP = true; /**< Leave invalid & unchanged fields out - see PresenceBitmap.h. */
+
+// QUIET PERIOD COMPRESSION - see SeriesCompression.h
+// In normal mode, frames that only contain the base port aren't sent. The turbidity readings are compressed into
+// breakpoints instead, and a series frame (SERIES_FRAME_PORT) is sent once it's full or SERIES_MAX_HOLD_MS has passed.
+// Set device_config.compression_dntu to 0 to send every reading.
+#define SERIES_MAX_HOLD_MS (60UL * 60 * 1000) /**< Max time a reading is held before a series frame is sent anyway. */
+swingingDoorCompressor turbidity_compressor(DEFAULT_DEVICE_CONFIG.compression_dntu / 10.0f);
+uint32_t last_series_frame_ms = 0; /**< When the last series frame was sent. */
+// forward declarations
+static bool compressQuietReading(const readingRecord *record);
+static void flushCompressedReadings(OUTBOX_PRIORITY priority);
+
+// DEEP SLEEP - see DeepSleep.h
+// If USE_DEEP_SLEEP is set and a wake timer is registered (setDeepSleepWakeTimer()), the device sleeps in System OFF
+// through long normal mode gaps instead of idling. It only does so DEEP_SLEEP_SETTLE_MS after a cycle (once the RX
+// windows are over) with nothing in flight that only lives in RAM; the outbox, history & session are in flash. On wake
+// resume_state restores the wall clock, detector, port rotation, airtime ledger & compressor, and setup() doesn't hold
+// the logs for Serial and skips the join.
+static const bool USE_DEEP_SLEEP = false; /**< Needs a wake timer (e.g. a RAK12002 alarm), off until one is fitted. */
+#define DEEP_SLEEP_MIN_MS        (15UL * 60 * 1000) /**< Shorter gaps idle instead, a reboot isn't worth it. */
+#define DEEP_SLEEP_SETTLE_MS     5000               /**< Time after a cycle for its RX windows & downlinks. */
+#define DEEP_SLEEP_WAKE_EARLY_MS 2000               /**< Wake this long before payloadTimer would have, to boot. */
+/** @brief State kept in retained RAM through deep sleep. */
+struct resumeState {
+    uint32_t asleep_ms;           /**< How long the wake timer was set for. */
+    uint32_t deep_sleeps;         /**< Deep sleeps since a cold boot. */
+    uint32_t series_held_ms;      /**< Time since the last series frame was sent. */
+    wallClockState clock;         /**< See wallClock::save(). */
+    changeDetectorState detector; /**< See changeDetector::save(). */
+    portRotationState rotation;   /**< See portRotation::save(). */
+    airtimeLedgerState airtime;   /**< See saveLoRaWANAirtime(). */
+    seriesCompressorState series; /**< See swingingDoorCompressor::save(). */
+};
+static_assert(sizeof(resumeState) <= RETAINED_BLOCK_SIZE, "resumeState doesn't fit in retained RAM");
+static resumeState resume_state = {};        /**< Filled on the way into deep sleep and out of it. */
+static bool resumed = false;                 /**< True if this boot woke from deep sleep with its state. */
+SoftwareTimer deepSleepTimer;                /**< One-shot, wakes the radio task to check for deep sleep. */
+static volatile bool deep_sleep_check = false; /**< Set by deepSleepTimer for the radio task. */
+static uint32_t next_cycle_ms = 0;           /**< millis() when payloadTimer fires next. */
+static uint32_t boot_to_ready_ms = 0;        /**< millis() at the end of setup(), logged at INFO. */
+// forward declarations
+static void deepSleepTimerHandler(TimerHandle_t unused);
+static void tryDeepSleep(void);
+
+// BOOT TIMELINE - see BootTimeline.h
+// setup() only does what the join needs before starting it: Serial isn't waited for (the drain task holds the logs
+// instead) and the sensors are initialised by the acquisition task, while the join accept is on its way. Each phase is
+// marked as it finishes. With the first reading after a cold boot the timeline is logged and a boot report is queued on
+// BOOT_REPORT_PORT, and that reading is sent rather than compressed, so the report goes up in the first uplink.
+#define BOOT_REPORT_ON_RESUME false /**< Report deep sleep wakes too, not only cold boots (logged either way). */
+static_assert(BOOT_TIMELINE_MAX_LENGTH <= OUTBOX_MAX_FRAME_LENGTH, "boot report doesn't fit in the outbox");
+static bootTimeline boot_timeline;  /**< Marked by setup(), the acquisition task & the radio task. */
+static bool boot_reported = false;  /**< The first reading has been through, only used by the radio task. */
+static bool sensors_ready = false;  /**< initSensors() worked, only used by the acquisition task. */
+// forward declarations
+static bool initRequiredSensors(void);
+static bool reportBoot(void);
 
-#define LORAWAN_10_TX_POWER TX_POWER_10
 /**
  * @brief Setup code runs once on reset/startup.
  */
 void setup() {
+    // waking from deep sleep is a reset, see if there's state to carry on from
+    resumed = USE_DEEP_SLEEP && takeDeepSleepState(&resume_state, sizeof(resume_state));
+    boot_timeline.start(resumed, readResetReason());
     // initialise the logging module - function does nothing if APP_LOG_LEVEL in Logging.h = NONE
-    initLogging();
-    log(LOG_LEVEL::INFO,
+    // doesn't wait for Serial, the logs are held for it unless waking from deep sleep
+    initLogging(!resumed);
+    boot_timeline.mark(BOOT_PHASE::LOGGING, millis());
+    LOG_INFO(
         "\n============================================"
         "\nWelcome to Combined Library WisBlock Example"
         "\n============================================");
+    // keep the logs on flash too, and show what the last boots left there once Serial is connected
+    initFlashLog();
+    boot_timeline.mark(BOOT_PHASE::FLASH_LOG, millis());
 
-    // Sensor_on();
+    // all rails off until a sensor acquires them
+    initPowerRails();
 
-    // Create the semaphore that will enable low power 'sleep'
+    // Create the semaphores that will enable low power 'sleep', and the mutex around the radio
     semaphore_handle = xSemaphoreCreateBinary();
+    acquisition_semaphore = xSemaphoreCreateBinary();
+    radio_mutex = xSemaphoreCreateMutex();
+    clock_mutex = xSemaphoreCreateMutex();
 
-    // Init sensors according to payload_port selected
-    // Neither 1901 or 1906 is needed for PORT1
-    if (!initSensors(&payload_port, false, false)) {
-        // error init-ing sensors
-        delay(1000);
-        return;
+    // Load the settings last set by downlink (or the defaults)
+    loadDeviceConfig(&device_config);
+    portSchema base_port;
+    if (findPortSchema(device_config.payload_port, &base_port)) {
+        port_rotation.setBasePort(&base_port);
+    }
+    port_rotation.setPresenceBitmap(USE_PRESENCE_BITMAP);
+    setTurbiditySamples(device_config.turbidity_samples);
+    turbidity_compressor.setErrorBound(device_config.compression_dntu / 10.0f);
+    configureDetector();
+    event_mode.configure(device_config.active_cycles);
+    lorawan_app_interval = device_config.normal_interval_ms;
+    if (resumed) {
+        // deep sleep is only entered in normal mode, so the event mode starts as it is after a cold boot
+        wall_clock.resume(&resume_state.clock, resume_state.asleep_ms, millis());
+        turbidity_detector.restore(&resume_state.detector);
+        port_rotation.resume(&resume_state.rotation, resume_state.asleep_ms);
+        resumeLoRaWANAirtime(&resume_state.airtime, resume_state.asleep_ms);
+        turbidity_compressor.restore(&resume_state.series);
+        last_series_frame_ms = 0 - resume_state.asleep_ms - resume_state.series_held_ms;
+        LOG_INFO("Resumed from deep sleep %lu: %lu s.", resume_state.deep_sleeps,
+            wall_clock.nowSeconds(millis()));
+    } else {
+        resume_state = {};
     }
+    boot_timeline.mark(BOOT_PHASE::CONFIG, millis());
 
     // Init payloadTimer
     appTimerInit();
 
-    // Init LoRaWAN
-    if (!initLoRaWAN(&payloadTimer, OTAA_KEY_APP_EUI, OTAA_KEY_DEV_EUI, OTAA_KEY_APP_KEY, LORAWAN_10_TX_POWER)) {
+    // Init LoRaWAN, before anything the join doesn't need
+    if (!initLoRaWAN(&payloadTimer, OTAA_KEY_APP_EUI, OTAA_KEY_DEV_EUI, OTAA_KEY_APP_KEY, device_config.tx_power)) {
         delay(1000);
         return;
     }
+    setLoRaWANDownlinkHandler(handleDownlink);
+    boot_timeline.mark(BOOT_PHASE::RADIO, millis());
 
-    // Attempt to join the network
+    // Attempt to join the network, the join accept takes seconds and the rest of the boot happens meanwhile
     startLoRaWANJoinProcedure();
+    if (resumed && isLoRaWANConnected()) {
+        // the session was restored & payloadTimer started, put it back on the schedule
+        scheduleNextCycle();
+    }
+    boot_timeline.mark(BOOT_PHASE::JOIN_STARTED, millis());
+
+    // Load any frames that were queued before the last reset
+    outbox.init();
+    history.init();
+    boot_timeline.mark(BOOT_PHASE::STORAGE, millis());
+
+    // Start the acquisition task, it initialises the sensors then waits for payloadTimer. It runs above the loop task
+    // so a reading is never held up by the radio.
+    if (xTaskCreate(acquisitionTask, "ACQ", ACQUISITION_STACK_WORDS, NULL, TASK_PRIO_NORMAL, &acquisition_task_handle) !=
+        pdPASS) {
+        LOG_ERROR("Acquisition task not created.");
+        delay(1000);
+        return;
+    }
 
-    // Go to 'sleep' now that setup is complete until an event task is triggered
-    current_task = EVENT_TASK::SLEEP;
+    boot_to_ready_ms = millis();
+    boot_timeline.mark(BOOT_PHASE::READY, boot_to_ready_ms);
+    LOG_INFO("Boot to ready: %lu ms (%s).", boot_to_ready_ms, resumed ? "resumed" : "cold");
+    // The loop task now 'sleeps' until there's a reading to send
 }
 
 /**
- * @brief Loop code runs repeated after setup().
+ * @brief Loop code runs repeated after setup(). This is the radio task: it sends every reading the acquisition task
+ * has queued, then a backfill fragment if one is due.
  */
 void loop() {
-    switch (current_task) {
-        case EVENT_TASK::SLEEP:
-            // Sleep until we are woken up by an event
-            Sensor_off();
-            log(LOG_LEVEL::DEBUG, "Semaphore sleep");
-            // This function call puts the device to 'sleep' in low power mode.
-            // The semaphore can only be taken once given in appTimerTimeoutHandler() (or another function).
-            // It will wait (up to portMAX_DELAY ticks) for the semaphore_handle semaphore to be given.
-            xSemaphoreTake(semaphore_handle, portMAX_DELAY);
-            // This point is only reached if the semaphore was able to be taken or the function timed out.
-            // If the semaphore was able to be taken, then the current_task should have been set before giving the
-            // semaphore. If xSemaphoreTake() timed out then the current_task has not changed and the switch-case will
-            // come back to EVENT_TASK::SLEEP and sleep again.
-            break;
-
-        // case EVENT_TASK::ACTIVE_MODE:
-        //     if (counter() == true) {
-        //     current_task = EVENT_TASK::SEND_PAYLOAD;
-        //     }
-        //     break;
-
-        // case EVENT_TASK::NORMAl_MODE:
-        //     // Sensor_on();
-        //     // lorawan_app_interval = 2 * 60 * 60 * 1000;
-        //     current_task = EVENT_TASK::SEND_PAYLOAD;
-        //     break;
-
-        case EVENT_TASK::SEND_PAYLOAD:
-            // do nothing if not connected
-            log(LOG_LEVEL::DEBUG,"lora wan : %d", lorawan_app_interval);
-            if (isLoRaWANConnected()) {
-                log(LOG_LEVEL::DEBUG, "Send payload");
-                // fill lora data buffer
-                fillPayload();
-                // send data
-                delay(1000);
-                sendLoRaWANFrame(&lorawan_payload);
-            } else {
-                log(LOG_LEVEL::DEBUG, "LoRaWAN not connected. Try again later.");
+    // Sleep until we are woken up by an event
+    LOG_DEBUG("Semaphore sleep");
+    // This function call puts the device to 'sleep' in low power mode.
+    // The semaphore can only be taken once given in acquisitionTask() or backfillTimerHandler().
+    // It will wait (up to portMAX_DELAY ticks) for the semaphore_handle semaphore to be given.
+    xSemaphoreTake(semaphore_handle, portMAX_DELAY);
+
+    readingRecord record;
+    bool sent_readings = false;
+    while (reading_ring.pop(&record)) {
+        sent_readings = true;
+        uint32_t queue_latency_ms = millis() - record.taken_ms;
+        if (queue_latency_ms > max_queue_latency_ms) {
+            max_queue_latency_ms = queue_latency_ms;
+        }
+        xSemaphoreTake(radio_mutex, portMAX_DELAY);
+        sendReading(&record);
+        xSemaphoreGive(radio_mutex);
+        logPipelineCounters();
+    }
+
+    if (backfill_due) {
+        backfill_due = false;
+        xSemaphoreTake(radio_mutex, portMAX_DELAY);
+        sendBackfillFragment();
+        xSemaphoreGive(radio_mutex);
+    }
+
+    if (USE_DEEP_SLEEP && sent_readings && deepSleepAvailable()) {
+        // check once the RX windows are over
+        deepSleepTimer.start();
+    }
+    if (deep_sleep_check) {
+        deep_sleep_check = false;
+        tryDeepSleep();
+    }
+}
+
+/**
+ * @brief The acquisition task. Starts a reading every time payloadTimer fires and runs it, sleeping on
+ * acquisition_semaphore until the next step is due.
+ */
+void acquisitionTask(void *unused) {
+    // deferred from setup(), so it happens while the join accept is on its way
+    initRequiredSensors();
+    acquisition_sequencer.add(&acquisition_cycle);
+    for (;;) {
+        if (reading_requested && !acquisition_cycle.running()) {
+            reading_requested = false;
+            uint32_t wake_latency_ms = millis() - timer_fired_ms;
+            if (wake_latency_ms > max_wake_latency_ms) {
+                max_wake_latency_ms = wake_latency_ms;
             }
-            // go back to 'sleep'
-            current_task = EVENT_TASK::SLEEP;
-            break;
+            acquisition_cycle.start(millis());
+        }
+        uint32_t wait_ms = acquisition_sequencer.run(millis());
+        // rails kept warm or waiting out their minimum off time
+        uint32_t rail_wait_ms = servicePowerRails(millis());
+        if (rail_wait_ms < wait_ms) {
+            wait_ms = rail_wait_ms;
+        }
+        xSemaphoreTake(acquisition_semaphore, (wait_ms == SEQUENCER_IDLE) ? portMAX_DELAY : pdMS_TO_TICKS(wait_ms));
+    }
+}
 
-        default:
-            // just in case there's an unknown current_task, go to 'sleep'
-            current_task = EVENT_TASK::SLEEP;
-            break;
+/**
+ * @brief Initialises the sensors needed by any port in the rotation, and marks the boot timeline the first time it
+ * works. If it doesn't, readings still go out with what can be read and it's tried again next cycle.
+ * @return True if successful.
+ */
+bool initRequiredSensors(void) {
+    // Neither 1901 or 1906 is needed for PORT1 or PORT10
+    xSemaphoreTake(radio_mutex, portMAX_DELAY);
+    portSchema required_sensors = port_rotation.requiredSensors();
+    xSemaphoreGive(radio_mutex);
+    sensors_ready = initSensors(&required_sensors, false, USE_RAK1906);
+    if (!sensors_ready) {
+        LOG_ERROR("Sensors not initialised, trying again next cycle.");
+        return false;
     }
+    boot_timeline.mark(BOOT_PHASE::SENSORS, millis());
+    return true;
+}
+
+/**
+ * @brief One acquisition cycle: schedule the next one, warm up & read the sensors, then push the reading to
+ * reading_ring and wake the radio task. If the ring is full the reading is dropped (and counted), rather than waiting
+ * and letting the sampling schedule slip.
+ */
+bool acquisitionCycle::body(uint32_t now_ms) {
+    SEQ_BEGIN();
+    LOG_DEBUG("lora wan : %d", lorawan_app_interval);
+    advanceMode();
+    // time the next wake up from the slot this one was for
+    scheduleNextCycle();
+    // apply any settings received by downlink before this cycle starts
+    applyDeviceConfig();
+    if (!sensors_ready) {
+        initRequiredSensors();
+    }
+    // the sensors warm up while waiting for the radio, so a busy radio doesn't move the reading
+    warm_ms = acquireSensorRails(millis());
+    xSemaphoreTake(radio_mutex, portMAX_DELAY);
+    // apply a time answer, or ask for one - the request goes out while the sensors warm up
+    if (applyClockAnswer()) {
+        LOG_INFO("Clock synced: %lu s (drift %.1f ppm).", wall_clock.nowSeconds(millis()),
+            wall_clock.driftPpm());
+        clock_stepped = true;
+        scheduleNextCycle();
+    }
+    syncWallClock();
+    frame_port = port_rotation.startFrame(millis());
+    record = {};
+    record.due_mask = port_rotation.dueMask();
+    xSemaphoreGive(radio_mutex);
+    // counted from the start of this step (now_ms), when the rails were acquired; keeps the reading on the slot even if
+    // they were kept warm
+    SEQ_SLEEP((warm_ms > SENSOR_WARMUP_MS) ? warm_ms : SENSOR_WARMUP_MS);
+
+    // the reading is taken even if not connected so it can be queued
+    sensor_reading.begin(&frame_port, now_ms);
+    SEQ_AWAIT(sensor_reading);
+    record.data = *sensor_reading.data();
+    // the rails stay on if the next cycle is sooner than warming them up again is worth
+    releaseSensorRails(millis(), ((int32_t)(next_cycle_ms - millis()) > 0) ? next_cycle_ms - millis() : 0);
+    logPowerRails(millis());
+    fillPayload(&record);
+    record.clock_stepped = clock_stepped;
+    record.taken_ms = millis();
+    if (reading_ring.push(record)) {
+        clock_stepped = false;
+    } else {
+        LOG_WARN("Reading ring full, reading dropped.");
+    }
+    xSemaphoreGive(semaphore_handle);
+    SEQ_END();
+}
+
+/**
+ * @brief Radio task side of a reading: compresses, keeps & encodes it, then sends it if it isn't compressed away.
+ * Called with radio_mutex held.
+ */
+void sendReading(readingRecord *record) {
+    if (record->clock_stepped) {
+        // one series frame never mixes uptime and Unix time
+        flushCompressedReadings(OUTBOX_PRIORITY::ROUTINE);
+        turbidity_compressor.restart();
+    }
+    sensorData *sensor_data = &record->data;
+    if (sensor_data->turbidity.is_valid) {
+        if (turbidity_compressor.frameReady()) {
+            // a full frame (or one closed by a long gap) goes before the compressor takes another point
+            flushCompressedReadings(OUTBOX_PRIORITY::ROUTINE);
+        }
+        if (device_config.compression_dntu > 0) {
+            turbidity_compressor.addReading(record->time_s, sensor_data->turbidity.value);
+        }
+        historyRecord summary = { record->time_s, clampNTU(sensor_data->turbidity.value),
+                                  clampNTU(sensor_data->turbidity.min), clampNTU(sensor_data->turbidity.max),
+                                  (uint16_t)(sensor_data->battery_mv.is_valid ? sensor_data->battery_mv.value : 0) };
+        history.append(&summary);
+    }
+
+    // reset the payload
+    memset(payload_buffer, 0, sizeof(payload_buffer));
+    lorawan_payload.buffsize = 0;
+
+    // encode the sensor data to lorawan_payload
+    lorawan_payload.buffsize =
+        port_rotation.encodeFrame(sensor_data, record->due_mask, payload_buffer, &lorawan_payload.port);
+
+    // log the encoded bytes
+    char encoded_payload_bytes[3 * PAYLOAD_BUFFER_SIZE + 1];
+    formatHex(payload_buffer, lorawan_payload.buffsize, encoded_payload_bytes, sizeof(encoded_payload_bytes));
+    LOG_INFO("Port: %2.d | Payload: %s", lorawan_payload.port, encoded_payload_bytes);
+
+    // in quiet periods the reading may just be added to the compressor, but not the one carrying the boot report
+    bool boot_report = !boot_reported && reportBoot();
+    boot_reported = true;
+    if (boot_report || compressQuietReading(record)) {
+        bool is_reading = (lorawan_payload.port != SERIES_FRAME_PORT);
+        // acknowledge the last config downlink, if there was one
+        addDeviceConfigAck();
+        // send data, or queue it in the outbox if it can't be sent
+        bool sent_live = sendPayload(record->alert ? OUTBOX_PRIORITY::ALERT : OUTBOX_PRIORITY::ROUTINE);
+        if (is_reading) {
+            // presence frames are only compared with readings that arrived in order
+            port_rotation.frameSent(sent_live);
+        }
+    }
+}
+
+/**
+ * @brief Marks the first reading on the boot timeline and logs it. After a cold boot (or any, with
+ * BOOT_REPORT_ON_RESUME) also queues the boot report, so it's batched with the reading. Called with radio_mutex held.
+ * @return True if a report was queued.
+ */
+bool reportBoot(void) {
+    uint32_t joined_ms = getLoRaWANJoinedMs();
+    if (joined_ms != 0) {
+        boot_timeline.mark(BOOT_PHASE::JOINED, joined_ms);
+    }
+    boot_timeline.mark(BOOT_PHASE::FIRST_READING, millis());
+    for (uint8_t i = 0; i < (uint8_t)BOOT_PHASE::COUNT; i++) {
+        if (boot_timeline.marked((BOOT_PHASE)i)) {
+            LOG_INFO("Boot %s: %lu ms.", bootPhaseName((BOOT_PHASE)i), boot_timeline.at((BOOT_PHASE)i));
+        }
+    }
+    if (boot_timeline.resumed() && !BOOT_REPORT_ON_RESUME) {
+        return false;
+    }
+    uint8_t report[BOOT_TIMELINE_MAX_LENGTH];
+    uint8_t length = boot_timeline.encode(report, sizeof(report));
+    return outbox.push(BOOT_REPORT_PORT, report, length, OUTBOX_PRIORITY::ROUTINE);
+}
+
+/**
+ * @brief Logs the pipeline counters: reading_ring depth, high water mark & overruns, the worst wake & queue
+ * latencies, the log ring's high water mark & drops, the flash log, and the airtime used & frames held back.
+ */
+void logPipelineCounters(void) {
+    spscRingStats ring;
+    reading_ring.stats(&ring);
+    LOG_DEBUG("Ring: %u/%u (high %u) | pushed %lu | overruns %lu | wake %lu ms | queue %lu ms", ring.depth,
+        reading_ring.capacity(), ring.high_water, ring.pushed, ring.overruns, max_wake_latency_ms,
+        max_queue_latency_ms);
+    spscRingStats log;
+    loggingStats(&log);
+    LOG_DEBUG("Log ring: high %u/%u | logged %lu | dropped %lu", log.high_water, LOG_RING_SLOTS, log.pushed,
+        log.overruns);
+    flashLogStats flash_log;
+    getFlashLogStats(&flash_log);
+    LOG_DEBUG("Flash log: page %u B | written %lu | dropped %lu | skipped %lu | budget %lu uJ", flash_log.page_used,
+        flash_log.pages_written, flash_log.pages_dropped, flash_log.records_skipped, flash_log.credit_uj);
+    // the ledger is also written by the clock sync uplinks
+    airtimeStatus airtime;
+    xSemaphoreTake(radio_mutex, portMAX_DELAY);
+    getLoRaWANAirtime(&airtime);
+    xSemaphoreGive(radio_mutex);
+    LOG_DEBUG("Airtime: %lu/%lu ms in 24 h | last frame %lu us | deferred %lu | too long %lu", airtime.used_ms,
+        airtime.budget_ms, airtime.last_frame_us, airtime.deferred, airtime.too_long);
 }
 
 /**
@@ -155,96 +562,381 @@ void loop() {
  * Initializes the payloadTimer as repeating with lorawan_app_interval timeout.
  */
 void appTimerInit(void) {
-    log(LOG_LEVEL::DEBUG, "Initialising timer...");
+    LOG_DEBUG("Initialising timer...");
     payloadTimer.begin(lorawan_app_interval, appTimerTimeoutHandler);
+    backfillTimer.begin(HISTORY_BACKFILL_INTERVAL_MS, backfillTimerHandler);
+    if (USE_DEEP_SLEEP) {
+        deepSleepTimer.begin(DEEP_SLEEP_SETTLE_MS, deepSleepTimerHandler, NULL, false);
+    }
 }
 
 /**
  * @brief Function for handling payloadTimer timeout event.
- * Sets the current_task to SEND_PAYLOAD and then 'wakes' the device by giving the semaphore so then it can be taken in
- * loop(), and the switch case will move to the new current_task.
+ * 'Wakes' the acquisition task by giving its semaphore so it can start a reading.
  */
-
-bool turbidity_trigger = false;
-
-int counter = 0;
 void appTimerTimeoutHandler(TimerHandle_t unused) {
-    Sensor_on();
-    delay(5000);
-    switch (current_mode) {
-        case EVENT_MODE::NORMAL_MODE:
-            if (turbidity_trigger) {
-                current_mode = EVENT_MODE::SWITCH_MODE;
-                log(LOG_LEVEL::INFO, "event mode : switch mode");
-            }
-            current_task = EVENT_TASK::SEND_PAYLOAD;
-            log(LOG_LEVEL::INFO, "event task : send payload");
-            break;
-        case EVENT_MODE::ACTIVE_MODE:
-            if (counter >= 9) {
-                lorawan_app_interval = 2 * 60 * 1000; // 3 hours
-                payloadTimer.setPeriod(lorawan_app_interval);
-                payloadTimer.reset();
-                current_mode = EVENT_MODE::NORMAL_MODE;
-                log(LOG_LEVEL::INFO, "event mode : normal");
-                counter = 0;
-                current_task = EVENT_TASK::SEND_PAYLOAD;
-                log(LOG_LEVEL::INFO, "event task : send payload");
-                break;
-            }
-            counter++;
-            current_task = EVENT_TASK::SEND_PAYLOAD;
-                log(LOG_LEVEL::INFO, "event task : send payload");
-            break;
-        case EVENT_MODE::SWITCH_MODE:
-            turbidity_trigger = false;
-            counter++;
-            current_mode = EVENT_MODE::ACTIVE_MODE;
-            log(LOG_LEVEL::INFO, "event mode : active mode");
-            current_task = EVENT_TASK::SEND_PAYLOAD;
-            log(LOG_LEVEL::INFO, "event task : send payload");
-            break;
-        default:
-            current_mode = EVENT_MODE::NORMAL_MODE;
-
-            break;
-    }
-    // current_task = EVENT_TASK::SEND_PAYLOAD;
-    // Give the semaphore, so the loop task can take it and wake up
-    xSemaphoreGiveFromISR(semaphore_handle, pdFALSE);
+    timer_fired_ms = millis();
+    reading_requested = true;
+    // Give the semaphore, so the acquisition task can take it and wake up
+    xSemaphoreGiveFromISR(acquisition_semaphore, pdFALSE);
+}
+
+/**
+ * @brief Moves between normal & active mode at the start of each cycle. Called from the acquisition task.
+ */
+void advanceMode(void) {
+    EVENT_MODE previous_mode = event_mode.mode();
+    if (event_mode.advance()) {
+        lorawan_app_interval = device_config.normal_interval_ms;
+    }
+    if (event_mode.mode() != previous_mode) {
+        LOG_INFO("event mode : %s", eventModeName(event_mode.mode()));
+    }
 }
 
 /**
- * @brief Gets the sensor data, then fills payload_buffer with the encoded data ready for sending via LoRaWAN.
- * Follows the portSchema specified in PortSchema.h.
+ * @brief Runs the event detector on a new reading and fills in the rest of its record. Called from the acquisition
+ * task; the reading is encoded by the radio task in sendReading().
  */
-void fillPayload(void) {
-    // get the sensor data
-    sensorData sensor_data = {};
-    sensor_data = getSensorData(&payload_port);
-    if (sensor_data.turbidity.value >= 30 && current_mode == EVENT_MODE::NORMAL_MODE) {
-        turbidity_trigger = true;
-        lorawan_app_interval = 60 * 1000; //20 minutes
-        payloadTimer.setPeriod(lorawan_app_interval);
-        payloadTimer.reset();
+void fillPayload(readingRecord *record) {
+    sensorData *sensor_data = &record->data;
+    TURBIDITY_SIGNAL signal = TURBIDITY_SIGNAL::QUIET;
+    if (sensor_data->turbidity.is_valid) {
+        signal = turbidity_detector.update(sensor_data->turbidity.value);
+        LOG_DEBUG("Detector: signal %u | baseline %.1f NTU | sigma %.1f | cusum %.1f", (uint8_t)signal,
+            turbidity_detector.baseline(), turbidity_detector.sigma(), turbidity_detector.cusum());
+    }
+    if (event_mode.update(signal)) {
+        lorawan_app_interval = device_config.active_interval_ms;
+        scheduleNextCycle();
     }
+    record->time_s = timestampSeconds();
+    record->alert = event_mode.alert();
     // log sensor data
-    log(LOG_LEVEL::INFO, "b: %.2f %% | t: %.2f C | h: %.2f %% | p: %lu Pa | g: %lu | l: %.5f, %.5f | t: %lu",
-        sensor_data.battery_mv.value, sensor_data.temperature.value, sensor_data.humidity.value, sensor_data.pressure.value,
-        sensor_data.gas_resist.value, sensor_data.location.latitude, sensor_data.location.longitude, sensor_data.turbidity.value);
+    LOG_INFO("b: %.2f %% | t: %.2f C | h: %.2f %% | p: %lu Pa | g: %lu | l: %.5f, %.5f | t: %lu",
+        sensor_data->battery_mv.value, sensor_data->temperature.value, sensor_data->humidity.value,
+        sensor_data->pressure.value, sensor_data->gas_resist.value, sensor_data->location.latitude,
+        sensor_data->location.longitude, sensor_data->turbidity.value);
+}
+
+/**
+ * @brief Sends the reading in lorawan_payload, using the outbox so that nothing is lost while the link is down.
+ * If nothing is queued the reading is sent straight away and only queued if the send fails. If frames are already
+ * queued the reading is queued behind them and one uplink is drained from the outbox (highest priority first, several
+ * frames coalesced into one batch frame where possible). One uplink per wake-up keeps within the duty cycle.
+ * @param priority Priority the reading is queued with.
+ * @return True if the reading was sent straight away, false if it was queued.
+ */
+bool sendPayload(OUTBOX_PRIORITY priority) {
+    if (!isLoRaWANConnected()) {
+        LOG_DEBUG("LoRaWAN not connected. Queueing payload.");
+        outbox.push(lorawan_payload.port, lorawan_payload.buffer, lorawan_payload.buffsize, priority);
+        return false;
+    }
+
+    if (outbox.pending() == 0) {
+        LOG_DEBUG("Send payload");
+        if (!sendLoRaWANFrame(&lorawan_payload)) {
+            outbox.push(lorawan_payload.port, lorawan_payload.buffer, lorawan_payload.buffsize, priority);
+            return false;
+        }
+        return true;
+    }
+
+    outbox.push(lorawan_payload.port, lorawan_payload.buffer, lorawan_payload.buffsize, priority);
+    // frames that can't go out at this data rate would hold every later reading in the outbox
+    outbox.dropLongerThan(min((uint8_t)OUTBOX_BATCH_MAX_LENGTH, getLoRaWANDwellPayloadLength()));
+    // only as much as the dwell time & airtime budget allow
+    uint8_t max_length = min((uint8_t)OUTBOX_BATCH_MAX_LENGTH, getLoRaWANMaxPayloadLength());
+    if (outbox.prepareFrame(&outbox_frame, max_length)) {
+        LOG_DEBUG("Send outbox frame (%u pending)", outbox.pending());
+        if (sendLoRaWANFrame(&outbox_frame)) {
+            outbox.markFrameSent();
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Decides whether the reading in lorawan_payload is sent, or only kept in the compressor.
+ * Outside of quiet periods (trigger, active mode, or other ports due) any compressed readings are flushed to the outbox
+ * so they are sent ahead of the reading. In quiet periods lorawan_payload is replaced with a series frame once the
+ * compressor has a full frame or SERIES_MAX_HOLD_MS has passed.
+ * @param record The reading in lorawan_payload; other ports are due if more than the base entry is in its due_mask.
+ * @return True if lorawan_payload should be sent.
+ */
+bool compressQuietReading(const readingRecord *record) {
+    if (device_config.compression_dntu == 0) {
+        return true;
+    }
+    if (record->alert || (record->due_mask != 1)) {
+        flushCompressedReadings(record->alert ? OUTBOX_PRIORITY::ALERT : OUTBOX_PRIORITY::ROUTINE);
+        return true;
+    }
+    if (!turbidity_compressor.frameReady() && ((millis() - last_series_frame_ms) < SERIES_MAX_HOLD_MS)) {
+        LOG_DEBUG("Reading compressed (%u points pending).", turbidity_compressor.pendingPoints());
+        return false;
+    }
 
-    // reset the payload
     memset(payload_buffer, 0, sizeof(payload_buffer));
-    lorawan_payload.buffsize = 0;
-    lorawan_payload.port = payload_port.port_number;
+    lorawan_payload.buffsize = turbidity_compressor.encodeFrame(payload_buffer, OUTBOX_BATCH_MAX_LENGTH);
+    lorawan_payload.port = SERIES_FRAME_PORT;
+    last_series_frame_ms = millis();
+    LOG_INFO("Series frame: %u bytes.", lorawan_payload.buffsize);
+    return lorawan_payload.buffsize > 0;
+}
 
-    // encode the sensor data to lorawan_payload
-    lorawan_payload.buffsize = payload_port.encodeSensorDataToPayload(&sensor_data, payload_buffer);
+/**
+ * @brief Queues any readings held in the compressor so the lead-up to an event isn't lost.
+ * The series frame ends with the latest reading, which is also in lorawan_payload; that's the cost of keeping the
+ * reconstructed curve continuous.
+ * @param priority Priority the series frame is queued with.
+ */
+void flushCompressedReadings(OUTBOX_PRIORITY priority) {
+    // a lone latest reading is about to be sent anyway; more than one frame if a long gap splits them
+    while (turbidity_compressor.pendingPoints() >= 2) {
+        uint8_t frame[OUTBOX_BATCH_MAX_LENGTH];
+        uint8_t length = turbidity_compressor.encodeFrame(frame, sizeof(frame));
+        outbox.push(SERIES_FRAME_PORT, frame, length, priority);
+        last_series_frame_ms = millis();
+    }
+}
 
-    // log the encoded bytes
-    char encoded_payload_bytes[3 * PAYLOAD_BUFFER_SIZE] = {};
-    for (int b = 0; b < lorawan_payload.buffsize; b++) {
-        snprintf(encoded_payload_bytes, sizeof(encoded_payload_bytes), "%s%02X ", encoded_payload_bytes, payload_buffer[b]);
+/**
+ * @brief Sets the event detector's sensitivity from device_config. The learnt baseline is kept.
+ */
+void configureDetector(void) {
+    turbidity_detector.configure(device_config.detector_slack_dsigma / 10.0f,
+                                 device_config.detector_threshold_dsigma / 10.0f, device_config.trigger_ntu);
+}
+
+/**
+ * @brief Unix time in seconds once the wall clock is synced, seconds since boot before. Used to timestamp compressed
+ * readings and the history.
+ */
+uint32_t timestampSeconds(void) {
+    return wall_clock.nowSeconds(millis());
+}
+
+/**
+ * @brief Called by the LoRaWAN library with every downlink. Only parses, see applyDeviceConfig().
+ */
+void handleDownlink(uint8_t port, const uint8_t *buffer, uint8_t size) {
+    if (port == DEVICE_CONFIG_PORT) {
+        handleConfigDownlink(&device_config, buffer, size);
+    } else if (port == CLOCK_SYNC_PORT) {
+        xSemaphoreTake(clock_mutex, portMAX_DELAY);
+        wall_clock.handleAnswer(buffer, size);
+        xSemaphoreGive(clock_mutex);
+    } else if (port == HISTORY_PORT) {
+        if (history.handleRequest(buffer, size)) {
+            backfillTimer.start();
+        }
+    } else if (port == FLASH_LOG_PORT) {
+        if (handleFlashLogRequest(buffer, size)) {
+            backfillTimer.start();
+        }
+    }
+}
+
+/**
+ * @brief Sets payloadTimer to wake SENSOR_WARMUP_MS before the next slot of lorawan_app_interval, so readings stay on
+ * absolute times instead of drifting with the time each cycle takes. Until the clock is synced it's just the interval.
+ */
+void scheduleNextCycle(void) {
+    uint32_t period_ms = wall_clock.msUntilNextSlot(millis(), lorawan_app_interval, SENSOR_WARMUP_MS);
+    next_cycle_ms = millis() + period_ms;
+    payloadTimer.setPeriod(period_ms);
+}
+
+/**
+ * @brief Applies a time answer stored by the RX callback, if there is one. Called with radio_mutex held.
+ * @return True if the clock was stepped, see wallClock::applyAnswer().
+ */
+bool applyClockAnswer(void) {
+    xSemaphoreTake(clock_mutex, portMAX_DELAY);
+    bool stepped = wall_clock.applyAnswer(millis());
+    xSemaphoreGive(clock_mutex);
+    return stepped;
+}
+
+/**
+ * @brief Sends a time request if one is due. Answers are applied by the acquisition cycle, which also flags the reading
+ * if the clock was stepped (e.g. the first sync moves it from uptime to Unix time) so the radio task restarts the
+ * compressor and one series frame never mixes the two. Called with radio_mutex held; clock_mutex is only held while the
+ * request is encoded, as the RX callback checks answers against it.
+ */
+void syncWallClock(void) {
+    uint8_t request[CLOCK_SYNC_REQUEST_SIZE];
+    lmh_app_data_t frame = { request, 0, CLOCK_SYNC_PORT, 0, 0 };
+    uint32_t airtime_ms = lorawanTimeOnAirUs(getLoRaWANDataRate(), CLOCK_SYNC_REQUEST_SIZE) / 1000;
+    xSemaphoreTake(clock_mutex, portMAX_DELAY);
+    if (wall_clock.syncDue(millis())) {
+        frame.buffsize = wall_clock.encodeRequest(request, millis(), airtime_ms);
+    }
+    xSemaphoreGive(clock_mutex);
+    if (frame.buffsize == 0) {
+        return;
+    }
+    if (!sendLoRaWANFrame(&frame)) {
+        LOG_DEBUG("Time request not sent.");
+    }
+}
+
+/**
+ * @brief Function for handling backfillTimer timeout event.
+ * Wakes the radio task to send a fragment once it has sent any readings that are waiting.
+ */
+void backfillTimerHandler(TimerHandle_t unused) {
+    backfill_due = true;
+    xSemaphoreGiveFromISR(semaphore_handle, pdFALSE);
+}
+
+/**
+ * @brief Function for handling deepSleepTimer timeout event. Wakes the radio task to see if it can deep sleep.
+ */
+void deepSleepTimerHandler(TimerHandle_t unused) {
+    deep_sleep_check = true;
+    xSemaphoreGiveFromISR(semaphore_handle, pdFALSE);
+}
+
+/**
+ * @brief Enters deep sleep until DEEP_SLEEP_WAKE_EARLY_MS before the next cycle, if the gap is long enough and nothing
+ * that only lives in RAM would be lost. Flushes the history & session first and saves the rest in resume_state, so
+ * the compressor's points are sent in a full frame after the wake. Doesn't return if it sleeps.
+ * Called from the radio task; the acquisition task is idle (checked) so its state can be saved.
+ */
+void tryDeepSleep(void) {
+    if (!deepSleepAvailable() || !wall_clock.isSynced() || event_mode.alert() || reading_requested ||
+        acquisition_cycle.running() || (reading_ring.depth() > 0) || !powerRailsIdle() || history.backfillPending() ||
+        flashLogUploadPending() || deviceConfigBusy() || wall_clock.answerPending()) {
+        return;
+    }
+    int32_t until_next_ms = (int32_t)(next_cycle_ms - millis());
+    if (until_next_ms < (int32_t)(DEEP_SLEEP_MIN_MS + DEEP_SLEEP_WAKE_EARLY_MS)) {
+        return;
+    }
+
+    xSemaphoreTake(radio_mutex, portMAX_DELAY);
+    history.flush();
+    saveLoRaWANSession(true);
+    resume_state.asleep_ms = until_next_ms - DEEP_SLEEP_WAKE_EARLY_MS;
+    resume_state.deep_sleeps++;
+    resume_state.series_held_ms = millis() - last_series_frame_ms;
+    wall_clock.save(&resume_state.clock, millis());
+    turbidity_detector.save(&resume_state.detector);
+    port_rotation.save(&resume_state.rotation, millis());
+    saveLoRaWANAirtime(&resume_state.airtime);
+    turbidity_compressor.save(&resume_state.series);
+    if (!enterDeepSleep(resume_state.asleep_ms, &resume_state, sizeof(resume_state))) {
+        resume_state.deep_sleeps--;
+    }
+    xSemaphoreGive(radio_mutex);
+}
+
+/**
+ * @brief Sends the next fragment of the backfill request, or of the flash log request once there's no backfill, and
+ * stops backfillTimer once the last one has been sent.
+ */
+void sendBackfillFragment(void) {
+    if (history.backfillPending()) {
+        backfill_frame.port = HISTORY_PORT;
+        backfill_frame.buffsize = history.prepareFragment(backfill_buffer, getLoRaWANMaxPayloadLength());
+        if ((backfill_frame.buffsize > 0) && sendLoRaWANFrame(&backfill_frame)) {
+            history.fragmentSent();
+        }
+    } else if (flashLogUploadPending()) {
+        backfill_frame.port = FLASH_LOG_PORT;
+        backfill_frame.buffsize = prepareFlashLogFragment(backfill_buffer, getLoRaWANMaxPayloadLength());
+        if ((backfill_frame.buffsize > 0) && sendLoRaWANFrame(&backfill_frame)) {
+            flashLogFragmentSent();
+        }
+    }
+    if (!history.backfillPending() && !flashLogUploadPending()) {
+        backfillTimer.stop();
+    }
+}
+
+/**
+ * @brief Applies settings received in a config downlink all at once.
+ * Called by the acquisition task at the start of a cycle, without radio_mutex, so settings never change part way
+ * through a reading. The sensors for a new port are initialised with radio_mutex released, the rest is applied with it
+ * held. If any part can't be applied (e.g. unknown port or the sensors for the new port fail to init) none of the
+ * settings are changed, and sensors_ready is cleared so the old port's sensors are initialised again.
+ */
+void applyDeviceConfig(void) {
+    deviceConfig new_config;
+    if (!getPendingDeviceConfig(&new_config)) {
+        return;
+    }
+
+    portSchema new_port;
+    bool applied = findPortSchema(new_config.payload_port, &new_port);
+    xSemaphoreTake(radio_mutex, portMAX_DELAY);
+    portSchema old_port = *port_rotation.basePort();
+    bool port_changed = applied && (new_port.port_number != old_port.port_number);
+    portSchema required_sensors = old_port;
+    if (port_changed) {
+        port_rotation.setBasePort(&new_port);
+        required_sensors = port_rotation.requiredSensors();
+        port_rotation.setBasePort(&old_port);
+    }
+    xSemaphoreGive(radio_mutex);
+    if (port_changed) {
+        sensors_ready = initSensors(&required_sensors, false, USE_RAK1906);
+        applied = sensors_ready;
+    }
+
+    xSemaphoreTake(radio_mutex, portMAX_DELAY);
+    if (applied && (new_config.tx_power != device_config.tx_power)) {
+        applied = setLoRaWANTxPower(new_config.tx_power);
+    }
+    if (port_changed) {
+        if (applied) {
+            port_rotation.setBasePort(&new_port);
+        } else {
+            sensors_ready = false;
+        }
+    }
+
+    if (applied) {
+        device_config = new_config;
+        setTurbiditySamples(device_config.turbidity_samples);
+        turbidity_compressor.setErrorBound(device_config.compression_dntu / 10.0f);
+        configureDetector();
+        event_mode.configure(device_config.active_cycles);
+        if (event_mode.mode() == EVENT_MODE::NORMAL_MODE) {
+            lorawan_app_interval = device_config.normal_interval_ms;
+        } else {
+            lorawan_app_interval = device_config.active_interval_ms;
+        }
+        scheduleNextCycle();
+    }
+    finishDeviceConfig(&device_config, applied);
+    xSemaphoreGive(radio_mutex);
+}
+
+/**
+ * @brief If a config downlink is waiting to be acknowledged, moves the encoded payload to DEVICE_CONFIG_PORT with the
+ * ack in front: [version][command id][status][original port][original payload].
+ * If that would be longer than the data rate carries (the outbox would drop the reading & ack together), the ack is
+ * queued in the outbox as a frame of its own and the payload is left as it is.
+ */
+void addDeviceConfigAck(void) {
+    uint8_t ack[DEVICE_CONFIG_ACK_SIZE];
+    uint8_t ack_size = takeDeviceConfigAck(ack);
+    if (ack_size == 0) {
+        return;
+    }
+    uint8_t max_length = min((uint8_t)PAYLOAD_BUFFER_SIZE, getLoRaWANDwellPayloadLength());
+    if ((lorawan_payload.buffsize + ack_size + 1) > max_length) {
+        LOG_DEBUG("Config ack sent on its own.");
+        outbox.push(DEVICE_CONFIG_PORT, ack, ack_size, OUTBOX_PRIORITY::ROUTINE);
+        return;
     }
-    log(LOG_LEVEL::INFO, "Port: %2.d | Payload: %s", lorawan_payload.port, encoded_payload_bytes);
+    memmove(&payload_buffer[ack_size + 1], payload_buffer, lorawan_payload.buffsize);
+    memcpy(payload_buffer, ack, ack_size);
+    payload_buffer[ack_size] = lorawan_payload.port;
+    lorawan_payload.buffsize += ack_size + 1;
+    lorawan_payload.port = DEVICE_CONFIG_PORT;
 }
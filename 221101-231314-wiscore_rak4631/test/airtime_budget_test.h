@@ -0,0 +1,65 @@
+#include "../lib/AirtimeBudget/src/AirtimeBudget.h"
+
+TEST(AirtimeBudgetTest, TimeOnAir) {
+    loraModulation sf7 = { 7, 125 };
+    EXPECT_EQ(loraTimeOnAirUs(&sf7, 23), 61696u);
+    // low data rate optimisation on at SF12 / 125 kHz
+    EXPECT_EQ(lorawanTimeOnAirUs(0, 0), 1155072u);
+    // a full 51 byte batch frame at DR2 is well over the 400 ms dwell time
+    EXPECT_EQ(lorawanTimeOnAirUs(2, 51), 698368u);
+    EXPECT_EQ(lorawanTimeOnAirUs(6, 51), 53888u);
+    EXPECT_EQ(lorawanTimeOnAirUs(7, 51), UINT32_MAX);
+    // AU915 with dwell time on allows 11 bytes at DR2
+    EXPECT_EQ(lorawanMaxPayloadForAirtime(2, 400000), 11);
+    EXPECT_EQ(lorawanMaxPayloadForAirtime(0, 400000), 0);
+}
+
+TEST(AirtimeBudgetTest, LedgerAdmitsDefersAndDownsizes) {
+    airtimeLedger ledger(1000, 400); // 1 s per day
+    uint32_t now = 0xFFFF0000;       // millis() about to wrap
+    EXPECT_EQ(ledger.check(now, 2, 51), AIRTIME_DECISION::TOO_LONG);
+    EXPECT_EQ(ledger.check(now, 5, 10), AIRTIME_DECISION::ADMIT);
+
+    // DR5, 10 bytes is 61.7 ms, so 16 fit in 1 s
+    uint32_t airtime = lorawanTimeOnAirUs(5, 10);
+    int sent = 0;
+    while (ledger.check(now, 5, 10) == AIRTIME_DECISION::ADMIT) {
+        ledger.record(now, airtime);
+        now += 10 * 60 * 1000;
+        sent++;
+    }
+    EXPECT_EQ(sent, 16);
+    EXPECT_EQ(ledger.check(now, 5, 10), AIRTIME_DECISION::DEFER);
+    EXPECT_LT(ledger.maxPayload(now, 5), 10);
+
+    airtimeStatus status;
+    ledger.status(now, &status);
+    EXPECT_EQ(status.used_ms, (16 * airtime) / 1000);
+    EXPECT_EQ(status.deferred, 2u);
+    EXPECT_EQ(status.too_long, 1u);
+
+    // the first frames drop out of the window a day later
+    now += 22 * AIRTIME_HOUR_MS;
+    EXPECT_EQ(ledger.check(now, 5, 10), AIRTIME_DECISION::ADMIT);
+    now += 2 * AIRTIME_HOUR_MS;
+    EXPECT_EQ(ledger.usedMs(now), 0u);
+}
+
+TEST(AirtimeBudgetTest, LedgerResumesAfterDeepSleep) {
+    airtimeLedger ledger(1000, 400);
+    uint32_t airtime = lorawanTimeOnAirUs(5, 10);
+    for (int i = 0; i < 16; i++) {
+        ledger.record(0, airtime);
+    }
+    airtimeLedgerState state;
+    ledger.save(&state, AIRTIME_HOUR_MS / 2);
+
+    // asleep for 2 h, then millis() starts again from 0
+    airtimeLedger resumed(1000, 400);
+    resumed.resume(&state, 2 * AIRTIME_HOUR_MS, 0);
+    EXPECT_EQ(resumed.usedMs(0), (16 * airtime) / 1000);
+    EXPECT_EQ(resumed.check(0, 5, 10), AIRTIME_DECISION::DEFER);
+    // the frames drop out 24 h after they were sent, not 24 h after the wake
+    EXPECT_EQ(resumed.usedMs(21 * AIRTIME_HOUR_MS), (16 * airtime) / 1000);
+    EXPECT_EQ(resumed.usedMs(22 * AIRTIME_HOUR_MS), 0u);
+}
@@ -0,0 +1,45 @@
+#include "../lib/BootTimeline/src/BootTimeline.h"
+
+TEST(BootTimelineTest, KeepsTheFirstMark) {
+    bootTimeline timeline;
+    timeline.start(false, 0x4);
+    EXPECT_FALSE(timeline.marked(BOOT_PHASE::SENSORS));
+    EXPECT_EQ(timeline.at(BOOT_PHASE::SENSORS), 0u);
+    // sensors retried next cycle, the first time they worked counts
+    EXPECT_TRUE(timeline.mark(BOOT_PHASE::SENSORS, 1200));
+    EXPECT_FALSE(timeline.mark(BOOT_PHASE::SENSORS, 61200));
+    EXPECT_TRUE(timeline.marked(BOOT_PHASE::SENSORS));
+    EXPECT_EQ(timeline.at(BOOT_PHASE::SENSORS), 1200u);
+    EXPECT_FALSE(timeline.mark(BOOT_PHASE::COUNT, 5));
+    EXPECT_STREQ(bootPhaseName(BOOT_PHASE::JOIN_STARTED), "join started");
+
+    // a new boot forgets it
+    timeline.start(true, 0);
+    EXPECT_TRUE(timeline.resumed());
+    EXPECT_FALSE(timeline.marked(BOOT_PHASE::SENSORS));
+}
+
+TEST(BootTimelineTest, EncodesMarkedPhasesInOrder) {
+    bootTimeline timeline;
+    timeline.start(true, 0x00010004);
+    // marked out of order, reported in phase order
+    timeline.mark(BOOT_PHASE::JOINED, 6543);
+    timeline.mark(BOOT_PHASE::LOGGING, 4);
+    timeline.mark(BOOT_PHASE::READY, 180);
+    timeline.mark(BOOT_PHASE::FIRST_READING, 900000); // past 0xFFFF ticks
+
+    uint8_t buffer[BOOT_TIMELINE_MAX_LENGTH];
+    uint8_t length = timeline.encode(buffer, sizeof(buffer));
+    const uint8_t expected[] = { BOOT_TIMELINE_VERSION, BOOT_TIMELINE_RESUMED, 0x00, 0x01, 0x00, 0x04,
+                                 (uint8_t)BOOT_PHASE::LOGGING, 0x00, 0x00,
+                                 (uint8_t)BOOT_PHASE::READY, 0x00, 18,
+                                 (uint8_t)BOOT_PHASE::JOINED, 0x02, 0x8E,
+                                 (uint8_t)BOOT_PHASE::FIRST_READING, 0xFF, 0xFF };
+    ASSERT_EQ(length, sizeof(expected));
+    EXPECT_EQ(memcmp(buffer, expected, length), 0);
+
+    // what doesn't fit is left out, a whole phase at a time
+    EXPECT_EQ(timeline.encode(buffer, BOOT_TIMELINE_HEADER + BOOT_TIMELINE_ITEM + 2),
+        BOOT_TIMELINE_HEADER + BOOT_TIMELINE_ITEM);
+    EXPECT_EQ(timeline.encode(buffer, BOOT_TIMELINE_HEADER - 1), 0);
+}
@@ -0,0 +1,59 @@
+#include "../lib/SensorHelper/src/ChangeDetector.h"
+
+// repeatable noise in [-1, 1]
+static float detectorNoise(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return ((*state >> 8) / (float)(1 << 24)) * 2 - 1;
+}
+
+TEST(ChangeDetectorTest, IgnoresSingleBurst) {
+    changeDetector detector(0.5f, 5.0f, 30);
+    uint32_t seed = 1;
+    for (int i = 0; i < 50; i++) {
+        EXPECT_EQ(detector.update(12 + detectorNoise(&seed)), TURBIDITY_SIGNAL::QUIET);
+    }
+    EXPECT_NEAR(detector.baseline(), 12, 0.5);
+    // one reading over the old fixed 30 NTU trigger
+    EXPECT_EQ(detector.update(35), TURBIDITY_SIGNAL::QUIET);
+    for (int i = 0; i < 20; i++) {
+        EXPECT_EQ(detector.update(12 + detectorNoise(&seed)), TURBIDITY_SIGNAL::QUIET);
+    }
+    // a real step is caught on its second reading
+    EXPECT_EQ(detector.update(25), TURBIDITY_SIGNAL::QUIET);
+    EXPECT_EQ(detector.update(25), TURBIDITY_SIGNAL::RISING);
+}
+
+TEST(ChangeDetectorTest, CatchesSlowRiseBelowCeiling) {
+    changeDetector detector(0.5f, 5.0f, 30);
+    uint32_t seed = 2;
+    for (int i = 0; i < 50; i++) {
+        detector.update(5 + 0.5f * detectorNoise(&seed));
+    }
+    // +0.3 NTU a reading, the old trigger wouldn't fire for 80 readings
+    int rising_at = -1;
+    for (int i = 0; i < 40 && rising_at < 0; i++) {
+        if (detector.update(5 + 0.3f * i + 0.5f * detectorNoise(&seed)) == TURBIDITY_SIGNAL::RISING) {
+            rising_at = i;
+        }
+    }
+    EXPECT_GE(rising_at, 0);
+    EXPECT_LT(rising_at, 15);
+    EXPECT_TRUE(detector.inEvent());
+    EXPECT_EQ(detector.update(20), TURBIDITY_SIGNAL::ELEVATED);
+
+    // back to the baseline
+    EXPECT_EQ(detector.update(5), TURBIDITY_SIGNAL::ELEVATED);
+    EXPECT_EQ(detector.update(5), TURBIDITY_SIGNAL::ELEVATED);
+    EXPECT_EQ(detector.update(5), TURBIDITY_SIGNAL::RECOVERED);
+    EXPECT_EQ(detector.update(5), TURBIDITY_SIGNAL::QUIET);
+}
+
+TEST(ChangeDetectorTest, CeilingWhileLearning) {
+    changeDetector detector(0.5f, 5.0f, 30);
+    EXPECT_EQ(detector.update(40), TURBIDITY_SIGNAL::QUIET);
+    EXPECT_EQ(detector.update(40), TURBIDITY_SIGNAL::RISING);
+    detector.reset();
+    detector.configure(0.5f, 5.0f, 0);
+    EXPECT_EQ(detector.update(40), TURBIDITY_SIGNAL::QUIET);
+    EXPECT_EQ(detector.update(40), TURBIDITY_SIGNAL::QUIET);
+}
@@ -0,0 +1,65 @@
+#include "../lib/DeepSleep/src/RetainedBlock.h"
+#include "../lib/SensorHelper/src/ChangeDetector.h"
+#include "../lib/WallClock/src/WallClock.h"
+#include <string.h>
+
+TEST(DeepSleepTest, RetainedBlockOpensOnce) {
+    retainedBlock block;
+    memset(&block, 0xA5, sizeof(block)); // RAM after a cold boot
+    uint8_t state[40];
+    uint8_t out[40];
+    EXPECT_FALSE(openRetainedBlock(&block, out, sizeof(out)));
+
+    for (uint8_t i = 0; i < sizeof(state); i++) {
+        state[i] = i * 7;
+    }
+    EXPECT_TRUE(sealRetainedBlock(&block, state, sizeof(state)));
+    // a different layout doesn't match
+    EXPECT_FALSE(openRetainedBlock(&block, out, sizeof(out) - 1));
+    EXPECT_TRUE(sealRetainedBlock(&block, state, sizeof(state)));
+    EXPECT_TRUE(openRetainedBlock(&block, out, sizeof(out)));
+    EXPECT_EQ(memcmp(state, out, sizeof(state)), 0);
+    // the next reset starts cold
+    EXPECT_FALSE(openRetainedBlock(&block, out, sizeof(out)));
+
+    // corrupted
+    EXPECT_TRUE(sealRetainedBlock(&block, state, sizeof(state)));
+    block.data[3] ^= 0x10;
+    EXPECT_FALSE(openRetainedBlock(&block, out, sizeof(out)));
+    // too big
+    uint8_t big[RETAINED_BLOCK_SIZE + 1] = {};
+    EXPECT_FALSE(sealRetainedBlock(&block, big, sizeof(big)));
+    EXPECT_FALSE(openRetainedBlock(&block, big, sizeof(big)));
+}
+
+TEST(DeepSleepTest, ClockAndDetectorResume) {
+    wallClock clock;
+    clock.sync(1700000000000ULL, 1000);
+    wallClockState clock_state;
+    clock.save(&clock_state, 61000);
+
+    // asleep for 15 min, then 800 ms to boot
+    wallClock resumed_clock;
+    resumed_clock.resume(&clock_state, 900000, 800);
+    EXPECT_TRUE(resumed_clock.isSynced());
+    EXPECT_EQ(resumed_clock.nowMs(800), 1700000960800ULL);
+    EXPECT_FALSE(resumed_clock.syncDue(800));
+
+    changeDetector detector(0.5f, 5.0f, 30);
+    for (int i = 0; i < 50; i++) {
+        detector.update((i % 2) ? 11.f : 13.f);
+    }
+    changeDetectorState detector_state;
+    detector.save(&detector_state);
+    changeDetector restored(0.5f, 5.0f, 30);
+    restored.restore(&detector_state);
+    EXPECT_NEAR(restored.baseline(), detector.baseline(), 0.001);
+    // carries on exactly as if it hadn't been reset, the baseline isn't learnt again
+    bool rising = false;
+    for (int i = 0; i < 5; i++) {
+        TURBIDITY_SIGNAL signal = restored.update(25);
+        EXPECT_EQ(signal, detector.update(25));
+        rising |= (signal == TURBIDITY_SIGNAL::RISING);
+    }
+    EXPECT_TRUE(rising);
+}
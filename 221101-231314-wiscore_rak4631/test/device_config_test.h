@@ -0,0 +1,157 @@
+#include "../lib/DeviceConfig/src/DeviceConfig.h"
+#include "hal/HostHal.h"
+
+#include <vector>
+
+// The config downlink parser: anything but a fully valid downlink changes nothing and is acked with the reason
+
+class DeviceConfigTest : public ::testing::Test {
+  protected:
+    void SetUp(void) override {
+        hostFlashErase();
+        loadDeviceConfig(&config);
+        // the parser's pending settings & ack outlive each test
+        deviceConfig pending;
+        if (getPendingDeviceConfig(&pending)) {
+            finishDeviceConfig(&pending, false);
+        }
+        takeDeviceConfigAck(ack);
+    }
+    void TearDown(void) override { hostFlashErase(); }
+
+    CONFIG_STATUS parse(const std::vector<uint8_t> &downlink) {
+        return handleConfigDownlink(&config, downlink.data(), (uint8_t)downlink.size());
+    }
+
+    // the ack a rejected downlink queued straight away
+    void expectAck(uint8_t command_id, CONFIG_STATUS status) {
+        ASSERT_EQ(takeDeviceConfigAck(ack), DEVICE_CONFIG_ACK_SIZE);
+        EXPECT_EQ(ack[0], DEVICE_CONFIG_VERSION);
+        EXPECT_EQ(ack[1], command_id);
+        EXPECT_EQ(ack[2], (uint8_t)status);
+        deviceConfig pending;
+        EXPECT_FALSE(getPendingDeviceConfig(&pending));
+    }
+
+    deviceConfig config;
+    uint8_t ack[DEVICE_CONFIG_ACK_SIZE] = {};
+};
+
+TEST_F(DeviceConfigTest, ValidDownlinkIsHeldUntilApplied) {
+    // the README's example: normal interval 3600 s & 20 turbidity samples
+    EXPECT_EQ(parse({ 0x01, 0x2A, 0x01, 0x02, 0x0E, 0x10, 0x04, 0x01, 0x14 }), CONFIG_STATUS::OK);
+    EXPECT_EQ(takeDeviceConfigAck(ack), 0u);
+    deviceConfig pending;
+    ASSERT_TRUE(getPendingDeviceConfig(&pending));
+    EXPECT_EQ(pending.normal_interval_ms, 3600000u);
+    EXPECT_EQ(pending.turbidity_samples, 20u);
+    EXPECT_EQ(pending.active_interval_ms, DEFAULT_DEVICE_CONFIG.active_interval_ms);
+    finishDeviceConfig(&pending, true);
+    EXPECT_FALSE(getPendingDeviceConfig(&pending));
+    EXPECT_EQ(takeDeviceConfigAck(ack), DEVICE_CONFIG_ACK_SIZE);
+    EXPECT_EQ(ack[1], 0x2A);
+    EXPECT_EQ(ack[2], (uint8_t)CONFIG_STATUS::OK);
+
+    // and saved
+    deviceConfig loaded;
+    EXPECT_TRUE(loadDeviceConfig(&loaded));
+    EXPECT_EQ(loaded.normal_interval_ms, 3600000u);
+}
+
+TEST_F(DeviceConfigTest, WrongVersionIsRejected) {
+    EXPECT_EQ(parse({ DEVICE_CONFIG_VERSION + 1, 0x10, (uint8_t)CONFIG_TLV::TX_POWER, 1, 5 }),
+              CONFIG_STATUS::BAD_VERSION);
+    expectAck(0x10, CONFIG_STATUS::BAD_VERSION);
+}
+
+TEST_F(DeviceConfigTest, TruncatedDownlinksAreMalformed) {
+    // no command id, so the ack carries 0
+    EXPECT_EQ(parse({ DEVICE_CONFIG_VERSION }), CONFIG_STATUS::MALFORMED);
+    expectAck(0, CONFIG_STATUS::MALFORMED);
+    // type without a length
+    EXPECT_EQ(parse({ DEVICE_CONFIG_VERSION, 0x11, (uint8_t)CONFIG_TLV::TX_POWER }), CONFIG_STATUS::MALFORMED);
+    expectAck(0x11, CONFIG_STATUS::MALFORMED);
+    // value shorter than its length
+    EXPECT_EQ(parse({ DEVICE_CONFIG_VERSION, 0x12, (uint8_t)CONFIG_TLV::NORMAL_INTERVAL, 2, 0x01 }),
+              CONFIG_STATUS::MALFORMED);
+    expectAck(0x12, CONFIG_STATUS::MALFORMED);
+    // a valid TLV followed by a truncated one changes nothing
+    EXPECT_EQ(parse({ DEVICE_CONFIG_VERSION, 0x13, (uint8_t)CONFIG_TLV::TX_POWER, 1, 5,
+                      (uint8_t)CONFIG_TLV::ACTIVE_CYCLES, 1 }),
+              CONFIG_STATUS::MALFORMED);
+    expectAck(0x13, CONFIG_STATUS::MALFORMED);
+}
+
+TEST_F(DeviceConfigTest, UnknownTypeIsRejected) {
+    EXPECT_EQ(parse({ DEVICE_CONFIG_VERSION, 0x20, (uint8_t)CONFIG_TLV::TX_POWER, 1, 5, 0x0B, 1, 0 }),
+              CONFIG_STATUS::UNKNOWN_TLV);
+    expectAck(0x20, CONFIG_STATUS::UNKNOWN_TLV);
+    EXPECT_EQ(parse({ DEVICE_CONFIG_VERSION, 0x21, 0x00, 1, 0 }), CONFIG_STATUS::UNKNOWN_TLV);
+    expectAck(0x21, CONFIG_STATUS::UNKNOWN_TLV);
+}
+
+TEST_F(DeviceConfigTest, OutOfRangeValuesAreRejected) {
+    // one TLV per type, just past its valid range (see the README)
+    const std::vector<std::vector<uint8_t>> invalid = {
+        { (uint8_t)CONFIG_TLV::NORMAL_INTERVAL, 2, 0x00, 0x09 },
+        { (uint8_t)CONFIG_TLV::ACTIVE_INTERVAL, 2, 0x00, 0x09 },
+        { (uint8_t)CONFIG_TLV::TRIGGER_NTU, 2, 0x00, 0x00 },
+        { (uint8_t)CONFIG_TLV::TRIGGER_NTU, 2, 0x0B, 0xB9 }, // 3001
+        { (uint8_t)CONFIG_TLV::TURBIDITY_SAMPLES, 1, 0 },
+        { (uint8_t)CONFIG_TLV::TX_POWER, 1, 11 },
+        { (uint8_t)CONFIG_TLV::ACTIVE_CYCLES, 1, 0 },
+        { (uint8_t)CONFIG_TLV::DETECTOR_THRESHOLD, 1, 9 },
+    };
+    uint8_t command_id = 0x30;
+    for (const std::vector<uint8_t> &tlv : invalid) {
+        std::vector<uint8_t> downlink = { DEVICE_CONFIG_VERSION, command_id };
+        downlink.insert(downlink.end(), tlv.begin(), tlv.end());
+        EXPECT_EQ(parse(downlink), CONFIG_STATUS::INVALID_VALUE) << "type " << (int)tlv[0];
+        expectAck(command_id++, CONFIG_STATUS::INVALID_VALUE);
+    }
+
+    // the port is checked when applied, compression & slack take any value
+    EXPECT_EQ(parse({ DEVICE_CONFIG_VERSION, 0x40, (uint8_t)CONFIG_TLV::PAYLOAD_PORT, 1, 0xFF,
+                      (uint8_t)CONFIG_TLV::COMPRESSION, 2, 0xFF, 0xFF, (uint8_t)CONFIG_TLV::DETECTOR_SLACK, 1, 0xFF }),
+              CONFIG_STATUS::OK);
+    deviceConfig pending;
+    ASSERT_TRUE(getPendingDeviceConfig(&pending));
+    EXPECT_EQ(pending.payload_port, 0xFF);
+    EXPECT_EQ(pending.compression_dntu, 0xFFFF);
+    EXPECT_EQ(pending.detector_slack_dsigma, 0xFF);
+    finishDeviceConfig(&pending, false);
+    expectAck(0x40, CONFIG_STATUS::APPLY_FAILED);
+}
+
+TEST_F(DeviceConfigTest, WrongLengthIsMalformedForEveryType) {
+    for (uint8_t type = (uint8_t)CONFIG_TLV::NORMAL_INTERVAL; type <= (uint8_t)CONFIG_TLV::DETECTOR_THRESHOLD; type++) {
+        bool two_bytes = (type == (uint8_t)CONFIG_TLV::NORMAL_INTERVAL) ||
+                         (type == (uint8_t)CONFIG_TLV::ACTIVE_INTERVAL) || (type == (uint8_t)CONFIG_TLV::TRIGGER_NTU) ||
+                         (type == (uint8_t)CONFIG_TLV::COMPRESSION);
+        std::vector<uint8_t> downlink = { DEVICE_CONFIG_VERSION, type, type };
+        if (two_bytes) {
+            downlink.insert(downlink.end(), { 1, 20 });
+        } else {
+            downlink.insert(downlink.end(), { 2, 0, 20 });
+        }
+        EXPECT_EQ(parse(downlink), CONFIG_STATUS::MALFORMED) << "type " << (int)type;
+        expectAck(type, CONFIG_STATUS::MALFORMED);
+    }
+}
+
+TEST_F(DeviceConfigTest, DuplicateTypeTakesTheLastValue) {
+    EXPECT_EQ(parse({ DEVICE_CONFIG_VERSION, 0x50, (uint8_t)CONFIG_TLV::TX_POWER, 1, 3, (uint8_t)CONFIG_TLV::TX_POWER,
+                      1, 7 }),
+              CONFIG_STATUS::OK);
+    deviceConfig pending;
+    ASSERT_TRUE(getPendingDeviceConfig(&pending));
+    EXPECT_EQ(pending.tx_power, 7u);
+    finishDeviceConfig(&pending, false);
+    takeDeviceConfigAck(ack);
+
+    // but any invalid copy still rejects the whole downlink
+    EXPECT_EQ(parse({ DEVICE_CONFIG_VERSION, 0x51, (uint8_t)CONFIG_TLV::TX_POWER, 1, 11, (uint8_t)CONFIG_TLV::TX_POWER,
+                      1, 7 }),
+              CONFIG_STATUS::INVALID_VALUE);
+    expectAck(0x51, CONFIG_STATUS::INVALID_VALUE);
+}
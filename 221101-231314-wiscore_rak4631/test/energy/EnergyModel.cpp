@@ -0,0 +1,162 @@
+/**
+ * @file EnergyModel.cpp
+ * @brief Charge drawn by the device from the host HAL's power events, see EnergyModel.h.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "EnergyModel.h"
+
+#include "AirtimeBudget.h"
+
+#define ENERGY_MS_PER_DAY (24.0 * 60 * 60 * 1000)
+#define ENERGY_UC_PER_MAH 3.6e6
+
+/** @brief SX1262 TX current at its output power, datasheet figures with the DC-DC on. */
+static const struct {
+    float dbm;
+    float ma;
+} TX_CURRENT[] = { { -9, 14 }, { 10, 26 }, { 14, 45 }, { 17, 90 }, { 20, 102 }, { 22, 118 } };
+
+static float txCurrentMa(float dbm) {
+    const size_t points = sizeof(TX_CURRENT) / sizeof(TX_CURRENT[0]);
+    if (dbm <= TX_CURRENT[0].dbm) {
+        return TX_CURRENT[0].ma;
+    }
+    for (size_t i = 1; i < points; i++) {
+        if (dbm <= TX_CURRENT[i].dbm) {
+            float f = (dbm - TX_CURRENT[i - 1].dbm) / (TX_CURRENT[i].dbm - TX_CURRENT[i - 1].dbm);
+            return TX_CURRENT[i - 1].ma + f * (TX_CURRENT[i].ma - TX_CURRENT[i - 1].ma);
+        }
+    }
+    return TX_CURRENT[points - 1].ma;
+}
+
+energyParams::energyParams(void) {
+    for (uint8_t tx_power = 0; tx_power <= TX_POWER_10; tx_power++) {
+        tx_ma[tx_power] = txCurrentMa(min(22.0f, 30.0f - 2.0f * tx_power - 2.15f));
+    }
+}
+
+// REPORT
+
+double energyReport::totalUc(void) const {
+    double total = 0;
+    for (double state_uc : charge_uc) {
+        total += state_uc;
+    }
+    return total;
+}
+
+double energyReport::mahPerDay(void) const {
+    if (duration_ms <= 0) {
+        return 0;
+    }
+    return totalUc() / ENERGY_UC_PER_MAH * ENERGY_MS_PER_DAY / duration_ms;
+}
+
+double energyReport::batteryDays(const energyParams &params) const {
+    double per_day = mahPerDay() + params.battery_mah * params.self_discharge_day;
+    return (per_day > 0) ? params.battery_mah * params.battery_usable / per_day : 0;
+}
+
+// MODEL
+
+void energyModel::charge(ENERGY_STATE state, double ma, double ms) { totals.charge_uc[(size_t)state] += ma * ms; }
+
+uint32_t energyModel::rxWindowUs(uint8_t data_rate, uint16_t length) const {
+    // DR8 - DR13: SF12 - SF7 at 500 kHz
+    loraModulation modulation = { (uint8_t)(12 - (constrain(data_rate, 8, 13) - 8)), 500 };
+    uint32_t open_us;
+    if (length > 0) {
+        open_us = loraTimeOnAirUs(&modulation, (uint8_t)min(length, (uint16_t)UINT8_MAX));
+    } else {
+        open_us = params.rx_symbols * ((1UL << modulation.spreading_factor) * 1000 / modulation.bandwidth_khz);
+    }
+    return open_us + params.rx_margin_ms * 1000;
+}
+
+void energyModel::begin(uint64_t start_ms) {
+    totals = {};
+    running = true;
+    this->start_ms = start_ms;
+    rail_on = hostPinLevel(params.rail_pin) == HIGH;
+    rail_whole = false;
+    rail_since_ms = start_ms;
+}
+
+void energyModel::railOff(uint64_t now_ms, bool whole) {
+    int64_t on_ms = (int64_t)(now_ms - rail_since_ms);
+    if (whole) {
+        // only a span switched on & off in the run has the whole warm-up in it
+        on_ms += (int64_t)params.rail_warmup_ms - SENSOR_RAIL_WARMUP_MS;
+    }
+    if (on_ms > 0) {
+        totals.rail_on_ms += on_ms;
+        charge(ENERGY_STATE::RAIL, params.rail_ma, on_ms);
+    }
+    rail_on = false;
+}
+
+void energyModel::add(const hostPowerEvent &event) {
+    if (!running) {
+        return;
+    }
+    switch (event.type) {
+        case HOST_POWER::PIN:
+            if (event.pin != params.rail_pin) {
+                break;
+            }
+            if ((event.level == HIGH) && !rail_on) {
+                rail_on = true;
+                rail_whole = true;
+                rail_since_ms = event.time_ms;
+            } else if ((event.level != HIGH) && rail_on) {
+                railOff(event.time_ms, rail_whole);
+            }
+            break;
+        case HOST_POWER::WAKE:
+            totals.wakes++;
+            charge(ENERGY_STATE::MCU, params.mcu_ma, params.wake_us / 1000.0);
+            break;
+        case HOST_POWER::ADC_SAMPLE:
+            totals.adc_samples++;
+            charge(ENERGY_STATE::MCU, params.mcu_ma, params.sample_us / 1000.0);
+            charge(ENERGY_STATE::ADC, params.adc_ma, params.sample_us / 1000.0);
+            break;
+        case HOST_POWER::RADIO_TX:
+            totals.tx_frames++;
+            totals.tx_ms += event.duration_ms;
+            charge(ENERGY_STATE::TX, params.standby_ma, params.standby_ms);
+            charge(ENERGY_STATE::TX, params.tx_ma[min(event.tx_power, (uint8_t)TX_POWER_10)], event.duration_ms);
+            break;
+        case HOST_POWER::RADIO_RX: {
+            uint32_t open_us = rxWindowUs(event.data_rate, event.length);
+            totals.rx_windows++;
+            totals.rx_frames += event.length > 0;
+            totals.rx_us += open_us;
+            charge(ENERGY_STATE::RX, params.standby_ma, params.standby_ms);
+            charge(ENERGY_STATE::RX, params.rx_ma, open_us / 1000.0);
+            break;
+        }
+        case HOST_POWER::FLASH_WRITE:
+            totals.flash_bytes += event.length;
+            charge(ENERGY_STATE::FLASH, params.flash_ma, event.length * params.flash_us_per_byte / 1000.0);
+            break;
+    }
+}
+
+void energyModel::finish(uint64_t end_ms) {
+    if (!running) {
+        return;
+    }
+    if (rail_on) {
+        railOff(end_ms, false);
+    }
+    running = false;
+    totals.duration_ms = (double)(end_ms - start_ms);
+    charge(ENERGY_STATE::IDLE, params.idle_ua / 1000.0, totals.duration_ms);
+}
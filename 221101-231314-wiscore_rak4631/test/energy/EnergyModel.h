@@ -0,0 +1,147 @@
+#pragma once
+/**
+ * @file EnergyModel.h
+ * @brief Charge drawn by the device, from the host HAL's power events (HostHal.h): each state's current over the time
+ * the firmware spends in it, on top of the idle current for the whole run. The firmware runs in virtual time, so the
+ * event trace has every pin change, wake, ADC sample, frame & RX window the firmware asked for, at the millisecond.
+ *
+ * The currents & times are parameters (energyParams), rough figures for a RAK4631 & the analog turbidity sensor by
+ * default. Charge is kept in µC (mA x ms), so mAh/day & battery life follow without a supply voltage.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "HostHal.h"
+
+#include <LoRaWan-RAK4630.h>
+
+#include "PowerRails.h"
+
+#define ENERGY_IDLE_UA            3.0f    /**< System ON idle, RTC running, radio asleep. */
+#define ENERGY_MCU_MA             3.0f    /**< nRF52840 running from flash with the DC-DC on. */
+#define ENERGY_WAKE_US            100     /**< CPU awake per wake from idle: the tick, a timer or a task. */
+#define ENERGY_SAMPLE_US          40      /**< CPU & SAADC busy per analogRead() in the burst loop, oversampling on. */
+#define ENERGY_ADC_MA             1.0f    /**< SAADC converting. */
+#define ENERGY_RAIL_MA            40.0f   /**< Turbidity sensor on the switched 3V3_S rail. */
+#define ENERGY_RADIO_STANDBY_MA   1.6f    /**< SX1262 in STDBY_XOSC, before each TX & RX window. */
+#define ENERGY_RADIO_STANDBY_MS   4       /**< TCXO start, calibration & setup per TX or RX window. */
+#define ENERGY_RX_MA              5.3f    /**< SX1262 receiving, DC-DC on. */
+#define ENERGY_RX_SYMBOLS         6       /**< An RX window with nothing in it closes after this many symbols... */
+#define ENERGY_RX_MARGIN_MS       5       /**< ... plus this for clock error. */
+#define ENERGY_FLASH_MA           3.5f    /**< nRF52840 writing or erasing flash. */
+#define ENERGY_FLASH_US_PER_BYTE  30.0f   /**< Word writes plus a share of the 85 ms page erase, per byte. */
+#define ENERGY_BATTERY_MAH        3200.0f /**< An 18650 cell. */
+#define ENERGY_BATTERY_USABLE     0.8f    /**< Share of the capacity above the brown-out voltage & over temperature. */
+#define ENERGY_SELF_DISCHARGE_DAY 0.0007f /**< Share of the capacity lost a day, about 2 % a month. */
+
+/** @brief What the charge is drawn by. */
+enum class ENERGY_STATE : uint8_t {
+    IDLE,  /**< The idle current, all the time. */
+    MCU,   /**< CPU awake: wakes & the sample loop. */
+    ADC,   /**< SAADC converting. */
+    RAIL,  /**< Sensor rail on. */
+    TX,    /**< Radio transmitting, and in standby before it. */
+    RX,    /**< RX windows, and standby before them. */
+    FLASH, /**< Flash writes. */
+    COUNT,
+};
+
+/** @brief The model's currents & times. */
+struct energyParams {
+    float idle_ua = ENERGY_IDLE_UA;
+    float mcu_ma = ENERGY_MCU_MA;
+    uint32_t wake_us = ENERGY_WAKE_US;
+    uint32_t sample_us = ENERGY_SAMPLE_US;
+    float adc_ma = ENERGY_ADC_MA;
+    float rail_ma = ENERGY_RAIL_MA;
+    uint32_t rail_pin = SENSOR_RAIL_PIN;
+    /**
+     * The sensor rail's warm-up. The firmware is built with SENSOR_RAIL_WARMUP_MS; anything else stretches or shortens
+     * each time the rail is on by the difference, to see what a different sensor would cost without a rebuild.
+     */
+    uint32_t rail_warmup_ms = SENSOR_RAIL_WARMUP_MS;
+    float tx_ma[TX_POWER_10 + 1]; /**< By TX_POWER_n, see energyParams(). */
+    float standby_ma = ENERGY_RADIO_STANDBY_MA;
+    uint32_t standby_ms = ENERGY_RADIO_STANDBY_MS;
+    float rx_ma = ENERGY_RX_MA;
+    uint32_t rx_symbols = ENERGY_RX_SYMBOLS;
+    uint32_t rx_margin_ms = ENERGY_RX_MARGIN_MS;
+    float flash_ma = ENERGY_FLASH_MA;
+    float flash_us_per_byte = ENERGY_FLASH_US_PER_BYTE;
+    float battery_mah = ENERGY_BATTERY_MAH;
+    float battery_usable = ENERGY_BATTERY_USABLE;
+    float self_discharge_day = ENERGY_SELF_DISCHARGE_DAY;
+
+    /**
+     * @brief The defaults, with tx_ma from the SX1262 datasheet's TX current at TX_POWER_n's output power: AU915's
+     * 30 dBm max EIRP less 2n dB, less the 2.15 dBi antenna gain, capped at the SX1262's 22 dBm.
+     */
+    energyParams(void);
+};
+
+/** @brief A run's charge by state, and what it was drawn by. Plain data, so it can be sent between processes. */
+struct energyReport {
+    double duration_ms;
+    double charge_uc[(size_t)ENERGY_STATE::COUNT]; /**< µC (mA x ms) by ENERGY_STATE. */
+    uint32_t wakes;
+    uint32_t adc_samples;
+    uint32_t tx_frames;
+    uint32_t rx_windows;
+    uint32_t rx_frames;  /**< RX windows that heard a frame. */
+    uint64_t rail_on_ms; /**< With the warm-up adjusted, see energyParams::rail_warmup_ms. */
+    uint64_t tx_ms;
+    uint64_t rx_us;
+    uint64_t flash_bytes;
+
+    double totalUc(void) const;
+    double mahPerDay(void) const;
+
+    /**
+     * @brief Days a battery lasts at this rate, self-discharge included.
+     */
+    double batteryDays(const energyParams &params) const;
+};
+
+/**
+ * @brief Adds up a run's power events. Hand it every event between begin() and finish(), e.g. from
+ * hostOnPowerEvent(); events outside them are ignored.
+ */
+class energyModel {
+  public:
+    explicit energyModel(const energyParams &params = energyParams()) : params(params){};
+
+    /**
+     * @brief Starts a run at virtual time start_ms, the rail's level then read from the HAL.
+     */
+    void begin(uint64_t start_ms);
+
+    void add(const hostPowerEvent &event);
+
+    /**
+     * @brief Ends the run, the rail's on-time & the idle charge up to end_ms.
+     */
+    void finish(uint64_t end_ms);
+
+    inline const energyReport &report(void) const { return totals; };
+
+    /**
+     * @brief Time an RX window is open: the downlink's time on air if it heard one (length > 0), else the symbol
+     * timeout at its data rate (AU915 DR8 - DR13 are SF12 - SF7 at 500 kHz), plus the margin.
+     */
+    uint32_t rxWindowUs(uint8_t data_rate, uint16_t length) const;
+
+  private:
+    void charge(ENERGY_STATE state, double ma, double ms);
+    void railOff(uint64_t now_ms, bool whole);
+
+    energyParams params;
+    energyReport totals = {};
+    bool running = false;
+    uint64_t start_ms = 0;
+    bool rail_on = false;
+    bool rail_whole = false; // switched on in the run, not on at begin()
+    uint64_t rail_since_ms = 0;
+};
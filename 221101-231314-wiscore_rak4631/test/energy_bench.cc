@@ -0,0 +1,266 @@
+/**
+ * @file energy_bench.cc
+ * @brief Runs a matrix of device configurations through the whole firmware on a recorded trace (see
+ * replay/FirmwareReplay.h) and compares each one's charge per day with a checked-in baseline, so a change that costs
+ * battery life fails CI. See energy/README.md.
+ *
+ * The matrix is a CSV: a name, then a column per setting (any of the device options, e.g. samples or tx-power, and
+ * warmup-ms for the energy model's sensor warm-up), an empty cell keeping the default. The baseline is a CSV of
+ * name,mah_per_day. Replays run in virtual time, so the same firmware & model always give the same figures.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "FirmwareReplay.h"
+
+#define BENCH_THRESHOLD_PCT 1.0f /**< Default change in mAh/day that fails the comparison. */
+
+/** @brief A row of the matrix. */
+struct benchConfig {
+    std::string name;
+    replayOptions options;
+};
+
+static std::vector<std::string> splitCsv(const std::string &line) {
+    std::vector<std::string> cells;
+    std::stringstream in(line);
+    std::string cell;
+    while (std::getline(in, cell, ',')) {
+        cells.push_back(cell);
+    }
+    if (!line.empty() && (line.back() == ',')) {
+        cells.push_back("");
+    }
+    return cells;
+}
+
+/**
+ * @brief Reads the matrix, each row's settings on top of base.
+ */
+static bool loadMatrix(const char *path, const replayOptions &base, std::vector<benchConfig> *configs,
+                       std::string *error) {
+    std::ifstream in(path);
+    if (!in) {
+        *error = std::string("can't open ") + path;
+        return false;
+    }
+    std::vector<std::string> columns;
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); line_number++) {
+        if (!line.empty() && (line.back() == '\r')) {
+            line.pop_back();
+        }
+        if (line.empty() || (line[0] == '#')) {
+            continue;
+        }
+        std::vector<std::string> cells = splitCsv(line);
+        if (columns.empty()) {
+            columns = cells;
+            continue;
+        }
+        if (cells.size() != columns.size()) {
+            *error = std::string(path) + ":" + std::to_string(line_number) + ": expected " +
+                     std::to_string(columns.size()) + " cells";
+            return false;
+        }
+        benchConfig config = { cells[0], base };
+        for (size_t i = 1; i < cells.size(); i++) {
+            if (cells[i].empty()) {
+                continue;
+            }
+            if (columns[i] == "warmup-ms") {
+                config.options.energy.rail_warmup_ms = atoi(cells[i].c_str());
+            } else if (!replayDeviceOption("--" + columns[i], cells[i].c_str(), &config.options)) {
+                *error = std::string(path) + ": unknown column " + columns[i];
+                return false;
+            }
+        }
+        configs->push_back(config);
+    }
+    if (configs->empty()) {
+        *error = std::string(path) + ": no configurations";
+        return false;
+    }
+    return true;
+}
+
+static std::map<std::string, double> loadBaseline(const char *path) {
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        std::vector<std::string> cells = splitCsv(line);
+        if ((cells.size() >= 2) && (cells[0] != "name") && (cells[0][0] != '#')) {
+            baseline[cells[0]] = atof(cells[1].c_str());
+        }
+    }
+    return baseline;
+}
+
+static bool saveBaseline(const char *path, const std::vector<benchConfig> &configs,
+                         const std::vector<replayJob> &jobs) {
+    FILE *out = fopen(path, "w");
+    if (out == nullptr) {
+        return false;
+    }
+    fprintf(out, "name,mah_per_day\n");
+    for (size_t i = 0; i < configs.size(); i++) {
+        fprintf(out, "%s,%.4f\n", configs[i].name.c_str(), jobs[i].result.energy.mahPerDay());
+    }
+    return fclose(out) == 0;
+}
+
+static void usage(void) {
+    printf("energy_bench [options] --matrix CSV TRACE\n"
+           "  TRACE                 CSV or binary trace, see test/replay/TraceFile.h\n"
+           "  --matrix CSV          configurations: name, then a column per option without the --, and warmup-ms\n"
+           "  --baseline CSV        name,mah_per_day to compare with; a config missing from it fails\n"
+           "  --threshold-pct P     change in mAh/day that fails the comparison (%.1f)\n"
+           "  --update-baseline     write the results to --baseline instead of comparing\n"
+           "  --events DIR          write each config's power events to DIR/NAME.csv\n"
+           "  --mv / --lead-in-s S  as trace_replay\n"
+           "  --jobs N              configs replayed at once, 0 = every core (0)\n",
+           BENCH_THRESHOLD_PCT);
+}
+
+int main(int argc, char **argv) {
+    replayOptions base;
+    const char *trace_path = nullptr;
+    const char *matrix_path = nullptr;
+    const char *baseline_path = nullptr;
+    const char *events_dir = nullptr;
+    float threshold_pct = BENCH_THRESHOLD_PCT;
+    bool update = false;
+    int parallel = 0;
+    for (int a = 1; a < argc; a++) {
+        std::string option = argv[a];
+        if ((option == "--help") || (option == "-h")) {
+            usage();
+            return 0;
+        }
+        if (option[0] != '-') {
+            trace_path = argv[a];
+            continue;
+        }
+        if (option == "--mv") {
+            base.millivolts = true;
+            continue;
+        }
+        if (option == "--update-baseline") {
+            update = true;
+            continue;
+        }
+        if (a + 1 >= argc) {
+            fprintf(stderr, "%s needs a value\n", argv[a]);
+            return 1;
+        }
+        const char *value = argv[++a];
+        if (option == "--matrix") {
+            matrix_path = value;
+        } else if (option == "--baseline") {
+            baseline_path = value;
+        } else if (option == "--threshold-pct") {
+            threshold_pct = atof(value);
+        } else if (option == "--events") {
+            events_dir = value;
+        } else if (option == "--lead-in-s") {
+            base.lead_in_ms = atoi(value) * 1000UL;
+        } else if (option == "--jobs") {
+            parallel = atoi(value);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[a - 1]);
+            usage();
+            return 1;
+        }
+    }
+    if ((trace_path == nullptr) || (matrix_path == nullptr) || (update && (baseline_path == nullptr))) {
+        usage();
+        return 1;
+    }
+
+    std::vector<benchConfig> configs;
+    std::string error;
+    if (!loadMatrix(matrix_path, base, &configs, &error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    std::vector<replayJob> jobs;
+    for (benchConfig &config : configs) {
+        if (events_dir != nullptr) {
+            config.options.events_path = std::string(events_dir) + "/" + config.name + ".csv";
+        }
+        replayJob job;
+        job.path = trace_path;
+        job.options = config.options;
+        jobs.push_back(job);
+    }
+    if (!replayAll(&jobs, parallel)) {
+        fprintf(stderr, "can't start a replay process\n");
+        return 1;
+    }
+
+    std::map<std::string, double> baseline;
+    if ((baseline_path != nullptr) && !update) {
+        baseline = loadBaseline(baseline_path);
+    }
+    printf("mAh/day by state, battery %.0f mAh x %.0f %%; %s\n", base.energy.battery_mah,
+           base.energy.battery_usable * 100, trace_path);
+    printf("%-16s %6s %6s %6s %6s %6s %6s %6s %8s %7s %7s %6s %8s %8s\n", "config", "idle", "mcu", "adc", "rail", "tx",
+           "rx", "flash", "mAh/d", "life-d", "uplinks", "found", "base", "change");
+    bool failed = false;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const replayResult &result = jobs[i].result;
+        const char *name = configs[i].name.c_str();
+        if (!result.ok) {
+            printf("%s: %s\n", name, result.error);
+            failed = true;
+            continue;
+        }
+        const energyReport &energy = result.energy;
+        double per_day = energy.mahPerDay();
+        printf("%-16s", name);
+        for (size_t state = 0; state < (size_t)ENERGY_STATE::COUNT; state++) {
+            // the states' share of the day's charge
+            printf(" %6.2f", (energy.totalUc() > 0) ? per_day * energy.charge_uc[state] / energy.totalUc() : 0.0);
+        }
+        printf(" %8.2f %7.0f %7u %3u/%-2u", per_day, energy.batteryDays(configs[i].options.energy), result.uplinks,
+               result.detected, result.events);
+        if (baseline_path == nullptr || update) {
+            printf("\n");
+            continue;
+        }
+        auto found = baseline.find(configs[i].name);
+        if (found == baseline.end()) {
+            printf(" %8s  no baseline\n", "-");
+            failed = true;
+            continue;
+        }
+        double change_pct = (found->second > 0) ? (per_day / found->second - 1) * 100 : INFINITY;
+        bool regressed = change_pct > threshold_pct;
+        printf(" %8.2f %+7.1f%%%s\n", found->second, change_pct,
+               regressed ? "  REGRESSION" : ((change_pct < -threshold_pct) ? "  better, update the baseline" : ""));
+        failed |= regressed;
+    }
+    if (update) {
+        if (failed || !saveBaseline(baseline_path, configs, jobs)) {
+            fprintf(stderr, "baseline not written\n");
+            return 1;
+        }
+        printf("baseline written to %s\n", baseline_path);
+    }
+    return failed ? 1 : 0;
+}
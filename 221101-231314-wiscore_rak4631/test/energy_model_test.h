@@ -0,0 +1,179 @@
+#include <gtest/gtest.h>
+
+#include "energy/EnergyModel.h"
+#include "hal/HostHal.h"
+
+// The energy model's arithmetic, and the host HAL's power events it is fed
+
+class EnergyModelTest : public ::testing::Test {
+  protected:
+    void SetUp(void) override {
+        hostReset();
+        hostResetPins();
+        hostRadioReset();
+    }
+    void TearDown(void) override {
+        hostOnPowerEvent(nullptr);
+        hostRadioReset();
+        hostResetPins();
+        hostReset();
+    }
+};
+
+static hostPowerEvent powerEvent(uint64_t time_ms, HOST_POWER type) {
+    hostPowerEvent event = {};
+    event.time_ms = time_ms;
+    event.type = type;
+    return event;
+}
+
+TEST_F(EnergyModelTest, ChargeByState) {
+    energyParams params;
+    params.rail_warmup_ms = SENSOR_RAIL_WARMUP_MS - 1000;
+    energyModel model(params);
+    model.begin(0);
+    // ignored: not the rail, and a second switch on
+    hostPowerEvent pin = powerEvent(1000, HOST_POWER::PIN);
+    pin.pin = params.rail_pin + 1;
+    pin.level = HIGH;
+    model.add(pin);
+    pin.pin = params.rail_pin;
+    model.add(pin);
+    pin.time_ms = 2000;
+    model.add(pin);
+    pin.time_ms = 11000;
+    pin.level = LOW;
+    model.add(pin);
+    model.add(powerEvent(3000, HOST_POWER::WAKE));
+    for (int i = 0; i < 10; i++) {
+        model.add(powerEvent(6000 + i, HOST_POWER::ADC_SAMPLE));
+    }
+    hostPowerEvent tx = powerEvent(12000, HOST_POWER::RADIO_TX);
+    tx.tx_power = TX_POWER_10;
+    tx.duration_ms = 200;
+    model.add(tx);
+    hostPowerEvent rx = powerEvent(13200, HOST_POWER::RADIO_RX);
+    rx.data_rate = 8;
+    model.add(rx);
+    hostPowerEvent flash = powerEvent(14000, HOST_POWER::FLASH_WRITE);
+    flash.length = 100;
+    model.add(flash);
+    model.finish(3600 * 1000);
+    // after finish(), ignored
+    model.add(tx);
+
+    const energyReport &report = model.report();
+    EXPECT_DOUBLE_EQ(report.duration_ms, 3600 * 1000.0);
+    // 10 s on, less the second of warm-up the model saves
+    EXPECT_EQ(report.rail_on_ms, 9000u);
+    EXPECT_NEAR(report.charge_uc[(size_t)ENERGY_STATE::RAIL], params.rail_ma * 9000, 1e-6);
+    EXPECT_NEAR(report.charge_uc[(size_t)ENERGY_STATE::IDLE], params.idle_ua / 1000 * 3600 * 1000, 1e-6);
+    EXPECT_EQ(report.wakes, 1u);
+    EXPECT_EQ(report.adc_samples, 10u);
+    EXPECT_NEAR(report.charge_uc[(size_t)ENERGY_STATE::MCU], params.mcu_ma * (params.wake_us + 10 * params.sample_us) /
+                                                                 1000.0, 1e-6);
+    EXPECT_NEAR(report.charge_uc[(size_t)ENERGY_STATE::ADC], params.adc_ma * 10 * params.sample_us / 1000.0, 1e-6);
+    EXPECT_EQ(report.tx_frames, 1u);
+    EXPECT_NEAR(report.charge_uc[(size_t)ENERGY_STATE::TX],
+                params.standby_ma * params.standby_ms + params.tx_ma[TX_POWER_10] * 200, 1e-3);
+    // an empty RX2 at DR8 (SF12, 500 kHz): 6 symbols of 8.192 ms & the margin
+    EXPECT_EQ(report.rx_windows, 1u);
+    EXPECT_EQ(report.rx_frames, 0u);
+    EXPECT_EQ(report.rx_us, 6 * 8192u + params.rx_margin_ms * 1000);
+    EXPECT_EQ(report.flash_bytes, 100u);
+    EXPECT_NEAR(report.charge_uc[(size_t)ENERGY_STATE::FLASH], params.flash_ma * 100 * params.flash_us_per_byte / 1000,
+                1e-6);
+}
+
+TEST_F(EnergyModelTest, TxCurrentFallsWithThePowerSetting) {
+    energyParams params;
+    // TX_POWER_0 is 27.85 dBm, capped at 22 dBm
+    EXPECT_FLOAT_EQ(params.tx_ma[TX_POWER_0], 118.0f);
+    for (uint8_t tx_power = TX_POWER_1; tx_power <= TX_POWER_10; tx_power++) {
+        EXPECT_LE(params.tx_ma[tx_power], params.tx_ma[tx_power - 1]);
+    }
+    EXPECT_LT(params.tx_ma[TX_POWER_10], 26.0f);
+}
+
+TEST_F(EnergyModelTest, RxWindowIsTheDownlinkWhenItHearsOne) {
+    energyModel model;
+    // DR13 is SF7 at 500 kHz
+    uint32_t empty_us = model.rxWindowUs(13, 0);
+    EXPECT_EQ(empty_us, 6 * 256u + ENERGY_RX_MARGIN_MS * 1000);
+    uint32_t heard_us = model.rxWindowUs(13, 21);
+    EXPECT_GT(heard_us, empty_us);
+    EXPECT_GT(model.rxWindowUs(8, 21), heard_us);
+}
+
+TEST_F(EnergyModelTest, MahPerDayAndBatteryLife) {
+    energyParams params;
+    params.self_discharge_day = 0;
+    energyReport report = {};
+    report.duration_ms = 12 * 3600 * 1000.0;
+    // 5 mAh in half a day
+    report.charge_uc[(size_t)ENERGY_STATE::RAIL] = 5 * 3.6e6;
+    EXPECT_NEAR(report.mahPerDay(), 10.0, 1e-9);
+    EXPECT_NEAR(report.batteryDays(params), params.battery_mah * params.battery_usable / 10.0, 1e-9);
+    params.self_discharge_day = 0.001f;
+    EXPECT_LT(report.batteryDays(params), params.battery_mah * params.battery_usable / 10.0);
+    report = {};
+    EXPECT_EQ(report.mahPerDay(), 0.0);
+}
+
+TEST_F(EnergyModelTest, HalEmitsPowerEvents) {
+    std::vector<hostPowerEvent> events;
+    hostOnPowerEvent([&events](const hostPowerEvent &event) { events.push_back(event); });
+    digitalWrite(WB_IO2, HIGH);
+    digitalWrite(WB_IO2, HIGH); // no change, no event
+    analogRead(WB_A1);
+    digitalWrite(WB_IO2, LOW);
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_EQ(events[0].type, HOST_POWER::PIN);
+    EXPECT_EQ(events[0].pin, (uint32_t)WB_IO2);
+    EXPECT_EQ(events[0].level, HIGH);
+    EXPECT_EQ(events[1].type, HOST_POWER::ADC_SAMPLE);
+    EXPECT_EQ(events[2].type, HOST_POWER::PIN);
+    EXPECT_EQ(events[2].level, LOW);
+
+    // a task waking from a delay
+    events.clear();
+    xTaskCreate(
+        [](void *) {
+            vTaskDelay(pdMS_TO_TICKS(1000));
+            vTaskDelay(portMAX_DELAY);
+        },
+        "WAKE", 256, NULL, TASK_PRIO_NORMAL, NULL);
+    hostRunFor(1500);
+    ASSERT_EQ(events.size(), 1u);
+    EXPECT_EQ(events[0].type, HOST_POWER::WAKE);
+    EXPECT_EQ(events[0].time_ms, 1000u);
+
+    // a join, then an uplink with nothing to receive: the frames & both RX windows of each
+    hostRadioConnect(nullptr);
+    lmh_callback_t callbacks = {};
+    lmh_param_t params = {};
+    params.tx_data_rate = DR_2;
+    params.tx_power = TX_POWER_10;
+    ASSERT_EQ(lmh_init(&callbacks, params, true, CLASS_A, LORAMAC_REGION_AU915), LMH_SUCCESS);
+    lmh_join();
+    delay(6000); // the built-in network accepts after 5 s
+    ASSERT_EQ(lmh_join_status_get(), LMH_SET);
+    events.clear();
+    uint8_t data[10] = {};
+    lmh_app_data_t app_data = { data, sizeof(data), 10, 0, 0 };
+    uint64_t sent_ms = hostNowMs();
+    ASSERT_EQ(lmh_send(&app_data, LMH_UNCONFIRMED_MSG), LMH_SUCCESS);
+    ASSERT_EQ(events.size(), 3u);
+    EXPECT_EQ(events[0].type, HOST_POWER::RADIO_TX);
+    EXPECT_EQ(events[0].length, sizeof(data) + 13);
+    EXPECT_EQ(events[0].data_rate, DR_2);
+    EXPECT_EQ(events[0].tx_power, TX_POWER_10);
+    EXPECT_EQ(events[0].duration_ms, hostTimeOnAirMs(DR_2, sizeof(data)));
+    EXPECT_EQ(events[1].type, HOST_POWER::RADIO_RX);
+    EXPECT_EQ(events[1].time_ms, sent_ms + events[0].duration_ms + 1000);
+    EXPECT_EQ(events[1].data_rate, 10);
+    EXPECT_EQ(events[1].length, 0u);
+    EXPECT_EQ(events[2].type, HOST_POWER::RADIO_RX);
+    EXPECT_EQ(events[2].time_ms, sent_ms + events[0].duration_ms + 2000);
+    EXPECT_EQ(events[2].data_rate, 8);
+}
@@ -0,0 +1,62 @@
+#include "../lib/SensorHelper/src/EventMode.h"
+
+// advance() calls until active mode ends, or -1 if it doesn't within limit
+static int advancesUntilNormal(eventMode *mode, int limit) {
+    for (int i = 1; i <= limit; i++) {
+        if (mode->advance()) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+TEST(EventModeTest, RisingSwitchesToActiveThenBack) {
+    eventMode mode(10);
+    EXPECT_EQ(mode.mode(), EVENT_MODE::NORMAL_MODE);
+    EXPECT_FALSE(mode.alert());
+    EXPECT_FALSE(mode.advance());
+    EXPECT_FALSE(mode.update(TURBIDITY_SIGNAL::QUIET));
+
+    // the trigger reading is already an alert
+    EXPECT_TRUE(mode.update(TURBIDITY_SIGNAL::RISING));
+    EXPECT_TRUE(mode.triggered());
+    EXPECT_TRUE(mode.alert());
+    EXPECT_FALSE(mode.advance());
+    EXPECT_EQ(mode.mode(), EVENT_MODE::SWITCH_MODE);
+    EXPECT_FALSE(mode.advance());
+    EXPECT_EQ(mode.mode(), EVENT_MODE::ACTIVE_MODE);
+    EXPECT_FALSE(mode.triggered());
+    EXPECT_TRUE(mode.alert());
+    // only triggers from normal mode
+    EXPECT_FALSE(mode.update(TURBIDITY_SIGNAL::RISING));
+
+    // the switch cycle counts as the first of active_cycles
+    EXPECT_EQ(advancesUntilNormal(&mode, 20), 10);
+    EXPECT_EQ(mode.mode(), EVENT_MODE::NORMAL_MODE);
+    EXPECT_FALSE(mode.alert());
+}
+
+TEST(EventModeTest, ElevatedReadingsKeepActiveMode) {
+    eventMode mode(5);
+    mode.update(TURBIDITY_SIGNAL::RISING);
+    mode.advance();
+    mode.advance();
+    for (int i = 0; i < 3; i++) {
+        EXPECT_FALSE(mode.advance());
+    }
+    // starts the count again
+    EXPECT_FALSE(mode.update(TURBIDITY_SIGNAL::ELEVATED));
+    EXPECT_EQ(advancesUntilNormal(&mode, 20), 5);
+
+    // a new active_cycles applies to the next event
+    mode.configure(2);
+    mode.update(TURBIDITY_SIGNAL::RISING);
+    mode.advance();
+    mode.advance();
+    EXPECT_EQ(advancesUntilNormal(&mode, 20), 1);
+}
+
+TEST(EventModeTest, Names) {
+    EXPECT_STREQ(eventModeName(EVENT_MODE::NORMAL_MODE), "normal");
+    EXPECT_STREQ(eventModeName(EVENT_MODE::ACTIVE_MODE), "active mode");
+}
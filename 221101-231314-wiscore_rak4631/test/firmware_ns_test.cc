@@ -0,0 +1,257 @@
+/**
+ * @file firmware_ns_test.cc
+ * @brief The whole firmware on the host HAL against the network server stand-in (test/ns/), over a local socket: real
+ * OTAA join, MICs, encryption & frame counters, and downlinks that change what the firmware does.
+ *
+ * Like firmware_test.cc the tests share one boot, and each must also work from a fresh boot (ctest runs each test in
+ * its own process).
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <gtest/gtest.h>
+
+#include "HostHal.h"
+#include "DeviceConfig.h"
+#include "LoRaWAN_functs.h"
+#include "LoRaWAN_session.h"
+#include "NsSocket.h"
+#include "Outbox.h"
+#include "SensorHelper.h"
+#include "WallClock.h"
+
+void setup(void);
+void loop(void);
+
+// OTAA_keys.h, included by main.cpp
+extern uint8_t OTAA_KEY_APP_EUI[8];
+extern uint8_t OTAA_KEY_DEV_EUI[8];
+extern uint8_t OTAA_KEY_APP_KEY[16];
+
+#define HOST_BATTERY_MV       3900.0f
+#define HOST_CLEAR_MV         1400.0f
+#define HOST_FIRST_READING_MS (5UL * 60 * 1000)
+#define HOST_UNIX_START_S     1667260800UL /**< 2022-11-01, the application server's clock at virtual time 0. */
+#define HOST_RX_DELAY_S       5            /**< RxDelay in the join accept, not the default 1 s. */
+
+static networkServer server;
+static nsSocketServer server_socket;
+
+/**
+ * @brief The application server: answers time requests (see the WallClock README) with the time the request ended.
+ */
+static void applicationServer(const nsUplink &uplink) {
+    if ((uplink.port != CLOCK_SYNC_PORT) || (uplink.data.size() < 2)) {
+        return;
+    }
+    uint64_t unix_ms = HOST_UNIX_START_S * 1000ULL + uplink.rx_ms;
+    uint32_t seconds = (uint32_t)(unix_ms / 1000);
+    uint16_t ms = (uint16_t)(unix_ms % 1000);
+    std::vector<uint8_t> answer = { CLOCK_SYNC_VERSION, uplink.data[1], (uint8_t)(seconds >> 24),
+                                    (uint8_t)(seconds >> 16), (uint8_t)(seconds >> 8), (uint8_t)seconds,
+                                    (uint8_t)(ms >> 8), (uint8_t)ms };
+    server.queueDownlink(uplink.dev_eui, CLOCK_SYNC_PORT, answer);
+}
+
+/**
+ * @brief Starts the server & boots the firmware connected to it the first time it's called, then runs until the first
+ * reading goes out.
+ */
+static void bootFirmware(void) {
+    static bool booted = false;
+    if (booted) {
+        return;
+    }
+    booted = true;
+    server.addDevice(OTAA_KEY_DEV_EUI, OTAA_KEY_APP_EUI, OTAA_KEY_APP_KEY);
+    server.onUplink(applicationServer);
+    server.setRxDelay(HOST_RX_DELAY_S);
+    ASSERT_TRUE(server_socket.start(&server));
+    ASSERT_TRUE(hostRadioConnect(("127.0.0.1:" + std::to_string(server_socket.port())).c_str()));
+
+    hostAdcSet(BATTERY_PIN, HOST_BATTERY_MV / BATTERY_COMPENSATION_FACTOR);
+    hostAdcSource(TURBIDITY_PIN, [](uint64_t) { return (hostPinLevel(SENSOR_RAIL_PIN) == HIGH) ? HOST_CLEAR_MV : 0.0f; });
+    hostBoot(setup, loop);
+    hostRunUntil([] { return hostRadioUplinks().size() >= 2; }, HOST_FIRST_READING_MS);
+}
+
+/**
+ * @brief Each (port, payload) in an uplink: the records of a batch frame (see the Outbox README), or the frame itself.
+ */
+static std::vector<std::pair<uint8_t, std::vector<uint8_t>>> frameRecords(uint8_t port,
+                                                                          const std::vector<uint8_t> &data) {
+    if (port != OUTBOX_BATCH_PORT) {
+        return { { port, data } };
+    }
+    std::vector<std::pair<uint8_t, std::vector<uint8_t>>> records;
+    size_t at = OUTBOX_BATCH_HEADER;
+    for (uint8_t i = 0; (i < data[0]) && (at + OUTBOX_BATCH_RECORD_HEADER <= data.size()); i++) {
+        uint8_t length = data[at + 3];
+        auto start = data.begin() + at + OUTBOX_BATCH_RECORD_HEADER;
+        records.push_back({ data[at], std::vector<uint8_t>(start, start + length) });
+        at += OUTBOX_BATCH_RECORD_HEADER + length;
+    }
+    return records;
+}
+
+TEST(FirmwareNsTest, JoinsThroughTheNetworkServer) {
+    bootFirmware();
+    std::vector<nsJoin> joins = server.joins();
+    ASSERT_EQ(joins.size(), 1u);
+    EXPECT_EQ(hostRadioJoinRequests(), 1u);
+    nsStats stats;
+    server.stats(&stats);
+    EXPECT_EQ(stats.join_rejects, 0u);
+    // the accept comes in the join's RX1
+    uint64_t latency_ms = joins[0].accept_ms - joins[0].request_ms;
+    EXPECT_GE(latency_ms, NS_JOIN_ACCEPT_DELAY1_MS);
+    EXPECT_LT(latency_ms, NS_JOIN_ACCEPT_DELAY2_MS);
+    // both ends derived the same session
+    nsSession session;
+    ASSERT_TRUE(server.session(nsEui(OTAA_KEY_DEV_EUI), &session));
+    struct hostRadioSession radio;
+    hostRadioSession(&radio);
+    EXPECT_EQ(radio.dev_addr, session.dev_addr);
+    RecordProperty("join_latency_ms", (int)latency_ms);
+}
+
+TEST(FirmwareNsTest, UplinksPassTheChecksAndDecrypt) {
+    bootFirmware();
+    hostRunFor(60 * 60 * 1000);
+    const std::vector<hostUplink> &sent = hostRadioUplinks();
+    std::vector<nsUplink> received = server.uplinks();
+    ASSERT_EQ(received.size(), sent.size());
+    uint32_t decode_us = 0;
+    for (size_t i = 0; i < sent.size(); i++) {
+        EXPECT_EQ(received[i].fcnt, sent[i].fcnt);
+        EXPECT_EQ(received[i].port, sent[i].port);
+        EXPECT_EQ(received[i].data, sent[i].data);
+        // heard as soon as it's off the air
+        EXPECT_EQ(received[i].rx_ms, sent[i].time_ms + sent[i].time_on_air_ms);
+        // the firmware runs with ADR off
+        EXPECT_FALSE(received[i].adr);
+        decode_us = max(decode_us, received[i].decode_us);
+    }
+    nsStats stats;
+    server.stats(&stats);
+    EXPECT_EQ(stats.bad_mics, 0u);
+    EXPECT_EQ(stats.replays, 0u);
+    EXPECT_EQ(stats.adr_requests, 0u);
+    struct hostRadioSession radio;
+    hostRadioSession(&radio);
+    EXPECT_EQ(radio.bad_downlinks, 0u);
+    RecordProperty("max_decode_us", (int)decode_us);
+}
+
+TEST(FirmwareNsTest, ClockAnswerStopsTheTimeRequests) {
+    bootFirmware();
+    hostRunFor(10 * 60 * 1000);
+    size_t from = hostRadioUplinks().size();
+    // unanswered, a time request would go out every CLOCK_SYNC_RETRY_MS
+    hostRunFor(4 * CLOCK_SYNC_RETRY_MS);
+    const std::vector<hostUplink> &uplinks = hostRadioUplinks();
+    for (size_t i = from; i < uplinks.size(); i++) {
+        EXPECT_NE(uplinks[i].port, CLOCK_SYNC_PORT) << "at " << uplinks[i].time_ms << " ms";
+    }
+}
+
+TEST(FirmwareNsTest, ConfigDownlinkIsAppliedAndAcked) {
+    bootFirmware();
+    size_t from = server.uplinks().size();
+    uint64_t queued_ms = hostNowMs();
+    const uint8_t command_id = 0x42;
+    const uint8_t new_tx_power = TX_POWER_5;
+    server.queueDownlink(nsEui(OTAA_KEY_DEV_EUI), DEVICE_CONFIG_PORT,
+                         { DEVICE_CONFIG_VERSION, command_id, (uint8_t)CONFIG_TLV::TX_POWER, 1, new_tx_power });
+    uint64_t acked_ms = 0;
+    hostRunUntil(
+        [&] {
+            std::vector<nsUplink> uplinks = server.uplinks();
+            for (size_t i = from; i < uplinks.size(); i++) {
+                for (const auto &record : frameRecords(uplinks[i].port, uplinks[i].data)) {
+                    if ((record.first == DEVICE_CONFIG_PORT) && (record.second.size() >= DEVICE_CONFIG_ACK_SIZE) &&
+                        (record.second[1] == command_id)) {
+                        EXPECT_EQ(record.second[2], (uint8_t)CONFIG_STATUS::OK);
+                        acked_ms = uplinks[i].rx_ms;
+                        return true;
+                    }
+                }
+            }
+            return false;
+        },
+        2 * 60 * 60 * 1000);
+    ASSERT_NE(acked_ms, 0u);
+    // applied to the radio
+    struct hostRadioSession radio;
+    hostRadioSession(&radio);
+    EXPECT_EQ(radio.tx_power, new_tx_power);
+    RecordProperty("config_ack_latency_ms", (int)(acked_ms - queued_ms));
+}
+
+TEST(FirmwareNsTest, RestoredSessionKeepsTheRxDelay) {
+    bootFirmware();
+    struct hostRadioSession radio;
+    hostRadioSession(&radio);
+    EXPECT_EQ(radio.rx1_delay_ms, HOST_RX_DELAY_S * 1000u);
+    saveLoRaWANSession(true);
+
+    // a reset stack is back on the default RX windows until the session is restored
+    MibRequestConfirm_t mib;
+    mib.Type = MIB_RECEIVE_DELAY_1;
+    mib.Param.ReceiveDelay1 = NS_RX1_DELAY_MS;
+    LoRaMacMibSetRequestConfirm(&mib);
+    mib.Type = MIB_RECEIVE_DELAY_2;
+    mib.Param.ReceiveDelay2 = NS_RX2_DELAY_MS;
+    LoRaMacMibSetRequestConfirm(&mib);
+    ASSERT_TRUE(loadLoRaWANSession(OTAA_KEY_APP_EUI, OTAA_KEY_DEV_EUI, OTAA_KEY_APP_KEY));
+    ASSERT_TRUE(restoreLoRaWANSession());
+    hostRadioSession(&radio);
+    EXPECT_EQ(radio.rx1_delay_ms, HOST_RX_DELAY_S * 1000u);
+
+    // and a downlink still lands in RX1
+    uint32_t missed = radio.missed_downlinks;
+    const uint8_t new_tx_power = (radio.tx_power == TX_POWER_3) ? TX_POWER_4 : TX_POWER_3;
+    server.queueDownlink(nsEui(OTAA_KEY_DEV_EUI), DEVICE_CONFIG_PORT,
+                         { DEVICE_CONFIG_VERSION, 0x43, (uint8_t)CONFIG_TLV::TX_POWER, 1, new_tx_power });
+    hostRunUntil(
+        [&] {
+            hostRadioSession(&radio);
+            return radio.tx_power == new_tx_power;
+        },
+        2 * 60 * 60 * 1000);
+    EXPECT_EQ(radio.tx_power, new_tx_power);
+    EXPECT_EQ(radio.missed_downlinks, missed);
+}
+
+TEST(FirmwareNsTest, ForgottenSessionRejoins) {
+    bootFirmware();
+    size_t joins = server.joins().size();
+    server.forgetSession(nsEui(OTAA_KEY_DEV_EUI));
+    nsStats stats;
+    server.stats(&stats);
+    uint32_t unknown = stats.unknown;
+    uint64_t forgot_ms = hostNowMs();
+    // nothing comes back, so a confirmed uplink goes out and after LORAWAN_LINK_CHECK_RETRIES unacked it rejoins
+    hostRunUntil([&] { return server.joins().size() > joins; }, 7UL * 24 * 60 * 60 * 1000);
+    ASSERT_GT(server.joins().size(), joins);
+    server.stats(&stats);
+    uint32_t lost = stats.unknown - unknown;
+    EXPECT_GE(lost, (uint32_t)LORAWAN_LINK_CHECK_UPLINKS);
+    EXPECT_LE(lost, (uint32_t)(LORAWAN_LINK_CHECK_UPLINKS + LORAWAN_LINK_CHECK_RETRIES));
+    RecordProperty("rejoin_after_s", (int)((hostNowMs() - forgot_ms) / 1000));
+
+    // and once the accept is in, the new session is in use
+    size_t from = server.uplinks().size();
+    hostRunFor(2 * 60 * 60 * 1000);
+    EXPECT_GT(server.uplinks().size(), from);
+    nsSession session;
+    ASSERT_TRUE(server.session(nsEui(OTAA_KEY_DEV_EUI), &session));
+    struct hostRadioSession radio;
+    hostRadioSession(&radio);
+    EXPECT_EQ(radio.dev_addr, session.dev_addr);
+    server.stats(&stats);
+    EXPECT_EQ(stats.unknown - unknown, lost);
+}
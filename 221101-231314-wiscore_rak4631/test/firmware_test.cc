@@ -0,0 +1,264 @@
+/**
+ * @file firmware_test.cc
+ * @brief The whole firmware (src/main.cpp & every library) running on the host HAL: boots it once, then checks what
+ * goes over the air as virtual time runs on.
+ *
+ * The firmware's globals can't be reset, so the tests share one boot and each carries on from where the last left
+ * off. ctest runs each test in its own process, so each must also work from a fresh boot.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <gtest/gtest.h>
+
+#include "HostHal.h"
+#include "PowerRails.h"
+#include "BootTimeline.h"
+#include "DeviceConfig.h"
+#include "FlashLog.h"
+#include "Outbox.h"
+#include "PresenceBitmap.h"
+#include "SensorHelper.h"
+#include "SeriesCompression.h"
+#include "WallClock.h"
+
+void setup(void);
+void loop(void);
+
+#define HOST_BATTERY_MV  3900.0f
+#define HOST_CLEAR_MV    1400.0f /**< At the pin, over 4.45 V at the sensor: 0 NTU. */
+#define HOST_STORM_MV    1000.0f /**< About 2600 NTU. */
+#define HOST_FIRST_READING_MS (5UL * 60 * 1000)
+
+/** @brief Readings go out as presence frames on the base port. */
+static const uint8_t READING_PORT = DEFAULT_DEVICE_CONFIG.payload_port + PRESENCE_PORT_OFFSET;
+
+static float turbidity_mv = HOST_CLEAR_MV;
+
+/**
+ * @brief Boots the firmware the first time it's called, with the battery & a clear water turbidity sensor on the ADC
+ * (only while the sensor rail powers it) and USB connected. Runs until the first reading goes out.
+ */
+static void bootFirmware(void) {
+    static bool booted = false;
+    if (booted) {
+        return;
+    }
+    booted = true;
+    hostAdcSet(BATTERY_PIN, HOST_BATTERY_MV / BATTERY_COMPENSATION_FACTOR);
+    hostAdcSource(TURBIDITY_PIN, [](uint64_t) {
+        // powered from the rail
+        return (hostPinLevel(SENSOR_RAIL_PIN) == HIGH) ? turbidity_mv : 0.0f;
+    });
+    hostSerialConnect(true);
+    hostBoot(setup, loop);
+    hostRunUntil([] { return hostRadioUplinks().size() >= 2; }, HOST_FIRST_READING_MS);
+}
+
+/**
+ * @brief Uplinks sent on a port since index from.
+ */
+static std::vector<hostUplink> uplinksOn(uint8_t port, size_t from = 0) {
+    std::vector<hostUplink> found;
+    const std::vector<hostUplink> &uplinks = hostRadioUplinks();
+    for (size_t i = from; i < uplinks.size(); i++) {
+        if (uplinks[i].port == port) {
+            found.push_back(uplinks[i]);
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief The ports of the records in a batch frame (see the Outbox README), or just the port of any other frame.
+ */
+static std::vector<uint8_t> framePorts(const hostUplink &uplink) {
+    if (uplink.port != OUTBOX_BATCH_PORT) {
+        return { uplink.port };
+    }
+    std::vector<uint8_t> ports;
+    size_t at = OUTBOX_BATCH_HEADER;
+    for (uint8_t i = 0; (i < uplink.data[0]) && (at + OUTBOX_BATCH_RECORD_HEADER <= uplink.data.size()); i++) {
+        ports.push_back(uplink.data[at]);
+        at += OUTBOX_BATCH_RECORD_HEADER + uplink.data[at + 3];
+    }
+    return ports;
+}
+
+/**
+ * @brief True if a frame carries a reading: on the base port as a presence frame, alone or in a batch.
+ */
+static bool carriesReading(const hostUplink &uplink) {
+    for (uint8_t port : framePorts(uplink)) {
+        if (port == READING_PORT) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST(FirmwareTest, ColdBootJoinsAndReportsTheBoot) {
+    bootFirmware();
+    EXPECT_EQ(hostRadioJoinRequests(), 1u);
+    const std::vector<hostUplink> &uplinks = hostRadioUplinks();
+    ASSERT_GE(uplinks.size(), 2u);
+    // the clock request goes out first, while the sensors warm up
+    EXPECT_EQ(uplinks[0].port, CLOCK_SYNC_PORT);
+    // then the first reading, batched with the boot report
+    std::vector<uint8_t> expected = { BOOT_REPORT_PORT, READING_PORT };
+    EXPECT_EQ(framePorts(uplinks[1]), expected);
+    EXPECT_LE(uplinks[1].data.size(), OUTBOX_BATCH_MAX_LENGTH);
+    // payloadTimer starts on the join, so the first reading is one interval after it
+    EXPECT_GE(uplinks[1].time_ms, DEFAULT_DEVICE_CONFIG.normal_interval_ms);
+    EXPECT_LT(uplinks[1].time_ms, HOST_FIRST_READING_MS);
+    // the boot was logged to USB
+    EXPECT_FALSE(hostSerialTake().empty());
+}
+
+TEST(FirmwareTest, QuietReadingsAreCompressedIntoSeriesFrames) {
+    bootFirmware();
+    size_t from = hostRadioUplinks().size();
+    uint32_t reads = hostAnalogReads(TURBIDITY_PIN);
+    hostRunFor(10 * DEFAULT_DEVICE_CONFIG.normal_interval_ms);
+    // a reading every interval, each averaging the burst of turbidity samples
+    EXPECT_EQ(hostAnalogReads(TURBIDITY_PIN) - reads, 10u * DEFAULT_DEVICE_CONFIG.turbidity_samples);
+    const std::vector<hostUplink> &uplinks = hostRadioUplinks();
+    for (size_t i = from; i < uplinks.size(); i++) {
+        EXPECT_FALSE(carriesReading(uplinks[i])) << "at " << uplinks[i].time_ms << " ms";
+    }
+    // held for at most an hour (main.cpp's SERIES_MAX_HOLD_MS)
+    hostRunFor(60 * 60 * 1000);
+    EXPECT_FALSE(uplinksOn(SERIES_FRAME_PORT, from).empty());
+}
+
+TEST(FirmwareTest, StormSendsEveryReadingInActiveMode) {
+    bootFirmware();
+    size_t from = hostRadioUplinks().size();
+    turbidity_mv = HOST_STORM_MV;
+    hostRunFor(15 * 60 * 1000);
+    std::vector<hostUplink> readings;
+    const std::vector<hostUplink> &uplinks = hostRadioUplinks();
+    for (size_t i = from; i < uplinks.size(); i++) {
+        if (carriesReading(uplinks[i])) {
+            readings.push_back(uplinks[i]);
+        }
+    }
+    ASSERT_GE(readings.size(), 10u);
+    // once active, every reading goes out live on the active interval
+    for (size_t i = 2; i < readings.size(); i++) {
+        EXPECT_EQ(readings[i].time_ms - readings[i - 1].time_ms, DEFAULT_DEVICE_CONFIG.active_interval_ms);
+    }
+
+    // clear again, back to normal mode after the active cycles
+    turbidity_mv = HOST_CLEAR_MV;
+    hostRunFor((DEFAULT_DEVICE_CONFIG.active_cycles + 2) * DEFAULT_DEVICE_CONFIG.active_interval_ms);
+    from = hostRadioUplinks().size();
+    hostRunFor(5 * DEFAULT_DEVICE_CONFIG.normal_interval_ms);
+    for (size_t i = from; i < uplinks.size(); i++) {
+        EXPECT_FALSE(carriesReading(uplinks[i])) << "at " << uplinks[i].time_ms << " ms";
+    }
+}
+
+TEST(FirmwareTest, ConfigAckGoesOnItsOwnWhenTheReadingLeavesNoRoom) {
+    bootFirmware();
+    MibRequestConfirm_t mib;
+    mib.Type = MIB_CHANNELS_DATARATE;
+    LoRaMacMibGetRequestConfirm(&mib);
+    int8_t data_rate = mib.Param.ChannelsDatarate;
+    // DR2 carries 11 bytes in the dwell time, too few for a reading with the ack in front
+    mib.Param.ChannelsDatarate = DR_2;
+    LoRaMacMibSetRequestConfirm(&mib);
+    size_t from = hostRadioUplinks().size();
+    const uint8_t command_id = 0x44;
+    hostRadioQueueDownlink(DEVICE_CONFIG_PORT, { DEVICE_CONFIG_VERSION, command_id, (uint8_t)CONFIG_TLV::ACTIVE_CYCLES,
+                                                 1, DEFAULT_DEVICE_CONFIG.active_cycles });
+    bool acked = hostRunUntil(
+        [&] {
+            for (const hostUplink &uplink : uplinksOn(DEVICE_CONFIG_PORT, from)) {
+                if ((uplink.data.size() == DEVICE_CONFIG_ACK_SIZE) && (uplink.data[1] == command_id)) {
+                    EXPECT_EQ(uplink.data[2], (uint8_t)CONFIG_STATUS::OK);
+                    return true;
+                }
+            }
+            return false;
+        },
+        2 * 60 * 60 * 1000);
+    EXPECT_TRUE(acked);
+    for (const hostUplink &uplink : uplinksOn(DEVICE_CONFIG_PORT, from)) {
+        EXPECT_LE(uplink.data.size(), 11u);
+    }
+    mib.Param.ChannelsDatarate = data_rate;
+    LoRaMacMibSetRequestConfirm(&mib);
+}
+
+/**
+ * @brief Checks a flash log fragment reads on its own: empty, or [length][record] items after a boot mark up to its
+ * end, with no record below the level asked for.
+ */
+static void checkFlashLogFragment(const hostUplink &uplink, LOG_LEVEL level) {
+    ASSERT_GE(uplink.data.size(), (size_t)FLASH_LOG_FRAGMENT_HEADER);
+    if (uplink.data.size() > FLASH_LOG_FRAGMENT_HEADER) {
+        EXPECT_EQ(uplink.data[FLASH_LOG_FRAGMENT_HEADER], LOG_PAGE_BOOT_MARK) << "no boot mark first";
+    }
+    size_t at = FLASH_LOG_FRAGMENT_HEADER;
+    while (at < uplink.data.size()) {
+        uint8_t length = uplink.data[at];
+        if (length == LOG_PAGE_BOOT_MARK) {
+            at += LOG_PAGE_BOOT_ITEM;
+            continue;
+        }
+        logRecordHeader header;
+        EXPECT_TRUE(readLogRecordHeader(&uplink.data[at + 1], length, &header));
+        EXPECT_LE(header.level, (uint8_t)level);
+        at += 1 + length;
+    }
+    EXPECT_EQ(at, uplink.data.size());
+}
+
+TEST(FirmwareTest, FlashLogRequestIsSentBackInFragments) {
+    bootFirmware();
+    // enough to fill a few pages
+    hostRunFor(6 * 60 * 60 * 1000);
+    size_t from = hostRadioUplinks().size();
+    hostRadioQueueDownlink(FLASH_LOG_PORT, { FLASH_LOG_VERSION, 0x61, (uint8_t)LOG_LEVEL::INFO, 0 });
+
+    // a new request comes in on the RX callback right after the first fragment, while the radio task is sending it
+    hostRadioOnUplink([](const hostUplink &uplink) {
+        if ((uplink.port == FLASH_LOG_PORT) && (uplink.data[1] == 0x61)) {
+            hostRadioQueueDownlink(FLASH_LOG_PORT, { FLASH_LOG_VERSION, 0x62, (uint8_t)LOG_LEVEL::WARN, 1 });
+            hostRadioOnUplink(nullptr);
+        }
+    });
+    bool done = hostRunUntil(
+        [&] {
+            std::vector<hostUplink> fragments = uplinksOn(FLASH_LOG_PORT, from);
+            return !fragments.empty() && (fragments.back().data[1] == 0x62) &&
+                   (fragments.back().data[3] & FLASH_LOG_FRAGMENT_LAST);
+        },
+        2 * 60 * 60 * 1000);
+    hostRadioOnUplink(nullptr);
+    ASSERT_TRUE(done);
+
+    // the old request stops, the new one starts over from fragment 0 with its own pages & level
+    std::vector<hostUplink> fragments = uplinksOn(FLASH_LOG_PORT, from);
+    ASSERT_EQ(fragments[0].data[1], 0x61);
+    uint8_t expected_id = 0x61;
+    uint8_t expected_fragment = 0;
+    for (const hostUplink &uplink : fragments) {
+        ASSERT_EQ(uplink.data[0], FLASH_LOG_VERSION);
+        if ((uplink.data[1] == 0x62) && (expected_id == 0x61)) {
+            expected_id = 0x62;
+            expected_fragment = 0;
+        }
+        EXPECT_EQ(uplink.data[1], expected_id) << "at " << uplink.time_ms << " ms";
+        EXPECT_EQ(uplink.data[2], expected_fragment++) << "at " << uplink.time_ms << " ms";
+        bool last = (&uplink == &fragments.back());
+        EXPECT_EQ((bool)(uplink.data[3] & FLASH_LOG_FRAGMENT_LAST), last) << "at " << uplink.time_ms << " ms";
+        checkFlashLogFragment(uplink, (expected_id == 0x61) ? LOG_LEVEL::INFO : LOG_LEVEL::WARN);
+    }
+    EXPECT_EQ(expected_id, 0x62);
+    EXPECT_FALSE(flashLogUploadPending());
+}
@@ -0,0 +1,83 @@
+#include "../lib/FlashLog/src/FlashLog.h"
+#include "hal/HostHal.h"
+
+// Log requests, taken up by the radio task a fragment at a time. The records in the fragments are tested on the whole
+// firmware (firmware_test.cc), nothing drains the log ring here so the RAM page stays empty.
+
+class FlashLogTest : public ::testing::Test {
+  protected:
+    void SetUp(void) override {
+        hostFlashErase();
+        initFlashLog();
+        // a request left over from another test
+        while (flashLogUploadPending() && (prepareFlashLogFragment(fragment, 51) > 0)) {
+            flashLogFragmentSent();
+        }
+    }
+    void TearDown(void) override {
+        setLogRecordSink(nullptr);
+        setSerialAttachHandler(nullptr);
+        hostFlashErase();
+    }
+
+    bool request(uint8_t id, LOG_LEVEL level, uint8_t pages) {
+        uint8_t downlink[FLASH_LOG_REQUEST_SIZE] = { FLASH_LOG_VERSION, id, (uint8_t)level, pages };
+        return handleFlashLogRequest(downlink, sizeof(downlink));
+    }
+
+    uint8_t fragment[64] = {};
+};
+
+TEST_F(FlashLogTest, RequestIsTakenUpByTheNextFragment) {
+    EXPECT_FALSE(flashLogUploadPending());
+    ASSERT_TRUE(request(1, LOG_LEVEL::INFO, 0));
+    EXPECT_TRUE(flashLogUploadPending());
+    // too short for a record, so the request waits
+    EXPECT_EQ(prepareFlashLogFragment(fragment, FLASH_LOG_FRAGMENT_HEADER + LOG_PAGE_BOOT_ITEM), 0u);
+    EXPECT_TRUE(flashLogUploadPending());
+
+    // nothing logged: one empty, last fragment
+    ASSERT_EQ(prepareFlashLogFragment(fragment, 51), FLASH_LOG_FRAGMENT_HEADER);
+    EXPECT_EQ(fragment[0], FLASH_LOG_VERSION);
+    EXPECT_EQ(fragment[1], 1);
+    EXPECT_EQ(fragment[2], 0);
+    EXPECT_EQ(fragment[3], FLASH_LOG_FRAGMENT_LAST);
+    EXPECT_TRUE(flashLogUploadPending());
+    flashLogFragmentSent();
+    EXPECT_FALSE(flashLogUploadPending());
+
+    // a bad request is ignored
+    uint8_t bad[FLASH_LOG_REQUEST_SIZE] = { FLASH_LOG_VERSION + 1, 2, 3, 0 };
+    EXPECT_FALSE(handleFlashLogRequest(bad, sizeof(bad)));
+    bad[0] = FLASH_LOG_VERSION;
+    EXPECT_FALSE(handleFlashLogRequest(bad, FLASH_LOG_REQUEST_SIZE - 1));
+    EXPECT_FALSE(flashLogUploadPending());
+}
+
+TEST_F(FlashLogTest, NewRequestReplacesOneInProgress) {
+    ASSERT_TRUE(request(3, LOG_LEVEL::INFO, 0));
+    ASSERT_EQ(prepareFlashLogFragment(fragment, 51), FLASH_LOG_FRAGMENT_HEADER);
+    EXPECT_EQ(fragment[1], 3);
+    EXPECT_EQ(fragment[3], FLASH_LOG_FRAGMENT_LAST);
+
+    // arrives while the old request's last fragment is on the air: that fragment is finished, then the new one starts
+    ASSERT_TRUE(request(4, LOG_LEVEL::WARN, 1));
+    flashLogFragmentSent();
+    EXPECT_TRUE(flashLogUploadPending());
+    ASSERT_EQ(prepareFlashLogFragment(fragment, 51), FLASH_LOG_FRAGMENT_HEADER);
+    EXPECT_EQ(fragment[1], 4);
+    EXPECT_EQ(fragment[2], 0);
+    EXPECT_EQ(fragment[3], FLASH_LOG_FRAGMENT_LAST);
+    flashLogFragmentSent();
+    EXPECT_FALSE(flashLogUploadPending());
+
+    // a fragment that couldn't be sent is prepared again, as the new request's first
+    ASSERT_TRUE(request(5, LOG_LEVEL::INFO, 0));
+    ASSERT_GT(prepareFlashLogFragment(fragment, 51), 0u);
+    ASSERT_TRUE(request(6, LOG_LEVEL::ERROR, 0));
+    ASSERT_GT(prepareFlashLogFragment(fragment, 51), 0u);
+    EXPECT_EQ(fragment[1], 6);
+    EXPECT_EQ(fragment[2], 0);
+    flashLogFragmentSent();
+    EXPECT_FALSE(flashLogUploadPending());
+}
@@ -0,0 +1,865 @@
+/**
+ * @file fleet_sim.cc
+ * @brief Discrete event simulator of a fleet of turbidity nodes sharing one gateway, for capacity & collision
+ * analysis. Not run by ctest, build the fleet_sim target and run it directly (fleet_sim --help).
+ *
+ * Each node runs the firmware's own decision code, so frames have the sizes and times the firmware would send:
+ * - eventMode for the normal/switch/active modes.
+ * - changeDetector for the trigger.
+ * - wallClock for the slot schedule.
+ * - portRotation's presence frames for the payloads.
+ * - swingingDoorCompressor for quiet periods.
+ * - An outbox that batches like Outbox::prepareFrame().
+ *
+ * The gateway listens on the channels of one AU915 sub-band with a limited number of demodulators. Frames on the same
+ * channel & spreading factor that overlap are lost, unless one is capture_db stronger than everything it overlapped
+ * (capture effect). Different spreading factors are taken as orthogonal.
+ *
+ * Turbidity is a per-node baseline plus noise, and storms: a Poisson process of regional events that reach a share of
+ * the nodes, each after its own lag (upstream to downstream), so whole groups of nodes go into active mode together.
+ *
+ * Each run is one thread; the node counts & replications are spread over the cores.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <queue>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AirtimeBudget.h"
+#include "DeviceConfig.h"
+#include "EventMode.h"
+#include "Outbox.h"
+#include "PortRotation.h"
+#include "SensorHelper.h"
+#include "SeriesCompression.h"
+#include "WallClock.h"
+
+#define SIM_WARMUP_MS         5000          /**< main.cpp's SENSOR_WARMUP_MS. */
+#define SIM_SERIES_MAX_HOLD_MS (60ULL * 60 * 1000) /**< main.cpp's SERIES_MAX_HOLD_MS. */
+#define SIM_DWELL_US          400000        /**< AU915 uplink dwell time. */
+#define SIM_UNIX_START_MS     1667260800000ULL /**< 2022-11-01, where the simulated wall clock starts. */
+#define SIM_STORM_RISE_MS     (30ULL * 60 * 1000) /**< Time a storm takes to reach its peak at a node. */
+#define SIM_STORM_SEEN_NTU    10.0f         /**< A node is in a storm once it adds this much, for latency & misses. */
+#define SIM_MAX_TX_DBM        22            /**< SX1262 PA limit. */
+#define SIM_ADR_MARGIN_DB     10            /**< Link margin kept when giving a node its data rate. */
+
+/** @brief One configuration to simulate. */
+struct simConfig {
+    std::vector<uint32_t> nodes = { 100, 500, 1000, 2000 }; /**< Fleet sizes, one run (per replication) each. */
+    double hours = 24 * 7;
+    uint32_t replications = 1;
+    uint32_t threads = 0; /**< 0 = every core. */
+    uint64_t seed = 1;
+    deviceConfig device = DEFAULT_DEVICE_CONFIG;
+    bool slots = true;            /**< Readings on wall clock slots, as once synced, or free running from boot. */
+    float clock_error_ms = 50;    /**< Sigma of each node's clock error after sync. */
+    double storms_per_day = 0.3;
+    float storm_reach = 0.8;      /**< Share of the nodes a storm reaches. */
+    float storm_lag_min = 60;     /**< Storm arrival spread over the fleet. */
+    float storm_hours = 6;        /**< Mean decay time of a storm, to 5% of its peak. */
+    float storm_peak_ntu = 400;
+    float radius_km = 3;
+    float shadowing_db = 6;
+    float fading_db = 2;
+    int fixed_dr = -1;            /**< -1 = each node at the fastest DR with SIM_ADR_MARGIN_DB to spare. */
+    uint8_t min_dr = 2;           /**< DR0 & DR1 aren't allowed with the AU915 dwell time. */
+    uint8_t channels = 8;
+    uint8_t demodulators = 8;
+    float capture_db = 6;
+    const char *per_node_file = nullptr;
+};
+
+/** @brief Totals from one or more runs. */
+struct simResult {
+    uint32_t nodes = 0;
+    double node_hours = 0;
+    uint64_t frames = 0, delivered = 0, alert_frames = 0, alerts_delivered = 0;
+    uint64_t lost_collision = 0, lost_demodulators = 0, lost_sensitivity = 0;
+    uint64_t readings = 0, readings_delivered = 0, dropped_readings = 0; /**< Dropped from a full outbox, or too long to send. */
+    uint64_t storms_seen = 0, storms_missed = 0, false_triggers = 0;
+    double airtime_us = 0, max_node_airtime_us = 0;
+    std::vector<float> alert_latency_s; /**< Storm onset at a node to its first alert delivered. */
+    double wall_s = 0;
+};
+
+/** @brief A regional storm. */
+struct simStorm {
+    uint64_t start_ms;
+    float peak_ntu;
+    float tau_ms; /**< Exponential decay after the peak. */
+};
+
+/** @brief A frame waiting in a node's outbox. */
+struct simQueued {
+    uint8_t length;
+    bool alert;
+    uint16_t readings;
+    uint64_t oldest_ms;
+    uint64_t sequence;
+};
+
+/** @brief An uplink in the air. */
+struct simFrame {
+    uint32_t node;
+    uint64_t end_us;
+    uint8_t channel;
+    uint8_t spreading_factor;
+    bool demodulated;
+    bool alert;
+    uint16_t readings;
+    float power_dbm;
+    float interference_dbm; /**< Strongest overlapping frame on the same channel & spreading factor. */
+    uint64_t start_ms;
+    uint64_t oldest_ms;     /**< When the oldest reading it carries was taken. */
+};
+
+static const portRotationEntry SIM_ROTATION[] = { { PORT10, 1, 0 } }; /**< main.cpp's schedule without a RAK1906. */
+
+/** @brief One node: the firmware's state plus the radio link. */
+struct simNode {
+    simNode(const deviceConfig *config)
+        : mode(config->active_cycles),
+          detector(config->detector_slack_dsigma / 10.0f, config->detector_threshold_dsigma / 10.0f,
+                   config->trigger_ntu),
+          compressor(config->compression_dntu / 10.0f), rotation(SIM_ROTATION, 1) {
+        rotation.setPresenceBitmap(true);
+    }
+    eventMode mode;
+    changeDetector detector;
+    swingingDoorCompressor compressor;
+    portRotation rotation;
+    wallClock clock;
+    uint64_t boot_ms = 0;
+    uint32_t interval_ms = 0;
+    uint64_t last_series_ms = 0;
+    uint64_t next_sync_ms = 0;
+    uint16_t unsent_readings = 0; /**< Readings only in the compressor. */
+    uint64_t unsent_oldest_ms = 0;
+    std::vector<simQueued> outbox;
+    uint64_t next_sequence = 0;
+    float baseline_ntu = 0;
+    float noise_ntu = 0;
+    float link_dbm = 0;           /**< Mean received power at the gateway. */
+    uint8_t data_rate = 0;
+    uint8_t max_length = 0;
+    uint64_t onset_ms = 0;        /**< Storm onset waiting for an alert to be delivered, 0 = none. */
+    uint64_t onset_end_ms = 0;    /**< When that storm has passed. */
+    uint64_t frames = 0, delivered = 0;
+    double airtime_us = 0;
+};
+
+/** @brief What's due in the event queue. */
+enum class SIM_EVENT : uint8_t { WAKE, TX_START, TX_END };
+
+struct simEvent {
+    uint64_t time_us;
+    uint64_t order;
+    SIM_EVENT type;
+    uint32_t index; /**< Node for WAKE, frame for TX_START & TX_END. */
+    bool operator>(const simEvent &other) const {
+        return (time_us != other.time_us) ? (time_us > other.time_us) : (order > other.order);
+    }
+};
+
+static uint64_t splitMix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+/** @brief A uniform number in [0, 1) that only depends on its inputs, so storms need no per-node state. */
+static float hashUniform(uint64_t seed, uint64_t a, uint64_t b) {
+    return (splitMix(seed ^ splitMix(a * 0x100000001B3ULL ^ splitMix(b))) >> 40) / (float)(1 << 24);
+}
+
+/** @brief SX126x sensitivity at 125 kHz. */
+static float sensitivityDbm(uint8_t spreading_factor) {
+    static const float SENSITIVITY[] = { -123.0f, -126.0f, -129.0f, -132.0f, -134.5f, -137.0f };
+    return SENSITIVITY[constrain(spreading_factor, 7, 12) - 7];
+}
+
+/** @brief Transmit power of a LoRaMac TX_POWER_n in AU915 (30 dBm EIRP - 2n dB), limited by the radio. */
+static float txPowerDbm(uint8_t tx_power) { return min(30.0f - 2.0f * tx_power, (float)SIM_MAX_TX_DBM); }
+
+/** @brief One run: a fleet for config->hours. */
+class simRun {
+  public:
+    simRun(const simConfig *config, uint32_t n_nodes, uint64_t seed) : config(config), seed(seed), random(splitMix(seed)) {
+        result.nodes = n_nodes;
+        nodes.reserve(n_nodes);
+        for (uint32_t i = 0; i < n_nodes; i++) {
+            nodes.emplace_back(&config->device);
+            placeNode(i);
+        }
+        makeStorms();
+        active.resize(config->channels);
+    }
+
+    simResult run(void);
+
+  private:
+    void placeNode(uint32_t i);
+    void makeStorms(void);
+    void schedule(uint64_t time_us, SIM_EVENT type, uint32_t index) { events.push({ time_us, order++, type, index }); }
+    float stormNtu(uint32_t i, uint64_t now_ms, uint64_t *onset_ms, uint64_t *end_ms);
+    void wake(uint32_t i, uint64_t now_ms);
+    void takeReading(uint32_t i, uint64_t now_ms);
+    void sendPayload(uint32_t i, uint64_t now_ms, const simQueued &frame);
+    void queue(uint32_t i, simQueued frame);
+    void transmit(uint32_t i, uint64_t now_ms, uint8_t length, bool alert, uint16_t readings, uint64_t oldest_ms);
+    void txStart(uint32_t f);
+    void txEnd(uint32_t f);
+    uint32_t nodeMillis(uint32_t i, uint64_t now_ms) const { return (uint32_t)(now_ms - nodes[i].boot_ms); }
+
+    const simConfig *config;
+    uint64_t seed;
+    std::mt19937_64 random;
+    std::normal_distribution<float> normal{ 0.0f, 1.0f };
+    std::vector<simNode> nodes;
+    std::vector<simStorm> storms;
+    size_t first_storm = 0; /**< Storms before this are over everywhere. */
+    std::priority_queue<simEvent, std::vector<simEvent>, std::greater<simEvent>> events;
+    uint64_t order = 0;
+    std::vector<simFrame> frames;
+    std::vector<uint32_t> free_frames;
+    std::vector<std::vector<uint32_t>> active; /**< Frames in the air, by channel. */
+    uint32_t demodulating = 0;
+    simResult result;
+};
+
+void simRun::placeNode(uint32_t i) {
+    simNode &node = nodes[i];
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    // uniform over the disc, at least 100 m out
+    float distance_km = max(0.1f, config->radius_km * sqrtf(uniform(random)));
+    // Okumura-Hata suburban at 915 MHz, 30 m gateway, 1.5 m node, plus log-normal shadowing
+    float path_loss_db = 120.5f + 35.2f * log10f(distance_km) + config->shadowing_db * normal(random);
+    node.link_dbm = txPowerDbm(config->device.tx_power) - path_loss_db;
+    if (config->fixed_dr >= 0) {
+        node.data_rate = config->fixed_dr;
+    } else {
+        node.data_rate = config->min_dr;
+        for (uint8_t dr = 5; dr > config->min_dr; dr--) {
+            if (node.link_dbm >= sensitivityDbm(12 - dr) + SIM_ADR_MARGIN_DB) {
+                node.data_rate = dr;
+                break;
+            }
+        }
+    }
+    node.max_length = min((uint8_t)OUTBOX_BATCH_MAX_LENGTH, lorawanMaxPayloadForAirtime(node.data_rate, SIM_DWELL_US));
+    node.baseline_ntu = 2.0f + 13.0f * uniform(random);
+    node.noise_ntu = 0.3f + 1.2f * uniform(random);
+    node.interval_ms = config->device.normal_interval_ms;
+
+    // booted & synced somewhere in the first interval, with its own clock error
+    node.boot_ms = (uint64_t)(uniform(random) * node.interval_ms);
+    wallClockState state = {};
+    state.synced = true;
+    state.base_unix_ms = SIM_UNIX_START_MS + node.boot_ms + (int64_t)(config->clock_error_ms * normal(random));
+    node.clock.resume(&state, 0, 0);
+    node.next_sync_ms = node.boot_ms + CLOCK_SYNC_INTERVAL_MS;
+    uint32_t first_ms = config->slots ? node.clock.msUntilNextSlot(0, node.interval_ms, SIM_WARMUP_MS)
+                                      : node.interval_ms;
+    schedule((node.boot_ms + first_ms) * 1000, SIM_EVENT::WAKE, i);
+}
+
+void simRun::makeStorms(void) {
+    // from the seed alone, so every fleet size sees the same weather
+    std::mt19937_64 weather(seed);
+    double end_ms = config->hours * 3600e3;
+    std::exponential_distribution<double> gap(config->storms_per_day / 86400e3);
+    for (double t = gap(weather); (config->storms_per_day > 0) && (t < end_ms); t += gap(weather)) {
+        // log-normal peaks, exponential lengths
+        float peak = config->storm_peak_ntu * expf(0.5f * normal(weather));
+        float hours = config->storm_hours * std::exponential_distribution<float>(1.0f)(weather);
+        storms.push_back({ (uint64_t)t, peak, max(0.5f, hours) * 3600e3f / 3.0f });
+    }
+}
+
+/**
+ * @brief Turbidity the storms add at a node.
+ * @param onset_ms Filled with the onset of the strongest storm there, if any.
+ * @param end_ms Filled with when that storm has passed.
+ */
+float simRun::stormNtu(uint32_t i, uint64_t now_ms, uint64_t *onset_ms, uint64_t *end_ms) {
+    float total = 0;
+    float strongest = 0;
+    uint64_t lag_max_ms = (uint64_t)(config->storm_lag_min * 60e3f);
+    for (size_t s = first_storm; (s < storms.size()) && (storms[s].start_ms <= now_ms); s++) {
+        const simStorm &storm = storms[s];
+        uint64_t passed_ms = storm.start_ms + lag_max_ms + SIM_STORM_RISE_MS + (uint64_t)(5 * storm.tau_ms);
+        if (passed_ms < now_ms) {
+            if (s == first_storm) {
+                first_storm++;
+            }
+            continue;
+        }
+        if (hashUniform(seed, i, s * 3) >= config->storm_reach) {
+            continue;
+        }
+        uint64_t onset = storm.start_ms + (uint64_t)(hashUniform(seed, i, s * 3 + 1) * lag_max_ms);
+        if (onset > now_ms) {
+            continue;
+        }
+        // nodes further down see it diluted
+        float peak = storm.peak_ntu * (0.5f + hashUniform(seed, i, s * 3 + 2));
+        float dt = now_ms - onset;
+        float ntu = (dt < SIM_STORM_RISE_MS) ? peak * dt / SIM_STORM_RISE_MS
+                                             : peak * expf(-(dt - SIM_STORM_RISE_MS) / storm.tau_ms);
+        total += ntu;
+        if (ntu > strongest) {
+            strongest = ntu;
+            *onset_ms = onset;
+            *end_ms = onset + SIM_STORM_RISE_MS + (uint64_t)(3 * storm.tau_ms);
+        }
+    }
+    return total;
+}
+
+/**
+ * @brief A payloadTimer wake: acquisitionCycle::body() up to the reading, then the reading itself.
+ */
+void simRun::wake(uint32_t i, uint64_t now_ms) {
+    simNode &node = nodes[i];
+    if (node.mode.advance()) {
+        node.interval_ms = config->device.normal_interval_ms;
+    }
+    uint32_t local_ms = nodeMillis(i, now_ms);
+    uint32_t next_ms = config->slots ? node.clock.msUntilNextSlot(local_ms, node.interval_ms, SIM_WARMUP_MS)
+                                     : node.interval_ms;
+    if (now_ms >= node.next_sync_ms) {
+        // the time request goes out while the sensors warm up; the answer only corrects the clock error modelled
+        node.next_sync_ms = now_ms + CLOCK_SYNC_INTERVAL_MS;
+        transmit(i, now_ms, CLOCK_SYNC_REQUEST_SIZE, false, 0, 0);
+    }
+    uint64_t reading_ms = now_ms + SIM_WARMUP_MS + (uint64_t)config->device.turbidity_samples * TURBIDITY_SAMPLE_INTERVAL_MS;
+    uint64_t next_wake_ms = now_ms + next_ms;
+    uint32_t interval_ms = node.interval_ms;
+    takeReading(i, reading_ms);
+    if (node.interval_ms != interval_ms) {
+        // triggered: scheduleNextCycle() again from the reading, on the active interval
+        next_ms = config->slots ? node.clock.msUntilNextSlot(nodeMillis(i, reading_ms), node.interval_ms,
+                                                             SIM_WARMUP_MS)
+                                : node.interval_ms;
+        next_wake_ms = reading_ms + next_ms;
+    }
+    schedule(next_wake_ms * 1000, SIM_EVENT::WAKE, i);
+}
+
+/**
+ * @brief fillPayload(), sendReading() & compressQuietReading() for a reading taken at now_ms.
+ */
+void simRun::takeReading(uint32_t i, uint64_t now_ms) {
+    simNode &node = nodes[i];
+    result.readings++;
+    uint64_t onset_ms = 0, end_ms = 0;
+    float storm_ntu = stormNtu(i, now_ms, &onset_ms, &end_ms);
+    if ((storm_ntu >= SIM_STORM_SEEN_NTU) && (onset_ms != node.onset_ms) && (onset_ms > node.onset_end_ms)) {
+        if (node.onset_ms != 0) {
+            result.storms_missed++;
+        }
+        node.onset_ms = onset_ms;
+        node.onset_end_ms = end_ms;
+        result.storms_seen++;
+    } else if ((node.onset_ms != 0) && (now_ms > node.onset_end_ms)) {
+        result.storms_missed++;
+        node.onset_ms = 0;
+    }
+    // the 100 sample average, and mvToNTU()'s 3000 NTU cap
+    float ntu = node.baseline_ntu + storm_ntu + node.noise_ntu * normal(random);
+    ntu = constrain(ntu, 0.0f, 3000.0f);
+
+    if (node.mode.update(node.detector.update(ntu))) {
+        node.interval_ms = config->device.active_interval_ms;
+        if (storm_ntu < 1.0f) {
+            result.false_triggers++;
+        }
+    }
+    bool alert = node.mode.alert();
+
+    node.rotation.startFrame(nodeMillis(i, now_ms));
+    sensorData data = {};
+    data.battery_mv.value = 3900.0f - (float)(now_ms / 3600000) * 0.05f;
+    data.battery_mv.is_valid = true;
+    data.turbidity.value = (uint32_t)ntu;
+    data.turbidity.min = (uint32_t)max(0.0f, ntu - 2 * node.noise_ntu);
+    data.turbidity.max = (uint32_t)(ntu + 2 * node.noise_ntu);
+    data.turbidity.is_valid = true;
+    uint8_t buffer[PAYLOAD_BUFFER_SIZE];
+    uint8_t port = 0;
+    uint8_t due_mask = node.rotation.dueMask();
+    uint8_t length = node.rotation.encodeFrame(&data, due_mask, buffer, &port);
+    if (config->device.compression_dntu > 0) {
+        node.compressor.addReading(node.clock.nowSeconds(nodeMillis(i, now_ms)), ntu);
+    }
+
+    simQueued frame = { length, alert, 1, now_ms, 0 };
+    bool is_reading = true;
+    if (config->device.compression_dntu > 0) {
+        if (alert || (due_mask != 1)) {
+            // flushCompressedReadings()
+            if (node.compressor.pendingPoints() >= 2) {
+                uint8_t series[OUTBOX_BATCH_MAX_LENGTH];
+                queue(i, { node.compressor.encodeFrame(series, sizeof(series)), alert, node.unsent_readings,
+                           node.unsent_oldest_ms, 0 });
+                node.last_series_ms = now_ms;
+                node.unsent_readings = 0;
+            }
+        } else if (!node.compressor.frameReady() && ((now_ms - node.last_series_ms) < SIM_SERIES_MAX_HOLD_MS)) {
+            if (node.unsent_readings++ == 0) {
+                node.unsent_oldest_ms = now_ms;
+            }
+            return;
+        } else {
+            if (node.unsent_readings++ == 0) {
+                node.unsent_oldest_ms = now_ms;
+            }
+            uint8_t series[OUTBOX_BATCH_MAX_LENGTH];
+            frame = { node.compressor.encodeFrame(series, sizeof(series)), false, node.unsent_readings,
+                      node.unsent_oldest_ms, 0 };
+            node.last_series_ms = now_ms;
+            node.unsent_readings = 0;
+            is_reading = false;
+        }
+    }
+    bool sent_live = node.outbox.empty();
+    sendPayload(i, now_ms, frame);
+    if (is_reading) {
+        node.rotation.frameSent(sent_live);
+    }
+}
+
+/**
+ * @brief Outbox::push(): when full the oldest frame goes, unless it's an alert and the new frame isn't.
+ */
+void simRun::queue(uint32_t i, simQueued frame) {
+    simNode &node = nodes[i];
+    frame.sequence = node.next_sequence++;
+    if (node.outbox.size() >= OUTBOX_SLOTS) {
+        auto oldest = std::min_element(node.outbox.begin(), node.outbox.end(),
+                                       [](const simQueued &a, const simQueued &b) { return a.sequence < b.sequence; });
+        if (oldest->alert && !frame.alert) {
+            result.dropped_readings += frame.readings;
+            return;
+        }
+        result.dropped_readings += oldest->readings;
+        node.outbox.erase(oldest);
+    }
+    node.outbox.push_back(frame);
+}
+
+/**
+ * @brief main.cpp's sendPayload(): straight out if nothing is queued, otherwise queued & one batch drained.
+ */
+void simRun::sendPayload(uint32_t i, uint64_t now_ms, const simQueued &frame) {
+    simNode &node = nodes[i];
+    if (frame.length == 0) {
+        return;
+    }
+    if (node.outbox.empty()) {
+        if (frame.length <= node.max_length) {
+            transmit(i, now_ms, frame.length, frame.alert, frame.readings, frame.oldest_ms);
+        } else {
+            // sendLoRaWANFrame() refuses it & the outbox drops it, the sim's data rates don't change
+            result.dropped_readings += frame.readings;
+        }
+        return;
+    }
+    queue(i, frame);
+    // Outbox::dropLongerThan(): max_length is the dwell limit, they'd never go
+    size_t kept = 0;
+    for (size_t q = 0; q < node.outbox.size(); q++) {
+        if (node.outbox[q].length > node.max_length) {
+            result.dropped_readings += node.outbox[q].readings;
+        } else {
+            node.outbox[kept++] = node.outbox[q];
+        }
+    }
+    node.outbox.resize(kept);
+    if (node.outbox.empty()) {
+        return;
+    }
+    // one frame, or the first (alerts first, then oldest) too long to batch, goes alone
+    size_t first = 0;
+    for (size_t q = 1; q < node.outbox.size(); q++) {
+        if (node.outbox[q].alert && !node.outbox[first].alert) {
+            first = q;
+        }
+    }
+    if ((node.outbox.size() == 1) ||
+        ((OUTBOX_BATCH_HEADER + OUTBOX_BATCH_RECORD_HEADER + node.outbox[first].length) > node.max_length)) {
+        const simQueued &only = node.outbox[first];
+        transmit(i, now_ms, only.length, only.alert, only.readings, only.oldest_ms);
+        node.outbox.erase(node.outbox.begin() + first);
+        return;
+    }
+    // alerts first, then oldest first (the outbox is in sequence order), as many as fit
+    uint8_t length = OUTBOX_BATCH_HEADER;
+    bool alert = false;
+    uint16_t readings = 0;
+    uint64_t oldest_ms = now_ms;
+    std::vector<bool> taken(node.outbox.size(), false);
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t q = 0; q < node.outbox.size(); q++) {
+            const simQueued &queued = node.outbox[q];
+            if ((queued.alert != (pass == 0)) ||
+                ((length + OUTBOX_BATCH_RECORD_HEADER + queued.length) > node.max_length)) {
+                continue;
+            }
+            taken[q] = true;
+            length += OUTBOX_BATCH_RECORD_HEADER + queued.length;
+            alert = alert || queued.alert;
+            readings += queued.readings;
+            oldest_ms = min(oldest_ms, queued.oldest_ms);
+        }
+    }
+    if (length == OUTBOX_BATCH_HEADER) {
+        return;
+    }
+    transmit(i, now_ms, length, alert, readings, oldest_ms);
+    kept = 0;
+    for (size_t q = 0; q < node.outbox.size(); q++) {
+        if (!taken[q]) {
+            node.outbox[kept++] = node.outbox[q];
+        }
+    }
+    node.outbox.resize(kept);
+}
+
+void simRun::transmit(uint32_t i, uint64_t now_ms, uint8_t length, bool alert, uint16_t readings,
+                      uint64_t oldest_ms) {
+    simNode &node = nodes[i];
+    uint32_t airtime_us = lorawanTimeOnAirUs(node.data_rate, length);
+    uint32_t f;
+    if (free_frames.empty()) {
+        f = frames.size();
+        frames.emplace_back();
+    } else {
+        f = free_frames.back();
+        free_frames.pop_back();
+    }
+    simFrame &frame = frames[f];
+    frame.node = i;
+    frame.end_us = now_ms * 1000 + airtime_us;
+    frame.channel = random() % config->channels;
+    frame.spreading_factor = 12 - node.data_rate;
+    frame.alert = alert;
+    frame.readings = readings;
+    frame.power_dbm = node.link_dbm + config->fading_db * normal(random);
+    frame.interference_dbm = -INFINITY;
+    frame.start_ms = now_ms;
+    frame.oldest_ms = oldest_ms;
+    node.frames++;
+    node.airtime_us += airtime_us;
+    result.frames++;
+    result.alert_frames += alert;
+    result.airtime_us += airtime_us;
+    schedule(now_ms * 1000, SIM_EVENT::TX_START, f);
+}
+
+void simRun::txStart(uint32_t f) {
+    simFrame &frame = frames[f];
+    // the gateway locks onto a preamble only with a demodulator free
+    frame.demodulated = demodulating < config->demodulators;
+    demodulating += frame.demodulated;
+    for (uint32_t other : active[frame.channel]) {
+        simFrame &overlapping = frames[other];
+        if (overlapping.spreading_factor == frame.spreading_factor) {
+            frame.interference_dbm = max(frame.interference_dbm, overlapping.power_dbm);
+            overlapping.interference_dbm = max(overlapping.interference_dbm, frame.power_dbm);
+        }
+    }
+    active[frame.channel].push_back(f);
+    schedule(frame.end_us, SIM_EVENT::TX_END, f);
+}
+
+void simRun::txEnd(uint32_t f) {
+    simFrame &frame = frames[f];
+    std::vector<uint32_t> &on_channel = active[frame.channel];
+    on_channel.erase(std::find(on_channel.begin(), on_channel.end(), f));
+    demodulating -= frame.demodulated;
+    simNode &node = nodes[frame.node];
+    if (!frame.demodulated) {
+        result.lost_demodulators++;
+    } else if (frame.power_dbm < sensitivityDbm(frame.spreading_factor)) {
+        result.lost_sensitivity++;
+    } else if (frame.power_dbm - frame.interference_dbm < config->capture_db) {
+        result.lost_collision++;
+    } else {
+        result.delivered++;
+        node.delivered++;
+        result.readings_delivered += frame.readings;
+        if (frame.alert) {
+            result.alerts_delivered++;
+            if ((node.onset_ms != 0) && (frame.start_ms >= node.onset_ms)) {
+                result.alert_latency_s.push_back((frame.end_us / 1000 - node.onset_ms) / 1000.0f);
+                node.onset_ms = 0;
+            }
+        }
+    }
+    free_frames.push_back(f);
+}
+
+simResult simRun::run(void) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t end_us = (uint64_t)(config->hours * 3600e6);
+    while (!events.empty() && (events.top().time_us < end_us)) {
+        simEvent event = events.top();
+        events.pop();
+        switch (event.type) {
+            case SIM_EVENT::WAKE:
+                wake(event.index, event.time_us / 1000);
+                break;
+            case SIM_EVENT::TX_START:
+                txStart(event.index);
+                break;
+            case SIM_EVENT::TX_END:
+                txEnd(event.index);
+                break;
+        }
+    }
+    for (const simNode &node : nodes) {
+        result.node_hours += config->hours - node.boot_ms / 3600e3;
+        result.max_node_airtime_us = max(result.max_node_airtime_us, node.airtime_us);
+    }
+    if (config->per_node_file != nullptr) {
+        FILE *file = fopen(config->per_node_file, "a");
+        if (file != nullptr) {
+            for (uint32_t i = 0; i < nodes.size(); i++) {
+                const simNode &node = nodes[i];
+                fprintf(file, "%u,%llu,%u,%u,%.1f,%llu,%llu,%.0f\n", result.nodes, (unsigned long long)seed, i,
+                        node.data_rate, node.link_dbm, (unsigned long long)node.frames,
+                        (unsigned long long)node.delivered, node.airtime_us / 1000);
+            }
+            fclose(file);
+        }
+    }
+    result.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+static void addResult(simResult *total, const simResult &run) {
+    total->nodes = run.nodes;
+    total->node_hours += run.node_hours;
+    total->frames += run.frames;
+    total->delivered += run.delivered;
+    total->alert_frames += run.alert_frames;
+    total->alerts_delivered += run.alerts_delivered;
+    total->lost_collision += run.lost_collision;
+    total->lost_demodulators += run.lost_demodulators;
+    total->lost_sensitivity += run.lost_sensitivity;
+    total->readings += run.readings;
+    total->readings_delivered += run.readings_delivered;
+    total->dropped_readings += run.dropped_readings;
+    total->storms_seen += run.storms_seen;
+    total->storms_missed += run.storms_missed;
+    total->false_triggers += run.false_triggers;
+    total->airtime_us += run.airtime_us;
+    total->max_node_airtime_us = max(total->max_node_airtime_us, run.max_node_airtime_us);
+    total->alert_latency_s.insert(total->alert_latency_s.end(), run.alert_latency_s.begin(),
+                                  run.alert_latency_s.end());
+    total->wall_s += run.wall_s;
+}
+
+static float percentile(std::vector<float> *values, float p) {
+    if (values->empty()) {
+        return NAN;
+    }
+    size_t k = (size_t)(p * (values->size() - 1));
+    std::nth_element(values->begin(), values->begin() + k, values->end());
+    return (*values)[k];
+}
+
+static double ratio(uint64_t part, uint64_t whole) { return (whole > 0) ? 100.0 * part / whole : NAN; }
+
+static void printResult(simResult *result, double hours_per_run) {
+    double runs = result->node_hours / (result->nodes * hours_per_run);
+    printf("%6u %10.0f %9.1f %7.2f %7.2f %7.2f %6.2f %6.2f %6.2f %6.2f %7.1f %7.1f %6llu %6llu %9.1f %8.1f %7.2f\n",
+           result->nodes, result->node_hours, result->frames / result->node_hours,
+           ratio(result->delivered, result->frames), ratio(result->alerts_delivered, result->alert_frames),
+           ratio(result->readings_delivered, result->readings), ratio(result->dropped_readings, result->readings),
+           ratio(result->lost_collision, result->frames), ratio(result->lost_demodulators, result->frames),
+           ratio(result->lost_sensitivity, result->frames), percentile(&result->alert_latency_s, 0.5f),
+           percentile(&result->alert_latency_s, 0.95f), (unsigned long long)result->storms_missed,
+           (unsigned long long)result->false_triggers, result->airtime_us / 1000 / result->node_hours,
+           result->max_node_airtime_us / 1000 / hours_per_run, result->wall_s / runs);
+}
+
+static void usage(void) {
+    printf("fleet_sim [options]\n"
+           "  --nodes 100,500,...   fleet sizes to run (default 100,500,1000,2000)\n"
+           "  --hours H             simulated time per run (168)\n"
+           "  --replications R      runs per fleet size with different seeds (1)\n"
+           "  --threads T           worker threads, 0 = every core (0)\n"
+           "  --seed S              first seed (1)\n"
+           "  --normal-s / --active-s / --active-cycles / --trigger-ntu / --samples / --compression-dntu / --tx-power\n"
+           "                        device config, as set by a config downlink (firmware defaults)\n"
+           "  --free-running        readings on the interval from boot, as before the first clock sync\n"
+           "  --clock-error-ms MS   sigma of each node's clock error after sync (50)\n"
+           "  --storms-per-day F    (0.3)  --storm-reach F (0.8)  --storm-lag-min M (60)\n"
+           "  --storm-hours H       (6)    --storm-peak-ntu N (400)\n"
+           "  --radius-km R         gateway coverage radius (3)\n"
+           "  --dr N                every node at DRn instead of the fastest with 10 dB margin\n"
+           "  --min-dr N            slowest DR a node is given (2, the AU915 dwell time limit)\n"
+           "  --channels N (8)  --demodulators N (8)  --capture-db DB (6)\n"
+           "  --per-node FILE       append nodes,seed,node,dr,link_dbm,frames,delivered,airtime_ms per node\n");
+}
+
+static std::vector<uint32_t> parseList(const char *text) {
+    std::vector<uint32_t> values;
+    for (const char *at = text; *at != '\0';) {
+        char *end;
+        values.push_back(strtoul(at, &end, 10));
+        at = (*end == ',') ? end + 1 : end;
+        if (end == at) {
+            break;
+        }
+    }
+    return values;
+}
+
+int main(int argc, char **argv) {
+    simConfig config;
+    for (int a = 1; a < argc; a++) {
+        std::string option = argv[a];
+        if ((option == "--help") || (option == "-h")) {
+            usage();
+            return 0;
+        }
+        if (option == "--free-running") {
+            config.slots = false;
+            continue;
+        }
+        if (a + 1 >= argc) {
+            fprintf(stderr, "%s needs a value\n", argv[a]);
+            return 1;
+        }
+        const char *value = argv[++a];
+        if (option == "--nodes") {
+            config.nodes = parseList(value);
+        } else if (option == "--hours") {
+            config.hours = atof(value);
+        } else if (option == "--replications") {
+            config.replications = max(1, atoi(value));
+        } else if (option == "--threads") {
+            config.threads = atoi(value);
+        } else if (option == "--seed") {
+            config.seed = strtoull(value, nullptr, 10);
+        } else if (option == "--normal-s") {
+            config.device.normal_interval_ms = atoi(value) * 1000;
+        } else if (option == "--active-s") {
+            config.device.active_interval_ms = atoi(value) * 1000;
+        } else if (option == "--active-cycles") {
+            config.device.active_cycles = atoi(value);
+        } else if (option == "--trigger-ntu") {
+            config.device.trigger_ntu = atoi(value);
+        } else if (option == "--samples") {
+            config.device.turbidity_samples = atoi(value);
+        } else if (option == "--compression-dntu") {
+            config.device.compression_dntu = atoi(value);
+        } else if (option == "--tx-power") {
+            config.device.tx_power = atoi(value);
+        } else if (option == "--clock-error-ms") {
+            config.clock_error_ms = atof(value);
+        } else if (option == "--storms-per-day") {
+            config.storms_per_day = atof(value);
+        } else if (option == "--storm-reach") {
+            config.storm_reach = atof(value);
+        } else if (option == "--storm-lag-min") {
+            config.storm_lag_min = atof(value);
+        } else if (option == "--storm-hours") {
+            config.storm_hours = atof(value);
+        } else if (option == "--storm-peak-ntu") {
+            config.storm_peak_ntu = atof(value);
+        } else if (option == "--radius-km") {
+            config.radius_km = atof(value);
+        } else if (option == "--dr") {
+            config.fixed_dr = constrain(atoi(value), 0, 5);
+        } else if (option == "--min-dr") {
+            config.min_dr = constrain(atoi(value), 0, 5);
+        } else if (option == "--channels") {
+            config.channels = constrain(atoi(value), 1, 64);
+        } else if (option == "--demodulators") {
+            config.demodulators = constrain(atoi(value), 1, 64);
+        } else if (option == "--capture-db") {
+            config.capture_db = atof(value);
+        } else if (option == "--per-node") {
+            config.per_node_file = value;
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[a - 1]);
+            usage();
+            return 1;
+        }
+    }
+    if (config.nodes.empty() || (config.hours <= 0)) {
+        usage();
+        return 1;
+    }
+
+    // every (fleet size, replication) is a job, handed out to the threads as they finish
+    struct simJob {
+        uint32_t nodes;
+        uint64_t seed;
+        simResult result;
+    };
+    std::vector<simJob> jobs;
+    for (uint32_t n : config.nodes) {
+        for (uint32_t r = 0; r < config.replications; r++) {
+            jobs.push_back({ n, splitMix(config.seed + r), {} });
+        }
+    }
+    uint32_t threads = (config.threads > 0) ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<uint32_t>(threads, jobs.size());
+    std::atomic<size_t> next_job(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            for (size_t j; (j = next_job++) < jobs.size();) {
+                jobs[j].result = simRun(&config, jobs[j].nodes, jobs[j].seed).run();
+            }
+        });
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%s, %.0f h x %u replications, %.2f storms/day reaching %.0f%%, normal %lu s, active %lu s\n",
+           config.slots ? "wall clock slots" : "free running", config.hours, config.replications, config.storms_per_day,
+           100 * config.storm_reach, (unsigned long)config.device.normal_interval_ms / 1000,
+           (unsigned long)config.device.active_interval_ms / 1000);
+    printf("%6s %10s %9s %7s %7s %7s %6s %6s %6s %6s %7s %7s %6s %6s %9s %8s %7s\n", "nodes", "node-h", "up/node-h",
+           "deliv%", "alert%", "read%", "drop%", "coll%", "demod%", "sens%", "lat50s", "lat95s", "missed", "false",
+           "ms/node-h", "max-ms/h", "cpu-s");
+    double node_hours = 0;
+    for (uint32_t n : config.nodes) {
+        simResult total;
+        for (const simJob &job : jobs) {
+            if (job.nodes == n) {
+                addResult(&total, job.result);
+            }
+        }
+        node_hours += total.node_hours;
+        printResult(&total, config.hours);
+    }
+    printf("%.0f node-hours in %.2f s on %u threads: %.2e node-hours/s\n", node_hours, wall_s, threads,
+           node_hours / wall_s);
+    return 0;
+}
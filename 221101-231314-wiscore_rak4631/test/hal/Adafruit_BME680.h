@@ -0,0 +1,66 @@
+#pragma once
+/**
+ * @file Adafruit_BME680.h
+ * @brief Host stand-in for the Adafruit BME680 library. begin() probes the chip ID over Wire and performReading()
+ * blocks for the measurement time like the real one, but the values come straight from the hostBme680 (see HostHal.h)
+ * rather than from its ADC registers & compensation.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define BME68X_DEFAULT_ADDRESS 0x77
+#define BME68X_CHIP_ID_ADDR    0xD0
+#define BME68X_CHIP_ID         0x61
+
+#define BME68X_OS_NONE 0
+#define BME68X_OS_1X   1
+#define BME68X_OS_2X   2
+#define BME68X_OS_4X   3
+#define BME68X_OS_8X   4
+#define BME68X_OS_16X  5
+#define BME680_OS_1X   BME68X_OS_1X
+#define BME680_OS_2X   BME68X_OS_2X
+#define BME680_OS_4X   BME68X_OS_4X
+#define BME680_OS_8X   BME68X_OS_8X
+#define BME680_OS_16X  BME68X_OS_16X
+
+#define BME68X_FILTER_OFF      0
+#define BME68X_FILTER_SIZE_1   1
+#define BME68X_FILTER_SIZE_3   2
+#define BME68X_FILTER_SIZE_7   3
+#define BME680_FILTER_SIZE_0   BME68X_FILTER_OFF
+#define BME680_FILTER_SIZE_1   BME68X_FILTER_SIZE_1
+#define BME680_FILTER_SIZE_3   BME68X_FILTER_SIZE_3
+#define BME680_FILTER_SIZE_7   BME68X_FILTER_SIZE_7
+
+class hostBme680;
+
+class Adafruit_BME680 {
+  public:
+    bool begin(uint8_t address = BME68X_DEFAULT_ADDRESS, bool init_settings = true);
+    bool setTemperatureOversampling(uint8_t os);
+    bool setHumidityOversampling(uint8_t os);
+    bool setPressureOversampling(uint8_t os);
+    bool setIIRFilterSize(uint8_t filter);
+    bool setGasHeater(uint16_t heater_temp, uint16_t heater_time);
+    /** @brief Blocks for the measurement (and gas heater) time, then fills in the values. */
+    bool performReading(void);
+
+    float temperature = 0;
+    float humidity = 0;
+    uint32_t pressure = 0;
+    uint32_t gas_resistance = 0;
+
+  private:
+    uint8_t address = BME68X_DEFAULT_ADDRESS;
+    uint8_t os_temperature = BME68X_OS_8X;
+    uint8_t os_humidity = BME68X_OS_2X;
+    uint8_t os_pressure = BME68X_OS_4X;
+    uint16_t heater_ms = 0;
+};
@@ -0,0 +1,64 @@
+#pragma once
+/**
+ * @file Adafruit_LittleFS.h
+ * @brief Host stand-in for the Adafruit LittleFS wrapper: files are kept in memory (see hostFlashFiles() in HostHal.h)
+ * and survive hostReset(), like the internal flash survives a reset. Directories aren't modelled.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+
+#define FILE_O_READ  0
+#define FILE_O_WRITE 1
+
+namespace Adafruit_LittleFS_Namespace {
+
+class Adafruit_LittleFS;
+
+class File {
+  public:
+    File(Adafruit_LittleFS &fs);
+    File(const char *path, uint8_t mode, Adafruit_LittleFS &fs);
+    /** @brief FILE_O_WRITE creates the file if needed and opens it at the end, FILE_O_READ opens it at the start. */
+    bool open(const char *path, uint8_t mode);
+    int read(void);
+    int read(void *buffer, uint16_t length);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t length);
+    int peek(void);
+    int available(void);
+    /** @brief Seeking past the end is allowed, a write there fills the gap with zeros. */
+    bool seek(uint32_t position);
+    uint32_t position(void);
+    uint32_t size(void);
+    bool truncate(uint32_t size);
+    bool truncate(void);
+    void flush(void);
+    void close(void);
+    bool isOpen(void);
+    operator bool(void);
+
+  private:
+    char path[64] = {};
+    bool open_ = false;
+    bool writable = false;
+    uint32_t pos = 0;
+};
+
+class Adafruit_LittleFS {
+  public:
+    /** @brief Mounts the file system, fails if hostFlashFailMount(). */
+    bool begin(void);
+    void end(void);
+    bool format(void);
+    bool exists(const char *path);
+    bool remove(const char *path);
+    bool rename(const char *from, const char *to);
+    bool mkdir(const char *path);
+};
+
+} // namespace Adafruit_LittleFS_Namespace
@@ -0,0 +1,163 @@
+#pragma once
+/**
+ * @file Arduino.h
+ * @brief Host stand-in for the Adafruit nRF52 core's Arduino.h: the Arduino, FreeRTOS & nRF52 calls the firmware makes,
+ * implemented on a virtual clock so the firmware can be built and run on a host. See HostHal.h for the other side: the
+ * test drives time, the ADC channels, I2C devices, the radio and the flash from there.
+ *
+ * Only what the firmware uses is here. Pin numbers are the RAK4631's (variant.h). One tick is 1 ms, rather than the
+ * nRF52's 1/1024 s.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+using std::max;
+using std::min;
+
+// FREERTOS - see HostScheduler.cpp
+typedef struct hostTask *TaskHandle_t;
+typedef struct hostSemaphore *SemaphoreHandle_t;
+typedef struct hostTimer *TimerHandle_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void (*TaskFunction_t)(void *);
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t);
+
+#define pdFALSE            0
+#define pdTRUE             1
+#define pdPASS             1
+#define pdFAIL             0
+#define portMAX_DELAY      0xFFFFFFFFUL
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms)  ((TickType_t)(ms))
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+#define TASK_PRIO_LOWEST  0 /**< The log drain task. */
+#define TASK_PRIO_LOW     1 /**< The loop task. */
+#define TASK_PRIO_NORMAL  2
+#define TASK_PRIO_HIGH    3 /**< The timer daemon, which also runs the radio's events. */
+#define TASK_PRIO_HIGHEST 4
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_words, void *parameter,
+    UBaseType_t priority, TaskHandle_t *handle);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken);
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *woken);
+
+/** @brief Nothing runs in an interrupt on the host. */
+inline uint32_t __get_IPSR(void) { return 0; }
+
+/** @brief The Adafruit core's wrapper around a FreeRTOS software timer. Callbacks run in the timer daemon task. */
+class SoftwareTimer {
+  public:
+    void begin(uint32_t ms, TimerCallbackFunction_t callback, void *timer_id = NULL, bool repeating = true);
+    void start(void);
+    void stop(void);
+    void reset(void);
+    /** @brief Like xTimerChangePeriod(), this also starts the timer. */
+    void setPeriod(uint32_t ms);
+    inline TimerHandle_t getHandle(void) { return handle; };
+
+  private:
+    TimerHandle_t handle = nullptr;
+};
+
+// ARDUINO
+#define HIGH         1
+#define LOW          0
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+#define WB_IO1      17
+#define WB_IO2      34 /**< Switches 3V3_S, the sensor rail. */
+#define WB_IO3      21
+#define WB_IO4      4
+#define WB_IO5      9
+#define WB_IO6      10
+#define WB_A0       5  /**< AIN3, also the battery divider. */
+#define WB_A1       31 /**< AIN7. */
+#define PIN_VBAT    WB_A0
+#define LED_GREEN   35
+#define LED_BLUE    36
+#define LED_BUILTIN LED_GREEN
+#define LED_CONN    LED_BLUE
+#define HOST_PINS   48 /**< P0.00 - P1.15. */
+
+/** @brief SAADC reference & gain, the full scale input is in the comment. */
+enum _eAnalogReference {
+    AR_DEFAULT,      /**< 3.6 V. */
+    AR_INTERNAL,     /**< 3.6 V. */
+    AR_INTERNAL_3_0, /**< 3.0 V. */
+    AR_INTERNAL_2_4, /**< 2.4 V. */
+    AR_INTERNAL_1_8, /**< 1.8 V. */
+    AR_INTERNAL_1_2, /**< 1.2 V. */
+    AR_VDD4,         /**< VDD, 3.3 V (VDD/4 reference with 1/4 gain). */
+};
+
+uint32_t millis(void);
+void delay(uint32_t ms);
+void yield(void);
+void pinMode(uint32_t pin, uint32_t mode);
+void digitalWrite(uint32_t pin, uint32_t level);
+int digitalRead(uint32_t pin);
+void analogReference(_eAnalogReference reference);
+void analogReadResolution(int bits);
+void analogOversampling(uint32_t samples);
+uint32_t analogRead(uint32_t pin);
+void randomSeed(unsigned long seed);
+long random(long max);
+long random(long min, long max);
+
+#define sq(x)                  ((x) * (x))
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+/** @brief USB CDC Serial. Output is kept for the test (hostSerialTake()), it's connected once hostSerialConnect(). */
+class HardwareSerial {
+  public:
+    void begin(unsigned long baud);
+    operator bool(void);
+    size_t print(const char *text);
+    size_t println(const char *text = "");
+    size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+    size_t write(const uint8_t *data, size_t length);
+    void flush(void);
+    int available(void);
+    int read(void);
+};
+extern HardwareSerial Serial;
+
+// NRF52
+#define POWER_RESETREAS_RESETPIN_Msk       (1UL << 0)
+#define POWER_RESETREAS_DOG_Msk            (1UL << 1)
+#define POWER_RESETREAS_SREQ_Msk           (1UL << 2)
+#define POWER_RESETREAS_LOCKUP_Msk         (1UL << 3)
+#define POWER_RESETREAS_OFF_Msk            (1UL << 16)
+#define POWER_RAM_POWERSET_S0RETENTION_Pos 16
+
+/** @brief RESETREAS at boot, see hostSetResetReason(). */
+uint32_t readResetReason(void);
+
+/** @brief System OFF. On the host every task stops and hostSystemOff() turns true; there's no wake. */
+void systemOff(uint32_t pin, uint8_t wake_logic);
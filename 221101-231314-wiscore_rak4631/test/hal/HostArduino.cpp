@@ -0,0 +1,219 @@
+/**
+ * @file HostArduino.cpp
+ * @brief Pins, the SAADC, Serial, random() and the reset reason on the host.
+ *
+ * analogRead() converts the voltage the test set on the pin like the SAADC: full scale is set by analogReference()
+ * (0.6 V internal reference and gain, or VDD/4 and gain 1/4), the result is clipped to the resolution and the
+ * oversampling averages that many conversions of the same voltage.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "HostHal.h"
+
+#include <stdarg.h>
+
+#include <random>
+
+#define HOST_VDD_MV            3300.0f
+#define HOST_SERIAL_KEEP_BYTES (1UL << 20)
+
+HardwareSerial Serial;
+
+static uint8_t pin_levels[HOST_PINS] = {};
+static uint8_t pin_modes[HOST_PINS] = {};
+static std::function<float(uint64_t)> adc_sources[HOST_PINS];
+static uint32_t adc_reads[HOST_PINS] = {};
+static float adc_full_scale_mv = 3600.0f;
+static int adc_resolution = 10;
+static uint32_t reset_reason = 0;
+static std::mt19937 random_engine;
+static bool serial_connected = false;
+static std::string serial_output;
+
+/**
+ * @brief Full scale input of a SAADC reference & gain setting.
+ */
+static float fullScaleMv(_eAnalogReference reference) {
+    switch (reference) {
+        case AR_INTERNAL_3_0:
+            return 3000.0f;
+        case AR_INTERNAL_2_4:
+            return 2400.0f;
+        case AR_INTERNAL_1_8:
+            return 1800.0f;
+        case AR_INTERNAL_1_2:
+            return 1200.0f;
+        case AR_VDD4:
+            return HOST_VDD_MV;
+        case AR_DEFAULT:
+        case AR_INTERNAL:
+        default:
+            return 3600.0f;
+    }
+}
+
+// PINS
+
+void pinMode(uint32_t pin, uint32_t mode) {
+    if (pin < HOST_PINS) {
+        pin_modes[pin] = mode;
+        if (mode == INPUT_PULLUP) {
+            pin_levels[pin] = HIGH;
+        }
+    }
+}
+
+void digitalWrite(uint32_t pin, uint32_t level) {
+    if (pin >= HOST_PINS) {
+        return;
+    }
+    int new_level = (level != LOW) ? HIGH : LOW;
+    if (new_level != pin_levels[pin]) {
+        hostPowerEvent event = {};
+        event.time_ms = hostNowMs();
+        event.type = HOST_POWER::PIN;
+        event.pin = pin;
+        event.level = (uint8_t)new_level;
+        hostPowerEmit(event);
+    }
+    pin_levels[pin] = new_level;
+}
+
+int digitalRead(uint32_t pin) { return (pin < HOST_PINS) ? pin_levels[pin] : LOW; }
+
+int hostPinLevel(uint32_t pin) { return digitalRead(pin); }
+
+// ADC
+
+void analogReference(_eAnalogReference reference) { adc_full_scale_mv = fullScaleMv(reference); }
+
+void analogReadResolution(int bits) { adc_resolution = constrain(bits, 8, 14); }
+
+void analogOversampling(uint32_t samples) {
+    // the same voltage every conversion, so averaging doesn't change the result
+    (void)samples;
+}
+
+uint32_t analogRead(uint32_t pin) {
+    if (pin >= HOST_PINS) {
+        return 0;
+    }
+    adc_reads[pin]++;
+    hostPowerEvent event = {};
+    event.time_ms = hostNowMs();
+    event.type = HOST_POWER::ADC_SAMPLE;
+    event.pin = pin;
+    hostPowerEmit(event);
+    float mv = adc_sources[pin] ? adc_sources[pin](hostNowMs()) : 0.0f;
+    uint32_t max_count = (1UL << adc_resolution) - 1;
+    float counts = roundf(mv * (float)(1UL << adc_resolution) / adc_full_scale_mv);
+    if (counts <= 0) {
+        return 0;
+    }
+    return (counts >= max_count) ? max_count : (uint32_t)counts;
+}
+
+void hostAdcSource(uint32_t pin, const std::function<float(uint64_t now_ms)> &mv) {
+    if (pin < HOST_PINS) {
+        adc_sources[pin] = mv;
+    }
+}
+
+void hostAdcSet(uint32_t pin, float mv) {
+    hostAdcSource(pin, [mv](uint64_t) { return mv; });
+}
+
+uint32_t hostAnalogReads(uint32_t pin) { return (pin < HOST_PINS) ? adc_reads[pin] : 0; }
+
+void hostResetPins(void) {
+    for (uint32_t pin = 0; pin < HOST_PINS; pin++) {
+        pin_levels[pin] = LOW;
+        pin_modes[pin] = INPUT;
+        adc_sources[pin] = nullptr;
+        adc_reads[pin] = 0;
+    }
+    adc_full_scale_mv = 3600.0f;
+    adc_resolution = 10;
+    reset_reason = 0;
+}
+
+// RANDOM
+
+void randomSeed(unsigned long seed) { random_engine.seed(seed); }
+
+long random(long max) {
+    if (max <= 0) {
+        return 0;
+    }
+    return std::uniform_int_distribution<long>(0, max - 1)(random_engine);
+}
+
+long random(long min, long max) {
+    if (min >= max) {
+        return min;
+    }
+    return min + random(max - min);
+}
+
+// RESET
+
+uint32_t readResetReason(void) { return reset_reason; }
+
+void hostSetResetReason(uint32_t reason) { reset_reason = reason; }
+
+// SERIAL
+
+void HardwareSerial::begin(unsigned long baud) { (void)baud; }
+
+HardwareSerial::operator bool(void) { return serial_connected; }
+
+size_t HardwareSerial::write(const uint8_t *data, size_t length) {
+    if (!serial_connected) {
+        // USB CDC drops it with nothing attached
+        return length;
+    }
+    static const bool echo = (getenv("HOST_SERIAL_ECHO") != nullptr) && (atoi(getenv("HOST_SERIAL_ECHO")) != 0);
+    if (echo) {
+        fwrite(data, 1, length, stdout);
+    }
+    serial_output.append((const char *)data, length);
+    if (serial_output.size() > HOST_SERIAL_KEEP_BYTES) {
+        // nobody is taking it, keep the newest half
+        serial_output.erase(0, serial_output.size() - HOST_SERIAL_KEEP_BYTES / 2);
+    }
+    return length;
+}
+
+size_t HardwareSerial::print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+
+size_t HardwareSerial::println(const char *text) { return print(text) + print("\r\n"); }
+
+size_t HardwareSerial::printf(const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) {
+        return 0;
+    }
+    return write((const uint8_t *)buffer, min((size_t)length, sizeof(buffer) - 1));
+}
+
+void HardwareSerial::flush(void) { fflush(stdout); }
+
+int HardwareSerial::available(void) { return 0; }
+
+int HardwareSerial::read(void) { return -1; }
+
+void hostSerialConnect(bool connected) { serial_connected = connected; }
+
+std::string hostSerialTake(void) {
+    std::string output;
+    output.swap(serial_output);
+    return output;
+}
@@ -0,0 +1,180 @@
+/**
+ * @file HostFlash.cpp
+ * @brief The internal flash file system on the host: a map of paths to bytes.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "HostHal.h"
+
+#include <InternalFileSystem.h>
+
+using namespace Adafruit_LittleFS_Namespace;
+
+Adafruit_LittleFS InternalFS;
+
+static std::map<std::string, std::vector<uint8_t>> files;
+static bool fail_mount = false;
+static struct hostFlashStats flash_stats = {};
+
+void hostFlashErase(void) {
+    files.clear();
+    flash_stats = {};
+}
+
+void hostFlashFailMount(bool fail) { fail_mount = fail; }
+
+std::map<std::string, std::vector<uint8_t>> &hostFlashFiles(void) { return files; }
+
+void hostFlashStats(struct hostFlashStats *stats) { *stats = flash_stats; }
+
+// FILE
+
+File::File(Adafruit_LittleFS &fs) { (void)fs; }
+
+File::File(const char *path, uint8_t mode, Adafruit_LittleFS &fs) {
+    (void)fs;
+    open(path, mode);
+}
+
+bool File::open(const char *path, uint8_t mode) {
+    close();
+    auto found = files.find(path);
+    if (mode == FILE_O_WRITE) {
+        std::vector<uint8_t> &data = files[path];
+        pos = data.size();
+        writable = true;
+    } else if (found != files.end()) {
+        pos = 0;
+        writable = false;
+    } else {
+        return false;
+    }
+    snprintf(this->path, sizeof(this->path), "%s", path);
+    open_ = true;
+    flash_stats.opens++;
+    return true;
+}
+
+int File::read(void) {
+    uint8_t byte;
+    return (read(&byte, 1) == 1) ? byte : -1;
+}
+
+int File::read(void *buffer, uint16_t length) {
+    if (!open_) {
+        return -1;
+    }
+    auto found = files.find(path);
+    if ((found == files.end()) || (pos >= found->second.size())) {
+        return 0;
+    }
+    const std::vector<uint8_t> &data = found->second;
+    uint32_t count = min((uint32_t)length, (uint32_t)data.size() - pos);
+    memcpy(buffer, &data[pos], count);
+    pos += count;
+    return count;
+}
+
+size_t File::write(uint8_t data) { return write(&data, 1); }
+
+size_t File::write(const uint8_t *data, size_t length) {
+    if (!open_ || !writable) {
+        return 0;
+    }
+    std::vector<uint8_t> &file = files[path];
+    if (file.size() < pos + length) {
+        // a gap left by seeking past the end reads back as zeros
+        file.resize(pos + length, 0);
+    }
+    memcpy(&file[pos], data, length);
+    pos += length;
+    flash_stats.writes++;
+    flash_stats.bytes_written += length;
+    hostPowerEvent event = {};
+    event.time_ms = hostNowMs();
+    event.type = HOST_POWER::FLASH_WRITE;
+    event.length = (uint16_t)min(length, (size_t)UINT16_MAX);
+    hostPowerEmit(event);
+    return length;
+}
+
+int File::peek(void) {
+    int byte = read();
+    if (byte >= 0) {
+        pos--;
+    }
+    return byte;
+}
+
+int File::available(void) {
+    uint32_t file_size = size();
+    return (pos < file_size) ? file_size - pos : 0;
+}
+
+bool File::seek(uint32_t position) {
+    if (!open_) {
+        return false;
+    }
+    pos = position;
+    return true;
+}
+
+uint32_t File::position(void) { return pos; }
+
+uint32_t File::size(void) {
+    auto found = files.find(path);
+    return (open_ && (found != files.end())) ? found->second.size() : 0;
+}
+
+bool File::truncate(uint32_t size) {
+    if (!open_ || !writable) {
+        return false;
+    }
+    files[path].resize(size, 0);
+    return true;
+}
+
+bool File::truncate(void) { return truncate(pos); }
+
+void File::flush(void) {}
+
+void File::close(void) { open_ = false; }
+
+bool File::isOpen(void) { return open_; }
+
+File::operator bool(void) { return open_; }
+
+// FILE SYSTEM
+
+bool Adafruit_LittleFS::begin(void) { return !fail_mount; }
+
+void Adafruit_LittleFS::end(void) {}
+
+bool Adafruit_LittleFS::format(void) {
+    files.clear();
+    return true;
+}
+
+bool Adafruit_LittleFS::exists(const char *path) { return files.count(path) > 0; }
+
+bool Adafruit_LittleFS::remove(const char *path) { return files.erase(path) > 0; }
+
+bool Adafruit_LittleFS::rename(const char *from, const char *to) {
+    auto found = files.find(from);
+    if (found == files.end()) {
+        return false;
+    }
+    std::vector<uint8_t> data = found->second;
+    files.erase(found);
+    files[to] = data;
+    return true;
+}
+
+bool Adafruit_LittleFS::mkdir(const char *path) {
+    (void)path;
+    return true;
+}
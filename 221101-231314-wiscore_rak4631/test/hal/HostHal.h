@@ -0,0 +1,332 @@
+#pragma once
+/**
+ * @file HostHal.h
+ * @brief The test's side of the host HAL: virtual time, the tasks, the simulated ADC channels, I2C devices, the LoRaWAN
+ * radio, Serial and the internal flash the firmware sees through Arduino.h & the library stand-ins in this directory.
+ *
+ * Time only moves while the test runs the firmware (hostRunFor()) or calls delay() itself, and it jumps straight to
+ * the next thing due whenever every task is blocked, so hours of firmware time run in milliseconds. Tasks are threads,
+ * but only one runs at a time and they switch like FreeRTOS tasks on one core: the highest priority ready task runs
+ * until it blocks, and a task made ready by a give or notify preempts a lower priority one straight away.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// TIME & TASKS - see HostScheduler.cpp
+
+/**
+ * @brief Starts the firmware: a loop task (TASK_PRIO_LOW, like the Adafruit core's) runs setup() then loop() for ever.
+ * Nothing runs until hostRunFor().
+ */
+void hostBoot(void (*setup)(void), void (*loop)(void));
+
+/**
+ * @brief Runs the tasks & timers for ms of virtual time. Returns once every task is blocked at that time.
+ */
+void hostRunFor(uint32_t ms);
+
+/**
+ * @brief Runs until condition() is true (checked whenever every task is blocked) or max_ms has passed.
+ * @return True if condition() was met.
+ */
+bool hostRunUntil(const std::function<bool(void)> &condition, uint32_t max_ms);
+
+/**
+ * @brief Virtual time since hostReset(), it doesn't wrap like millis().
+ */
+uint64_t hostNowMs(void);
+
+/**
+ * @brief Stops every task (they unwind from the call they're blocked in) and timer, and starts time again at start_ms
+ * (millis() then starts there too, e.g. just before it wraps). The pins, ADC, I2C devices, radio, Serial and flash
+ * are kept: use their own resets. The firmware's globals aren't reset, so boot it once per process.
+ */
+void hostReset(uint32_t start_ms = 0);
+
+/** @brief Scheduler counters. */
+struct hostSchedulerStats {
+    uint32_t tasks;            /**< Tasks created, the timer daemon included. */
+    uint64_t context_switches; /**< Times a different task was given the CPU. */
+    uint64_t idle_ms;          /**< Time every task was blocked. */
+    uint64_t wakeups;          /**< Times the CPU woke from idle. */
+    uint64_t timer_callbacks;  /**< Software timer callbacks & radio events run. */
+};
+
+/**
+ * @brief Fills stats with the scheduler counters since hostReset().
+ */
+void hostSchedulerStats(struct hostSchedulerStats *stats);
+
+/**
+ * @brief Runs event() in the timer daemon at virtual time hostNowMs() + delay_ms, like an interrupt handed to a high
+ * priority task. The radio uses it for the join accept & downlinks.
+ */
+void hostScheduleEvent(uint32_t delay_ms, const std::function<void(void)> &event);
+
+// PINS & ADC - see HostArduino.cpp
+
+/**
+ * @brief Level last written to a pin, LOW if never.
+ */
+int hostPinLevel(uint32_t pin);
+
+/**
+ * @brief Drives an analog input: the voltage at the pin, in mV, as a function of hostNowMs(). The default is 0 mV.
+ */
+void hostAdcSource(uint32_t pin, const std::function<float(uint64_t now_ms)> &mv);
+
+/**
+ * @brief Drives an analog input with a fixed voltage.
+ */
+void hostAdcSet(uint32_t pin, float mv);
+
+/**
+ * @brief analogRead() calls made on a pin.
+ */
+uint32_t hostAnalogReads(uint32_t pin);
+
+/**
+ * @brief Sets the pins, ADC channels & reset reason back to power on.
+ */
+void hostResetPins(void);
+
+/**
+ * @brief RESETREAS for readResetReason(), e.g. POWER_RESETREAS_DOG_Msk for a watchdog reset. 0 is a power on.
+ */
+void hostSetResetReason(uint32_t reason);
+
+/**
+ * @brief True once the firmware called systemOff().
+ */
+bool hostSystemOff(void);
+
+// SERIAL - see HostArduino.cpp
+
+/**
+ * @brief Plugs USB in (or unplugs it), Serial is true while connected.
+ */
+void hostSerialConnect(bool connected);
+
+/**
+ * @brief Returns what was written to Serial since the last call. Set HOST_SERIAL_ECHO=1 to see it on stdout as well.
+ */
+std::string hostSerialTake(void);
+
+// I2C - see HostWire.cpp
+
+/** @brief A device on the I2C bus. Transactions are whole: one write or one read per call. */
+class hostI2cDevice {
+  public:
+    virtual ~hostI2cDevice(void) {}
+    /** @return False to NACK. */
+    virtual bool write(const uint8_t *data, size_t length) = 0;
+    /** @return Bytes read, 0 to NACK. */
+    virtual size_t read(uint8_t *data, size_t length) = 0;
+};
+
+/**
+ * @brief Puts a device on the bus at a 7 bit address, replacing any there. The device is kept by pointer.
+ */
+void hostI2cAttach(uint8_t address, hostI2cDevice *device);
+
+/**
+ * @brief Takes the device at the address off the bus.
+ */
+void hostI2cDetach(uint8_t address);
+
+/**
+ * @brief The device at the address, nullptr if none.
+ */
+hostI2cDevice *hostI2cFind(uint8_t address);
+
+/** @brief A Sensirion SHTC3 (RAK1901) at 0x70: wake, sleep, ID & measurement commands, with CRCs. */
+class hostShtc3 : public hostI2cDevice {
+  public:
+    bool write(const uint8_t *data, size_t length) override;
+    size_t read(uint8_t *data, size_t length) override;
+    float temperature_c = 22.0f;
+    float humidity_pct = 50.0f;
+    uint32_t measurements = 0;
+
+  private:
+    bool awake = false;
+    uint16_t command = 0;
+};
+
+/**
+ * @brief A Bosch BME680 (RAK1906) at 0x76. Only the chip ID register is modelled on the bus; Adafruit_BME680 in this
+ * directory reads the compensated values straight from here.
+ */
+class hostBme680 : public hostI2cDevice {
+  public:
+    bool write(const uint8_t *data, size_t length) override;
+    size_t read(uint8_t *data, size_t length) override;
+    float temperature_c = 22.0f;
+    float humidity_pct = 50.0f;
+    uint32_t pressure_pa = 101325;
+    uint32_t gas_ohm = 50000;
+    uint32_t measurements = 0;
+
+  private:
+    uint8_t reg = 0;
+};
+
+// RADIO - see HostRadio.cpp
+
+/** @brief An uplink the firmware got out of lmh_send(). */
+struct hostUplink {
+    uint64_t time_ms;          /**< hostNowMs() when sent. */
+    uint8_t port;              /**< LoRaWAN port. */
+    std::vector<uint8_t> data; /**< Application payload. */
+    uint8_t data_rate;         /**< DR0 - DR6. */
+    uint32_t fcnt;             /**< Uplink frame counter. */
+    bool confirmed;            /**< Sent as a confirmed message. */
+    uint32_t time_on_air_ms;   /**< From the payload length & data rate, AU915. */
+};
+
+/**
+ * @brief Forgets the session, the uplinks, queued downlinks & the uplink handler. Joins are accepted 5 s after the
+ * request and downlinks come in RX1, 1 s after the uplink.
+ */
+void hostRadioReset(void);
+
+/**
+ * @brief The next failures joins are rejected (the join failed callback runs instead of joined).
+ */
+void hostRadioFailJoins(uint32_t failures);
+
+/**
+ * @brief Queues a downlink, sent in RX1 after the next uplink.
+ */
+void hostRadioQueueDownlink(uint8_t port, const std::vector<uint8_t> &data);
+
+/**
+ * @brief Called with every uplink, in the sending task, e.g. a network server that answers with
+ * hostRadioQueueDownlink(). nullptr for none.
+ */
+void hostRadioOnUplink(const std::function<void(const hostUplink &)> &handler);
+
+/**
+ * @brief Uplinks sent since hostRadioReset().
+ */
+const std::vector<hostUplink> &hostRadioUplinks(void);
+
+/**
+ * @brief Join requests sent since hostRadioReset().
+ */
+uint32_t hostRadioJoinRequests(void);
+
+/**
+ * @brief Radio.Sleep() calls since hostRadioReset().
+ */
+uint32_t hostRadioSleeps(void);
+
+/**
+ * @brief Sends the joins & uplinks, as real LoRaWAN frames, to a network server (test/ns/NetworkServer.h) at address
+ * ("host:port", see test/ns/NsSocket.h) instead of the built-in network. Its answers come back in RX1 or RX2, and its
+ * MAC commands are answered. Kept by hostRadioReset(); nullptr goes back to the built-in network. Setting
+ * HOST_NETWORK_SERVER to an address does the same at the first lmh_init().
+ * @return False if it couldn't connect.
+ */
+bool hostRadioConnect(const char *address);
+
+/**
+ * @brief The signal the gateway reports for each uplink, for the network server's ADR. Default -100 dBm & 5 dB SNR.
+ */
+void hostRadioSetLink(int16_t rssi, int8_t snr);
+
+/**
+ * @brief The radio's session, as the device sees it: the data rate & TX power (set by the firmware or a LinkADRReq),
+ * the address and the frame counters.
+ */
+struct hostRadioSession {
+    uint32_t dev_addr;
+    uint8_t data_rate;
+    uint8_t tx_power;
+    uint32_t uplink_counter;   /**< Next uplink's. */
+    uint32_t downlink_counter; /**< Next downlink's expected. */
+    uint32_t bad_downlinks;    /**< Dropped for a bad MIC, address or counter (network server only). */
+    uint32_t missed_downlinks; /**< Sent outside the RX windows the radio opened (network server only). */
+    uint32_t rx1_delay_ms;     /**< End of an uplink to RX1. */
+};
+void hostRadioSession(struct hostRadioSession *session);
+
+/**
+ * @brief Time on air of an uplink of length bytes at a data rate (AU915: DR0-DR5 SF12-SF7 at 125 kHz, DR6 SF8 at
+ * 500 kHz), 13 bytes of LoRaWAN overhead included.
+ */
+uint32_t hostTimeOnAirMs(uint8_t data_rate, uint8_t length);
+
+// FLASH - see HostFlash.cpp
+
+/** @brief Flash counters, for wear & energy. */
+struct hostFlashStats {
+    uint64_t bytes_written; /**< Bytes written to files. */
+    uint64_t writes;        /**< File write() calls. */
+    uint64_t opens;         /**< File opens. */
+};
+
+/**
+ * @brief Erases the file system, like a new device. The flash otherwise survives hostReset().
+ */
+void hostFlashErase(void);
+
+/**
+ * @brief Makes InternalFS.begin() fail (or work again), like a corrupt file system.
+ */
+void hostFlashFailMount(bool fail);
+
+/**
+ * @brief The files on the flash, by path.
+ */
+std::map<std::string, std::vector<uint8_t>> &hostFlashFiles(void);
+
+/**
+ * @brief Fills stats with the flash counters since hostFlashErase().
+ */
+void hostFlashStats(struct hostFlashStats *stats);
+
+// POWER - see HostPower.cpp
+
+/** @brief Things that draw current, for an energy model (test/energy/EnergyModel.h). */
+enum class HOST_POWER : uint8_t {
+    PIN,         /**< A pin changed level: pin & level. */
+    WAKE,        /**< The CPU woke from idle. */
+    ADC_SAMPLE,  /**< An analogRead(): pin. */
+    RADIO_TX,    /**< A frame sent: data_rate, tx_power, length (PHY payload) & duration_ms (time on air). */
+    RADIO_RX,    /**< An RX window opened: data_rate (DR8 and up downlink) & length received, 0 for none. */
+    FLASH_WRITE, /**< A file write: length. */
+};
+
+/** @brief One of those, at virtual time time_ms (an RX window's may be ahead of hostNowMs()). */
+struct hostPowerEvent {
+    uint64_t time_ms;
+    HOST_POWER type;
+    uint32_t pin;
+    uint8_t level;
+    uint8_t data_rate;
+    uint8_t tx_power;
+    uint16_t length;
+    uint32_t duration_ms;
+};
+
+/**
+ * @brief Called with every power event, nullptr for none. It may be called with the scheduler's lock held, so it
+ * mustn't call back into the HAL.
+ */
+void hostOnPowerEvent(const std::function<void(const hostPowerEvent &)> &listener);
+
+/**
+ * @brief Hands an event to the listener, for the stand-ins in this directory.
+ */
+void hostPowerEmit(const hostPowerEvent &event);
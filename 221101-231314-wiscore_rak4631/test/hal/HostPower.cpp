@@ -0,0 +1,22 @@
+/**
+ * @file HostPower.cpp
+ * @brief Power events from the host HAL's stand-ins (pins, wakes, ADC, radio, flash), for an energy model. See
+ * HostHal.h.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "HostHal.h"
+
+static std::function<void(const hostPowerEvent &)> power_listener;
+
+void hostOnPowerEvent(const std::function<void(const hostPowerEvent &)> &listener) { power_listener = listener; }
+
+void hostPowerEmit(const hostPowerEvent &event) {
+    if (power_listener) {
+        power_listener(event);
+    }
+}
@@ -0,0 +1,690 @@
+/**
+ * @file HostRadio.cpp
+ * @brief The lmh_* LoRaWAN helper & LoRaMac MIB on the host: a class A AU915 device with a network that always hears
+ * it. Joins are answered after HOST_JOIN_DELAY_MS, and while an uplink is on air and its RX windows are open lmh_send()
+ * is busy. The callbacks run in the timer daemon, like the SX126x driver's events run in its own task.
+ *
+ * Connected to a network server (hostRadioConnect()) the network is that server instead: joins & uplinks are built as
+ * LoRaWAN 1.0.x frames, encrypted & signed with the keys the firmware set, and its answers are checked and decrypted
+ * the same way. LinkADRReq (only taken with ADR on, like LoRaMac) and DevStatusReq are answered in the next uplink.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "HostHal.h"
+
+#include <LoRaWan-RAK4630.h>
+
+#include <deque>
+
+#include "NsSocket.h" /**< The link to a network server. */
+
+#define HOST_JOIN_DELAY_MS     5000 /**< Join request to accept (JOIN_ACCEPT_DELAY1 is 5 s). */
+#define HOST_RX1_DELAY_MS      1000 /**< End of the uplink to RX1, until a join accept's RxDelay says otherwise. */
+#define HOST_RX2_DELAY_MS      2000 /**< End of the uplink to RX2, the radio is busy until it closes. */
+#define HOST_RX_WINDOW_MS      100  /**< Time RX2 stays open. */
+#define HOST_DOWNLINK_RSSI     -90
+#define HOST_DOWNLINK_SNR      7
+#define HOST_DEV_ADDR          0x260B0001UL
+#define HOST_NET_ID            0x000013UL
+#define HOST_LINK_RSSI         -100
+#define HOST_LINK_SNR          5
+#define HOST_JOIN_REQUEST_SIZE 23   /**< MHDR, AppEUI, DevEUI, DevNonce & MIC. */
+#define HOST_JOIN_ACCEPT_SIZE  17   /**< MHDR, AppNonce, NetID, DevAddr, DLSettings, RxDelay & MIC. */
+#define HOST_RX2_DATA_RATE     8    /**< AU915 RX2: DR8, SF12 at 500 kHz. */
+#define HOST_RX2_FREQUENCY     923300000 /**< AU915 RX2 channel. */
+
+struct hostDownlink {
+    uint8_t port;
+    std::vector<uint8_t> data;
+};
+
+static lmh_callback_t callbacks = {};
+static lmh_param_t params = {};
+static bool initialised = false;
+static lmh_join_status join_status = LMH_RESET;
+static uint32_t join_failures = 0;     // joins still to reject, see hostRadioFailJoins()
+static uint32_t join_requests = 0;
+static uint64_t busy_until_ms = 0;     // end of the last uplink's RX windows
+static DeviceClass_t device_class = CLASS_A;
+static int8_t data_rate = DR_0;
+static int8_t tx_power = TX_POWER_0;
+static uint32_t dev_addr = 0;
+static uint32_t net_id = 0;
+static uint8_t nwk_s_key[16] = {};
+static uint8_t app_s_key[16] = {};
+static uint32_t uplink_counter = 0;
+static uint32_t downlink_counter = 0;
+static std::vector<hostUplink> uplinks;
+static std::deque<hostDownlink> downlinks;
+static std::function<void(const hostUplink &)> uplink_handler;
+static uint32_t radio_sleeps = 0;
+static uint32_t radio_standbys = 0;
+static uint32_t session = 0;           // bumped by hostRadioReset(), so callbacks scheduled before it are dropped
+static uint8_t app_eui[8] = {};        // MSB first, as the firmware sets them
+static uint8_t dev_eui[8] = {};
+static uint8_t app_key[LORAWAN_KEY_SIZE] = {};
+static nsSocketClient network_server;  // connected: joins & uplinks go to it, see hostRadioConnect()
+static bool environment_checked = false;
+static int16_t link_rssi = HOST_LINK_RSSI;
+static int8_t link_snr = HOST_LINK_SNR;
+static std::vector<uint8_t> mac_answers; // MAC command answers for the next uplink's FOpts
+static bool ack_pending = false;       // a confirmed downlink to ack in the next uplink
+static uint16_t dev_nonce = 0;
+static uint32_t bad_downlinks = 0;
+static uint32_t missed_downlinks = 0;
+static uint32_t receive_delay1_ms = HOST_RX1_DELAY_MS; // the RX windows, from the join accept or the MIB
+static uint32_t receive_delay2_ms = HOST_RX2_DELAY_MS;
+static Rx2ChannelParams_t rx2_channel = { HOST_RX2_FREQUENCY, HOST_RX2_DATA_RATE };
+
+LoRaMacParams_t LoRaMacParams = {};
+
+static void radioSleep(void) { radio_sleeps++; }
+
+static void radioStandby(void) { radio_standbys++; }
+
+const struct Radio_s Radio = { radioSleep, radioStandby };
+
+/**
+ * @brief The AU915 RX1 data rate for an uplink's: DR8 - DR13 for DR0 - DR5, DR13 for DR6, less the RX1DROffset down to
+ * DR8.
+ */
+static uint8_t rx1DataRate(uint8_t uplink_data_rate) {
+    return (uint8_t)max(min(8 + uplink_data_rate, 13) - LoRaMacParams.Rx1DrOffset, 8);
+}
+
+/**
+ * @brief Emits a TX or RX window power event. length is the PHY payload, 0 for a window that heard nothing.
+ */
+static void powerEvent(HOST_POWER type, uint64_t time_ms, uint8_t rate, size_t length, uint32_t duration_ms) {
+    hostPowerEvent event = {};
+    event.time_ms = time_ms;
+    event.type = type;
+    event.data_rate = rate;
+    event.tx_power = (uint8_t)tx_power;
+    event.length = (uint16_t)length;
+    event.duration_ms = duration_ms;
+    hostPowerEmit(event);
+}
+
+/**
+ * @brief The power events of a class A exchange: the frame on air, then RX1 & RX2, or only RX1 if it heard something.
+ * @param rx_length The answer's PHY payload, 0 for none.
+ * @param rx_delay_ms End of the frame to the window the answer came in.
+ */
+static void powerExchange(size_t tx_length, uint32_t time_on_air_ms, uint32_t rx1_delay_ms, uint32_t rx2_delay_ms,
+                          size_t rx_length, uint32_t rx_delay_ms, uint8_t rx_data_rate) {
+    uint64_t now_ms = hostNowMs();
+    uint64_t end_ms = now_ms + time_on_air_ms;
+    powerEvent(HOST_POWER::RADIO_TX, now_ms, (uint8_t)data_rate, tx_length, time_on_air_ms);
+    if ((rx_length > 0) && (rx_delay_ms < rx2_delay_ms)) {
+        powerEvent(HOST_POWER::RADIO_RX, end_ms + rx1_delay_ms, rx_data_rate, rx_length, 0);
+        return;
+    }
+    powerEvent(HOST_POWER::RADIO_RX, end_ms + rx1_delay_ms, rx1DataRate(data_rate), 0, 0);
+    powerEvent(HOST_POWER::RADIO_RX, end_ms + rx2_delay_ms, (rx_length > 0) ? rx_data_rate : rx2_channel.Datarate,
+               rx_length, 0);
+}
+
+uint32_t hostTimeOnAirMs(uint8_t data_rate, uint8_t length) {
+    // AU915: DR0 - DR5 are SF12 - SF7 at 125 kHz, DR6 is SF8 at 500 kHz
+    uint32_t sf = (data_rate <= 5) ? 12 - data_rate : 8;
+    uint32_t bandwidth_hz = (data_rate <= 5) ? 125000 : 500000;
+    double symbol_ms = (double)(1UL << sf) * 1000.0 / bandwidth_hz;
+    int low_data_rate = (symbol_ms >= 16.0) ? 1 : 0;
+    // 13 bytes of MHDR, FHDR, FPort & MIC; explicit header, CRC on, coding rate 4/5 & an 8 symbol preamble
+    int phy_length = length + 13;
+    double blocks = ceil((8.0 * phy_length - 4.0 * sf + 28 + 16) / (4.0 * (sf - 2 * low_data_rate)));
+    double payload_symbols = 8 + ((blocks > 0) ? blocks : 0) * 5;
+    return (uint32_t)ceil((8 + 4.25 + payload_symbols) * symbol_ms);
+}
+
+void hostRadioReset(void) {
+    session++;
+    callbacks = {};
+    params = {};
+    initialised = false;
+    join_status = LMH_RESET;
+    join_failures = 0;
+    join_requests = 0;
+    busy_until_ms = 0;
+    device_class = CLASS_A;
+    data_rate = DR_0;
+    tx_power = TX_POWER_0;
+    dev_addr = 0;
+    net_id = 0;
+    memset(nwk_s_key, 0, sizeof(nwk_s_key));
+    memset(app_s_key, 0, sizeof(app_s_key));
+    uplink_counter = 0;
+    downlink_counter = 0;
+    uplinks.clear();
+    downlinks.clear();
+    uplink_handler = nullptr;
+    radio_sleeps = 0;
+    radio_standbys = 0;
+    mac_answers.clear();
+    ack_pending = false;
+    bad_downlinks = 0;
+    missed_downlinks = 0;
+    receive_delay1_ms = HOST_RX1_DELAY_MS;
+    receive_delay2_ms = HOST_RX2_DELAY_MS;
+    rx2_channel = { HOST_RX2_FREQUENCY, HOST_RX2_DATA_RATE };
+    LoRaMacParams = {};
+}
+
+bool hostRadioConnect(const char *address) {
+    environment_checked = true;
+    if (address == nullptr) {
+        network_server.close();
+        return true;
+    }
+    return network_server.connect(address);
+}
+
+void hostRadioSetLink(int16_t rssi, int8_t snr) {
+    link_rssi = rssi;
+    link_snr = snr;
+}
+
+void hostRadioSession(struct hostRadioSession *radio_session) {
+    radio_session->dev_addr = dev_addr;
+    radio_session->data_rate = data_rate;
+    radio_session->tx_power = tx_power;
+    radio_session->uplink_counter = uplink_counter;
+    radio_session->downlink_counter = downlink_counter;
+    radio_session->bad_downlinks = bad_downlinks;
+    radio_session->missed_downlinks = missed_downlinks;
+    radio_session->rx1_delay_ms = receive_delay1_ms;
+}
+
+void hostRadioFailJoins(uint32_t failures) { join_failures = failures; }
+
+void hostRadioQueueDownlink(uint8_t port, const std::vector<uint8_t> &data) { downlinks.push_back({ port, data }); }
+
+void hostRadioOnUplink(const std::function<void(const hostUplink &)> &handler) { uplink_handler = handler; }
+
+const std::vector<hostUplink> &hostRadioUplinks(void) { return uplinks; }
+
+uint32_t hostRadioJoinRequests(void) { return join_requests; }
+
+uint32_t hostRadioSleeps(void) { return radio_sleeps; }
+
+// BOARD
+
+uint32_t lora_rak4630_init(void) { return 0; }
+
+uint8_t BoardGetBatteryLevel(void) { return 254; }
+
+void BoardGetUniqueId(uint8_t *id) {
+    static const uint8_t UNIQUE_ID[8] = { 0x00, 0x48, 0x4F, 0x53, 0x54, 0x00, 0x00, 0x01 };
+    memcpy(id, UNIQUE_ID, sizeof(UNIQUE_ID));
+}
+
+uint32_t BoardGetRandomSeed(void) { return 0x5EED1234UL; }
+
+// LMH
+
+void lmh_setAppEui(uint8_t *app_eui_in) { memcpy(app_eui, app_eui_in, sizeof(app_eui)); }
+
+void lmh_setDevEui(uint8_t *dev_eui_in) { memcpy(dev_eui, dev_eui_in, sizeof(dev_eui)); }
+
+void lmh_setAppKey(uint8_t *app_key_in) { memcpy(app_key, app_key_in, sizeof(app_key)); }
+
+// NETWORK SERVER
+
+/**
+ * @brief Sends a frame to the network server and schedules its answer, if any, for the RX window it picked.
+ * @param receive Called in the timer daemon with the answer's PHY payload, or an empty one once the windows have closed
+ * with nothing.
+ */
+static void exchangeFrame(const std::vector<uint8_t> &phy, uint32_t time_on_air_ms, uint32_t first_window_ms,
+                          uint32_t last_window_ms, const std::function<void(const std::vector<uint8_t> &)> &receive) {
+    nsRadioFrame frame = { hostNowMs(), time_on_air_ms, (uint8_t)data_rate, link_rssi, link_snr, phy };
+    nsDownlink answer = {};
+    if (!network_server.exchange(frame, &answer)) {
+        answer.present = false;
+    }
+    if (answer.present && (answer.delay_ms != first_window_ms) && (answer.delay_ms != last_window_ms)) {
+        // sent while the radio wasn't listening
+        missed_downlinks++;
+        answer.present = false;
+    }
+    powerExchange(phy.size(), time_on_air_ms, first_window_ms, last_window_ms, answer.present ? answer.phy.size() : 0,
+                  answer.delay_ms, answer.data_rate);
+    uint32_t receiving = session;
+    std::vector<uint8_t> received = answer.present ? answer.phy : std::vector<uint8_t>();
+    uint32_t delay_ms = answer.present ? answer.delay_ms : last_window_ms + HOST_RX_WINDOW_MS;
+    hostScheduleEvent(time_on_air_ms + delay_ms, [receiving, received, receive] {
+        if (receiving == session) {
+            receive(received);
+        }
+    });
+}
+
+static void expandEui(uint8_t *at, const uint8_t eui[8]) {
+    // LSB first on air
+    for (int i = 0; i < 8; i++) {
+        at[i] = eui[7 - i];
+    }
+}
+
+static void sendJoinRequest(void) {
+    // a fresh DevNonce for every request, the server refuses any it has seen
+    uint32_t mixed = BoardGetRandomSeed() ^ (session * 0x9E3779B1UL) ^ (join_requests * 0x85EBCA77UL);
+    mixed ^= mixed >> 15;
+    dev_nonce = (uint16_t)(mixed * 0x2C1B3C6DUL >> 16);
+    std::vector<uint8_t> request(HOST_JOIN_REQUEST_SIZE);
+    request[0] = (uint8_t)LORAWAN_MTYPE::JOIN_REQUEST;
+    expandEui(&request[1], app_eui);
+    expandEui(&request[9], dev_eui);
+    lorawanPutLe(&request[17], dev_nonce, 2);
+    lorawanPutLe(&request[19], lorawanJoinMic(app_key, request.data(), 19), LORAWAN_MIC_SIZE);
+    exchangeFrame(request, hostTimeOnAirMs(data_rate, HOST_JOIN_REQUEST_SIZE - 13), NS_JOIN_ACCEPT_DELAY1_MS,
+                  NS_JOIN_ACCEPT_DELAY2_MS, [](const std::vector<uint8_t> &accept) {
+                      if (join_status != LMH_ONGOING) {
+                          return;
+                      }
+                      // [MHDR][AppNonce (3)][NetID (3)][DevAddr (4)][DLSettings][RxDelay][MIC], encrypted after MHDR
+                      std::vector<uint8_t> plain = accept;
+                      if ((plain.size() == 17) && (plain[0] == (uint8_t)LORAWAN_MTYPE::JOIN_ACCEPT)) {
+                          lorawanJoinAcceptDecrypt(app_key, &plain[1], 16);
+                      }
+                      if ((plain.size() != 17) || (plain[0] != (uint8_t)LORAWAN_MTYPE::JOIN_ACCEPT) ||
+                          (lorawanJoinMic(app_key, plain.data(), 13) != lorawanGetLe(&plain[13], LORAWAN_MIC_SIZE))) {
+                          join_status = LMH_FAILED;
+                          if (callbacks.lmh_has_joined_failed != nullptr) {
+                              callbacks.lmh_has_joined_failed();
+                          }
+                          return;
+                      }
+                      uint32_t app_nonce = lorawanGetLe(&plain[1], 3);
+                      net_id = lorawanGetLe(&plain[4], 3);
+                      dev_addr = lorawanGetLe(&plain[7], 4);
+                      LoRaMacParams.Rx1DrOffset = (plain[11] >> 4) & 0x07;
+                      rx2_channel.Datarate = plain[11] & 0x0F;
+                      receive_delay1_ms = max(plain[12] & 0x0F, 1) * 1000UL; // RxDelay 0 is 1 s too
+                      receive_delay2_ms = receive_delay1_ms + 1000;
+                      lorawanSessionKeys(app_key, app_nonce, net_id, dev_nonce, nwk_s_key, app_s_key);
+                      join_status = LMH_SET;
+                      uplink_counter = 0;
+                      downlink_counter = 0;
+                      mac_answers.clear();
+                      ack_pending = false;
+                      if (callbacks.lmh_has_joined != nullptr) {
+                          callbacks.lmh_has_joined();
+                      }
+                  });
+}
+
+/**
+ * @brief Answers the MAC commands in a downlink, the answers go in the next uplink.
+ */
+static void handleMacCommands(const uint8_t *commands, size_t length) {
+    for (size_t at = 0; at < length;) {
+        switch ((LORAWAN_MAC)commands[at]) {
+            case LORAWAN_MAC::LINK_ADR: {
+                if (at + 5 > length) {
+                    return;
+                }
+                uint8_t new_data_rate = commands[at + 1] >> 4;
+                uint8_t new_tx_power = commands[at + 1] & 0x0F;
+                // channel mask always taken; data rate & power only with ADR on
+                uint8_t status = 0x01;
+                status |= (params.adr_enable && (new_data_rate <= DR_6)) ? 0x02 : 0x00;
+                status |= (params.adr_enable && (new_tx_power <= TX_POWER_10)) ? 0x04 : 0x00;
+                if (status == 0x07) {
+                    data_rate = new_data_rate;
+                    tx_power = new_tx_power;
+                }
+                mac_answers.push_back((uint8_t)LORAWAN_MAC::LINK_ADR);
+                mac_answers.push_back(status);
+                at += 5;
+                break;
+            }
+            case LORAWAN_MAC::DEV_STATUS: {
+                uint8_t battery = (callbacks.BoardGetBatteryLevel != nullptr) ? callbacks.BoardGetBatteryLevel() : 255;
+                mac_answers.push_back((uint8_t)LORAWAN_MAC::DEV_STATUS);
+                mac_answers.push_back(battery);
+                mac_answers.push_back((uint8_t)(HOST_DOWNLINK_SNR & 0x3F));
+                at += 1;
+                break;
+            }
+            case LORAWAN_MAC::LINK_CHECK:
+                at += 3;
+                break;
+            default:
+                // can't tell how long it is, so nothing after it can be read
+                return;
+        }
+    }
+}
+
+/**
+ * @brief Checks, decrypts & hands on a downlink from the network server.
+ * @return True if it was for this device and acked the uplink.
+ */
+static bool receiveDownlink(const std::vector<uint8_t> &phy) {
+    size_t length = phy.size();
+    if (length == 0) {
+        return false;
+    }
+    uint8_t mtype = phy[0] & 0xE0;
+    if ((length < 12) ||
+        ((mtype != (uint8_t)LORAWAN_MTYPE::UNCONFIRMED_DOWN) && (mtype != (uint8_t)LORAWAN_MTYPE::CONFIRMED_DOWN)) ||
+        (lorawanGetLe(&phy[1], 4) != dev_addr)) {
+        bad_downlinks++;
+        return false;
+    }
+    uint8_t fopts_length = phy[5] & 0x0F;
+    size_t header = 8 + fopts_length;
+    uint32_t fcnt = (downlink_counter & 0xFFFF0000UL) | lorawanGetLe(&phy[6], 2);
+    if (fcnt < downlink_counter) {
+        fcnt += 0x10000;
+    }
+    if ((header + LORAWAN_MIC_SIZE > length) ||
+        (lorawanFrameMic(nwk_s_key, LORAWAN_DIR::DOWNLINK, dev_addr, fcnt, phy.data(), length - LORAWAN_MIC_SIZE) !=
+         lorawanGetLe(&phy[length - LORAWAN_MIC_SIZE], LORAWAN_MIC_SIZE))) {
+        bad_downlinks++;
+        return false;
+    }
+    downlink_counter = fcnt + 1;
+    ack_pending = (mtype == (uint8_t)LORAWAN_MTYPE::CONFIRMED_DOWN);
+    bool acked = (phy[5] & LORAWAN_FCTRL_ACK) != 0;
+    handleMacCommands(&phy[8], fopts_length);
+    if (header >= length - LORAWAN_MIC_SIZE) {
+        return acked;
+    }
+    uint8_t port = phy[header];
+    std::vector<uint8_t> data(phy.begin() + header + 1, phy.end() - LORAWAN_MIC_SIZE);
+    lorawanPayloadCrypt((port == 0) ? nwk_s_key : app_s_key, LORAWAN_DIR::DOWNLINK, dev_addr, fcnt, data.data(),
+                        data.size());
+    if (port == 0) {
+        handleMacCommands(data.data(), data.size());
+        return acked;
+    }
+    lmh_app_data_t rx = { data.data(), (uint8_t)data.size(), port, HOST_DOWNLINK_RSSI, HOST_DOWNLINK_SNR };
+    if (callbacks.lmh_RxData != nullptr) {
+        callbacks.lmh_RxData(&rx);
+    }
+    return acked;
+}
+
+/**
+ * @brief Tells the firmware an uplink's RX windows are over, as the stack's MCPS confirm does.
+ */
+static void uplinkFinished(bool confirmed, bool acked) {
+    if (confirmed && (callbacks.lmh_conf_result != nullptr)) {
+        callbacks.lmh_conf_result(acked);
+    } else if (!confirmed && (callbacks.lmh_unconf_finished != nullptr)) {
+        callbacks.lmh_unconf_finished();
+    }
+}
+
+/**
+ * @brief Sends an uplink to the network server as a LoRaWAN data frame.
+ */
+static void sendDataFrame(const hostUplink &uplink) {
+    std::vector<uint8_t> fopts(mac_answers.begin(),
+                               mac_answers.begin() + min(mac_answers.size(), (size_t)LORAWAN_FOPTS_MAX));
+    mac_answers.clear();
+    std::vector<uint8_t> phy(8);
+    phy[0] = (uint8_t)(uplink.confirmed ? LORAWAN_MTYPE::CONFIRMED_UP : LORAWAN_MTYPE::UNCONFIRMED_UP);
+    lorawanPutLe(&phy[1], dev_addr, 4);
+    phy[5] = (uint8_t)((params.adr_enable ? LORAWAN_FCTRL_ADR : 0) | (ack_pending ? LORAWAN_FCTRL_ACK : 0) |
+                       fopts.size());
+    lorawanPutLe(&phy[6], uplink.fcnt, 2);
+    phy.insert(phy.end(), fopts.begin(), fopts.end());
+    ack_pending = false;
+    std::vector<uint8_t> data = uplink.data;
+    lorawanPayloadCrypt(app_s_key, LORAWAN_DIR::UPLINK, dev_addr, uplink.fcnt, data.data(), data.size());
+    phy.push_back(uplink.port);
+    phy.insert(phy.end(), data.begin(), data.end());
+    uint32_t mic = lorawanFrameMic(nwk_s_key, LORAWAN_DIR::UPLINK, dev_addr, uplink.fcnt, phy.data(), phy.size());
+    phy.resize(phy.size() + LORAWAN_MIC_SIZE);
+    lorawanPutLe(&phy[phy.size() - LORAWAN_MIC_SIZE], mic, LORAWAN_MIC_SIZE);
+    bool confirmed = uplink.confirmed;
+    exchangeFrame(phy, uplink.time_on_air_ms, receive_delay1_ms, receive_delay2_ms,
+                  [confirmed](const std::vector<uint8_t> &answer) {
+                      uplinkFinished(confirmed, receiveDownlink(answer));
+                  });
+}
+
+lmh_error_status lmh_init(lmh_callback_t *callbacks_in, lmh_param_t params_in, bool otaa, DeviceClass_t class_in,
+    LoRaMacRegion_t region) {
+    (void)otaa;
+    if (region != LORAMAC_REGION_AU915) {
+        return LMH_ERROR;
+    }
+    if (!environment_checked) {
+        environment_checked = true;
+        const char *address = getenv("HOST_NETWORK_SERVER");
+        if ((address != nullptr) && !network_server.connect(address)) {
+            fprintf(stderr, "HostRadio: can't connect to the network server at %s\n", address);
+        }
+    }
+    callbacks = *callbacks_in;
+    params = params_in;
+    device_class = class_in;
+    data_rate = params.tx_data_rate;
+    tx_power = params.tx_power;
+    initialised = true;
+    return LMH_SUCCESS;
+}
+
+void lmh_join(void) {
+    if (!initialised || (join_status == LMH_ONGOING)) {
+        return;
+    }
+    join_status = LMH_ONGOING;
+    join_requests++;
+    if (network_server.connected()) {
+        sendJoinRequest();
+        return;
+    }
+    // the request's time on air is in HOST_JOIN_DELAY_MS, the accept comes in RX1; RX2 is a second after it
+    uint32_t request_ms = hostTimeOnAirMs(data_rate, HOST_JOIN_REQUEST_SIZE - 13);
+    uint32_t rx1_delay_ms = (HOST_JOIN_DELAY_MS > request_ms) ? HOST_JOIN_DELAY_MS - request_ms : 0;
+    powerExchange(HOST_JOIN_REQUEST_SIZE, request_ms, rx1_delay_ms, rx1_delay_ms + 1000,
+                  (join_failures > 0) ? 0 : HOST_JOIN_ACCEPT_SIZE, rx1_delay_ms, rx1DataRate(data_rate));
+    uint32_t joining = session;
+    hostScheduleEvent(HOST_JOIN_DELAY_MS, [joining] {
+        if ((joining != session) || (join_status != LMH_ONGOING)) {
+            return;
+        }
+        if (join_failures > 0) {
+            join_failures--;
+            join_status = LMH_FAILED;
+            if (callbacks.lmh_has_joined_failed != nullptr) {
+                callbacks.lmh_has_joined_failed();
+            }
+            return;
+        }
+        join_status = LMH_SET;
+        dev_addr = HOST_DEV_ADDR + join_requests;
+        net_id = HOST_NET_ID;
+        for (uint8_t i = 0; i < sizeof(nwk_s_key); i++) {
+            nwk_s_key[i] = 0xA0 + i;
+            app_s_key[i] = 0xB0 + i;
+        }
+        uplink_counter = 0;
+        downlink_counter = 0;
+        if (callbacks.lmh_has_joined != nullptr) {
+            callbacks.lmh_has_joined();
+        }
+    });
+}
+
+lmh_join_status lmh_join_status_get(void) { return join_status; }
+
+lmh_error_status lmh_class_request(DeviceClass_t class_in) {
+    if (join_status != LMH_SET) {
+        return LMH_ERROR;
+    }
+    device_class = class_in;
+    if (callbacks.lmh_ConfirmClass != nullptr) {
+        callbacks.lmh_ConfirmClass(class_in);
+    }
+    return LMH_SUCCESS;
+}
+
+lmh_error_status lmh_send(lmh_app_data_t *app_data, lmh_confirm confirm) {
+    if (join_status != LMH_SET) {
+        return LMH_ERROR;
+    }
+    uint64_t now_ms = hostNowMs();
+    if (now_ms < busy_until_ms) {
+        return LMH_BUSY;
+    }
+    hostUplink uplink;
+    uplink.time_ms = now_ms;
+    uplink.port = app_data->port;
+    uplink.data.assign(app_data->buffer, app_data->buffer + app_data->buffsize);
+    uplink.data_rate = data_rate;
+    uplink.fcnt = uplink_counter++;
+    uplink.confirmed = (confirm == LMH_CONFIRMED_MSG);
+    uplink.time_on_air_ms = hostTimeOnAirMs(data_rate, app_data->buffsize);
+    uplinks.push_back(uplink);
+    busy_until_ms = now_ms + uplink.time_on_air_ms + receive_delay2_ms + HOST_RX_WINDOW_MS;
+    if (uplink_handler) {
+        uplink_handler(uplink);
+    }
+    if (network_server.connected()) {
+        sendDataFrame(uplink);
+        return LMH_SUCCESS;
+    }
+    // 13 bytes of MHDR, FHDR, FPort & MIC around either payload
+    powerExchange(uplink.data.size() + 13, uplink.time_on_air_ms, receive_delay1_ms, receive_delay2_ms,
+                  downlinks.empty() ? 0 : downlinks.front().data.size() + 13, receive_delay1_ms,
+                  rx1DataRate(data_rate));
+    if (!downlinks.empty()) {
+        uint32_t receiving = session;
+        hostScheduleEvent(uplink.time_on_air_ms + receive_delay1_ms, [receiving] {
+            if ((receiving != session) || downlinks.empty()) {
+                return;
+            }
+            hostDownlink downlink = downlinks.front();
+            downlinks.pop_front();
+            downlink_counter++;
+            lmh_app_data_t rx = { downlink.data.data(), (uint8_t)downlink.data.size(), downlink.port,
+                                  HOST_DOWNLINK_RSSI, HOST_DOWNLINK_SNR };
+            if (callbacks.lmh_RxData != nullptr) {
+                callbacks.lmh_RxData(&rx);
+            }
+        });
+    }
+    if (uplink.confirmed) {
+        // the network always hears it, so it's always acked
+        uint32_t finishing = session;
+        hostScheduleEvent(uplink.time_on_air_ms + receive_delay1_ms, [finishing] {
+            if (finishing == session) {
+                uplinkFinished(true, true);
+            }
+        });
+    }
+    return LMH_SUCCESS;
+}
+
+// LORAMAC MIB
+
+LoRaMacStatus_t LoRaMacMibSetRequestConfirm(MibRequestConfirm_t *mib) {
+    switch (mib->Type) {
+        case MIB_DEVICE_CLASS:
+            device_class = mib->Param.Class;
+            break;
+        case MIB_NETWORK_JOINED:
+            join_status = mib->Param.IsNetworkJoined ? LMH_SET : LMH_RESET;
+            break;
+        case MIB_NET_ID:
+            net_id = mib->Param.NetID;
+            break;
+        case MIB_DEV_ADDR:
+            dev_addr = mib->Param.DevAddr;
+            break;
+        case MIB_NWK_SKEY:
+            memcpy(nwk_s_key, mib->Param.NwkSKey, sizeof(nwk_s_key));
+            break;
+        case MIB_APP_SKEY:
+            memcpy(app_s_key, mib->Param.AppSKey, sizeof(app_s_key));
+            break;
+        case MIB_CHANNELS_DATARATE:
+            if ((mib->Param.ChannelsDatarate < DR_0) || (mib->Param.ChannelsDatarate > DR_6)) {
+                return LORAMAC_STATUS_PARAMETER_INVALID;
+            }
+            data_rate = mib->Param.ChannelsDatarate;
+            break;
+        case MIB_CHANNELS_TX_POWER:
+            if ((mib->Param.ChannelsTxPower < TX_POWER_0) || (mib->Param.ChannelsTxPower > TX_POWER_10)) {
+                return LORAMAC_STATUS_PARAMETER_INVALID;
+            }
+            tx_power = mib->Param.ChannelsTxPower;
+            break;
+        case MIB_UPLINK_COUNTER:
+            uplink_counter = mib->Param.UpLinkCounter;
+            break;
+        case MIB_DOWNLINK_COUNTER:
+            downlink_counter = mib->Param.DownLinkCounter;
+            break;
+        case MIB_RECEIVE_DELAY_1:
+            receive_delay1_ms = mib->Param.ReceiveDelay1;
+            break;
+        case MIB_RECEIVE_DELAY_2:
+            receive_delay2_ms = mib->Param.ReceiveDelay2;
+            break;
+        case MIB_RX2_CHANNEL:
+            rx2_channel = mib->Param.Rx2Channel;
+            break;
+        default:
+            return LORAMAC_STATUS_SERVICE_UNKNOWN;
+    }
+    return LORAMAC_STATUS_OK;
+}
+
+LoRaMacStatus_t LoRaMacMibGetRequestConfirm(MibRequestConfirm_t *mib) {
+    switch (mib->Type) {
+        case MIB_DEVICE_CLASS:
+            mib->Param.Class = device_class;
+            break;
+        case MIB_NETWORK_JOINED:
+            mib->Param.IsNetworkJoined = (join_status == LMH_SET);
+            break;
+        case MIB_NET_ID:
+            mib->Param.NetID = net_id;
+            break;
+        case MIB_DEV_ADDR:
+            mib->Param.DevAddr = dev_addr;
+            break;
+        case MIB_NWK_SKEY:
+            mib->Param.NwkSKey = nwk_s_key;
+            break;
+        case MIB_APP_SKEY:
+            mib->Param.AppSKey = app_s_key;
+            break;
+        case MIB_CHANNELS_DATARATE:
+            mib->Param.ChannelsDatarate = data_rate;
+            break;
+        case MIB_CHANNELS_TX_POWER:
+            mib->Param.ChannelsTxPower = tx_power;
+            break;
+        case MIB_UPLINK_COUNTER:
+            mib->Param.UpLinkCounter = uplink_counter;
+            break;
+        case MIB_DOWNLINK_COUNTER:
+            mib->Param.DownLinkCounter = downlink_counter;
+            break;
+        case MIB_RECEIVE_DELAY_1:
+            mib->Param.ReceiveDelay1 = receive_delay1_ms;
+            break;
+        case MIB_RECEIVE_DELAY_2:
+            mib->Param.ReceiveDelay2 = receive_delay2_ms;
+            break;
+        case MIB_RX2_CHANNEL:
+            mib->Param.Rx2Channel = rx2_channel;
+            break;
+        default:
+            return LORAMAC_STATUS_SERVICE_UNKNOWN;
+    }
+    return LORAMAC_STATUS_OK;
+}
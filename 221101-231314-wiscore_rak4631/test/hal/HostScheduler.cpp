@@ -0,0 +1,689 @@
+/**
+ * @file HostScheduler.cpp
+ * @brief FreeRTOS tasks, semaphores, notifications & software timers on a virtual clock.
+ *
+ * Each task is a thread, but only the one in running executes: the others wait on their own condition variable until
+ * they're given the CPU. Whoever gives up the CPU (a task blocking or being preempted, or the test in hostRunFor())
+ * calls dispatch(), which hands it to the highest priority ready task. When every task is blocked it moves time on to
+ * the next wake, timer or event, or hands the CPU back to the test at the end of the run. Everything is done under
+ * world_mutex, which the running task only holds inside these calls.
+ *
+ * The timer daemon is a task too (TASK_PRIO_HIGH, like configTIMER_TASK_PRIORITY), it runs the software timer
+ * callbacks and the events of hostScheduleEvent() as they come due.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "HostHal.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define NEVER UINT64_MAX
+
+enum class TASK_STATE { READY, BLOCKED, DONE };
+
+struct hostTask {
+    TaskFunction_t function;
+    void *parameter;
+    const char *name;
+    UBaseType_t priority;
+    TASK_STATE state = TASK_STATE::READY;
+    uint64_t ready_order = 0;           // FIFO order among ready tasks of the same priority
+    uint64_t wake_ms = NEVER;           // timeout of the block
+    hostSemaphore *waiting_on = nullptr; // semaphore blocked on
+    bool waiting_notify = false;        // blocked in ulTaskNotifyTake()
+    bool given = false;                 // the semaphore was handed over rather than timing out
+    uint32_t notify_count = 0;
+    std::condition_variable turn;
+    std::thread thread;
+};
+
+struct hostSemaphore {
+    uint32_t count;
+    uint32_t max_count;
+    std::vector<hostTask *> waiters;
+};
+
+struct hostTimer {
+    TimerCallbackFunction_t callback;
+    void *timer_id;
+    uint32_t period_ms;
+    bool repeating;
+    bool active = false;
+    uint64_t expiry_ms = 0;
+};
+
+struct hostEvent {
+    uint64_t due_ms;
+    uint64_t order;
+    std::function<void(void)> event;
+};
+
+/** @brief Thrown out of a blocking call to stop a task, see hostReset(). */
+struct hostTaskExit {};
+
+static std::mutex world_mutex;
+static std::condition_variable driver_turn_cv;
+static bool driver_turn = true;              // the test has the CPU
+static bool stopping = false;                // hostReset() is stopping the tasks
+static bool system_off = false;              // see systemOff()
+static uint64_t now_ms = 0;                  // virtual time since hostReset()
+static uint32_t millis_offset = 0;           // millis() at now_ms 0
+static uint64_t run_until_ms = 0;            // end of the current hostRunFor()
+static const std::function<bool(void)> *run_condition = nullptr;
+static bool condition_met = false;
+static hostTask *running = nullptr;
+static std::vector<hostTask *> tasks;
+static hostTask *daemon_task = nullptr;
+static std::vector<hostTimer *> timers;      // never freed, the SoftwareTimers keep pointers to them
+static std::vector<hostSemaphore *> semaphores; // never freed either, the firmware keeps the handles
+static std::vector<hostEvent> events;
+static uint64_t next_order = 0;
+static struct hostSchedulerStats stats = {};
+static thread_local hostTask *this_task = nullptr;
+
+static void timerDaemon(void *unused);
+
+/**
+ * @brief Makes a blocked task ready. Called with world_mutex held.
+ */
+static void makeReady(hostTask *task) {
+    if (task->waiting_on != nullptr) {
+        std::vector<hostTask *> &waiters = task->waiting_on->waiters;
+        waiters.erase(std::remove(waiters.begin(), waiters.end(), task), waiters.end());
+        task->waiting_on = nullptr;
+    }
+    task->waiting_notify = false;
+    task->wake_ms = NEVER;
+    task->state = TASK_STATE::READY;
+    task->ready_order = next_order++;
+}
+
+/**
+ * @brief True if a timer or event is due at now_ms. Called with world_mutex held.
+ */
+static bool daemonWorkDue(void) {
+    for (hostTimer *timer : timers) {
+        if (timer->active && (timer->expiry_ms <= now_ms)) {
+            return true;
+        }
+    }
+    for (const hostEvent &event : events) {
+        if (event.due_ms <= now_ms) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief The next time something is due: a task's timeout, a timer or an event. Called with world_mutex held.
+ */
+static uint64_t nextDueMs(void) {
+    uint64_t next = NEVER;
+    for (hostTask *task : tasks) {
+        if ((task->state == TASK_STATE::BLOCKED) && (task->wake_ms < next)) {
+            next = task->wake_ms;
+        }
+    }
+    for (hostTimer *timer : timers) {
+        if (timer->active && (timer->expiry_ms < next)) {
+            next = timer->expiry_ms;
+        }
+    }
+    for (const hostEvent &event : events) {
+        if (event.due_ms < next) {
+            next = event.due_ms;
+        }
+    }
+    return next;
+}
+
+/**
+ * @brief Readies the tasks whose timeout has passed, and the daemon if it has work. Called with world_mutex held.
+ */
+static void wakeDueTasks(void) {
+    for (hostTask *task : tasks) {
+        if ((task->state == TASK_STATE::BLOCKED) && (task->wake_ms <= now_ms)) {
+            makeReady(task);
+        }
+    }
+    if ((daemon_task != nullptr) && (daemon_task->state == TASK_STATE::BLOCKED) && daemonWorkDue()) {
+        makeReady(daemon_task);
+    }
+}
+
+/**
+ * @brief Hands the CPU to the highest priority ready task, moving time on while every task is blocked, or back to the
+ * test once the run is over. The running task keeps the CPU over ready tasks of its own priority. Called with
+ * world_mutex held by whoever is giving up the CPU, which then waits for its turn.
+ */
+static void dispatch(void) {
+    for (;;) {
+        hostTask *next = nullptr;
+        if (!system_off) {
+            wakeDueTasks();
+            for (hostTask *task : tasks) {
+                if (task->state != TASK_STATE::READY) {
+                    continue;
+                }
+                if ((next == nullptr) || (task->priority > next->priority) ||
+                    ((task->priority == next->priority) && (next != running) &&
+                     ((task == running) || (task->ready_order < next->ready_order)))) {
+                    next = task;
+                }
+            }
+        }
+        if (next != nullptr) {
+            if (next != running) {
+                stats.context_switches++;
+            }
+            running = next;
+            next->turn.notify_one();
+            return;
+        }
+
+        // every task is blocked
+        if ((run_condition != nullptr) && (*run_condition)()) {
+            condition_met = true;
+        }
+        uint64_t due_ms = system_off ? NEVER : nextDueMs();
+        if (condition_met || (due_ms > run_until_ms) || (due_ms == NEVER)) {
+            // NEVER only when the test waits for something nothing will do
+            if (!condition_met && (run_until_ms != NEVER)) {
+                stats.idle_ms += run_until_ms - now_ms;
+                now_ms = run_until_ms;
+            }
+            running = nullptr;
+            driver_turn = true;
+            driver_turn_cv.notify_one();
+            return;
+        }
+        if (due_ms > now_ms) {
+            stats.idle_ms += due_ms - now_ms;
+            stats.wakeups++;
+            now_ms = due_ms;
+            hostPowerEvent wake = {};
+            wake.time_ms = now_ms;
+            wake.type = HOST_POWER::WAKE;
+            hostPowerEmit(wake);
+        }
+    }
+}
+
+/**
+ * @brief Gives up the CPU and waits to get it back. Called by a task with world_mutex held, after setting its state.
+ */
+static void reschedule(std::unique_lock<std::mutex> &lock, hostTask *self) {
+    dispatch();
+    self->turn.wait(lock, [self] { return (running == self) || stopping; });
+    if (stopping) {
+        throw hostTaskExit();
+    }
+}
+
+/**
+ * @brief Blocks the calling task until it's made ready or timeout_ms has passed (NEVER for no timeout).
+ */
+static void block(std::unique_lock<std::mutex> &lock, hostTask *self, uint64_t timeout_ms) {
+    self->state = TASK_STATE::BLOCKED;
+    self->wake_ms = (timeout_ms == NEVER) ? NEVER : now_ms + timeout_ms;
+    reschedule(lock, self);
+}
+
+/**
+ * @brief Lets a task just made ready run if it's above the caller. From the test nothing runs until hostRunFor().
+ */
+static void preemptFor(std::unique_lock<std::mutex> &lock, hostTask *woken) {
+    hostTask *self = this_task;
+    if ((self != nullptr) && (woken->priority > self->priority)) {
+        reschedule(lock, self);
+    }
+}
+
+static void taskEntry(hostTask *self) {
+    this_task = self;
+    {
+        std::unique_lock<std::mutex> lock(world_mutex);
+        self->turn.wait(lock, [self] { return (running == self) || stopping; });
+        if (stopping) {
+            self->state = TASK_STATE::DONE;
+            return;
+        }
+    }
+    try {
+        self->function(self->parameter);
+    } catch (const hostTaskExit &) {
+        std::lock_guard<std::mutex> lock(world_mutex);
+        self->state = TASK_STATE::DONE;
+        return;
+    }
+    // FreeRTOS tasks mustn't return, but on the host it just ends the task
+    std::lock_guard<std::mutex> lock(world_mutex);
+    self->state = TASK_STATE::DONE;
+    if (!stopping) {
+        dispatch();
+    }
+}
+
+static void stopWorld(void) {
+    std::vector<hostTask *> stopped;
+    {
+        std::lock_guard<std::mutex> lock(world_mutex);
+        stopping = true;
+        for (hostTask *task : tasks) {
+            task->turn.notify_one();
+        }
+        stopped.swap(tasks);
+        for (hostSemaphore *semaphore : semaphores) {
+            semaphore->waiters.clear();
+        }
+        daemon_task = nullptr;
+        running = nullptr;
+    }
+    for (hostTask *task : stopped) {
+        if (task->thread.joinable()) {
+            task->thread.join();
+        }
+        delete task;
+    }
+}
+
+/**
+ * @brief Creates a task, ready to run. Called with world_mutex held.
+ */
+static hostTask *createTask(TaskFunction_t function, const char *name, void *parameter, UBaseType_t priority) {
+    static bool stop_at_exit = false;
+    if (!stop_at_exit) {
+        // the threads have to be joined before the firmware's globals go
+        stop_at_exit = true;
+        atexit(stopWorld);
+    }
+    hostTask *task = new hostTask();
+    task->function = function;
+    task->parameter = parameter;
+    task->name = name;
+    task->priority = priority;
+    task->ready_order = next_order++;
+    tasks.push_back(task);
+    stats.tasks++;
+    task->thread = std::thread(taskEntry, task);
+    return task;
+}
+
+/**
+ * @brief Creates the timer daemon if it isn't there yet. Called with world_mutex held.
+ */
+static void startDaemon(void) {
+    if (daemon_task == nullptr) {
+        daemon_task = createTask(timerDaemon, "Tmr Svc", nullptr, TASK_PRIO_HIGH);
+    }
+}
+
+/**
+ * @brief Runs the timer callbacks & events as they come due, earliest first.
+ */
+static void timerDaemon(void *unused) {
+    (void)unused;
+    hostTask *self = this_task;
+    std::unique_lock<std::mutex> lock(world_mutex);
+    for (;;) {
+        hostTimer *timer = nullptr;
+        for (hostTimer *candidate : timers) {
+            if (candidate->active && (candidate->expiry_ms <= now_ms) &&
+                ((timer == nullptr) || (candidate->expiry_ms < timer->expiry_ms))) {
+                timer = candidate;
+            }
+        }
+        size_t event = events.size();
+        for (size_t i = 0; i < events.size(); i++) {
+            if ((events[i].due_ms <= now_ms) &&
+                ((event == events.size()) || (events[i].due_ms < events[event].due_ms) ||
+                 ((events[i].due_ms == events[event].due_ms) && (events[i].order < events[event].order)))) {
+                event = i;
+            }
+        }
+        if ((event < events.size()) && ((timer == nullptr) || (events[event].due_ms <= timer->expiry_ms))) {
+            std::function<void(void)> run = events[event].event;
+            events.erase(events.begin() + event);
+            stats.timer_callbacks++;
+            lock.unlock();
+            run();
+            lock.lock();
+        } else if (timer != nullptr) {
+            if (timer->repeating) {
+                // from the expiry rather than now, like FreeRTOS
+                timer->expiry_ms += (timer->period_ms > 0) ? timer->period_ms : 1;
+            } else {
+                timer->active = false;
+            }
+            stats.timer_callbacks++;
+            lock.unlock();
+            timer->callback((TimerHandle_t)timer);
+            lock.lock();
+        } else {
+            block(lock, self, NEVER);
+        }
+    }
+}
+
+// DRIVER
+
+/**
+ * @brief Runs the tasks until run_until_ms, or until condition is met. Called by the test.
+ */
+static bool runWorld(uint64_t until_ms, const std::function<bool(void)> *condition) {
+    if (this_task != nullptr) {
+        fprintf(stderr, "hostRunFor() called from task %s\n", this_task->name);
+        abort();
+    }
+    std::unique_lock<std::mutex> lock(world_mutex);
+    run_until_ms = until_ms;
+    run_condition = condition;
+    condition_met = false;
+    driver_turn = false;
+    dispatch();
+    driver_turn_cv.wait(lock, [] { return driver_turn; });
+    run_condition = nullptr;
+    return condition_met;
+}
+
+void hostBoot(void (*setup)(void), void (*loop)(void)) {
+    struct arduinoMain {
+        void (*setup)(void);
+        void (*loop)(void);
+    };
+    static arduinoMain main_functions;
+    main_functions = { setup, loop };
+    std::lock_guard<std::mutex> lock(world_mutex);
+    startDaemon();
+    createTask(
+        [](void *functions) {
+            arduinoMain *main = (arduinoMain *)functions;
+            main->setup();
+            for (;;) {
+                main->loop();
+            }
+        },
+        "loop", &main_functions, TASK_PRIO_LOW);
+}
+
+void hostRunFor(uint32_t ms) { runWorld(now_ms + ms, nullptr); }
+
+bool hostRunUntil(const std::function<bool(void)> &condition, uint32_t max_ms) {
+    if (condition()) {
+        return true;
+    }
+    return runWorld(now_ms + max_ms, &condition);
+}
+
+uint64_t hostNowMs(void) { return now_ms; }
+
+void hostReset(uint32_t start_ms) {
+    stopWorld();
+    std::lock_guard<std::mutex> lock(world_mutex);
+    for (hostTimer *timer : timers) {
+        timer->active = false;
+    }
+    events.clear();
+    stopping = false;
+    system_off = false;
+    driver_turn = true;
+    now_ms = 0;
+    millis_offset = start_ms;
+    stats = {};
+}
+
+void hostSchedulerStats(struct hostSchedulerStats *out) {
+    std::lock_guard<std::mutex> lock(world_mutex);
+    *out = stats;
+}
+
+void hostScheduleEvent(uint32_t delay_ms, const std::function<void(void)> &event) {
+    std::unique_lock<std::mutex> lock(world_mutex);
+    startDaemon();
+    events.push_back({ now_ms + delay_ms, next_order++, event });
+    if ((delay_ms == 0) && (daemon_task->state == TASK_STATE::BLOCKED)) {
+        makeReady(daemon_task);
+        preemptFor(lock, daemon_task);
+    }
+}
+
+bool hostSystemOff(void) { return system_off; }
+
+void systemOff(uint32_t pin, uint8_t wake_logic) {
+    // the host is woken by hostReset(), not a pin
+    (void)pin;
+    (void)wake_logic;
+    std::unique_lock<std::mutex> lock(world_mutex);
+    system_off = true;
+    hostTask *self = this_task;
+    if (self != nullptr) {
+        // never comes back, the tasks are stopped by hostReset()
+        block(lock, self, NEVER);
+    }
+}
+
+// ARDUINO TIME
+
+uint32_t millis(void) { return (uint32_t)(millis_offset + now_ms); }
+
+void delay(uint32_t ms) {
+    if (this_task != nullptr) {
+        vTaskDelay(pdMS_TO_TICKS(ms));
+        return;
+    }
+    bool idle;
+    {
+        std::lock_guard<std::mutex> lock(world_mutex);
+        idle = tasks.empty();
+        if (idle) {
+            now_ms += ms;
+        }
+    }
+    if (!idle) {
+        // the test waiting, the firmware runs meanwhile
+        hostRunFor(ms);
+    }
+}
+
+void yield(void) {
+    hostTask *self = this_task;
+    if (self == nullptr) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock(world_mutex);
+    // behind the other ready tasks of the same priority
+    self->ready_order = next_order++;
+    reschedule(lock, self);
+}
+
+// FREERTOS TASKS
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack_words, void *parameter,
+    UBaseType_t priority, TaskHandle_t *handle) {
+    (void)stack_words;
+    std::unique_lock<std::mutex> lock(world_mutex);
+    hostTask *task = createTask(function, name, parameter, priority);
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    preemptFor(lock, task);
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    hostTask *self = this_task;
+    if (self == nullptr) {
+        delay(ticks);
+        return;
+    }
+    if (ticks == 0) {
+        yield();
+        return;
+    }
+    std::unique_lock<std::mutex> lock(world_mutex);
+    block(lock, self, ticks);
+}
+
+TickType_t xTaskGetTickCount(void) { return millis(); }
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    hostTask *self = this_task;
+    if (self == nullptr) {
+        return 0;
+    }
+    std::unique_lock<std::mutex> lock(world_mutex);
+    if ((self->notify_count == 0) && (ticks > 0)) {
+        self->waiting_notify = true;
+        block(lock, self, (ticks == portMAX_DELAY) ? NEVER : ticks);
+    }
+    uint32_t count = self->notify_count;
+    if (count > 0) {
+        self->notify_count = clear_on_exit ? 0 : count - 1;
+    }
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    std::unique_lock<std::mutex> lock(world_mutex);
+    task->notify_count++;
+    if (task->waiting_notify) {
+        makeReady(task);
+        preemptFor(lock, task);
+    }
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+    if (woken != nullptr) {
+        *woken = pdTRUE;
+    }
+    xTaskNotifyGive(task);
+}
+
+// FREERTOS SEMAPHORES
+
+/**
+ * @brief A semaphore with count taken of max_count. Mutexes are binary semaphores that start given, there's no
+ * priority inheritance.
+ */
+static SemaphoreHandle_t createSemaphore(uint32_t count, uint32_t max_count) {
+    std::lock_guard<std::mutex> lock(world_mutex);
+    hostSemaphore *semaphore = new hostSemaphore{ count, max_count, {} };
+    semaphores.push_back(semaphore);
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) { return createSemaphore(0, 1); }
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) { return createSemaphore(1, 1); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks) {
+    hostTask *self = this_task;
+    std::unique_lock<std::mutex> lock(world_mutex);
+    if (semaphore->count > 0) {
+        semaphore->count--;
+        return pdTRUE;
+    }
+    if (ticks == 0) {
+        return pdFALSE;
+    }
+    if (self == nullptr) {
+        // the test waits for it, running the firmware meanwhile
+        lock.unlock();
+        uint64_t until_ms = (ticks == portMAX_DELAY) ? NEVER : now_ms + ticks;
+        std::function<bool(void)> given = [semaphore] { return semaphore->count > 0; };
+        if (!runWorld(until_ms, &given)) {
+            return pdFALSE;
+        }
+        lock.lock();
+        semaphore->count--;
+        return pdTRUE;
+    }
+    self->waiting_on = semaphore;
+    self->given = false;
+    semaphore->waiters.push_back(self);
+    block(lock, self, (ticks == portMAX_DELAY) ? NEVER : ticks);
+    return self->given ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+    std::unique_lock<std::mutex> lock(world_mutex);
+    if (semaphore->waiters.empty()) {
+        if (semaphore->count >= semaphore->max_count) {
+            return pdFALSE;
+        }
+        semaphore->count++;
+        return pdTRUE;
+    }
+    // straight to the highest priority waiter, the first to wait of those
+    hostTask *waiter = semaphore->waiters.front();
+    for (hostTask *candidate : semaphore->waiters) {
+        if (candidate->priority > waiter->priority) {
+            waiter = candidate;
+        }
+    }
+    waiter->given = true;
+    makeReady(waiter);
+    preemptFor(lock, waiter);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *woken) {
+    if (woken != nullptr) {
+        *woken = pdTRUE;
+    }
+    return xSemaphoreGive(semaphore);
+}
+
+// SOFTWARE TIMERS
+
+void SoftwareTimer::begin(uint32_t ms, TimerCallbackFunction_t callback, void *timer_id, bool repeating) {
+    std::lock_guard<std::mutex> lock(world_mutex);
+    startDaemon();
+    if (handle == nullptr) {
+        handle = new hostTimer();
+        timers.push_back(handle);
+    }
+    handle->callback = callback;
+    handle->timer_id = timer_id;
+    handle->period_ms = ms;
+    handle->repeating = repeating;
+    handle->active = false;
+}
+
+void SoftwareTimer::start(void) {
+    std::lock_guard<std::mutex> lock(world_mutex);
+    if (handle == nullptr) {
+        return;
+    }
+    startDaemon();
+    handle->active = true;
+    handle->expiry_ms = now_ms + handle->period_ms;
+}
+
+void SoftwareTimer::stop(void) {
+    std::lock_guard<std::mutex> lock(world_mutex);
+    if (handle != nullptr) {
+        handle->active = false;
+    }
+}
+
+void SoftwareTimer::reset(void) { start(); }
+
+void SoftwareTimer::setPeriod(uint32_t ms) {
+    {
+        std::lock_guard<std::mutex> lock(world_mutex);
+        if (handle == nullptr) {
+            return;
+        }
+        handle->period_ms = ms;
+    }
+    start();
+}
@@ -0,0 +1,313 @@
+/**
+ * @file HostWire.cpp
+ * @brief The I2C bus, and the SHTC3 & BME680 on both sides of it: the library stand-ins the firmware calls and the
+ * device models the test attaches.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "HostHal.h"
+
+#include <Adafruit_BME680.h>
+#include <SparkFun_SHTC3.h>
+#include <Wire.h>
+
+TwoWire Wire;
+
+static std::map<uint8_t, hostI2cDevice *> i2c_devices;
+
+void hostI2cAttach(uint8_t address, hostI2cDevice *device) { i2c_devices[address] = device; }
+
+void hostI2cDetach(uint8_t address) { i2c_devices.erase(address); }
+
+hostI2cDevice *hostI2cFind(uint8_t address) {
+    auto found = i2c_devices.find(address);
+    return (found != i2c_devices.end()) ? found->second : nullptr;
+}
+
+// TWOWIRE
+
+void TwoWire::begin(void) {}
+
+void TwoWire::end(void) {}
+
+void TwoWire::setClock(uint32_t frequency) { (void)frequency; }
+
+void TwoWire::beginTransmission(uint8_t address) {
+    this->address = address;
+    tx_length = 0;
+}
+
+size_t TwoWire::write(uint8_t data) {
+    if (tx_length >= WIRE_BUFFER_LENGTH) {
+        return 0;
+    }
+    tx[tx_length++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t length) {
+    size_t written = 0;
+    while ((written < length) && (write(data[written]) == 1)) {
+        written++;
+    }
+    return written;
+}
+
+uint8_t TwoWire::endTransmission(bool stop) {
+    (void)stop;
+    hostI2cDevice *device = hostI2cFind(address);
+    if (device == nullptr) {
+        return 2;
+    }
+    return device->write(tx, tx_length) ? 0 : 3;
+}
+
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool stop) {
+    (void)stop;
+    rx_length = 0;
+    rx_pos = 0;
+    hostI2cDevice *device = hostI2cFind(address);
+    if (device == nullptr) {
+        return 0;
+    }
+    rx_length = device->read(rx, min((uint8_t)WIRE_BUFFER_LENGTH, quantity));
+    return rx_length;
+}
+
+int TwoWire::available(void) { return rx_length - rx_pos; }
+
+int TwoWire::read(void) { return (rx_pos < rx_length) ? rx[rx_pos++] : -1; }
+
+int TwoWire::peek(void) { return (rx_pos < rx_length) ? rx[rx_pos] : -1; }
+
+// SHTC3
+
+#define SHTC3_ID       0x0887 /**< Bits 11 & 5:0 identify an SHTC3, the rest vary. */
+#define SHTC3_ID_MASK  0x083F
+#define SHTC3_ID_MATCH 0x0807
+
+uint8_t shtc3CRC(const uint8_t *data, size_t length) {
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (uint8_t b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief Puts a word & its CRC in data.
+ */
+static void shtc3Word(uint16_t word, uint8_t *data) {
+    data[0] = word >> 8;
+    data[1] = word & 0xFF;
+    data[2] = shtc3CRC(data, 2);
+}
+
+/**
+ * @brief Reads a word & checks its CRC.
+ */
+static bool shtc3ReadWord(const uint8_t *data, uint16_t *word) {
+    if (shtc3CRC(data, 2) != data[2]) {
+        return false;
+    }
+    *word = ((uint16_t)data[0] << 8) | data[1];
+    return true;
+}
+
+SHTC3_Status_TypeDef SHTC3::sendCommand(uint16_t command) {
+    wire->beginTransmission(SHTC3_ADDR);
+    wire->write(command >> 8);
+    wire->write(command & 0xFF);
+    return (wire->endTransmission() == 0) ? SHTC3_Status_Nominal : SHTC3_Status_Error;
+}
+
+SHTC3_Status_TypeDef SHTC3::wake(void) {
+    lastStatus = sendCommand(SHTC3_CMD_WAKE);
+    return lastStatus;
+}
+
+SHTC3_Status_TypeDef SHTC3::sleep(bool sleep) {
+    lastStatus = sleep ? sendCommand(SHTC3_CMD_SLEEP) : wake();
+    return lastStatus;
+}
+
+SHTC3_Status_TypeDef SHTC3::begin(TwoWire &wire) {
+    this->wire = &wire;
+    if (wake() != SHTC3_Status_Nominal) {
+        return lastStatus;
+    }
+    uint8_t data[3];
+    uint16_t id = 0;
+    if ((sendCommand(SHTC3_CMD_READ_ID) != SHTC3_Status_Nominal) ||
+        (this->wire->requestFrom(SHTC3_ADDR, sizeof(data)) != sizeof(data))) {
+        lastStatus = SHTC3_Status_Error;
+        return lastStatus;
+    }
+    for (uint8_t &byte : data) {
+        byte = this->wire->read();
+    }
+    if (!shtc3ReadWord(data, &id)) {
+        lastStatus = SHTC3_Status_CRC_Fail;
+    } else if ((id & SHTC3_ID_MASK) != SHTC3_ID_MATCH) {
+        lastStatus = SHTC3_Status_ID_Fail;
+    } else {
+        lastStatus = SHTC3_Status_Nominal;
+    }
+    return lastStatus;
+}
+
+SHTC3_Status_TypeDef SHTC3::update(void) {
+    if (wake() != SHTC3_Status_Nominal) {
+        return lastStatus;
+    }
+    // clock stretching, so the read waits for the measurement on the bus
+    uint8_t data[6];
+    if ((sendCommand(SHTC3_CMD_CSE_RHF_NPM) != SHTC3_Status_Nominal) ||
+        (wire->requestFrom(SHTC3_ADDR, sizeof(data)) != sizeof(data))) {
+        lastStatus = SHTC3_Status_Error;
+        return lastStatus;
+    }
+    for (uint8_t &byte : data) {
+        byte = wire->read();
+    }
+    if (!shtc3ReadWord(&data[0], &RH) || !shtc3ReadWord(&data[3], &T)) {
+        lastStatus = SHTC3_Status_CRC_Fail;
+        return lastStatus;
+    }
+    sleep(true);
+    return lastStatus;
+}
+
+float SHTC3::toDegC(void) { return -45.0f + 175.0f * T / 65536.0f; }
+
+float SHTC3::toPercent(void) { return 100.0f * RH / 65536.0f; }
+
+bool hostShtc3::write(const uint8_t *data, size_t length) {
+    if (length != 2) {
+        return false;
+    }
+    uint16_t received = ((uint16_t)data[0] << 8) | data[1];
+    if (received == SHTC3_CMD_WAKE) {
+        awake = true;
+        return true;
+    }
+    if (!awake) {
+        // asleep, only the wake command is acknowledged
+        return false;
+    }
+    if (received == SHTC3_CMD_SLEEP) {
+        awake = false;
+    } else if (received == SHTC3_CMD_CSE_RHF_NPM) {
+        measurements++;
+    } else if (received != SHTC3_CMD_READ_ID) {
+        return false;
+    }
+    command = received;
+    return true;
+}
+
+size_t hostShtc3::read(uint8_t *data, size_t length) {
+    if (!awake) {
+        return 0;
+    }
+    uint8_t words[6];
+    size_t available = 0;
+    if (command == SHTC3_CMD_READ_ID) {
+        shtc3Word(SHTC3_ID, words);
+        available = 3;
+    } else if (command == SHTC3_CMD_CSE_RHF_NPM) {
+        float rh = constrain(humidity_pct, 0.0f, 100.0f);
+        float t = constrain(temperature_c, -45.0f, 130.0f);
+        shtc3Word((uint16_t)min(65535.0f, roundf(rh * 65536.0f / 100.0f)), &words[0]);
+        shtc3Word((uint16_t)min(65535.0f, roundf((t + 45.0f) * 65536.0f / 175.0f)), &words[3]);
+        available = 6;
+    }
+    command = 0;
+    length = min(length, available);
+    memcpy(data, words, length);
+    return length;
+}
+
+// BME680
+
+bool hostBme680::write(const uint8_t *data, size_t length) {
+    if (length > 0) {
+        // the register pointer, any bytes after it are register writes which aren't modelled
+        reg = data[0];
+    }
+    return true;
+}
+
+size_t hostBme680::read(uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        data[i] = ((reg + i) == BME68X_CHIP_ID_ADDR) ? BME68X_CHIP_ID : 0;
+    }
+    return length;
+}
+
+bool Adafruit_BME680::begin(uint8_t address, bool init_settings) {
+    this->address = address;
+    Wire.beginTransmission(address);
+    Wire.write(BME68X_CHIP_ID_ADDR);
+    if ((Wire.endTransmission() != 0) || (Wire.requestFrom(address, 1) != 1)) {
+        return false;
+    }
+    if (Wire.read() != BME68X_CHIP_ID) {
+        return false;
+    }
+    if (init_settings) {
+        os_temperature = BME68X_OS_8X;
+        os_humidity = BME68X_OS_2X;
+        os_pressure = BME68X_OS_4X;
+        heater_ms = 150;
+    }
+    return true;
+}
+
+bool Adafruit_BME680::setTemperatureOversampling(uint8_t os) {
+    os_temperature = os;
+    return os <= BME68X_OS_16X;
+}
+
+bool Adafruit_BME680::setHumidityOversampling(uint8_t os) {
+    os_humidity = os;
+    return os <= BME68X_OS_16X;
+}
+
+bool Adafruit_BME680::setPressureOversampling(uint8_t os) {
+    os_pressure = os;
+    return os <= BME68X_OS_16X;
+}
+
+bool Adafruit_BME680::setIIRFilterSize(uint8_t filter) { return filter <= BME68X_FILTER_SIZE_7; }
+
+bool Adafruit_BME680::setGasHeater(uint16_t heater_temp, uint16_t heater_time) {
+    heater_ms = (heater_temp == 0) ? 0 : heater_time;
+    return true;
+}
+
+bool Adafruit_BME680::performReading(void) {
+    hostBme680 *device = dynamic_cast<hostBme680 *>(hostI2cFind(address));
+    if (device == nullptr) {
+        return false;
+    }
+    // the BME68x datasheet's measurement duration: 1963 us per oversampled conversion, plus the gas heater
+    static const uint8_t CYCLES[] = { 0, 1, 2, 4, 8, 16 };
+    uint32_t cycles = CYCLES[min(os_temperature, (uint8_t)5)] + CYCLES[min(os_pressure, (uint8_t)5)] +
+                      CYCLES[min(os_humidity, (uint8_t)5)];
+    uint32_t measure_us = cycles * 1963 + 477 * 4 + 477 * 5 + 1000;
+    delay((measure_us + 999) / 1000 + heater_ms);
+    device->measurements++;
+    temperature = (os_temperature != BME68X_OS_NONE) ? device->temperature_c : NAN;
+    humidity = (os_humidity != BME68X_OS_NONE) ? device->humidity_pct : NAN;
+    pressure = (os_pressure != BME68X_OS_NONE) ? device->pressure_pa : 0;
+    gas_resistance = (heater_ms > 0) ? device->gas_ohm : 0;
+    return true;
+}
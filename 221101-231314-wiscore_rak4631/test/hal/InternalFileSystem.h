@@ -0,0 +1,14 @@
+#pragma once
+/**
+ * @file InternalFileSystem.h
+ * @brief Host stand-in for the nRF52's internal flash file system, see Adafruit_LittleFS.h.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Adafruit_LittleFS.h>
+
+extern Adafruit_LittleFS_Namespace::Adafruit_LittleFS InternalFS;
@@ -0,0 +1,188 @@
+#pragma once
+/**
+ * @file LoRaWan-RAK4630.h
+ * @brief Host stand-in for the SX126x-Arduino LoRaWAN helper (lmh_*) and the LoRaMac MIB. There's no radio: the join is
+ * accepted (or rejected) after a delay, uplinks are recorded with their time on air and queued downlinks come back in
+ * RX1, or all of it goes to a network server (test/ns/). The test drives it from HostHal.h. Class A & AU915 only,
+ * there's no duty cycle or confirmed retries, and ADR only with a network server.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+
+typedef struct {
+    uint8_t *buffer;
+    uint8_t buffsize;
+    uint8_t port;
+    int16_t rssi;
+    int8_t snr;
+} lmh_app_data_t;
+
+typedef enum {
+    LMH_UNCONFIRMED_MSG = 0,
+    LMH_CONFIRMED_MSG = 1,
+} lmh_confirm;
+
+typedef enum {
+    LMH_RESET = 0,
+    LMH_SET = 1,
+    LMH_ONGOING = 2,
+    LMH_FAILED = 3,
+} lmh_join_status;
+
+typedef enum {
+    LMH_SUCCESS = 0,
+    LMH_BUSY = -1,
+    LMH_ERROR = -2,
+} lmh_error_status;
+
+typedef enum {
+    CLASS_A,
+    CLASS_B,
+    CLASS_C,
+} DeviceClass_t;
+
+typedef enum {
+    LORAMAC_REGION_AS923,
+    LORAMAC_REGION_AU915,
+    LORAMAC_REGION_CN470,
+    LORAMAC_REGION_CN779,
+    LORAMAC_REGION_EU433,
+    LORAMAC_REGION_EU868,
+    LORAMAC_REGION_KR920,
+    LORAMAC_REGION_IN865,
+    LORAMAC_REGION_US915,
+} LoRaMacRegion_t;
+
+typedef enum {
+    LORAMAC_STATUS_OK,
+    LORAMAC_STATUS_BUSY,
+    LORAMAC_STATUS_SERVICE_UNKNOWN,
+    LORAMAC_STATUS_PARAMETER_INVALID,
+} LoRaMacStatus_t;
+
+typedef enum {
+    MIB_DEVICE_CLASS,
+    MIB_NETWORK_JOINED,
+    MIB_NET_ID,
+    MIB_DEV_ADDR,
+    MIB_NWK_SKEY,
+    MIB_APP_SKEY,
+    MIB_CHANNELS_DATARATE,
+    MIB_CHANNELS_TX_POWER,
+    MIB_UPLINK_COUNTER,
+    MIB_DOWNLINK_COUNTER,
+    MIB_RECEIVE_DELAY_1,
+    MIB_RECEIVE_DELAY_2,
+    MIB_RX2_CHANNEL,
+} Mib_t;
+
+typedef struct {
+    uint32_t Frequency;
+    uint8_t Datarate;
+} Rx2ChannelParams_t;
+
+typedef union {
+    DeviceClass_t Class;
+    bool IsNetworkJoined;
+    uint32_t NetID;
+    uint32_t DevAddr;
+    uint8_t *NwkSKey;
+    uint8_t *AppSKey;
+    int8_t ChannelsDatarate;
+    int8_t ChannelsTxPower;
+    uint32_t UpLinkCounter;
+    uint32_t DownLinkCounter;
+    uint32_t ReceiveDelay1;
+    uint32_t ReceiveDelay2;
+    Rx2ChannelParams_t Rx2Channel;
+} MibParam_t;
+
+typedef struct {
+    Mib_t Type;
+    MibParam_t Param;
+} MibRequestConfirm_t;
+
+LoRaMacStatus_t LoRaMacMibSetRequestConfirm(MibRequestConfirm_t *mib);
+LoRaMacStatus_t LoRaMacMibGetRequestConfirm(MibRequestConfirm_t *mib);
+
+/** @brief The LoRaMac parameters, only those the MIB doesn't reach. The stack has them as a global. */
+typedef struct {
+    uint8_t Rx1DrOffset;
+} LoRaMacParams_t;
+extern LoRaMacParams_t LoRaMacParams;
+
+typedef struct {
+    bool adr_enable;
+    int8_t tx_data_rate;
+    bool enable_public_network;
+    uint8_t nb_trials;
+    int8_t tx_power;
+    bool duty_cycle;
+} lmh_param_t;
+
+typedef struct {
+    uint8_t (*BoardGetBatteryLevel)(void);
+    void (*BoardGetUniqueId)(uint8_t *id);
+    uint32_t (*BoardGetRandomSeed)(void);
+    void (*lmh_RxData)(lmh_app_data_t *app_data);
+    void (*lmh_has_joined)(void);
+    void (*lmh_ConfirmClass)(DeviceClass_t device_class);
+    void (*lmh_has_joined_failed)(void);
+    void (*lmh_unconf_finished)(void);
+    void (*lmh_conf_result)(bool result);
+} lmh_callback_t;
+
+#define LORAWAN_ADR_ON           true
+#define LORAWAN_ADR_OFF          false
+#define LORAWAN_PUBLIC_NETWORK   true
+#define LORAWAN_DUTYCYCLE_ON     true
+#define LORAWAN_DUTYCYCLE_OFF    false
+#define LORAWAN_DEFAULT_DATARATE DR_3
+#define LORAWAN_DEFAULT_TX_POWER TX_POWER_0
+
+#define DR_0 0
+#define DR_1 1
+#define DR_2 2
+#define DR_3 3
+#define DR_4 4
+#define DR_5 5
+#define DR_6 6
+
+#define TX_POWER_0  0
+#define TX_POWER_1  1
+#define TX_POWER_2  2
+#define TX_POWER_3  3
+#define TX_POWER_4  4
+#define TX_POWER_5  5
+#define TX_POWER_6  6
+#define TX_POWER_7  7
+#define TX_POWER_8  8
+#define TX_POWER_9  9
+#define TX_POWER_10 10
+
+uint32_t lora_rak4630_init(void);
+uint8_t BoardGetBatteryLevel(void);
+void BoardGetUniqueId(uint8_t *id);
+uint32_t BoardGetRandomSeed(void);
+
+void lmh_setAppEui(uint8_t *app_eui);
+void lmh_setDevEui(uint8_t *dev_eui);
+void lmh_setAppKey(uint8_t *app_key);
+lmh_error_status lmh_init(lmh_callback_t *callbacks, lmh_param_t params, bool otaa, DeviceClass_t device_class,
+    LoRaMacRegion_t region);
+void lmh_join(void);
+lmh_join_status lmh_join_status_get(void);
+lmh_error_status lmh_send(lmh_app_data_t *app_data, lmh_confirm confirm);
+lmh_error_status lmh_class_request(DeviceClass_t device_class);
+
+/** @brief The radio driver, only what the firmware calls. */
+struct Radio_s {
+    void (*Sleep)(void);
+    void (*Standby)(void);
+};
+extern const struct Radio_s Radio;
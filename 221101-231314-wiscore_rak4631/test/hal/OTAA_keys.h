@@ -0,0 +1,17 @@
+#pragma once
+/**
+ * @file OTAA_keys.h
+ * @brief Made up OTAA keys for the host build, the real ones are kept out of the repo (see the LoRaWAN_functs README).
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+uint8_t OTAA_KEY_APP_EUI[8] = { 0x70, 0xB3, 0xD5, 0x7E, 0xD0, 0x00, 0x00, 0x01 };
+uint8_t OTAA_KEY_DEV_EUI[8] = { 0x00, 0x48, 0x4F, 0x53, 0x54, 0x00, 0x00, 0x01 };
+uint8_t OTAA_KEY_APP_KEY[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+                                 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
@@ -0,0 +1,55 @@
+#pragma once
+/**
+ * @file SparkFun_SHTC3.h
+ * @brief Host stand-in for the SparkFun SHTC3 library. Speaks the SHTC3's I2C protocol through Wire, so it works with a
+ * hostShtc3 (see HostHal.h) attached at SHTC3_ADDR.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define SHTC3_ADDR 0x70
+
+typedef enum {
+    SHTC3_Status_Nominal = 0,
+    SHTC3_Status_Error,
+    SHTC3_Status_CRC_Fail,
+    SHTC3_Status_ID_Fail,
+} SHTC3_Status_TypeDef;
+
+typedef enum {
+    SHTC3_CMD_WAKE = 0x3517,
+    SHTC3_CMD_SLEEP = 0xB098,
+    SHTC3_CMD_READ_ID = 0xEFC8,
+    SHTC3_CMD_CSE_RHF_NPM = 0x5C24, /**< Clock stretching, RH first, normal power mode. */
+} SHTC3_Commands_TypeDef;
+
+/**
+ * @brief CRC-8 of the SHTC3's words: polynomial 0x31, starting at 0xFF.
+ */
+uint8_t shtc3CRC(const uint8_t *data, size_t length);
+
+class SHTC3 {
+  public:
+    /** @brief Wakes the sensor and checks its ID. */
+    SHTC3_Status_TypeDef begin(TwoWire &wire = Wire);
+    /** @brief Wakes the sensor, takes a measurement and puts it back to sleep. */
+    SHTC3_Status_TypeDef update(void);
+    SHTC3_Status_TypeDef sleep(bool sleep = true);
+    SHTC3_Status_TypeDef wake(void);
+    float toDegC(void);
+    float toPercent(void);
+
+    SHTC3_Status_TypeDef lastStatus = SHTC3_Status_Nominal;
+    uint16_t RH = 0; /**< Raw humidity of the last measurement. */
+    uint16_t T = 0;  /**< Raw temperature of the last measurement. */
+
+  private:
+    SHTC3_Status_TypeDef sendCommand(uint16_t command);
+    TwoWire *wire = &Wire;
+};
@@ -0,0 +1,41 @@
+#pragma once
+/**
+ * @file Wire.h
+ * @brief Host stand-in for the Arduino I2C master. Transactions go to the hostI2cDevice attached at the address (see
+ * HostHal.h), an address with nothing on it NACKs.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <Arduino.h>
+
+#define WIRE_BUFFER_LENGTH 64
+
+class TwoWire {
+  public:
+    void begin(void);
+    void end(void);
+    void setClock(uint32_t frequency);
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t length);
+    /** @return 0 if acknowledged, 2 if the address was NACKed, 3 if the data was. */
+    uint8_t endTransmission(bool stop = true);
+    /** @return Bytes read, 0 if NACKed. */
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, bool stop = true);
+    int available(void);
+    int read(void);
+    int peek(void);
+
+  private:
+    uint8_t address = 0;
+    uint8_t tx[WIRE_BUFFER_LENGTH];
+    uint8_t tx_length = 0;
+    uint8_t rx[WIRE_BUFFER_LENGTH];
+    uint8_t rx_length = 0;
+    uint8_t rx_pos = 0;
+};
+extern TwoWire Wire;
@@ -0,0 +1,20 @@
+#pragma once
+/**
+ * @file nrf_soc.h
+ * @brief Host stand-in for the SoftDevice calls the firmware makes. There's no RAM to power down on the host.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#define NRF_SUCCESS 0
+
+inline uint32_t sd_power_ram_power_set(uint8_t index, uint32_t ram_powerset) {
+    (void)index;
+    (void)ram_powerset;
+    return NRF_SUCCESS;
+}
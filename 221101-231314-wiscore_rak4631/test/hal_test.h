@@ -0,0 +1,182 @@
+#include <gtest/gtest.h>
+
+#include "hal/HostHal.h"
+#include "hal/InternalFileSystem.h"
+#include "hal/SparkFun_SHTC3.h"
+#include "hal/Wire.h"
+
+// The host HAL itself: the scheduler, timers, ADC, I2C & flash the firmware test runs on
+
+class HostHalTest : public ::testing::Test {
+  protected:
+    void SetUp(void) override { hostReset(); }
+    void TearDown(void) override { hostReset(); }
+};
+
+static uint32_t hal_ticks = 0;
+static uint64_t hal_last_tick_ms = 0;
+
+TEST_F(HostHalTest, DelayJumpsStraightToTheNextWake) {
+    hal_ticks = 0;
+    xTaskCreate(
+        [](void *) {
+            for (;;) {
+                vTaskDelay(pdMS_TO_TICKS(1000));
+                hal_ticks++;
+                hal_last_tick_ms = hostNowMs();
+            }
+        },
+        "TICK", 256, NULL, TASK_PRIO_NORMAL, NULL);
+    hostRunFor(10500);
+    EXPECT_EQ(hal_ticks, 10u);
+    EXPECT_EQ(hal_last_tick_ms, 10000u);
+    EXPECT_EQ(hostNowMs(), 10500u);
+    EXPECT_EQ(millis(), 10500u);
+    struct hostSchedulerStats stats;
+    hostSchedulerStats(&stats);
+    EXPECT_EQ(stats.idle_ms, 10500u);
+    EXPECT_EQ(stats.wakeups, 10u);
+}
+
+TEST_F(HostHalTest, MillisWrapsFromTheStartTime) {
+    hostReset(UINT32_MAX - 999);
+    uint32_t before = millis();
+    delay(2000);
+    EXPECT_EQ(millis(), 1000u);
+    EXPECT_EQ(millis() - before, 2000u);
+    EXPECT_EQ(hostNowMs(), 2000u);
+}
+
+static SemaphoreHandle_t hal_semaphore = NULL;
+static std::vector<std::string> hal_order;
+
+TEST_F(HostHalTest, GivingPreemptsForAHigherPriorityWaiter) {
+    hal_semaphore = xSemaphoreCreateBinary();
+    hal_order.clear();
+    xTaskCreate(
+        [](void *) {
+            xSemaphoreTake(hal_semaphore, portMAX_DELAY);
+            hal_order.push_back("high took");
+            vTaskDelay(portMAX_DELAY);
+        },
+        "HIGH", 256, NULL, TASK_PRIO_NORMAL, NULL);
+    xTaskCreate(
+        [](void *) {
+            hal_order.push_back("low giving");
+            xSemaphoreGive(hal_semaphore);
+            hal_order.push_back("low gave");
+            vTaskDelay(portMAX_DELAY);
+        },
+        "LOW", 256, NULL, TASK_PRIO_LOW, NULL);
+    hostRunFor(10);
+    std::vector<std::string> expected = { "low giving", "high took", "low gave" };
+    EXPECT_EQ(hal_order, expected);
+}
+
+TEST_F(HostHalTest, TakeTimesOut) {
+    hal_semaphore = xSemaphoreCreateBinary();
+    hal_order.clear();
+    xTaskCreate(
+        [](void *) {
+            hal_order.push_back(xSemaphoreTake(hal_semaphore, pdMS_TO_TICKS(250)) ? "taken" : "timed out");
+            hal_last_tick_ms = hostNowMs();
+            vTaskDelay(portMAX_DELAY);
+        },
+        "TAKE", 256, NULL, TASK_PRIO_NORMAL, NULL);
+    hostRunFor(1000);
+    std::vector<std::string> expected = { "timed out" };
+    EXPECT_EQ(hal_order, expected);
+    EXPECT_EQ(hal_last_tick_ms, 250u);
+    // the test can take it too, running the tasks until it's given
+    hostScheduleEvent(300, [] { xSemaphoreGiveFromISR(hal_semaphore, NULL); });
+    EXPECT_EQ(xSemaphoreTake(hal_semaphore, portMAX_DELAY), pdTRUE);
+    EXPECT_EQ(hostNowMs(), 1300u);
+}
+
+static SoftwareTimer hal_timer;
+static std::vector<uint64_t> hal_fired_ms;
+
+TEST_F(HostHalTest, RepeatingTimerKeepsItsPeriod) {
+    hal_fired_ms.clear();
+    hal_timer.begin(250, [](TimerHandle_t) { hal_fired_ms.push_back(hostNowMs()); });
+    hal_timer.start();
+    hostRunFor(1000);
+    std::vector<uint64_t> expected = { 250, 500, 750, 1000 };
+    EXPECT_EQ(hal_fired_ms, expected);
+    // a new period restarts it from now
+    hal_timer.setPeriod(400);
+    hostRunFor(1000);
+    EXPECT_EQ(hal_fired_ms.back(), 1800u);
+    hal_timer.stop();
+    hostRunFor(1000);
+    EXPECT_EQ(hal_fired_ms.size(), 6u);
+}
+
+TEST_F(HostHalTest, AdcConvertsLikeTheSaadc) {
+    hostResetPins();
+    hostAdcSource(WB_A1, [](uint64_t now_ms) { return (now_ms < 1000) ? 1500.0f : 3500.0f; });
+    analogReference(AR_INTERNAL_3_0);
+    analogReadResolution(12);
+    EXPECT_EQ(analogRead(WB_A1), 2048u);
+    delay(1000);
+    // clipped at full scale
+    EXPECT_EQ(analogRead(WB_A1), 4095u);
+    analogReference(AR_VDD4);
+    analogReadResolution(10);
+    EXPECT_EQ(analogRead(WB_A1), 1023u);
+    EXPECT_EQ(analogRead(WB_A0), 0u);
+    EXPECT_EQ(hostAnalogReads(WB_A1), 3u);
+    hostResetPins();
+}
+
+TEST_F(HostHalTest, Shtc3OverTheBus) {
+    hostShtc3 device;
+    device.temperature_c = 18.5f;
+    device.humidity_pct = 64.0f;
+    hostI2cAttach(SHTC3_ADDR, &device);
+    SHTC3 shtc3;
+    ASSERT_EQ(shtc3.begin(Wire), SHTC3_Status_Nominal);
+    ASSERT_EQ(shtc3.update(), SHTC3_Status_Nominal);
+    EXPECT_NEAR(shtc3.toDegC(), 18.5f, 0.01f);
+    EXPECT_NEAR(shtc3.toPercent(), 64.0f, 0.01f);
+    EXPECT_EQ(device.measurements, 1u);
+    // asleep after the measurement, only the wake command is acknowledged
+    Wire.beginTransmission(SHTC3_ADDR);
+    Wire.write(SHTC3_CMD_CSE_RHF_NPM >> 8);
+    Wire.write(SHTC3_CMD_CSE_RHF_NPM & 0xFF);
+    EXPECT_EQ(Wire.endTransmission(), 3);
+    hostI2cDetach(SHTC3_ADDR);
+    EXPECT_EQ(shtc3.begin(Wire), SHTC3_Status_Error);
+}
+
+TEST_F(HostHalTest, FlashFilesAppendAndReadBack) {
+    using namespace Adafruit_LittleFS_Namespace;
+    hostFlashErase();
+    ASSERT_TRUE(InternalFS.begin());
+    const uint8_t first[] = { 1, 2, 3 };
+    const uint8_t second[] = { 4, 5 };
+    File file(InternalFS);
+    ASSERT_TRUE(file.open("/log", FILE_O_WRITE));
+    EXPECT_EQ(file.write(first, sizeof(first)), sizeof(first));
+    file.close();
+    // opened for writing at the end
+    ASSERT_TRUE(file.open("/log", FILE_O_WRITE));
+    EXPECT_EQ(file.write(second, sizeof(second)), sizeof(second));
+    file.close();
+    uint8_t data[8] = {};
+    ASSERT_TRUE(file.open("/log", FILE_O_READ));
+    EXPECT_EQ(file.size(), 5u);
+    EXPECT_EQ(file.read(data, sizeof(data)), 5);
+    file.close();
+    const uint8_t expected[] = { 1, 2, 3, 4, 5 };
+    EXPECT_EQ(memcmp(data, expected, sizeof(expected)), 0);
+    EXPECT_FALSE(file.open("/missing", FILE_O_READ));
+    EXPECT_FALSE(InternalFS.exists("/missing"));
+    struct hostFlashStats stats;
+    hostFlashStats(&stats);
+    EXPECT_EQ(stats.bytes_written, 5u);
+    hostFlashFailMount(true);
+    EXPECT_FALSE(InternalFS.begin());
+    hostFlashFailMount(false);
+    hostFlashErase();
+}
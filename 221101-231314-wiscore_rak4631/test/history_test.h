@@ -0,0 +1,187 @@
+#include "../lib/History/src/History.h"
+#include "hal/HostHal.h"
+
+#include <memory>
+#include <vector>
+
+// The summary ring on the flash, and backfilling a time range from it one fragment at a time
+
+#define HISTORY_TEST_INTERVAL_S 120 /**< Summary times, as at the normal interval. */
+
+class HistoryTest : public ::testing::Test {
+  protected:
+    void SetUp(void) override {
+        hostFlashErase();
+        history.reset(new History());
+        ASSERT_TRUE(history->init());
+    }
+    void TearDown(void) override { hostFlashErase(); }
+
+    // summary n is at n * HISTORY_TEST_INTERVAL_S, with its mean NTU the low bits of n
+    void append(uint32_t n) {
+        for (uint32_t i = 0; i < n; i++) {
+            historyRecord record = { appended * HISTORY_TEST_INTERVAL_S, (uint16_t)appended, 0, 0, 3900 };
+            history->append(&record);
+            appended++;
+        }
+    }
+
+    bool request(uint8_t id, uint32_t start_s, uint32_t end_s) {
+        uint8_t downlink[HISTORY_REQUEST_SIZE] = { HISTORY_VERSION,         id,
+                                                   (uint8_t)(start_s >> 24), (uint8_t)(start_s >> 16),
+                                                   (uint8_t)(start_s >> 8),  (uint8_t)start_s,
+                                                   (uint8_t)(end_s >> 24),   (uint8_t)(end_s >> 16),
+                                                   (uint8_t)(end_s >> 8),    (uint8_t)end_s };
+        return history->handleRequest(downlink, sizeof(downlink));
+    }
+
+    // the summary times in a fragment
+    static std::vector<uint32_t> fragmentTimes(const uint8_t *fragment, uint8_t length) {
+        std::vector<uint32_t> times;
+        for (uint8_t at = HISTORY_FRAGMENT_HEADER; at + HISTORY_RECORD_SIZE <= length; at += HISTORY_RECORD_SIZE) {
+            times.push_back(((uint32_t)fragment[at] << 24) | ((uint32_t)fragment[at + 1] << 16) |
+                            ((uint32_t)fragment[at + 2] << 8) | fragment[at + 3]);
+        }
+        return times;
+    }
+
+    // sends every fragment of the request, returning the summary times
+    std::vector<uint32_t> backfill(uint8_t id, uint8_t max_length = 51) {
+        std::vector<uint32_t> times;
+        uint8_t expected_fragment = 0;
+        while (history->backfillPending()) {
+            uint8_t length = history->prepareFragment(fragment, max_length);
+            EXPECT_GE(length, HISTORY_FRAGMENT_HEADER);
+            if (length < HISTORY_FRAGMENT_HEADER) {
+                break;
+            }
+            EXPECT_EQ(fragment[0], HISTORY_VERSION);
+            EXPECT_EQ(fragment[1], id);
+            EXPECT_EQ(fragment[2], expected_fragment++);
+            std::vector<uint32_t> more = fragmentTimes(fragment, length);
+            times.insert(times.end(), more.begin(), more.end());
+            history->fragmentSent();
+            EXPECT_EQ(history->backfillPending(), !(fragment[3] & HISTORY_FRAGMENT_LAST));
+        }
+        return times;
+    }
+
+    std::unique_ptr<History> history;
+    uint32_t appended = 0;
+    uint8_t fragment[64] = {};
+};
+
+TEST_F(HistoryTest, FlushesEveryEightSummaries) {
+    append(HISTORY_FLUSH_RECORDS - 1);
+    EXPECT_EQ(history->count(), HISTORY_FLUSH_RECORDS - 1);
+    EXPECT_EQ(hostFlashFiles().count(HISTORY_FILE), 0u);
+    append(1);
+    ASSERT_EQ(hostFlashFiles().count(HISTORY_FILE), 1u);
+    size_t size = hostFlashFiles()[HISTORY_FILE].size();
+    EXPECT_EQ(size % HISTORY_FLUSH_RECORDS, 0u);
+    append(HISTORY_FLUSH_RECORDS);
+    EXPECT_EQ(hostFlashFiles()[HISTORY_FILE].size(), 2 * size);
+
+    // a partial batch only goes on flush()
+    append(3);
+    EXPECT_EQ(hostFlashFiles()[HISTORY_FILE].size(), 2 * size);
+    EXPECT_TRUE(history->flush());
+    EXPECT_EQ(hostFlashFiles()[HISTORY_FILE].size(), 2 * size + 3 * (size / HISTORY_FLUSH_RECORDS));
+}
+
+TEST_F(HistoryTest, RebuildsTheIndexFromTheFlash) {
+    append(2 * HISTORY_FLUSH_RECORDS + 3);
+    // a reset loses what was only buffered
+    history.reset(new History());
+    ASSERT_TRUE(history->init());
+    EXPECT_EQ(history->count(), 2 * HISTORY_FLUSH_RECORDS);
+    ASSERT_TRUE(request(1, 0, UINT32_MAX));
+    std::vector<uint32_t> times = backfill(1);
+    ASSERT_EQ(times.size(), 2u * HISTORY_FLUSH_RECORDS);
+    for (size_t i = 0; i < times.size(); i++) {
+        EXPECT_EQ(times[i], i * HISTORY_TEST_INTERVAL_S);
+    }
+
+    // and appends carry on after the last summary on the flash, over the lost ones
+    appended = 2 * HISTORY_FLUSH_RECORDS;
+    append(HISTORY_FLUSH_RECORDS);
+    EXPECT_EQ(history->count(), 3 * HISTORY_FLUSH_RECORDS);
+}
+
+TEST_F(HistoryTest, WrapsAfterEverySlotIsUsed) {
+    append(HISTORY_SLOTS);
+    size_t size = hostFlashFiles()[HISTORY_FILE].size();
+    append(HISTORY_FLUSH_RECORDS + 4);
+    EXPECT_EQ(history->count(), HISTORY_SLOTS);
+    // the oldest slots were overwritten, not added to
+    EXPECT_EQ(hostFlashFiles()[HISTORY_FILE].size(), size);
+
+    // after a reset the newest lap wins: the oldest kept is the first one the wrap didn't overwrite
+    history.reset(new History());
+    ASSERT_TRUE(history->init());
+    EXPECT_EQ(history->count(), HISTORY_SLOTS);
+    uint32_t oldest = HISTORY_FLUSH_RECORDS;
+    ASSERT_TRUE(request(2, 0, UINT32_MAX));
+    std::vector<uint32_t> times = backfill(2);
+    ASSERT_EQ(times.size(), (size_t)HISTORY_BACKFILL_MAX_RECORDS);
+    EXPECT_EQ(times.front(), oldest * HISTORY_TEST_INTERVAL_S);
+}
+
+TEST_F(HistoryTest, SendsOnlyTheRequestedRange) {
+    append(40);
+    // inclusive at both ends
+    ASSERT_TRUE(request(3, 10 * HISTORY_TEST_INTERVAL_S, 20 * HISTORY_TEST_INTERVAL_S));
+    std::vector<uint32_t> times = backfill(3);
+    ASSERT_EQ(times.size(), 11u);
+    EXPECT_EQ(times.front(), 10u * HISTORY_TEST_INTERVAL_S);
+    EXPECT_EQ(times.back(), 20u * HISTORY_TEST_INTERVAL_S);
+
+    // nothing in range: one empty, last fragment
+    ASSERT_TRUE(request(4, 100 * HISTORY_TEST_INTERVAL_S, 200 * HISTORY_TEST_INTERVAL_S));
+    EXPECT_EQ(history->prepareFragment(fragment, 51), HISTORY_FRAGMENT_HEADER);
+    EXPECT_EQ(fragment[3], HISTORY_FRAGMENT_LAST);
+    history->fragmentSent();
+    EXPECT_FALSE(history->backfillPending());
+
+    // a bad request is ignored
+    uint8_t bad[HISTORY_REQUEST_SIZE] = { HISTORY_VERSION + 1 };
+    EXPECT_FALSE(history->handleRequest(bad, sizeof(bad)));
+    EXPECT_FALSE(history->handleRequest(bad, HISTORY_REQUEST_SIZE - 1));
+    EXPECT_FALSE(history->backfillPending());
+}
+
+TEST_F(HistoryTest, StopsAtTheBackfillLimit) {
+    append(HISTORY_BACKFILL_MAX_RECORDS + 20);
+    ASSERT_TRUE(request(5, 0, UINT32_MAX));
+    // nothing is prepared in a fragment too short for a summary
+    EXPECT_EQ(history->prepareFragment(fragment, HISTORY_FRAGMENT_HEADER + HISTORY_RECORD_SIZE - 1), 0u);
+    std::vector<uint32_t> times = backfill(5, HISTORY_FRAGMENT_HEADER + 3 * HISTORY_RECORD_SIZE);
+    ASSERT_EQ(times.size(), (size_t)HISTORY_BACKFILL_MAX_RECORDS);
+    EXPECT_EQ(times.back(), (HISTORY_BACKFILL_MAX_RECORDS - 1) * HISTORY_TEST_INTERVAL_S);
+}
+
+TEST_F(HistoryTest, NewRequestReplacesOneInProgress) {
+    append(60);
+    ASSERT_TRUE(request(6, 0, UINT32_MAX));
+    ASSERT_GT(history->prepareFragment(fragment, 51), HISTORY_FRAGMENT_HEADER);
+    EXPECT_EQ(fragment[1], 6);
+
+    // arrives while that fragment is on the air: the fragment is finished, then the new request starts over
+    ASSERT_TRUE(request(7, 30 * HISTORY_TEST_INTERVAL_S, 35 * HISTORY_TEST_INTERVAL_S));
+    history->fragmentSent();
+    EXPECT_TRUE(history->backfillPending());
+    std::vector<uint32_t> times = backfill(7);
+    ASSERT_EQ(times.size(), 6u);
+    EXPECT_EQ(times.front(), 30u * HISTORY_TEST_INTERVAL_S);
+
+    // even when the old request's last fragment was the one on the air
+    ASSERT_TRUE(request(8, 0, 0));
+    ASSERT_EQ(history->prepareFragment(fragment, 51), HISTORY_FRAGMENT_HEADER + HISTORY_RECORD_SIZE);
+    EXPECT_EQ(fragment[3], HISTORY_FRAGMENT_LAST);
+    ASSERT_TRUE(request(9, 50 * HISTORY_TEST_INTERVAL_S, UINT32_MAX));
+    history->fragmentSent();
+    EXPECT_TRUE(history->backfillPending());
+    times = backfill(9);
+    ASSERT_EQ(times.size(), 10u);
+    EXPECT_EQ(times.front(), 50u * HISTORY_TEST_INTERVAL_S);
+}
@@ -0,0 +1,89 @@
+/**
+ * @file log_detokenise.cc
+ * @brief Host detokeniser for tokenised logs (see LogToken.h). Builds the token table from the LOG_ calls in the source
+ * files given, then copies a serial capture from stdin to stdout with each '$' line rendered as
+ * "{H:MM:SS.ms} LEVEL: message". Not run by ctest, build the log_detokenise target and run it directly:
+ *
+ *   log_detokenise $(find ../src ../lib -name '*.cpp' -o -name '*.h') < capture.txt
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+
+#include "../lib/Logging/src/LogToken.h"
+
+static std::map<uint32_t, std::string> formats;
+
+static void addFormat(const char *format, void *source_file) {
+    uint32_t token = logToken(format);
+    auto existing = formats.find(token);
+    if ((existing != formats.end()) && (existing->second != format)) {
+        fprintf(stderr, "%s: token %08X is also \"%s\", reword one of them\n", (const char *)source_file, token,
+                existing->second.c_str());
+    }
+    formats[token] = format;
+}
+
+static bool readFile(const char *path, std::string *text) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    char chunk[4096];
+    size_t read;
+    while ((read = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        text->append(chunk, read);
+    }
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s source files... < capture\n", argv[0]);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        std::string text;
+        if (!readFile(argv[i], &text)) {
+            fprintf(stderr, "can't read %s\n", argv[i]);
+            return 1;
+        }
+        findLogFormats(text.c_str(), addFormat, argv[i]);
+    }
+    fprintf(stderr, "%zu log formats\n", formats.size());
+
+    static const char *const LEVELS[] = { " NONE", "ERROR", " WARN", " INFO", "DEBUG" };
+    char line[1024];
+    while (fgets(line, sizeof(line), stdin) != nullptr) {
+        uint8_t record[LOG_RECORD_MAX];
+        uint8_t length = decodeLogLine(line, record);
+        logRecordHeader header;
+        if ((length == 0) || !readLogRecordHeader(record, length, &header)) {
+            fputs(line, stdout);
+            continue;
+        }
+        uint32_t ms = header.time_ms;
+        printf("{%lu:%02lu:%02lu.%03lu} %s: ", (unsigned long)(ms / 3600000), (unsigned long)(ms / 60000 % 60),
+               (unsigned long)(ms / 1000 % 60), (unsigned long)(ms % 1000),
+               (header.level < 5) ? LEVELS[header.level] : "  ???");
+        auto format = formats.find(header.token);
+        if (format == formats.end()) {
+            printf("<unknown token %08X>\n", header.token);
+            continue;
+        }
+        char message[512];
+        renderLogMessage(format->second.c_str(), &record[header.args_at], length - header.args_at, message,
+                         sizeof(message));
+        printf("%s%s\n", message, header.truncated ? " <truncated>" : "");
+    }
+    return 0;
+}
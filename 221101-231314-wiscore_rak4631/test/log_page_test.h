@@ -0,0 +1,144 @@
+#include "../lib/FlashLog/src/LogPage.h"
+#include "../lib/Logging/src/LogToken.h"
+
+#include <vector>
+
+// a record at a level, with a number to tell it apart
+static uint8_t logPageRecord(uint8_t level, uint32_t n, uint8_t *record) {
+    logRecord packed(level, 1000 + n, logToken("n = %lu"));
+    logArg(&packed, (unsigned long)n);
+    memcpy(record, packed.data(), packed.length());
+    return packed.length();
+}
+
+TEST(LogPageTest, KeepsItemsAndChecksThem) {
+    logPage page;
+    startLogPage(&page, 41);
+    EXPECT_TRUE(checkLogPage(&page));
+    EXPECT_TRUE(addLogPageBoot(&page, 7));
+    uint8_t record[LOG_RECORD_MAX];
+    uint32_t added = 0;
+    for (;;) {
+        uint8_t length = logPageRecord(3, added, record);
+        if (!addLogPageRecord(&page, record, length)) {
+            break;
+        }
+        added++;
+    }
+    // full, and still as it was
+    EXPECT_GT(added, 40u);
+    EXPECT_LT(logPageRoom(&page), 8u);
+    EXPECT_TRUE(checkLogPage(&page));
+
+    uint16_t at = 0;
+    logPageItem item;
+    ASSERT_TRUE(nextLogPageItem(&page, &at, &item));
+    EXPECT_TRUE(item.boot_mark);
+    EXPECT_EQ(item.boot, 7);
+    uint32_t read = 0;
+    while (nextLogPageItem(&page, &at, &item)) {
+        ASSERT_FALSE(item.boot_mark);
+        logRecordHeader header;
+        ASSERT_TRUE(readLogRecordHeader(item.record, item.length, &header));
+        EXPECT_EQ(header.time_ms, 1000 + read);
+        read++;
+    }
+    EXPECT_EQ(read, added);
+
+    // a record half written when the power went
+    page.data[page.used] = 9;
+    page.used += 5;
+    EXPECT_FALSE(checkLogPage(&page));
+    page.used -= 5;
+    EXPECT_TRUE(checkLogPage(&page));
+    page.sequence++;
+    EXPECT_FALSE(checkLogPage(&page));
+}
+
+TEST(LogPageTest, PacksFragmentsThatReadOnTheirOwn) {
+    logPage page;
+    startLogPage(&page, 0);
+    uint8_t record[LOG_RECORD_MAX];
+    addLogPageBoot(&page, 3);
+    for (uint32_t n = 0; n < 6; n++) {
+        // every other one is DEBUG
+        uint8_t length = logPageRecord((n % 2 == 0) ? 3 : 4, n, record);
+        addLogPageRecord(&page, record, length);
+    }
+    addLogPageBoot(&page, 4);
+    for (uint32_t n = 6; n < 8; n++) {
+        uint8_t length = logPageRecord(1, n, record);
+        addLogPageRecord(&page, record, length);
+    }
+
+    // INFO & above, 2 records (and a boot mark) to a fragment
+    uint8_t length = logPageRecord(3, 0, record);
+    uint8_t max_length = 4 + LOG_PAGE_BOOT_ITEM + 2 * (1 + length);
+    std::vector<uint32_t> numbers;
+    std::vector<uint16_t> boots;
+    uint16_t at = 0;
+    bool done = false;
+    for (uint8_t fragments = 0; !done && (fragments < 10); fragments++) {
+        uint8_t buffer[64];
+        logFragment fragment(buffer, 4, max_length, 3);
+        done = fragment.pack(&page, &at);
+        EXPECT_LE(fragment.length(), max_length);
+        // read it back like the decoder: each one starts with a boot mark
+        uint8_t pos = 4;
+        EXPECT_EQ(buffer[pos], LOG_PAGE_BOOT_MARK);
+        uint16_t boot = 0;
+        while (pos < fragment.length()) {
+            if (buffer[pos] == LOG_PAGE_BOOT_MARK) {
+                boot = ((uint16_t)buffer[pos + 1] << 8) | buffer[pos + 2];
+                pos += LOG_PAGE_BOOT_ITEM;
+                continue;
+            }
+            logRecordHeader header;
+            ASSERT_TRUE(readLogRecordHeader(&buffer[pos + 1], buffer[pos], &header));
+            EXPECT_LE(header.level, 3);
+            numbers.push_back(header.time_ms - 1000);
+            boots.push_back(boot);
+            pos += 1 + buffer[pos];
+        }
+    }
+    EXPECT_TRUE(done);
+    EXPECT_EQ(numbers, std::vector<uint32_t>({ 0, 2, 4, 6, 7 }));
+    EXPECT_EQ(boots, std::vector<uint16_t>({ 3, 3, 3, 4, 4 }));
+}
+
+TEST(LogPageTest, WriteBudgetRefillsUpToADay) {
+    const uint32_t DAY_MS = 24UL * 60 * 60 * 1000;
+    const uint32_t START_MS = 0xFFFFF000UL;
+    logWriteBudget budget;
+    startLogWriteBudget(&budget, 72000, START_MS);
+    for (int i = 0; i < 24; i++) {
+        EXPECT_TRUE(spendLogWriteBudget(&budget, START_MS, 3000));
+    }
+    EXPECT_FALSE(spendLogWriteBudget(&budget, START_MS, 3000));
+    // an hour later (across the millis() wrap) there's one more write
+    uint32_t hour_later = START_MS + DAY_MS / 24;
+    EXPECT_EQ(logWriteCredit(&budget, hour_later), 3000u);
+    EXPECT_TRUE(spendLogWriteBudget(&budget, hour_later, 3000));
+    EXPECT_FALSE(spendLogWriteBudget(&budget, hour_later, 1));
+    // never more than a day's worth
+    EXPECT_EQ(logWriteCredit(&budget, hour_later + 3 * DAY_MS), 72000u);
+
+    // after a reset the credit is kept, unless it isn't a budget
+    spendLogWriteBudget(&budget, hour_later + 3 * DAY_MS, 70000);
+    EXPECT_TRUE(resumeLogWriteBudget(&budget, 72000, 5));
+    EXPECT_EQ(logWriteCredit(&budget, 5), 2000u);
+    budget.credit_uj = 0xDEADBEEF;
+    EXPECT_FALSE(resumeLogWriteBudget(&budget, 72000, 5));
+    EXPECT_EQ(logWriteCredit(&budget, 5), 72000u);
+}
+
+TEST(LogPageTest, WriteBudgetKeepsTheRefillRemainder) {
+    logWriteBudget budget;
+    startLogWriteBudget(&budget, 72000, 0); // 1 µJ every 1.2 s
+    spendLogWriteBudget(&budget, 0, 72000);
+    // checked every 1.8 s, the 0.6 s left over each time isn't lost
+    for (uint32_t now = 1800; now <= 7200; now += 1800) {
+        logWriteCredit(&budget, now);
+    }
+    EXPECT_EQ(logWriteCredit(&budget, 7200), 6u);
+}
@@ -0,0 +1,56 @@
+#include "../lib/Logging/src/LogToken.h"
+#include <string.h>
+
+static_assert(logTokenValue<logToken("ADC: %.2f mV")>::value == logToken("ADC: %.2f mV"), "token isn't constexpr");
+
+// packs a record the way logTokenised() does, renders it with its format
+template <typename... Args> static std::string logRoundTrip(const char *format, Args... args) {
+    logRecord record(4, 3723004, logToken(format));
+    logArgs(&record, args...);
+    char line[LOG_TOKEN_LINE_MAX];
+    encodeLogLine(record.data(), record.length(), line);
+    EXPECT_EQ(line[0], '$');
+
+    uint8_t decoded[LOG_RECORD_MAX];
+    uint8_t length = decodeLogLine(line, decoded);
+    EXPECT_EQ(length, record.length());
+    logRecordHeader header;
+    EXPECT_TRUE(readLogRecordHeader(decoded, length, &header));
+    EXPECT_EQ(header.level, 4);
+    EXPECT_EQ(header.time_ms, 3723004u);
+    EXPECT_EQ(header.token, logToken(format));
+    char message[200];
+    renderLogMessage(format, &decoded[header.args_at], length - header.args_at, message, sizeof(message));
+    return header.truncated ? std::string(message) + " <truncated>" : std::string(message);
+}
+
+TEST(LogTokenTest, RendersLikePrintf) {
+    EXPECT_EQ(logRoundTrip("Boot to ready: %lu ms (%s).", (unsigned long)812, "resumed"),
+              "Boot to ready: 812 ms (resumed).");
+    EXPECT_EQ(logRoundTrip("LIPO: %.2f mV = %.2f%%", 3712.5f, 87.25), "LIPO: 3712.50 mV = 87.25%");
+    EXPECT_EQ(logRoundTrip("snr:%d rssi:%d count %u", -7, (int16_t)-112, (uint8_t)200), "snr:-7 rssi:-112 count 200");
+    // the device's 32 bit view of a value
+    EXPECT_EQ(logRoundTrip("%08lX %u", (uint32_t)0x260B1234, -1), "260B1234 4294967295");
+    // not a conversion, shown as it is
+    EXPECT_EQ(logRoundTrip("turbidity = %.2f% NTU", 4.5f), "turbidity = 4.50% NTU");
+    // too long for the record
+    char hex[100];
+    memset(hex, 'A', sizeof(hex) - 1);
+    hex[sizeof(hex) - 1] = '\0';
+    std::string long_string = logRoundTrip("bytes: %s", hex);
+    EXPECT_EQ(long_string.find("bytes: AAAA"), 0u);
+    EXPECT_NE(long_string.find("<truncated>"), std::string::npos);
+}
+
+static void collectFormat(const char *format, void *formats) { ((std::string *)formats)->append(format).append("|"); }
+
+TEST(LogTokenTest, FindsFormatsInSource) {
+    const char *source = "#define LOG_ERROR(format, ...) LOG_AT(LOG_LEVEL::ERROR, format, ##__VA_ARGS__)\n"
+                         "    LOG_INFO(\"Welcome\\n\"\n"
+                         "             \"\\t%s \\\"x\\\"\", name);\n"
+                         "    MY_LOG_DEBUG(\"not this\");\n"
+                         "    LOG_DEBUG (\"%d\", sample);\n";
+    std::string formats;
+    findLogFormats(source, collectFormat, &formats);
+    EXPECT_EQ(formats, "Welcome\n\t%s \"x\"|%d|");
+}
@@ -0,0 +1,66 @@
+#include "ns/LoRaWanCrypto.h"
+
+#include <string.h>
+
+static const uint8_t CRYPTO_TEST_KEY[16] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+                                             0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+
+TEST(LoRaWanCryptoTest, AesMatchesFips197) {
+    const uint8_t plain[16] = { 0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96,
+                                0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a };
+    const uint8_t expected[16] = { 0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60,
+                                   0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97 };
+    aes128Key key;
+    aes128Init(&key, CRYPTO_TEST_KEY);
+    uint8_t cipher[16], back[16];
+    aes128Encrypt(&key, plain, cipher);
+    EXPECT_EQ(memcmp(cipher, expected, 16), 0);
+    aes128Decrypt(&key, cipher, back);
+    EXPECT_EQ(memcmp(back, plain, 16), 0);
+}
+
+TEST(LoRaWanCryptoTest, CmacMatchesRfc4493) {
+    const uint8_t message[40] = { 0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93,
+                                  0x17, 0x2a, 0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac,
+                                  0x45, 0xaf, 0x8e, 0x51, 0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11 };
+    const uint8_t empty[16] = { 0xbb, 0x1d, 0x69, 0x29, 0xe9, 0x59, 0x37, 0x28,
+                                0x7f, 0xa3, 0x7d, 0x12, 0x9b, 0x75, 0x67, 0x46 };
+    const uint8_t one_block[16] = { 0x07, 0x0a, 0x16, 0xb4, 0x6b, 0x4d, 0x41, 0x44,
+                                    0xf7, 0x9b, 0xdd, 0x9d, 0xd0, 0x4a, 0x28, 0x7c };
+    const uint8_t partial[16] = { 0xdf, 0xa6, 0x67, 0x47, 0xde, 0x9a, 0xe6, 0x30,
+                                  0x30, 0xca, 0x32, 0x61, 0x14, 0x97, 0xc8, 0x27 };
+    uint8_t mac[16];
+    aesCmac(CRYPTO_TEST_KEY, message, 0, mac);
+    EXPECT_EQ(memcmp(mac, empty, 16), 0);
+    aesCmac(CRYPTO_TEST_KEY, message, 16, mac);
+    EXPECT_EQ(memcmp(mac, one_block, 16), 0);
+    aesCmac(CRYPTO_TEST_KEY, message, 40, mac);
+    EXPECT_EQ(memcmp(mac, partial, 16), 0);
+}
+
+TEST(LoRaWanCryptoTest, PayloadAndJoinAcceptRoundTrip) {
+    uint8_t data[40];
+    for (int i = 0; i < 40; i++) {
+        data[i] = (uint8_t)i;
+    }
+    uint8_t original[40];
+    memcpy(original, data, sizeof(data));
+    lorawanPayloadCrypt(CRYPTO_TEST_KEY, LORAWAN_DIR::UPLINK, 0x260B0001, 70000, data, sizeof(data));
+    EXPECT_NE(memcmp(data, original, sizeof(data)), 0);
+    lorawanPayloadCrypt(CRYPTO_TEST_KEY, LORAWAN_DIR::UPLINK, 0x260B0001, 70000, data, sizeof(data));
+    EXPECT_EQ(memcmp(data, original, sizeof(data)), 0);
+
+    // the network encrypts with AES decrypt so the device only needs AES encrypt
+    lorawanJoinAcceptEncrypt(CRYPTO_TEST_KEY, data, 32);
+    lorawanJoinAcceptDecrypt(CRYPTO_TEST_KEY, data, 32);
+    EXPECT_EQ(memcmp(data, original, 32), 0);
+
+    // the MIC covers the direction & counter
+    uint32_t mic = lorawanFrameMic(CRYPTO_TEST_KEY, LORAWAN_DIR::UPLINK, 0x260B0001, 1, original, 20);
+    EXPECT_NE(mic, lorawanFrameMic(CRYPTO_TEST_KEY, LORAWAN_DIR::DOWNLINK, 0x260B0001, 1, original, 20));
+    EXPECT_NE(mic, lorawanFrameMic(CRYPTO_TEST_KEY, LORAWAN_DIR::UPLINK, 0x260B0001, 2, original, 20));
+
+    uint8_t nwk_s_key[16], app_s_key[16];
+    lorawanSessionKeys(CRYPTO_TEST_KEY, 0x000001, 0x000013, 0x1234, nwk_s_key, app_s_key);
+    EXPECT_NE(memcmp(nwk_s_key, app_s_key, 16), 0);
+}
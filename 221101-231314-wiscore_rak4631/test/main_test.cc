@@ -1,5 +1,30 @@
 #include <gtest/gtest.h>
 #include "measurement_test.h"
+#include "series_compression_test.h"
+#include "payload_writer_test.h"
+#include "airtime_budget_test.h"
+#include "wall_clock_test.h"
+#include "change_detector_test.h"
+#include "spsc_ring_test.h"
+#include "sequencer_test.h"
+#include "deep_sleep_test.h"
+#include "power_rail_test.h"
+#include "log_token_test.h"
+#include "mpsc_ring_test.h"
+#include "log_page_test.h"
+#include "boot_timeline_test.h"
+#include "hal_test.h"
+#include "event_mode_test.h"
+#include "lorawan_crypto_test.h"
+#include "network_server_test.h"
+#include "trace_file_test.h"
+#include "energy_model_test.h"
+#include "outbox_test.h"
+#include "port_rotation_test.h"
+#include "device_config_test.h"
+#include "presence_bitmap_test.h"
+#include "history_test.h"
+#include "flash_log_test.h"
 // #include "hello_test.h"
 int main(int argc, char **argv)
 {
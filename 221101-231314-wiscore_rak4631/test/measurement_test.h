@@ -1,8 +1,51 @@
-// #include <gtest/gtest.h>
-#include "../src/measurement.cc"
+#include <gtest/gtest.h>
 
-TEST(MeasurementTest, BasicAssertion) {
+#include "../lib/SensorHelper/src/AnalogSensor.h"
+#include "hal/HostHal.h"
 
-    EXPECT_EQ(anologue_to_digital(5), 1);
+// Counts to mV through the host SAADC, which converts like the nRF52's
 
-}
\ No newline at end of file
+TEST(MeasurementTest, BatteryVoltageThroughTheDivider) {
+    hostResetPins();
+    hostAdcSet(BATTERY_PIN, 3900.0f / BATTERY_COMPENSATION_FACTOR);
+    BatteryLevel battery;
+    battery.ADCInit();
+    // 12 bit on 0..3.0 V, times the divider
+    float lsb_mv = BATTERY_COMPENSATION_FACTOR * 3000.0f / 4096.0f;
+    EXPECT_NEAR(battery.getSensorMV(), 3900.0f, lsb_mv);
+    EXPECT_NEAR(battery.mvToSoC(3900.0f), 70.0f + 10.0f * (3900.0f - 3873.0f) / (3951.0f - 3873.0f), 0.01f);
+    EXPECT_FLOAT_EQ(battery.mvToSoC(3200.0f), 0.0f);
+    EXPECT_FLOAT_EQ(battery.mvToSoC(4300.0f), 100.0f);
+}
+
+TEST(MeasurementTest, TurbidityVoltageAndNTU) {
+    hostResetPins();
+    hostAdcSet(TURBIDITY_PIN, 1000.0f);
+    TurbidityLevel turbidity;
+    turbidity.ADCInit();
+    // 10 bit on VDD/4 with gain 1/4, 0..3.3 V: the 825 mV reference times the compensation factor
+    float lsb_mv = TURBIDITY_COMPENSATION_FACTOR * 825.0f / 1024.0f;
+    float mv = turbidity.getSensorMV();
+    EXPECT_NEAR(mv, 1000.0f, lsb_mv);
+    float volts = mv / 1000.0f * 3.227f;
+    EXPECT_NEAR(turbidity.mvToNTU(mv), -843.846f * sq(volts - 2.563f) + 3004.742f, 0.1f);
+    // clear water & the limits of the fit
+    EXPECT_FLOAT_EQ(turbidity.mvToNTU(1400.0f), 0.0f);
+    EXPECT_FLOAT_EQ(turbidity.mvToNTU(700.0f), 3000.0f);
+}
+
+TEST(MeasurementTest, SensorsSharingTheADC) {
+    hostResetPins();
+    hostAdcSet(BATTERY_PIN, 3700.0f / BATTERY_COMPENSATION_FACTOR);
+    hostAdcSet(TURBIDITY_PIN, 1200.0f);
+    BatteryLevel battery;
+    battery.ADCInit();
+    TurbidityLevel turbidity;
+    turbidity.ADCInit();
+    // each read sets the reference & resolution back for its own sensor
+    EXPECT_NEAR(battery.getSensorMV(), 3700.0f, 2.0f);
+    EXPECT_NEAR(turbidity.getSensorMV(), 1200.0f, 4.0f);
+    EXPECT_NEAR(battery.getSensorMV(), 3700.0f, 2.0f);
+    EXPECT_EQ(hostAnalogReads(BATTERY_PIN), 3u);
+    EXPECT_EQ(hostAnalogReads(TURBIDITY_PIN), 2u);
+}
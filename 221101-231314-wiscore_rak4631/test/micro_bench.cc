@@ -0,0 +1,428 @@
+/**
+ * @file micro_bench.cc
+ * @brief Google Benchmark microbenchmarks for the code run on every reading: each port's
+ * portSchema::encodeSensorDataToPayload(), the sensorPortSchema::encodeData() overloads (encodeDataWithSchema<T>),
+ * TurbidityLevel::mvToNTU(), BatteryLevel::mvToSoC(), log() (enabled, filtered & tokenised) and formatTimestamp().
+ * See bench/README.md.
+ *
+ * Each one runs on synthetic inputs spread over the sensors' ranges, and on the readings of a recorded trace
+ * (replay/TraceFile.h) if one is given. The times are compared with a checked-in baseline in Google Benchmark's JSON
+ * format, so a change that slows a hot path fails like energy_bench does. The baseline is first scaled by the median
+ * ratio of all the times to it, so it holds on a faster or slower (or busier) machine than the one it was written on.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <benchmark/benchmark.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "AnalogSensor.h"
+#include "LoRaWAN_functs.h"
+#include "Logging.h"
+#include "PortSchema.h"
+#include "TraceFile.h"
+
+#define BENCH_INPUTS          1024 /**< Synthetic inputs of each kind, cycled through by a benchmark. */
+#define BENCH_THRESHOLD_PCT   25.0f /**< Default rise in CPU time that fails the comparison. */
+#define BENCH_NOISE_NS        5.0f /**< Rises smaller than this never fail: a few ns is timer & cache noise. */
+#define BENCH_MV_PER_LSB      (3300.0f / 1024) /**< TurbidityLevel's VDD/4 reference at 10 bits: trace count to mV. */
+#define BENCH_TRACE_MINMAX    10 /**< Trace samples a reading's turbidity min & max are taken over. */
+
+// Not in Logging.h, the firmware only calls it from log()
+void formatTimestamp(unsigned long timestamp, char *buffer, int buffer_len);
+
+/** @brief The inputs one set of benchmarks cycles through. */
+struct benchInputs {
+    std::vector<sensorData> readings;
+    std::vector<float> turbidity_mv;
+    std::vector<float> battery_mv; // left empty if the inputs have no battery readings
+    std::vector<unsigned long> times_ms;
+};
+
+/** @brief The name & CPU time per iteration (ns) of a benchmark run. */
+typedef std::map<std::string, double> benchTimes;
+
+/**
+ * @brief Console output that also keeps each run's CPU time, for the comparison.
+ */
+class collectingReporter : public benchmark::ConsoleReporter {
+  public:
+    void ReportRuns(const std::vector<Run> &reports) override {
+        for (const Run &run : reports) {
+            if (!run.error_occurred) {
+                times[run.benchmark_name()] = run.GetAdjustedCPUTime();
+            }
+        }
+        ConsoleReporter::ReportRuns(reports);
+    }
+
+    benchTimes times;
+};
+
+// Deterministic, so the synthetic inputs are the same every run
+static uint32_t bench_seed = 1;
+static float uniform(float low, float high) {
+    bench_seed = bench_seed * 1664525u + 1013904223u;
+    return low + (high - low) * (bench_seed >> 8) / (float)(1u << 24);
+}
+
+static sensorData typicalReading(void) {
+    sensorData reading = {};
+    reading.battery_mv = { 3700, true };
+    reading.temperature = { 21.5f, true };
+    reading.humidity = { 55.0f, true };
+    reading.pressure = { 101325, true };
+    reading.gas_resist = { 50000, true };
+    reading.location = { -27.4698f, 153.0251f, true };
+    reading.turbidity = { 0, 0, 0, true };
+    return reading;
+}
+
+/**
+ * @brief Inputs spread over each sensor's range, including the ends of the conversions' curves.
+ */
+static benchInputs syntheticInputs(void) {
+    benchInputs inputs;
+    for (int i = 0; i < BENCH_INPUTS; i++) {
+        sensorData reading;
+        reading.battery_mv = { uniform(3000, 4200), true };
+        reading.temperature = { uniform(-10, 45), true };
+        reading.humidity = { uniform(0, 100), true };
+        reading.pressure = { (uint32_t)uniform(90000, 105000), true };
+        reading.gas_resist = { (uint32_t)uniform(1000, 500000), true };
+        reading.location = { uniform(-45, -10), uniform(110, 155), true };
+        uint32_t ntu = (uint32_t)uniform(0, 3000);
+        reading.turbidity = { ntu, ntu - ntu / 10, ntu + ntu / 10, true };
+        inputs.readings.push_back(reading);
+        inputs.turbidity_mv.push_back(uniform(0, 3300));
+        inputs.battery_mv.push_back(uniform(2900, 4300));
+        inputs.times_ms.push_back((unsigned long)uniform(0, 49 * 24 * 3600e3f));
+    }
+    return inputs;
+}
+
+/**
+ * @brief Inputs from a turbidity trace: its samples as mV, the NTU they convert to as readings, and its sample times.
+ * The other sensors are held at typical values, a trace has no battery channel.
+ */
+static benchInputs traceInputs(const turbidityTrace &trace, uint32_t period_ms) {
+    benchInputs inputs;
+    TurbidityLevel turbidity;
+    sensorData reading = typicalReading();
+    std::vector<uint32_t> recent;
+    for (uint64_t time_ms = 0; time_ms <= trace.durationMs(); time_ms += period_ms) {
+        float mv = trace.valueAt(time_ms) * BENCH_MV_PER_LSB;
+        uint32_t ntu = (uint32_t)turbidity.mvToNTU(mv);
+        recent.push_back(ntu);
+        if (recent.size() > BENCH_TRACE_MINMAX) {
+            recent.erase(recent.begin());
+        }
+        reading.turbidity.value = ntu;
+        reading.turbidity.min = *std::min_element(recent.begin(), recent.end());
+        reading.turbidity.max = *std::max_element(recent.begin(), recent.end());
+        inputs.readings.push_back(reading);
+        inputs.turbidity_mv.push_back(mv);
+        inputs.times_ms.push_back((unsigned long)time_ms);
+    }
+    return inputs;
+}
+
+template <typename T> static const T &nextInput(const std::vector<T> &inputs, size_t *i) {
+    const T &input = inputs[*i];
+    *i = (*i + 1 < inputs.size()) ? *i + 1 : 0;
+    return input;
+}
+
+static void benchEncodePort(benchmark::State &state, portSchema port, const benchInputs *inputs) {
+    uint8_t payload[PAYLOAD_BUFFER_SIZE];
+    size_t i = 0;
+    for (auto _ : state) {
+        sensorData reading = nextInput(inputs->readings, &i);
+        benchmark::DoNotOptimize(port.encodeSensorDataToPayload(&reading, payload));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(state.iterations() * port.payloadLength());
+}
+
+/**
+ * @brief encodeData() with the overload for T, through the schema that takes T's kind of value.
+ */
+template <typename T>
+static void benchEncodeData(benchmark::State &state, const sensorPortSchema *schema, T (*pick)(const sensorData &),
+                            const benchInputs *inputs) {
+    uint8_t payload[PAYLOAD_BUFFER_SIZE];
+    size_t i = 0;
+    for (auto _ : state) {
+        PayloadWriter writer(payload, sizeof(payload));
+        benchmark::DoNotOptimize(schema->encodeData(pick(nextInput(inputs->readings, &i)), true, &writer));
+        benchmark::ClobberMemory();
+    }
+}
+
+static void benchMvToNTU(benchmark::State &state, const benchInputs *inputs) {
+    TurbidityLevel turbidity;
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(turbidity.mvToNTU(nextInput(inputs->turbidity_mv, &i)));
+    }
+}
+
+static void benchMvToSoC(benchmark::State &state, const benchInputs *inputs) {
+    BatteryLevel battery;
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(battery.mvToSoC(nextInput(inputs->battery_mv, &i)));
+    }
+}
+
+/**
+ * @brief log() with a message about a reading; LOG_LEVEL::NONE is the filtered early return. Serial is left
+ * disconnected (hostSerialConnect()), so the line is formatted & dropped as it is on a device with nothing attached.
+ */
+static void benchLog(benchmark::State &state, LOG_LEVEL level, const benchInputs *inputs) {
+    size_t i = 0;
+    for (auto _ : state) {
+        const sensorData &reading = nextInput(inputs->readings, &i);
+        log(level, "Turbidity: %lu NTU (%lu..%lu), battery: %.0f mV", (unsigned long)reading.turbidity.value,
+            (unsigned long)reading.turbidity.min, (unsigned long)reading.turbidity.max, reading.battery_mv.value);
+        benchmark::ClobberMemory();
+    }
+}
+
+/**
+ * @brief Packing the same message as a tokenised record, the LOG_ macros' path up to the ring.
+ */
+static void benchLogTokenised(benchmark::State &state, const benchInputs *inputs) {
+    size_t i = 0;
+    for (auto _ : state) {
+        const sensorData &reading = nextInput(inputs->readings, &i);
+        logRecord record((uint8_t)LOG_LEVEL::INFO, millis(),
+                         logTokenValue<logToken("Turbidity: %lu NTU (%lu..%lu), battery: %.0f mV")>::value);
+        logArgs(&record, (unsigned long)reading.turbidity.value, (unsigned long)reading.turbidity.min,
+                (unsigned long)reading.turbidity.max, reading.battery_mv.value);
+        benchmark::DoNotOptimize(record.length());
+        benchmark::ClobberMemory();
+    }
+}
+
+static void benchFormatTimestamp(benchmark::State &state, const benchInputs *inputs) {
+    char timestamp[40];
+    size_t i = 0;
+    for (auto _ : state) {
+        formatTimestamp(nextInput(inputs->times_ms, &i), timestamp, sizeof(timestamp));
+        benchmark::DoNotOptimize(timestamp);
+        benchmark::ClobberMemory();
+    }
+}
+
+static int pickInt(const sensorData &reading) { return (int)reading.temperature.value; }
+static float pickFloat(const sensorData &reading) { return reading.temperature.value; }
+static uint8_t pickUint8(const sensorData &reading) { return (uint8_t)reading.humidity.value; }
+static uint16_t pickUint16(const sensorData &reading) { return (uint16_t)reading.battery_mv.value; }
+static uint32_t pickUint32(const sensorData &reading) { return reading.pressure.value; }
+
+/**
+ * @brief Registers every benchmark on one set of inputs, named NAME/SET.
+ */
+static void registerBenchmarks(const char *set, const benchInputs *inputs) {
+    static const uint8_t port_numbers[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 50, 51, 52, 53, 54, 55, 56, 57, 58, 59 };
+    std::string suffix = std::string("/") + set;
+    for (uint8_t port_number : port_numbers) {
+        portSchema port;
+        if (findPortSchema(port_number, &port)) {
+            std::string name = "encodeSensorDataToPayload/PORT" + std::to_string(port_number) + suffix;
+            benchmark::RegisterBenchmark(name.c_str(), benchEncodePort, port, inputs);
+        }
+    }
+    benchmark::RegisterBenchmark(("encodeData/int" + suffix).c_str(), benchEncodeData<int>, &temperatureSchema, pickInt,
+                                 inputs);
+    benchmark::RegisterBenchmark(("encodeData/float" + suffix).c_str(), benchEncodeData<float>, &temperatureSchema,
+                                 pickFloat, inputs);
+    benchmark::RegisterBenchmark(("encodeData/uint8_t" + suffix).c_str(), benchEncodeData<uint8_t>,
+                                 &relativeHumiditySchema, pickUint8, inputs);
+    benchmark::RegisterBenchmark(("encodeData/uint16_t" + suffix).c_str(), benchEncodeData<uint16_t>,
+                                 &batteryVoltageSchema, pickUint16, inputs);
+    benchmark::RegisterBenchmark(("encodeData/uint32_t" + suffix).c_str(), benchEncodeData<uint32_t>,
+                                 &airPressureSchema, pickUint32, inputs);
+    benchmark::RegisterBenchmark(("mvToNTU" + suffix).c_str(), benchMvToNTU, inputs);
+    if (!inputs->battery_mv.empty()) {
+        benchmark::RegisterBenchmark(("mvToSoC" + suffix).c_str(), benchMvToSoC, inputs);
+    }
+    benchmark::RegisterBenchmark(("log/enabled" + suffix).c_str(), benchLog, LOG_LEVEL::INFO, inputs);
+    benchmark::RegisterBenchmark(("log/filtered" + suffix).c_str(), benchLog, LOG_LEVEL::NONE, inputs);
+    benchmark::RegisterBenchmark(("log/tokenised" + suffix).c_str(), benchLogTokenised, inputs);
+    benchmark::RegisterBenchmark(("formatTimestamp" + suffix).c_str(), benchFormatTimestamp, inputs);
+}
+
+/**
+ * @brief Reads the name & cpu_time of each benchmark in Google Benchmark's JSON output, one field a line as it writes
+ * them. Every benchmark here reports in ns.
+ */
+static bool loadBaseline(const char *path, benchTimes *baseline) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    std::string name;
+    while (std::getline(in, line)) {
+        size_t colon = line.find("\":");
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(line.find('"') + 1, colon - line.find('"') - 1);
+        std::string value = line.substr(colon + 2);
+        if (key == "name") {
+            size_t start = value.find('"') + 1;
+            name = value.substr(start, value.rfind('"') - start);
+        } else if ((key == "cpu_time") && !name.empty()) {
+            (*baseline)[name] = atof(value.c_str());
+            name.clear();
+        }
+    }
+    return !baseline->empty();
+}
+
+static void usage(void) {
+    printf("micro_bench [options] [--benchmark_... options]\n"
+           "  --trace TRACE         also run on a recorded trace's readings, see test/replay/TraceFile.h\n"
+           "  --period-ms MS        trace sampling period for the readings (30000)\n"
+           "  --baseline JSON       Google Benchmark JSON output to compare the CPU times with\n"
+           "  --threshold-pct P     rise in CPU time that fails the comparison, if over %.0f ns too (%.0f)\n"
+           "  --update-baseline     write the results to --baseline instead of comparing\n"
+           "  --benchmark_filter, --benchmark_min_time, ... as any Google Benchmark:\n\n",
+           BENCH_NOISE_NS, BENCH_THRESHOLD_PCT);
+}
+
+int main(int argc, char **argv) {
+    const char *trace_path = nullptr;
+    const char *baseline_path = nullptr;
+    uint32_t period_ms = 30000;
+    float threshold_pct = BENCH_THRESHOLD_PCT;
+    bool update = false;
+    // ours are taken out, the rest go to Google Benchmark
+    std::vector<std::string> passed = { argv[0] };
+    for (int a = 1; a < argc; a++) {
+        std::string option = argv[a];
+        if ((option == "--help") || (option == "-h")) {
+            // then Google Benchmark's own
+            usage();
+        }
+        if (option == "--update-baseline") {
+            update = true;
+            continue;
+        }
+        bool ours = (option == "--trace") || (option == "--period-ms") || (option == "--baseline") ||
+                    (option == "--threshold-pct");
+        if (!ours) {
+            passed.push_back(option);
+            continue;
+        }
+        if (a + 1 >= argc) {
+            fprintf(stderr, "%s needs a value\n", argv[a]);
+            return 1;
+        }
+        const char *value = argv[++a];
+        if (option == "--trace") {
+            trace_path = value;
+        } else if (option == "--period-ms") {
+            period_ms = atoi(value);
+        } else if (option == "--baseline") {
+            baseline_path = value;
+        } else {
+            threshold_pct = atof(value);
+        }
+    }
+    if ((update && (baseline_path == nullptr)) || (period_ms == 0)) {
+        usage();
+        return 1;
+    }
+    if (update) {
+        passed.push_back(std::string("--benchmark_out=") + baseline_path);
+        passed.push_back("--benchmark_out_format=json");
+    }
+    std::vector<char *> args;
+    for (std::string &arg : passed) {
+        args.push_back(&arg[0]);
+    }
+    int count = args.size();
+    benchmark::Initialize(&count, args.data());
+    if (benchmark::ReportUnrecognizedArguments(count, args.data())) {
+        usage();
+        return 1;
+    }
+
+    benchInputs synthetic = syntheticInputs();
+    registerBenchmarks("synthetic", &synthetic);
+    benchInputs recorded;
+    if (trace_path != nullptr) {
+        turbidityTrace trace;
+        std::string error;
+        if (!trace.load(trace_path, &error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        recorded = traceInputs(trace, period_ms);
+        registerBenchmarks("trace", &recorded);
+    }
+
+    collectingReporter reporter;
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+    if (update) {
+        printf("baseline written to %s\n", baseline_path);
+        return 0;
+    }
+    if (baseline_path == nullptr) {
+        return 0;
+    }
+
+    benchTimes baseline;
+    if (!loadBaseline(baseline_path, &baseline)) {
+        fprintf(stderr, "can't read a baseline from %s\n", baseline_path);
+        return 1;
+    }
+    // this machine's speed against the baseline's: the median ratio, so one path slowing down stands out
+    std::vector<double> ratios;
+    for (const auto &result : reporter.times) {
+        auto found = baseline.find(result.first);
+        if ((found != baseline.end()) && (found->second > 0)) {
+            ratios.push_back(result.second / found->second);
+        }
+    }
+    double speed = 1;
+    if (!ratios.empty()) {
+        std::nth_element(ratios.begin(), ratios.begin() + ratios.size() / 2, ratios.end());
+        speed = ratios[ratios.size() / 2];
+    }
+    printf("\nCPU time against %s, scaled by this machine's %.2fx\n", baseline_path, speed);
+    printf("%-48s %10s %10s %8s\n", "benchmark", "ns", "base", "change");
+    bool failed = false;
+    for (const auto &result : reporter.times) {
+        auto found = baseline.find(result.first);
+        if (found == baseline.end()) {
+            printf("%-48s %10.1f %10s  no baseline\n", result.first.c_str(), result.second, "-");
+            failed = true;
+            continue;
+        }
+        double base = found->second * speed;
+        double change_pct = (base > 0) ? (result.second / base - 1) * 100 : INFINITY;
+        bool regressed = (change_pct > threshold_pct) && (result.second - base > BENCH_NOISE_NS);
+        printf("%-48s %10.1f %10.1f %+7.1f%%%s\n", result.first.c_str(), result.second, base, change_pct,
+               regressed ? "  REGRESSION" : ((change_pct < -threshold_pct) ? "  better, update the baseline" : ""));
+        failed |= regressed;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+#include "../lib/SpscRing/src/MpscRing.h"
+
+#include <thread>
+
+TEST(MpscRingTest, FifoAndOverruns) {
+    mpscRing<uint32_t, 4> ring;
+    uint32_t value = 0;
+    EXPECT_EQ(ring.capacity(), 4);
+    EXPECT_FALSE(ring.pop(&value));
+    for (uint32_t i = 1; i <= 4; i++) {
+        EXPECT_TRUE(ring.push(i));
+    }
+    EXPECT_FALSE(ring.push(5));
+    EXPECT_EQ(ring.depth(), 4);
+    EXPECT_TRUE(ring.pop(&value));
+    EXPECT_EQ(value, 1u);
+    EXPECT_TRUE(ring.push(6));
+    for (uint32_t expected : { 2u, 3u, 4u, 6u }) {
+        EXPECT_TRUE(ring.pop(&value));
+        EXPECT_EQ(value, expected);
+    }
+    EXPECT_FALSE(ring.pop(&value));
+
+    spscRingStats stats;
+    ring.stats(&stats);
+    EXPECT_EQ(stats.depth, 0);
+    EXPECT_EQ(stats.high_water, 4);
+    EXPECT_EQ(stats.pushed, 5u);
+    EXPECT_EQ(stats.overruns, 1u);
+}
+
+TEST(MpscRingTest, ProducersKeepTheirOwnOrder) {
+    struct record {
+        uint8_t producer;
+        uint32_t sequence;
+        uint32_t check;
+    };
+    static mpscRing<record, 8> ring;
+    const uint32_t count = 20000;
+    std::thread producers[3];
+    for (uint8_t p = 0; p < 3; p++) {
+        producers[p] = std::thread([p, count]() {
+            for (uint32_t i = 0; i < count;) {
+                if (ring.push({ p, i, ~i ^ p })) {
+                    i++;
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    uint32_t expected[3] = {};
+    bool in_order = true;
+    for (uint32_t received = 0; received < 3 * count;) {
+        record r;
+        if (ring.pop(&r)) {
+            in_order &= (r.producer < 3) && (r.sequence == expected[r.producer % 3]) &&
+                        (r.check == (~r.sequence ^ r.producer));
+            expected[r.producer % 3]++;
+            received++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    for (std::thread &producer : producers) {
+        producer.join();
+    }
+    EXPECT_TRUE(in_order);
+    EXPECT_EQ(ring.depth(), 0);
+}
@@ -0,0 +1,96 @@
+/**
+ * @file network_server.cc
+ * @brief The network server stand-in (test/ns/) on its own, for running the host firmware against it by hand. Not run
+ * by ctest, build the network_server target and run it directly (network_server --help), then start a host build with
+ * HOST_NETWORK_SERVER set to the address it prints.
+ *
+ * It knows the device in the OTAA_keys.h the firmware builds with, answers time requests like the application server would, and prints
+ * each uplink as it's decoded.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+#include "NetworkServer.h"
+#include "NsSocket.h"
+#include "OTAA_keys.h"
+#include "WallClock.h"
+
+static networkServer server;
+
+static void printUsage(void) {
+    printf("network_server [--port N] [--backhaul-ms N] [--unix-start S]\n"
+           "  --port N         TCP port on 127.0.0.1, 0 picks a free one (default 0)\n"
+           "  --backhaul-ms N  gateway <-> server round trip (default 0)\n"
+           "  --unix-start S   unix time at virtual time 0, for time answers (default 1667260800)\n");
+}
+
+int main(int argc, char **argv) {
+    uint16_t port = 0;
+    uint32_t backhaul_ms = 0;
+    static uint64_t unix_start_s = 1667260800ULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--port") && (i + 1 < argc)) {
+            port = (uint16_t)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--backhaul-ms") && (i + 1 < argc)) {
+            backhaul_ms = (uint32_t)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--unix-start") && (i + 1 < argc)) {
+            unix_start_s = strtoull(argv[++i], NULL, 10);
+        } else {
+            printUsage();
+            return strcmp(argv[i], "--help") ? 1 : 0;
+        }
+    }
+
+    server.addDevice(OTAA_KEY_DEV_EUI, OTAA_KEY_APP_EUI, OTAA_KEY_APP_KEY);
+    server.setBackhaulMs(backhaul_ms);
+    server.onUplink([](const nsUplink &uplink) {
+        printf("%10llu ms  fcnt %5u  port %3u  DR%u  SNR %3d  %2zu bytes ", (unsigned long long)uplink.rx_ms,
+               uplink.fcnt, uplink.port, uplink.data_rate, uplink.snr, uplink.data.size());
+        for (uint8_t byte : uplink.data) {
+            printf("%02X", byte);
+        }
+        printf("\n");
+        fflush(stdout);
+        // time requests, see the WallClock README
+        if ((uplink.port == CLOCK_SYNC_PORT) && (uplink.data.size() >= 2)) {
+            uint64_t unix_ms = unix_start_s * 1000ULL + uplink.rx_ms;
+            uint32_t seconds = (uint32_t)(unix_ms / 1000);
+            uint16_t ms = (uint16_t)(unix_ms % 1000);
+            server.queueDownlink(uplink.dev_eui, CLOCK_SYNC_PORT,
+                                 { CLOCK_SYNC_VERSION, uplink.data[1], (uint8_t)(seconds >> 24),
+                                   (uint8_t)(seconds >> 16), (uint8_t)(seconds >> 8), (uint8_t)seconds,
+                                   (uint8_t)(ms >> 8), (uint8_t)ms });
+        }
+    });
+
+    nsSocketServer socket_server;
+    if (!socket_server.start(&server, port)) {
+        fprintf(stderr, "can't listen on port %u\n", port);
+        return 1;
+    }
+    printf("HOST_NETWORK_SERVER=127.0.0.1:%u\n", socket_server.port());
+    fflush(stdout);
+    nsStats reported = {};
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        nsStats stats;
+        server.stats(&stats);
+        if ((stats.joins != reported.joins) || (stats.join_rejects != reported.join_rejects) ||
+            (stats.bad_mics != reported.bad_mics) || (stats.replays != reported.replays)) {
+            printf("joins %u  rejected %u  bad MICs %u  replays %u\n", stats.joins, stats.join_rejects, stats.bad_mics,
+                   stats.replays);
+            fflush(stdout);
+            reported = stats;
+        }
+    }
+}
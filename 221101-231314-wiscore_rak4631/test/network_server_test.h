@@ -0,0 +1,231 @@
+#include "ns/NetworkServer.h"
+#include "ns/NsSocket.h"
+
+#include <string.h>
+
+static const uint8_t NS_TEST_DEV_EUI[8] = { 0x00, 0x48, 0x4F, 0x53, 0x54, 0x00, 0x00, 0x02 };
+static const uint8_t NS_TEST_APP_EUI[8] = { 0x70, 0xB3, 0xD5, 0x7E, 0xD0, 0x00, 0x00, 0x01 };
+static const uint8_t NS_TEST_APP_KEY[16] = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+                                             0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10 };
+
+/** @brief The device side, built straight on LoRaWanCrypto.h. */
+class NetworkServerTest : public ::testing::Test {
+  protected:
+    void SetUp() override { server.addDevice(NS_TEST_DEV_EUI, NS_TEST_APP_EUI, NS_TEST_APP_KEY); }
+
+    nsRadioFrame frame(const std::vector<uint8_t> &phy) {
+        return { now_ms, 100, data_rate, -100, snr, phy };
+    }
+
+    nsDownlink join(uint16_t nonce) {
+        std::vector<uint8_t> request(23);
+        request[0] = (uint8_t)LORAWAN_MTYPE::JOIN_REQUEST;
+        for (int i = 0; i < 8; i++) {
+            request[1 + i] = NS_TEST_APP_EUI[7 - i];
+            request[9 + i] = NS_TEST_DEV_EUI[7 - i];
+        }
+        lorawanPutLe(&request[17], nonce, 2);
+        lorawanPutLe(&request[19], lorawanJoinMic(NS_TEST_APP_KEY, request.data(), 19), LORAWAN_MIC_SIZE);
+        nsDownlink accept = server.handleUplink(frame(request));
+        if (accept.present && (accept.phy.size() == 17)) {
+            lorawanJoinAcceptDecrypt(NS_TEST_APP_KEY, &accept.phy[1], 16);
+            dev_addr = lorawanGetLe(&accept.phy[7], 4);
+            lorawanSessionKeys(NS_TEST_APP_KEY, lorawanGetLe(&accept.phy[1], 3), lorawanGetLe(&accept.phy[4], 3), nonce,
+                               nwk_s_key, app_s_key);
+        }
+        return accept;
+    }
+
+    std::vector<uint8_t> uplink(uint32_t fcnt, uint8_t port, std::vector<uint8_t> data, bool adr = false,
+                                const std::vector<uint8_t> &fopts = {}) {
+        std::vector<uint8_t> phy(8);
+        phy[0] = (uint8_t)LORAWAN_MTYPE::UNCONFIRMED_UP;
+        lorawanPutLe(&phy[1], dev_addr, 4);
+        phy[5] = (uint8_t)((adr ? LORAWAN_FCTRL_ADR : 0) | fopts.size());
+        lorawanPutLe(&phy[6], fcnt, 2);
+        phy.insert(phy.end(), fopts.begin(), fopts.end());
+        lorawanPayloadCrypt(app_s_key, LORAWAN_DIR::UPLINK, dev_addr, fcnt, data.data(), data.size());
+        phy.push_back(port);
+        phy.insert(phy.end(), data.begin(), data.end());
+        uint32_t mic = lorawanFrameMic(nwk_s_key, LORAWAN_DIR::UPLINK, dev_addr, fcnt, phy.data(), phy.size());
+        phy.resize(phy.size() + LORAWAN_MIC_SIZE);
+        lorawanPutLe(&phy[phy.size() - LORAWAN_MIC_SIZE], mic, LORAWAN_MIC_SIZE);
+        return phy;
+    }
+
+    // checks & decrypts a downlink in place, leaving [FOpts][FPort][FRMPayload]
+    bool openDownlink(uint32_t fcnt, std::vector<uint8_t> *phy) {
+        size_t length = phy->size();
+        if ((length < 12) || (lorawanGetLe(&(*phy)[1], 4) != dev_addr) ||
+            (lorawanFrameMic(nwk_s_key, LORAWAN_DIR::DOWNLINK, dev_addr, fcnt, phy->data(), length - 4) !=
+             lorawanGetLe(&(*phy)[length - 4], 4))) {
+            return false;
+        }
+        size_t header = 8 + ((*phy)[5] & 0x0F);
+        if (header + 1 < length - 4) {
+            lorawanPayloadCrypt(app_s_key, LORAWAN_DIR::DOWNLINK, dev_addr, fcnt, &(*phy)[header + 1],
+                                length - 4 - header - 1);
+        }
+        phy->erase(phy->end() - 4, phy->end());
+        phy->erase(phy->begin(), phy->begin() + 8);
+        return true;
+    }
+
+    networkServer server;
+    uint64_t now_ms = 0;
+    uint8_t data_rate = 2;
+    int8_t snr = 0;
+    uint32_t dev_addr = 0;
+    uint8_t nwk_s_key[16] = {};
+    uint8_t app_s_key[16] = {};
+};
+
+TEST_F(NetworkServerTest, JoinAcceptAndSessionKeys) {
+    nsDownlink accept = join(0x1111);
+    ASSERT_TRUE(accept.present);
+    EXPECT_EQ(accept.delay_ms, NS_JOIN_ACCEPT_DELAY1_MS);
+    EXPECT_EQ(accept.data_rate, NS_RX1_DATA_RATE_BASE + data_rate);
+    EXPECT_EQ(accept.phy[0], (uint8_t)LORAWAN_MTYPE::JOIN_ACCEPT);
+    EXPECT_EQ(lorawanJoinMic(NS_TEST_APP_KEY, accept.phy.data(), 13), lorawanGetLe(&accept.phy[13], 4));
+    nsSession session;
+    ASSERT_TRUE(server.session(nsEui(NS_TEST_DEV_EUI), &session));
+    EXPECT_EQ(session.dev_addr, dev_addr);
+    EXPECT_EQ(memcmp(session.nwk_s_key, nwk_s_key, 16), 0);
+    EXPECT_EQ(memcmp(session.app_s_key, app_s_key, 16), 0);
+
+    // a DevNonce can't be used twice
+    EXPECT_FALSE(join(0x1111).present);
+    nsStats stats;
+    server.stats(&stats);
+    EXPECT_EQ(stats.joins, 1u);
+    EXPECT_EQ(stats.join_rejects, 1u);
+}
+
+TEST_F(NetworkServerTest, RxDelayFromTheJoinAccept) {
+    server.setRxDelay(5);
+    nsDownlink accept = join(0x5555);
+    ASSERT_TRUE(accept.present);
+    EXPECT_EQ(accept.phy[12], 5);
+    nsSession session;
+    ASSERT_TRUE(server.session(nsEui(NS_TEST_DEV_EUI), &session));
+    EXPECT_EQ(session.rx1_delay_ms, 5000u);
+
+    // RX1 & RX2 move with it
+    uint64_t dev_eui = nsEui(NS_TEST_DEV_EUI);
+    server.queueDownlink(dev_eui, 5, { 1 });
+    nsDownlink downlink = server.handleUplink(frame(uplink(0, 10, { 1 })));
+    ASSERT_TRUE(downlink.present);
+    EXPECT_EQ(downlink.delay_ms, 5000u);
+    server.setBackhaulMs(5000);
+    server.queueDownlink(dev_eui, 5, { 2 });
+    downlink = server.handleUplink(frame(uplink(1, 10, { 1 })));
+    ASSERT_TRUE(downlink.present);
+    EXPECT_EQ(downlink.delay_ms, 6000u);
+    EXPECT_EQ(downlink.data_rate, NS_RX2_DATA_RATE);
+}
+
+TEST_F(NetworkServerTest, UplinksAreCheckedAndDecrypted) {
+    join(0x2222);
+    now_ms = 1000;
+    EXPECT_FALSE(server.handleUplink(frame(uplink(0, 10, { 1, 2, 3 }))).present);
+    EXPECT_FALSE(server.handleUplink(frame(uplink(1, 10, { 4, 5 }))).present);
+    std::vector<nsUplink> uplinks = server.uplinks();
+    ASSERT_EQ(uplinks.size(), 2u);
+    EXPECT_EQ(uplinks[0].data, std::vector<uint8_t>({ 1, 2, 3 }));
+    EXPECT_EQ(uplinks[1].port, 10);
+    EXPECT_EQ(uplinks[1].rx_ms, 1100u);
+
+    // replayed, tampered with
+    server.handleUplink(frame(uplink(1, 10, { 4, 5 })));
+    std::vector<uint8_t> tampered = uplink(2, 10, { 6 });
+    tampered[9] ^= 0x01;
+    server.handleUplink(frame(tampered));
+    // too far ahead
+    server.handleUplink(frame(uplink(2 + NS_MAX_FCNT_GAP, 10, { 6 })));
+    // the counter rolls over its 16 bits on air
+    for (uint32_t fcnt = 0x4000; fcnt < 0x10000; fcnt += 0x3FFF) {
+        server.handleUplink(frame(uplink(fcnt, 10, { 7 })));
+    }
+    server.handleUplink(frame(uplink(0x10003, 10, { 8 })));
+    nsStats stats;
+    server.stats(&stats);
+    EXPECT_EQ(stats.replays, 2u);
+    EXPECT_EQ(stats.bad_mics, 1u);
+    uplinks = server.uplinks();
+    ASSERT_EQ(uplinks.size(), 7u);
+    EXPECT_EQ(uplinks.back().fcnt, 0x10003u);
+    EXPECT_EQ(uplinks.back().data, std::vector<uint8_t>({ 8 }));
+}
+
+TEST_F(NetworkServerTest, DownlinksInRx1OrRx2) {
+    join(0x3333);
+    uint64_t dev_eui = nsEui(NS_TEST_DEV_EUI);
+    // the application answers the uplink in its own RX windows
+    server.onUplink([&](const nsUplink &up) { server.queueDownlink(up.dev_eui, up.port, { 0xAB }); });
+    nsDownlink downlink = server.handleUplink(frame(uplink(0, 201, { 1 })));
+    ASSERT_TRUE(downlink.present);
+    EXPECT_EQ(downlink.delay_ms, NS_RX1_DELAY_MS);
+    std::vector<uint8_t> opened = downlink.phy;
+    ASSERT_TRUE(openDownlink(0, &opened));
+    EXPECT_EQ(opened, std::vector<uint8_t>({ 201, 0xAB }));
+
+    // too slow for RX1, then for RX2 too
+    server.onUplink(nullptr);
+    server.setBackhaulMs(1500);
+    server.queueDownlink(dev_eui, 5, { 1 });
+    downlink = server.handleUplink(frame(uplink(1, 10, { 1 })));
+    ASSERT_TRUE(downlink.present);
+    EXPECT_EQ(downlink.delay_ms, NS_RX2_DELAY_MS);
+    EXPECT_EQ(downlink.data_rate, NS_RX2_DATA_RATE);
+    opened = downlink.phy;
+    EXPECT_TRUE(openDownlink(1, &opened));
+    server.setBackhaulMs(3000);
+    server.queueDownlink(dev_eui, 5, { 2 });
+    EXPECT_FALSE(server.handleUplink(frame(uplink(2, 10, { 1 }))).present);
+    nsStats stats;
+    server.stats(&stats);
+    EXPECT_EQ(stats.late_downlinks, 1u);
+}
+
+TEST_F(NetworkServerTest, AdrSpeedsUpAStrongLink) {
+    join(0x4444);
+    snr = 10;
+    nsDownlink downlink = {};
+    for (uint32_t fcnt = 0; fcnt < NS_ADR_HISTORY; fcnt++) {
+        // no decision on too few uplinks
+        EXPECT_FALSE(downlink.present);
+        downlink = server.handleUplink(frame(uplink(fcnt, 10, { 1 }, true)));
+    }
+    ASSERT_TRUE(downlink.present);
+    std::vector<uint8_t> opened = downlink.phy;
+    ASSERT_TRUE(openDownlink(0, &opened));
+    // 10 dB - (-15 dB at DR2) - 10 dB margin = 5 steps: DR5, then 2 steps less power
+    ASSERT_GE(opened.size(), 5u);
+    EXPECT_EQ(opened[0], (uint8_t)LORAWAN_MAC::LINK_ADR);
+    EXPECT_EQ(opened[1], (5 << 4) | 2);
+
+    // taken once the device acks it
+    nsSession session;
+    server.handleUplink(frame(uplink(NS_ADR_HISTORY, 10, { 1 }, true, { (uint8_t)LORAWAN_MAC::LINK_ADR, 0x07 })));
+    ASSERT_TRUE(server.session(nsEui(NS_TEST_DEV_EUI), &session));
+    EXPECT_EQ(session.data_rate, 5);
+    EXPECT_EQ(session.tx_power, 2);
+}
+
+TEST_F(NetworkServerTest, OverTheSocket) {
+    nsSocketServer socket_server;
+    ASSERT_TRUE(socket_server.start(&server));
+    nsSocketClient client;
+    ASSERT_TRUE(client.connect(("127.0.0.1:" + std::to_string(socket_server.port())).c_str()));
+    join(0x5555);
+    nsDownlink answer;
+    ASSERT_TRUE(client.exchange(frame(uplink(0, 10, { 9, 9 })), &answer));
+    EXPECT_FALSE(answer.present);
+    server.queueDownlink(nsEui(NS_TEST_DEV_EUI), 7, { 1, 2 });
+    ASSERT_TRUE(client.exchange(frame(uplink(1, 10, { 9 })), &answer));
+    EXPECT_TRUE(answer.present);
+    EXPECT_TRUE(openDownlink(0, &answer.phy));
+    EXPECT_EQ(server.uplinks().size(), 2u);
+    socket_server.stop();
+    EXPECT_FALSE(client.exchange(frame(uplink(2, 10, { 9 })), &answer));
+}
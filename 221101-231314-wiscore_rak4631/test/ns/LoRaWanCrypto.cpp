@@ -0,0 +1,272 @@
+/**
+ * @file LoRaWanCrypto.cpp
+ * @brief AES-128 (FIPS-197), AES-CMAC (RFC 4493) and the LoRaWAN 1.0.x security functions built on them.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "LoRaWanCrypto.h"
+
+#include <string.h>
+
+static const uint8_t SBOX[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76, 0xca, 0x82, 0xc9,
+    0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0, 0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f,
+    0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15, 0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07,
+    0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75, 0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3,
+    0x29, 0xe3, 0x2f, 0x84, 0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58,
+    0xcf, 0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8, 0x51, 0xa3,
+    0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2, 0xcd, 0x0c, 0x13, 0xec, 0x5f,
+    0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73, 0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88,
+    0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb, 0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac,
+    0x62, 0x91, 0x95, 0xe4, 0x79, 0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a,
+    0xae, 0x08, 0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a, 0x70,
+    0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e, 0xe1, 0xf8, 0x98, 0x11,
+    0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf, 0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42,
+    0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+static uint8_t inv_sbox[256];
+
+static uint8_t xtime(uint8_t x) { return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00)); }
+
+static uint8_t gmul(uint8_t a, uint8_t b) {
+    uint8_t product = 0;
+    while (b != 0) {
+        if (b & 1) {
+            product ^= a;
+        }
+        a = xtime(a);
+        b >>= 1;
+    }
+    return product;
+}
+
+void aes128Init(aes128Key *key, const uint8_t raw[LORAWAN_KEY_SIZE]) {
+    if (inv_sbox[0x63] == 0) {
+        // filled once; racing threads write the same values
+        for (int i = 0; i < 256; i++) {
+            inv_sbox[SBOX[i]] = (uint8_t)i;
+        }
+    }
+    uint8_t *w = key->round_keys;
+    memcpy(w, raw, LORAWAN_KEY_SIZE);
+    uint8_t rcon = 0x01;
+    for (int i = 16; i < 176; i += 4) {
+        uint8_t t[4] = { w[i - 4], w[i - 3], w[i - 2], w[i - 1] };
+        if ((i % 16) == 0) {
+            uint8_t first = t[0];
+            t[0] = SBOX[t[1]] ^ rcon;
+            t[1] = SBOX[t[2]];
+            t[2] = SBOX[t[3]];
+            t[3] = SBOX[first];
+            rcon = xtime(rcon);
+        }
+        for (int j = 0; j < 4; j++) {
+            w[i + j] = w[i - 16 + j] ^ t[j];
+        }
+    }
+}
+
+static void addRoundKey(uint8_t state[16], const uint8_t *round_key) {
+    for (int i = 0; i < 16; i++) {
+        state[i] ^= round_key[i];
+    }
+}
+
+void aes128Encrypt(const aes128Key *key, const uint8_t in[16], uint8_t out[16]) {
+    uint8_t s[16];
+    memcpy(s, in, 16);
+    addRoundKey(s, key->round_keys);
+    for (int round = 1; round <= 10; round++) {
+        // SubBytes & ShiftRows (the state is column major)
+        uint8_t t[16];
+        for (int i = 0; i < 16; i++) {
+            t[i] = SBOX[s[(i + 4 * (i % 4)) % 16]];
+        }
+        if (round < 10) {
+            // MixColumns
+            for (int c = 0; c < 4; c++) {
+                uint8_t *col = &t[4 * c];
+                uint8_t a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+                uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+                col[0] ^= all ^ xtime(a0 ^ a1);
+                col[1] ^= all ^ xtime(a1 ^ a2);
+                col[2] ^= all ^ xtime(a2 ^ a3);
+                col[3] ^= all ^ xtime(a3 ^ a0);
+            }
+        }
+        memcpy(s, t, 16);
+        addRoundKey(s, key->round_keys + 16 * round);
+    }
+    memcpy(out, s, 16);
+}
+
+void aes128Decrypt(const aes128Key *key, const uint8_t in[16], uint8_t out[16]) {
+    uint8_t s[16];
+    memcpy(s, in, 16);
+    addRoundKey(s, key->round_keys + 160);
+    for (int round = 9; round >= 0; round--) {
+        // InvShiftRows & InvSubBytes
+        uint8_t t[16];
+        for (int i = 0; i < 16; i++) {
+            t[(i + 4 * (i % 4)) % 16] = inv_sbox[s[i]];
+        }
+        addRoundKey(t, key->round_keys + 16 * round);
+        if (round > 0) {
+            // InvMixColumns
+            for (int c = 0; c < 4; c++) {
+                uint8_t *col = &t[4 * c];
+                uint8_t a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+                col[0] = gmul(a0, 14) ^ gmul(a1, 11) ^ gmul(a2, 13) ^ gmul(a3, 9);
+                col[1] = gmul(a0, 9) ^ gmul(a1, 14) ^ gmul(a2, 11) ^ gmul(a3, 13);
+                col[2] = gmul(a0, 13) ^ gmul(a1, 9) ^ gmul(a2, 14) ^ gmul(a3, 11);
+                col[3] = gmul(a0, 11) ^ gmul(a1, 13) ^ gmul(a2, 9) ^ gmul(a3, 14);
+            }
+        }
+        memcpy(s, t, 16);
+    }
+    memcpy(out, s, 16);
+}
+
+// doubling in GF(2^128), for the CMAC subkeys
+static void cmacShift(const uint8_t in[16], uint8_t out[16]) {
+    uint8_t carry = in[0] >> 7;
+    for (int i = 0; i < 15; i++) {
+        out[i] = (uint8_t)((in[i] << 1) | (in[i + 1] >> 7));
+    }
+    out[15] = (uint8_t)((in[15] << 1) ^ (carry ? 0x87 : 0x00));
+}
+
+void aesCmac(const uint8_t key[LORAWAN_KEY_SIZE], const uint8_t *data, size_t length, uint8_t mac[16]) {
+    aes128Key expanded;
+    aes128Init(&expanded, key);
+    uint8_t zero[16] = {};
+    uint8_t l[16], k1[16], k2[16];
+    aes128Encrypt(&expanded, zero, l);
+    cmacShift(l, k1);
+    cmacShift(k1, k2);
+
+    size_t blocks = (length + 15) / 16;
+    bool complete = (length > 0) && ((length % 16) == 0);
+    if (blocks == 0) {
+        blocks = 1;
+    }
+    uint8_t x[16] = {};
+    for (size_t b = 0; b < blocks; b++) {
+        uint8_t block[16] = {};
+        size_t at = 16 * b;
+        size_t count = (length - at < 16) ? length - at : 16;
+        if (at < length) {
+            memcpy(block, data + at, count);
+        } else {
+            count = 0;
+        }
+        if (b == blocks - 1) {
+            // the last block is padded & masked with k2, or masked with k1 if complete
+            if (!complete) {
+                block[count] = 0x80;
+            }
+            const uint8_t *subkey = complete ? k1 : k2;
+            for (int i = 0; i < 16; i++) {
+                block[i] ^= subkey[i];
+            }
+        }
+        for (int i = 0; i < 16; i++) {
+            x[i] ^= block[i];
+        }
+        aes128Encrypt(&expanded, x, x);
+    }
+    memcpy(mac, x, 16);
+}
+
+void lorawanPutLe(uint8_t *at, uint32_t value, uint8_t bytes) {
+    for (uint8_t i = 0; i < bytes; i++) {
+        at[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+uint32_t lorawanGetLe(const uint8_t *at, uint8_t bytes) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < bytes; i++) {
+        value |= (uint32_t)at[i] << (8 * i);
+    }
+    return value;
+}
+
+uint32_t lorawanJoinMic(const uint8_t app_key[LORAWAN_KEY_SIZE], const uint8_t *frame, size_t length) {
+    uint8_t mac[16];
+    aesCmac(app_key, frame, length, mac);
+    return lorawanGetLe(mac, LORAWAN_MIC_SIZE);
+}
+
+// the A & B0 blocks: [type][0 x 4][dir][DevAddr][FCnt (32 bits)][0][last]
+static void lorawanBlock(uint8_t block[16], uint8_t type, LORAWAN_DIR dir, uint32_t dev_addr, uint32_t fcnt,
+                         uint8_t last) {
+    memset(block, 0, 16);
+    block[0] = type;
+    block[5] = (uint8_t)dir;
+    lorawanPutLe(&block[6], dev_addr, 4);
+    lorawanPutLe(&block[10], fcnt, 4);
+    block[15] = last;
+}
+
+uint32_t lorawanFrameMic(const uint8_t nwk_s_key[LORAWAN_KEY_SIZE], LORAWAN_DIR dir, uint32_t dev_addr, uint32_t fcnt,
+                         const uint8_t *frame, size_t length) {
+    uint8_t message[16 + 256];
+    if (length > 256) {
+        return 0;
+    }
+    lorawanBlock(message, 0x49, dir, dev_addr, fcnt, (uint8_t)length);
+    memcpy(message + 16, frame, length);
+    uint8_t mac[16];
+    aesCmac(nwk_s_key, message, 16 + length, mac);
+    return lorawanGetLe(mac, LORAWAN_MIC_SIZE);
+}
+
+void lorawanPayloadCrypt(const uint8_t key[LORAWAN_KEY_SIZE], LORAWAN_DIR dir, uint32_t dev_addr, uint32_t fcnt,
+                         uint8_t *data, size_t length) {
+    aes128Key expanded;
+    aes128Init(&expanded, key);
+    for (size_t at = 0; at < length; at += 16) {
+        uint8_t a[16], s[16];
+        lorawanBlock(a, 0x01, dir, dev_addr, fcnt, (uint8_t)(at / 16 + 1));
+        aes128Encrypt(&expanded, a, s);
+        for (size_t i = 0; (i < 16) && (at + i < length); i++) {
+            data[at + i] ^= s[i];
+        }
+    }
+}
+
+void lorawanJoinAcceptEncrypt(const uint8_t app_key[LORAWAN_KEY_SIZE], uint8_t *data, size_t length) {
+    aes128Key expanded;
+    aes128Init(&expanded, app_key);
+    for (size_t at = 0; at + 16 <= length; at += 16) {
+        aes128Decrypt(&expanded, data + at, data + at);
+    }
+}
+
+void lorawanJoinAcceptDecrypt(const uint8_t app_key[LORAWAN_KEY_SIZE], uint8_t *data, size_t length) {
+    aes128Key expanded;
+    aes128Init(&expanded, app_key);
+    for (size_t at = 0; at + 16 <= length; at += 16) {
+        aes128Encrypt(&expanded, data + at, data + at);
+    }
+}
+
+void lorawanSessionKeys(const uint8_t app_key[LORAWAN_KEY_SIZE], uint32_t app_nonce, uint32_t net_id,
+                        uint16_t dev_nonce, uint8_t nwk_s_key[LORAWAN_KEY_SIZE], uint8_t app_s_key[LORAWAN_KEY_SIZE]) {
+    aes128Key expanded;
+    aes128Init(&expanded, app_key);
+    uint8_t block[16] = {};
+    lorawanPutLe(&block[1], app_nonce, 3);
+    lorawanPutLe(&block[4], net_id, 3);
+    lorawanPutLe(&block[7], dev_nonce, 2);
+    block[0] = 0x01;
+    aes128Encrypt(&expanded, block, nwk_s_key);
+    block[0] = 0x02;
+    aes128Encrypt(&expanded, block, app_s_key);
+}
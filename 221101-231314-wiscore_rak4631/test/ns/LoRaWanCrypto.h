@@ -0,0 +1,77 @@
+#pragma once
+/**
+ * @file LoRaWanCrypto.h
+ * @brief LoRaWAN 1.0.x security on the host: AES-128, AES-CMAC (RFC 4493) and the MIC, payload encryption, join
+ * accept & session key derivation built on them. Used by both ends: the host radio (HostRadio.cpp) and the network
+ * server emulator (NetworkServer.h). Slow & simple, not constant time; test use only.
+ *
+ * Multi-byte LoRaWAN fields are little endian on air, EUIs included. The OTAA keys are held MSB first, as in OTAA_keys.h.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LORAWAN_KEY_SIZE 16
+#define LORAWAN_MIC_SIZE 4
+
+/** @brief Frame direction, as used in the MIC & encryption blocks. */
+enum class LORAWAN_DIR : uint8_t {
+    UPLINK = 0,
+    DOWNLINK = 1,
+};
+
+/** @brief An expanded AES-128 key. */
+struct aes128Key {
+    uint8_t round_keys[176];
+};
+
+void aes128Init(aes128Key *key, const uint8_t raw[LORAWAN_KEY_SIZE]);
+void aes128Encrypt(const aes128Key *key, const uint8_t in[16], uint8_t out[16]);
+void aes128Decrypt(const aes128Key *key, const uint8_t in[16], uint8_t out[16]);
+
+/**
+ * @brief AES-CMAC (RFC 4493) of data.
+ */
+void aesCmac(const uint8_t key[LORAWAN_KEY_SIZE], const uint8_t *data, size_t length, uint8_t mac[16]);
+
+/**
+ * @brief MIC of a join request or accept: the first 4 bytes of the CMAC over the frame (MHDR onwards) with the AppKey.
+ */
+uint32_t lorawanJoinMic(const uint8_t app_key[LORAWAN_KEY_SIZE], const uint8_t *frame, size_t length);
+
+/**
+ * @brief MIC of a data frame (MHDR to the end of FRMPayload) with the NwkSKey.
+ */
+uint32_t lorawanFrameMic(const uint8_t nwk_s_key[LORAWAN_KEY_SIZE], LORAWAN_DIR dir, uint32_t dev_addr, uint32_t fcnt,
+                         const uint8_t *frame, size_t length);
+
+/**
+ * @brief Encrypts or decrypts (the same operation) an FRMPayload in place: AppSKey for FPort 1-255, NwkSKey for 0.
+ */
+void lorawanPayloadCrypt(const uint8_t key[LORAWAN_KEY_SIZE], LORAWAN_DIR dir, uint32_t dev_addr, uint32_t fcnt,
+                         uint8_t *data, size_t length);
+
+/**
+ * @brief Encrypts a join accept after the MHDR in place, length a multiple of 16 (the network side uses AES decrypt).
+ */
+void lorawanJoinAcceptEncrypt(const uint8_t app_key[LORAWAN_KEY_SIZE], uint8_t *data, size_t length);
+
+/**
+ * @brief Decrypts a join accept after the MHDR in place (the device side uses AES encrypt).
+ */
+void lorawanJoinAcceptDecrypt(const uint8_t app_key[LORAWAN_KEY_SIZE], uint8_t *data, size_t length);
+
+/**
+ * @brief Derives the session keys from a join.
+ */
+void lorawanSessionKeys(const uint8_t app_key[LORAWAN_KEY_SIZE], uint32_t app_nonce, uint32_t net_id,
+                        uint16_t dev_nonce, uint8_t nwk_s_key[LORAWAN_KEY_SIZE], uint8_t app_s_key[LORAWAN_KEY_SIZE]);
+
+/** @brief Little endian field helpers. */
+void lorawanPutLe(uint8_t *at, uint32_t value, uint8_t bytes);
+uint32_t lorawanGetLe(const uint8_t *at, uint8_t bytes);
@@ -0,0 +1,428 @@
+/**
+ * @file NetworkServer.cpp
+ * @brief The LoRaWAN 1.0.x network server stand-in, see NetworkServer.h.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "NetworkServer.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#define NS_JOIN_REQUEST_SIZE 23 /**< MHDR, AppEUI, DevEUI, DevNonce & MIC. */
+#define NS_DATA_MIN_SIZE     12 /**< MHDR, DevAddr, FCtrl, FCnt & MIC. */
+
+/** @brief SNR needed to demodulate DR0 - DR5 (SF12 - SF7), dB. */
+static const float NS_REQUIRED_SNR[] = { -20.0f, -17.5f, -15.0f, -12.5f, -10.0f, -7.5f };
+
+uint64_t nsEui(const uint8_t eui[8]) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | eui[i];
+    }
+    return value;
+}
+
+// an EUI on air is LSB first
+static uint64_t getEui(const uint8_t *at) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | at[i];
+    }
+    return value;
+}
+
+static uint32_t elapsedUs(std::chrono::steady_clock::time_point since) {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - since)
+        .count();
+}
+
+void networkServer::addDevice(const uint8_t dev_eui[8], const uint8_t app_eui[8],
+                              const uint8_t app_key[LORAWAN_KEY_SIZE]) {
+    std::lock_guard<std::mutex> lock(mutex);
+    device dev = {};
+    dev.dev_eui = nsEui(dev_eui);
+    dev.app_eui = nsEui(app_eui);
+    memcpy(dev.app_key, app_key, LORAWAN_KEY_SIZE);
+    devices[dev.dev_eui] = dev;
+}
+
+void networkServer::forgetSession(uint64_t dev_eui) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = devices.find(dev_eui);
+    if ((found == devices.end()) || !found->second.joined) {
+        return;
+    }
+    dev_addrs.erase(found->second.session.dev_addr);
+    found->second.joined = false;
+    found->second.queue.clear();
+}
+
+void networkServer::queueDownlink(uint64_t dev_eui, uint8_t port, const std::vector<uint8_t> &data, bool confirmed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = devices.find(dev_eui);
+    if (found != devices.end()) {
+        found->second.queue.push_back({ port, data, confirmed });
+    }
+}
+
+void networkServer::onUplink(const std::function<void(const nsUplink &)> &handler) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uplink_handler = handler;
+}
+
+void networkServer::setBackhaulMs(uint32_t round_trip_ms) {
+    std::lock_guard<std::mutex> lock(mutex);
+    backhaul_ms = round_trip_ms;
+}
+
+void networkServer::setRxDelay(uint8_t seconds) {
+    std::lock_guard<std::mutex> lock(mutex);
+    rx_delay_s = (uint8_t)std::min(std::max((int)seconds, 1), 15);
+}
+
+std::vector<nsUplink> networkServer::uplinks(void) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return uplink_log;
+}
+
+std::vector<nsJoin> networkServer::joins(void) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return join_log;
+}
+
+void networkServer::stats(nsStats *stats) {
+    std::lock_guard<std::mutex> lock(mutex);
+    *stats = counters;
+}
+
+bool networkServer::session(uint64_t dev_eui, nsSession *session) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = devices.find(dev_eui);
+    if ((found == devices.end()) || !found->second.joined) {
+        return false;
+    }
+    *session = found->second.session;
+    return true;
+}
+
+nsDownlink networkServer::handleUplink(const nsRadioFrame &frame) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (frame.phy.empty()) {
+        counters.malformed++;
+        return {};
+    }
+    switch ((LORAWAN_MTYPE)(frame.phy[0] & 0xE0)) {
+        case LORAWAN_MTYPE::JOIN_REQUEST:
+            return handleJoin(frame);
+        case LORAWAN_MTYPE::UNCONFIRMED_UP:
+        case LORAWAN_MTYPE::CONFIRMED_UP:
+            return handleData(frame, lock);
+        default:
+            counters.malformed++;
+            return {};
+    }
+}
+
+/**
+ * @brief Picks the window a downlink makes, given how long the server took.
+ * @return False if it makes neither.
+ */
+bool networkServer::rxWindow(uint32_t delay1_ms, uint32_t delay2_ms, uint32_t processing_ms, uint32_t *delay_ms) {
+    uint32_t ready_ms = backhaul_ms + processing_ms + NS_SCHEDULE_MARGIN_MS;
+    if (ready_ms <= delay1_ms) {
+        *delay_ms = delay1_ms;
+        return true;
+    }
+    if (ready_ms <= delay2_ms) {
+        *delay_ms = delay2_ms;
+        return true;
+    }
+    return false;
+}
+
+nsDownlink networkServer::handleJoin(const nsRadioFrame &frame) {
+    auto start = std::chrono::steady_clock::now();
+    nsDownlink downlink = {};
+    if (frame.phy.size() != NS_JOIN_REQUEST_SIZE) {
+        counters.malformed++;
+        return downlink;
+    }
+    const uint8_t *phy = frame.phy.data();
+    uint64_t app_eui = getEui(&phy[1]);
+    uint64_t dev_eui = getEui(&phy[9]);
+    uint16_t dev_nonce = (uint16_t)lorawanGetLe(&phy[17], 2);
+    auto found = devices.find(dev_eui);
+    if ((found == devices.end()) || (found->second.app_eui != app_eui)) {
+        counters.join_rejects++;
+        return downlink;
+    }
+    device &dev = found->second;
+    if ((lorawanJoinMic(dev.app_key, phy, NS_JOIN_REQUEST_SIZE - LORAWAN_MIC_SIZE) !=
+         lorawanGetLe(&phy[19], LORAWAN_MIC_SIZE)) ||
+        (dev.dev_nonces.count(dev_nonce) > 0)) {
+        counters.join_rejects++;
+        return downlink;
+    }
+    dev.dev_nonces.insert(dev_nonce);
+
+    // a new session; the old DevAddr goes
+    if (dev.joined) {
+        dev_addrs.erase(dev.session.dev_addr);
+    }
+    uint32_t nonce = app_nonce++ & 0xFFFFFF;
+    dev.session = {};
+    dev.session.dev_addr = next_dev_addr++;
+    dev.session.data_rate = frame.data_rate;
+    dev.session.rx1_delay_ms = rx_delay_s * 1000UL;
+    lorawanSessionKeys(dev.app_key, nonce, NS_NET_ID, dev_nonce, dev.session.nwk_s_key, dev.session.app_s_key);
+    dev.joined = true;
+    dev.has_uplink = false;
+    dev.mac_answers.clear();
+    dev.snr_history.clear();
+    dev.adr_pending = false;
+    dev_addrs[dev.session.dev_addr] = dev_eui;
+
+    // [MHDR][AppNonce (3)][NetID (3)][DevAddr (4)][DLSettings][RxDelay][MIC], encrypted after the MHDR
+    uint8_t accept[17] = {};
+    accept[0] = (uint8_t)LORAWAN_MTYPE::JOIN_ACCEPT;
+    lorawanPutLe(&accept[1], nonce, 3);
+    lorawanPutLe(&accept[4], NS_NET_ID, 3);
+    lorawanPutLe(&accept[7], dev.session.dev_addr, 4);
+    accept[11] = NS_RX2_DATA_RATE; // RX1DROffset 0
+    accept[12] = rx_delay_s;
+    lorawanPutLe(&accept[13], lorawanJoinMic(dev.app_key, accept, 13), LORAWAN_MIC_SIZE);
+    lorawanJoinAcceptEncrypt(dev.app_key, &accept[1], 16);
+
+    uint32_t processing_ms = elapsedUs(start) / 1000;
+    if (!rxWindow(NS_JOIN_ACCEPT_DELAY1_MS, NS_JOIN_ACCEPT_DELAY2_MS, processing_ms, &downlink.delay_ms)) {
+        counters.join_rejects++;
+        return downlink;
+    }
+    downlink.present = true;
+    downlink.data_rate = (downlink.delay_ms == NS_JOIN_ACCEPT_DELAY1_MS)
+                             ? std::min(NS_RX1_DATA_RATE_BASE + frame.data_rate, 13)
+                             : NS_RX2_DATA_RATE;
+    downlink.phy.assign(accept, accept + sizeof(accept));
+    counters.joins++;
+    counters.downlinks++;
+    join_log.push_back({ dev_eui, dev_nonce, dev.session.dev_addr, frame.time_ms,
+                         frame.time_ms + frame.time_on_air_ms + downlink.delay_ms });
+    return downlink;
+}
+
+nsDownlink networkServer::handleData(const nsRadioFrame &frame, std::unique_lock<std::mutex> &lock) {
+    auto start = std::chrono::steady_clock::now();
+    size_t length = frame.phy.size();
+    const uint8_t *phy = frame.phy.data();
+    if (length < NS_DATA_MIN_SIZE) {
+        counters.malformed++;
+        return {};
+    }
+    uint32_t dev_addr = lorawanGetLe(&phy[1], 4);
+    uint8_t fctrl = phy[5];
+    uint8_t fopts_length = fctrl & 0x0F;
+    size_t header = 8 + fopts_length;
+    if (header + LORAWAN_MIC_SIZE > length) {
+        counters.malformed++;
+        return {};
+    }
+    auto address = dev_addrs.find(dev_addr);
+    if (address == dev_addrs.end()) {
+        counters.unknown++;
+        return {};
+    }
+    device &dev = devices[address->second];
+
+    // the full counter: the upper 16 bits from the last uplink, rolled over if the lower went down
+    uint32_t fcnt16 = lorawanGetLe(&phy[6], 2);
+    uint32_t fcnt = (dev.session.fcnt_up & 0xFFFF0000UL) | fcnt16;
+    if (dev.has_uplink && (fcnt < dev.session.fcnt_up)) {
+        fcnt += 0x10000;
+    }
+    if (lorawanFrameMic(dev.session.nwk_s_key, LORAWAN_DIR::UPLINK, dev_addr, fcnt, phy, length - LORAWAN_MIC_SIZE) !=
+        lorawanGetLe(&phy[length - LORAWAN_MIC_SIZE], LORAWAN_MIC_SIZE)) {
+        counters.bad_mics++;
+        return {};
+    }
+    if (dev.has_uplink && ((fcnt <= dev.session.fcnt_up) || (fcnt - dev.session.fcnt_up > NS_MAX_FCNT_GAP))) {
+        counters.replays++;
+        return {};
+    }
+    dev.has_uplink = true;
+    dev.session.fcnt_up = fcnt;
+    if (!dev.adr_pending) {
+        dev.session.data_rate = frame.data_rate;
+    }
+
+    nsUplink uplink = {};
+    uplink.dev_eui = dev.dev_eui;
+    uplink.dev_addr = dev_addr;
+    uplink.fcnt = fcnt;
+    uplink.confirmed = (LORAWAN_MTYPE)(phy[0] & 0xE0) == LORAWAN_MTYPE::CONFIRMED_UP;
+    uplink.adr = (fctrl & LORAWAN_FCTRL_ADR) != 0;
+    uplink.data_rate = frame.data_rate;
+    uplink.snr = frame.snr;
+    uplink.rx_ms = frame.time_ms + frame.time_on_air_ms;
+    handleMacCommands(&dev, &phy[8], fopts_length, frame);
+    if (header < length - LORAWAN_MIC_SIZE) {
+        uplink.port = phy[header];
+        uplink.data.assign(phy + header + 1, phy + length - LORAWAN_MIC_SIZE);
+        const uint8_t *key = (uplink.port == 0) ? dev.session.nwk_s_key : dev.session.app_s_key;
+        lorawanPayloadCrypt(key, LORAWAN_DIR::UPLINK, dev_addr, fcnt, uplink.data.data(), uplink.data.size());
+        if (uplink.port == 0) {
+            handleMacCommands(&dev, uplink.data.data(), (uint8_t)uplink.data.size(), frame);
+        }
+    }
+    if (uplink.adr) {
+        dev.snr_history.push_back(frame.snr);
+        if (dev.snr_history.size() > NS_ADR_HISTORY) {
+            dev.snr_history.pop_front();
+        }
+        runAdr(&dev);
+    }
+    uplink.decode_us = elapsedUs(start);
+    counters.uplinks++;
+    uplink_log.push_back(uplink);
+
+    // the application server, which may queue a downlink for this uplink
+    std::function<void(const nsUplink &)> handler = uplink_handler;
+    uint64_t dev_eui = dev.dev_eui;
+    if (handler && (uplink.port != 0)) {
+        lock.unlock();
+        handler(uplink);
+        lock.lock();
+    }
+    device &answering = devices[dev_eui];
+    return buildDownlink(&answering, frame, uplink.confirmed, elapsedUs(start) / 1000);
+}
+
+void networkServer::handleMacCommands(device *dev, const uint8_t *commands, uint8_t length, const nsRadioFrame &frame) {
+    for (uint8_t at = 0; at < length;) {
+        switch ((LORAWAN_MAC)commands[at]) {
+            case LORAWAN_MAC::LINK_CHECK: {
+                // margin over the demodulation floor, and one gateway
+                int margin = frame.snr - (int)NS_REQUIRED_SNR[std::min(frame.data_rate, (uint8_t)5)];
+                dev->mac_answers.push_back((uint8_t)LORAWAN_MAC::LINK_CHECK);
+                dev->mac_answers.push_back((uint8_t)std::max(margin, 0));
+                dev->mac_answers.push_back(1);
+                at += 1;
+                break;
+            }
+            case LORAWAN_MAC::LINK_ADR:
+                if (at + 2 > length) {
+                    return;
+                }
+                // power, data rate & channel mask all acked
+                if (dev->adr_pending && ((commands[at + 1] & 0x07) == 0x07)) {
+                    dev->session.data_rate = dev->adr_data_rate;
+                    dev->session.tx_power = dev->adr_tx_power;
+                    dev->snr_history.clear();
+                }
+                dev->adr_pending = false;
+                at += 2;
+                break;
+            case LORAWAN_MAC::DEV_STATUS:
+                at += 3;
+                break;
+            default:
+                // can't tell how long it is, so nothing after it can be read
+                return;
+        }
+    }
+}
+
+/**
+ * @brief The usual ADR: the best SNR over the last NS_ADR_HISTORY uplinks, less what the data rate needs and the
+ * installation margin, spent 3 dB a step on faster data rates then lower power (or taken back as more power).
+ */
+void networkServer::runAdr(device *dev) {
+    if (dev->adr_pending || (dev->snr_history.size() < NS_ADR_HISTORY)) {
+        return;
+    }
+    int8_t best_snr = *std::max_element(dev->snr_history.begin(), dev->snr_history.end());
+    uint8_t data_rate = std::min(dev->session.data_rate, (uint8_t)NS_ADR_MAX_DATA_RATE);
+    uint8_t tx_power = dev->session.tx_power;
+    int steps = (int)floorf((best_snr - NS_REQUIRED_SNR[data_rate] - NS_ADR_MARGIN_DB) / 3.0f);
+    while ((steps > 0) && (data_rate < NS_ADR_MAX_DATA_RATE)) {
+        data_rate++;
+        steps--;
+    }
+    while ((steps > 0) && (tx_power < NS_ADR_MAX_TX_POWER)) {
+        tx_power++;
+        steps--;
+    }
+    while ((steps < 0) && (tx_power > 0)) {
+        tx_power--;
+        steps++;
+    }
+    if ((data_rate == dev->session.data_rate) && (tx_power == dev->session.tx_power)) {
+        return;
+    }
+    dev->adr_pending = true;
+    dev->adr_data_rate = data_rate;
+    dev->adr_tx_power = tx_power;
+}
+
+nsDownlink networkServer::buildDownlink(device *dev, const nsRadioFrame &frame, bool ack, uint32_t processing_ms) {
+    nsDownlink downlink = {};
+    std::vector<uint8_t> fopts = dev->mac_answers;
+    bool adr_request = dev->adr_pending && (fopts.size() + 5 <= LORAWAN_FOPTS_MAX);
+    if (adr_request) {
+        // AU915 sub-band 2 (channels 8-15), as The Things Stack uses
+        fopts.push_back((uint8_t)LORAWAN_MAC::LINK_ADR);
+        fopts.push_back((uint8_t)((dev->adr_data_rate << 4) | dev->adr_tx_power));
+        fopts.push_back(0x00);
+        fopts.push_back(0xFF);
+        fopts.push_back(0x01); // ChMaskCntl 0, NbTrans 1
+    }
+    bool has_data = !dev->queue.empty();
+    if (!ack && !has_data && fopts.empty()) {
+        return downlink;
+    }
+    uint32_t rx1_delay_ms = dev->session.rx1_delay_ms;
+    if (!rxWindow(rx1_delay_ms, rx1_delay_ms + 1000, processing_ms, &downlink.delay_ms)) {
+        counters.late_downlinks += has_data;
+        return downlink;
+    }
+    fopts.resize(std::min(fopts.size(), (size_t)LORAWAN_FOPTS_MAX));
+    dev->mac_answers.clear();
+
+    uint32_t fcnt = dev->session.fcnt_down++;
+    uint32_t dev_addr = dev->session.dev_addr;
+    bool confirmed = has_data && dev->queue.front().confirmed;
+    std::vector<uint8_t> &phy = downlink.phy;
+    phy.push_back((uint8_t)(confirmed ? LORAWAN_MTYPE::CONFIRMED_DOWN : LORAWAN_MTYPE::UNCONFIRMED_DOWN));
+    phy.resize(5);
+    lorawanPutLe(&phy[1], dev_addr, 4);
+    phy.push_back((uint8_t)(LORAWAN_FCTRL_ADR | (ack ? LORAWAN_FCTRL_ACK : 0) | fopts.size()));
+    phy.push_back((uint8_t)fcnt);
+    phy.push_back((uint8_t)(fcnt >> 8));
+    phy.insert(phy.end(), fopts.begin(), fopts.end());
+    if (has_data) {
+        queuedDownlink data = dev->queue.front();
+        dev->queue.pop_front();
+        lorawanPayloadCrypt(dev->session.app_s_key, LORAWAN_DIR::DOWNLINK, dev_addr, fcnt, data.data.data(),
+                            data.data.size());
+        phy.push_back(data.port);
+        phy.insert(phy.end(), data.data.begin(), data.data.end());
+    }
+    uint32_t mic = lorawanFrameMic(dev->session.nwk_s_key, LORAWAN_DIR::DOWNLINK, dev_addr, fcnt, phy.data(),
+                                   phy.size());
+    phy.resize(phy.size() + LORAWAN_MIC_SIZE);
+    lorawanPutLe(&phy[phy.size() - LORAWAN_MIC_SIZE], mic, LORAWAN_MIC_SIZE);
+
+    downlink.present = true;
+    downlink.data_rate = (downlink.delay_ms == rx1_delay_ms) ? std::min(NS_RX1_DATA_RATE_BASE + frame.data_rate, 13)
+                                                             : NS_RX2_DATA_RATE;
+    counters.downlinks++;
+    counters.adr_requests += adr_request;
+    return downlink;
+}
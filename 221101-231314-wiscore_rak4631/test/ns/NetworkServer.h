@@ -0,0 +1,231 @@
+#pragma once
+/**
+ * @file NetworkServer.h
+ * @brief A LoRaWAN 1.0.x network server stand-in for end-to-end tests: OTAA joins, MIC checks, frame counters, ADR and
+ * downlinks scheduled in RX1 or RX2. It takes uplinks as the gateway heard them and answers with the downlink to send,
+ * if any. NsSocket.h carries that over a local socket to the host radio (HostRadio.cpp).
+ *
+ * AU915, class A, one gateway that hears everything it's given. The application server is a callback: it sees each
+ * uplink, decrypted, and can queue downlinks that go out in the same uplink's RX windows.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "LoRaWanCrypto.h"
+
+#define NS_JOIN_ACCEPT_DELAY1_MS 5000       /**< End of a join request to the accept's RX1. */
+#define NS_JOIN_ACCEPT_DELAY2_MS 6000       /**< ... and RX2. */
+#define NS_RX1_DELAY_MS          1000       /**< End of an uplink to RX1 (RxDelay 1), unless setRxDelay() changes it. */
+#define NS_RX2_DELAY_MS          2000       /**< ... and RX2, always a second after RX1. */
+#define NS_RX2_DATA_RATE         8          /**< AU915 RX2: DR8, SF12 at 500 kHz. */
+#define NS_RX1_DATA_RATE_BASE    8          /**< AU915 RX1 data rate is DR8 + the uplink's (RX1DROffset 0). */
+#define NS_SCHEDULE_MARGIN_MS    200        /**< A downlink must be ready this long before its window opens. */
+#define NS_NET_ID                0x000013UL /**< NetID given in join accepts. */
+#define NS_DEV_ADDR_BASE         0x260B0000UL /**< DevAddrs are handed out from here. */
+#define NS_MAX_FCNT_GAP          16384      /**< Uplinks skipping more frames than this are dropped. */
+#define NS_ADR_HISTORY           20         /**< Uplinks the ADR decision is taken over. */
+#define NS_ADR_MARGIN_DB         10         /**< Installation margin kept by ADR. */
+#define NS_ADR_MAX_DATA_RATE     5          /**< Fastest data rate ADR gives (DR5, SF7 at 125 kHz). */
+#define NS_ADR_MAX_TX_POWER      10         /**< Lowest power ADR gives (TX_POWER_10, 10 dBm). */
+
+/** @brief LoRaWAN MAC commands handled. */
+enum class LORAWAN_MAC : uint8_t {
+    LINK_CHECK = 0x02, /**< Req: no payload. Ans: [margin][gateway count]. */
+    LINK_ADR = 0x03,   /**< Req: [DR << 4 | TXPower][ChMask (2)][Redundancy]. Ans: [status]. */
+    DEV_STATUS = 0x06, /**< Req: no payload. Ans: [battery][margin]. */
+};
+
+/** @brief LoRaWAN message types, the top 3 bits of the MHDR. */
+enum class LORAWAN_MTYPE : uint8_t {
+    JOIN_REQUEST = 0x00,
+    JOIN_ACCEPT = 0x20,
+    UNCONFIRMED_UP = 0x40,
+    UNCONFIRMED_DOWN = 0x60,
+    CONFIRMED_UP = 0x80,
+    CONFIRMED_DOWN = 0xA0,
+};
+
+#define LORAWAN_FCTRL_ADR    0x80
+#define LORAWAN_FCTRL_ACK    0x20
+#define LORAWAN_FOPTS_MAX    15
+
+/** @brief An uplink as the gateway heard it. */
+struct nsRadioFrame {
+    uint64_t time_ms;         /**< Virtual time the uplink started. */
+    uint32_t time_on_air_ms;
+    uint8_t data_rate;
+    int16_t rssi;
+    int8_t snr;
+    std::vector<uint8_t> phy; /**< MHDR to MIC. */
+};
+
+/** @brief The answer to an uplink. */
+struct nsDownlink {
+    bool present;             /**< False if nothing is sent. */
+    uint32_t delay_ms;        /**< From the end of the uplink: RX1 or RX2. */
+    uint8_t data_rate;
+    std::vector<uint8_t> phy;
+};
+
+/** @brief A data uplink that passed the checks, decrypted. */
+struct nsUplink {
+    uint64_t dev_eui;
+    uint32_t dev_addr;
+    uint32_t fcnt;            /**< Full 32 bit counter. */
+    uint8_t port;             /**< 0 if there was no FRMPayload. */
+    std::vector<uint8_t> data;
+    bool confirmed;
+    bool adr;                 /**< The device has ADR on. */
+    uint8_t data_rate;
+    int8_t snr;
+    uint64_t rx_ms;           /**< Virtual time the uplink ended. */
+    uint32_t decode_us;       /**< Wall time spent checking & decrypting it. */
+};
+
+/** @brief A join accepted. */
+struct nsJoin {
+    uint64_t dev_eui;
+    uint16_t dev_nonce;
+    uint32_t dev_addr;
+    uint64_t request_ms;      /**< Virtual time the request started. */
+    uint64_t accept_ms;       /**< Virtual time the accept is sent. */
+};
+
+/** @brief Counters. */
+struct nsStats {
+    uint32_t joins;
+    uint32_t join_rejects;    /**< Unknown device, bad MIC or a DevNonce used before. */
+    uint32_t uplinks;
+    uint32_t bad_mics;
+    uint32_t replays;         /**< Frame counter not above the last one, or too far ahead. */
+    uint32_t unknown;         /**< DevAddr with no session. */
+    uint32_t malformed;
+    uint32_t downlinks;
+    uint32_t late_downlinks;  /**< Queued downlinks that missed both windows and wait for the next uplink. */
+    uint32_t adr_requests;    /**< LinkADRReq sent. */
+};
+
+/** @brief A device's session, for tests. */
+struct nsSession {
+    uint32_t dev_addr;
+    uint8_t nwk_s_key[LORAWAN_KEY_SIZE];
+    uint8_t app_s_key[LORAWAN_KEY_SIZE];
+    uint32_t fcnt_up;         /**< Last uplink counter. */
+    uint32_t fcnt_down;       /**< Next downlink counter. */
+    uint8_t data_rate;        /**< Set by the last LinkADRReq the device accepted, else the last uplink's. */
+    uint8_t tx_power;
+    uint32_t rx1_delay_ms;    /**< From the RxDelay in its join accept. */
+};
+
+/**
+ * @brief EUI as a number, from the MSB first bytes used in OTAA_keys.h.
+ */
+uint64_t nsEui(const uint8_t eui[8]);
+
+/**
+ * @brief The network & application server for any number of OTAA devices. Thread safe.
+ */
+class networkServer {
+  public:
+    /**
+     * @brief Adds a device that may join. Keys are MSB first, as in OTAA_keys.h.
+     */
+    void addDevice(const uint8_t dev_eui[8], const uint8_t app_eui[8], const uint8_t app_key[LORAWAN_KEY_SIZE]);
+
+    /**
+     * @brief Drops a device's session, as if its network state was lost: its uplinks are unknown until it joins again.
+     * The DevNonces it has used are kept.
+     */
+    void forgetSession(uint64_t dev_eui);
+
+    /**
+     * @brief Queues an application downlink, sent in the RX windows of the device's next uplink.
+     */
+    void queueDownlink(uint64_t dev_eui, uint8_t port, const std::vector<uint8_t> &data, bool confirmed = false);
+
+    /**
+     * @brief The application server: called with each uplink that passes the checks. Downlinks it queues go out in that
+     * uplink's RX windows. Called from handleUplink() without the lock held.
+     */
+    void onUplink(const std::function<void(const nsUplink &)> &handler);
+
+    /**
+     * @brief Round trip time between the gateway & the server, taken off the time left to answer in RX1 / RX2. With
+     * more than the RX1 delay less NS_SCHEDULE_MARGIN_MS, downlinks go in RX2.
+     */
+    void setBackhaulMs(uint32_t round_trip_ms);
+
+    /**
+     * @brief The RxDelay (1 - 15 s) given in join accepts from now on. Joined devices keep the one they were given.
+     */
+    void setRxDelay(uint8_t seconds);
+
+    /**
+     * @brief Handles an uplink (join request or data frame).
+     * @return The downlink to send, if any.
+     */
+    nsDownlink handleUplink(const nsRadioFrame &frame);
+
+    std::vector<nsUplink> uplinks(void);
+    std::vector<nsJoin> joins(void);
+    void stats(nsStats *stats);
+
+    /**
+     * @brief Copies a device's session.
+     * @return False if it hasn't joined.
+     */
+    bool session(uint64_t dev_eui, nsSession *session);
+
+  private:
+    struct queuedDownlink {
+        uint8_t port;
+        std::vector<uint8_t> data;
+        bool confirmed;
+    };
+    struct device {
+        uint64_t dev_eui;
+        uint64_t app_eui;
+        uint8_t app_key[LORAWAN_KEY_SIZE];
+        std::set<uint16_t> dev_nonces; // every DevNonce used, they can't be reused
+        bool joined;
+        bool has_uplink;               // fcnt_up is valid
+        nsSession session;
+        std::deque<queuedDownlink> queue;
+        std::vector<uint8_t> mac_answers; // MAC commands for the next downlink's FOpts
+        std::deque<int8_t> snr_history;
+        bool adr_pending;              // a LinkADRReq is waiting for its answer
+        uint8_t adr_data_rate;
+        uint8_t adr_tx_power;
+    };
+
+    nsDownlink handleJoin(const nsRadioFrame &frame);
+    nsDownlink handleData(const nsRadioFrame &frame, std::unique_lock<std::mutex> &lock);
+    void handleMacCommands(device *dev, const uint8_t *commands, uint8_t length, const nsRadioFrame &frame);
+    void runAdr(device *dev);
+    bool rxWindow(uint32_t delay1_ms, uint32_t delay2_ms, uint32_t processing_ms, uint32_t *delay_ms);
+    nsDownlink buildDownlink(device *dev, const nsRadioFrame &frame, bool ack, uint32_t processing_ms);
+
+    std::mutex mutex;
+    std::map<uint64_t, device> devices;     // by DevEUI
+    std::map<uint32_t, uint64_t> dev_addrs; // DevAddr to DevEUI
+    uint32_t next_dev_addr = NS_DEV_ADDR_BASE;
+    uint32_t app_nonce = 0x000001;
+    uint32_t backhaul_ms = 0;
+    uint8_t rx_delay_s = NS_RX1_DELAY_MS / 1000;
+    std::function<void(const nsUplink &)> uplink_handler;
+    std::vector<nsUplink> uplink_log;
+    std::vector<nsJoin> join_log;
+    nsStats counters = {};
+};
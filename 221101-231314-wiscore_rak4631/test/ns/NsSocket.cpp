@@ -0,0 +1,230 @@
+/**
+ * @file NsSocket.cpp
+ * @brief The loopback link between the host radio and the network server, see NsSocket.h.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "NsSocket.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+static bool sendAll(int fd, const uint8_t *data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = ::send(fd, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        length -= sent;
+    }
+    return true;
+}
+
+static bool receiveAll(int fd, uint8_t *data, size_t length) {
+    while (length > 0) {
+        ssize_t got = ::recv(fd, data, length, 0);
+        if (got <= 0) {
+            return false;
+        }
+        data += got;
+        length -= got;
+    }
+    return true;
+}
+
+bool nsSocketSend(int fd, uint8_t type, const std::vector<uint8_t> &body) {
+    std::vector<uint8_t> message(5);
+    lorawanPutLe(&message[0], body.size() + 1, 4);
+    message[4] = type;
+    message.insert(message.end(), body.begin(), body.end());
+    return sendAll(fd, message.data(), message.size());
+}
+
+bool nsSocketReceive(int fd, uint8_t *type, std::vector<uint8_t> *body) {
+    uint8_t header[5];
+    if (!receiveAll(fd, header, sizeof(header))) {
+        return false;
+    }
+    uint32_t length = lorawanGetLe(header, 4);
+    if ((length == 0) || (length > NS_SOCKET_MAX_SIZE)) {
+        return false;
+    }
+    *type = header[4];
+    body->resize(length - 1);
+    return body->empty() || receiveAll(fd, body->data(), body->size());
+}
+
+// SERVER
+
+nsSocketServer::~nsSocketServer() { stop(); }
+
+bool nsSocketServer::start(networkServer *server, uint16_t port) {
+    this->server = server;
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    socklen_t address_length = sizeof(address);
+    if ((bind(listener, (sockaddr *)&address, sizeof(address)) != 0) || (listen(listener, 4) != 0) ||
+        (getsockname(listener, (sockaddr *)&address, &address_length) != 0)) {
+        ::close(listener);
+        listener = -1;
+        return false;
+    }
+    bound_port = ntohs(address.sin_port);
+    running = true;
+    acceptor = std::thread([this] { acceptLoop(); });
+    return true;
+}
+
+void nsSocketServer::stop(void) {
+    if (!running.exchange(false)) {
+        return;
+    }
+    // wakes accept() & recv()
+    shutdown(listener, SHUT_RDWR);
+    ::close(listener);
+    listener = -1;
+    acceptor.join();
+    std::vector<std::thread> finishing;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int connection : connections) {
+            shutdown(connection, SHUT_RDWR);
+        }
+        finishing.swap(workers);
+    }
+    for (std::thread &worker : finishing) {
+        worker.join();
+    }
+}
+
+void nsSocketServer::acceptLoop(void) {
+    while (running) {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            continue;
+        }
+        int no_delay = 1;
+        setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!running) {
+            ::close(connection);
+            break;
+        }
+        connections.push_back(connection);
+        workers.emplace_back([this, connection] { serve(connection); });
+    }
+}
+
+void nsSocketServer::serve(int connection) {
+    uint8_t type;
+    std::vector<uint8_t> body;
+    while (nsSocketReceive(connection, &type, &body)) {
+        if ((type != NS_SOCKET_UPLINK) || (body.size() < 16)) {
+            break;
+        }
+        nsRadioFrame frame;
+        frame.time_ms = lorawanGetLe(&body[0], 4) | ((uint64_t)lorawanGetLe(&body[4], 4) << 32);
+        frame.time_on_air_ms = lorawanGetLe(&body[8], 4);
+        frame.data_rate = body[12];
+        frame.rssi = (int16_t)lorawanGetLe(&body[13], 2);
+        frame.snr = (int8_t)body[15];
+        frame.phy.assign(body.begin() + 16, body.end());
+        nsDownlink downlink = server->handleUplink(frame);
+
+        std::vector<uint8_t> answer(6);
+        answer[0] = downlink.present;
+        lorawanPutLe(&answer[1], downlink.delay_ms, 4);
+        answer[5] = downlink.data_rate;
+        answer.insert(answer.end(), downlink.phy.begin(), downlink.phy.end());
+        if (!nsSocketSend(connection, NS_SOCKET_ANSWER, answer)) {
+            break;
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    connections.erase(std::remove(connections.begin(), connections.end(), connection), connections.end());
+    ::close(connection);
+}
+
+// CLIENT
+
+nsSocketClient::~nsSocketClient() { close(); }
+
+bool nsSocketClient::connect(const char *address) {
+    close();
+    std::string text = address;
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    sockaddr_in server = {};
+    server.sin_family = AF_INET;
+    server.sin_port = htons((uint16_t)atoi(text.c_str() + colon + 1));
+    if (inet_pton(AF_INET, text.substr(0, colon).c_str(), &server.sin_addr) != 1) {
+        return false;
+    }
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    if (::connect(fd, (sockaddr *)&server, sizeof(server)) != 0) {
+        close();
+        return false;
+    }
+    int no_delay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+    return true;
+}
+
+void nsSocketClient::close(void) {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool nsSocketClient::exchange(const nsRadioFrame &uplink, nsDownlink *answer) {
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<uint8_t> body(16);
+    lorawanPutLe(&body[0], (uint32_t)uplink.time_ms, 4);
+    lorawanPutLe(&body[4], (uint32_t)(uplink.time_ms >> 32), 4);
+    lorawanPutLe(&body[8], uplink.time_on_air_ms, 4);
+    body[12] = uplink.data_rate;
+    lorawanPutLe(&body[13], (uint16_t)uplink.rssi, 2);
+    body[15] = (uint8_t)uplink.snr;
+    body.insert(body.end(), uplink.phy.begin(), uplink.phy.end());
+    uint8_t type;
+    std::vector<uint8_t> reply;
+    if (!nsSocketSend(fd, NS_SOCKET_UPLINK, body) || !nsSocketReceive(fd, &type, &reply) ||
+        (type != NS_SOCKET_ANSWER) || (reply.size() < 6)) {
+        close();
+        return false;
+    }
+    answer->present = reply[0] != 0;
+    answer->delay_ms = lorawanGetLe(&reply[1], 4);
+    answer->data_rate = reply[5];
+    answer->phy.assign(reply.begin() + 6, reply.end());
+    return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+/**
+ * @file NsSocket.h
+ * @brief Carries uplinks from the host radio to a network server (NetworkServer.h) and its answers back, over TCP on
+ * the loopback interface. The radio waits for each answer before virtual time moves on, so nothing runs against the
+ * wall clock: the RX windows are in the answer.
+ *
+ * Messages are [length (4)][type] then the fields, all little endian:
+ * - Uplink (0x01): [start ms (8)][time on air ms (4)][data rate][RSSI (2)][SNR][PHY payload].
+ * - Answer (0x02): [present][delay ms (4)][data rate][PHY payload].
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "NetworkServer.h"
+
+#define NS_SOCKET_UPLINK   0x01
+#define NS_SOCKET_ANSWER   0x02
+#define NS_SOCKET_MAX_SIZE 1024 /**< Longest message, anything longer closes the connection. */
+
+/**
+ * @brief Serves a networkServer on 127.0.0.1, one thread per connection.
+ */
+class nsSocketServer {
+  public:
+    ~nsSocketServer();
+
+    /**
+     * @brief Starts listening.
+     * @param port TCP port, 0 for any free one (see port()).
+     * @return False if the socket couldn't be opened.
+     */
+    bool start(networkServer *server, uint16_t port = 0);
+
+    /**
+     * @brief Closes the listening socket & every connection, and waits for the threads.
+     */
+    void stop(void);
+
+    inline uint16_t port(void) const { return bound_port; };
+
+  private:
+    void acceptLoop(void);
+    void serve(int connection);
+
+    networkServer *server = nullptr;
+    int listener = -1;
+    uint16_t bound_port = 0;
+    std::atomic<bool> running{ false };
+    std::thread acceptor;
+    std::mutex mutex;
+    std::vector<int> connections;
+    std::vector<std::thread> workers;
+};
+
+/**
+ * @brief The radio's end of the link.
+ */
+class nsSocketClient {
+  public:
+    ~nsSocketClient();
+
+    /**
+     * @brief Connects to a server.
+     * @param address "host:port", e.g. "127.0.0.1:1700".
+     */
+    bool connect(const char *address);
+
+    void close(void);
+
+    inline bool connected(void) const { return fd >= 0; };
+
+    /**
+     * @brief Sends an uplink and waits for the answer.
+     * @return False if the link failed; it's then closed.
+     */
+    bool exchange(const nsRadioFrame &uplink, nsDownlink *answer);
+
+  private:
+    int fd = -1;
+};
+
+/**
+ * @brief Writes or reads one message.
+ */
+bool nsSocketSend(int fd, uint8_t type, const std::vector<uint8_t> &body);
+bool nsSocketReceive(int fd, uint8_t *type, std::vector<uint8_t> *body);
@@ -0,0 +1,62 @@
+#include <gtest/gtest.h>
+
+#include "Outbox.h"
+#include "hal/HostHal.h"
+
+// Frames the uplink can't carry must not hold the outbox up
+
+class OutboxTest : public ::testing::Test {
+  protected:
+    void SetUp(void) override {
+        hostFlashErase();
+        outbox.init();
+    }
+    void TearDown(void) override { hostFlashErase(); }
+
+    bool push(uint8_t port, uint8_t length, OUTBOX_PRIORITY priority = OUTBOX_PRIORITY::ROUTINE) {
+        uint8_t data[OUTBOX_MAX_FRAME_LENGTH];
+        memset(data, port, length);
+        return outbox.push(port, data, length, priority);
+    }
+
+    Outbox outbox;
+    uint8_t buffer[PAYLOAD_BUFFER_SIZE] = {};
+    lmh_app_data_t frame = { buffer, 0, 0, 0, 0 };
+};
+
+TEST_F(OutboxTest, DropsFramesLongerThanTheDataRateCarries) {
+    // a frame queued at a fast data rate, then the network moves the device to DR2 (11 bytes)
+    ASSERT_TRUE(push(59, 40));
+    EXPECT_FALSE(outbox.prepareFrame(&frame, 11));
+    EXPECT_EQ(outbox.pending(), 1u);
+    EXPECT_EQ(outbox.dropLongerThan(11), 1u);
+    EXPECT_EQ(outbox.pending(), 0u);
+    EXPECT_EQ(outbox.dropped(), 1u);
+    EXPECT_FALSE(outbox.prepareFrame(&frame, 11));
+
+    // and stays dropped after a reset
+    outbox.init();
+    EXPECT_EQ(outbox.pending(), 0u);
+}
+
+TEST_F(OutboxTest, SendsAFrameTooLongToBatchOnItsOwn) {
+    // 48 bytes fit in 51 but not with the batch headers
+    ASSERT_TRUE(push(10, 48));
+    ASSERT_TRUE(push(10, 5));
+    ASSERT_TRUE(outbox.prepareFrame(&frame, OUTBOX_BATCH_MAX_LENGTH));
+    EXPECT_EQ(frame.port, 10);
+    EXPECT_EQ(frame.buffsize, 48);
+    outbox.markFrameSent();
+    EXPECT_EQ(outbox.pending(), 1u);
+
+    // the rest batch as before
+    ASSERT_TRUE(push(1, 5, OUTBOX_PRIORITY::ALERT));
+    ASSERT_TRUE(outbox.prepareFrame(&frame, OUTBOX_BATCH_MAX_LENGTH));
+    EXPECT_EQ(frame.port, OUTBOX_BATCH_PORT);
+    EXPECT_EQ(frame.buffer[0], 2);
+    // alert first
+    EXPECT_EQ(frame.buffer[OUTBOX_BATCH_HEADER], 1);
+    outbox.markFrameSent();
+    EXPECT_EQ(outbox.pending(), 0u);
+    EXPECT_EQ(outbox.dropped(), 0u);
+}
@@ -0,0 +1,103 @@
+/**
+ * @file payload_writer_bench.cc
+ * @brief Host microbenchmarks for the payload encode path: the old open-coded encode loop and snprintf hex log against
+ * PayloadWriter and formatHex(). Not run by ctest, build the payload_writer_bench target and run it directly.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "LoRaWAN_functs.h" // PAYLOAD_BUFFER_SIZE
+#include "PayloadWriter.h"
+
+#define ITERATIONS 200000
+
+static volatile uint8_t sink;       // stops the compiler dropping the work
+static volatile int source = 3700; // stops the compiler folding the inputs
+
+/**
+ * @brief The encode loop encodeDataWithSchema() used before PayloadWriter (no bounds check).
+ */
+static uint8_t legacyEncode(int data_to_encode, int data_size, uint8_t *payload_buffer, uint8_t buf_pos) {
+    uint8_t i = 0;
+    uint8_t j = (data_size - 1);
+    for (; i < data_size; i++, j--) {
+        uint8_t bitshift = j * 8;
+        if (j > 0) {
+            payload_buffer[buf_pos + i] = (uint8_t)((data_to_encode & (0xFF << bitshift)) >> bitshift);
+        } else {
+            payload_buffer[buf_pos + i] = (uint8_t)(data_to_encode & 0xFF);
+        }
+    }
+    return (buf_pos + i);
+}
+
+/**
+ * @brief The hex log fillPayload() used before formatHex(), with strlen() standing in for the self-referencing "%s".
+ */
+static void legacyHex(const uint8_t *data, uint8_t length, char *out, size_t out_size) {
+    out[0] = '\0';
+    for (int b = 0; b < length; b++) {
+        size_t used = strlen(out);
+        snprintf(out + used, out_size - used, "%02X ", data[b]);
+    }
+}
+
+template <typename F> static void bench(const char *name, F work) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        work(i);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%-24s %8.1f ns/op\n", name, elapsed.count() / ITERATIONS);
+}
+
+int main() {
+    uint8_t buffer[PAYLOAD_BUFFER_SIZE];
+    char hex[3 * PAYLOAD_BUFFER_SIZE + 1];
+
+    // PORT9 sized frame: 2 + 2 + 1 + 4 + 4 bytes
+    bench("encode legacy", [&](int i) {
+        uint8_t length = legacyEncode(source + (i & 7), 2, buffer, 0);
+        length = legacyEncode(source - 4934, 2, buffer, length);
+        length = legacyEncode(128, 1, buffer, length);
+        length = legacyEncode(101325, 4, buffer, length);
+        length = legacyEncode(52000, 4, buffer, length);
+        sink = buffer[length - 1];
+    });
+    bench("encode PayloadWriter", [&](int i) {
+        PayloadWriter writer(buffer, sizeof(buffer));
+        writer.putBE(source + (i & 7), 2);
+        writer.putBE(source - 4934, 2);
+        writer.putBE(128, 1);
+        writer.putBE(101325, 4);
+        writer.putBE(52000, 4);
+        sink = buffer[writer.length() - 1];
+    });
+
+    for (uint8_t i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = i * 37;
+    }
+    const uint8_t lengths[] = { 13, 51, PAYLOAD_BUFFER_SIZE };
+    for (uint8_t length : lengths) {
+        char name[32];
+        snprintf(name, sizeof(name), "hex snprintf (%u B)", length);
+        bench(name, [&](int) {
+            legacyHex(buffer, length, hex, sizeof(hex));
+            sink = hex[0];
+        });
+        snprintf(name, sizeof(name), "hex formatHex (%u B)", length);
+        bench(name, [&](int) {
+            formatHex(buffer, length, hex, sizeof(hex));
+            sink = hex[0];
+        });
+    }
+    return 0;
+}
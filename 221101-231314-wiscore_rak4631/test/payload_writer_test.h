@@ -0,0 +1,47 @@
+#include <string.h>
+
+#include "../lib/PayloadWriter/src/PayloadWriter.h"
+
+TEST(PayloadWriterTest, GoldenVector) {
+    uint8_t buffer[16];
+    PayloadWriter writer(buffer, sizeof(buffer));
+    EXPECT_TRUE(writer.putU16(3700));            // battery mV
+    EXPECT_TRUE(writer.putBE(-1234, 2));         // temperature x100
+    EXPECT_TRUE(writer.putU8(0x80));             // humidity
+    EXPECT_TRUE(writer.putU32(101325));          // pressure
+    EXPECT_TRUE(writer.putBE(0x7F7F7F7F, 3));    // invalid 3 byte signed
+    const uint8_t expected[] = { 0x0E, 0x74, 0xFB, 0x2E, 0x80, 0x00, 0x01, 0x8B, 0xCD, 0x7F, 0x7F, 0x7F };
+    ASSERT_EQ(writer.length(), sizeof(expected));
+    EXPECT_EQ(memcmp(buffer, expected, sizeof(expected)), 0);
+    EXPECT_FALSE(writer.overflowed());
+    EXPECT_EQ(writer.remaining(), 4);
+}
+
+TEST(PayloadWriterTest, OverflowWritesNothingAndSticks) {
+    uint8_t buffer[8] = {};
+    PayloadWriter writer(buffer, 5, 2);
+    EXPECT_TRUE(writer.putU16(0xABCD));
+    EXPECT_FALSE(writer.putU16(0x1234)); // 1 byte left
+    EXPECT_TRUE(writer.overflowed());
+    EXPECT_FALSE(writer.putU8(0x56));    // would have fitted, but the payload is already incomplete
+    EXPECT_EQ(writer.length(), 4);
+    EXPECT_EQ(writer.remaining(), 0);
+    const uint8_t expected[8] = { 0x00, 0x00, 0xAB, 0xCD, 0x00, 0x00, 0x00, 0x00 };
+    EXPECT_EQ(memcmp(buffer, expected, sizeof(expected)), 0);
+    EXPECT_EQ(writer.reserve(0), nullptr);
+}
+
+TEST(PayloadWriterTest, FormatHex) {
+    const uint8_t data[] = { 0x00, 0x0A, 0xF1, 0xFF };
+    char out[13];
+    EXPECT_EQ(formatHex(data, sizeof(data), out, sizeof(out)), 12u);
+    EXPECT_STREQ(out, "00 0A F1 FF ");
+
+    // truncated to the last whole byte that fits
+    char small[8];
+    EXPECT_EQ(formatHex(data, sizeof(data), small, sizeof(small)), 6u);
+    EXPECT_STREQ(small, "00 0A ");
+
+    EXPECT_EQ(formatHex(data, 0, out, sizeof(out)), 0u);
+    EXPECT_STREQ(out, "");
+}
@@ -0,0 +1,23 @@
+#include "../lib/PortRotation/src/PortRotation.h"
+
+TEST(PortRotationTest, TimedPortsStayOnScheduleAfterResume) {
+    const portRotationEntry schedule[] = { { PORT10, 1, 0 }, { PORT9, 0, 60UL * 60 * 1000 } };
+    const uint32_t minute = 60UL * 1000;
+    portRotation rotation(schedule, 2);
+    rotation.startFrame(0);
+    EXPECT_EQ(rotation.dueMask(), 0x03); // everything on the first frame
+    rotation.startFrame(10 * minute);
+    EXPECT_EQ(rotation.dueMask(), 0x01);
+    portRotationState state;
+    rotation.save(&state, 20 * minute);
+
+    // asleep for 15 min, then millis() starts again from 0: PORT9 was sent 35 min before the wake
+    portRotation resumed(schedule, 2);
+    resumed.resume(&state, 15 * minute);
+    resumed.startFrame(1000);
+    EXPECT_EQ(resumed.dueMask(), 0x01);
+    resumed.startFrame(24 * minute);
+    EXPECT_EQ(resumed.dueMask(), 0x01);
+    resumed.startFrame(25 * minute);
+    EXPECT_EQ(resumed.dueMask(), 0x03);
+}
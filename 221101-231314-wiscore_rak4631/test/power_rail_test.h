@@ -0,0 +1,70 @@
+#include "../lib/PowerRails/src/PowerRail.h"
+
+static int rail_switches = 0; // on +1, off -1, so it's the rail's level if balanced
+static void countRailSwitch(bool on) { rail_switches += on ? 1 : -1; }
+
+TEST(PowerRailTest, SharedUntilLastRelease) {
+    const powerRailConfig config = { "test", 5000, 0, 500, 0 };
+    powerRail rail(&config, countRailSwitch);
+    rail_switches = 0;
+    EXPECT_EQ(rail.acquire(1000), 5000u);
+    EXPECT_EQ(rail_switches, 1);
+    // a second user waits out what's left of the warm-up and doesn't switch it again
+    EXPECT_EQ(rail.acquire(3000), 3000u);
+    rail.release(7000);
+    EXPECT_TRUE(rail.isOn());
+    rail.release(8000);
+    EXPECT_FALSE(rail.isOn());
+    EXPECT_EQ(rail_switches, 0);
+    rail.release(8000); // extra release is ignored
+
+    // on again within the minimum off time waits for it
+    EXPECT_EQ(rail.acquire(8200), 300u + 5000u);
+    EXPECT_FALSE(rail.isOn());
+    EXPECT_EQ(rail.service(8300), 200u);
+    EXPECT_EQ(rail.service(8500), POWER_RAIL_IDLE);
+    EXPECT_TRUE(rail.isOn());
+    rail.release(9500);
+
+    powerRailStats stats;
+    rail.stats(&stats, 9500);
+    EXPECT_FALSE(stats.on);
+    EXPECT_EQ(stats.on_time_ms, 7000u + 1000u);
+    EXPECT_EQ(stats.switch_ons, 2u);
+    EXPECT_TRUE(rail.isIdle());
+}
+
+TEST(PowerRailTest, KeepsWarmWhenCheaper) {
+    const powerRailConfig config = { "test", 5000, 2000, 0, 6000 };
+    powerRail rail(&config, countRailSwitch);
+    rail_switches = 0;
+    rail.acquire(0);
+    // released inside the minimum on time, it stays on until that's over
+    rail.release(1000, POWER_RAIL_IDLE);
+    EXPECT_TRUE(rail.isOn());
+    EXPECT_EQ(rail.service(1500), 500u);
+    rail.service(2000);
+    EXPECT_FALSE(rail.isOn());
+
+    // next use in 4 s is cheaper kept on, and it's already warm then
+    rail.acquire(10000);
+    rail.release(20000, 4000);
+    EXPECT_TRUE(rail.isOn());
+    EXPECT_EQ(rail.acquire(24000), 0u);
+    // next use in 60 s isn't
+    rail.release(30000, 60000);
+    EXPECT_FALSE(rail.isOn());
+    // a use that doesn't come still switches it off
+    rail.acquire(40000);
+    rail.release(50000, 1000);
+    EXPECT_EQ(rail.service(50000), 7000u);
+    rail.service(57000);
+    EXPECT_FALSE(rail.isOn());
+    EXPECT_EQ(rail_switches, 0);
+
+    powerRailStats stats;
+    rail.stats(&stats, 57000);
+    EXPECT_EQ(stats.on_time_ms, 2000u + 20000u + 17000u);
+    EXPECT_EQ(stats.switch_ons, 3u);
+    EXPECT_EQ(stats.kept_warm, 2u);
+}
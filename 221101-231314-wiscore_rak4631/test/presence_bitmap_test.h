@@ -0,0 +1,106 @@
+#include "../lib/PortSchema/src/PresenceBitmap.h"
+
+#include <vector>
+
+// Presence frames leave out what the decoder already knows, and keyframes bound how long it can be wrong
+
+#define PRESENCE_BME680 0x1E /**< Temperature, humidity, pressure & gas: PORT9 less the battery. */
+
+class PresenceBitmapTest : public ::testing::Test {
+  protected:
+    void SetUp(void) override {
+        data = {};
+        data.battery_mv = { 3900, true };
+        data.temperature = { 21.5f, true };
+        data.humidity = { 60, true };
+        data.pressure = { 101300, true };
+        data.gas_resist = { 50000, true };
+    }
+
+    std::vector<uint8_t> encode(bool commit = true) {
+        uint8_t buffer[PAYLOAD_BUFFER_SIZE] = {};
+        PayloadWriter writer(buffer, sizeof(buffer));
+        uint8_t port_number = 0;
+        EXPECT_TRUE(encoder.encode(&PORT9, &data, &writer, &port_number));
+        EXPECT_EQ(port_number, 9 + PRESENCE_PORT_OFFSET);
+        if (commit) {
+            encoder.commit();
+        }
+        return std::vector<uint8_t>(buffer, buffer + writer.length());
+    }
+
+    void deadBme680(void) {
+        data.temperature.is_valid = false;
+        data.humidity.is_valid = false;
+        data.pressure.is_valid = false;
+        data.gas_resist.is_valid = false;
+    }
+
+    presenceEncoder encoder;
+    sensorData data;
+};
+
+TEST_F(PresenceBitmapTest, OmitsUnchangedFields) {
+    std::vector<uint8_t> frame = encode();
+    EXPECT_EQ(frame[0], 0x1F);
+    // battery within its 20 mV tolerance, a new temperature
+    data.battery_mv.value += 15;
+    data.temperature.value += 1;
+    frame = encode();
+    ASSERT_FALSE(frame.empty());
+    EXPECT_EQ(frame[0], 1 << (uint8_t)PRESENCE_FIELD::TEMPERATURE);
+    // compared with what was sent, not the last reading: the drift adds up to a change
+    data.battery_mv.value += 15;
+    frame = encode();
+    EXPECT_EQ(frame, std::vector<uint8_t>({ 0x01, 0x0F, 0x5A })); // 3930 mV
+    // nothing changed, just the bitmap
+    EXPECT_EQ(encode(), std::vector<uint8_t>({ 0x00 }));
+}
+
+TEST_F(PresenceBitmapTest, InvalidMaskOnlyWhenAFieldGoesInvalid) {
+    encode();
+    deadBme680();
+    EXPECT_EQ(encode(), std::vector<uint8_t>({ PRESENCE_INVALID_FOLLOWS, PRESENCE_BME680 }));
+    // still invalid is unchanged, so only the new battery voltage goes
+    data.battery_mv.value = 3800;
+    EXPECT_EQ(encode(), std::vector<uint8_t>({ 0x01, 0x0E, 0xD8 }));
+    EXPECT_EQ(encode(), std::vector<uint8_t>({ 0x00 }));
+    // back again, it's sent
+    data.temperature.is_valid = true;
+    std::vector<uint8_t> frame = encode();
+    ASSERT_FALSE(frame.empty());
+    EXPECT_EQ(frame[0], 1 << (uint8_t)PRESENCE_FIELD::TEMPERATURE);
+}
+
+TEST_F(PresenceBitmapTest, KeyframeEveryTwelveFrames) {
+    deadBme680();
+    // the first frame is a keyframe
+    EXPECT_EQ(encode(), std::vector<uint8_t>({ PRESENCE_INVALID_FOLLOWS | 0x01, PRESENCE_BME680, 0x0F, 0x3C }));
+    for (uint8_t i = 1; i < PRESENCE_KEYFRAME_INTERVAL; i++) {
+        EXPECT_EQ(encode(), std::vector<uint8_t>({ 0x00 })) << "frame " << (int)i;
+    }
+    // every valid field, and the invalid ones marked again
+    EXPECT_EQ(encode(), std::vector<uint8_t>({ PRESENCE_INVALID_FOLLOWS | 0x01, PRESENCE_BME680, 0x0F, 0x3C }));
+    EXPECT_EQ(encode(), std::vector<uint8_t>({ 0x00 }));
+}
+
+TEST_F(PresenceBitmapTest, CommitAndInvalidate) {
+    encode();
+    // a frame that isn't committed (not sent yet) doesn't change what the next one is compared with
+    data.battery_mv.value = 3800;
+    EXPECT_EQ(encode(false), std::vector<uint8_t>({ 0x01, 0x0E, 0xD8 }));
+    EXPECT_EQ(encode(), std::vector<uint8_t>({ 0x01, 0x0E, 0xD8 }));
+    EXPECT_EQ(encode(), std::vector<uint8_t>({ 0x00 }));
+
+    // a frame queued out of order: the next is full
+    encoder.invalidate();
+    std::vector<uint8_t> frame = encode();
+    ASSERT_FALSE(frame.empty());
+    EXPECT_EQ(frame[0], 0x1F);
+
+    // and the keyframe count restarts from it
+    for (uint8_t i = 1; i < PRESENCE_KEYFRAME_INTERVAL; i++) {
+        EXPECT_EQ(encode(), std::vector<uint8_t>({ 0x00 })) << "frame " << (int)i;
+    }
+    EXPECT_EQ(encode()[0], 0x1F);
+}
@@ -0,0 +1,344 @@
+/**
+ * @file FirmwareReplay.cpp
+ * @brief Replays a trace through the whole firmware in a forked process, see FirmwareReplay.h.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include "FirmwareReplay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "HostHal.h"
+#include "PowerRails.h"
+#include "SensorHelper.h"
+#include "WallClock.h"
+
+void setup(void);
+void loop(void);
+
+// main.cpp
+extern deviceConfig device_config;
+extern int lorawan_app_interval;
+
+#define REPLAY_BATTERY_MV     3900.0f
+#define REPLAY_UNIX_START_S   1667260800UL /**< The application server's clock at virtual time 0. */
+#define REPLAY_ADC_MV_PER_LSB (3300.0f / 1024) /**< TurbidityLevel's VDD/4 reference at 10 bits: raw count to mV. */
+#define REPLAY_RUN_CHUNK_MS   (24UL * 60 * 60 * 1000) /**< Longest hostRunUntil() call. */
+
+/**
+ * @brief The application server: answers time requests (see the WallClock README) with the time the request ended.
+ */
+static void answerTimeRequest(const hostUplink &uplink) {
+    if ((uplink.port != CLOCK_SYNC_PORT) || (uplink.data.size() < 2)) {
+        return;
+    }
+    uint64_t unix_ms = REPLAY_UNIX_START_S * 1000ULL + uplink.time_ms + uplink.time_on_air_ms;
+    uint32_t seconds = (uint32_t)(unix_ms / 1000);
+    uint16_t ms = (uint16_t)(unix_ms % 1000);
+    hostRadioQueueDownlink(CLOCK_SYNC_PORT, { CLOCK_SYNC_VERSION, uplink.data[1], (uint8_t)(seconds >> 24),
+                                              (uint8_t)(seconds >> 16), (uint8_t)(seconds >> 8), (uint8_t)seconds,
+                                              (uint8_t)(ms >> 8), (uint8_t)ms });
+}
+
+static bool sameConfig(const deviceConfig &a, const deviceConfig &b) {
+    return (a.normal_interval_ms == b.normal_interval_ms) && (a.active_interval_ms == b.active_interval_ms) &&
+           (a.trigger_ntu == b.trigger_ntu) && (a.turbidity_samples == b.turbidity_samples) &&
+           (a.tx_power == b.tx_power) && (a.active_cycles == b.active_cycles) &&
+           (a.compression_dntu == b.compression_dntu) && (a.detector_slack_dsigma == b.detector_slack_dsigma) &&
+           (a.detector_threshold_dsigma == b.detector_threshold_dsigma);
+}
+
+/**
+ * @brief Boots the firmware on a trace and runs it to the end. Once per process.
+ */
+static replayResult replayTrace(const char *name, turbidityTrace *trace, const replayOptions &options,
+                                std::vector<float> *latencies_s) {
+    replayResult result = {};
+    auto start = std::chrono::steady_clock::now();
+    const uint64_t lead_in_ms = options.lead_in_ms;
+    hostAdcSet(BATTERY_PIN, REPLAY_BATTERY_MV / BATTERY_COMPENSATION_FACTOR);
+    hostAdcSource(TURBIDITY_PIN, [&](uint64_t now_ms) {
+        if (hostPinLevel(SENSOR_RAIL_PIN) != HIGH) {
+            return 0.0f;
+        }
+        float value = trace->valueAt((now_ms > lead_in_ms) ? now_ms - lead_in_ms : 0);
+        return options.millivolts ? value : value * REPLAY_ADC_MV_PER_LSB;
+    });
+    hostRadioOnUplink(answerTimeRequest);
+    energyModel energy(options.energy);
+    FILE *events = nullptr;
+    if (!options.events_path.empty()) {
+        events = fopen(options.events_path.c_str(), "w");
+        if (events == nullptr) {
+            snprintf(result.error, sizeof(result.error), "can't write %s", options.events_path.c_str());
+            return result;
+        }
+        fprintf(events, "time_ms,type,pin,level,data_rate,tx_power,length,duration_ms\n");
+    }
+    bool tracing = false;
+    hostOnPowerEvent([&](const hostPowerEvent &event) {
+        energy.add(event);
+        if ((events != nullptr) && tracing) {
+            // in trace time, like the events & triggers
+            fprintf(events, "%llu,%u,%u,%u,%u,%u,%u,%u\n", (unsigned long long)(event.time_ms - lead_in_ms),
+                    (unsigned)event.type, (unsigned)event.pin, event.level, event.data_rate, event.tx_power,
+                    event.length, (unsigned)event.duration_ms);
+        }
+    });
+    if (!options.config_tlvs.empty()) {
+        std::vector<uint8_t> command = { DEVICE_CONFIG_VERSION, 1 };
+        command.insert(command.end(), options.config_tlvs.begin(), options.config_tlvs.end());
+        hostRadioQueueDownlink(DEVICE_CONFIG_PORT, command);
+    }
+    hostBoot(setup, loop);
+    hostRunFor(options.lead_in_ms);
+    if (!sameConfig(device_config, options.device)) {
+        snprintf(result.error, sizeof(result.error), "the config downlink wasn't applied in the lead-in");
+        return result;
+    }
+    if (device_config.active_interval_ms == device_config.normal_interval_ms) {
+        snprintf(result.error, sizeof(result.error), "active & normal intervals are the same, triggers can't be seen");
+        return result;
+    }
+
+    // watched every time the firmware blocks
+    size_t first_uplink = hostRadioUplinks().size();
+    energy.begin(hostNowMs());
+    tracing = true;
+    std::vector<std::pair<uint64_t, uint64_t>> active; // (trigger, end) in trace time
+    bool in_event = (uint32_t)lorawan_app_interval == device_config.active_interval_ms;
+    if (in_event) {
+        active.push_back({ 0, UINT64_MAX });
+    }
+    auto watch = [&] {
+        uint64_t now_ms = hostNowMs();
+        bool now_in_event = (uint32_t)lorawan_app_interval == device_config.active_interval_ms;
+        if (now_in_event && !in_event) {
+            active.push_back({ now_ms - lead_in_ms, UINT64_MAX });
+        } else if (!now_in_event && in_event) {
+            active.back().second = now_ms - lead_in_ms;
+        }
+        in_event = now_in_event;
+        return false;
+    };
+    for (uint64_t left_ms = trace->durationMs(); left_ms > 0;) {
+        uint32_t run_ms = (uint32_t)std::min<uint64_t>(left_ms, REPLAY_RUN_CHUNK_MS);
+        hostRunUntil(watch, run_ms);
+        left_ms -= run_ms;
+    }
+    watch();
+    energy.finish(hostNowMs());
+    hostOnPowerEvent(nullptr);
+    if (events != nullptr) {
+        fclose(events);
+    }
+    result.energy = energy.report();
+    result.hours = trace->durationMs() / 3.6e6;
+
+    // events & triggers
+    result.events = trace->events.size();
+    result.triggers = active.size();
+    for (const traceEvent &event : trace->events) {
+        bool detected = false;
+        for (const auto &span : active) {
+            if ((span.first <= event.end_ms) && (span.second >= event.start_ms)) {
+                float latency_s = (span.first > event.start_ms) ? (span.first - event.start_ms) / 1000.0f : 0.0f;
+                latencies_s->push_back(latency_s);
+                detected = true;
+                if (options.verbose) {
+                    printf("%s: event at %.2f h detected after %.0f s\n", name, event.start_ms / 3.6e6, latency_s);
+                }
+                break;
+            }
+        }
+        result.detected += detected;
+        if (!detected && options.verbose) {
+            printf("%s: event at %.2f h missed\n", name, event.start_ms / 3.6e6);
+        }
+    }
+    for (const auto &span : active) {
+        bool in_an_event = false;
+        for (const traceEvent &event : trace->events) {
+            in_an_event |= (span.first >= event.start_ms) && (span.first <= event.end_ms);
+        }
+        if (!in_an_event && (span.first != 0)) {
+            result.false_triggers++;
+            if (options.verbose) {
+                printf("%s: false trigger at %.2f h\n", name, span.first / 3.6e6);
+            }
+        }
+    }
+
+    // uplinks
+    const std::vector<hostUplink> &uplinks = hostRadioUplinks();
+    for (size_t i = first_uplink; i < uplinks.size(); i++) {
+        result.uplinks++;
+        result.airtime_ms += uplinks[i].time_on_air_ms;
+    }
+    result.wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.ok = true;
+    return result;
+}
+
+static bool writeAll(int fd, const void *data, size_t length) {
+    const uint8_t *at = (const uint8_t *)data;
+    while (length > 0) {
+        ssize_t written = write(fd, at, length);
+        if (written <= 0) {
+            return false;
+        }
+        at += written;
+        length -= written;
+    }
+    return true;
+}
+
+static bool readAll(int fd, void *data, size_t length) {
+    uint8_t *at = (uint8_t *)data;
+    while (length > 0) {
+        ssize_t got = read(fd, at, length);
+        if (got <= 0) {
+            return false;
+        }
+        at += got;
+        length -= got;
+    }
+    return true;
+}
+
+/**
+ * @brief Forks a process that loads & replays the trace, and sends the result & latencies back down a pipe.
+ */
+static bool startJob(replayJob *job) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    fflush(stdout);
+    job->pid = fork();
+    if (job->pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (job->pid == 0) {
+        close(fds[0]);
+        replayResult result = {};
+        std::vector<float> latencies_s;
+        turbidityTrace trace;
+        std::string error;
+        if (trace.load(job->path, &error)) {
+            result = replayTrace(job->path, &trace, job->options, &latencies_s);
+        } else {
+            snprintf(result.error, sizeof(result.error), "%s", error.c_str());
+        }
+        uint32_t count = latencies_s.size();
+        bool sent = writeAll(fds[1], &result, sizeof(result)) && writeAll(fds[1], &count, sizeof(count)) &&
+                    writeAll(fds[1], latencies_s.data(), count * sizeof(float));
+        fflush(stdout);
+        // the firmware's tasks are still blocked, don't unwind them
+        _exit(sent ? 0 : 1);
+    }
+    close(fds[1]);
+    job->fd = fds[0];
+    return true;
+}
+
+static void finishJob(replayJob *job) {
+    uint32_t count = 0;
+    job->result = {};
+    if (!readAll(job->fd, &job->result, sizeof(job->result)) || !readAll(job->fd, &count, sizeof(count))) {
+        snprintf(job->result.error, sizeof(job->result.error), "replay process died");
+        job->result.ok = false;
+    } else {
+        job->latencies_s.resize(count);
+        readAll(job->fd, job->latencies_s.data(), count * sizeof(float));
+    }
+    close(job->fd);
+    waitpid(job->pid, nullptr, 0);
+}
+
+bool replayAll(std::vector<replayJob> *jobs, int parallel) {
+    size_t at_once = (parallel > 0) ? parallel : std::max(1u, std::thread::hardware_concurrency());
+    for (size_t started = 0, finished = 0; finished < jobs->size();) {
+        while ((started < jobs->size()) && (started - finished < at_once)) {
+            if (!startJob(&(*jobs)[started])) {
+                // let the ones running finish
+                while (finished < started) {
+                    finishJob(&(*jobs)[finished++]);
+                }
+                return false;
+            }
+            started++;
+        }
+        finishJob(&(*jobs)[finished++]);
+    }
+    return true;
+}
+
+// OPTIONS
+
+/**
+ * @brief Adds a config TLV, value MSB first.
+ */
+static void addTlv(std::vector<uint8_t> *tlvs, CONFIG_TLV type, uint32_t value, uint8_t length) {
+    tlvs->push_back((uint8_t)type);
+    tlvs->push_back(length);
+    for (int i = length - 1; i >= 0; i--) {
+        tlvs->push_back((uint8_t)(value >> (8 * i)));
+    }
+}
+
+bool replayDeviceOption(const std::string &option, const char *value, replayOptions *options) {
+    deviceConfig *device = &options->device;
+    std::vector<uint8_t> *tlvs = &options->config_tlvs;
+    if (option == "--normal-s") {
+        device->normal_interval_ms = atoi(value) * 1000UL;
+        addTlv(tlvs, CONFIG_TLV::NORMAL_INTERVAL, atoi(value), 2);
+    } else if (option == "--active-s") {
+        device->active_interval_ms = atoi(value) * 1000UL;
+        addTlv(tlvs, CONFIG_TLV::ACTIVE_INTERVAL, atoi(value), 2);
+    } else if (option == "--active-cycles") {
+        device->active_cycles = atoi(value);
+        addTlv(tlvs, CONFIG_TLV::ACTIVE_CYCLES, atoi(value), 1);
+    } else if (option == "--trigger-ntu") {
+        device->trigger_ntu = atoi(value);
+        addTlv(tlvs, CONFIG_TLV::TRIGGER_NTU, atoi(value), 2);
+    } else if (option == "--samples") {
+        device->turbidity_samples = atoi(value);
+        addTlv(tlvs, CONFIG_TLV::TURBIDITY_SAMPLES, atoi(value), 1);
+    } else if (option == "--compression-dntu") {
+        device->compression_dntu = atoi(value);
+        addTlv(tlvs, CONFIG_TLV::COMPRESSION, atoi(value), 2);
+    } else if (option == "--tx-power") {
+        device->tx_power = atoi(value);
+        addTlv(tlvs, CONFIG_TLV::TX_POWER, atoi(value), 1);
+    } else if (option == "--slack-dsigma") {
+        device->detector_slack_dsigma = atoi(value);
+        addTlv(tlvs, CONFIG_TLV::DETECTOR_SLACK, atoi(value), 1);
+    } else if (option == "--threshold-dsigma") {
+        device->detector_threshold_dsigma = atoi(value);
+        addTlv(tlvs, CONFIG_TLV::DETECTOR_THRESHOLD, atoi(value), 1);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char *replayDeviceUsage(void) {
+    return "  --normal-s / --active-s / --active-cycles / --trigger-ntu / --samples / --compression-dntu / --tx-power\n"
+           "  --slack-dsigma / --threshold-dsigma\n"
+           "                        device config, sent as a config downlink (firmware defaults)\n";
+}
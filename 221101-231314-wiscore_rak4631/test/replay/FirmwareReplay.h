@@ -0,0 +1,86 @@
+#pragma once
+/**
+ * @file FirmwareReplay.h
+ * @brief Replays a turbidity trace (TraceFile.h) through the whole firmware (src/main.cpp) on the host HAL, for
+ * trace_replay & energy_bench.
+ *
+ * The trace drives the turbidity pin's ADC while the sensor rail is on, so the readings go through the firmware's own
+ * acquisition, mvToNTU(), the event detector and the mode switching. A lead-in holding the first sample lets the
+ * detector learn the baseline, and the application server answers time requests so readings go on wall clock slots as
+ * in the field. Device settings are set with a config downlink, as they would be in the field.
+ *
+ * A trigger is seen when the firmware switches to the active interval (lorawan_app_interval), at the reading that
+ * triggered. The charge drawn over the trace comes from the HAL's power events through an energyModel.
+ *
+ * The firmware's globals can't be reset, so each trace is replayed in its own forked process.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include "DeviceConfig.h"
+#include "EnergyModel.h"
+#include "TraceFile.h"
+
+#define REPLAY_LEAD_IN_S 3600 /**< Default time the first sample is held before the trace starts. */
+
+/** @brief What a replay is run with. */
+struct replayOptions {
+    uint32_t lead_in_ms = REPLAY_LEAD_IN_S * 1000UL;
+    bool millivolts = false;       // trace values are mV at the pin, not raw counts
+    deviceConfig device = DEFAULT_DEVICE_CONFIG;
+    std::vector<uint8_t> config_tlvs; // the settings that differ from the defaults, as a config downlink
+    energyParams energy;
+    std::string events_path; // if set, the power events over the trace are written here as CSV
+    bool verbose = false;
+};
+
+/** @brief A trace's results, sent back from its process. */
+struct replayResult {
+    bool ok;
+    char error[160];
+    double hours;
+    uint32_t events;
+    uint32_t detected;
+    uint32_t triggers;
+    uint32_t false_triggers;
+    uint32_t uplinks;
+    double airtime_ms;
+    energyReport energy;
+    double wall_s;
+};
+
+/** @brief A trace being replayed in a child process. */
+struct replayJob {
+    const char *path;
+    replayOptions options;
+    pid_t pid = 0;
+    int fd = -1;
+    replayResult result = {};
+    std::vector<float> latencies_s; /**< Detection latency of each detected event. */
+};
+
+/**
+ * @brief Sets a device option (--normal-s, --active-s, --active-cycles, --trigger-ntu, --samples, --compression-dntu,
+ * --tx-power, --slack-dsigma or --threshold-dsigma) in options->device & the config downlink.
+ * @return False if option isn't one of them.
+ */
+bool replayDeviceOption(const std::string &option, const char *value, replayOptions *options);
+
+/**
+ * @brief The device options' usage lines, for a tool's --help.
+ */
+const char *replayDeviceUsage(void);
+
+/**
+ * @brief Replays each job's trace with its options, up to parallel at once (0 = every core), and fills in the results.
+ * @return False if a process couldn't be started.
+ */
+bool replayAll(std::vector<replayJob> *jobs, int parallel);
@@ -0,0 +1,168 @@
+/**
+ * @file TraceFile.cpp
+ * @brief Recorded turbidity traces, see TraceFile.h.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "TraceFile.h"
+
+#define TRACE_HEADER_SIZE 12 /**< Magic, period & event count. */
+#define TRACE_LINE_MAX    256
+
+static void putLe(uint8_t *at, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        at[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t getLe(const uint8_t *at) {
+    return (uint32_t)at[0] | ((uint32_t)at[1] << 8) | ((uint32_t)at[2] << 16) | ((uint32_t)at[3] << 24);
+}
+
+bool turbidityTrace::load(const char *path, std::string *error) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr) {
+        *error = std::string("can't open ") + path;
+        return false;
+    }
+    times.clear();
+    values.clear();
+    events.clear();
+    cursor = 0;
+    char magic[4] = {};
+    bool binary = (fread(magic, 1, sizeof(magic), file) == sizeof(magic)) && !memcmp(magic, TRACE_BINARY_MAGIC, 4);
+    rewind(file);
+    bool loaded = binary ? loadBinary(file, error) : loadCsv(file, error);
+    fclose(file);
+    if (loaded && times.empty()) {
+        *error = std::string(path) + " has no samples";
+        return false;
+    }
+    if (!loaded) {
+        *error = std::string(path) + ": " + *error;
+    }
+    return loaded;
+}
+
+bool turbidityTrace::loadCsv(FILE *file, std::string *error) {
+    char line[TRACE_LINE_MAX];
+    for (uint32_t number = 1; fgets(line, sizeof(line), file) != nullptr; number++) {
+        if (line[0] == '#') {
+            unsigned long long start_ms, end_ms;
+            if ((sscanf(line, "# event %llu %llu", &start_ms, &end_ms) == 2)) {
+                if (end_ms < start_ms) {
+                    *error = "line " + std::to_string(number) + ": event ends before it starts";
+                    return false;
+                }
+                events.push_back({ start_ms, end_ms });
+            }
+            continue;
+        }
+        char *end;
+        unsigned long long time_ms = strtoull(line, &end, 10);
+        if (end == line) {
+            continue; // a header or blank line
+        }
+        if (*end != ',') {
+            *error = "line " + std::to_string(number) + ": expected time_ms,value";
+            return false;
+        }
+        char *value_end;
+        float value = strtof(end + 1, &value_end);
+        if ((value_end == end + 1) || (!times.empty() && (time_ms < times.back()))) {
+            *error = "line " + std::to_string(number) + ": bad value or time going backwards";
+            return false;
+        }
+        add(time_ms, value);
+    }
+    return true;
+}
+
+bool turbidityTrace::loadBinary(FILE *file, std::string *error) {
+    uint8_t header[TRACE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        *error = "truncated header";
+        return false;
+    }
+    uint32_t period_ms = getLe(&header[4]);
+    uint32_t event_count = getLe(&header[8]);
+    if (period_ms == 0) {
+        *error = "zero sample period";
+        return false;
+    }
+    for (uint32_t i = 0; i < event_count; i++) {
+        uint8_t event[8];
+        if (fread(event, 1, sizeof(event), file) != sizeof(event)) {
+            *error = "truncated events";
+            return false;
+        }
+        events.push_back({ getLe(&event[0]), getLe(&event[4]) });
+    }
+    uint8_t sample[2];
+    for (uint64_t time_ms = 0; fread(sample, 1, sizeof(sample), file) == sizeof(sample); time_ms += period_ms) {
+        add(time_ms, (float)(sample[0] | (sample[1] << 8)));
+    }
+    return true;
+}
+
+bool turbidityTrace::saveBinary(const char *path, uint32_t period_ms) const {
+    if ((period_ms == 0) || (durationMs() > UINT32_MAX)) {
+        return false;
+    }
+    for (const traceEvent &event : events) {
+        if (event.end_ms > UINT32_MAX) {
+            return false;
+        }
+    }
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    std::vector<uint8_t> data(TRACE_HEADER_SIZE);
+    memcpy(data.data(), TRACE_BINARY_MAGIC, 4);
+    putLe(&data[4], period_ms);
+    putLe(&data[8], (uint32_t)events.size());
+    for (const traceEvent &event : events) {
+        data.resize(data.size() + 8);
+        putLe(&data[data.size() - 8], (uint32_t)event.start_ms);
+        putLe(&data[data.size() - 4], (uint32_t)event.end_ms);
+    }
+    for (uint64_t time_ms = 0; time_ms <= durationMs(); time_ms += period_ms) {
+        long value = lroundf(valueAt(time_ms));
+        uint16_t sample = (uint16_t)std::min(std::max(value, 0L), 65535L);
+        data.push_back((uint8_t)sample);
+        data.push_back((uint8_t)(sample >> 8));
+    }
+    bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+    return (fclose(file) == 0) && written;
+}
+
+void turbidityTrace::add(uint64_t time_ms, float value) {
+    times.push_back(time_ms);
+    values.push_back(value);
+}
+
+float turbidityTrace::valueAt(uint64_t time_ms) const {
+    if (times.empty()) {
+        return 0.0f;
+    }
+    if ((cursor >= times.size()) || (times[cursor] > time_ms)) {
+        auto after = std::upper_bound(times.begin(), times.end(), time_ms);
+        cursor = (after == times.begin()) ? 0 : (after - times.begin()) - 1;
+    }
+    while ((cursor + 1 < times.size()) && (times[cursor + 1] <= time_ms)) {
+        cursor++;
+    }
+    return values[cursor];
+}
@@ -0,0 +1,75 @@
+#pragma once
+/**
+ * @file TraceFile.h
+ * @brief Recorded turbidity sensor traces for trace_replay.cc: the raw ADC value over time, with the water events in
+ * it labelled. Read from CSV or a compact binary format, and written as binary.
+ *
+ * CSV: a "time_ms,value" line per sample, times ascending. Lines starting with # are comments, except
+ * "# event START_MS END_MS" which labels an event. Other lines that don't start with a number (a header) are skipped.
+ *
+ * Binary (.trc), little endian: "TRC1"[period ms (4)][event count (4)] then [start ms (4)][end ms (4)] per event, then
+ * one uint16_t value per period to the end of the file: 2 bytes a sample, for traces up to 49 days.
+ *
+ * Values are raw turbidity ADC counts (TurbidityLevel: VDD/4 reference, 10 bits) unless the replay is told they're
+ * millivolts at the pin.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#define TRACE_BINARY_MAGIC "TRC1"
+
+/** @brief A labelled event: from when the water changed to when it was back to normal. */
+struct traceEvent {
+    uint64_t start_ms;
+    uint64_t end_ms;
+};
+
+/**
+ * @brief One recorded trace.
+ */
+class turbidityTrace {
+  public:
+    /**
+     * @brief Reads a trace, binary if the file starts with TRACE_BINARY_MAGIC, else CSV.
+     * @return False with a message in error if it can't be read or has no samples.
+     */
+    bool load(const char *path, std::string *error);
+
+    /**
+     * @brief Writes the trace as binary, taking valueAt() every period_ms.
+     * @return False if the file can't be written or the trace is longer than the format takes.
+     */
+    bool saveBinary(const char *path, uint32_t period_ms) const;
+
+    /**
+     * @brief Adds a sample; times must not go backwards.
+     */
+    void add(uint64_t time_ms, float value);
+
+    /**
+     * @brief The value held from the last sample at or before time_ms: the first sample's before the trace starts, the
+     * last one's after it ends.
+     */
+    float valueAt(uint64_t time_ms) const;
+
+    uint64_t durationMs(void) const { return times.empty() ? 0 : times.back(); };
+    size_t samples(void) const { return times.size(); };
+
+    std::vector<traceEvent> events; /**< Labelled events, in trace time. */
+
+  private:
+    bool loadCsv(FILE *file, std::string *error);
+    bool loadBinary(FILE *file, std::string *error);
+
+    std::vector<uint64_t> times;
+    std::vector<float> values;
+    mutable size_t cursor = 0; // valueAt() is mostly called with rising times
+};
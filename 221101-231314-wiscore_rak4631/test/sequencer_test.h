@@ -0,0 +1,104 @@
+#include "../lib/Sequencer/src/Sequencer.h"
+
+// samples every 100 ms, like the turbidity burst
+class sampleBurst : public sequence {
+  public:
+    uint32_t sample_ms[8] = {};
+    uint8_t samples = 0;
+    uint8_t wanted = 0;
+
+  protected:
+    bool body(uint32_t now_ms) override {
+        SEQ_BEGIN();
+        for (samples = 0; samples < wanted; samples++) {
+            sample_ms[samples] = now_ms;
+            SEQ_SLEEP(100);
+        }
+        SEQ_END();
+    }
+};
+
+// warms up, then runs a burst, like an acquisition cycle
+class warmThenSample : public sequence {
+  public:
+    sampleBurst burst;
+    uint32_t done_ms = 0;
+
+  protected:
+    bool body(uint32_t now_ms) override {
+        SEQ_BEGIN();
+        SEQ_SLEEP(5000);
+        burst.wanted = 3;
+        burst.start(now_ms);
+        SEQ_AWAIT(burst);
+        done_ms = now_ms;
+        SEQ_END();
+    }
+};
+
+// waits for a flag set from outside
+class waitForFlag : public sequence {
+  public:
+    bool flag = false;
+    uint32_t seen_ms = 0;
+
+  protected:
+    bool body(uint32_t now_ms) override {
+        SEQ_BEGIN();
+        SEQ_WAIT_UNTIL(flag, 250);
+        seen_ms = now_ms;
+        SEQ_END();
+    }
+};
+
+TEST(SequencerTest, SleepsAndAwaitsOnVirtualClock) {
+    virtualClock clock(1000);
+    sequencer sequences;
+    warmThenSample cycle;
+    sequences.add(&cycle);
+    EXPECT_EQ(sequences.run(clock.nowMs()), SEQUENCER_IDLE);
+
+    cycle.start(clock.nowMs());
+    clock.runFor(&sequences, 60000);
+    EXPECT_FALSE(cycle.running());
+    EXPECT_EQ(cycle.burst.samples, 3);
+    EXPECT_EQ(cycle.burst.sample_ms[0], 6000u);
+    EXPECT_EQ(cycle.burst.sample_ms[1], 6100u);
+    EXPECT_EQ(cycle.burst.sample_ms[2], 6200u);
+    EXPECT_EQ(cycle.done_ms, 6300u);
+    EXPECT_EQ(clock.nowMs(), 61000u);
+
+    // runs again from the top
+    cycle.start(clock.nowMs());
+    clock.runFor(&sequences, 5050);
+    EXPECT_TRUE(cycle.running());
+    EXPECT_EQ(cycle.burst.sample_ms[0], 66000u);
+    EXPECT_EQ(sequences.run(clock.nowMs()), 50u);
+}
+
+TEST(SequencerTest, InterleavesAndWaitsForConditions) {
+    virtualClock clock(0xFFFFF000); // millis() wraps during the test
+    sequencer sequences;
+    sampleBurst burst;
+    waitForFlag waiter;
+    sequences.add(&burst);
+    sequences.add(&waiter);
+    burst.wanted = 8;
+    burst.start(clock.nowMs());
+    waiter.start(clock.nowMs());
+
+    clock.runFor(&sequences, 420);
+    EXPECT_EQ(burst.samples, 4);
+    EXPECT_TRUE(waiter.running());
+    waiter.flag = true;
+    // polled every 250 ms, so seen on the 500 ms poll
+    clock.runFor(&sequences, 1000);
+    EXPECT_FALSE(waiter.running());
+    EXPECT_EQ(waiter.seen_ms, 0xFFFFF000u + 500);
+    EXPECT_FALSE(burst.running());
+    EXPECT_EQ(burst.sample_ms[7], 0xFFFFF000u + 700);
+
+    waiter.start(clock.nowMs());
+    waiter.stop();
+    EXPECT_EQ(sequences.run(clock.nowMs()), SEQUENCER_IDLE);
+}
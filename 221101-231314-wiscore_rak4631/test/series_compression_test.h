@@ -0,0 +1,125 @@
+#include <math.h>
+
+#include "../lib/SeriesCompression/src/SeriesCompression.h"
+
+TEST(SeriesCompressionTest, FlatSeriesNeedsTwoPoints) {
+    swingingDoorCompressor compressor(1.0);
+    for (uint32_t t = 0; t <= 3600; t += 120) {
+        compressor.addReading(t, 12.0);
+    }
+    EXPECT_EQ(compressor.pendingPoints(), 2);
+    EXPECT_FALSE(compressor.frameReady());
+}
+
+TEST(SeriesCompressionTest, ReconstructionWithinErrorBound) {
+    const float error_bound = 2.0;
+    swingingDoorCompressor compressor(error_bound);
+    seriesPoint readings[200];
+    seriesPoint decoded[200];
+    uint16_t n_decoded = 0;
+    uint8_t frame[51];
+
+    for (uint16_t i = 0; i < 200; i++) {
+        // slow drift with a storm event in the middle
+        float value = 20.0 + 0.01 * i + ((i > 80 && i < 140) ? 400.0 * sinf((i - 80) * 3.14159 / 60) : 0);
+        readings[i] = { (uint32_t)i * 60, value };
+        compressor.addReading(readings[i].time_s, value);
+        if (compressor.frameReady()) {
+            uint8_t length = compressor.encodeFrame(frame, sizeof(frame));
+            n_decoded += decodeSeriesFrame(frame, length, &decoded[n_decoded], 200 - n_decoded);
+        }
+    }
+    uint8_t length = compressor.encodeFrame(frame, sizeof(frame));
+    n_decoded += decodeSeriesFrame(frame, length, &decoded[n_decoded], 200 - n_decoded);
+
+    EXPECT_LT(n_decoded, 100);
+    for (uint16_t i = 0; i < 200; i++) {
+        // + the 0.1 resolution of the frame
+        EXPECT_NEAR(reconstructSeries(decoded, n_decoded, readings[i].time_s), readings[i].value,
+                    error_bound + 0.1);
+    }
+}
+
+TEST(SeriesCompressionTest, FrameGoldenVector) {
+    swingingDoorCompressor compressor(0.5);
+    compressor.addReading(1000, 10.0);
+    compressor.addReading(1060, 10.0);
+    compressor.addReading(1120, 50.0);
+    uint8_t frame[51];
+    const uint8_t expected[] = {
+        0x01, 0x03, 0x00, 0x00, 0x03, 0xE8,  // version, 3 points, base time 1000
+        0x00, 0x00, 0x00, 0x64,              // +0 s, 10.0
+        0x00, 0x3C, 0x00, 0x64,              // +60 s, 10.0
+        0x00, 0x3C, 0x01, 0xF4,              // +60 s, 50.0
+    };
+    ASSERT_EQ(compressor.encodeFrame(frame, sizeof(frame)), sizeof(expected));
+    for (uint8_t i = 0; i < sizeof(expected); i++) {
+        EXPECT_EQ(frame[i], expected[i]) << "byte " << (int)i;
+    }
+    // truncated frame
+    seriesPoint points[3];
+    EXPECT_EQ(decodeSeriesFrame(frame, 10, points, 3), 0);
+}
+
+TEST(SeriesCompressionTest, LongGapStartsANewFrame) {
+    swingingDoorCompressor compressor(0.5);
+    compressor.addReading(1000, 10.0);
+    compressor.addReading(1060, 20.0);
+    compressor.addReading(1120, 10.0);
+    // a day without readings is longer than a point's dt can hold
+    compressor.addReading(1120 + 86400, 10.0);
+    EXPECT_TRUE(compressor.frameReady());
+
+    uint8_t frame[51];
+    seriesPoint points[SERIES_MAX_POINTS];
+    uint8_t length = compressor.encodeFrame(frame, sizeof(frame));
+    uint8_t n_points = decodeSeriesFrame(frame, length, points, SERIES_MAX_POINTS);
+    ASSERT_GT(n_points, 0);
+    EXPECT_LE(points[n_points - 1].time_s, 1120u);
+    // the rest go in the next frame, from their own base time
+    length = compressor.encodeFrame(frame, sizeof(frame));
+    ASSERT_EQ(decodeSeriesFrame(frame, length, points, SERIES_MAX_POINTS), 1);
+    EXPECT_EQ(points[0].time_s, 1120u + 86400);
+    EXPECT_FLOAT_EQ(points[0].value, 10.0);
+    EXPECT_EQ(compressor.pendingPoints(), 0);
+}
+
+TEST(SeriesCompressionTest, PointsThatDontFitWaitForTheNextFrame) {
+    swingingDoorCompressor compressor(0.5);
+    for (uint32_t i = 0; i < 8; i++) {
+        compressor.addReading(i * 60, (i % 2) ? 50.0 : 10.0);
+    }
+    uint8_t pending = compressor.pendingPoints();
+    ASSERT_GT(pending, 4);
+    // room for 4 points
+    uint8_t frame[SERIES_FRAME_HEADER + 4 * SERIES_FRAME_POINT];
+    seriesPoint points[SERIES_MAX_POINTS];
+    uint8_t length = compressor.encodeFrame(frame, sizeof(frame));
+    ASSERT_EQ(decodeSeriesFrame(frame, length, points, SERIES_MAX_POINTS), 4);
+    EXPECT_EQ(points[3].time_s, 180u);
+    EXPECT_EQ(compressor.pendingPoints(), pending - 4);
+    length = compressor.encodeFrame(frame, sizeof(frame));
+    ASSERT_GT(decodeSeriesFrame(frame, length, points, SERIES_MAX_POINTS), 0);
+    EXPECT_EQ(points[0].time_s, 240u);
+}
+
+TEST(SeriesCompressionTest, RestoredCompressorCarriesOn) {
+    swingingDoorCompressor compressor(0.5);
+    for (uint32_t i = 0; i < 5; i++) {
+        compressor.addReading(i * 60, (i % 2) ? 50.0 : 10.0);
+    }
+    seriesCompressorState state;
+    compressor.save(&state);
+
+    swingingDoorCompressor restored(0.5);
+    restored.restore(&state);
+    EXPECT_EQ(restored.pendingPoints(), compressor.pendingPoints());
+    compressor.addReading(300, 12.0);
+    restored.addReading(300, 12.0);
+    uint8_t frame[SERIES_FRAME_HEADER + SERIES_MAX_POINTS * SERIES_FRAME_POINT];
+    uint8_t restored_frame[sizeof(frame)];
+    uint8_t length = compressor.encodeFrame(frame, sizeof(frame));
+    ASSERT_GT(length, 0);
+    ASSERT_EQ(restored.encodeFrame(restored_frame, sizeof(restored_frame)), length);
+    EXPECT_EQ(memcmp(frame, restored_frame, length), 0);
+}
@@ -0,0 +1,64 @@
+#include "../lib/SpscRing/src/SpscRing.h"
+
+#include <thread>
+
+TEST(SpscRingTest, FifoAndOverruns) {
+    spscRing<uint32_t, 4> ring;
+    uint32_t value = 0;
+    EXPECT_EQ(ring.capacity(), 3);
+    EXPECT_FALSE(ring.pop(&value));
+    EXPECT_TRUE(ring.push(1));
+    EXPECT_TRUE(ring.push(2));
+    EXPECT_TRUE(ring.push(3));
+    EXPECT_FALSE(ring.push(4));
+    EXPECT_EQ(ring.depth(), 3);
+    EXPECT_TRUE(ring.pop(&value));
+    EXPECT_EQ(value, 1u);
+    EXPECT_TRUE(ring.push(5));
+    EXPECT_TRUE(ring.pop(&value));
+    EXPECT_EQ(value, 2u);
+    EXPECT_TRUE(ring.pop(&value));
+    EXPECT_EQ(value, 3u);
+    EXPECT_TRUE(ring.pop(&value));
+    EXPECT_EQ(value, 5u);
+    EXPECT_FALSE(ring.pop(&value));
+
+    spscRingStats stats;
+    ring.stats(&stats);
+    EXPECT_EQ(stats.depth, 0);
+    EXPECT_EQ(stats.high_water, 3);
+    EXPECT_EQ(stats.pushed, 4u);
+    EXPECT_EQ(stats.overruns, 1u);
+}
+
+TEST(SpscRingTest, TwoThreadsKeepOrder) {
+    struct record {
+        uint32_t sequence;
+        uint32_t check;
+    };
+    static spscRing<record, 8> ring;
+    const uint32_t count = 20000;
+    std::thread producer([&]() {
+        for (uint32_t i = 0; i < count;) {
+            if (ring.push({ i, ~i })) {
+                i++;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    uint32_t expected = 0;
+    bool in_order = true;
+    while (expected < count) {
+        record r;
+        if (ring.pop(&r)) {
+            in_order &= (r.sequence == expected) && (r.check == ~expected);
+            expected++;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    EXPECT_TRUE(in_order);
+    EXPECT_EQ(ring.depth(), 0);
+}
@@ -0,0 +1,74 @@
+#include "replay/TraceFile.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+// writes text to a temporary file, returns its path
+static std::string writeTraceFile(const char *text) {
+    char path[] = "/tmp/trace_file_testXXXXXX";
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        ssize_t written = write(fd, text, strlen(text));
+        (void)written;
+        close(fd);
+    }
+    return path;
+}
+
+TEST(TraceFileTest, CsvWithEventsAndHeader) {
+    std::string path = writeTraceFile("# a comment\n"
+                                      "# event 1000 5000\n"
+                                      "time_ms,raw\n"
+                                      "0,434\n"
+                                      "2000,420\n"
+                                      "4000,400.5\n");
+    turbidityTrace trace;
+    std::string error;
+    ASSERT_TRUE(trace.load(path.c_str(), &error)) << error;
+    EXPECT_EQ(trace.samples(), 3u);
+    EXPECT_EQ(trace.durationMs(), 4000u);
+    ASSERT_EQ(trace.events.size(), 1u);
+    EXPECT_EQ(trace.events[0].start_ms, 1000u);
+    EXPECT_EQ(trace.events[0].end_ms, 5000u);
+    // held from the last sample, in either direction
+    EXPECT_FLOAT_EQ(trace.valueAt(1999), 434.0f);
+    EXPECT_FLOAT_EQ(trace.valueAt(2000), 420.0f);
+    EXPECT_FLOAT_EQ(trace.valueAt(9000), 400.5f);
+    EXPECT_FLOAT_EQ(trace.valueAt(0), 434.0f);
+    remove(path.c_str());
+}
+
+TEST(TraceFileTest, BadCsvIsRefused) {
+    turbidityTrace trace;
+    std::string error;
+    std::string path = writeTraceFile("0,434\n2000,420\n1000,410\n");
+    EXPECT_FALSE(trace.load(path.c_str(), &error));
+    EXPECT_NE(error.find("line 3"), std::string::npos);
+    remove(path.c_str());
+    path = writeTraceFile("time_ms,raw\n");
+    EXPECT_FALSE(trace.load(path.c_str(), &error));
+    remove(path.c_str());
+    EXPECT_FALSE(trace.load("/tmp/no/such/trace.csv", &error));
+}
+
+TEST(TraceFileTest, BinaryRoundTrip) {
+    std::string path = writeTraceFile("# event 60000 120000\n0,434\n30000,433\n90000,300\n180000,430\n");
+    turbidityTrace trace;
+    std::string error;
+    ASSERT_TRUE(trace.load(path.c_str(), &error)) << error;
+    std::string binary = path + ".trc";
+    ASSERT_TRUE(trace.saveBinary(binary.c_str(), 10000));
+
+    turbidityTrace loaded;
+    ASSERT_TRUE(loaded.load(binary.c_str(), &error)) << error;
+    EXPECT_EQ(loaded.samples(), 19u);
+    EXPECT_EQ(loaded.durationMs(), 180000u);
+    ASSERT_EQ(loaded.events.size(), 1u);
+    EXPECT_EQ(loaded.events[0].start_ms, 60000u);
+    EXPECT_EQ(loaded.events[0].end_ms, 120000u);
+    for (uint64_t time_ms = 0; time_ms <= 180000; time_ms += 10000) {
+        EXPECT_FLOAT_EQ(loaded.valueAt(time_ms), trace.valueAt(time_ms)) << time_ms;
+    }
+    remove(path.c_str());
+    remove(binary.c_str());
+}
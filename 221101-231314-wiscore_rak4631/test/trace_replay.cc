@@ -0,0 +1,187 @@
+/**
+ * @file trace_replay.cc
+ * @brief Replays recorded turbidity traces (test/replay/TraceFile.h) through the whole firmware on the host HAL, to
+ * tune sampling & event detection against past events before a change goes near a field device. Not run by ctest
+ * except on the example trace, build the trace_replay target and run it directly (trace_replay --help).
+ *
+ * How a trace is replayed is in replay/FirmwareReplay.h. Per trace it reports:
+ * - Detection latency: from a labelled event's start to the first trigger in it, 0 if active mode was already on.
+ * - Events missed: no active mode in the event.
+ * - False triggers: triggers outside every labelled event.
+ * - Uplinks and their airtime.
+ * - Charge drawn, in mAh/day, and the battery life it gives, from the energy model (energy/EnergyModel.h).
+ *
+ * Each trace is replayed in its own process, --jobs at a time.
+ *
+ * @version 0.1
+ * @date 2022-11-14
+ *
+ * @copyright (c) 2021 Kalina Knight - MIT License
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "FirmwareReplay.h"
+
+/** @brief What the tool is run with, on top of the replay's. */
+struct toolOptions {
+    bool check = false;
+    int jobs = 0;
+    uint32_t convert_period_ms = 0;
+};
+
+static float percentile(std::vector<float> values, float p) {
+    if (values.empty()) {
+        return NAN;
+    }
+    size_t k = (size_t)(p * (values.size() - 1));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+static void printResult(const char *path, const replayResult &result, const std::vector<float> &latencies_s,
+                        const energyParams &params) {
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    double days = result.hours / 24;
+    printf("%-24s %7.1f %6u %6u %7.0f %7.0f %6u %7.2f %7u %8.1f %8.2f %7.0f %8.0f\n", name, result.hours,
+           result.events, result.events - result.detected, percentile(latencies_s, 0.5f),
+           percentile(latencies_s, 1.0f), result.false_triggers, result.false_triggers / days, result.uplinks,
+           result.airtime_ms / 1000, result.energy.mahPerDay(), result.energy.batteryDays(params),
+           result.hours * 3600 / result.wall_s);
+}
+
+static void usage(void) {
+    printf("trace_replay [options] TRACE...\n"
+           "  TRACE                 CSV or binary trace, see test/replay/TraceFile.h\n"
+           "  --mv                  trace values are mV at the pin, not raw ADC counts\n"
+           "  --lead-in-s S         first sample held this long before the trace, for the detector (3600)\n"
+           "%s"
+           "  --jobs N              traces replayed at once, 0 = every core (0)\n"
+           "  --verbose             list each event & false trigger\n"
+           "  --check               exit 1 if an event is missed or there's a false trigger\n"
+           "  --convert PERIOD_MS   write each trace as binary (TRACE.trc) sampled every PERIOD_MS, then exit\n",
+           replayDeviceUsage());
+}
+
+int main(int argc, char **argv) {
+    replayOptions options;
+    toolOptions tool;
+    std::vector<const char *> paths;
+    for (int a = 1; a < argc; a++) {
+        std::string option = argv[a];
+        if ((option == "--help") || (option == "-h")) {
+            usage();
+            return 0;
+        }
+        if (option[0] != '-') {
+            paths.push_back(argv[a]);
+            continue;
+        }
+        if (option == "--mv") {
+            options.millivolts = true;
+            continue;
+        }
+        if (option == "--verbose") {
+            options.verbose = true;
+            continue;
+        }
+        if (option == "--check") {
+            tool.check = true;
+            continue;
+        }
+        if (a + 1 >= argc) {
+            fprintf(stderr, "%s needs a value\n", argv[a]);
+            return 1;
+        }
+        const char *value = argv[++a];
+        if (option == "--lead-in-s") {
+            options.lead_in_ms = atoi(value) * 1000UL;
+        } else if (option == "--jobs") {
+            tool.jobs = atoi(value);
+        } else if (option == "--convert") {
+            tool.convert_period_ms = atoi(value);
+        } else if (!replayDeviceOption(option, value, &options)) {
+            fprintf(stderr, "unknown option %s\n", argv[a - 1]);
+            usage();
+            return 1;
+        }
+    }
+    if (paths.empty()) {
+        usage();
+        return 1;
+    }
+
+    if (tool.convert_period_ms > 0) {
+        for (const char *path : paths) {
+            turbidityTrace trace;
+            std::string error;
+            std::string out = std::string(path) + ".trc";
+            if (!trace.load(path, &error) || !trace.saveBinary(out.c_str(), tool.convert_period_ms)) {
+                fprintf(stderr, "%s\n", error.empty() ? ("can't write " + out).c_str() : error.c_str());
+                return 1;
+            }
+            printf("%s: %zu samples to %s\n", path, trace.samples(), out.c_str());
+        }
+        return 0;
+    }
+
+    std::vector<replayJob> jobs;
+    for (const char *path : paths) {
+        replayJob job;
+        job.path = path;
+        job.options = options;
+        jobs.push_back(job);
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (!replayAll(&jobs, tool.jobs)) {
+        fprintf(stderr, "can't start a replay process\n");
+        return 1;
+    }
+    double wall_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("normal %lu s, active %lu s x %u, detector %.1f / %.1f sigma, trigger %u NTU, %u samples, lead-in %lu s\n",
+           (unsigned long)options.device.normal_interval_ms / 1000,
+           (unsigned long)options.device.active_interval_ms / 1000, options.device.active_cycles,
+           options.device.detector_slack_dsigma / 10.0f, options.device.detector_threshold_dsigma / 10.0f,
+           options.device.trigger_ntu, options.device.turbidity_samples, (unsigned long)options.lead_in_ms / 1000);
+    printf("%-24s %7s %6s %6s %7s %7s %6s %7s %7s %8s %8s %7s %8s\n", "trace", "hours", "events", "missed", "lat50-s",
+           "max-s", "false", "false/d", "uplinks", "air-s", "mAh/d", "life-d", "speedup");
+    replayResult total = {};
+    std::vector<float> latencies_s;
+    bool failed = false;
+    for (replayJob &job : jobs) {
+        if (!job.result.ok) {
+            printf("%s: %s\n", job.path, job.result.error);
+            failed = true;
+            continue;
+        }
+        printResult(job.path, job.result, job.latencies_s, options.energy);
+        total.hours += job.result.hours;
+        total.events += job.result.events;
+        total.detected += job.result.detected;
+        total.false_triggers += job.result.false_triggers;
+        total.uplinks += job.result.uplinks;
+        total.airtime_ms += job.result.airtime_ms;
+        // the total's rate only needs the charge & the time
+        total.energy.duration_ms += job.result.energy.duration_ms;
+        for (size_t state = 0; state < (size_t)ENERGY_STATE::COUNT; state++) {
+            total.energy.charge_uc[state] += job.result.energy.charge_uc[state];
+        }
+        total.wall_s += job.result.wall_s;
+        latencies_s.insert(latencies_s.end(), job.latencies_s.begin(), job.latencies_s.end());
+        failed |= tool.check && ((job.result.detected < job.result.events) || (job.result.false_triggers > 0));
+    }
+    if (jobs.size() > 1) {
+        printResult("total", total, latencies_s, options.energy);
+    }
+    printf("%.1f trace hours in %.2f s\n", total.hours, wall_s);
+    return failed ? 1 : 0;
+}
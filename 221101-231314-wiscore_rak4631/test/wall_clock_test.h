@@ -0,0 +1,77 @@
+#include "../lib/WallClock/src/WallClock.h"
+#include <string.h>
+
+static uint8_t answerFor(const uint8_t *request, uint64_t unix_ms, uint8_t *answer) {
+    uint32_t seconds = (uint32_t)(unix_ms / 1000);
+    uint16_t ms = (uint16_t)(unix_ms % 1000);
+    uint8_t a[CLOCK_SYNC_ANSWER_SIZE] = { CLOCK_SYNC_VERSION, request[1], (uint8_t)(seconds >> 24),
+                                          (uint8_t)(seconds >> 16), (uint8_t)(seconds >> 8), (uint8_t)seconds,
+                                          (uint8_t)(ms >> 8), (uint8_t)ms };
+    memcpy(answer, a, sizeof(a));
+    return sizeof(a);
+}
+
+TEST(WallClockTest, UptimeUntilSyncedThenUnixTime) {
+    wallClock clock;
+    uint32_t local = 0xFFFFF000; // millis() about to wrap
+    EXPECT_FALSE(clock.isSynced());
+    EXPECT_EQ(clock.nowMs(local), 0xFFFFF000ULL);
+    EXPECT_EQ(clock.nowMs(local + 0x2000), 0x100001000ULL);
+    local += 0x2000;
+    EXPECT_EQ(clock.msUntilNextSlot(local, 120000, 5000), 120000u);
+
+    uint8_t request[CLOCK_SYNC_REQUEST_SIZE];
+    uint8_t answer[CLOCK_SYNC_ANSWER_SIZE];
+    EXPECT_TRUE(clock.syncDue(local));
+    EXPECT_EQ(clock.encodeRequest(request, local, 100), CLOCK_SYNC_REQUEST_SIZE);
+    EXPECT_FALSE(clock.syncDue(local + 1000));
+    // wrong token is ignored
+    answerFor(request, 1700000000000ULL, answer);
+    answer[1]++;
+    EXPECT_FALSE(clock.handleAnswer(answer, sizeof(answer)));
+    answerFor(request, 1700000000000ULL, answer);
+    EXPECT_TRUE(clock.handleAnswer(answer, sizeof(answer)));
+    // applied later, the time is carried forward from when the request was received
+    EXPECT_TRUE(clock.applyAnswer(local + 3100));
+    EXPECT_FALSE(clock.applyAnswer(local + 3100));
+    EXPECT_TRUE(clock.isSynced());
+    EXPECT_EQ(clock.nowMs(local + 3100), 1700000003000ULL);
+    EXPECT_EQ(clock.nowSeconds(local + 3100), 1700000003u);
+}
+
+TEST(WallClockTest, EstimatesDriftAndAlignsSlots) {
+    wallClock clock;
+    uint64_t real_ms = 1700000000000ULL;
+    uint32_t local = 1000;
+    clock.sync(real_ms, local);
+
+    // local clock runs 100 ppm fast: after 12 h it's 4.32 s ahead
+    const uint32_t span = CLOCK_SYNC_INTERVAL_MS;
+    local += span + span / 10000;
+    real_ms += span;
+    int64_t correction = clock.sync(real_ms, local);
+    EXPECT_NEAR((double)correction, -4320.0, 1.0);
+    EXPECT_NEAR(clock.driftPpm(), 100.0, 0.1);
+    // the next 12 h need no correction
+    local += span + span / 10000;
+    real_ms += span;
+    EXPECT_NEAR((double)clock.nowMs(local), (double)real_ms, 2.0);
+
+    // woken up 5 s before a 2 min slot, the next wake is 5 s before the one after
+    uint64_t slot = (real_ms / 120000 + 1) * 120000;
+    local += (uint32_t)((slot - 5000 - real_ms) * 1.0001);
+    uint32_t wait = clock.msUntilNextSlot(local, 120000, 5000);
+    EXPECT_NEAR((double)wait, 120000 * 1.0001, 2.0);
+    // woken up a little late it's still the same slot
+    EXPECT_NEAR((double)clock.msUntilNextSlot(local + 300, 120000, 5000), 120000 * 1.0001 - 300, 2.0);
+}
+
+TEST(WallClockTest, NeverGoesBackwards) {
+    wallClock clock;
+    clock.sync(1700000000000ULL, 0);
+    EXPECT_EQ(clock.nowMs(10000), 1700000010000ULL);
+    // a small backwards correction holds the clock rather than going back
+    clock.sync(1700000008000ULL, 10000);
+    EXPECT_EQ(clock.nowMs(10000), 1700000010000ULL);
+    EXPECT_EQ(clock.nowMs(13000), 1700000011000ULL);
+}